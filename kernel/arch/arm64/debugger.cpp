@@ -26,7 +26,7 @@ static constexpr uint64_t kMdscrSSMask = 1;
 static constexpr uint64_t kSSMaskSPSR = (1 << 21);
 
 zx_status_t arch_get_general_regs(struct thread* thread, zx_thread_state_general_regs_t* out) {
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     // Punt if registers aren't available. E.g.,
     // ZX-563 (registers aren't available in synthetic exceptions)
@@ -47,7 +47,7 @@ zx_status_t arch_get_general_regs(struct thread* thread, zx_thread_state_general
 }
 
 zx_status_t arch_set_general_regs(struct thread* thread, const zx_thread_state_general_regs_t* in) {
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     // Punt if registers aren't available. E.g.,
     // ZX-563 (registers aren't available in synthetic exceptions)
@@ -68,7 +68,7 @@ zx_status_t arch_set_general_regs(struct thread* thread, const zx_thread_state_g
 }
 
 zx_status_t arch_get_single_step(struct thread* thread, bool* single_step) {
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     // Punt if registers aren't available. E.g.,
     // ZX-563 (registers aren't available in synthetic exceptions)
@@ -84,7 +84,7 @@ zx_status_t arch_get_single_step(struct thread* thread, bool* single_step) {
 }
 
 zx_status_t arch_set_single_step(struct thread* thread, bool single_step) {
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     // Punt if registers aren't available. E.g.,
     // ZX-563 (registers aren't available in synthetic exceptions)
@@ -114,7 +114,7 @@ zx_status_t arch_set_fp_regs(struct thread* thread, const zx_thread_state_fp_reg
 }
 
 zx_status_t arch_get_vector_regs(struct thread* thread, zx_thread_state_vector_regs* out) {
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     const fpstate* in = &thread->arch.fpstate;
     out->fpcr = in->fpcr;
@@ -128,7 +128,7 @@ zx_status_t arch_get_vector_regs(struct thread* thread, zx_thread_state_vector_r
 }
 
 zx_status_t arch_set_vector_regs(struct thread* thread, const zx_thread_state_vector_regs* in) {
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     fpstate* out = &thread->arch.fpstate;
     out->fpcr = in->fpcr;
@@ -143,7 +143,7 @@ zx_status_t arch_set_vector_regs(struct thread* thread, const zx_thread_state_ve
 
 zx_status_t arch_get_debug_regs(struct thread* thread, zx_thread_state_debug_regs* out) {
     out->hw_bps_count = arm64_hw_breakpoint_count();
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     // The kernel ensures that this state is being kept up to date, so we can safely copy the
     // information over.
@@ -178,7 +178,7 @@ zx_status_t arch_set_debug_regs(struct thread* thread, const zx_thread_state_deb
         return ZX_ERR_INVALID_ARGS;
     }
 
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
     thread->arch.track_debug_state = true;
     thread->arch.debug_state = state;
 
@@ -58,6 +58,9 @@ private:
 
     void FreePageTable(void* vaddr, paddr_t paddr, uint page_size_shift) TA_REQ(lock_);
 
+    zx_status_t SplitLargePage(vaddr_t vaddr, uint index_shift, uint page_size_shift,
+                               vaddr_t pt_index, volatile pte_t* page_table) TA_REQ(lock_);
+
     ssize_t MapPageTable(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
                          paddr_t paddr_in, size_t size_in, pte_t attrs,
                          uint index_shift, uint page_size_shift,
@@ -469,6 +469,56 @@ volatile pte_t* ArmArchVmAspace::GetPageTable(vaddr_t index, uint page_size_shif
     }
 }
 
+// Replace the block mapping at page_table[pt_index], covering |vaddr|, with a
+// table of next level entries mapping the same physical range with the same
+// attributes, so that part of it can be unmapped or protected.
+// NOTE: caller must DSB afterwards to ensure TLB entries are flushed
+zx_status_t ArmArchVmAspace::SplitLargePage(vaddr_t vaddr, uint index_shift, uint page_size_shift,
+                                            vaddr_t pt_index, volatile pte_t* page_table) {
+    const pte_t pte = page_table[pt_index];
+    DEBUG_ASSERT(index_shift > page_size_shift);
+    DEBUG_ASSERT((pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK);
+
+    LTRACEF("vaddr %#" PRIxPTR ", index shift %u, pte %#" PRIx64 "\n", vaddr, index_shift, pte);
+
+    paddr_t paddr;
+    zx_status_t ret = AllocPageTable(&paddr, page_size_shift);
+    if (ret) {
+        TRACEF("failed to allocate page table\n");
+        return ret;
+    }
+
+    const uint next_index_shift = index_shift - (page_size_shift - 3);
+    const size_t next_block_size = 1UL << next_index_shift;
+    const pte_t attrs = pte & ~(MMU_PTE_OUTPUT_ADDR_MASK | MMU_PTE_DESCRIPTOR_MASK);
+    const pte_t desc = (next_index_shift > page_size_shift) ? MMU_PTE_L012_DESCRIPTOR_BLOCK
+                                                            : MMU_PTE_L3_DESCRIPTOR_PAGE;
+    paddr_t block_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
+
+    volatile pte_t* next_page_table = static_cast<volatile pte_t*>(paddr_to_physmap(paddr));
+    const size_t count = 1UL << (page_size_shift - 3);
+    for (size_t i = 0; i < count; i++) {
+        next_page_table[i] = (block_paddr + i * next_block_size) | attrs | desc;
+    }
+
+    // ensure that the new table is observable from hardware page table walkers
+    __dmb(ARM_MB_ISHST);
+
+    // break before make: the block has to be invalidated and flushed from the
+    // TLB before the table replacing it can be installed
+    page_table[pt_index] = MMU_PTE_DESCRIPTOR_INVALID;
+    __dmb(ARM_MB_ISHST);
+    FlushTLBEntry(ROUNDDOWN(vaddr, 1UL << index_shift), true);
+    __dsb(ARM_MB_ISH);
+
+    page_table[pt_index] = paddr | MMU_PTE_L012_DESCRIPTOR_TABLE;
+    __dmb(ARM_MB_ISHST);
+
+    LTRACEF("pte %p[%#" PRIxPTR "] = %#" PRIx64 " (was block)\n",
+            page_table, pt_index, page_table[pt_index]);
+    return ZX_OK;
+}
+
 static bool page_table_is_clear(volatile pte_t* page_table, uint page_size_shift) {
     int i;
     int count = 1U << (page_size_shift - 3);
@@ -539,6 +589,16 @@ ssize_t ArmArchVmAspace::UnmapPageTable(vaddr_t vaddr, vaddr_t vaddr_rel,
 
         pte = page_table[index];
 
+        // Only part of a block mapping is being unmapped, split it first.  If
+        // that fails the whole block is unmapped below and a later page fault
+        // will map the rest back in.
+        if (index_shift > page_size_shift && chunk_size != block_size &&
+            (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK) {
+            if (SplitLargePage(vaddr, index_shift, page_size_shift, index, page_table) == ZX_OK) {
+                pte = page_table[index];
+            }
+        }
+
         if (index_shift > page_size_shift &&
             (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_TABLE) {
             page_table_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
@@ -703,6 +763,16 @@ int ArmArchVmAspace::ProtectPageTable(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
         index = vaddr_rel >> index_shift;
         pte = page_table[index];
 
+        // Only part of a block mapping is being protected, split it first.
+        if (index_shift > page_size_shift && chunk_size != block_size &&
+            (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK) {
+            ret = SplitLargePage(vaddr, index_shift, page_size_shift, index, page_table);
+            if (ret != ZX_OK) {
+                goto err;
+            }
+            pte = page_table[index];
+        }
+
         if (index_shift > page_size_shift &&
             (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_TABLE) {
             page_table_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
@@ -28,6 +28,10 @@ uint arm64_cpu_cpu_ids[SMP_MAX_CPUS] = {0};
 // total number of detected cpus
 uint arm_num_cpus = 1;
 
+// cpu id to the mask of cpus sharing its last level cache, the boot cpu is on
+// its own until arch_init_cpu_map runs
+static cpu_mask_t arm64_cache_sibling_masks[SMP_MAX_CPUS] = {1u};
+
 // per cpu structures, each cpu will point to theirs using the x18 register
 arm64_percpu arm64_percpu_array[SMP_MAX_CPUS];
 
@@ -55,6 +59,15 @@ void arch_init_cpu_map(uint cluster_count, const uint* cluster_cpus) {
         }
     }
     arm_num_cpus = cpu_id;
+
+    // cpus within a cluster share its L2
+    cpu_mask_t cluster_masks[SMP_CPU_MAX_CLUSTERS] = {};
+    for (uint i = 0; i < arm_num_cpus; i++) {
+        cluster_masks[arm64_cpu_cluster_ids[i]] |= cpu_num_to_mask(i);
+    }
+    for (uint i = 0; i < arm_num_cpus; i++) {
+        arm64_cache_sibling_masks[i] = cluster_masks[arm64_cpu_cluster_ids[i]];
+    }
     smp_mb();
 }
 
@@ -79,6 +92,12 @@ zx_status_t arch_mp_reschedule(cpu_mask_t mask) {
     return arch_mp_send_ipi(MP_IPI_TARGET_MASK, mask, MP_IPI_RESCHEDULE);
 }
 
+cpu_mask_t arch_mp_cache_sibling_mask(cpu_num_t cpu_num) {
+    DEBUG_ASSERT(cpu_num < arm_num_cpus);
+
+    return arm64_cache_sibling_masks[cpu_num];
+}
+
 zx_status_t arch_mp_send_ipi(mp_ipi_target_t target, cpu_mask_t mask, mp_ipi_t ipi) {
     LTRACEF("target %d mask %#x, ipi %d\n", target, mask, ipi);
 
@@ -122,7 +122,7 @@ zx_status_t x86_get_set_vector_regs(struct thread* thread, zx_thread_state_vecto
     // Whether to force the components to be marked present in the xsave area.
     bool mark_present = access == RegAccess::kSet;
 
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     constexpr int kNumSSERegs = 16;
 
@@ -201,7 +201,7 @@ zx_status_t x86_get_set_vector_regs(struct thread* thread, zx_thread_state_vecto
 } // namespace
 
 zx_status_t arch_get_general_regs(struct thread* thread, zx_thread_state_general_regs_t* out) {
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     // Punt if registers aren't available. E.g.,
     // ZX-563 (registers aren't available in synthetic exceptions)
@@ -225,7 +225,7 @@ zx_status_t arch_get_general_regs(struct thread* thread, zx_thread_state_general
 }
 
 zx_status_t arch_set_general_regs(struct thread* thread, const zx_thread_state_general_regs_t* in) {
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     // Punt if registers aren't available. E.g.,
     // ZX-563 (registers aren't available in synthetic exceptions)
@@ -259,7 +259,7 @@ zx_status_t arch_set_general_regs(struct thread* thread, const zx_thread_state_g
 }
 
 zx_status_t arch_get_single_step(struct thread* thread, bool* single_step) {
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     // Punt if registers aren't available. E.g.,
     // ZX-563 (registers aren't available in synthetic exceptions)
@@ -284,7 +284,7 @@ zx_status_t arch_get_single_step(struct thread* thread, bool* single_step) {
 }
 
 zx_status_t arch_set_single_step(struct thread* thread, bool single_step) {
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     // Punt if registers aren't available. E.g.,
     // ZX-563 (registers aren't available in synthetic exceptions)
@@ -316,7 +316,7 @@ zx_status_t arch_get_fp_regs(struct thread* thread, zx_thread_state_fp_regs* out
     // Don't leak any reserved fields.
     memset(out, 0, sizeof(zx_thread_state_fp_regs));
 
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     uint32_t comp_size = 0;
     x86_xsave_legacy_area* save = static_cast<x86_xsave_legacy_area*>(
@@ -336,7 +336,7 @@ zx_status_t arch_get_fp_regs(struct thread* thread, zx_thread_state_fp_regs* out
 }
 
 zx_status_t arch_set_fp_regs(struct thread* thread, const zx_thread_state_fp_regs* in) {
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     uint32_t comp_size = 0;
     x86_xsave_legacy_area* save = static_cast<x86_xsave_legacy_area*>(
@@ -376,7 +376,7 @@ static void print_debug_state(const x86_debug_state_t* debug_state) {
 }
 
 zx_status_t arch_get_debug_regs(struct thread* thread, zx_thread_state_debug_regs* out) {
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     // The kernel updates this per-thread data everytime a hw debug event occurs, meaning that
     // these values will be always up to date. If the thread is not using hw debug capabilities,
@@ -392,7 +392,7 @@ zx_status_t arch_get_debug_regs(struct thread* thread, zx_thread_state_debug_reg
 }
 
 zx_status_t arch_set_debug_regs(struct thread* thread, const zx_thread_state_debug_regs* in) {
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     // Replace the state of the thread with the given one. We now need to keep track of the debug
     // state of this register across context switches.
@@ -432,28 +432,28 @@ zx_status_t arch_set_debug_regs(struct thread* thread, const zx_thread_state_deb
 }
 
 zx_status_t arch_get_x86_register_fs(struct thread* thread, uint64_t* out) {
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     *out = thread->arch.fs_base;
     return ZX_OK;
 }
 
 zx_status_t arch_set_x86_register_fs(struct thread* thread, const uint64_t* in) {
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     thread->arch.fs_base = *in;
     return ZX_OK;
 }
 
 zx_status_t arch_get_x86_register_gs(struct thread* thread, uint64_t* out) {
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     *out = thread->arch.gs_base;
     return ZX_OK;
 }
 
 zx_status_t arch_set_x86_register_gs(struct thread* thread, const uint64_t* in) {
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     thread->arch.gs_base = *in;
     return ZX_OK;
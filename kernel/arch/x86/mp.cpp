@@ -37,6 +37,10 @@ struct x86_percpu* ap_percpus;
 uint8_t x86_num_cpus = 1;
 static bool use_monitor = false;
 
+// for each cpu, the mask of cpus sharing its last level cache, filled in once
+// the apic ids of all cpus are known. until then the boot cpu is on its own
+static cpu_mask_t cache_sibling_masks[SMP_MAX_CPUS] = {1u};
+
 extern struct idt _idt;
 
 #if __has_feature(safe_stack)
@@ -75,6 +79,28 @@ struct x86_percpu bp_percpu = {
     .interrupt_stacks = {},
 };
 
+static uint32_t x86_cpu_num_to_apic_id(cpu_num_t cpu_num) {
+    return cpu_num ? ap_percpus[cpu_num - 1].apic_id : bp_percpu.apic_id;
+}
+
+// treat the cpus of a die as sharing the last level cache
+static void x86_init_cache_sibling_masks() {
+    x86_cpu_topology_t topo[SMP_MAX_CPUS];
+    for (cpu_num_t i = 0; i < x86_num_cpus; i++) {
+        x86_cpu_topology_decode(x86_cpu_num_to_apic_id(i), &topo[i]);
+    }
+
+    for (cpu_num_t i = 0; i < x86_num_cpus; i++) {
+        cpu_mask_t mask = 0;
+        for (cpu_num_t j = 0; j < x86_num_cpus; j++) {
+            if (topo[j].package_id == topo[i].package_id && topo[j].node_id == topo[i].node_id) {
+                mask |= cpu_num_to_mask(j);
+            }
+        }
+        cache_sibling_masks[i] = mask;
+    }
+}
+
 zx_status_t x86_allocate_ap_structures(uint32_t* apic_ids, uint8_t cpu_count) {
     ASSERT(ap_percpus == nullptr);
 
@@ -127,6 +153,7 @@ zx_status_t x86_allocate_ap_structures(uint32_t* apic_ids, uint8_t cpu_count) {
     }
 
     x86_num_cpus = cpu_count;
+    x86_init_cache_sibling_masks();
     return ZX_OK;
 }
 
@@ -259,8 +286,6 @@ int x86_apic_id_to_cpu_num(uint32_t apic_id) {
 }
 
 zx_status_t arch_mp_reschedule(cpu_mask_t mask) {
-    DEBUG_ASSERT(thread_lock_held());
-
     cpu_mask_t needs_ipi = 0;
     if (use_monitor) {
         while (mask) {
@@ -271,11 +296,11 @@ zx_status_t arch_mp_reschedule(cpu_mask_t mask) {
             // When a cpu see that it is about to start the idle thread, it sets its own
             // monitor flag. When a cpu is rescheduling another cpu, if it sees the monitor flag
             // set, it can clear the flag to wake up the other cpu w/o an IPI. When the other
-            // cpu wakes up, the idle thread sees the cleared flag and preempts itself. Both of
-            // these operations are under the scheduler lock, so there are no races where the
-            // wrong signal can be sent.
-            uint8_t old_val = *percpu->monitor;
-            *percpu->monitor = 0;
+            // cpu wakes up, the idle thread sees the cleared flag and preempts itself. This
+            // runs after the scheduler lock is dropped, so the other cpu may set or clear its
+            // flag meanwhile; the worst that can happen is an ipi to a cpu that already woke
+            // up, which only reschedules it once more.
+            uint8_t old_val = __atomic_exchange_n(percpu->monitor, 0, __ATOMIC_SEQ_CST);
             if (!old_val) {
                 needs_ipi |= cpu_mask;
             }
@@ -288,6 +313,12 @@ zx_status_t arch_mp_reschedule(cpu_mask_t mask) {
     return needs_ipi ? arch_mp_send_ipi(MP_IPI_TARGET_MASK, needs_ipi, MP_IPI_RESCHEDULE) : ZX_OK;
 }
 
+cpu_mask_t arch_mp_cache_sibling_mask(cpu_num_t cpu_num) {
+    DEBUG_ASSERT(cpu_num < x86_num_cpus);
+
+    return cache_sibling_masks[cpu_num];
+}
+
 void arch_prepare_current_cpu_idle_state(bool idle) {
     DEBUG_ASSERT(thread_lock_held());
 
@@ -9,7 +9,10 @@
 #include <err.h>
 #include <kernel/auto_lock.h>
 #include <kernel/spinlock.h>
+#include <lib/histograms.h>
 #include <lk/init.h>
+#include <platform.h>
+#include <zircon/time.h>
 #include <zircon/types.h>
 
 #define ARM_MAX_INT 1024
@@ -189,8 +192,13 @@ void interrupt_init_percpu() {
     intr_ops->init_percpu();
 }
 
+// time spent in interrupt handlers
+KHISTOGRAM(irq_latency, "kernel.latency.irq");
+
 void platform_irq(iframe* frame) {
+    const zx_time_t start = current_time();
     intr_ops->handle_irq(frame);
+    khistogram_add(irq_latency, zx_time_sub_time(current_time(), start));
 }
 
 void platform_fiq(iframe* frame) {
@@ -18,13 +18,18 @@ __BEGIN_CDECLS
 zx_status_t arch_mp_send_ipi(mp_ipi_target_t, cpu_mask_t mask, mp_ipi_t ipi);
 
 /* Reschedules tasks on the cpus specified by mask. Mask will not
- * contain the local cpu_id. Will be called under the thread lock.
+ * contain the local cpu_id. Called with interrupts disabled, right after
+ * the thread lock is dropped.
  */
 zx_status_t arch_mp_reschedule(cpu_mask_t mask);
 /* Sets the idle state of the current cpu. Will be called under the
  * thread lock. */
 void arch_prepare_current_cpu_idle_state(bool idle);
 
+/* Returns the mask of cpus that share the last level cache with |cpu|,
+ * including |cpu| itself. */
+cpu_mask_t arch_mp_cache_sibling_mask(cpu_num_t cpu);
+
 /* Bring a CPU up and enter it into the scheduler */
 zx_status_t platform_mp_cpu_hotplug(cpu_num_t cpu_id);
 
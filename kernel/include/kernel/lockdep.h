@@ -43,7 +43,7 @@ using lockdep::LockFlagsTrackingDisabled;
 //  LOCK_DEP_SINGLETON_LOCK_WRAPPER(ThreadLock, thread_lock [, LockFlags]);
 //
 //  void DoThreadStuff() {
-//      Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+//      Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
 //      // ...
 //  }
 #define DECLARE_SINGLETON_LOCK_WRAPPER(name, global_lock, ...) \
@@ -18,9 +18,6 @@
 __BEGIN_CDECLS
 
 struct percpu {
-    // per cpu timer queue
-    struct list_node timer_queue;
-
     // per cpu preemption timer; ZX_TIME_INFINITE means not set
     zx_time_t preempt_timer_deadline;
 
@@ -31,6 +28,11 @@ struct percpu {
     struct list_node run_queue[NUM_PRIORITIES];
     uint32_t run_queue_bitmap;
 
+    // threads woken up by other cpus that have yet to be moved into the run
+    // queue, linked through thread_t::wakeup_next; guarded by thread_lock like
+    // the run queue
+    struct thread* wakeup_queue;
+
 #if WITH_LOCK_DEP
     // state for runtime lock validation when in irq context
     lockdep_state_t lock_state;
@@ -45,6 +47,16 @@ struct percpu {
     // kernel counters arena
     int64_t* counters;
 
+    // kernel histograms arena; null until it is set up
+    int64_t* histograms;
+
+    // when this cpu took thread_lock, if kernel.thread-lock-hold-stats is set
+    zx_time_t thread_lock_acquired;
+
+    // cpus to send a reschedule ipi to once this cpu drops thread_lock; see
+    // mp_reschedule()
+    cpu_mask_t reschedule_ipis;
+
     // dpc context
     list_node_t dpc_list;
     event_t dpc_event;
@@ -91,8 +91,13 @@ typedef struct thread {
 
     // active bits
     struct list_node queue_node;
+    // link in a cpu's wakeup queue while waiting to be moved into its run queue
+    struct thread* wakeup_next;
     enum thread_state state;
     zx_time_t last_started_running;
+    // when the thread was last made ready by a wakeup, until it next runs;
+    // 0 otherwise
+    zx_time_t ready_time;
     zx_duration_t remaining_time_slice;
     unsigned int flags;
     unsigned int signals;
@@ -131,6 +136,15 @@ typedef struct thread {
     // are we allowed to be interrupted on the current thing we're blocked/sleeping on
     bool interruptable;
 
+    // set while this thread wakes up a thread it is about to block on, so the
+    // scheduler can hand it this cpu rather than sending it elsewhere. see
+    // AutoHandoffWakeup
+    bool handoff_wakeup;
+    // set along with handoff_wakeup when this thread goes on running instead
+    // of blocking, and yields the cpu to the woken thread at its next
+    // reschedule
+    bool handoff_yield;
+
     // number of mutexes we currently hold
     int mutexes_held;
 
@@ -368,6 +382,14 @@ static inline bool thread_lock_held(void) {
     return spin_lock_held(&thread_lock);
 }
 
+// Acquire and release the thread lock like spin_lock() and spin_unlock(), while
+// counting contended acquisitions and, with kernel.thread-lock-hold-stats, timing
+// each cpu's hold.  |lock| must be &thread_lock and interrupts must be disabled.
+// Guards on ThreadLock get these through the ThreadLockIrqSave and
+// ThreadLockNoIrqSave options; see kernel/thread_lock.h.
+void thread_lock_acquire(spin_lock_t* lock) TA_ACQ(lock);
+void thread_lock_release(spin_lock_t* lock) TA_REL(lock);
+
 // Thread local storage. See tls_slots.h in the object layer above for
 // the current slot usage.
 
@@ -552,4 +574,45 @@ private:
     bool started_ = false;
 };
 
+// AutoHandoffWakeup marks the scope in which the current thread wakes up
+// a thread it is going to wait on right after, typically the server side of
+// a synchronous request.  The first thread woken in the scope is queued to
+// run next on the current cpu with what is left of the current thread's time
+// slice, instead of being sent to another cpu, so that the current thread
+// blocking switches straight to it.  Only use it where the current thread
+// does block right after: the woken thread waits behind it otherwise.
+//
+// With Mode::Yield the current thread goes on running instead, typically a
+// server replying to a synchronous request.  It gives up the rest of its time
+// slice along with the cpu, and is preempted in favour of the woken thread as
+// soon as it can be, such as when the AutoReschedDisable scope around the
+// wakeup ends.
+//
+// Wakeups done by interrupt handlers that run inside the scope are not
+// handed off.
+class AutoHandoffWakeup {
+public:
+    enum class Mode { Block,
+                      Yield };
+
+    explicit AutoHandoffWakeup(Mode mode = Mode::Block) {
+        thread_t* current_thread = get_current_thread();
+        saved_ = current_thread->handoff_wakeup;
+        saved_yield_ = current_thread->handoff_yield;
+        current_thread->handoff_wakeup = true;
+        current_thread->handoff_yield = mode == Mode::Yield;
+    }
+    ~AutoHandoffWakeup() {
+        thread_t* current_thread = get_current_thread();
+        current_thread->handoff_wakeup = saved_;
+        current_thread->handoff_yield = saved_yield_;
+    }
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(AutoHandoffWakeup);
+
+private:
+    bool saved_;
+    bool saved_yield_;
+};
+
 #endif // __cplusplus
@@ -14,8 +14,57 @@
 #pragma once
 
 #include <kernel/lockdep.h>
+#include <kernel/spinlock.h>
 #include <kernel/thread.h>
 
 DECLARE_SINGLETON_LOCK_WRAPPER(ThreadLock, thread_lock,
                                (LockFlagsReportingDisabled |
                                 LockFlagsTrackingDisabled));
+
+// Option tag for acquiring ThreadLock WITHOUT saving irq state.
+struct ThreadLockNoIrqSave {};
+
+// Option tag for acquiring ThreadLock WITH saving irq state.
+struct ThreadLockIrqSave {};
+
+// Lock policies for the thread lock.  These are the spin_lock_t policies with
+// the accounting of thread_lock_acquire() and thread_lock_release() added, so
+// that only the thread lock pays for it.  Use them on ThreadLock only:
+//
+//     Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
+struct ThreadLockNoIrqSavePolicy {
+    // No extra state required when not saving irq state.
+    struct State {};
+
+    static bool Acquire(spin_lock_t* lock, State*) TA_ACQ(lock) {
+        thread_lock_acquire(lock);
+        return true;
+    }
+    static void Release(spin_lock_t* lock, State*) TA_REL(lock) {
+        thread_lock_release(lock);
+    }
+};
+
+struct ThreadLockIrqSavePolicy {
+    // State and flags required to save irq state, as for IrqSave.
+    struct State {
+        State(spin_lock_save_flags_t flags = SPIN_LOCK_FLAG_INTERRUPTS)
+            : flags{flags} {}
+
+        spin_lock_save_flags_t flags;
+        spin_lock_saved_state_t state;
+    };
+
+    static bool Acquire(spin_lock_t* lock, State* state) TA_ACQ(lock) {
+        arch_interrupt_save(&state->state, state->flags);
+        thread_lock_acquire(lock);
+        return true;
+    }
+    static void Release(spin_lock_t* lock, State* state) TA_REL(lock) {
+        thread_lock_release(lock);
+        arch_interrupt_restore(state->state, state->flags);
+    }
+};
+
+LOCK_DEP_POLICY_OPTION(spin_lock_t, ThreadLockNoIrqSave, ThreadLockNoIrqSavePolicy);
+LOCK_DEP_POLICY_OPTION(spin_lock_t, ThreadLockIrqSave, ThreadLockIrqSavePolicy);
@@ -7,9 +7,9 @@
 
 #pragma once
 
+#include <fbl/intrusive_wavl_tree.h>
 #include <kernel/spinlock.h>
 #include <kernel/timer_slack.h>
-#include <list.h>
 #include <sys/types.h>
 #include <zircon/compiler.h>
 #include <zircon/types.h>
@@ -25,7 +25,11 @@ typedef void (*timer_callback)(struct timer*, zx_time_t now, void* arg);
 
 typedef struct timer {
     int magic;
-    struct list_node node;
+    // link in the timer queue of cpu |queue_cpu|, which orders timers by
+    // scheduled_time and then by |queue_seq|, the order they were queued in
+    fbl::WAVLTreeNodeState<struct timer*> node;
+    uint queue_cpu;
+    uint64_t queue_seq;
 
     zx_time_t scheduled_time;
     zx_duration_t slack; // Stores the applied slack adjustment from
@@ -40,7 +44,9 @@ typedef struct timer {
 #define TIMER_INITIAL_VALUE(t)              \
     {                                       \
         .magic = TIMER_MAGIC,               \
-        .node = LIST_INITIAL_CLEARED_VALUE, \
+        .node = {},                         \
+        .queue_cpu = 0,                     \
+        .queue_seq = 0,                     \
         .scheduled_time = 0,                \
         .slack = 0,                         \
         .callback = NULL,                   \
@@ -74,7 +74,7 @@ static zx_status_t event_wait_worker(event_t* e,
     DEBUG_ASSERT(e->magic == EVENT_MAGIC);
     DEBUG_ASSERT(!arch_blocking_disallowed());
 
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
 
     current_thread->interruptable = interruptable;
 
@@ -202,7 +202,7 @@ static int event_signal_internal(event_t* e, bool reschedule,
  * @return  Returns the number of threads that have been unblocked.
  */
 int event_signal_etc(event_t* e, bool reschedule, zx_status_t wait_result) {
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
     return event_signal_internal(e, reschedule, wait_result);
 }
 
@@ -224,7 +224,7 @@ int event_signal_etc(event_t* e, bool reschedule, zx_status_t wait_result) {
  * @return  Returns the number of threads that have been unblocked.
  */
 int event_signal(event_t* e, bool reschedule) {
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
     return event_signal_internal(e, reschedule, ZX_OK);
 }
 
@@ -20,6 +20,7 @@
 #include <kernel/event.h>
 #include <kernel/mp.h>
 #include <kernel/mutex.h>
+#include <kernel/percpu.h>
 #include <kernel/sched.h>
 #include <kernel/spinlock.h>
 #include <kernel/stats.h>
@@ -54,7 +55,7 @@ void mp_prepare_current_cpu_idle_state(bool idle) {
 
 void mp_reschedule(cpu_mask_t mask, uint flags) {
     // we must be holding the thread lock to access some of the cpu
-    // state bitmaps and some arch_mp_reschedule implementations.
+    // state bitmaps, and so that the ipis below are sent on its release.
     DEBUG_ASSERT(thread_lock_held());
 
     const cpu_num_t local_cpu = arch_curr_cpu_num();
@@ -77,7 +78,11 @@ void mp_reschedule(cpu_mask_t mask, uint flags) {
         return;
     }
 
-    arch_mp_reschedule(mask);
+    // Send the ipis once the thread lock is dropped rather than while holding
+    // it: the other cpus need the lock to reschedule anyway, and a wakeup storm
+    // would otherwise send an ipi per woken thread inside the critical section.
+    // thread_lock_release() sends them.
+    get_local_percpu()->reschedule_ipis |= mask;
 }
 
 void mp_interrupt(mp_ipi_target_t target, cpu_mask_t mask) {
@@ -241,7 +246,7 @@ static void mp_unplug_trampoline(void) {
 
     // do *not* enable interrupts, we want this CPU to never receive another
     // interrupt
-    spin_unlock(&thread_lock);
+    thread_lock_release(&thread_lock);
 
     // Stop and then shutdown this CPU's platform timer.
     platform_stop_timer();
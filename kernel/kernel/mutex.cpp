@@ -87,7 +87,7 @@ retry:
 
     {
         // we contended with someone else, will probably need to block
-        Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+        Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
 
         // save the current state and check to see if it wasn't released in the interim
         oldval = mutex_val(m);
@@ -140,7 +140,8 @@ static inline void mutex_release_internal(mutex_t* m, bool reschedule, bool thre
         if (unlikely(ct->inherited_priority >= 0) && ct->mutexes_held == 0) {
             spin_lock_saved_state_t state;
             if (!thread_lock_held) {
-                spin_lock_irqsave(&thread_lock, state);
+                arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+                thread_lock_acquire(&thread_lock);
             }
 
             bool local_resched = false;
@@ -150,7 +151,8 @@ static inline void mutex_release_internal(mutex_t* m, bool reschedule, bool thre
             }
 
             if (!thread_lock_held) {
-                spin_unlock_irqrestore(&thread_lock, state);
+                thread_lock_release(&thread_lock);
+                arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
             }
         }
         return;
@@ -173,7 +175,8 @@ static inline void mutex_release_internal(mutex_t* m, bool reschedule, bool thre
     // the state variable needs to exit in either path.
     spin_lock_saved_state_t state;
     if (!thread_lock_held) {
-        spin_lock_irqsave(&thread_lock, state);
+        arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+        thread_lock_acquire(&thread_lock);
     }
 
     // release a thread in the wait queue
@@ -205,7 +208,8 @@ static inline void mutex_release_internal(mutex_t* m, bool reschedule, bool thre
 
     // conditionally THREAD_UNLOCK
     if (!thread_lock_held) {
-        spin_unlock_irqrestore(&thread_lock, state);
+        thread_lock_release(&thread_lock);
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
     }
 }
 
@@ -6,15 +6,20 @@
 // https://opensource.org/licenses/MIT
 #include <kernel/sched.h>
 
+#include <arch/mp.h>
 #include <assert.h>
 #include <debug.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/cmdline.h>
 #include <kernel/mp.h>
 #include <kernel/percpu.h>
 #include <kernel/thread.h>
+#include <lib/counters.h>
+#include <lib/histograms.h>
 #include <lib/ktrace.h>
 #include <list.h>
+#include <lk/init.h>
 #include <platform.h>
 #include <printf.h>
 #include <string.h>
@@ -53,6 +58,38 @@
 // threads get 10ms to run before they use up their time slice and the scheduler is invoked
 #define THREAD_INITIAL_TIME_SLICE ZX_MSEC(10)
 
+KCOUNTER(sched_remote_wakeup, "kernel.sched.remote_wakeup");
+KCOUNTER(sched_wakeup_queue_drain, "kernel.sched.wakeup_queue_drain");
+KCOUNTER(sched_migrate_count, "kernel.sched.migrate");
+KCOUNTER(sched_steal_sibling, "kernel.sched.steal.sibling");
+KCOUNTER(sched_steal_remote, "kernel.sched.steal.remote");
+KCOUNTER(sched_handoff, "kernel.sched.handoff");
+
+// time from a thread being woken up to it running
+KHISTOGRAM(sched_wakeup_latency, "kernel.latency.sched.wakeup");
+
+// when set, threads woken up for another cpu are handed over through that
+// cpu's wakeup queue instead of being put into its run queue directly; see
+// kernel.sched.wakeup-queue. both sides still hold thread_lock: the queue only
+// keeps the waker off the other cpu's run queue and bitmap cache lines.
+static bool wakeup_queue_enabled = true;
+
+// when set, a cpu about to go idle first tries to pull a ready thread from a
+// busy cpu; see kernel.sched.idle-steal
+static bool idle_steal_enabled = true;
+
+// when set, wakeups inside an AutoHandoffWakeup scope queue the woken thread
+// to run next on the waking cpu; see kernel.sched.handoff
+static bool handoff_enabled = true;
+
+static void sched_options_init(uint level) {
+    wakeup_queue_enabled = cmdline_get_bool("kernel.sched.wakeup-queue", true);
+    idle_steal_enabled = cmdline_get_bool("kernel.sched.idle-steal", true);
+    handoff_enabled = cmdline_get_bool("kernel.sched.handoff", true);
+}
+
+LK_INIT_HOOK(sched_options, sched_options_init, LK_INIT_LEVEL_KERNEL);
+
 static bool local_migrate_if_needed(thread_t* curr_thread);
 
 // compute the effective priority of a thread
@@ -233,6 +270,59 @@ static void insert_in_run_queue_tail(cpu_num_t cpu, thread_t* t) TA_REQ(thread_l
     mp_set_cpu_busy(cpu);
 }
 
+// hand a thread woken up on this cpu over to another cpu without touching
+// that cpu's run queue. the other cpu moves it into its run queue the next
+// time it reschedules, see drain_wakeup_queue().
+static void queue_remote_wakeup(cpu_num_t cpu, thread_t* t) TA_REQ(thread_lock) {
+    DEBUG_ASSERT(!list_in_list(&t->queue_node));
+    DEBUG_ASSERT(t->curr_cpu == cpu);
+
+    struct percpu* c = &percpu[cpu];
+    t->wakeup_next = c->wakeup_queue;
+    c->wakeup_queue = t;
+
+    // the cpu is busy as far as anyone else is concerned
+    mp_set_cpu_busy(cpu);
+
+    kcounter_add(sched_remote_wakeup, 1);
+}
+
+// move all of the threads other cpus queued up for |cpu| into its run queue.
+// must be done before looking for a READY thread assigned to |cpu|.
+static void drain_wakeup_queue(cpu_num_t cpu) TA_REQ(thread_lock) {
+    struct percpu* c = &percpu[cpu];
+    if (likely(c->wakeup_queue == nullptr)) {
+        return;
+    }
+
+    thread_t* t = c->wakeup_queue;
+    c->wakeup_queue = nullptr;
+
+    // the queue is built up newest first, reverse it to preserve wakeup order
+    thread_t* list = nullptr;
+    while (t) {
+        thread_t* next = t->wakeup_next;
+        t->wakeup_next = list;
+        list = t;
+        t = next;
+    }
+
+    while ((t = list) != nullptr) {
+        list = t->wakeup_next;
+        t->wakeup_next = nullptr;
+
+        DEBUG_ASSERT(t->state == THREAD_READY);
+        DEBUG_ASSERT(t->curr_cpu == cpu);
+        if (t->remaining_time_slice > 0) {
+            insert_in_run_queue_head(cpu, t);
+        } else {
+            insert_in_run_queue_tail(cpu, t);
+        }
+    }
+
+    kcounter_add(sched_wakeup_queue_drain, 1);
+}
+
 // remove the thread from the run queue it's in
 static void remove_from_run_queue(thread_t* t, int prio_queue) TA_REQ(thread_lock) {
     DEBUG_ASSERT(t->state == THREAD_READY);
@@ -247,10 +337,14 @@ static void remove_from_run_queue(thread_t* t, int prio_queue) TA_REQ(thread_loc
     }
 }
 
+// find the highest priority queue set in a run queue bitmap
+static uint highest_queue_in(uint32_t bitmap) {
+    return HIGHEST_PRIORITY - __builtin_clz(bitmap) - (sizeof(bitmap) * CHAR_BIT - NUM_PRIORITIES);
+}
+
 // using the per cpu run queue bitmap, find the highest populated queue
 static uint highest_run_queue(const struct percpu* c) TA_REQ(thread_lock) {
-    return HIGHEST_PRIORITY - __builtin_clz(c->run_queue_bitmap) -
-           (sizeof(c->run_queue_bitmap) * CHAR_BIT - NUM_PRIORITIES);
+    return highest_queue_in(c->run_queue_bitmap);
 }
 
 static thread_t* sched_get_top_thread(cpu_num_t cpu) TA_REQ(thread_lock) {
@@ -282,6 +376,72 @@ static thread_t* sched_get_top_thread(cpu_num_t cpu) TA_REQ(thread_lock) {
     return &c->idle_thread;
 }
 
+// pull the highest priority ready thread that may run on |cpu| out of
+// |victim|'s run queue, or return nullptr if there is none
+static thread_t* steal_from_cpu(cpu_num_t cpu, cpu_num_t victim) TA_REQ(thread_lock) {
+    struct percpu* c = &percpu[victim];
+    const cpu_mask_t cpu_mask = cpu_num_to_mask(cpu);
+
+    uint32_t bitmap = c->run_queue_bitmap;
+    while (bitmap) {
+        uint queue = highest_queue_in(bitmap);
+        bitmap &= ~(1u << queue);
+
+        thread_t* t;
+        list_for_every_entry (&c->run_queue[queue], t, thread_t, queue_node) {
+            if (!(t->cpu_affinity & cpu_mask)) {
+                continue;
+            }
+            DEBUG_ASSERT(t->state == THREAD_READY);
+            DEBUG_ASSERT(t->curr_cpu == victim);
+
+            list_delete(&t->queue_node);
+            if (list_is_empty(&c->run_queue[queue])) {
+                c->run_queue_bitmap &= ~(1u << queue);
+            }
+            t->curr_cpu = cpu;
+            return t;
+        }
+    }
+    return nullptr;
+}
+
+// called by a cpu with nothing left in its own run queue. look for ready work
+// queued up behind the running thread of a busy cpu, trying the cpus that
+// share our last level cache before the rest of the system.
+static thread_t* sched_steal_thread(cpu_num_t cpu) TA_REQ(thread_lock) {
+    if (!idle_steal_enabled || !mp_is_cpu_active(cpu)) {
+        return nullptr;
+    }
+
+    cpu_mask_t busy = mp_get_active_mask() & ~mp_get_idle_mask() & ~cpu_num_to_mask(cpu);
+    if (busy == 0) {
+        return nullptr;
+    }
+
+    const cpu_mask_t siblings = busy & arch_mp_cache_sibling_mask(cpu);
+    const cpu_mask_t groups[] = {siblings, busy & ~siblings};
+    for (cpu_mask_t mask : groups) {
+        while (mask) {
+            cpu_num_t victim = lowest_cpu_set(mask);
+            mask &= ~cpu_num_to_mask(victim);
+
+            thread_t* t = steal_from_cpu(cpu, victim);
+            if (t) {
+                LOCAL_KTRACE2("sched_steal", (uint32_t)t->user_tid, victim);
+                if (siblings & cpu_num_to_mask(victim)) {
+                    kcounter_add(sched_steal_sibling, 1);
+                } else {
+                    kcounter_add(sched_steal_remote, 1);
+                }
+                kcounter_add(sched_migrate_count, 1);
+                return t;
+            }
+        }
+    }
+    return nullptr;
+}
+
 void sched_init_thread(thread_t* t, int priority) {
     t->base_priority = priority;
     t->priority_boost = 0;
@@ -303,10 +463,65 @@ void sched_block() {
     sched_resched_internal();
 }
 
+// if the current thread is handing its cpu off, see AutoHandoffWakeup, put |t| at the front of
+// the local run queue with the rest of the current thread's time slice. the current thread is
+// about to block, so there is no need to reschedule for it, unless it is yielding instead: then
+// it gives up all of its time slice and sets |local_resched| so that it is switched out.
+//
+// a wakeup from an interrupt handler that lands inside the scope is not the current thread's
+// to hand off: the thread is not about to block or yield, and can't from interrupt context anyway.
+static bool try_handoff(thread_t* t, bool* local_resched) TA_REQ(thread_lock) {
+    thread_t* current_thread = get_current_thread();
+    const cpu_num_t curr_cpu = arch_curr_cpu_num();
+
+    if (!handoff_enabled || !current_thread->handoff_wakeup || arch_blocking_disallowed() ||
+        !(t->cpu_affinity & cpu_num_to_mask(curr_cpu))) {
+        return false;
+    }
+
+    // only the first thread woken gets the cpu
+    current_thread->handoff_wakeup = false;
+    kcounter_add(sched_handoff, 1);
+
+    zx_duration_t used = zx_time_sub_time(current_time(), current_thread->last_started_running);
+    zx_duration_t left = zx_duration_sub_duration(
+        current_thread->remaining_time_slice, MIN(used, current_thread->remaining_time_slice));
+    if (t->remaining_time_slice < left) {
+        // the time moves rather than being copied: charge what |t| gains to the current thread,
+        // which is then switched out as if it had used it
+        current_thread->remaining_time_slice = zx_duration_sub_duration(
+            current_thread->remaining_time_slice,
+            zx_duration_sub_duration(left, t->remaining_time_slice));
+        t->remaining_time_slice = left;
+    }
+
+    // a yielding thread goes to the back of the run queue behind |t|
+    if (current_thread->handoff_yield) {
+        current_thread->remaining_time_slice = 0;
+        *local_resched = true;
+    }
+
+    if (t->last_cpu != INVALID_CPU && t->last_cpu != curr_cpu) {
+        kcounter_add(sched_migrate_count, 1);
+    }
+
+    t->curr_cpu = curr_cpu;
+    if (t->remaining_time_slice > 0) {
+        insert_in_run_queue_head(curr_cpu, t);
+    } else {
+        insert_in_run_queue_tail(curr_cpu, t);
+    }
+    return true;
+}
+
 // find a cpu to run the thread on, put it in the run queue for that cpu, and accumulate a list
 // of cpus we'll need to reschedule, including the local cpu.
 static void find_cpu_and_insert(thread_t* t, bool* local_resched,
                                 cpu_mask_t* accum_cpu_mask) TA_REQ(thread_lock) {
+    if (try_handoff(t, local_resched)) {
+        return;
+    }
+
     // find a core to run it on
     cpu_mask_t cpu = find_cpu_mask(t);
     cpu_num_t cpu_num;
@@ -320,8 +535,14 @@ static void find_cpu_and_insert(thread_t* t, bool* local_resched,
         *accum_cpu_mask |= cpu_num_to_mask(cpu_num);
     }
 
+    if (t->last_cpu != INVALID_CPU && t->last_cpu != cpu_num) {
+        kcounter_add(sched_migrate_count, 1);
+    }
+
     t->curr_cpu = cpu_num;
-    if (t->remaining_time_slice > 0) {
+    if (wakeup_queue_enabled && cpu_num != arch_curr_cpu_num()) {
+        queue_remote_wakeup(cpu_num, t);
+    } else if (t->remaining_time_slice > 0) {
         insert_in_run_queue_head(cpu_num, t);
     } else {
         insert_in_run_queue_tail(cpu_num, t);
@@ -340,6 +561,7 @@ bool sched_unblock(thread_t* t) {
 
     // stuff the new thread in the run queue
     t->state = THREAD_READY;
+    t->ready_time = current_time();
 
     bool local_resched = false;
     cpu_mask_t mask = 0;
@@ -360,6 +582,7 @@ bool sched_unblock_list(struct list_node* list) {
     // pop the list of threads and shove into the scheduler
     bool local_resched = false;
     cpu_mask_t accum_cpu_mask = 0;
+    const zx_time_t now = current_time();
     thread_t* t;
     while ((t = list_remove_tail_type(list, thread_t, queue_node))) {
         DEBUG_ASSERT(t->magic == THREAD_MAGIC);
@@ -370,6 +593,7 @@ bool sched_unblock_list(struct list_node* list) {
 
         // stuff the new thread in the run queue
         t->state = THREAD_READY;
+        t->ready_time = now;
         find_cpu_and_insert(t, &local_resched, &accum_cpu_mask);
     }
 
@@ -514,6 +738,9 @@ void sched_transition_off_cpu(cpu_num_t old_cpu) {
     // Ensure we do not get scheduled on anymore.
     mp_set_curr_cpu_active(false);
 
+    // Pick up anything other cpus handed us before we went inactive.
+    drain_wakeup_queue(old_cpu);
+
     thread_t* t;
     bool local_resched = false;
     cpu_mask_t accum_cpu_mask = 0;
@@ -589,6 +816,7 @@ void sched_migrate(thread_t* t) {
         }
 
         // it's sitting in a run queue somewhere, so pull it out of that one and find a new home
+        drain_wakeup_queue(t->curr_cpu);
         DEBUG_ASSERT_MSG(list_in_list(&t->queue_node), "thread %p name %s curr_cpu %u\n", t, t->name, t->curr_cpu);
         remove_from_run_queue(t, t->effec_priority);
 
@@ -626,6 +854,7 @@ static void sched_priority_changed(thread_t* t, int old_prio,
         break;
     case THREAD_READY:
         // it's sitting in a run queue somewhere, remove and add back to the proper queue on that cpu
+        drain_wakeup_queue(t->curr_cpu);
         DEBUG_ASSERT_MSG(list_in_list(&t->queue_node), "thread %p name %s curr_cpu %u\n", t, t->name, t->curr_cpu);
         remove_from_run_queue(t, old_prio);
 
@@ -787,8 +1016,17 @@ void sched_resched_internal() {
 
     CPU_STATS_INC(reschedules);
 
-    // pick a new thread to run
+    // take in the threads other cpus have woken up for us
+    drain_wakeup_queue(cpu);
+
+    // pick a new thread to run, looking for work elsewhere before going idle
     thread_t* newthread = sched_get_top_thread(cpu);
+    if (thread_is_idle(newthread)) {
+        thread_t* stolen = sched_steal_thread(cpu);
+        if (stolen) {
+            newthread = stolen;
+        }
+    }
 
     DEBUG_ASSERT(newthread);
 
@@ -804,6 +1042,13 @@ void sched_resched_internal() {
     // core rescheduled us but the work disappeared before we got to run.
     mp_prepare_current_cpu_idle_state(thread_is_idle(newthread));
 
+    // a thread that was woken up is running now, even if it never stopped
+    if (newthread->ready_time != 0) {
+        khistogram_add(sched_wakeup_latency,
+                       zx_time_sub_time(current_time(), newthread->ready_time));
+        newthread->ready_time = 0;
+    }
+
     // if it's the same thread as we're already running, exit
     if (newthread == oldthread) {
         return;
@@ -900,8 +1145,10 @@ void sched_resched_internal() {
 
 void sched_init_early() {
     // initialize the run queues
-    for (unsigned int cpu = 0; cpu < SMP_MAX_CPUS; cpu++)
+    for (unsigned int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
         for (unsigned int i = 0; i < NUM_PRIORITIES; i++) {
             list_initialize(&percpu[cpu].run_queue[i]);
         }
+        percpu[cpu].wakeup_queue = nullptr;
+    }
 }
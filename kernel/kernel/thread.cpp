@@ -17,6 +17,7 @@
 #include <kernel/thread.h>
 
 #include <arch/exception.h>
+#include <arch/mp.h>
 #include <assert.h>
 #include <debug.h>
 #include <err.h>
@@ -33,9 +34,12 @@
 #include <kernel/thread_lock.h>
 #include <kernel/timer.h>
 
+#include <kernel/cmdline.h>
 #include <lib/counters.h>
 #include <lib/heap.h>
+#include <lib/histograms.h>
 #include <lib/ktrace.h>
+#include <lk/init.h>
 
 #include <list.h>
 #include <malloc.h>
@@ -72,6 +76,59 @@ static struct list_node thread_list = LIST_INITIAL_VALUE(thread_list);
 // master thread spinlock
 spin_lock_t thread_lock __CPU_ALIGN_EXCLUSIVE = SPIN_LOCK_INITIAL_VALUE;
 
+// counts the acquisitions of thread_lock that had to spin
+KCOUNTER(thread_lock_contended, "kernel.thread_lock.contended");
+// time spent spinning on thread_lock when contended
+KHISTOGRAM(thread_lock_wait, "kernel.latency.thread_lock.wait");
+// time thread_lock is held, when kernel.thread-lock-hold-stats is set
+KHISTOGRAM(thread_lock_hold, "kernel.latency.thread_lock.hold");
+
+// timing every hold costs two clock reads per acquisition, so it is off
+// unless asked for
+static bool thread_lock_hold_stats = false;
+
+static void thread_lock_stats_init(uint level) {
+    thread_lock_hold_stats = cmdline_get_bool("kernel.thread-lock-hold-stats", false);
+}
+
+LK_INIT_HOOK(thread_lock_stats, thread_lock_stats_init, LK_INIT_LEVEL_KERNEL);
+
+// The thread lock is held by a cpu rather than a thread: it is routinely
+// acquired by one thread and released by another after a context switch.
+// So the hold time is tracked per cpu.  Acquisitions that bypass
+// thread_lock_acquire() leave no start time and are not counted.
+void thread_lock_acquire(spin_lock_t* lock) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(lock == &thread_lock);
+    if (unlikely(spin_trylock(lock))) {
+        const zx_time_t start = current_time();
+        spin_lock(lock);
+        kcounter_add(thread_lock_contended, 1);
+        khistogram_add(thread_lock_wait, zx_time_sub_time(current_time(), start));
+    }
+    if (unlikely(thread_lock_hold_stats)) {
+        get_local_percpu()->thread_lock_acquired = current_time();
+    }
+}
+
+void thread_lock_release(spin_lock_t* lock) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(lock == &thread_lock);
+    struct percpu* c = get_local_percpu();
+    if (unlikely(thread_lock_hold_stats) && c->thread_lock_acquired != 0) {
+        khistogram_add(thread_lock_hold,
+                       zx_time_sub_time(current_time(), c->thread_lock_acquired));
+        c->thread_lock_acquired = 0;
+    }
+    spin_unlock(lock);
+
+    // send the reschedule ipis mp_reschedule() held back; interrupts are still
+    // disabled, so this is still the cpu that queued them
+    if (unlikely(c->reschedule_ipis != 0)) {
+        const cpu_mask_t mask = c->reschedule_ipis;
+        c->reschedule_ipis = 0;
+        arch_mp_reschedule(mask);
+    }
+}
+
 // local routines
 static void thread_exit_locked(thread_t* current_thread, int retcode) __NO_RETURN;
 static void thread_do_suspend(void);
@@ -96,7 +153,7 @@ static void initial_thread_func(void) {
     int ret;
 
     // release the thread lock that was implicitly held across the reschedule
-    spin_unlock(&thread_lock);
+    thread_lock_release(&thread_lock);
     arch_enable_ints();
 
     thread_t* ct = get_current_thread();
@@ -200,7 +257,7 @@ thread_t* thread_create_etc(
 
     // add it to the global thread list
     {
-        Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+        Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
         list_add_head(&thread_list, &t->thread_list_node);
     }
 
@@ -250,7 +307,7 @@ zx_status_t thread_set_real_time(thread_t* t) {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
 
     {
-        Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+        Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
         if (t == get_current_thread()) {
             // if we're currently running, cancel the preemption timer.
             timer_preempt_cancel();
@@ -280,7 +337,7 @@ void thread_resume(thread_t* t) {
     }
 
     {
-        Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+        Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
 
         if (t->state == THREAD_DEATH) {
             // The thread is dead, resuming it is a no-op.
@@ -324,7 +381,7 @@ zx_status_t thread_suspend(thread_t* t) {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
     DEBUG_ASSERT(!thread_is_idle(t));
 
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
 
     if (t->state == THREAD_DEATH) {
         return ZX_ERR_BAD_STATE;
@@ -395,7 +452,7 @@ zx_status_t thread_suspend(thread_t* t) {
 // syscall.
 void thread_signal_policy_exception(void) {
     thread_t* t = get_current_thread();
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
     t->signals |= THREAD_SIGNAL_POLICY_EXCEPTION;
 }
 
@@ -403,7 +460,7 @@ zx_status_t thread_join(thread_t* t, int* retcode, zx_time_t deadline) {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
 
     {
-        Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+        Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
 
         if (t->flags & THREAD_FLAG_DETACHED) {
             // the thread is detached, go ahead and exit
@@ -445,7 +502,7 @@ zx_status_t thread_join(thread_t* t, int* retcode, zx_time_t deadline) {
 zx_status_t thread_detach(thread_t* t) {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
 
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
 
     // if another thread is blocked inside thread_join() on this thread,
     // wake them up with a specific return code
@@ -473,7 +530,7 @@ static void thread_free_dpc(struct dpc* dpc) {
     // grab and release the thread lock, which effectively serializes us with
     // the thread that is queuing itself for destruction.
     {
-        Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+        Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
         atomic_signal_fence();
     }
 
@@ -525,7 +582,7 @@ __NO_RETURN static void thread_exit_locked(thread_t* current_thread,
  */
 void thread_forget(thread_t* t) {
     {
-        Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+        Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
 
         __UNUSED thread_t* current_thread = get_current_thread();
         DEBUG_ASSERT(current_thread != t);
@@ -554,7 +611,7 @@ void thread_exit(int retcode) {
 
     invoke_user_callback(current_thread, THREAD_USER_STATE_EXIT);
 
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
     thread_exit_locked(current_thread, retcode);
 }
 
@@ -562,7 +619,7 @@ void thread_exit(int retcode) {
 void thread_kill(thread_t* t) {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
 
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
 
     // deliver a signal to the thread.
     // NOTE: it's not important to do this atomically, since we're inside
@@ -632,7 +689,7 @@ void thread_kill(thread_t* t) {
 void thread_set_cpu_affinity(thread_t* t, cpu_mask_t affinity) {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
 
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
 
     // make sure the passed in mask is valid and at least one cpu can run the thread
     if (affinity & mp_get_active_mask()) {
@@ -674,7 +731,7 @@ static void thread_do_suspend(void) {
     invoke_user_callback(current_thread, THREAD_USER_STATE_SUSPEND);
 
     {
-        Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+        Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
 
         // make sure we haven't been killed while the lock was dropped for the user callback
         if (check_kill_signal(current_thread)) {
@@ -713,7 +770,7 @@ void thread_process_pending_signals(void) {
     }
 
     // grab the thread lock so we can safely look at the signal mask
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
     if (check_kill_signal(current_thread)) {
         guard.Release();
         thread_exit(0);
@@ -757,7 +814,7 @@ void thread_yield(void) {
     DEBUG_ASSERT(current_thread->state == THREAD_RUNNING);
     DEBUG_ASSERT(!arch_blocking_disallowed());
 
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
 
     CPU_STATS_INC(yields);
     sched_yield();
@@ -781,7 +838,7 @@ void thread_preempt(void) {
         CPU_STATS_INC(irq_preempts);
     }
 
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
 
     sched_preempt();
 }
@@ -800,7 +857,7 @@ void thread_reschedule(void) {
     DEBUG_ASSERT(current_thread->state == THREAD_RUNNING);
     DEBUG_ASSERT(!arch_blocking_disallowed());
 
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
 
     sched_reschedule();
 }
@@ -812,7 +869,7 @@ void thread_check_preempt_pending(void) {
     // At this point, interrupts could be enabled, so an interrupt handler
     // might preempt us and set preempt_pending to false after we read it.
     if (unlikely(current_thread->preempt_pending)) {
-        Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+        Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
         // Recheck preempt_pending just in case it got set to false after
         // our earlier check.  Its value now cannot change because
         // interrupts are now disabled.
@@ -837,7 +894,7 @@ static void thread_sleep_handler(timer_t* timer, zx_time_t now, void* arg) {
     }
 
     if (t->state != THREAD_SLEEPING) {
-        spin_unlock(&thread_lock);
+        thread_lock_release(&thread_lock);
         return;
     }
 
@@ -848,7 +905,7 @@ static void thread_sleep_handler(timer_t* timer, zx_time_t now, void* arg) {
         sched_reschedule();
     }
 
-    spin_unlock(&thread_lock);
+    thread_lock_release(&thread_lock);
 }
 
 #define MIN_SLEEP_SLACK ZX_USEC(1)
@@ -897,7 +954,7 @@ zx_status_t thread_sleep_etc(zx_time_t deadline,
     timer_t timer;
     timer_init(&timer);
 
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
 
     // if we've been killed and going in interruptable, abort here
     if (interruptable && unlikely((current_thread->signals))) {
@@ -948,7 +1005,7 @@ zx_status_t thread_sleep_interruptable(zx_time_t deadline) {
  * runtime of the thread.
  */
 zx_duration_t thread_runtime(const thread_t* t) {
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
 
     zx_duration_t runtime = t->runtime_ns;
     if (t->state == THREAD_RUNNING) {
@@ -983,7 +1040,7 @@ void thread_construct_first(thread_t* t, const char* name) {
     arch_thread_construct_first(t);
     set_current_thread(t);
 
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
     list_add_head(&thread_list, &t->thread_list_node);
 }
 
@@ -1035,7 +1092,7 @@ void thread_set_user_callback(thread_t* t, thread_user_callback_t cb) {
 void thread_set_priority(thread_t* t, int priority) {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
 
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
 
     if (priority <= IDLE_PRIORITY) {
         priority = IDLE_PRIORITY + 1;
@@ -1079,7 +1136,7 @@ void thread_become_idle(void) {
 
     // Grab the thread lock, mark ourself idle and reschedule
     {
-        Guard<spin_lock_t, NoIrqSave> guard{ThreadLock::Get()};
+        Guard<spin_lock_t, ThreadLockNoIrqSave> guard{ThreadLock::Get()};
 
         mp_set_cpu_idle(curr_cpu);
 
@@ -1148,7 +1205,7 @@ thread_t* thread_create_idle_thread(cpu_num_t cpu_num) {
     t->flags |= THREAD_FLAG_IDLE | THREAD_FLAG_DETACHED;
     t->cpu_affinity = cpu_num_to_mask(cpu_num);
 
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
     sched_unblock_idle(t);
     return t;
 }
@@ -1240,7 +1297,7 @@ void dump_thread_locked(thread_t* t, bool full_dump) {
 }
 
 void dump_thread(thread_t* t, bool full) {
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
     dump_thread_locked(t, full);
 }
 
@@ -1261,12 +1318,12 @@ void dump_all_threads_locked(bool full) {
 }
 
 void dump_all_threads(bool full) {
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
     dump_all_threads_locked(full);
 }
 
 void dump_thread_user_tid(uint64_t tid, bool full) {
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
     dump_thread_user_tid_locked(tid, full);
 }
 
@@ -1305,7 +1362,7 @@ thread_t* thread_id_to_thread_slow(uint64_t tid) {
 void ktrace_report_live_threads(void) {
     thread_t* t;
 
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
     list_for_every_entry (&thread_list, t, thread_t, thread_list_node) {
         DEBUG_ASSERT(t->magic == THREAD_MAGIC);
         if (t->user_tid) {
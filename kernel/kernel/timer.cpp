@@ -32,7 +32,6 @@
 #include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <lib/counters.h>
-#include <list.h>
 #include <malloc.h>
 #include <platform.h>
 #include <platform/timer.h>
@@ -60,6 +59,44 @@ namespace {
 spin_lock_t timer_lock __CPU_ALIGN_EXCLUSIVE = SPIN_LOCK_INITIAL_VALUE;
 DECLARE_SINGLETON_LOCK_WRAPPER(TimerLock, timer_lock);
 
+// Each cpu's pending timers, in a tree ordered by scheduled_time and then by
+// the order they were queued in, so that setting and canceling a timer is
+// O(log n) however many are pending, while the next timer to fire is always
+// at hand.  A heap would do for firing them, but coalescing a new timer needs
+// the pending ones due on either side of it.
+struct TimerQueueKey {
+    zx_time_t scheduled_time;
+    uint64_t seq;
+};
+
+struct TimerQueueTraits {
+    static TimerQueueKey GetKey(const timer_t& timer) {
+        return {timer.scheduled_time, timer.queue_seq};
+    }
+    static bool LessThan(const TimerQueueKey& a, const TimerQueueKey& b) {
+        return a.scheduled_time < b.scheduled_time ||
+               (a.scheduled_time == b.scheduled_time && a.seq < b.seq);
+    }
+    static bool EqualTo(const TimerQueueKey& a, const TimerQueueKey& b) {
+        return a.scheduled_time == b.scheduled_time && a.seq == b.seq;
+    }
+    static fbl::WAVLTreeNodeState<timer_t*>& node_state(timer_t& timer) {
+        return timer.node;
+    }
+};
+
+using TimerQueue = fbl::WAVLTree<TimerQueueKey, timer_t*, TimerQueueTraits, TimerQueueTraits>;
+
+// Guarded by timer_lock.
+TimerQueue timer_queues[SMP_MAX_CPUS];
+// Source of queue_seq, which starts at 1; guarded by timer_lock.
+uint64_t timer_queue_seq;
+
+timer_t* timer_queue_head(uint cpu) {
+    TimerQueue& queue = timer_queues[cpu];
+    return queue.is_empty() ? nullptr : &queue.front();
+}
+
 } // anonymous namespace
 
 void timer_init(timer_t* timer) {
@@ -88,112 +125,79 @@ static void insert_timer_in_queue(uint cpu, timer_t* timer,
     LTRACEF("timer %p, cpu %u, scheduled %" PRIi64 "\n", timer, cpu, timer->scheduled_time);
 
     // For inserting the timer we consider several cases. In general we
-    // want to coalesce with the current timer unless we can prove that
-    // either that:
-    //  1- there is no slack overlap with current timer OR
-    //  2- the next timer is a better fit.
+    // want to coalesce with an existing timer whose deadline falls within
+    // the new timer's slack, picking the closest of the two timers on either
+    // side of it.
     //
     // In diagrams that follow
-    // - Let |e| be the current (existing) timer deadline
     // - Let |t| be the deadline of the timer we are inserting
-    // - Let |n| be the next timer deadline if any
-    // - Let |x| be the end of the list (not a timer)
+    // - Let |p| be the previous timer deadline, the last one before |t|
+    // - Let |n| be the next timer deadline, the first one at or after |t|
     // - Let |(| and |)| the earliest_deadline and latest_deadline.
     //
-    timer_t* entry;
-
-    list_for_every_entry (&percpu[cpu].timer_queue, entry, timer_t, node) {
-        if (entry->scheduled_time > latest_deadline) {
-            // New timer latest is earlier than the current timer.
-            // Just add upfront as is, without slack.
-            //
-            //   ---------t---)--e-------------------------------> time
-            //
-            timer->slack = 0ll;
-            list_add_before(&entry->node, &timer->node);
-            return;
-        }
-
-        if (entry->scheduled_time >= timer->scheduled_time) {
-            //  New timer slack overlaps and is to the left (or equal). We
-            //  coalesce with current by scheduling late.
-            //
-            //  --------(----t---e-)----------------------------> time
-            //
-            timer->slack = zx_time_sub_time(entry->scheduled_time, timer->scheduled_time);
-            timer->scheduled_time = entry->scheduled_time;
-            kcounter_add(timer_coalesced_counter, 1);
-            list_add_after(&entry->node, &timer->node);
-            return;
-        }
-
-        if (entry->scheduled_time < earliest_deadline) {
-            // new timer earliest is later than the current timer. This case
-            // is handled in a future iteration.
+    TimerQueue& queue = timer_queues[cpu];
+    auto next = queue.lower_bound({timer->scheduled_time, 0});
+    timer_t* target = nullptr;
+
+    if (next != queue.begin()) {
+        auto prev = next;
+        --prev;
+        if (prev->scheduled_time >= earliest_deadline) {
+            // There is overlap with the previous timer, but could the next
+            // timer (if any) be a better fit?
             //
-            //   ----------------e--(---t-----------------------> time
+            //  -------------(--p---t-----?-------------------> time
             //
-            continue;
-        }
-
-        // New timer is to the right of current timer and there is overlap
-        // with the current timer, but could the next timer (if any) be
-        // a better fit?
-        //
-        //  -------------(--e---t-----?-------------------> time
-        //
-
-        const timer_t* next =
-            list_next_type(&percpu[cpu].timer_queue, &entry->node, timer_t, node);
-
-        if (next != NULL) {
-            if (next->scheduled_time <= timer->scheduled_time) {
-                // The new timer is to the right of the next timer. There is no
-                // chance the current timer is a better fit.
-                //
-                //  -------------(--e---n---t----------------------> time
-                //
-                continue;
-            }
-
-            if (next->scheduled_time < latest_deadline) {
-                // There is slack overlap with the next timer, and also with the
-                // current timer. Which coalescing is a better match?
-                //
-                //  --------------(-e---t---n-)-----------------------> time
-                //
-                zx_duration_t delta_entry =
-                    zx_time_sub_time(timer->scheduled_time, entry->scheduled_time);
-                zx_duration_t delta_next =
-                    zx_time_sub_time(next->scheduled_time, timer->scheduled_time);
-                if (delta_next < delta_entry) {
-                    // New timer is closer to the next timer, handle it in the
-                    // next iteration.
-                    continue;
+            target = &*prev;
+            if (next.IsValid()) {
+                if (next->scheduled_time == timer->scheduled_time) {
+                    // The next timer is due at the same time.
+                    target = &*next;
+                } else if (next->scheduled_time < latest_deadline) {
+                    // There is slack overlap with both timers. Which coalescing
+                    // is a better match?
+                    //
+                    //  --------------(-p---t---n-)-----------------------> time
+                    //
+                    zx_duration_t delta_prev =
+                        zx_time_sub_time(timer->scheduled_time, prev->scheduled_time);
+                    zx_duration_t delta_next =
+                        zx_time_sub_time(next->scheduled_time, timer->scheduled_time);
+                    if (delta_next < delta_prev) {
+                        target = &*next;
+                    }
                 }
             }
         }
+    }
 
-        // Handles the remaining cases, note that there is overlap with
-        // the current timer.
+    if (target == nullptr && next.IsValid() && next->scheduled_time <= latest_deadline) {
+        //  New timer slack overlaps and is to the left (or equal) of the next
+        //  timer, and not the previous one.
         //
-        //  1- this is the last timer (next == NULL) or
-        //  2- there is no overlap with the next timer, or
-        //  3- there is overlap with both current and next but
-        //     current is closer.
+        //  --------(----t---n-)----------------------------> time
         //
-        //  So we coalesce by scheduling early.
-        //
-        timer->slack = zx_time_sub_time(entry->scheduled_time, timer->scheduled_time);
-        timer->scheduled_time = entry->scheduled_time;
+        target = &*next;
+    }
+
+    if (target != nullptr) {
+        // Coalesce by scheduling early or late, as the case may be.
+        timer->slack = zx_time_sub_time(target->scheduled_time, timer->scheduled_time);
+        timer->scheduled_time = target->scheduled_time;
         kcounter_add(timer_coalesced_counter, 1);
-        list_add_after(&entry->node, &timer->node);
-        return;
+    } else {
+        // No overlap, add it as is, without slack.
+        //
+        //   ------p--(---t---)--n-----------------------------> time
+        //
+        timer->slack = 0;
     }
 
-    // Walked off the end of the list and there was no overlap.
-    timer->slack = 0;
-    list_add_tail(&percpu[cpu].timer_queue, &timer->node);
+    // Timers coalesced with |target| fire after it, and after any others that
+    // were coalesced with it before.
+    timer->queue_cpu = cpu;
+    timer->queue_seq = ++timer_queue_seq;
+    queue.insert(timer);
 }
 
 void timer_set(timer_t* timer, zx_time_t deadline, TimerSlack slack,
@@ -206,8 +210,8 @@ void timer_set(timer_t* timer, zx_time_t deadline, TimerSlack slack,
     DEBUG_ASSERT(slack.mode() <= TIMER_SLACK_EARLY);
     DEBUG_ASSERT(slack.amount() >= 0);
 
-    if (list_in_list(&timer->node)) {
-        panic("timer %p already in list\n", timer);
+    if (timer->node.InContainer()) {
+        panic("timer %p already in queue\n", timer);
     }
 
     zx_time_t latest_deadline;
@@ -261,7 +265,7 @@ void timer_set(timer_t* timer, zx_time_t deadline, TimerSlack slack,
     insert_timer_in_queue(cpu, timer, earliest_deadline, latest_deadline);
     kcounter_add(timer_created_counter, 1);
 
-    if (list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node) == timer) {
+    if (timer_queue_head(cpu) == timer) {
         // we just modified the head of the timer queue
         update_platform_timer(cpu, deadline);
     }
@@ -316,14 +320,14 @@ bool timer_cancel(timer_t* timer) {
     bool callback_not_running;
 
     // if the timer is in a queue, remove it and adjust hardware timers if needed
-    if (list_in_list(&timer->node)) {
+    if (timer->node.InContainer()) {
         callback_not_running = true;
 
         // save a copy of the old head of the queue so later we can see if we modified the head
-        timer_t* oldhead = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
+        timer_t* oldhead = timer_queue_head(cpu);
 
-        // remove our timer from the queue
-        list_delete(&timer->node);
+        // remove our timer from the queue, which need not be this cpu's
+        timer_queues[timer->queue_cpu].erase(*timer);
         kcounter_add(timer_canceled_counter, 1);
 
         // TODO(cpu): if  after removing |timer| there is one other single timer with
@@ -334,7 +338,7 @@ bool timer_cancel(timer_t* timer) {
         // if we modified another cpu's queue, we'll just let it fire and sort itself out
         if (unlikely(oldhead == timer)) {
             // timer we're canceling was at head of queue, see if we should update platform timer
-            timer_t* newhead = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
+            timer_t* newhead = timer_queue_head(cpu);
             if (newhead) {
                 update_platform_timer(cpu, newhead->scheduled_time);
             } else if (percpu[cpu].next_timer_deadline == ZX_TIME_INFINITE) {
@@ -385,7 +389,7 @@ void timer_tick(zx_time_t now) {
 
     for (;;) {
         // see if there's an event to process
-        timer = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
+        timer = timer_queue_head(cpu);
         if (likely(timer == 0)) {
             break;
         }
@@ -400,7 +404,7 @@ void timer_tick(zx_time_t now) {
         DEBUG_ASSERT_MSG(timer && timer->magic == TIMER_MAGIC,
                          "ASSERT: timer failed magic check: timer %p, magic 0x%x\n",
                          timer, (uint)timer->magic);
-        list_delete(&timer->node);
+        timer_queues[cpu].pop_front();
 
         // mark the timer busy
         timer->active_cpu = cpu;
@@ -428,7 +432,7 @@ void timer_tick(zx_time_t now) {
 
     // get the deadline of the event at the head of the queue (if any)
     zx_time_t deadline = ZX_TIME_INFINITE;
-    timer = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
+    timer = timer_queue_head(cpu);
     if (timer) {
         deadline = timer->scheduled_time;
 
@@ -466,12 +470,12 @@ void timer_transition_off_cpu(uint old_cpu) {
     Guard<spin_lock_t, IrqSave> guard{TimerLock::Get()};
     uint cpu = arch_curr_cpu_num();
 
-    timer_t* old_head = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
+    timer_t* old_head = timer_queue_head(cpu);
 
-    timer_t *entry = NULL, *tmp_entry = NULL;
     // Move all timers from old_cpu to this cpu
-    list_for_every_entry_safe (&percpu[old_cpu].timer_queue, entry, tmp_entry, timer_t, node) {
-        list_delete(&entry->node);
+    TimerQueue& old_queue = timer_queues[old_cpu];
+    while (!old_queue.is_empty()) {
+        timer_t* entry = old_queue.pop_front();
         // We lost the original asymmetric slack information so when we combine them
         // with the other timer queue they are not coalesced again.
         // TODO(cpu): figure how important this case is.
@@ -481,7 +485,7 @@ void timer_transition_off_cpu(uint old_cpu) {
         // created.
     }
 
-    timer_t* new_head = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
+    timer_t* new_head = timer_queue_head(cpu);
     if (new_head != NULL && new_head != old_head) {
         // we just modified the head of the timer queue
         update_platform_timer(cpu, new_head->scheduled_time);
@@ -502,7 +506,7 @@ void timer_thaw_percpu(void) {
     percpu[cpu].next_timer_deadline = ZX_TIME_INFINITE;
     zx_time_t deadline = percpu[cpu].preempt_timer_deadline;
 
-    timer_t* t = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
+    timer_t* t = timer_queue_head(cpu);
     if (t) {
         if (t->scheduled_time < deadline) {
             deadline = t->scheduled_time;
@@ -516,7 +520,6 @@ void timer_thaw_percpu(void) {
 
 void timer_queue_init(void) {
     for (uint i = 0; i < SMP_MAX_CPUS; i++) {
-        list_initialize(&percpu[i].timer_queue);
         percpu[i].preempt_timer_deadline = ZX_TIME_INFINITE;
         percpu[i].next_timer_deadline = ZX_TIME_INFINITE;
     }
@@ -533,15 +536,14 @@ static void dump_timer_queues(char* buf, size_t len) {
         if (mp_is_cpu_online(i)) {
             ptr += snprintf(buf + ptr, len - ptr, "cpu %u:\n", i);
 
-            timer_t* t;
             zx_time_t last = now;
-            list_for_every_entry (&percpu[i].timer_queue, t, timer_t, node) {
-                zx_duration_t delta_now = zx_time_sub_time(t->scheduled_time, now);
-                zx_duration_t delta_last = zx_time_sub_time(t->scheduled_time, last);
+            for (const timer_t& t : timer_queues[i]) {
+                zx_duration_t delta_now = zx_time_sub_time(t.scheduled_time, now);
+                zx_duration_t delta_last = zx_time_sub_time(t.scheduled_time, last);
                 ptr += snprintf(buf + ptr, len - ptr,
                                 "\ttime %" PRIi64 " delta_now %" PRIi64 " delta_last %" PRIi64 " func %p arg %p\n",
-                                t->scheduled_time, delta_now, delta_last, t->callback, t->arg);
-                last = t->scheduled_time;
+                                t.scheduled_time, delta_now, delta_last, t.callback, t.arg);
+                last = t.scheduled_time;
             }
         }
     }
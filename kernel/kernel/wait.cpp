@@ -196,7 +196,7 @@ static void wait_queue_timeout_handler(timer_t* timer, zx_time_t now,
 
     wait_queue_unblock_thread(thread, ZX_ERR_TIMED_OUT);
 
-    spin_unlock(&thread_lock);
+    thread_lock_release(&thread_lock);
 }
 
 /**
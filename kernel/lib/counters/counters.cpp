@@ -14,11 +14,15 @@
 #include <kernel/percpu.h>
 #include <kernel/spinlock.h>
 #include <kernel/timer.h>
+#include <ktl/move.h>
 #include <lib/console.h>
+#include <lib/zircon-internal/kcounter.h>
 #include <lk/init.h>
 #include <platform.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vm/vm_object_paged.h>
 
 #include "counters_private.h"
 
@@ -69,6 +73,87 @@ static const k_counter_desc* upper_bound(
     return first;
 }
 
+static_assert(static_cast<uint64_t>(k_counter_type::sum) == KCOUNTER_TYPE_SUM, "");
+static_assert(static_cast<uint64_t>(k_counter_type::min) == KCOUNTER_TYPE_MIN, "");
+static_assert(static_cast<uint64_t>(k_counter_type::max) == KCOUNTER_TYPE_MAX, "");
+
+// The VMOs handed out by counters_get_vmos().  The arena VMO is backed by the
+// kernel's own pages of kcounters_arena, so the kernel keeps a reference to
+// make sure they are never returned to the free pool.
+static fbl::Mutex vmo_lock;
+static fbl::RefPtr<VmObject> desc_vmo TA_GUARDED(vmo_lock);
+static fbl::RefPtr<VmObject> arena_vmo TA_GUARDED(vmo_lock);
+
+static zx_status_t create_desc_vmo(fbl::RefPtr<VmObject>* out) {
+    const size_t num_counters = get_num_counters();
+    const size_t size = sizeof(kcounter_desc_header_t) + num_counters * sizeof(kcounter_desc_entry_t);
+
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, ROUNDUP(size, PAGE_SIZE),
+                                               &vmo);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    kcounter_desc_header_t header = {};
+    header.magic = KCOUNTER_DESC_MAGIC;
+    header.max_cpus = SMP_MAX_CPUS;
+    header.num_counters = static_cast<uint32_t>(num_counters);
+    status = vmo->Write(&header, 0, sizeof(header));
+    for (size_t ix = 0; ix != num_counters && status == ZX_OK; ++ix) {
+        kcounter_desc_entry_t entry = {};
+        DEBUG_ASSERT(strlen(kcountdesc_begin[ix].name) < sizeof(entry.name));
+        strlcpy(entry.name, kcountdesc_begin[ix].name, sizeof(entry.name));
+        entry.type = static_cast<uint64_t>(kcountdesc_begin[ix].type);
+        status = vmo->Write(&entry,
+                            offsetof(kcounter_desc_header_t, descriptors) + ix * sizeof(entry),
+                            sizeof(entry));
+    }
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    vmo->set_name(KCOUNTER_DESC_VMO_NAME, sizeof(KCOUNTER_DESC_VMO_NAME) - 1);
+    *out = ktl::move(vmo);
+    return ZX_OK;
+}
+
+static zx_status_t create_arena_vmo(fbl::RefPtr<VmObject>* out) {
+    // kernel.ld page-aligns both ends of the arena, so the VMO shares
+    // nothing else with userspace.
+    const size_t size = get_num_counters() * SMP_MAX_CPUS * sizeof(int64_t);
+
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::CreateFromROData(kcounters_arena,
+                                                         ROUNDUP(size, PAGE_SIZE), &vmo);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    vmo->set_name(KCOUNTER_ARENA_VMO_NAME, sizeof(KCOUNTER_ARENA_VMO_NAME) - 1);
+    *out = ktl::move(vmo);
+    return ZX_OK;
+}
+
+zx_status_t counters_get_vmos(fbl::RefPtr<VmObject>* desc, fbl::RefPtr<VmObject>* arena) {
+    fbl::AutoLock lock(&vmo_lock);
+    if (!desc_vmo) {
+        zx_status_t status = create_desc_vmo(&desc_vmo);
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+    if (!arena_vmo) {
+        zx_status_t status = create_arena_vmo(&arena_vmo);
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+    *desc = desc_vmo;
+    *arena = arena_vmo;
+    return ZX_OK;
+}
+
 static void counters_init(unsigned level) {
     // Wire the memory defined in the .bss section to the counters.
     for (size_t ix = 0; ix != SMP_MAX_CPUS; ++ix) {
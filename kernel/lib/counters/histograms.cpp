@@ -0,0 +1,159 @@
+// Copyright 2018 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/histograms.h>
+
+#include <arch/mp.h>
+#include <arch/ops.h>
+#include <fbl/mutex.h>
+#include <kernel/auto_lock.h>
+#include <kernel/cmdline.h>
+#include <kernel/percpu.h>
+#include <ktl/move.h>
+#include <lk/init.h>
+#include <stddef.h>
+#include <string.h>
+#include <trace.h>
+#include <vm/vm_aspace.h>
+#include <vm/vm_object_paged.h>
+
+#define LOCAL_TRACE 0
+
+static_assert(KHISTOGRAM_BUCKETS == 48, "update the bucket tests");
+
+// Set up by histograms_init().  The arena VMO is mapped into the kernel for
+// good and carved into per-cpu blocks, and the same VMO is handed to
+// userspace, so the mapping keeps its pages committed.
+static size_t num_cpus;
+static size_t num_histograms;
+
+static fbl::Mutex vmo_lock;
+static fbl::RefPtr<VmObject> desc_vmo TA_GUARDED(vmo_lock);
+static fbl::RefPtr<VmObject> arena_vmo TA_GUARDED(vmo_lock);
+
+static size_t get_num_families() {
+    // None are published if the arena was never set up.
+    return num_histograms ? khistdesc_end - khistdesc_begin : 0;
+}
+
+static zx_status_t create_desc_vmo(fbl::RefPtr<VmObject>* out) {
+    const size_t num_families = get_num_families();
+    const size_t size = sizeof(khistogram_desc_header_t) +
+                        num_families * sizeof(khistogram_desc_entry_t);
+
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, ROUNDUP(size, PAGE_SIZE),
+                                               &vmo);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    khistogram_desc_header_t header = {};
+    header.magic = KHISTOGRAM_DESC_MAGIC;
+    header.num_cpus = static_cast<uint32_t>(num_cpus);
+    header.num_buckets = KHISTOGRAM_BUCKETS;
+    header.num_families = static_cast<uint32_t>(num_families);
+    header.num_histograms = static_cast<uint32_t>(num_histograms);
+    status = vmo->Write(&header, 0, sizeof(header));
+    for (size_t ix = 0; ix != num_families && status == ZX_OK; ++ix) {
+        khistogram_desc_entry_t entry = {};
+        DEBUG_ASSERT(strlen(khistdesc_begin[ix].name) < sizeof(entry.name));
+        strlcpy(entry.name, khistdesc_begin[ix].name, sizeof(entry.name));
+        entry.count = khistdesc_begin[ix].count;
+        entry.first = khistdesc_begin[ix].first;
+        status = vmo->Write(&entry,
+                            offsetof(khistogram_desc_header_t, descriptors) + ix * sizeof(entry),
+                            sizeof(entry));
+    }
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    vmo->set_name(KHISTOGRAM_DESC_VMO_NAME, sizeof(KHISTOGRAM_DESC_VMO_NAME) - 1);
+    *out = ktl::move(vmo);
+    return ZX_OK;
+}
+
+zx_status_t histograms_get_vmos(fbl::RefPtr<VmObject>* desc, fbl::RefPtr<VmObject>* arena) {
+    fbl::AutoLock lock(&vmo_lock);
+    if (!arena_vmo) {
+        zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, 0u, &arena_vmo);
+        if (status != ZX_OK) {
+            return status;
+        }
+        arena_vmo->set_name(KHISTOGRAM_ARENA_VMO_NAME, sizeof(KHISTOGRAM_ARENA_VMO_NAME) - 1);
+    }
+    if (!desc_vmo) {
+        zx_status_t status = create_desc_vmo(&desc_vmo);
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+    *desc = desc_vmo;
+    *arena = arena_vmo;
+    return ZX_OK;
+}
+
+static void histograms_init(unsigned level) {
+    if (!cmdline_get_bool("kernel.histograms", true) || khistdesc_end - khistdesc_begin == 0) {
+        return;
+    }
+
+    // Number the histograms of each family consecutively, in name order.
+    size_t total = 0;
+    for (auto it = khistdesc_begin; it != khistdesc_end; ++it) {
+        it->first = static_cast<uint32_t>(total);
+        total += it->count;
+    }
+
+    // This runs late enough for the number of cpus to be known, so the arena
+    // need not cover SMP_MAX_CPUS the way the counters' does.
+    const size_t cpus = arch_max_num_cpus();
+    const size_t block = total * KHISTOGRAM_BUCKETS * sizeof(int64_t);
+    const size_t size = ROUNDUP(cpus * block, PAGE_SIZE);
+
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, size, &vmo);
+    if (status != ZX_OK) {
+        TRACEF("histograms: cannot create arena: %d\n", status);
+        return;
+    }
+    vmo->set_name(KHISTOGRAM_ARENA_VMO_NAME, sizeof(KHISTOGRAM_ARENA_VMO_NAME) - 1);
+
+    fbl::RefPtr<VmMapping> mapping;
+    status = VmAspace::kernel_aspace()->RootVmar()->CreateVmMapping(
+        0 /* ignored */, size, 0 /* align pow2 */, 0 /* vmar flags */, vmo, 0,
+        ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE, "histograms", &mapping);
+    if (status != ZX_OK) {
+        TRACEF("histograms: cannot map arena: %d\n", status);
+        return;
+    }
+    status = mapping->MapRange(0, size, true);
+    if (status != ZX_OK) {
+        TRACEF("histograms: cannot commit arena: %d\n", status);
+        mapping->Destroy();
+        return;
+    }
+
+    {
+        fbl::AutoLock lock(&vmo_lock);
+        arena_vmo = ktl::move(vmo);
+    }
+    num_cpus = cpus;
+    num_histograms = total;
+
+    // The descriptors must be seen complete before any cpu records into the
+    // arena through its pointer.
+    smp_mb();
+    auto base = reinterpret_cast<uint8_t*>(mapping->base());
+    for (size_t ix = 0; ix != cpus; ++ix) {
+        percpu[ix].histograms = reinterpret_cast<int64_t*>(base + ix * block);
+    }
+
+    LTRACEF("%zu histograms in %zu families, %zu bytes\n", total, get_num_families(), size);
+}
+
+LK_INIT_HOOK(khistograms, histograms_init, LK_INIT_LEVEL_TARGET);
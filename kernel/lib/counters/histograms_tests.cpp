@@ -0,0 +1,50 @@
+// Copyright 2018 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/histograms.h>
+
+#include <lib/unittest/unittest.h>
+
+static bool bucket_bounds() {
+    BEGIN_TEST;
+
+    EXPECT_EQ(khistogram_bucket(0), 0u, "");
+    EXPECT_EQ(khistogram_bucket(127), 0u, "");
+    EXPECT_EQ(khistogram_bucket(128), 1u, "");
+    EXPECT_EQ(khistogram_bucket(191), 1u, "");
+    EXPECT_EQ(khistogram_bucket(192), 2u, "");
+    EXPECT_EQ(khistogram_bucket(256), 3u, "");
+    EXPECT_EQ(khistogram_bucket((1ull << 30) - 1), KHISTOGRAM_BUCKETS - 2u, "");
+    EXPECT_EQ(khistogram_bucket(1ull << 30), KHISTOGRAM_BUCKETS - 1u, "");
+    EXPECT_EQ(khistogram_bucket(UINT64_MAX), KHISTOGRAM_BUCKETS - 1u, "");
+
+    END_TEST;
+}
+
+// Every bucket's lower bound lands in that bucket, the value just below it in
+// the previous one, and the bounds grow by no more than half a power of two.
+static bool bucket_round_trip() {
+    BEGIN_TEST;
+
+    EXPECT_EQ(khistogram_bucket_min(0), 0u, "");
+    for (uint32_t bucket = 1; bucket < KHISTOGRAM_BUCKETS; ++bucket) {
+        const uint64_t min = khistogram_bucket_min(bucket);
+        const uint64_t prev = khistogram_bucket_min(bucket - 1);
+        EXPECT_EQ(khistogram_bucket(min), bucket, "");
+        EXPECT_EQ(khistogram_bucket(min - 1), bucket - 1, "");
+        EXPECT_GT(min, prev, "");
+        if (bucket > 1) {
+            EXPECT_LE(2 * min, 3 * prev, "");
+        }
+    }
+
+    END_TEST;
+}
+
+UNITTEST_START_TESTCASE(histograms_tests)
+UNITTEST("bucket bounds", bucket_bounds)
+UNITTEST("bucket round trip", bucket_round_trip)
+UNITTEST_END_TESTCASE(histograms_tests, "histograms_tests", "Histograms tests");
@@ -10,7 +10,11 @@
 #include <kernel/atomic.h>
 #include <kernel/percpu.h>
 
+#include <fbl/ref_ptr.h>
 #include <zircon/compiler.h>
+#include <zircon/types.h>
+
+class VmObject;
 
 // Kernel counters are a facility designed to help field diagnostics and
 // to help devs properly dimension the load/clients/size of the kernel
@@ -18,8 +22,10 @@
 //   - after N seconds how many outstanding <x> things are allocated?
 //   - up to this point has <Y> ever happened?
 //
-// Currently the only query interface to the counters is the console
-// k counters command. Issue 'k counters help' to learn what it can do.
+// The counters can be queried with the console k counters command. Issue
+// 'k counters help' to learn what it can do. They are also published to
+// userspace as read-only VMOs (see counters_get_vmos() below), which the
+// kcounter tool reads.
 //
 // Kernel counters public API:
 // 1- define a new counter.
@@ -119,3 +125,8 @@ static inline void kcounter_max(const struct k_counter_desc* var, int64_t value)
 static inline void kcounter_max_counter(const struct k_counter_desc* var, const struct k_counter_desc* other_var) {
     kcounter_max(var, *kcounter_slot(other_var));
 }
+
+// Returns the VMOs that publish the counters to userspace, laid out as
+// described in <lib/zircon-internal/kcounter.h>: the descriptors, and the
+// per-cpu arena itself.  Userspace must only be given read-only handles.
+zx_status_t counters_get_vmos(fbl::RefPtr<VmObject>* desc_vmo, fbl::RefPtr<VmObject>* arena_vmo);
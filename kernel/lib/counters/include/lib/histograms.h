@@ -0,0 +1,94 @@
+// Copyright 2018 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <arch/ops.h>
+#include <assert.h>
+#include <kernel/atomic.h>
+#include <kernel/percpu.h>
+#include <lib/zircon-internal/khistogram.h>
+
+#include <fbl/ref_ptr.h>
+#include <zircon/compiler.h>
+#include <zircon/types.h>
+
+class VmObject;
+
+// Kernel histograms are the counters' counterpart for latencies: where a
+// counter answers "how many times", a histogram answers "how long, and how
+// often that long".  Each histogram counts durations in the log-linear
+// buckets described in <lib/zircon-internal/khistogram.h>, in a per-cpu
+// arena, so recording one is a couple of instructions and never takes a lock.
+//
+// Histograms come in families: a family is a fixed number of histograms
+// that share a name, such as one per syscall number.  A lone histogram is a
+// family of one.
+//
+// Kernel histograms public API:
+// 1- define a new histogram, or family of them.
+//      KHISTOGRAM(hist_name, "<histogram name>");
+//      KHISTOGRAM_FAMILY(hist_name, "<histogram name>", count);
+//
+// 2- record a duration in nanoseconds, with interrupts disabled:
+//      khistogram_add(hist_name, duration);
+//    or
+//      khistogram_add(hist_name, index, duration);
+//
+// The naming convention follows the counters', e.g. "kernel.latency.irq".
+//
+// The histograms are published to userspace as read-only VMOs (see
+// histograms_get_vmos() below), which the kcounter tool reads with -H.  They
+// are only recorded once histograms_init() has set up the arena, and not at
+// all if kernel.histograms=false is on the kernel command line.
+
+struct k_histogram_desc {
+    const char* name;
+    uint32_t count;
+    // Index of the family's first histogram in each per-cpu block; set by
+    // histograms_init().
+    uint32_t first;
+};
+
+// Via magic in kernel.ld, all the descriptors wind up in a contiguous array
+// bounded by these two symbols, sorted by name.  They are not const because
+// histograms_init() fills in |first|.
+#define KHISTOGRAM_FAMILY(var, name, count)                                                        \
+    __USED __SECTION("khistdesc." name) static struct k_histogram_desc var[] = {{name, count, 0}}
+
+#define KHISTOGRAM(var, name) KHISTOGRAM_FAMILY(var, name, 1)
+
+extern struct k_histogram_desc khistdesc_begin[], khistdesc_end[];
+
+// Interrupts must be disabled, so that the bucket updated is the current
+// cpu's own.
+static inline void khistogram_add(const struct k_histogram_desc* var, uint32_t index,
+                                  zx_duration_t value) {
+    DEBUG_ASSERT(arch_ints_disabled());
+    int64_t* hist = get_local_percpu()->histograms;
+    if (unlikely(hist == nullptr || index >= var->count)) {
+        return;
+    }
+    int64_t* slot = &hist[(var->first + index) * KHISTOGRAM_BUCKETS +
+                          khistogram_bucket(value > 0 ? value : 0)];
+#if defined(__aarch64__)
+    // As in kcounter_add().
+    atomic_add_64_relaxed(slot, 1);
+#else
+    *slot += 1;
+#endif
+}
+
+static inline void khistogram_add(const struct k_histogram_desc* var, zx_duration_t value) {
+    khistogram_add(var, 0, value);
+}
+
+// Returns the VMOs that publish the histograms to userspace, laid out as
+// described in <lib/zircon-internal/khistogram.h>.  Userspace must only be
+// given read-only handles.  If the histograms are disabled, the descriptors
+// list no families and the arena is empty.
+zx_status_t histograms_get_vmos(fbl::RefPtr<VmObject>* desc_vmo,
+                                fbl::RefPtr<VmObject>* arena_vmo);
@@ -10,7 +10,9 @@ MODULE := $(LOCAL_DIR)
 
 MODULE_SRCS += \
 	$(LOCAL_DIR)/counters.cpp \
-	$(LOCAL_DIR)/counters_tests.cpp
+	$(LOCAL_DIR)/counters_tests.cpp \
+	$(LOCAL_DIR)/histograms.cpp \
+	$(LOCAL_DIR)/histograms_tests.cpp
 
 MODULE_DEPS += \
 	kernel/lib/console \
@@ -6,19 +6,27 @@
 
 #include <debug.h>
 #include <err.h>
+#include <inttypes.h>
 #include <platform.h>
 #include <string.h>
 
 #include <arch/ops.h>
 #include <arch/user_copy.h>
+#include <fbl/algorithm.h>
+#include <fbl/atomic.h>
 #include <hypervisor/ktrace.h>
+#include <kernel/align.h>
+#include <kernel/atomic.h>
 #include <kernel/cmdline.h>
+#include <kernel/spinlock.h>
 #include <lib/ktrace.h>
 #include <lk/init.h>
 #include <object/thread_dispatcher.h>
 #include <vm/vm_aspace.h>
 #include <zircon/thread_annotations.h>
 
+#include "ktrace_private.h"
+
 #define ktrace_timestamp() current_ticks();
 #define ktrace_ticks_per_ms() (ticks_per_second() / 1000)
 
@@ -75,88 +83,241 @@ static void ktrace_report_probes(void) {
     }
 }
 
-typedef struct ktrace_state {
-    // where the next record will be written
-    int offset;
-
-    // mask of groups we allow, 0 == tracing disabled
-    int grpmask;
+static ktrace_state_t KTRACE_STATE;
+static ktrace_cpu_t KTRACE_CPU[SMP_MAX_CPUS];
 
-    // total size of the trace buffer
-    uint32_t bufsize;
+// Serializes reads and control operations with each other.
+static fbl::Mutex ktrace_lock;
 
-    // offset where tracing was stopped, 0 if tracing active
-    uint32_t marker;
+// Returns the bytes of records held by chunk |n| of |kc|, whose head chunk is |head|.
+static uint32_t ktrace_chunk_len(const ktrace_cpu_t* kc, uint64_t n, uint64_t head) {
+    return n == head ? kc->offset.load(fbl::memory_order_relaxed) : kc->len[n % kChunksPerCpu];
+}
 
-    // raw trace buffer
-    uint8_t* buffer;
-} ktrace_state_t;
+static uint8_t* ktrace_chunk(const ktrace_state_t* ks, const ktrace_cpu_t* kc, uint64_t n) {
+    return kc->buffer + (n % kChunksPerCpu) * ks->chunksize;
+}
 
-static ktrace_state_t KTRACE_STATE;
+static uint32_t ktrace_meta_len(ktrace_state_t* ks) {
+    return static_cast<uint32_t>(atomic_load(&ks->offset));
+}
 
-ssize_t ktrace_read_user(void* ptr, uint32_t off, size_t len) {
-    ktrace_state_t* ks = &KTRACE_STATE;
+// Copies |len| bytes at |src| to |*ptr| and advances it.
+static zx_status_t ktrace_copy_out(ktrace_copy_fn copy, uint8_t** ptr, const uint8_t* src,
+                                   size_t len) {
+    if (copy(*ptr, src, len) != ZX_OK) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    *ptr += len;
+    return ZX_OK;
+}
 
-    // Buffer size is limited by the marker if set,
-    // otherwise limited by offset (last written point).
-    // Offset can end up pointing past the end, so clip
-    // it to the actual buffer size to be safe.
-    uint32_t max;
-    if (ks->marker) {
-        max = ks->marker;
-    } else {
-        max = ks->offset;
-        if (max > ks->bufsize) {
-            max = ks->bufsize;
+// Outside of streaming mode the trace reads as one file: the metadata followed
+// by each cpu's chunks from oldest to newest.  Reading while a circular trace
+// is running may see chunks that are being overwritten, so stop it first.
+static ssize_t ktrace_read_snapshot(ktrace_state_t* ks, ktrace_copy_fn copy, void* ptr,
+                                    uint32_t off, size_t len) {
+    uint8_t* out = static_cast<uint8_t*>(ptr);
+    size_t pos = 0;
+    size_t actual = 0;
+
+    // Copies the part of the piece at [pos, pos + n) of the file that was asked for.
+    auto add = [&](const uint8_t* src, size_t n) -> zx_status_t {
+        size_t end = pos + n;
+        if (out != nullptr && end > off && actual < len) {
+            size_t start = off > pos ? off - pos : 0;
+            size_t count = fbl::min(n - start, len - actual);
+            zx_status_t status = ktrace_copy_out(copy, &out, src + start, count);
+            if (status != ZX_OK) {
+                return status;
+            }
+            actual += count;
+        }
+        pos = end;
+        return ZX_OK;
+    };
+
+    zx_status_t status = add(ks->buffer, ktrace_meta_len(ks));
+    for (uint32_t cpu = 0; cpu < ks->ncpus && status == ZX_OK; cpu++) {
+        ktrace_cpu_t* kc = &ks->cpus[cpu];
+        uint64_t head = kc->head.load(fbl::memory_order_acquire);
+        for (uint64_t n = kc->tail.load(fbl::memory_order_relaxed);
+             n <= head && status == ZX_OK; n++) {
+            status = add(ktrace_chunk(ks, kc, n), ktrace_chunk_len(kc, n, head));
         }
     }
+    if (status != ZX_OK) {
+        return status;
+    }
 
     // null read is a query for trace buffer size
-    if (ptr == nullptr) {
-        return max;
+    return out == nullptr ? pos : actual;
+}
+
+// In streaming mode reads consume the trace and ignore the offset.  Each read
+// returns the metadata not yet read, then the closed chunks of each cpu,
+// letting their writers reuse them.  Once tracing stops, the chunks being
+// written are read as well.  A read that fills the caller's buffer is
+// continued from the same place by the next one, so that records are never
+// split between sources.
+static ssize_t ktrace_read_stream(ktrace_state_t* ks, ktrace_copy_fn copy, void* ptr,
+                                  size_t len) {
+    const bool stopped = atomic_load(&ks->grpmask) == 0;
+    uint8_t* out = static_cast<uint8_t*>(ptr);
+    size_t actual = 0;
+
+    for (uint32_t i = 0; i <= ks->ncpus; i++) {
+        uint32_t src = (ks->read_src + i) % (ks->ncpus + 1);
+
+        if (src == 0) {
+            uint32_t n = ktrace_meta_len(ks) - ks->meta_read;
+            if (out != nullptr) {
+                n = static_cast<uint32_t>(fbl::min<size_t>(n, len - actual));
+                zx_status_t status =
+                    ktrace_copy_out(copy, &out, ks->buffer + ks->meta_read, n);
+                if (status != ZX_OK) {
+                    return status;
+                }
+                ks->meta_read += n;
+            }
+            actual += n;
+        } else {
+            ktrace_cpu_t* kc = &ks->cpus[src - 1];
+            uint64_t head = kc->head.load(fbl::memory_order_acquire);
+            uint32_t read_off = kc->read_off;
+            for (uint64_t n = kc->tail.load(fbl::memory_order_relaxed);
+                 n < head || (stopped && n == head); n++) {
+                uint32_t count = ktrace_chunk_len(kc, n, head) - read_off;
+                if (out == nullptr) {
+                    actual += count;
+                    read_off = 0;
+                    continue;
+                }
+                count = static_cast<uint32_t>(fbl::min<size_t>(count, len - actual));
+                zx_status_t status =
+                    ktrace_copy_out(copy, &out, ktrace_chunk(ks, kc, n) + read_off, count);
+                if (status != ZX_OK) {
+                    return status;
+                }
+                actual += count;
+                kc->read_off = read_off += count;
+                if (read_off < ktrace_chunk_len(kc, n, head) || n == head) {
+                    break;
+                }
+                // The whole chunk has been read; hand it back to the writer.
+                kc->read_off = read_off = 0;
+                kc->tail.store(n + 1, fbl::memory_order_release);
+            }
+        }
+
+        if (out != nullptr && actual == len) {
+            ks->read_src = src;
+            break;
+        }
     }
 
-    // constrain read to available buffer
-    if (off >= max) {
+    // null read is a query for the bytes ready to be read
+    return actual;
+}
+
+ssize_t ktrace_read_state(ktrace_state_t* ks, ktrace_copy_fn copy, void* ptr, uint32_t off,
+                          size_t len) {
+    if (ks->mode == KTRACE_MODE_STREAMING) {
+        return ktrace_read_stream(ks, copy, ptr, len);
+    }
+    return ktrace_read_snapshot(ks, copy, ptr, off, len);
+}
+
+ssize_t ktrace_read_user(void* ptr, uint32_t off, size_t len) {
+    ktrace_state_t* ks = &KTRACE_STATE;
+    if (ks->buffer == nullptr) {
         return 0;
     }
-    if (len > (max - off)) {
-        len = max - off;
+
+    fbl::AutoLock lock(&ktrace_lock);
+    return ktrace_read_state(ks, arch_copy_to_user, ptr, off, len);
+}
+
+void ktrace_reset_state(ktrace_state_t* ks) {
+    for (uint32_t cpu = 0; cpu < ks->ncpus; cpu++) {
+        ktrace_cpu_t* kc = &ks->cpus[cpu];
+        kc->offset.store(0);
+        kc->head.store(0);
+        kc->tail.store(0);
+        kc->read_off = 0;
+        kc->dropped.store(0);
     }
+    ks->rewind_pending = false;
+    ks->meta_read = 0;
+    ks->read_src = 0;
 
-    if (arch_copy_to_user(ptr, ks->buffer + off, len) != ZX_OK) {
-        return ZX_ERR_INVALID_ARGS;
+    // roll back to just after the version and tick rate
+    atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
+}
+
+bool ktrace_start_state(ktrace_state_t* ks, uint32_t grpmask) {
+    const bool rewound = ks->rewind_pending;
+    if (rewound) {
+        atomic_store(&ks->grpmask, 0);
+        ktrace_reset_state(ks);
+    }
+    atomic_store(&ks->grpmask, static_cast<int>(grpmask));
+    return rewound;
+}
+
+uint64_t ktrace_stop_state(ktrace_state_t* ks) {
+    atomic_store(&ks->grpmask, 0);
+    uint64_t dropped = 0;
+    for (uint32_t cpu = 0; cpu < ks->ncpus; cpu++) {
+        dropped += ks->cpus[cpu].dropped.load();
     }
-    return len;
+    return dropped;
+}
+
+// Reports the names that every trace starts with.
+static void ktrace_report_metadata() {
+    ktrace_report_syscalls(kt_syscall_info);
+    ktrace_report_probes();
+    ktrace_report_vcpu_meta();
+}
+
+// Empties the buffer, leaving the metadata that every trace starts with.
+static void ktrace_reset(ktrace_state_t* ks) TA_REQ(ktrace_lock) {
+    ktrace_reset_state(ks);
+    ktrace_report_metadata();
 }
 
 zx_status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
     ktrace_state_t* ks = &KTRACE_STATE;
     switch (action) {
-    case KTRACE_ACTION_START:
+    case KTRACE_ACTION_START: {
+        fbl::AutoLock lock(&ktrace_lock);
+        if (ks->buffer == nullptr) {
+            break;
+        }
         options = KTRACE_GRP_TO_MASK(options);
-        ks->marker = 0;
-        atomic_store(&ks->grpmask, options ? options : KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL));
+        if (ktrace_start_state(ks, options ? options : KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL))) {
+            ktrace_report_metadata();
+        }
         ktrace_report_live_processes();
         ktrace_report_live_threads();
         break;
+    }
     case KTRACE_ACTION_STOP: {
-        atomic_store(&ks->grpmask, 0);
-        uint32_t n = ks->offset;
-        if (n > ks->bufsize) {
-            ks->marker = ks->bufsize;
-        } else {
-            ks->marker = n;
+        fbl::AutoLock lock(&ktrace_lock);
+        uint64_t dropped = ktrace_stop_state(ks);
+        if (dropped) {
+            dprintf(INFO, "ktrace: %" PRIu64 " records dropped, buffer full\n", dropped);
         }
         break;
     }
-    case KTRACE_ACTION_REWIND:
-        // roll back to just after the metadata
-        atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
-        ktrace_report_syscalls(kt_syscall_info);
-        ktrace_report_probes();
-        ktrace_report_vcpu_meta();
+    case KTRACE_ACTION_REWIND: {
+        // The records are kept until tracing starts again, so that a trace
+        // can be stopped, rewound and then read.
+        fbl::AutoLock lock(&ktrace_lock);
+        ks->rewind_pending = true;
         break;
+    }
     case KTRACE_ACTION_NEW_PROBE: {
         fbl::AutoLock lock(&probe_list_lock);
         ktrace_probe_info_t* probe;
@@ -172,6 +333,20 @@ zx_status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
         ktrace_add_probe(probe);
         return probe->num;
     }
+    case KTRACE_ACTION_SET_MODE: {
+        if (options > KTRACE_MODE_STREAMING) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        fbl::AutoLock lock(&ktrace_lock);
+        if (atomic_load(&ks->grpmask) != 0) {
+            return ZX_ERR_BAD_STATE;
+        }
+        ks->mode = options;
+        if (ks->buffer != nullptr) {
+            ktrace_reset(ks);
+        }
+        break;
+    }
     default:
         return ZX_ERR_INVALID_ARGS;
     }
@@ -193,19 +368,36 @@ void ktrace_init(unsigned level) {
 
     mb *= (1024*1024);
 
+    // An eighth of the buffer holds the metadata, and the rest is split
+    // evenly between the cpus.
+    uint32_t ncpus = arch_max_num_cpus();
+    uint32_t metasize = mb / 8;
+    uint32_t chunksize = ROUNDDOWN((mb - metasize) / ncpus / kChunksPerCpu, 8);
+    if (chunksize < 2 * kMaxRecordSize) {
+        dprintf(INFO, "ktrace: buffer too small for %u cpus\n", ncpus);
+        return;
+    }
+
     zx_status_t status;
+    uint8_t* buffer;
     VmAspace* aspace = VmAspace::kernel_aspace();
-    if ((status = aspace->Alloc("ktrace", mb, (void**)&ks->buffer, 0, VmAspace::VMM_FLAG_COMMIT,
+    if ((status = aspace->Alloc("ktrace", mb, (void**)&buffer, 0, VmAspace::VMM_FLAG_COMMIT,
                                 ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE)) < 0) {
         dprintf(INFO, "ktrace: cannot alloc buffer %d\n", status);
         return;
     }
 
-    // The last packet written can overhang the end of the buffer,
-    // so we reduce the reported size by the max size of a record
-    ks->bufsize = mb - 256;
+    ks->buffer = buffer;
+    ks->cpus = KTRACE_CPU;
+    ks->metasize = metasize;
+    ks->ncpus = ncpus;
+    ks->chunksize = chunksize;
+    for (uint32_t cpu = 0; cpu < ncpus; cpu++) {
+        KTRACE_CPU[cpu].buffer = buffer + metasize + cpu * kChunksPerCpu * chunksize;
+    }
 
-    dprintf(INFO, "ktrace: buffer at %p (%u bytes)\n", ks->buffer, mb);
+    dprintf(INFO, "ktrace: buffer at %p (%u bytes, %u cpus of %u x %u byte chunks)\n",
+            buffer, mb, ncpus, kChunksPerCpu, chunksize);
 
     // register all static probes
     {
@@ -219,7 +411,7 @@ void ktrace_init(unsigned level) {
 
     // write metadata to the first two event slots
     uint64_t n = ktrace_ticks_per_ms();
-    ktrace_rec_32b_t* rec = (ktrace_rec_32b_t*) ks->buffer;
+    ktrace_rec_32b_t* rec = (ktrace_rec_32b_t*) buffer;
     rec[0].tag = TAG_VERSION;
     rec[0].a = KTRACE_VERSION;
     rec[1].tag = TAG_TICKS_PER_MS;
@@ -227,17 +419,15 @@ void ktrace_init(unsigned level) {
     rec[1].b = (uint32_t)(n >> 32);
 
     // enable tracing
-    atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
-    ktrace_report_syscalls(kt_syscall_info);
-    ktrace_report_probes();
-    atomic_store(&ks->grpmask, KTRACE_GRP_TO_MASK(grpmask));
+    {
+        fbl::AutoLock lock(&ktrace_lock);
+        ktrace_reset(ks);
+        atomic_store(&ks->grpmask, KTRACE_GRP_TO_MASK(grpmask));
+    }
 
     // report names of existing threads
     ktrace_report_live_threads();
 
-    // report metadata for VCPUs
-    ktrace_report_vcpu_meta();
-
     // Report an event for "tracing is all set up now".  This also
     // serves to ensure that there will be at least one static probe
     // entry so that the __{start,stop}_ktrace_probe symbols above
@@ -245,20 +435,70 @@ void ktrace_init(unsigned level) {
     ktrace_probe0("ktrace_ready");
 }
 
+// Moves |kc| on to its next chunk, after the current one was filled up to
+// |off|.  Returns false if the record being written must be dropped instead.
+static bool ktrace_next_chunk(ktrace_state_t* ks, ktrace_cpu_t* kc, uint32_t off) {
+    uint64_t head = kc->head.load(fbl::memory_order_relaxed);
+    if (head + 1 - kc->tail.load(fbl::memory_order_acquire) == kChunksPerCpu) {
+        switch (ks->mode) {
+        case KTRACE_MODE_CIRCULAR:
+            // overwrite the oldest chunk
+            kc->tail.store(head + 2 - kChunksPerCpu, fbl::memory_order_relaxed);
+            break;
+        case KTRACE_MODE_STREAMING:
+            // the reader has yet to drain the oldest chunk
+            kc->dropped.fetch_add(1, fbl::memory_order_relaxed);
+            return false;
+        default:
+            // This cpu is done, but the others go on until their own rings
+            // fill, so that a busy cpu does not cut the trace short.
+            kc->dropped.fetch_add(1, fbl::memory_order_relaxed);
+            return false;
+        }
+    }
+    kc->len[head % kChunksPerCpu] = off;
+    kc->offset.store(0, fbl::memory_order_relaxed);
+    kc->head.store(head + 1, fbl::memory_order_release);
+    return true;
+}
+
+ktrace_header_t* ktrace_reserve_state(ktrace_state_t* ks, ktrace_cpu_t* kc, uint32_t tag,
+                                      uint32_t tid) {
+    const uint32_t len = KTRACE_LEN(tag);
+    uint32_t off = kc->offset.load(fbl::memory_order_relaxed);
+    if (off + len > ks->chunksize) {
+        if (!ktrace_next_chunk(ks, kc, off)) {
+            return nullptr;
+        }
+        off = 0;
+    }
+    ktrace_header_t* hdr = (ktrace_header_t*) (ktrace_chunk(ks, kc, kc->head.load(fbl::memory_order_relaxed)) +
+                              off);
+    hdr->ts = ktrace_timestamp();
+    hdr->tag = tag;
+    hdr->tid = tid;
+    kc->offset.store(off + len, fbl::memory_order_relaxed);
+    return hdr;
+}
+
+// Reserves space for a record on the current cpu and writes its header.
+static ktrace_header_t* ktrace_reserve(uint32_t tag, uint32_t tid) {
+    ktrace_state_t* ks = &KTRACE_STATE;
+
+    // With interrupts disabled nothing else writes to this cpu's ring, so
+    // the offset needs no atomic read-modify-write.
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    ktrace_header_t* hdr = ktrace_reserve_state(ks, &ks->cpus[arch_curr_cpu_num()], tag, tid);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    return hdr;
+}
+
 void ktrace_tiny(uint32_t tag, uint32_t arg) {
     ktrace_state_t* ks = &KTRACE_STATE;
     if (tag & atomic_load(&ks->grpmask)) {
         tag = (tag & 0xFFFFFFF0) | 2;
-        int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_HDRSIZE)) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
-        } else {
-            ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
-            hdr->ts = ktrace_timestamp();
-            hdr->tag = tag;
-            hdr->tid = arg;
-        }
+        ktrace_reserve(tag, arg);
     }
 }
 
@@ -268,18 +508,8 @@ void* ktrace_open(uint32_t tag) {
         return nullptr;
     }
 
-    int off;
-    if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-        // if we arrive at the end, stop
-        atomic_store(&ks->grpmask, 0);
-        return nullptr;
-    }
-
-    ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
-    hdr->ts = ktrace_timestamp();
-    hdr->tag = tag;
-    hdr->tid = (uint32_t)get_current_thread()->user_tid;
-    return hdr + 1;
+    ktrace_header_t* hdr = ktrace_reserve(tag, (uint32_t)get_current_thread()->user_tid);
+    return hdr ? hdr + 1 : nullptr;
 }
 
 void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char* name, bool always) {
@@ -290,18 +520,22 @@ void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char* name,
         // set size to: sizeof(hdr) + len + 1, round up to multiple of 8
         tag = (tag & 0xFFFFFFF0) | ((KTRACE_NAMESIZE + len + 1 + 7) >> 3);
 
-        int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
-        } else {
-            ktrace_rec_name_t* rec = (ktrace_rec_name_t*) (ks->buffer + off);
-            rec->tag = tag;
-            rec->id = id;
-            rec->arg = arg;
-            memcpy(rec->name, name, len);
-            rec->name[len] = 0;
-        }
+        // Names go to the metadata region, so that they outlive the records
+        // that refer to them.  Names that do not fit are dropped.
+        const uint32_t size = KTRACE_LEN(tag);
+        int off = atomic_load(&ks->offset);
+        do {
+            if (static_cast<uint32_t>(off) + size > ks->metasize) {
+                return;
+            }
+        } while (!atomic_cmpxchg(&ks->offset, &off, off + static_cast<int>(size)));
+
+        ktrace_rec_name_t* rec = (ktrace_rec_name_t*) (ks->buffer + off);
+        rec->tag = tag;
+        rec->id = id;
+        rec->arg = arg;
+        memcpy(rec->name, name, len);
+        rec->name[len] = 0;
     }
 }
 
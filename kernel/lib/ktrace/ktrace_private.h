@@ -0,0 +1,111 @@
+// Copyright 2018 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+// The trace buffer and the routines that manage it, exposed here only for
+// testing purposes. See ktrace.cpp for details.
+
+#pragma once
+
+#include <fbl/atomic.h>
+#include <kernel/align.h>
+#include <lib/zircon-internal/ktrace.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <zircon/types.h>
+
+// Each cpu writes its records to its own ring of this many chunks.  A chunk is
+// closed once the next record does not fit in it: a streaming read only drains
+// closed chunks, and a circular ring drops its oldest chunk when it wraps.
+static constexpr uint32_t kChunksPerCpu = 16;
+
+// The largest record, whose tag has all of the size bits set.
+static constexpr uint32_t kMaxRecordSize = KTRACE_LEN(0xF);
+
+typedef struct ktrace_cpu {
+    // this cpu's ring of kChunksPerCpu chunks
+    uint8_t* buffer;
+
+    // where the next record will be written in the head chunk; only the
+    // owning cpu writes it, with interrupts disabled
+    fbl::atomic<uint32_t> offset;
+
+    // monotonic chunk numbers: records go to the head chunk, and the chunks
+    // in [tail, head) are closed and hold len[n % kChunksPerCpu] bytes each
+    fbl::atomic<uint64_t> head;
+    fbl::atomic<uint64_t> tail;
+    uint32_t len[kChunksPerCpu];
+
+    // bytes of the tail chunk already consumed by streaming reads
+    uint32_t read_off;
+
+    // records dropped because the ring was full: in oneshot mode once it
+    // filled up, in streaming mode while the reader was behind
+    fbl::atomic<uint64_t> dropped;
+} __CPU_ALIGN ktrace_cpu_t;
+
+typedef struct ktrace_state {
+    // where the next metadata record will be written
+    int offset;
+
+    // mask of groups we allow, 0 == tracing disabled
+    int grpmask;
+
+    // one of KTRACE_MODE_*
+    uint32_t mode;
+
+    // size of the metadata region at the start of the buffer, which holds
+    // the version, tick rate and name records
+    uint32_t metasize;
+
+    // number of per-cpu rings after the metadata, and the size of their chunks
+    uint32_t ncpus;
+    uint32_t chunksize;
+
+    // set by KTRACE_ACTION_REWIND, so that the buffer is still readable
+    // until the next KTRACE_ACTION_START empties it
+    bool rewind_pending;
+
+    // metadata bytes already consumed by streaming reads
+    uint32_t meta_read;
+
+    // the source a streaming read resumes from: the metadata when 0,
+    // otherwise the ring of cpu (read_src - 1)
+    uint32_t read_src;
+
+    // raw trace buffer, and the rings of its |ncpus| cpus
+    uint8_t* buffer;
+    ktrace_cpu_t* cpus;
+} ktrace_state_t;
+
+// Copies |len| bytes of the trace to |dst|, e.g. arch_copy_to_user().
+typedef zx_status_t (*ktrace_copy_fn)(void* dst, const void* src, size_t len);
+
+// The routines below do the work of ktrace_read_user() and ktrace_control()
+// on the trace |ks|, without reporting any names to it.  Callers serialize
+// them with each other.
+
+ssize_t ktrace_read_state(ktrace_state_t* ks, ktrace_copy_fn copy, void* ptr, uint32_t off,
+                          size_t len);
+
+// Empties the rings, and drops all but the version and tick rate records from
+// the metadata.
+void ktrace_reset_state(ktrace_state_t* ks);
+
+// Starts tracing the groups in |grpmask|, emptying the trace first if it was
+// rewound.  Returns true if it was.
+bool ktrace_start_state(ktrace_state_t* ks, uint32_t grpmask);
+
+// Stops tracing and returns the number of records dropped since the trace
+// was last emptied.
+uint64_t ktrace_stop_state(ktrace_state_t* ks);
+
+// Reserves space for a record with |tag| on the ring |kc| of |ks| and writes
+// its header, or returns nullptr if the record is dropped.  Nothing else may
+// write to |kc| meanwhile; the rings of the live trace are only written by
+// their own cpus, with interrupts disabled.
+ktrace_header_t* ktrace_reserve_state(ktrace_state_t* ks, ktrace_cpu_t* kc, uint32_t tag,
+                                      uint32_t tid);
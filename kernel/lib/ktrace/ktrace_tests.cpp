@@ -0,0 +1,276 @@
+// Copyright 2018 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <fbl/alloc_checker.h>
+#include <fbl/unique_ptr.h>
+#include <lib/ktrace.h>
+#include <lib/unittest/unittest.h>
+#include <string.h>
+
+#include "ktrace_private.h"
+
+namespace {
+
+// A trace of two cpus, each with a ring of 8 records per chunk.
+constexpr uint32_t kTestCpus = 2;
+constexpr uint32_t kTestMetaSize = 256;
+constexpr uint32_t kTestChunkSize = 256;
+constexpr uint32_t kTestBufferSize = kTestMetaSize + kTestCpus * kChunksPerCpu * kTestChunkSize;
+
+constexpr uint32_t kTestTag = KTRACE_TAG_32B(1, KTRACE_GRP_PROBE);
+constexpr uint32_t kRecordsPerChunk = kTestChunkSize / KTRACE_LEN(kTestTag);
+constexpr uint32_t kRecordsPerCpu = kRecordsPerChunk * kChunksPerCpu;
+constexpr uint32_t kMaxRecords = kTestBufferSize / KTRACE_LEN(kTestTag);
+
+// The tid of each test record tells which cpu wrote it, and when.
+constexpr uint32_t test_tid(uint32_t cpu, uint32_t seq) {
+    return (cpu << 16) | seq;
+}
+
+ktrace_cpu_t test_cpus[kTestCpus];
+
+zx_status_t copy_to_kernel(void* dst, const void* src, size_t len) {
+    memcpy(dst, src, len);
+    return ZX_OK;
+}
+
+// Sets up a trace the way ktrace_init() sets up the live one, and reads it
+// back the way a client would.  The tests run one at a time, so they share
+// the per-cpu state.
+class TestTrace {
+public:
+    bool Init(uint32_t mode) {
+        fbl::AllocChecker ac;
+        buffer_.reset(new (&ac) uint8_t[kTestBufferSize]);
+        if (!ac.check()) {
+            return false;
+        }
+        read_buf_.reset(new (&ac) uint8_t[kTestBufferSize]);
+        if (!ac.check()) {
+            return false;
+        }
+        memset(buffer_.get(), 0, kTestBufferSize);
+
+        ks_ = {};
+        ks_.mode = mode;
+        ks_.metasize = kTestMetaSize;
+        ks_.ncpus = kTestCpus;
+        ks_.chunksize = kTestChunkSize;
+        ks_.buffer = buffer_.get();
+        ks_.cpus = test_cpus;
+        for (uint32_t cpu = 0; cpu < kTestCpus; cpu++) {
+            test_cpus[cpu].buffer = buffer_.get() + kTestMetaSize +
+                                    cpu * kChunksPerCpu * kTestChunkSize;
+        }
+
+        ktrace_rec_32b_t* rec = reinterpret_cast<ktrace_rec_32b_t*>(buffer_.get());
+        rec[0].tag = TAG_VERSION;
+        rec[0].a = KTRACE_VERSION;
+        rec[1].tag = TAG_TICKS_PER_MS;
+        ktrace_reset_state(&ks_);
+        return true;
+    }
+
+    ktrace_state_t* state() { return &ks_; }
+
+    // Writes record |seq| on |cpu|.  Returns false if it was dropped.
+    bool Write(uint32_t cpu, uint32_t seq) {
+        return ktrace_reserve_state(&ks_, &test_cpus[cpu], kTestTag, test_tid(cpu, seq)) !=
+               nullptr;
+    }
+
+    // Writes records |first| to |first| + |count| - 1 on |cpu|, and returns
+    // how many of them were kept.
+    uint32_t WriteMany(uint32_t cpu, uint32_t first, uint32_t count) {
+        uint32_t kept = 0;
+        for (uint32_t seq = first; seq < first + count; seq++) {
+            kept += Write(cpu, seq) ? 1 : 0;
+        }
+        return kept;
+    }
+
+    // Reads the trace, and collects the tids of the test records in it.
+    bool Read() {
+        count_ = 0;
+        ssize_t len = ktrace_read_state(&ks_, copy_to_kernel, read_buf_.get(), 0,
+                                        kTestBufferSize);
+        if (len < 0) {
+            return false;
+        }
+        for (size_t pos = 0; pos < static_cast<size_t>(len);) {
+            auto hdr = reinterpret_cast<const ktrace_header_t*>(read_buf_.get() + pos);
+            uint32_t size = KTRACE_LEN(hdr->tag);
+            if (size == 0 || pos + size > static_cast<size_t>(len)) {
+                return false;
+            }
+            if (hdr->tag == kTestTag && count_ < kMaxRecords) {
+                tids_[count_++] = hdr->tid;
+            }
+            pos += size;
+        }
+        return true;
+    }
+
+    uint32_t count() const { return count_; }
+
+    // Checks that the records read from |index| on are |count| consecutive
+    // ones of |cpu|, from |first| on.
+    bool HasRecords(uint32_t index, uint32_t cpu, uint32_t first, uint32_t count) const {
+        if (index + count > count_) {
+            return false;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            if (tids_[index + i] != test_tid(cpu, first + i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    fbl::unique_ptr<uint8_t[]> buffer_;
+    fbl::unique_ptr<uint8_t[]> read_buf_;
+    ktrace_state_t ks_;
+    uint32_t tids_[kMaxRecords];
+    uint32_t count_ = 0;
+};
+
+// A full ring stops only its own cpu.
+bool oneshot_fill() {
+    BEGIN_TEST;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<TestTrace> trace(new (&ac) TestTrace);
+    ASSERT_TRUE(ac.check(), "");
+    ASSERT_TRUE(trace->Init(KTRACE_MODE_ONESHOT), "");
+    ktrace_start_state(trace->state(), KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL));
+
+    EXPECT_EQ(kRecordsPerCpu, trace->WriteMany(0, 0, kRecordsPerCpu + 10), "");
+    EXPECT_NE(0, trace->state()->grpmask, "tracing stopped with one ring full");
+    EXPECT_EQ(kRecordsPerChunk, trace->WriteMany(1, 0, kRecordsPerChunk), "");
+    EXPECT_FALSE(trace->Write(0, kRecordsPerCpu + 10), "");
+    EXPECT_EQ(11u, ktrace_stop_state(trace->state()), "");
+
+    ASSERT_TRUE(trace->Read(), "");
+    EXPECT_EQ(kRecordsPerCpu + kRecordsPerChunk, trace->count(), "");
+    EXPECT_TRUE(trace->HasRecords(0, 0, 0, kRecordsPerCpu), "");
+    EXPECT_TRUE(trace->HasRecords(kRecordsPerCpu, 1, 0, kRecordsPerChunk), "");
+
+    END_TEST;
+}
+
+// A circular ring overwrites its oldest chunk, and keeps the newest records
+// in order.
+bool circular_wrap() {
+    BEGIN_TEST;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<TestTrace> trace(new (&ac) TestTrace);
+    ASSERT_TRUE(ac.check(), "");
+    ASSERT_TRUE(trace->Init(KTRACE_MODE_CIRCULAR), "");
+    ktrace_start_state(trace->state(), KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL));
+
+    // Several times around the ring, ending halfway through a chunk: the
+    // ring holds the chunk being written and the ones before it.
+    const uint32_t total = kRecordsPerCpu * 3 + kRecordsPerChunk / 2;
+    EXPECT_EQ(total, trace->WriteMany(0, 0, total), "");
+    EXPECT_EQ(2u, trace->WriteMany(1, 0, 2), "");
+    EXPECT_EQ(0u, ktrace_stop_state(trace->state()), "nothing is dropped");
+
+    const uint32_t kept = (kChunksPerCpu - 1) * kRecordsPerChunk + kRecordsPerChunk / 2;
+    ASSERT_TRUE(trace->Read(), "");
+    EXPECT_EQ(kept + 2, trace->count(), "");
+    EXPECT_TRUE(trace->HasRecords(0, 0, total - kept, kept), "");
+    EXPECT_TRUE(trace->HasRecords(kept, 1, 0, 2), "");
+
+    END_TEST;
+}
+
+// A streaming read drains the closed chunks, which lets their cpu go on once
+// it was dropping records, and picks up where it left off.
+bool streaming_drain() {
+    BEGIN_TEST;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<TestTrace> trace(new (&ac) TestTrace);
+    ASSERT_TRUE(ac.check(), "");
+    ASSERT_TRUE(trace->Init(KTRACE_MODE_STREAMING), "");
+    ktrace_start_state(trace->state(), KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL));
+
+    // With the reader behind, the ring fills and further records are dropped.
+    EXPECT_EQ(kRecordsPerCpu, trace->WriteMany(0, 0, kRecordsPerCpu + 5), "");
+    EXPECT_FALSE(trace->Write(0, kRecordsPerCpu + 5), "");
+
+    // A null read reports the bytes ready: all but the chunk being written.
+    const uint32_t closed = kRecordsPerCpu - kRecordsPerChunk;
+    EXPECT_EQ(static_cast<ssize_t>(2 * KTRACE_RECSIZE + closed * KTRACE_LEN(kTestTag)),
+              ktrace_read_state(trace->state(), copy_to_kernel, nullptr, 0, 0), "");
+
+    ASSERT_TRUE(trace->Read(), "");
+    EXPECT_EQ(closed, trace->count(), "");
+    EXPECT_TRUE(trace->HasRecords(0, 0, 0, closed), "");
+
+    // There is room again, and the drained records are not read twice.
+    const uint32_t next = kRecordsPerCpu + 6;
+    EXPECT_EQ(kRecordsPerChunk, trace->WriteMany(0, next, kRecordsPerChunk), "");
+    ASSERT_TRUE(trace->Read(), "");
+    EXPECT_EQ(kRecordsPerChunk, trace->count(), "");
+    EXPECT_TRUE(trace->HasRecords(0, 0, closed, kRecordsPerChunk), "");
+
+    // Stopping counts the drops, and the chunk being written is read too.
+    EXPECT_EQ(6u, ktrace_stop_state(trace->state()), "");
+    ASSERT_TRUE(trace->Read(), "");
+    EXPECT_EQ(kRecordsPerChunk, trace->count(), "");
+    EXPECT_TRUE(trace->HasRecords(0, 0, next, kRecordsPerChunk), "");
+    ASSERT_TRUE(trace->Read(), "");
+    EXPECT_EQ(0u, trace->count(), "");
+
+    END_TEST;
+}
+
+// A rewound trace stays readable, and is only emptied when tracing starts
+// again.
+bool rewind_then_start() {
+    BEGIN_TEST;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<TestTrace> trace(new (&ac) TestTrace);
+    ASSERT_TRUE(ac.check(), "");
+    ASSERT_TRUE(trace->Init(KTRACE_MODE_ONESHOT), "");
+    EXPECT_FALSE(ktrace_start_state(trace->state(), KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL)), "");
+
+    EXPECT_EQ(kRecordsPerCpu, trace->WriteMany(0, 0, kRecordsPerCpu + 1), "");
+    EXPECT_EQ(3u, trace->WriteMany(1, 0, 3), "");
+    EXPECT_EQ(1u, ktrace_stop_state(trace->state()), "");
+    trace->state()->rewind_pending = true;
+
+    ASSERT_TRUE(trace->Read(), "");
+    EXPECT_EQ(kRecordsPerCpu + 3, trace->count(), "");
+
+    EXPECT_TRUE(ktrace_start_state(trace->state(), KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL)), "");
+    ASSERT_TRUE(trace->Read(), "");
+    EXPECT_EQ(0u, trace->count(), "");
+
+    // The emptied rings have all of their room again.
+    EXPECT_EQ(kRecordsPerCpu, trace->WriteMany(0, 100, kRecordsPerCpu), "");
+    EXPECT_EQ(2u, trace->WriteMany(1, 100, 2), "");
+    EXPECT_EQ(0u, ktrace_stop_state(trace->state()), "");
+    ASSERT_TRUE(trace->Read(), "");
+    EXPECT_EQ(kRecordsPerCpu + 2, trace->count(), "");
+    EXPECT_TRUE(trace->HasRecords(0, 0, 100, kRecordsPerCpu), "");
+    EXPECT_TRUE(trace->HasRecords(kRecordsPerCpu, 1, 100, 2), "");
+
+    END_TEST;
+}
+
+} // namespace
+
+UNITTEST_START_TESTCASE(ktrace_tests)
+UNITTEST("oneshot stops only the full cpu", oneshot_fill)
+UNITTEST("circular wraps around", circular_wrap)
+UNITTEST("streaming drains and drops", streaming_drain)
+UNITTEST("rewind then start", rewind_then_start)
+UNITTEST_END_TESTCASE(ktrace_tests, "ktrace", "ktrace tests");
@@ -6,6 +6,73 @@
 
 #include <object/buffer_chain.h>
 
+#include <arch/ops.h>
+#include <kernel/align.h>
+#include <kernel/lockdep.h>
+#include <kernel/spinlock.h>
+#include <lib/counters.h>
+
+KCOUNTER(buffer_cache_hit, "kernel.channel.buffer_cache.hit");
+KCOUNTER(buffer_cache_miss, "kernel.channel.buffer_cache.miss");
+KCOUNTER(buffer_cache_recycle, "kernel.channel.buffer_cache.recycle");
+KCOUNTER(buffer_cache_overflow, "kernel.channel.buffer_cache.overflow");
+
+namespace {
+
+// The number of chains each cpu holds on to for each chain length. Single buffer chains are by
+// far the most common and get the deepest stack. Altogether a cpu pins down at most 60 pages.
+constexpr size_t kClassCapacity[BufferChain::kNumSizeClasses] = {16, 8, 4, 4};
+constexpr size_t kMaxClassCapacity = 16;
+
+// A cpu's stacks of recycled chains, one per chain length.
+//
+// Recycled chains are kept whole: their pages stay in the VM_PAGE_STATE_IPC state and their
+// Buffers stay constructed and linked, so reusing one is a pop off a stack. Most recently freed
+// chains are handed out first, they are the most likely to still be cache hot.
+struct ChainCache {
+    DECLARE_SPINLOCK(ChainCache) lock;
+    BufferChain* chains[BufferChain::kNumSizeClasses][kMaxClassCapacity] TA_GUARDED(lock) = {};
+    size_t count[BufferChain::kNumSizeClasses] TA_GUARDED(lock) = {};
+} __CPU_ALIGN;
+
+ChainCache chain_cache[SMP_MAX_CPUS];
+
+size_t NumBuffers(size_t size) {
+    size += sizeof(BufferChain);
+    return (size + BufferChain::kRawDataSize - 1) / BufferChain::kRawDataSize;
+}
+
+// Pops a chain of |num_buffers| buffers off the current cpu's cache, if it has one.
+BufferChain* TakeCachedChain(size_t num_buffers) {
+    const size_t cls = num_buffers - 1;
+
+    // We may migrate between picking the cache and locking it, which only costs locality.
+    ChainCache* cache = &chain_cache[arch_curr_cpu_num()];
+    Guard<SpinLock, IrqSave> guard{&cache->lock};
+
+    if (cache->count[cls] == 0) {
+        return nullptr;
+    }
+    return cache->chains[cls][--cache->count[cls]];
+}
+
+// Pushes |chain| of |num_buffers| buffers onto the current cpu's cache. Returns false if the
+// cache for that length is full.
+bool PutCachedChain(BufferChain* chain, size_t num_buffers) {
+    const size_t cls = num_buffers - 1;
+
+    ChainCache* cache = &chain_cache[arch_curr_cpu_num()];
+    Guard<SpinLock, IrqSave> guard{&cache->lock};
+
+    if (cache->count[cls] == kClassCapacity[cls]) {
+        return false;
+    }
+    cache->chains[cls][cache->count[cls]++] = chain;
+    return true;
+}
+
+} // namespace
+
 // Makes a const void* look like a user_in_ptr<const void>.
 //
 // Sometimes we need to copy data from kernel space. KernelPtrAdapter allows us to implement the
@@ -26,6 +93,82 @@ private:
     const void* p_;
 };
 
+// static
+BufferChain* BufferChain::Alloc(size_t size) {
+    const size_t num_buffers = NumBuffers(size);
+
+    if (num_buffers <= kNumSizeClasses) {
+        BufferChain* chain = TakeCachedChain(num_buffers);
+        if (chain) {
+            kcounter_add(buffer_cache_hit, 1);
+            return chain;
+        }
+        kcounter_add(buffer_cache_miss, 1);
+    }
+
+    // Allocate a list of pages.
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    zx_status_t status = pmm_alloc_pages(num_buffers, 0, &pages);
+    if (unlikely(status != ZX_OK)) {
+        return nullptr;
+    }
+
+    // Construct a Buffer in each page and add them to a temporary list.
+    BufferChain::BufferList temp;
+    vm_page_t* page;
+    list_for_every_entry (&pages, page, vm_page_t, queue_node) {
+        DEBUG_ASSERT(page->state == VM_PAGE_STATE_ALLOC);
+        page->state = VM_PAGE_STATE_IPC;
+        void* va = paddr_to_physmap(page->paddr());
+        temp.push_front(new (va) BufferChain::Buffer);
+    }
+
+    // We now have a list of buffers and a list of pages.  Construct a chain inside the first
+    // buffer and give the buffers and pages to the chain.
+    BufferChain* chain = new (temp.front().data()) BufferChain(&temp, &pages);
+    DEBUG_ASSERT(list_is_empty(&pages));
+
+    return chain;
+}
+
+// static
+void BufferChain::Free(BufferChain* chain) {
+    const size_t num_buffers = list_length(&chain->pages_);
+
+    if (num_buffers <= kNumSizeClasses) {
+        if (PutCachedChain(chain, num_buffers)) {
+            kcounter_add(buffer_cache_recycle, 1);
+            return;
+        }
+        kcounter_add(buffer_cache_overflow, 1);
+    }
+
+    // Remove the buffers and vm_page_t's from the chain *before* destroying it.
+    BufferChain::BufferList buffers(ktl::move(*chain->buffers()));
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    list_move(&chain->pages_, &pages);
+
+    chain->~BufferChain();
+
+    while (!buffers.is_empty()) {
+        BufferChain::Buffer* buf = buffers.pop_front();
+        buf->Buffer::~Buffer();
+    }
+    pmm_free(&pages);
+}
+
+// static
+size_t BufferChain::CachedChainCount(size_t num_buffers) {
+    DEBUG_ASSERT(num_buffers > 0);
+    if (num_buffers > kNumSizeClasses) {
+        return 0;
+    }
+
+    ChainCache* cache = &chain_cache[arch_curr_cpu_num()];
+    Guard<SpinLock, IrqSave> guard{&cache->lock};
+    return cache->count[num_buffers - 1];
+}
+
 zx_status_t BufferChain::CopyInKernel(const void* src, size_t dst_offset, size_t size) {
     return CopyInCommon(KernelPtrAdapter(src), dst_offset, size);
 }
@@ -6,6 +6,10 @@
 
 #include <object/buffer_chain.h>
 
+#include <arch/ops.h>
+#include <fbl/auto_call.h>
+#include <kernel/cpu.h>
+#include <kernel/thread.h>
 #include <lib/unittest/unittest.h>
 #include <lib/unittest/user_memory.h>
 #include <lib/user_copy/user_ptr.h>
@@ -56,6 +60,70 @@ static bool alloc_free_basic() {
     END_TEST;
 }
 
+// Checks that short chains are recycled whole through the current cpu's cache, which stops
+// growing once full, and that long chains bypass it.
+static bool alloc_free_recycle() {
+    BEGIN_TEST;
+
+    // Stay on one cpu so every Alloc and Free below goes through the same cache.
+    thread_t* const current = get_current_thread();
+    const cpu_mask_t old_affinity = current->cpu_affinity;
+    thread_set_cpu_affinity(current, cpu_num_to_mask(arch_curr_cpu_num()));
+    auto restore_affinity = fbl::MakeAutoCall([current, old_affinity]() {
+        thread_set_cpu_affinity(current, old_affinity);
+    });
+
+    constexpr size_t kNumChains = 32;
+    BufferChain* chains[kNumChains];
+
+    // Empty the cache of two buffer chains.
+    const size_t two_buffers = BufferChain::kContig + 1;
+    size_t held = 0;
+    while (BufferChain::CachedChainCount(2) > 0) {
+        ASSERT_LT(held, kNumChains, "");
+        chains[held] = BufferChain::Alloc(two_buffers);
+        ASSERT_NE(chains[held], nullptr, "");
+        held++;
+    }
+
+    // A freed chain is kept, and handed out again as is.
+    BufferChain* bc = BufferChain::Alloc(two_buffers);
+    ASSERT_NE(bc, nullptr, "");
+    BufferChain::Free(bc);
+    EXPECT_EQ(BufferChain::CachedChainCount(2), 1u, "");
+    BufferChain* recycled = BufferChain::Alloc(two_buffers);
+    EXPECT_EQ(recycled, bc, "");
+    EXPECT_EQ(BufferChain::CachedChainCount(2), 0u, "");
+
+    // It comes back with nothing reserved beyond the chain itself.
+    ASSERT_EQ(recycled->buffers()->size_slow(), 2u, "");
+    EXPECT_EQ(recycled->buffers()->front().size(),
+              BufferChain::kRawDataSize - sizeof(BufferChain), "");
+    EXPECT_EQ((++recycled->buffers()->begin())->size(), BufferChain::kRawDataSize, "");
+    BufferChain::Free(recycled);
+
+    // Freeing many chains fills the cache, but no further.
+    for (; held < kNumChains; held++) {
+        chains[held] = BufferChain::Alloc(two_buffers);
+        ASSERT_NE(chains[held], nullptr, "");
+    }
+    for (size_t i = 0; i < kNumChains; i++) {
+        BufferChain::Free(chains[i]);
+    }
+    EXPECT_GT(BufferChain::CachedChainCount(2), 0u, "");
+    EXPECT_LT(BufferChain::CachedChainCount(2), kNumChains, "");
+
+    // Chains longer than the largest size class go straight back to the PMM.
+    const size_t long_chain = BufferChain::kNumSizeClasses * BufferChain::kRawDataSize;
+    bc = BufferChain::Alloc(long_chain);
+    ASSERT_NE(bc, nullptr, "");
+    ASSERT_EQ(bc->buffers()->size_slow(), BufferChain::kNumSizeClasses + 1, "");
+    BufferChain::Free(bc);
+    EXPECT_EQ(BufferChain::CachedChainCount(BufferChain::kNumSizeClasses + 1), 0u, "");
+
+    END_TEST;
+}
+
 static bool copy_in_copy_out() {
     BEGIN_TEST;
 
@@ -142,5 +210,6 @@ static bool copy_in_copy_out() {
 
 UNITTEST_START_TESTCASE(buffer_chain_tests)
 UNITTEST("alloc_free_basic", alloc_free_basic)
+UNITTEST("alloc_free_recycle", alloc_free_recycle)
 UNITTEST("copy_in_copy_out", copy_in_copy_out)
 UNITTEST_END_TESTCASE(buffer_chain_tests, "buffer_chain", "BufferChain tests");
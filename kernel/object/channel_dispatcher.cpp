@@ -272,7 +272,9 @@ alloc_txid:
         // waiter to the list.
         waiters_.push_back(waiter);
 
-        // (1) Write outbound message to opposing endpoint.
+        // (1) Write outbound message to opposing endpoint.  We are about to wait for the reply,
+        // so if that wakes up a server thread, let it have this cpu.
+        AutoHandoffWakeup handoff;
         peer_->WriteSelf(ktl::move(msg));
     }
 
@@ -337,6 +339,9 @@ void ChannelDispatcher::WriteSelf(MessagePacketPtr msg) {
             // Remove waiter from list.
             if (waiter.get_txid() == txid) {
                 waiters_.erase(waiter);
+                // Hand the cpu back to the caller.  The replying thread is switched out once it
+                // drops the channel lock, rather than having the caller wait behind it.
+                AutoHandoffWakeup handoff(AutoHandoffWakeup::Mode::Yield);
                 waiter.Deliver(ktl::move(msg));
                 return;
             }
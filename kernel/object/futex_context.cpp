@@ -23,7 +23,9 @@ FutexContext::~FutexContext() {
 
     // All of the threads should have removed themselves from wait queues
     // by the time the process has exited.
-    DEBUG_ASSERT(futex_table_.is_empty());
+    for (const auto& bucket : buckets_) {
+        DEBUG_ASSERT(bucket.futex_table.is_empty());
+    }
 }
 
 zx_status_t FutexContext::FutexWait(user_in_ptr<const zx_futex_t> value_ptr,
@@ -47,7 +49,8 @@ zx_status_t FutexContext::FutexWait(user_in_ptr<const zx_futex_t> value_ptr,
     // If a FutexWake() operation could occur between them, a userland mutex
     // operation built on top of futexes would have a race condition that
     // could miss wakeups.
-    Guard<fbl::Mutex> guard{&lock_};
+    Bucket* bucket = BucketFor(futex_key);
+    Guard<fbl::Mutex> guard{&bucket->lock};
 
     int value;
     zx_status_t result = value_ptr.copy_from_user(&value);
@@ -62,9 +65,9 @@ zx_status_t FutexContext::FutexWait(user_in_ptr<const zx_futex_t> value_ptr,
     node.set_hash_key(futex_key);
     node.SetAsSingletonList();
 
-    QueueNodesLocked(&node);
+    QueueNodesLocked(bucket, &node);
 
-    // Block current thread.  This releases lock_ and does not reacquire it.
+    // Block current thread.  This releases the bucket lock and does not reacquire it.
     result = node.BlockThread(guard.take(), deadline, slack);
     if (result == ZX_OK) {
         DEBUG_ASSERT(!node.IsInQueue());
@@ -78,9 +81,21 @@ zx_status_t FutexContext::FutexWait(user_in_ptr<const zx_futex_t> value_ptr,
     //
     // We need to ensure that the thread's node is removed from the wait
     // queue, because FutexWake() probably didn't do that.
-    Guard<fbl::Mutex> guard2{&lock_};
-    if (UnqueueNodeLocked(&node)) {
-        return result;
+    //
+    // A FutexRequeue() may have moved the node to a futex in another bucket
+    // meanwhile.  Requeues change the key with the locks of both buckets held,
+    // so once the key read under a bucket's lock still maps to that bucket it
+    // cannot change under us.
+    for (;;) {
+        bucket = BucketFor(node.GetKey());
+        Guard<fbl::Mutex> guard2{&bucket->lock};
+        if (BucketFor(node.GetKey()) != bucket) {
+            continue;
+        }
+        if (UnqueueNodeLocked(bucket, &node)) {
+            return result;
+        }
+        break;
     }
     // The current thread was not found on the wait queue.  This means
     // that, although we hit the deadline (or were suspended/killed), we
@@ -117,11 +132,13 @@ zx_status_t FutexContext::FutexWake(user_in_ptr<const zx_futex_t> value_ptr,
     if (futex_key % sizeof(int))
         return ZX_ERR_INVALID_ARGS;
 
+    Bucket* bucket = BucketFor(futex_key);
+
     AutoReschedDisable resched_disable; // Must come before the Guard.
     resched_disable.Disable();
-    Guard<fbl::Mutex> guard{&lock_};
+    Guard<fbl::Mutex> guard{&bucket->lock};
 
-    FutexNode* node = futex_table_.erase(futex_key);
+    FutexNode* node = bucket->futex_table.erase(futex_key);
     if (!node) {
         // nothing blocked on this futex if we can't find it
         return ZX_OK;
@@ -133,7 +150,7 @@ zx_status_t FutexContext::FutexWake(user_in_ptr<const zx_futex_t> value_ptr,
 
     if (remaining_waiters) {
         DEBUG_ASSERT(remaining_waiters->GetKey() == futex_key);
-        futex_table_.insert(remaining_waiters);
+        bucket->futex_table.insert(remaining_waiters);
     }
 
     return ZX_OK;
@@ -159,24 +176,50 @@ zx_status_t FutexContext::FutexRequeue(user_in_ptr<const zx_futex_t> wake_ptr,
         return ZX_ERR_INVALID_ARGS;
     }
 
+    uintptr_t wake_key = reinterpret_cast<uintptr_t>(wake_ptr.get());
+    uintptr_t requeue_key = reinterpret_cast<uintptr_t>(requeue_ptr.get());
+    if (wake_key == requeue_key) return ZX_ERR_INVALID_ARGS;
+    if (wake_key % sizeof(int) || requeue_key % sizeof(int))
+        return ZX_ERR_INVALID_ARGS;
+
+    Bucket* wake_bucket = BucketFor(wake_key);
+    Bucket* requeue_bucket = BucketFor(requeue_key);
+
     AutoReschedDisable resched_disable; // Must come before the Guard.
-    Guard<fbl::Mutex> guard{&lock_};
+    if (wake_bucket == requeue_bucket) {
+        Guard<fbl::Mutex> guard{&wake_bucket->lock};
+        return RequeueLocked(wake_ptr, wake_count, current_value, requeue_key, requeue_count,
+                             &resched_disable);
+    }
+
+    // GuardMultiple takes the two bucket locks in address order, so
+    // concurrent requeues in opposite directions cannot deadlock.
+    GuardMultiple<2, fbl::Mutex> guard{&wake_bucket->lock, &requeue_bucket->lock};
+    return RequeueLocked(wake_ptr, wake_count, current_value, requeue_key, requeue_count,
+                         &resched_disable);
+}
+
+zx_status_t FutexContext::RequeueLocked(user_in_ptr<const zx_futex_t> wake_ptr,
+                                        uint32_t wake_count,
+                                        zx_futex_t current_value,
+                                        uintptr_t requeue_key,
+                                        uint32_t requeue_count,
+                                        AutoReschedDisable* resched_disable) {
+    uintptr_t wake_key = reinterpret_cast<uintptr_t>(wake_ptr.get());
+    Bucket* wake_bucket = BucketFor(wake_key);
+    Bucket* requeue_bucket = BucketFor(requeue_key);
+    DEBUG_ASSERT(wake_bucket->lock.lock().IsHeld());
+    DEBUG_ASSERT(requeue_bucket->lock.lock().IsHeld());
 
     int value;
     zx_status_t result = wake_ptr.copy_from_user(&value);
     if (result != ZX_OK) return result;
     if (value != current_value) return ZX_ERR_BAD_STATE;
 
-    uintptr_t wake_key = reinterpret_cast<uintptr_t>(wake_ptr.get());
-    uintptr_t requeue_key = reinterpret_cast<uintptr_t>(requeue_ptr.get());
-    if (wake_key == requeue_key) return ZX_ERR_INVALID_ARGS;
-    if (wake_key % sizeof(int) || requeue_key % sizeof(int))
-        return ZX_ERR_INVALID_ARGS;
-
     // This must happen before RemoveFromHead() calls set_hash_key() on
-    // nodes below, because operations on futex_table_ look at the GetKey
+    // nodes below, because operations on futex_table look at the GetKey
     // field of the list head nodes for wake_key and requeue_key.
-    FutexNode* node = futex_table_.erase(wake_key);
+    FutexNode* node = wake_bucket->futex_table.erase(wake_key);
     if (!node) {
         // nothing blocked on this futex if we can't find it
         return ZX_OK;
@@ -184,7 +227,7 @@ zx_status_t FutexContext::FutexRequeue(user_in_ptr<const zx_futex_t> wake_ptr,
 
     // This must come before WakeThreads() to be useful, but we want to
     // avoid doing it before copy_from_user() in case that faults.
-    resched_disable.Disable();
+    resched_disable->Disable();
 
     if (wake_count > 0) {
         node = FutexNode::WakeThreads(node, wake_count, wake_key);
@@ -200,14 +243,14 @@ zx_status_t FutexContext::FutexRequeue(user_in_ptr<const zx_futex_t> wake_ptr,
 
             // now requeue our nodes to requeue_ptr mutex
             DEBUG_ASSERT(requeue_head->GetKey() == requeue_key);
-            QueueNodesLocked(requeue_head);
+            QueueNodesLocked(requeue_bucket, requeue_head);
         }
     }
 
     // add any remaining nodes back to wake_key futex
     if (node != nullptr) {
         DEBUG_ASSERT(node->GetKey() == wake_key);
-        futex_table_.insert(node);
+        wake_bucket->futex_table.insert(node);
     }
 
     return ZX_OK;
@@ -218,8 +261,8 @@ zx_status_t FutexContext::FutexGetOwner(user_in_ptr<const zx_futex_t> wake_ptr,
     return koid.copy_to_user(ZX_KOID_INVALID);
 }
 
-void FutexContext::QueueNodesLocked(FutexNode* head) {
-    DEBUG_ASSERT(lock_.lock().IsHeld());
+void FutexContext::QueueNodesLocked(Bucket* bucket, FutexNode* head) {
+    DEBUG_ASSERT(bucket->lock.lock().IsHeld());
 
     FutexNode::HashTable::iterator iter;
 
@@ -227,15 +270,15 @@ void FutexContext::QueueNodesLocked(FutexNode* head) {
     // succeeds, then the current thread is first to block on this futex and we
     // are finished.  If the insert fails, then there is already a thread
     // waiting on this futex.  Add ourselves to that thread's list.
-    if (!futex_table_.insert_or_find(head, &iter))
+    if (!bucket->futex_table.insert_or_find(head, &iter))
         iter->AppendList(head);
 }
 
 // This attempts to unqueue a thread (which may or may not be waiting on a
 // futex), given its FutexNode.  This returns whether the FutexNode was
 // found and removed from a futex wait queue.
-bool FutexContext::UnqueueNodeLocked(FutexNode* node) {
-    DEBUG_ASSERT(lock_.lock().IsHeld());
+bool FutexContext::UnqueueNodeLocked(Bucket* bucket, FutexNode* node) {
+    DEBUG_ASSERT(bucket->lock.lock().IsHeld());
 
     if (!node->IsInQueue())
         return false;
@@ -246,10 +289,10 @@ bool FutexContext::UnqueueNodeLocked(FutexNode* node) {
     // FutexRequeue(), so we need to re-get the hash table key here.
     uintptr_t futex_key = node->GetKey();
 
-    FutexNode* old_head = futex_table_.erase(futex_key);
+    FutexNode* old_head = bucket->futex_table.erase(futex_key);
     DEBUG_ASSERT(old_head);
     FutexNode* new_head = FutexNode::RemoveNodeFromList(old_head, node);
     if (new_head)
-        futex_table_.insert(new_head);
+        bucket->futex_table.insert(new_head);
     return true;
 }
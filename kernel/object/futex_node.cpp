@@ -83,8 +83,8 @@ FutexNode* FutexNode::WakeThreads(FutexNode* node, uint32_t count,
     FutexNode* const list_end = node->queue_prev_;
     for (uint32_t i = 0; i < count; i++) {
         DEBUG_ASSERT(node->GetKey() == old_hash_key);
-        // Clear this field to avoid any possible confusion.
-        node->set_hash_key(0);
+        // The key is left alone: a waiter that timed out at the same time
+        // uses it to pick the bucket lock under which it observes this wake.
 
         const bool is_last_node = (node == list_end);
         FutexNode* next = node->queue_next_;
@@ -154,7 +154,7 @@ zx_status_t FutexNode::BlockThread(Guard<fbl::Mutex>&& adopt_guard,
     // frame. The runtime validator state is not affected by the adoption.
     Guard<fbl::Mutex> guard{AdoptLock, ktl::move(adopt_guard)};
 
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
     ThreadDispatcher::AutoBlocked by(ThreadDispatcher::Blocked::FUTEX);
 
     // We specifically want reschedule=MutexPolicy::NoReschedule here, otherwise
@@ -187,7 +187,7 @@ void FutexNode::WakeThread() {
     // We must do this before we wake the thread, to handle case 2.
     MarkAsNotInQueue();
 
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
     wait_queue_.WakeOne(/* reschedule */ true, ZX_OK);
 }
 
@@ -6,6 +6,10 @@
 
 #include <object/handle.h>
 
+#include <arch/ops.h>
+#include <kernel/align.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
 #include <object/dispatcher.h>
 #include <fbl/arena.h>
 #include <fbl/mutex.h>
@@ -25,6 +29,8 @@ KCOUNTER(handle_count_made, "kernel.handles.made");
 KCOUNTER(handle_count_duped, "kernel.handles.duped");
 KCOUNTER(handle_count_live, "kernel.handles.live");
 KCOUNTER(handle_count_max_live, "kernel.handles.max_live");
+KCOUNTER(handle_cache_miss, "kernel.handles.cache.miss");
+KCOUNTER(handle_cache_overflow, "kernel.handles.cache.overflow");
 
 // Masks for building a Handle's base_value, which ProcessDispatcher
 // uses to create zx_handle_t values.
@@ -49,11 +55,125 @@ static_assert(((3 << 30) ^ kHandleGenerationMask ^ kHandleIndexMask) ==
                   0xffffffffu,
               "Masks do not agree");
 
+// Marks the base_value held in the upper half of Handle::lookup_state_ as
+// belonging to a live Handle. base_value bit 31 is always zero, so this also
+// keeps a live Handle with base_value 0 from matching a free slot.
+constexpr uint64_t kLookupLive = 1ull << 31;
+constexpr uint64_t kLookupCountMask = 0xffffffffull;
+
+constexpr uint64_t LiveLookupState(uint32_t base_value) {
+    return (base_value | kLookupLive) << 32;
+}
+
+// The number of free slots moved between a cpu's cache and the arena at
+// once. Each cpu holds at most two batches, so creating and closing handles
+// only takes ArenaLock about once per batch, and a few idle cpus can't
+// starve the rest of the arena.
+constexpr size_t kSlotBatch = 32;
+
+// The number of live handles, including ones whose slots came from a cache.
+fbl::atomic<size_t> outstanding_handles{0};
+
 }  // namespace
 
+// A torn-down slot on a cpu's free list. The first word still holds the
+// base_value stashed by TearDown, and concurrent lookups may read the slot's
+// base_value_ and lookup_state_, so the link lives in the Handle's list node,
+// which nothing reads while the slot is free.
+struct Handle::FreeSlot {
+    uint32_t stashed_base_value;
+    FreeSlot* next;
+};
+
+// A cpu's free handle slots, kept as a batch being handed out and a full
+// spare batch. A cpu which only closes handles fills the spare and then
+// returns whole batches to the arena; one which only creates them drains
+// the spare before going back to the arena. Most recently freed slots are
+// handed out first, they are the most likely to still be cache hot.
+class Handle::SlotCache {
+public:
+    // Returns the current cpu's cache. Callers don't pin themselves to the
+    // cpu, since a slot is as good on any cpu as on the one that freed it.
+    static SlotCache& Current() { return slot_caches_[arch_curr_cpu_num()]; }
+
+    // Takes a free slot from any cpu's cache. Used when the arena has run
+    // dry but other cpus may still be holding free slots.
+    static FreeSlot* Steal();
+
+    FreeSlot* Take() {
+        Guard<SpinLock, IrqSave> guard{&lock_};
+        if (loaded_count_ == 0) {
+            if (!spare_)
+                return nullptr;
+            loaded_ = spare_;
+            loaded_count_ = kSlotBatch;
+            spare_ = nullptr;
+        }
+        FreeSlot* slot = loaded_;
+        loaded_ = slot->next;
+        --loaded_count_;
+        return slot;
+    }
+
+    // Adds |slot| to the cache. If that leaves the cache with more than two
+    // batches, returns the older full one for the caller to give back to
+    // the arena.
+    FreeSlot* Put(FreeSlot* slot) {
+        Guard<SpinLock, IrqSave> guard{&lock_};
+        FreeSlot* full = nullptr;
+        if (loaded_count_ == kSlotBatch) {
+            full = spare_;
+            spare_ = loaded_;
+            loaded_ = nullptr;
+            loaded_count_ = 0;
+        }
+        slot->next = loaded_;
+        loaded_ = slot;
+        ++loaded_count_;
+        return full;
+    }
+
+    // Hands out |batch|, |count| slots fresh from the arena, from now on.
+    // Fails if the cache is not empty, which happens when another thread
+    // refilled it first or the caller has migrated.
+    bool Refill(FreeSlot* batch, size_t count) {
+        Guard<SpinLock, IrqSave> guard{&lock_};
+        if (loaded_count_ != 0 || spare_)
+            return false;
+        loaded_ = batch;
+        loaded_count_ = count;
+        return true;
+    }
+
+    size_t count() {
+        Guard<SpinLock, IrqSave> guard{&lock_};
+        return loaded_count_ + (spare_ ? kSlotBatch : 0);
+    }
+
+private:
+    DECLARE_SPINLOCK(SlotCache) lock_;
+    FreeSlot* loaded_ TA_GUARDED(lock_) = nullptr;
+    size_t loaded_count_ TA_GUARDED(lock_) = 0;
+    FreeSlot* spare_ TA_GUARDED(lock_) = nullptr;
+} __CPU_ALIGN;
+
+Handle::SlotCache Handle::slot_caches_[SMP_MAX_CPUS];
+
+Handle::FreeSlot* Handle::SlotCache::Steal() {
+    for (SlotCache& cache : slot_caches_) {
+        FreeSlot* slot = cache.Take();
+        if (slot)
+            return slot;
+    }
+    return nullptr;
+}
+
 fbl::Arena Handle::arena_;
+fbl::atomic<uint32_t> Handle::slot_limit_;
 
 void Handle::Init() TA_NO_THREAD_SAFETY_ANALYSIS {
+    static_assert(sizeof(FreeSlot) <= sizeof(fbl::DoublyLinkedListable<Handle*>),
+                  "FreeSlot must fit in the list node of a free slot");
     arena_.Init("handles", sizeof(Handle), kMaxHandleCount);
 }
 
@@ -65,7 +185,7 @@ void Handle::set_process_id(zx_koid_t pid) {
 // Returns a new |base_value| based on the value stored in the free
 // arena slot pointed to by |addr|. The new value will be different
 // from the last |base_value| used by this slot.
-uint32_t Handle::GetNewBaseValue(void* addr) TA_REQ(ArenaLock::Get()) {
+uint32_t Handle::GetNewBaseValue(void* addr) {
     // Get the index of this slot within the arena.
     uint32_t handle_index = HandleToIndex(reinterpret_cast<Handle*>(addr));
     DEBUG_ASSERT((handle_index & ~kHandleIndexMask) == 0);
@@ -83,33 +203,69 @@ uint32_t Handle::GetNewBaseValue(void* addr) TA_REQ(ArenaLock::Get()) {
     return (handle_index | new_gen);
 }
 
+// Takes a batch of slots from the arena, returning one of them and caching
+// the rest on the current cpu.
+void* Handle::AllocFromArena() {
+    FreeSlot* batch = nullptr;
+    size_t count = 0;
+    {
+        Guard<fbl::Mutex> guard{ArenaLock::Get()};
+        for (; count < kSlotBatch; ++count) {
+            auto slot = static_cast<FreeSlot*>(arena_.Alloc());
+            if (!slot)
+                break;
+            // Lookups may now read this slot without taking ArenaLock.
+            uint32_t limit = HandleToIndex(reinterpret_cast<Handle*>(slot)) + 1;
+            if (limit > slot_limit_.load(fbl::memory_order_relaxed))
+                slot_limit_.store(limit, fbl::memory_order_release);
+            slot->next = batch;
+            batch = slot;
+        }
+    }
+    if (unlikely(count == 0))
+        return SlotCache::Steal();
+
+    FreeSlot* rest = batch->next;
+    if (count > 1 && !SlotCache::Current().Refill(rest, count - 1))
+        FreeToArena(rest);
+    return batch;
+}
+
+// Returns the slots on the list |slots| to the arena.
+void Handle::FreeToArena(FreeSlot* slots) {
+    Guard<fbl::Mutex> guard{ArenaLock::Get()};
+    while (slots) {
+        FreeSlot* next = slots->next;
+        arena_.Free(slots);
+        slots = next;
+    }
+}
+
 // Allocate space for a Handle from the arena, but don't instantiate the
 // object.  |base_value| gets the value for Handle::base_value_.  |what|
 // says whether this is allocation or duplication, for the error message.
 void* Handle::Alloc(const fbl::RefPtr<Dispatcher>& dispatcher,
                     const char* what, uint32_t* base_value) {
-    size_t outstanding_handles;
-    {
-        Guard<fbl::Mutex> guard{ArenaLock::Get()};
-        void* addr = arena_.Alloc();
-        outstanding_handles = arena_.DiagnosticCount();
-        if (likely(addr)) {
-            if (outstanding_handles > kHighHandleCount) {
-                // TODO: Avoid calling this for every handle after
-                // kHighHandleCount; printfs are slow and we're
-                // holding the mutex.
-                printf("WARNING: High handle count: %zu handles\n",
-                       outstanding_handles);
-            }
-            dispatcher->increment_handle_count();
-            *base_value = GetNewBaseValue(addr);
-            return addr;
-        }
+    void* addr = SlotCache::Current().Take();
+    if (unlikely(!addr)) {
+        kcounter_add(handle_cache_miss, 1);
+        addr = AllocFromArena();
+    }
+    if (unlikely(!addr)) {
+        printf("WARNING: Could not allocate %s handle (%zu outstanding)\n",
+               what, outstanding_handles.load(fbl::memory_order_relaxed));
+        return nullptr;
     }
 
-    printf("WARNING: Could not allocate %s handle (%zu outstanding)\n",
-           what, outstanding_handles);
-    return nullptr;
+    size_t outstanding = outstanding_handles.fetch_add(1, fbl::memory_order_relaxed) + 1;
+    if (outstanding > kHighHandleCount) {
+        // TODO: Avoid calling this for every handle after
+        // kHighHandleCount; printfs are slow.
+        printf("WARNING: High handle count: %zu handles\n", outstanding);
+    }
+    dispatcher->increment_handle_count();
+    *base_value = GetNewBaseValue(addr);
+    return addr;
 }
 
 HandleOwner Handle::Make(fbl::RefPtr<Dispatcher> dispatcher,
@@ -131,7 +287,10 @@ Handle::Handle(fbl::RefPtr<Dispatcher> dispatcher, zx_rights_t rights,
     : process_id_(0u),
       dispatcher_(ktl::move(dispatcher)),
       rights_(rights),
-      base_value_(base_value) {
+      base_value_(base_value),
+      lookup_state_(0u) {
+    // Publish the fields above to GetDispatcherU32.
+    lookup_state_.store(LiveLookupState(base_value), fbl::memory_order_release);
 }
 
 HandleOwner Handle::Dup(Handle* source, zx_rights_t rights) {
@@ -150,7 +309,25 @@ Handle::Handle(Handle* rhs, zx_rights_t rights, uint32_t base_value)
     : process_id_(rhs->process_id()),
       dispatcher_(rhs->dispatcher_),
       rights_(rights),
-      base_value_(base_value) {
+      base_value_(base_value),
+      lookup_state_(0u) {
+    lookup_state_.store(LiveLookupState(base_value), fbl::memory_order_release);
+}
+
+void Handle::Retire() {
+    uint64_t state = lookup_state_.load(fbl::memory_order_relaxed);
+    for (;;) {
+        if (state & kLookupCountMask) {
+            // Lookups hold a Handle with preemption disabled for a few
+            // loads, so this does not spin for long.
+            arch_spinloop_pause();
+            state = lookup_state_.load(fbl::memory_order_relaxed);
+        } else if (lookup_state_.compare_exchange_weak(&state, 0u,
+                                                       fbl::memory_order_acquire,
+                                                       fbl::memory_order_relaxed)) {
+            return;
+        }
+    }
 }
 
 // Destroys, but does not free, the Handle, and fixes up its memory to protect
@@ -159,13 +336,17 @@ Handle::Handle(Handle* rhs, zx_rights_t rights, uint32_t base_value)
 void Handle::TearDown() TA_EXCL(ArenaLock::Get()) {
     uint32_t old_base_value = base_value();
 
+    // Lookups must be done with this Handle before it is destroyed.
+    Retire();
+
     // Calling the handle dtor can cause many things to happen, so it is
     // important to call it outside the lock.
     this->~Handle();
 
     // There may be stale pointers to this slot. Zero out most of its fields
     // to ensure that the Handle does not appear to belong to any process
-    // or point to any Dispatcher.
+    // or point to any Dispatcher. Retire already zeroed |lookup_state_|, so
+    // this leaves it as concurrent lookups expect.
     memset(this, 0, sizeof(*this));
 
     // Hold onto the base_value for the next user of this slot, stashing
@@ -187,11 +368,13 @@ void Handle::Delete() {
 
     TearDown();
 
-    bool zero_handles = false;
-    {
-        Guard<fbl::Mutex> guard{ArenaLock::Get()};
-        zero_handles = disp->decrement_handle_count();
-        arena_.Free(this);
+    bool zero_handles = disp->decrement_handle_count();
+    outstanding_handles.fetch_sub(1, fbl::memory_order_relaxed);
+
+    FreeSlot* full = SlotCache::Current().Put(reinterpret_cast<FreeSlot*>(this));
+    if (full) {
+        kcounter_add(handle_cache_overflow, 1);
+        FreeToArena(full);
     }
 
     if (zero_handles)
@@ -203,28 +386,68 @@ void Handle::Delete() {
 }
 
 Handle* Handle::FromU32(uint32_t value) TA_NO_THREAD_SAFETY_ANALYSIS {
-    uintptr_t handle_addr = IndexToHandle(value & kHandleIndexMask);
-    {
-        Guard<fbl::Mutex> guard{ArenaLock::Get()};
-        if (unlikely(!arena_.in_range(handle_addr)))
-            return nullptr;
-    }
-    auto handle = reinterpret_cast<Handle*>(handle_addr);
+    uint32_t index = value & kHandleIndexMask;
+    if (unlikely(index >= slot_limit_.load(fbl::memory_order_acquire)))
+        return nullptr;
+    auto handle = reinterpret_cast<Handle*>(IndexToHandle(index));
     return likely(handle->base_value() == value) ? handle : nullptr;
 }
 
+bool Handle::GetDispatcherU32(uint32_t value, zx_koid_t pid,
+                              fbl::RefPtr<Dispatcher>* dispatcher,
+                              zx_rights_t* rights) TA_NO_THREAD_SAFETY_ANALYSIS {
+    uint32_t index = value & kHandleIndexMask;
+    if (unlikely(index >= slot_limit_.load(fbl::memory_order_acquire)))
+        return false;
+    auto handle = reinterpret_cast<Handle*>(IndexToHandle(index));
+
+    // Count ourselves in |lookup_state_| so that the slot is not torn down
+    // while we read it. This fails if the Handle named by |value| has been
+    // retired, even if the slot has since been reused. Preemption is off
+    // while we hold the Handle, so that Retire never waits on a thread which
+    // is not running.
+    const uint64_t live = LiveLookupState(value);
+    bool found = false;
+    fbl::RefPtr<Dispatcher> disp;
+    thread_preempt_disable();
+    uint64_t state = handle->lookup_state_.load(fbl::memory_order_relaxed);
+    while ((state & ~kLookupCountMask) == live) {
+        if (handle->lookup_state_.compare_exchange_weak(&state, state + 1,
+                                                        fbl::memory_order_acquire,
+                                                        fbl::memory_order_relaxed)) {
+            found = handle->process_id() == pid;
+            if (found) {
+                if (dispatcher)
+                    disp = handle->dispatcher_;
+                if (rights)
+                    *rights = handle->rights_;
+            }
+            handle->lookup_state_.fetch_sub(1, fbl::memory_order_release);
+            break;
+        }
+    }
+    thread_preempt_reenable();
+
+    if (found && dispatcher)
+        *dispatcher = ktl::move(disp);
+    return found;
+}
+
 uint32_t Handle::Count(const fbl::RefPtr<const Dispatcher>& dispatcher) {
-    // Handle::ArenaLock also guards Dispatcher::handle_count_.
-    Guard<fbl::Mutex> guard{ArenaLock::Get()};
     return dispatcher->current_handle_count();
 }
 
 size_t Handle::diagnostics::OutstandingHandles() {
-    Guard<fbl::Mutex> guard{ArenaLock::Get()};
-    return arena_.DiagnosticCount();
+    return outstanding_handles.load(fbl::memory_order_relaxed);
 }
 
 void Handle::diagnostics::DumpTableInfo() {
+    size_t cached = 0;
+    for (SlotCache& cache : slot_caches_)
+        cached += cache.count();
+    printf("%zu live handles, %zu free slots in per-cpu caches\n",
+           OutstandingHandles(), cached);
+
     Guard<fbl::Mutex> guard{ArenaLock::Get()};
     arena_.Dump();
 }
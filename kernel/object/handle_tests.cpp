@@ -0,0 +1,86 @@
+// Copyright 2018 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <object/handle.h>
+
+#include <lib/unittest/unittest.h>
+#include <object/event_dispatcher.h>
+
+namespace {
+
+// A handle which has not been given to a process is found with ZX_KOID_INVALID as its owner,
+// and only while it is live.
+static bool lookup_live_and_closed() {
+    BEGIN_TEST;
+
+    fbl::RefPtr<Dispatcher> event;
+    zx_rights_t rights;
+    ASSERT_EQ(EventDispatcher::Create(0u, &event, &rights), ZX_OK, "");
+
+    HandleOwner handle = Handle::Make(event, rights);
+    ASSERT_TRUE(handle, "");
+    const uint32_t value = handle->base_value();
+
+    fbl::RefPtr<Dispatcher> found;
+    zx_rights_t found_rights = 0;
+    EXPECT_TRUE(Handle::GetDispatcherU32(value, ZX_KOID_INVALID, &found, &found_rights), "");
+    EXPECT_EQ(found.get(), event.get(), "");
+    EXPECT_EQ(found_rights, rights, "");
+    found.reset();
+
+    // No process may find it yet, and once it is closed its value finds nothing.
+    EXPECT_FALSE(Handle::GetDispatcherU32(value, event->get_koid(), nullptr, nullptr), "");
+    handle.reset(nullptr);
+    EXPECT_FALSE(Handle::GetDispatcherU32(value, ZX_KOID_INVALID, &found, nullptr), "");
+    EXPECT_FALSE(found, "");
+
+    // The slot is most likely reused straight from this cpu's cache; the old value must still
+    // not find the new handle.
+    handle = Handle::Make(event, rights);
+    ASSERT_TRUE(handle, "");
+    EXPECT_NE(handle->base_value(), value, "");
+    EXPECT_FALSE(Handle::GetDispatcherU32(value, ZX_KOID_INVALID, nullptr, nullptr), "");
+    EXPECT_TRUE(Handle::GetDispatcherU32(handle->base_value(), ZX_KOID_INVALID, nullptr,
+                                         nullptr), "");
+
+    END_TEST;
+}
+
+// Makes and closes more handles than the per-cpu slot caches hold, so that slots move back and
+// forth between the caches and the arena.
+static bool make_close_recycle() {
+    BEGIN_TEST;
+
+    fbl::RefPtr<Dispatcher> event;
+    zx_rights_t rights;
+    ASSERT_EQ(EventDispatcher::Create(0u, &event, &rights), ZX_OK, "");
+
+    constexpr size_t kNumHandles = 256;
+    HandleOwner handles[kNumHandles];
+
+    for (int round = 0; round < 2; round++) {
+        for (size_t i = 0; i < kNumHandles; i++) {
+            handles[i] = Handle::Make(event, rights);
+            ASSERT_TRUE(handles[i], "");
+        }
+        EXPECT_EQ(Handle::Count(event), kNumHandles, "");
+        for (size_t i = 0; i < kNumHandles; i++) {
+            EXPECT_TRUE(Handle::GetDispatcherU32(handles[i]->base_value(), ZX_KOID_INVALID,
+                                                 nullptr, nullptr), "");
+            handles[i].reset(nullptr);
+        }
+        EXPECT_EQ(Handle::Count(event), 0u, "");
+    }
+
+    END_TEST;
+}
+
+}  // namespace
+
+UNITTEST_START_TESTCASE(handle_tests)
+UNITTEST("lookup_live_and_closed", lookup_live_and_closed)
+UNITTEST("make_close_recycle", make_close_recycle)
+UNITTEST_END_TESTCASE(handle_tests, "handle", "Handle tests");
@@ -84,53 +84,26 @@ public:
 
     // Creates a BufferChain with enough buffers to store |size| bytes.
     //
+    // Chains of up to kNumSizeClasses buffers are taken whole from the current cpu's cache of
+    // recycled chains when possible, everything else comes straight from the PMM.
+    //
     // It is the caller's responsibility to free the chain with BufferChain::Free.
     //
     // Returns nullptr on error.
-    static BufferChain* Alloc(size_t size) {
-        size += sizeof(BufferChain);
-        const size_t num_buffers = (size + kRawDataSize - 1) / kRawDataSize;
-
-        // Allocate a list of pages.
-        list_node pages = LIST_INITIAL_VALUE(pages);
-        zx_status_t status = pmm_alloc_pages(num_buffers, 0, &pages);
-        if (unlikely(status != ZX_OK)) {
-            return nullptr;
-        }
-
-        // Construct a Buffer in each page and add them to a temporary list.
-        BufferChain::BufferList temp;
-        vm_page_t* page;
-        list_for_every_entry (&pages, page, vm_page_t, queue_node) {
-            DEBUG_ASSERT(page->state == VM_PAGE_STATE_ALLOC);
-            page->state = VM_PAGE_STATE_IPC;
-            void* va = paddr_to_physmap(page->paddr());
-            temp.push_front(new (va) BufferChain::Buffer);
-        }
-
-        // We now have a list of buffers and a list of pages.  Construct a chain inside the first
-        // buffer and give the buffers and pages to the chain.
-        BufferChain* chain = new (temp.front().data()) BufferChain(&temp, &pages);
-        DEBUG_ASSERT(list_is_empty(&pages));
-
-        return chain;
-    }
+    static BufferChain* Alloc(size_t size);
 
     // Frees |chain| and its buffers.
-    static void Free(BufferChain* chain) {
-        // Remove the buffers and vm_page_t's from the chain *before* destroying it.
-        BufferChain::BufferList buffers(ktl::move(*chain->buffers()));
-        list_node pages = LIST_INITIAL_VALUE(pages);
-        list_move(&chain->pages_, &pages);
+    //
+    // Short chains are kept, buffers and all, in the current cpu's cache until the cache for
+    // their length is full. The rest go back to the PMM.
+    static void Free(BufferChain* chain);
 
-        chain->~BufferChain();
+    // The number of chain lengths the cache keeps chains for. Every message of up to kContig
+    // bytes, which covers small inline RPC messages, is a single buffer chain.
+    constexpr static size_t kNumSizeClasses = 4;
 
-        while (!buffers.is_empty()) {
-            BufferChain::Buffer* buf = buffers.pop_front();
-            buf->Buffer::~Buffer();
-        }
-        pmm_free(&pages);
-    }
+    // Returns the number of chains of |num_buffers| buffers in the current cpu's cache.
+    static size_t CachedChainCount(size_t num_buffers);
 
     // Copies |size| bytes from |src| to this chain starting at offset |dst_offset|.
     //
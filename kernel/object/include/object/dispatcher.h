@@ -10,6 +10,7 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <fbl/atomic.h>
 #include <fbl/auto_lock.h>
 #include <fbl/canary.h>
 #include <fbl/intrusive_double_list.h>
@@ -102,21 +103,19 @@ public:
 
     zx_koid_t get_koid() const { return koid_; }
 
-    // Must be called under the handle table lock.
-    void increment_handle_count() TA_REQ(Handle::ArenaLock::Get()) {
-        ++handle_count_;
+    // Called by Handle when a handle to this object is created.
+    void increment_handle_count() {
+        handle_count_.fetch_add(1u, fbl::memory_order_relaxed);
     }
 
-    // Must be called under the handle table lock.
+    // Called by Handle when a handle to this object is destroyed.
     // Returns true exactly when the handle count goes to zero.
-    bool decrement_handle_count() TA_REQ(Handle::ArenaLock::Get()) {
-        --handle_count_;
-        return handle_count_ == 0u;
+    bool decrement_handle_count() {
+        return handle_count_.fetch_sub(1u, fbl::memory_order_acq_rel) == 1u;
     }
 
-    // Must be called under the handle table lock.
-    uint32_t current_handle_count() const TA_REQ(Handle::ArenaLock::Get()) {
-        return handle_count_;
+    uint32_t current_handle_count() const {
+        return handle_count_.load(fbl::memory_order_relaxed);
     }
 
     // The following are only to be called when |is_waitable| reports true.
@@ -218,7 +217,7 @@ private:
                               zx_signals_t signals) TA_REQ(get_lock());
 
     const zx_koid_t koid_;
-    uint32_t handle_count_ TA_GUARDED(Handle::ArenaLock::Get());
+    fbl::atomic<uint32_t> handle_count_;
 
     zx_signals_t signals_ TA_GUARDED(get_lock());
 
@@ -14,7 +14,9 @@
 
 // FutexContext is a class that encapsulates support for futex operations.
 // FutexContext uses a hash table keyed on the futex address (a pointer to integer in userspace)
-// to contain all active futexes.
+// to contain all active futexes. The table is split into buckets selected by hashing the
+// futex address, each with its own lock, so that operations on unrelated futexes do not
+// serialize against each other.
 // A futex is considered active if there is one or more threads blocked on the futex.
 // After no threads are left blocked on a futex it is removed from the hash table.
 // The value in the futex hash table is the FutexNode object associated with the head
@@ -79,14 +81,36 @@ private:
     FutexContext(const FutexContext&) = delete;
     FutexContext& operator=(const FutexContext&) = delete;
 
-    void QueueNodesLocked(FutexNode* head) TA_REQ(lock_);
+    // Number of independently locked buckets; must be a power of two.
+    static constexpr uint32_t kNumBucketsShift = 4;
+    static constexpr uint32_t kNumBuckets = 1u << kNumBucketsShift;
 
-    bool UnqueueNodeLocked(FutexNode* node) TA_REQ(lock_);
+    struct Bucket {
+        // protects futex_table
+        DECLARE_MUTEX(Bucket) lock;
 
-    // protects futex_table_
-    DECLARE_MUTEX(FutexContext) lock_;
+        // Hash table for the futexes in this bucket.
+        // Key is futex address, value is the FutexNode for the head of futex's blocked thread
+        // list.
+        FutexNode::HashTable futex_table TA_GUARDED(lock);
+    };
+
+    Bucket* BucketFor(uintptr_t futex_key) {
+        // Fibonacci hashing; the low bits of neighbouring futex addresses
+        // differ little.
+        return &buckets_[(futex_key * 0x9E3779B97F4A7C15ull) >> (64 - kNumBucketsShift)];
+    }
+
+    static void QueueNodesLocked(Bucket* bucket, FutexNode* head) TA_REQ(bucket->lock);
+
+    static bool UnqueueNodeLocked(Bucket* bucket, FutexNode* node) TA_REQ(bucket->lock);
+
+    // Does the work of FutexRequeue() once the locks of the buckets for both
+    // futexes are held. The static analysis cannot follow GuardMultiple.
+    zx_status_t RequeueLocked(user_in_ptr<const zx_futex_t> wake_ptr, uint32_t wake_count,
+                              zx_futex_t current_value, uintptr_t requeue_key,
+                              uint32_t requeue_count, AutoReschedDisable* resched_disable)
+        TA_NO_THREAD_SAFETY_ANALYSIS;
 
-    // Hash table for futexes in this context.
-    // Key is futex address, value is the FutexNode for the head of futex's blocked thread list.
-    FutexNode::HashTable futex_table_ TA_GUARDED(lock_);
+    Bucket buckets_[kNumBuckets];
 };
@@ -18,7 +18,10 @@
 // Intended to be embedded within a ThreadDispatcher Instance
 class FutexNode : public fbl::SinglyLinkedListable<FutexNode*> {
 public:
-    using HashTable = fbl::HashTable<uintptr_t, FutexNode*>;
+    // FutexContext spreads its futexes over a number of these tables, so each
+    // one only needs a handful of buckets.
+    using HashTable = fbl::HashTable<uintptr_t, FutexNode*, fbl::SinglyLinkedList<FutexNode*>,
+                                     size_t, 7>;
 
     FutexNode();
     ~FutexNode();
@@ -64,7 +67,8 @@ private:
 
     // hash_key_ contains the futex address.  This field has two roles:
     //  * It is used by FutexWait() to determine which queue to remove the
-    //    thread from when a wait operation times out.
+    //    thread from when a wait operation times out, and which bucket lock
+    //    to take to find out.  It is left in place when the thread is woken.
     //  * Additionally, when this FutexNode is the head of a futex wait
     //    queue, this field is used by the HashTable (because it uses
     //    intrusive SinglyLinkedLists).
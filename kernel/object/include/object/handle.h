@@ -79,8 +79,8 @@ private:
 // A Handle is how a specific process refers to a specific Dispatcher.
 class Handle final : public fbl::DoublyLinkedListable<Handle*> {
 public:
-    // The handle arena's mutex. This is public since it protects
-    // other things like |Dispatcher::handle_count_|.
+    // The handle arena's mutex. Only taken to move batches of slots
+    // between the arena and the per-cpu slot caches.
     DECLARE_SINGLETON_MUTEX(ArenaLock);
 
     // Returns the Dispatcher to which this instance points.
@@ -119,6 +119,14 @@ public:
     // Maps an integer obtained by Handle::base_value() back to a Handle.
     static Handle* FromU32(uint32_t value);
 
+    // Looks up the Handle whose base_value() is |value| without taking any
+    // lock. If it is live and owned by process |pid|, sets |*dispatcher|
+    // and |*rights| (either may be null) and returns true; otherwise
+    // returns false.
+    static bool GetDispatcherU32(uint32_t value, zx_koid_t pid,
+                                 fbl::RefPtr<Dispatcher>* dispatcher,
+                                 zx_rights_t* rights);
+
     // Get the number of outstanding handles for a given dispatcher.
     static uint32_t Count(const fbl::RefPtr<const Dispatcher>&);
 
@@ -148,14 +156,24 @@ private:
     // Private subroutines of Make and Dup.
     static void* Alloc(const fbl::RefPtr<Dispatcher>&, const char* what,
                        uint32_t* base_value);
+    static void* AllocFromArena();
     static uint32_t GetNewBaseValue(void* addr);
 
+    // Free slots are kept in per-cpu caches before going back to the arena.
+    struct FreeSlot;
+    class SlotCache;
+    static void FreeToArena(FreeSlot* slots);
+
     // Handle should never be destroyed by anything other than Delete,
     // which uses TearDown to do the actual destruction.
     ~Handle() = default;
     void TearDown() TA_EXCL(ArenaLock::Get());
     void Delete();
 
+    // Called by TearDown. Keeps GetDispatcherU32 from finding this
+    // instance again, and waits for the lookups already reading it.
+    void Retire();
+
     // Only HandleOwner is allowed to call Delete.
     friend class HandleOwner;
 
@@ -167,9 +185,23 @@ private:
     const zx_rights_t rights_;
     const uint32_t base_value_;
 
+    // Lets GetDispatcherU32 read a Handle without any lock. The upper half
+    // is base_value_ tagged with kLookupLive while the Handle is live, and
+    // zero once Retire has run; the lower half counts the lookups reading
+    // the Handle. A free slot is zeroed, so no lookup can match it.
+    fbl::atomic<uint64_t> lookup_state_;
+
     // The handle arena.
     static fbl::Arena TA_GUARDED(ArenaLock::Get()) arena_;
 
+    // The number of arena slots handed out so far. Arena slots are never
+    // decommitted once handed out, so lookups may read any slot below this
+    // bound without holding ArenaLock.
+    static fbl::atomic<uint32_t> slot_limit_;
+
+    // Indexed by cpu number.
+    static SlotCache slot_caches_[];
+
     // NOTE! This can return an invalid address.  It must be checked
     // against the arena bounds before being cast to a Handle*.
     static uintptr_t IndexToHandle(uint32_t index) TA_NO_THREAD_SAFETY_ANALYSIS {
@@ -154,7 +154,7 @@ private:
 // |packets_| linked list and case 4 uses |interrupt_packets_| linked list.
 //
 // The threads that wish to receive notifications block on Dequeue() (which
-// maps to zx_port_wait()) and will receive packets from any of the four sources
+// maps to zx_port_wait()) or DequeueMany() (zx_port_wait_many()) and will receive packets from any of the four sources
 // depending on what kind of object the port has been 'bound' to.
 //
 // When a packet from any of the sources arrives to the port, one waiting
@@ -178,6 +178,13 @@ public:
     zx_status_t QueueUser(const zx_port_packet_t& packet);
     bool QueueInterruptPacket(PortInterruptPacket* port_packet, zx_time_t timestamp);
     zx_status_t Dequeue(zx_time_t deadline, TimerSlack slack, zx_port_packet_t* packet);
+    // Like Dequeue() but returns up to |count| packets in |packets|, and how many in |actual|.
+    // Only waits until the first packet arrives, the rest are whatever else is queued by then.
+    zx_status_t DequeueMany(zx_time_t deadline, TimerSlack slack, zx_port_packet_t* packets,
+                            size_t count, size_t* actual);
+    // Puts |count| packets that were dequeued but could not be delivered back at the front of
+    // the queue, in their original order.
+    void Requeue(const zx_port_packet_t* packets, size_t count);
     bool RemoveInterruptPacket(PortInterruptPacket* port_packet);
 
     // Decides who is going to destroy the observer. If it returns the
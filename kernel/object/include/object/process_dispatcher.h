@@ -287,6 +287,12 @@ private:
     ProcessDispatcher& operator=(const ProcessDispatcher&) = delete;
 
 
+    // Like GetHandleLocked, but takes no lock: sets |*dispatcher| and
+    // |*rights| (either may be null) from the Handle instead of returning it,
+    // since it may be closed as soon as this returns.
+    bool LookupHandle(zx_handle_t handle_value, bool skip_policy,
+                      fbl::RefPtr<Dispatcher>* dispatcher, zx_rights_t* rights);
+
     zx_status_t GetDispatcherInternal(zx_handle_t handle_value, fbl::RefPtr<Dispatcher>* dispatcher,
                                       zx_rights_t* rights);
 
@@ -298,44 +298,67 @@ zx_status_t PortDispatcher::Queue(PortPacket* port_packet, zx_signals_t observed
 
 zx_status_t PortDispatcher::Dequeue(zx_time_t deadline, TimerSlack slack,
                                     zx_port_packet_t* out_packet) {
+    size_t actual;
+    return DequeueMany(deadline, slack, out_packet, 1u, &actual);
+}
+
+zx_status_t PortDispatcher::DequeueMany(zx_time_t deadline, TimerSlack slack,
+                                        zx_port_packet_t* out_packets, size_t count,
+                                        size_t* actual) {
     canary_.Assert();
+    DEBUG_ASSERT(count > 0);
 
     while (true) {
+        size_t n = 0;
         if (options_ == ZX_PORT_BIND_TO_INTERRUPT) {
             Guard<SpinLock, IrqSave> guard{&spinlock_};
-            PortInterruptPacket* port_interrupt_packet = interrupt_packets_.pop_front();
-            if (port_interrupt_packet != nullptr) {
+            while (n < count) {
+                PortInterruptPacket* port_interrupt_packet = interrupt_packets_.pop_front();
+                if (port_interrupt_packet == nullptr) {
+                    break;
+                }
+                zx_port_packet_t* out_packet = &out_packets[n++];
                 *out_packet = {};
                 out_packet->key = port_interrupt_packet->key;
                 out_packet->type = ZX_PKT_TYPE_INTERRUPT;
                 out_packet->status = ZX_OK;
                 out_packet->interrupt.timestamp = port_interrupt_packet->timestamp;
-                return ZX_OK;
             }
         }
-        {
-            Guard<fbl::Mutex> guard{get_lock()};
-            PortPacket* port_packet = packets_.pop_front();
-            if (port_packet != nullptr) {
-                --num_packets_;
-                *out_packet = port_packet->packet;
-
-                bool is_ephemeral = port_packet->is_ephemeral();
-                // The reference to the port that the observer holds cannot be the last one
-                // because another reference was used to call Dequeue, so we don't need to
-                // worry about destroying ourselves.
-                port_packet->observer.reset();
-                guard.Release();
-
-                // If the packet is ephemeral, free it outside of the lock. We need to read
-                // is_ephemeral inside the lock because it's possible for a non-ephemeral packet
-                // to get deleted after a call to |MaybeReap| as soon as we release the lock.
-                if (is_ephemeral) {
-                    port_packet->Free();
+        if (n < count) {
+            fbl::DoublyLinkedList<PortPacket*> ephemeral;
+            {
+                Guard<fbl::Mutex> guard{get_lock()};
+                while (n < count) {
+                    PortPacket* port_packet = packets_.pop_front();
+                    if (port_packet == nullptr) {
+                        break;
+                    }
+                    --num_packets_;
+                    out_packets[n++] = port_packet->packet;
+
+                    // The reference to the port that the observer holds cannot be the last one
+                    // because another reference was used to call Dequeue, so we don't need to
+                    // worry about destroying ourselves.
+                    port_packet->observer.reset();
+
+                    // If the packet is ephemeral, free it outside of the lock. We need to read
+                    // is_ephemeral inside the lock because it's possible for a non-ephemeral
+                    // packet to get deleted after a call to |MaybeReap| as soon as we release
+                    // the lock.
+                    if (port_packet->is_ephemeral()) {
+                        ephemeral.push_back(port_packet);
+                    }
                 }
-                return ZX_OK;
+            }
+            while (!ephemeral.is_empty()) {
+                ephemeral.pop_front()->Free();
             }
         }
+        if (n > 0) {
+            *actual = n;
+            return ZX_OK;
+        }
 
         {
             ThreadDispatcher::AutoBlocked by(ThreadDispatcher::Blocked::PORT);
@@ -346,6 +369,41 @@ zx_status_t PortDispatcher::Dequeue(zx_time_t deadline, TimerSlack slack,
     }
 }
 
+void PortDispatcher::Requeue(const zx_port_packet_t* packets, size_t count) {
+    canary_.Assert();
+
+    // The packets go back as ephemeral copies.  Observers are done with their own packets once
+    // they are dequeued, and may have queued them again since.  If the arena runs out, the rest
+    // of the packets are dropped.
+    fbl::DoublyLinkedList<PortPacket*> requeue;
+    for (size_t i = 0; i < count; i++) {
+        PortPacket* port_packet = port_allocator.Alloc();
+        if (!port_packet) {
+            break;
+        }
+        port_packet->packet = packets[i];
+        requeue.push_back(port_packet);
+    }
+
+    {
+        AutoReschedDisable resched_disable; // Must come before the lock guard.
+        Guard<fbl::Mutex> guard{get_lock()};
+        if (!zero_handles_) {
+            resched_disable.Disable();
+            while (!requeue.is_empty()) {
+                packets_.push_front(requeue.pop_back());
+                ++num_packets_;
+                sema_.Post();
+            }
+        }
+    }
+
+    // Nobody can dequeue them anymore.
+    while (!requeue.is_empty()) {
+        requeue.pop_front()->Free();
+    }
+}
+
 ktl::unique_ptr<PortObserver> PortDispatcher::MaybeReap(ktl::unique_ptr<PortObserver> observer,
                                                         PortPacket* port_packet) {
     canary_.Assert();
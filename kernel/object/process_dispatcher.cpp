@@ -49,9 +49,12 @@ static zx_handle_t map_handle_to_value(const Handle* handle, uint32_t mixer) {
     return static_cast<zx_handle_t>(mixer ^ handle_id);
 }
 
+static uint32_t map_value_to_base_value(zx_handle_t value, uint32_t mixer) {
+    return (static_cast<uint32_t>(value) ^ mixer) >> 1;
+}
+
 static Handle* map_value_to_handle(zx_handle_t value, uint32_t mixer) {
-    auto handle_id = (static_cast<uint32_t>(value) ^ mixer) >> 1;
-    return Handle::FromU32(handle_id);
+    return Handle::FromU32(map_value_to_base_value(value, mixer));
 }
 
 zx_status_t ProcessDispatcher::Create(
@@ -460,6 +463,19 @@ Handle* ProcessDispatcher::GetHandleLocked(zx_handle_t handle_value,
     return nullptr;
 }
 
+bool ProcessDispatcher::LookupHandle(zx_handle_t handle_value, bool skip_policy,
+                                     fbl::RefPtr<Dispatcher>* dispatcher,
+                                     zx_rights_t* rights) {
+    if (likely(Handle::GetDispatcherU32(map_value_to_base_value(handle_value, handle_rand_),
+                                        get_koid(), dispatcher, rights)))
+        return true;
+
+    // See GetHandleLocked.
+    if (likely(!skip_policy))
+        QueryBasicPolicy(ZX_POL_BAD_HANDLE);
+    return false;
+}
+
 void ProcessDispatcher::AddHandle(HandleOwner handle) {
     Guard<fbl::Mutex> guard{&handle_table_lock_};
     AddHandleLocked(ktl::move(handle));
@@ -522,24 +538,17 @@ zx_status_t ProcessDispatcher::RemoveHandles(user_in_ptr<const zx_handle_t> user
 }
 
 zx_koid_t ProcessDispatcher::GetKoidForHandle(zx_handle_t handle_value) {
-    Guard<fbl::Mutex> guard{&handle_table_lock_};
-    Handle* handle = GetHandleLocked(handle_value);
-    if (!handle)
+    fbl::RefPtr<Dispatcher> dispatcher;
+    if (!LookupHandle(handle_value, false, &dispatcher, nullptr))
         return ZX_KOID_INVALID;
-    return handle->dispatcher()->get_koid();
+    return dispatcher->get_koid();
 }
 
 zx_status_t ProcessDispatcher::GetDispatcherInternal(zx_handle_t handle_value,
                                                      fbl::RefPtr<Dispatcher>* dispatcher,
                                                      zx_rights_t* rights) {
-    Guard<fbl::Mutex> guard{&handle_table_lock_};
-    Handle* handle = GetHandleLocked(handle_value);
-    if (!handle)
+    if (!LookupHandle(handle_value, false, dispatcher, rights))
         return ZX_ERR_BAD_HANDLE;
-
-    *dispatcher = handle->dispatcher();
-    if (rights)
-        *rights = handle->rights();
     return ZX_OK;
 }
 
@@ -547,17 +556,17 @@ zx_status_t ProcessDispatcher::GetDispatcherWithRightsInternal(zx_handle_t handl
                                                                zx_rights_t desired_rights,
                                                                fbl::RefPtr<Dispatcher>* dispatcher_out,
                                                                zx_rights_t* out_rights) {
-    Guard<fbl::Mutex> guard{&handle_table_lock_};
-    Handle* handle = GetHandleLocked(handle_value);
-    if (!handle)
+    fbl::RefPtr<Dispatcher> dispatcher;
+    zx_rights_t rights;
+    if (!LookupHandle(handle_value, false, &dispatcher, &rights))
         return ZX_ERR_BAD_HANDLE;
 
-    if (!handle->HasRights(desired_rights))
+    if ((rights & desired_rights) != desired_rights)
         return ZX_ERR_ACCESS_DENIED;
 
-    *dispatcher_out = handle->dispatcher();
+    *dispatcher_out = ktl::move(dispatcher);
     if (out_rights)
-        *out_rights = handle->rights();
+        *out_rights = rights;
     return ZX_OK;
 }
 
@@ -863,13 +872,11 @@ const char* StateToString(ProcessDispatcher::State state) {
 }
 
 bool ProcessDispatcher::IsHandleValid(zx_handle_t handle_value) {
-    Guard<fbl::Mutex> guard{&handle_table_lock_};
-    return (GetHandleLocked(handle_value) != nullptr);
+    return LookupHandle(handle_value, false, nullptr, nullptr);
 }
 
 bool ProcessDispatcher::IsHandleValidNoPolicyCheck(zx_handle_t handle_value) {
-    Guard<fbl::Mutex> guard{&handle_table_lock_};
-    return (GetHandleLocked(handle_value, true) != nullptr);
+    return LookupHandle(handle_value, true, nullptr, nullptr);
 }
 
 void ProcessDispatcher::OnProcessStartForJobDebugger(ThreadDispatcher *t) {
@@ -56,6 +56,7 @@ MODULE_SRCS := \
 # Tests
 MODULE_SRCS += \
     $(LOCAL_DIR)/buffer_chain_tests.cpp \
+    $(LOCAL_DIR)/handle_tests.cpp \
     $(LOCAL_DIR)/job_policy_tests.cpp \
     $(LOCAL_DIR)/mbuf_tests.cpp \
     $(LOCAL_DIR)/message_packet_tests.cpp \
@@ -18,14 +18,17 @@
 #include <kernel/auto_lock.h>
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
+#include <lib/histograms.h>
 #include <lib/pow2_range_allocator.h>
 #include <lk/init.h>
+#include <platform.h>
 #include <platform/pc.h>
 #include <platform/pc/acpi.h>
 #include <platform/pic.h>
 #include <pow2.h>
 #include <reg.h>
 #include <sys/types.h>
+#include <zircon/time.h>
 #include <zircon/types.h>
 
 #include "platform_p.h"
@@ -159,6 +162,9 @@ zx_status_t get_interrupt_config(unsigned int vector,
     return apic_io_fetch_irq_config(vector, tm, pol);
 }
 
+// time spent in interrupt handlers
+KHISTOGRAM(irq_latency, "kernel.latency.irq");
+
 void platform_irq(x86_iframe_t* frame) {
     // get the current vector
     uint64_t x86_vector = frame->vector;
@@ -168,12 +174,14 @@ void platform_irq(x86_iframe_t* frame) {
     // deliver the interrupt
     struct int_handler_struct* handler = &int_handler_table[x86_vector];
 
+    const zx_time_t start = current_time();
     {
         AutoSpinLockNoIrqSave guard(&handler->lock);
         if (handler->handler) {
             handler->handler(handler->arg);
         }
     }
+    khistogram_add(irq_latency, zx_time_sub_time(current_time(), start));
 
     // NOTE: On x86, we always deactivate the interrupt.
     apic_issue_eoi();
@@ -430,6 +430,36 @@ zx_status_t sys_object_get_info(zx_handle_t handle, uint32_t topic,
         return single_record_result(
             _buffer, buffer_size, _actual, _avail, &info, sizeof(info));
     }
+    case ZX_INFO_VMAR_FAULT_STATS: {
+        fbl::RefPtr<VmAddressRegionDispatcher> vmar;
+        zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_INSPECT, &vmar);
+        if (status != ZX_OK)
+            return status;
+
+        VmAddressRegion::FaultStats stats;
+        vmar->vmar()->GetFaultStats(&stats);
+        zx_info_vmar_fault_stats_t info = {
+            .page_faults = stats.page_faults,
+            .fault_around_pages = stats.fault_around_pages,
+        };
+
+        return single_record_result(
+            _buffer, buffer_size, _actual, _avail, &info, sizeof(info));
+    }
+    case ZX_INFO_VMO_LARGE_PAGES: {
+        fbl::RefPtr<VmObjectDispatcher> vmo;
+        zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_INSPECT, &vmo);
+        if (status != ZX_OK)
+            return status;
+
+        zx_info_vmo_large_pages_t info = {
+            .large_page_size = LARGE_PAGE_SIZE,
+            .committed_large_pages = vmo->vmo()->AllocatedLargePages(),
+        };
+
+        return single_record_result(
+            _buffer, buffer_size, _actual, _avail, &info, sizeof(info));
+    }
     case ZX_INFO_CPU_STATS: {
         auto status = validate_resource(handle, ZX_RSRC_KIND_ROOT);
         if (status != ZX_OK)
@@ -458,7 +488,7 @@ zx_status_t sys_object_get_info(zx_handle_t handle, uint32_t topic,
 
             // account for idle time if a cpu is currently idle
             {
-                Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+                Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
                 zx_time_t idle_time = cpu->stats.idle_time;
                 bool is_idle = mp_is_cpu_idle(i);
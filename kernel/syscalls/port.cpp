@@ -13,6 +13,7 @@
 #include <object/port_dispatcher.h>
 #include <object/process_dispatcher.h>
 
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/ref_ptr.h>
 
@@ -96,6 +97,73 @@ zx_status_t sys_port_wait(zx_handle_t handle, zx_time_t deadline,
     return ZX_OK;
 }
 
+// Packets are handed to zx_port_wait_many callers through a buffer of this many on the stack.
+static constexpr size_t kPortWaitManyBatch = 16;
+
+// zx_status_t zx_port_wait_many
+zx_status_t sys_port_wait_many(zx_handle_t handle, zx_time_t deadline,
+                               user_out_ptr<zx_port_packet_t> packets_out, size_t count,
+                               user_out_ptr<size_t> actual_out) {
+    LTRACEF("handle %x count %zu\n", handle, count);
+
+    if (count == 0)
+        return ZX_ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<PortDispatcher> port;
+    zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_READ, &port);
+    if (status != ZX_OK)
+        return status;
+
+    const TimerSlack slack = up->GetTimerSlackPolicy();
+
+    // Make sure the count can be handed back before taking any packets off the port, since
+    // packets that were copied out without it are as good as lost.
+    status = actual_out.copy_to_user(static_cast<size_t>(0));
+    if (status != ZX_OK)
+        return status;
+
+    ktrace(TAG_PORT_WAIT, (uint32_t)port->get_koid(), 0, 0, 0);
+
+    // Only the first batch waits.  Later ones are taken only while the previous batch came back
+    // full, and just collect what is already queued.  Each batch is copied out before the next
+    // one is dequeued, and one that can't be is put back on the port.
+    zx_port_packet_t pp[kPortWaitManyBatch];
+    size_t total = 0;
+    zx_status_t st = ZX_OK;
+    while (total < count) {
+        const size_t batch = fbl::min(count - total, kPortWaitManyBatch);
+        size_t n;
+        st = port->DequeueMany(total == 0 ? deadline : 0, slack, pp, batch, &n);
+        if (st != ZX_OK)
+            break;
+
+        st = packets_out.copy_array_to_user(pp, n, total);
+        if (st != ZX_OK) {
+            port->Requeue(pp, n);
+            break;
+        }
+
+        total += n;
+        if (n < batch)
+            break;
+    }
+
+    ktrace(TAG_PORT_WAIT_DONE, (uint32_t)port->get_koid(), st, 0, 0);
+
+    // Running out of queued packets, or of room to copy them to, after the first batch is not
+    // an error: the caller gets what was delivered.
+    if (total == 0)
+        return st;
+
+    status = actual_out.copy_to_user(total);
+    if (status != ZX_OK)
+        return status;
+
+    return ZX_OK;
+}
+
 // zx_status_t zx_port_cancel
 zx_status_t sys_port_cancel(zx_handle_t handle, zx_handle_t source, uint64_t key) {
     auto up = ProcessDispatcher::GetCurrent();
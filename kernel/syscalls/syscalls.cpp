@@ -7,12 +7,14 @@
 #include <err.h>
 #include <kernel/stats.h>
 #include <kernel/thread.h>
+#include <lib/histograms.h>
 #include <lib/ktrace.h>
 #include <lib/vdso.h>
 #include <object/process_dispatcher.h>
 #include <platform.h>
 #include <syscalls/syscalls.h>
 #include <trace.h>
+#include <zircon/time.h>
 #include <zircon/zx-syscall-numbers.h>
 
 #include <inttypes.h>
@@ -23,6 +25,9 @@
 
 #define LOCAL_TRACE 0
 
+// time from entering to leaving the kernel, per syscall number
+KHISTOGRAM_FAMILY(syscall_latency, "kernel.latency.syscall", ZX_SYS_COUNT);
+
 int sys_invalid_syscall(uint64_t num, uint64_t pc,
                         uintptr_t vdso_code_address) {
     LTRACEF("invalid syscall %lu from PC %#lx vDSO code %#lx\n",
@@ -40,6 +45,8 @@ inline syscall_result do_syscall(uint64_t syscall_num, uint64_t pc,
                                         bool (*valid_pc)(uintptr_t), T make_call) {
     ktrace_tiny(TAG_SYSCALL_ENTER, (static_cast<uint32_t>(syscall_num) << 8) | arch_curr_cpu_num());
 
+    const zx_time_t start = current_time();
+
     CPU_STATS_INC(syscalls);
 
     /* re-enable interrupts to maintain kernel preemptiveness
@@ -63,11 +70,18 @@ inline syscall_result do_syscall(uint64_t syscall_num, uint64_t pc,
     LTRACEF_LEVEL(2, "t %p ret %#" PRIx64 "\n", get_current_thread(), ret);
 
     /* re-disable interrupts on the way out
-       This must be done before the below ktrace_tiny call. */
+       This must be done before the below ktrace_tiny and khistogram_add
+       calls. */
     arch_disable_ints();
 
     ktrace_tiny(TAG_SYSCALL_EXIT, (static_cast<uint32_t>(syscall_num << 8)) | arch_curr_cpu_num());
 
+    // Recorded with interrupts disabled, like the ktrace above, so the sample
+    // lands in this cpu's arena.  khistogram_add() ignores syscall numbers
+    // past the end of the family.
+    khistogram_add(syscall_latency, static_cast<uint32_t>(MIN(syscall_num, UINT32_MAX)),
+                   zx_time_sub_time(current_time(), start));
+
     // The assembler caller will re-disable interrupts at the appropriate time.
     return {ret, thread_is_signaled(get_current_thread())};
 }
@@ -9,12 +9,15 @@
 
 #include <arch/ops.h>
 #include <err.h>
+#include <fbl/algorithm.h>
 #include <inttypes.h>
 #include <kernel/mp.h>
 #include <kernel/mutex.h>
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
+#include <kernel/timer.h>
 #include <platform.h>
+#include <vm/pmm.h>
 #include <rand.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -270,6 +273,142 @@ __NO_INLINE static void bench_mutex() {
     printf("%" PRIu64 " cycles to acquire/release uncontended mutex %u times (%" PRIu64 " cycles per)\n", c, count, c / count);
 }
 
+static int bench_pmm_thread(void* arg) {
+    static const size_t kPagesPerRound = 8;
+    const size_t rounds = reinterpret_cast<uintptr_t>(arg);
+
+    for (size_t i = 0; i < rounds; i++) {
+        vm_page_t* pages[kPagesPerRound];
+        for (size_t j = 0; j < kPagesPerRound; j++) {
+            if (pmm_alloc_page(0, &pages[j]) != ZX_OK) {
+                while (j-- > 0) {
+                    pmm_free_page(pages[j]);
+                }
+                return ZX_ERR_NO_MEMORY;
+            }
+        }
+        for (size_t j = 0; j < kPagesPerRound; j++) {
+            pmm_free_page(pages[j]);
+        }
+    }
+
+    return ZX_OK;
+}
+
+// Run alloc/free pairs on every online cpu at once and report the aggregate throughput.
+static void bench_pmm_parallel_run(const char* label) {
+    static const size_t kRounds = 128 * 1024;
+    static const size_t kOpsPerRound = 8;
+
+    thread_t* threads[SMP_MAX_CPUS] = {};
+    uint num_threads = 0;
+
+    cpu_mask_t online = mp_get_online_mask();
+    for (cpu_num_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        if (!(online & cpu_num_to_mask(cpu))) {
+            continue;
+        }
+        thread_t* t = thread_create("pmm bench", &bench_pmm_thread,
+                                    reinterpret_cast<void*>(kRounds), DEFAULT_PRIORITY);
+        if (!t) {
+            break;
+        }
+        thread_set_cpu_affinity(t, cpu_num_to_mask(cpu));
+        threads[num_threads++] = t;
+    }
+
+    zx_time_t t = current_time();
+    for (uint i = 0; i < num_threads; i++) {
+        thread_resume(threads[i]);
+    }
+    bool failed = false;
+    for (uint i = 0; i < num_threads; i++) {
+        int retcode;
+        thread_join(threads[i], &retcode, ZX_TIME_INFINITE);
+        failed |= (retcode != ZX_OK);
+    }
+    zx_duration_t duration = current_time() - t;
+
+    if (failed) {
+        printf("pmm alloc/free (%s): ran out of memory\n", label);
+        return;
+    }
+
+    uint64_t ops = static_cast<uint64_t>(num_threads) * kRounds * kOpsPerRound;
+    printf("pmm alloc/free (%s): %" PRIu64 " alloc/free pairs on %u cpus in %" PRIi64 " ns "
+           "(%" PRIu64 " pairs/sec)\n",
+           label, ops, num_threads, duration, ops * ZX_SEC(1) / fbl::max<zx_duration_t>(duration, 1));
+}
+
+__NO_INLINE static void bench_pmm_parallel() {
+    size_t high, batch;
+    pmm_get_page_cache_limits(&high, &batch);
+
+    pmm_set_page_cache_limits(0, 0);
+    bench_pmm_parallel_run("no page cache");
+
+    if (high != 0) {
+        pmm_set_page_cache_limits(high, batch);
+    } else {
+        pmm_set_page_cache_limits(64, 16);
+    }
+    bench_pmm_parallel_run("page cache");
+
+    pmm_set_page_cache_limits(high, batch);
+}
+
+static void bench_timer_cb(timer_t*, zx_time_t, void*) {
+}
+
+// Measure setting and canceling a timer while |pending| other timers, due at random times in the
+// future, are queued on the same cpu.
+__NO_INLINE static void bench_timer_set_cancel(size_t pending) {
+    static const size_t kIter = 10000;
+
+    timer_t* timers = static_cast<timer_t*>(malloc(sizeof(timer_t) * (pending + 1)));
+    if (timers == nullptr) {
+        TRACEF("error: malloc failed\n");
+        return;
+    }
+
+    thread_t* t = get_current_thread();
+    const cpu_mask_t affinity = t->cpu_affinity;
+    thread_set_cpu_affinity(t, cpu_num_to_mask(arch_curr_cpu_num()));
+
+    const zx_time_t base = current_time() + ZX_HOUR(1);
+    for (size_t i = 0; i < pending; i++) {
+        timer_init(&timers[i]);
+        zx_time_t deadline = base + (static_cast<zx_duration_t>(rand()) % ZX_SEC(1));
+        timer_set(&timers[i], deadline, kNoSlack, bench_timer_cb, nullptr);
+    }
+
+    timer_t* timer = &timers[pending];
+    timer_init(timer);
+    uint64_t c = arch_cycle_count();
+    for (size_t i = 0; i < kIter; i++) {
+        zx_time_t deadline = base + (static_cast<zx_duration_t>(rand()) % ZX_SEC(1));
+        timer_set(timer, deadline, kNoSlack, bench_timer_cb, nullptr);
+        timer_cancel(timer);
+    }
+    c = arch_cycle_count() - c;
+
+    for (size_t i = 0; i < pending; i++) {
+        timer_cancel(&timers[i]);
+    }
+    thread_set_cpu_affinity(t, affinity);
+    free(timers);
+
+    printf("%" PRIu64 " cycles to set/cancel a timer with %zu pending %zu times (%" PRIu64 " cycles per)\n",
+           c, pending, kIter, c / kIter);
+}
+
+__NO_INLINE static void bench_timers() {
+    static const size_t kPending[] = {0, 100, 1000, 10000, 20000};
+    for (size_t pending : kPending) {
+        bench_timer_set_cancel(pending);
+    }
+}
+
 int benchmarks(int, const cmd_args*, uint32_t) {
     bench_set_overhead();
     bench_memcpy();
@@ -287,5 +426,9 @@ int benchmarks(int, const cmd_args*, uint32_t) {
     bench_spinlock();
     bench_mutex();
 
+    bench_pmm_parallel();
+
+    bench_timers();
+
     return 0;
 }
@@ -35,7 +35,7 @@ static void timer_callback_func(timer_t* timer, zx_time_t now, void* arg) {
     // preempt_disable is set.
     thread->preempt_pending = false;
     {
-        Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+        Guard<spin_lock_t, ThreadLockIrqSave> guard{ThreadLock::Get()};
         sched_reschedule();
     }
     ASSERT(thread->preempt_pending);
@@ -475,6 +475,116 @@ static bool trylock_or_cancel_get_lock() {
     END_TEST;
 }
 
+// Enough timers that a timer queue with linear insertion would crawl.
+static constexpr size_t kManyTimers = 16384;
+
+// Returns a random slack of up to |max| in a random mode.
+static TimerSlack rand_slack(zx_duration_t max) {
+    static const slack_mode kModes[] = {TIMER_SLACK_CENTER, TIMER_SLACK_LATE, TIMER_SLACK_EARLY};
+    return TimerSlack(rand_duration(max), kModes[rand() % fbl::count_of(kModes)]);
+}
+
+// Whether |timer|, set for |deadline| with |slack|, was coalesced within its slack.
+static bool within_slack(const timer_t& timer, zx_time_t deadline, TimerSlack slack) {
+    zx_time_t earliest = deadline;
+    zx_time_t latest = deadline;
+    if (slack.mode() != TIMER_SLACK_LATE) {
+        earliest = zx_time_sub_duration(deadline, slack.amount());
+    }
+    if (slack.mode() != TIMER_SLACK_EARLY) {
+        latest = zx_time_add_duration(deadline, slack.amount());
+    }
+    return timer.scheduled_time >= earliest && timer.scheduled_time <= latest &&
+           zx_time_sub_duration(timer.scheduled_time, timer.slack) == deadline;
+}
+
+// Set many timers far in the future, then cancel them all in a different order.
+static bool many_timers_cancel() {
+    BEGIN_TEST;
+
+    timer_args arg{};
+    timer_t* timers = static_cast<timer_t*>(malloc(sizeof(timer_t) * kManyTimers));
+    ASSERT_NONNULL(timers, "");
+
+    const zx_time_t base = current_time() + ZX_HOUR(5);
+    for (size_t i = 0; i < kManyTimers; i++) {
+        timer_init(&timers[i]);
+        zx_time_t deadline = base + rand_duration(ZX_SEC(1));
+        TimerSlack slack = rand_slack(ZX_USEC(100));
+        timer_set(&timers[i], deadline, slack, timer_cb, &arg);
+        EXPECT_TRUE(within_slack(timers[i], deadline, slack), "");
+    }
+
+    // Cancel them with a stride that visits every timer once.
+    for (size_t i = 0, ix = 0; i < kManyTimers; i++, ix = (ix + 7919) % kManyTimers) {
+        EXPECT_TRUE(timer_cancel(&timers[ix]), "");
+    }
+    EXPECT_FALSE(atomic_load(&arg.timer_fired), "");
+
+    free(timers);
+    END_TEST;
+}
+
+struct many_timers_args {
+    volatile int fired;
+    volatile int early;
+    volatile int out_of_order;
+    // The scheduled_time of the last timer to fire on each cpu.
+    zx_time_t last[SMP_MAX_CPUS];
+};
+
+static void many_timers_cb(struct timer* t, zx_time_t now, void* void_arg) {
+    many_timers_args* arg = reinterpret_cast<many_timers_args*>(void_arg);
+    const uint cpu = arch_curr_cpu_num();
+    if (now < t->scheduled_time) {
+        atomic_add(&arg->early, 1);
+    }
+    if (t->scheduled_time < arg->last[cpu]) {
+        atomic_add(&arg->out_of_order, 1);
+    }
+    arg->last[cpu] = t->scheduled_time;
+    atomic_add(&arg->fired, 1);
+}
+
+// Set many timers a few milliseconds out and see that each cpu fires its timers in order, and
+// none of them early.
+static bool many_timers_fire_in_order() {
+    BEGIN_TEST;
+
+    many_timers_args arg{};
+    timer_t* timers = static_cast<timer_t*>(malloc(sizeof(timer_t) * kManyTimers));
+    ASSERT_NONNULL(timers, "");
+
+    const zx_time_t base = current_time() + ZX_MSEC(100);
+    for (size_t i = 0; i < kManyTimers; i++) {
+        timer_init(&timers[i]);
+        zx_time_t deadline = base + rand_duration(ZX_MSEC(10));
+        TimerSlack slack = rand_slack(ZX_USEC(50));
+        timer_set(&timers[i], deadline, slack, many_timers_cb, &arg);
+        EXPECT_TRUE(within_slack(timers[i], deadline, slack), "");
+    }
+    // If the first timers fired before the last were set, those could rightly fire out of order.
+    const bool all_set_in_time = current_time() < base - ZX_USEC(50);
+
+    while (atomic_load(&arg.fired) != static_cast<int>(kManyTimers)) {
+        thread_sleep_relative(ZX_MSEC(5));
+    }
+    EXPECT_EQ(atomic_load(&arg.early), 0, "");
+    if (all_set_in_time) {
+        EXPECT_EQ(atomic_load(&arg.out_of_order), 0, "");
+    } else {
+        printf("setting %zu timers took too long to check their order\n", kManyTimers);
+    }
+
+    // Every timer has fired, but make sure none is still in its callback.
+    for (size_t i = 0; i < kManyTimers; i++) {
+        EXPECT_FALSE(timer_cancel(&timers[i]), "");
+    }
+
+    free(timers);
+    END_TEST;
+}
+
 UNITTEST_START_TESTCASE(timer_tests)
 UNITTEST("cancel_before_deadline", cancel_before_deadline)
 UNITTEST("cancel_after_fired", cancel_after_fired)
@@ -482,4 +592,6 @@ UNITTEST("cancel_from_callback", cancel_from_callback)
 UNITTEST("set_from_callback", set_from_callback)
 UNITTEST("trylock_or_cancel_canceled", trylock_or_cancel_canceled)
 UNITTEST("trylock_or_cancel_get_lock", trylock_or_cancel_get_lock)
+UNITTEST("many_timers_cancel", many_timers_cancel)
+UNITTEST("many_timers_fire_in_order", many_timers_fire_in_order)
 UNITTEST_END_TESTCASE(timer_tests, "timer", "timer tests");
@@ -29,6 +29,10 @@ enum vm_page_state {
 #define VM_PAGE_STATE_BITS 3
 static_assert((1u << VM_PAGE_STATE_BITS) >= VM_PAGE_STATE_COUNT_, "");
 
+// page flags
+#define VM_PAGE_FLAG_PMM_CACHED (0x1) // page is sitting in a pmm per cpu page cache
+#define VM_PAGE_FLAG_ZEROED     (0x2) // free page is known to be filled with zeroes
+
 // core per page structure allocated at pmm arena creation time
 typedef struct vm_page {
     struct list_node queue_node;
@@ -47,6 +51,9 @@ typedef struct vm_page {
 #define VM_PAGE_OBJECT_MAX_PIN_COUNT ((1ul << VM_PAGE_OBJECT_PIN_COUNT_BITS) - 1)
 
             uint8_t pin_count : VM_PAGE_OBJECT_PIN_COUNT_BITS;
+            // set while the page is part of an intact large page run in its
+            // object's VmPageList
+            uint8_t large_page : 1;
         } object; // attached to a vm object
     };
 
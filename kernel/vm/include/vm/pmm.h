@@ -32,6 +32,7 @@ zx_status_t pmm_add_arena(const pmm_arena_info_t* arena) __NONNULL((1));
 // flags for allocation routines below
 #define PMM_ALLOC_FLAG_ANY (0x0)    // no restrictions on which arena to allocate from
 #define PMM_ALLOC_FLAG_LO_MEM (0x1) // allocate only from arenas marked LO_MEM
+#define PMM_ALLOC_FLAG_ZEROED (0x2) // return pages filled with zeroes
 
 // Allocate count pages of physical memory, adding to the tail of the passed list.
 // The list must be initialized.
@@ -57,6 +58,15 @@ void pmm_free(list_node* list) __NONNULL((1));
 // Free a single page.
 void pmm_free_page(vm_page_t* page) __NONNULL((1));
 
+// Set the watermarks of the per cpu page caches that sit in front of the
+// global free list. Each cpu caches at most |high| free pages and refills or
+// drains them |batch| pages at a time. A |high| of 0 disables the caches.
+zx_status_t pmm_set_page_cache_limits(size_t high, size_t batch);
+void pmm_get_page_cache_limits(size_t* high, size_t* batch) __NONNULL((1, 2));
+
+// Return every page held in a per cpu page cache to the global free list.
+void pmm_drain_page_caches();
+
 // Return count of unallocated physical pages in system.
 uint64_t pmm_count_free_pages();
 
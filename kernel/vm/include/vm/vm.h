@@ -19,6 +19,13 @@
 #define ROUNDUP_PAGE_SIZE(x) ROUNDUP((x), PAGE_SIZE)
 #define IS_PAGE_ALIGNED(x) IS_ALIGNED((x), PAGE_SIZE)
 
+// Large pages that user VMOs may be opportunistically backed and mapped with.
+// This is the second level page table entry size for a 4KB granule on both
+// x86 and arm64.
+#define LARGE_PAGE_SIZE_SHIFT 21
+#define LARGE_PAGE_SIZE (1UL << LARGE_PAGE_SIZE_SHIFT)
+#define LARGE_PAGE_PAGE_COUNT (LARGE_PAGE_SIZE / PAGE_SIZE)
+
 // kernel address space
 static_assert(KERNEL_ASPACE_BASE + (KERNEL_ASPACE_SIZE - 1) > KERNEL_ASPACE_BASE, "");
 
@@ -110,6 +110,17 @@ public:
     // Recursively compute the number of allocated pages within this region
     virtual size_t AllocatedPages() const;
 
+    // Page fault counters of the mappings within a region
+    struct FaultStats {
+        // Number of faults resolved by the mappings
+        uint64_t page_faults = 0;
+        // Number of additional pages mapped around faulting addresses
+        uint64_t fault_around_pages = 0;
+    };
+
+    // Recursively accumulate the page fault counters within this region into *stats*
+    void GetFaultStats(FaultStats* stats) const;
+
     // Subtype information and safe down-casting
     virtual bool is_mapping() const = 0;
     fbl::RefPtr<VmAddressRegion> as_vm_address_region();
@@ -168,6 +179,9 @@ protected:
     // Version of AllocatedPages() that does not acquire the aspace lock
     virtual size_t AllocatedPagesLocked() const = 0;
 
+    // Version of GetFaultStats() that does not acquire the aspace lock
+    virtual void GetFaultStatsLocked(FaultStats* stats) const = 0;
+
     // Transition from NOT_READY to READY, and add references to self to related
     // structures.
     virtual void Activate() = 0;
@@ -254,6 +268,8 @@ protected:
     explicit VmAddressRegion(VmAspace& kernel_aspace);
     // Count the allocated pages, caller must be holding the aspace lock
     size_t AllocatedPagesLocked() const override;
+    // Sum the fault counters of all children, caller must be holding the aspace lock
+    void GetFaultStatsLocked(FaultStats* stats) const override;
     // Used to implement VmAspace::EnumerateChildren.
     // |aspace_->lock()| must be held.
     virtual bool EnumerateChildrenLocked(VmEnumerator* ve, uint depth);
@@ -404,6 +420,8 @@ public:
         return 0;
     }
 
+    void GetFaultStatsLocked(FaultStats* stats) const override {}
+
     zx_status_t DestroyLocked() override {
         return ZX_ERR_BAD_STATE;
     }
@@ -486,6 +504,9 @@ private:
     // Version of AllocatedPages() that does not acquire the aspace lock
     size_t AllocatedPagesLocked() const override;
 
+    // Version of GetFaultStats() that does not acquire the aspace lock
+    void GetFaultStatsLocked(FaultStats* stats) const override;
+
     void Activate() override;
 
     // Version of Activate that does not take the object_ lock.
@@ -500,6 +521,20 @@ private:
     // cached mapping flags (read/write/user/etc)
     uint arch_mmu_flags_;
 
+    // Map already present pages of the object around the faulting address *va*.
+    // Returns the number of pages mapped.
+    size_t FaultAroundLocked(vaddr_t va, uint pf_flags) TA_REQ(object_->lock());
+
+    // If the object backs *vmo_offset* with a large page that can be mapped as a
+    // whole within this mapping, returns where it would be mapped and its
+    // physical address.
+    zx_status_t GetLargePageRangeLocked(uint64_t vmo_offset, vaddr_t* large_va, paddr_t* large_pa)
+        TA_REQ(object_->lock());
+
     // used to detect recursions through the vmo fault path
     bool currently_faulting_ = false;
+
+    // page fault counters, protected by the aspace lock
+    uint64_t page_faults_ = 0;
+    uint64_t fault_around_pages_ = 0;
 };
@@ -68,6 +68,18 @@ public:
         return AllocatedPagesInRange(0, size());
     }
 
+    // Returns the number of LARGE_PAGE_SIZE physically contiguous runs
+    // currently backing the object.
+    virtual size_t AllocatedLargePages() const {
+        return 0;
+    }
+
+    // Returns true if the object may back aligned ranges with large pages, in
+    // which case mappings of it should be placed on LARGE_PAGE_SIZE boundaries.
+    virtual bool CanUseLargePages() const {
+        return false;
+    }
+
     // find physical pages to back the range of the object
     virtual zx_status_t CommitRange(uint64_t offset, uint64_t len) {
         return ZX_ERR_NOT_SUPPORTED;
@@ -183,6 +195,13 @@ public:
         return ZX_ERR_NOT_SUPPORTED;
     }
 
+    // If |offset| is backed by an intact large page, returns the
+    // LARGE_PAGE_SIZE aligned object offset and physical address it starts at.
+    virtual zx_status_t GetLargePageLocked(uint64_t offset, uint64_t* large_offset,
+                                           paddr_t* pa) TA_REQ(lock_) {
+        return ZX_ERR_NOT_FOUND;
+    }
+
     Lock<fbl::Mutex>* lock() TA_RET_CAP(lock_) { return &lock_; }
     Lock<fbl::Mutex>& lock_ref() TA_RET_CAP(lock_) { return lock_; }
 
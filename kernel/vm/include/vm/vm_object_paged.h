@@ -48,6 +48,11 @@ public:
     static zx_status_t CreateExternal(fbl::RefPtr<PageSource> src,
                                       uint64_t size, fbl::RefPtr<VmObject>* vmo);
 
+    // After failing to find a free large page, VMOs stop looking for a while.
+    // Lets the next large page allocation search the arenas right away, e.g.
+    // once contiguous memory has been freed.
+    static void ResetLargePageBackoff();
+
     zx_status_t Resize(uint64_t size) override;
     zx_status_t ResizeLocked(uint64_t size) override TA_REQ(lock_);
     uint32_t create_options() const override { return options_; }
@@ -60,6 +65,8 @@ public:
     bool is_resizable() const override { return (options_ & kResizable); }
 
     size_t AllocatedPagesInRange(uint64_t offset, uint64_t len) const override;
+    size_t AllocatedLargePages() const override;
+    bool CanUseLargePages() const override;
 
     zx_status_t CommitRange(uint64_t offset, uint64_t len) override;
     zx_status_t DecommitRange(uint64_t offset, uint64_t len) override;
@@ -87,6 +94,9 @@ public:
         // Calls a Locked method of the parent, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS;
 
+    zx_status_t GetLargePageLocked(uint64_t offset, uint64_t* large_offset,
+                                   paddr_t* pa) override TA_REQ(lock_);
+
     zx_status_t CloneCOW(bool resizable, uint64_t offset, uint64_t size, bool copy_name,
                          fbl::RefPtr<VmObject>* clone_vmo) override
         // Calls a Locked method of the child, which confuses analysis.
@@ -135,6 +145,18 @@ private:
     // internal check if any pages in a range are pinned
     bool AnyPagesPinnedLocked(uint64_t offset, size_t len) TA_REQ(lock_);
 
+    // whether the parent, if any, already has a page backing |offset|
+    bool ParentHasPageLocked(uint64_t offset)
+        // Calls a Locked method of the parent, which confuses analysis.
+        TA_NO_THREAD_SAFETY_ANALYSIS;
+
+    // whether new pages may be allocated as large pages
+    bool CanUseLargePagesLocked() const TA_REQ(lock_);
+
+    // try to back the empty, LARGE_PAGE_SIZE aligned range at |offset| with a
+    // single large page
+    zx_status_t AllocLargePageLocked(uint64_t offset) TA_REQ(lock_);
+
     // internal read/write routine that takes a templated copy function to help share some code
     template <typename T>
     zx_status_t ReadWriteInternal(uint64_t offset, size_t len, bool write, T copyfunc);
@@ -227,10 +227,30 @@ public:
     // Frees all pages in the range [start_offset, end_offset).
     void FreePages(uint64_t start_offset, uint64_t end_offset);
     bool IsEmpty();
+    // Returns true if any page is present in the range [start_offset, end_offset).
+    bool AnyPagesInRange(uint64_t start_offset, uint64_t end_offset) const;
 
     // Takes the pages in the range [offset, length) out of this page list.
     VmPageSpliceList TakePages(uint64_t offset, uint64_t length);
 
+    // Adds the LARGE_PAGE_PAGE_COUNT physically contiguous pages on |pages|, in
+    // ascending order, as one large page at the LARGE_PAGE_SIZE aligned
+    // |offset|.  Every slot in the range must be empty.  On success |pages| is
+    // left empty.
+    zx_status_t AddLargePage(list_node* pages, uint64_t offset);
+    // Returns the first page of the intact large page covering |offset|, or
+    // null if |offset| is not backed by one.
+    vm_page* GetLargePage(uint64_t offset);
+    // Number of intact large pages in the list.
+    size_t large_page_count() const { return large_page_count_; }
+
 private:
+    // Large pages are tracked by flagging each of their pages.  Removing any
+    // page of a large page, or taking it out of the list, first splits it back
+    // into individually tracked pages.
+    void SplitLargePage(uint64_t offset);
+    void SplitLargePagesInRange(uint64_t start_offset, uint64_t end_offset);
+
     fbl::WAVLTree<uint64_t, ktl::unique_ptr<VmPageListNode>> list_;
+    size_t large_page_count_ = 0;
 };
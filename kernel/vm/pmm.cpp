@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/cmdline.h>
 #include <kernel/mp.h>
 #include <kernel/timer.h>
 #include <lib/console.h>
@@ -47,6 +48,24 @@ static void pmm_enforce_fill(uint level) {
 LK_INIT_HOOK(pmm_fill, &pmm_enforce_fill, LK_INIT_LEVEL_VM);
 #endif
 
+static void pmm_page_cache_init(uint level) {
+    uint32_t high = cmdline_get_uint32("kernel.pmm.cache-high", PMM_PAGE_CACHE_DEFAULT_HIGH);
+    uint32_t batch = cmdline_get_uint32("kernel.pmm.cache-batch", PMM_PAGE_CACHE_DEFAULT_BATCH);
+
+    zx_status_t status = pmm_node.SetPageCacheLimits(high, batch);
+    if (status != ZX_OK) {
+        printf("PMM: invalid page cache limits high %u batch %u, using defaults\n", high, batch);
+        pmm_node.SetPageCacheLimits(PMM_PAGE_CACHE_DEFAULT_HIGH, PMM_PAGE_CACHE_DEFAULT_BATCH);
+    }
+}
+LK_INIT_HOOK(pmm_page_cache, &pmm_page_cache_init, LK_INIT_LEVEL_VM);
+
+static void pmm_zero_pool_init(uint level) {
+    pmm_node.StartZeroPool(cmdline_get_uint64("kernel.pmm.zero-pool-pages",
+                                              PMM_ZERO_POOL_DEFAULT_PAGES));
+}
+LK_INIT_HOOK(pmm_zero_pool, &pmm_zero_pool_init, LK_INIT_LEVEL_THREADING);
+
 vm_page_t* paddr_to_vm_page(paddr_t addr) {
     return pmm_node.PaddrToPage(addr);
 }
@@ -99,6 +118,18 @@ void pmm_free_page(vm_page* page) {
     pmm_node.FreePage(page);
 }
 
+zx_status_t pmm_set_page_cache_limits(size_t high, size_t batch) {
+    return pmm_node.SetPageCacheLimits(high, batch);
+}
+
+void pmm_get_page_cache_limits(size_t* high, size_t* batch) {
+    pmm_node.GetPageCacheLimits(high, batch);
+}
+
+void pmm_drain_page_caches() {
+    pmm_node.DrainPageCaches();
+}
+
 uint64_t pmm_count_free_pages() {
     return pmm_node.CountFreePages();
 }
@@ -127,6 +158,8 @@ static int cmd_pmm(int argc, const cmd_args* argv, uint32_t flags) {
         printf("%s dump\n", argv[0].str);
         if (!is_panic) {
             printf("%s free\n", argv[0].str);
+            printf("%s cache [<high> <batch>]\n", argv[0].str);
+            printf("%s cache drain\n", argv[0].str);
         }
         return ZX_ERR_INTERNAL;
     }
@@ -152,6 +185,19 @@ static int cmd_pmm(int argc, const cmd_args* argv, uint32_t flags) {
             timer_cancel(&timer);
             show_mem = false;
         }
+    } else if (!strcmp(argv[1].str, "cache")) {
+        if (argc == 3 && !strcmp(argv[2].str, "drain")) {
+            pmm_node.DrainPageCaches();
+        } else if (argc == 4) {
+            zx_status_t status = pmm_node.SetPageCacheLimits(argv[2].u, argv[3].u);
+            if (status != ZX_OK) {
+                printf("batch must be between 1 and high, or high must be 0\n");
+                return status;
+            }
+        } else if (argc != 2) {
+            goto usage;
+        }
+        pmm_node.DumpPageCaches();
     } else {
         printf("unknown command\n");
         goto usage;
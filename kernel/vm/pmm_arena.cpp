@@ -137,7 +137,13 @@ retry:
 
 void PmmArena::CountStates(size_t state_count[VM_PAGE_STATE_COUNT_]) const {
     for (size_t i = 0; i < size() / PAGE_SIZE; i++) {
-        state_count[page_array_[i].state]++;
+        // pages parked in a per cpu page cache are free in all but name
+        const vm_page_t& page = page_array_[i];
+        if (page.flags & VM_PAGE_FLAG_PMM_CACHED) {
+            state_count[VM_PAGE_STATE_FREE]++;
+        } else {
+            state_count[page.state]++;
+        }
     }
 }
 
@@ -5,8 +5,10 @@
 // https://opensource.org/licenses/MIT
 #include "pmm_node.h"
 
+#include <arch/ops.h>
 #include <inttypes.h>
 #include <kernel/mp.h>
+#include <lib/counters.h>
 #include <new>
 #include <trace.h>
 #include <vm/bootalloc.h>
@@ -16,6 +18,14 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+KCOUNTER(pmm_cache_hit, "kernel.pmm.cache.hit");
+KCOUNTER(pmm_cache_miss, "kernel.pmm.cache.miss");
+KCOUNTER(pmm_cache_refill, "kernel.pmm.cache.refill");
+KCOUNTER(pmm_cache_drain, "kernel.pmm.cache.drain");
+KCOUNTER(pmm_zero_pool_hit, "kernel.pmm.zero_pool.hit");
+KCOUNTER(pmm_zero_pool_miss, "kernel.pmm.zero_pool.miss");
+KCOUNTER(pmm_zero_pool_zeroed, "kernel.pmm.zero_pool.zeroed");
+
 namespace {
 
 void set_state_alloc(vm_page* page) {
@@ -26,6 +36,18 @@ void set_state_alloc(vm_page* page) {
     page->state = VM_PAGE_STATE_ALLOC;
 }
 
+void zero_page(vm_page* page) {
+    void* ptr = paddr_to_physmap(page->paddr());
+    DEBUG_ASSERT(ptr);
+
+    arch_zero_page(ptr);
+}
+
+// move every page of |from| to the tail of |to|
+void list_append(list_node* to, list_node* from) {
+    list_splice_after(from, to->prev);
+}
+
 } // namespace
 
 PmmNode::PmmNode() {
@@ -91,24 +113,158 @@ void PmmNode::AddFreePages(list_node* list) TA_NO_THREAD_SAFETY_ANALYSIS {
     LTRACEF("free count now %" PRIu64 "\n", free_count_);
 }
 
-zx_status_t PmmNode::AllocPage(uint alloc_flags, vm_page_t** page_out, paddr_t* pa_out) {
-    Guard<fbl::Mutex> guard{&lock_};
+// Unlink a free page from whichever free queue it is sitting in.
+void PmmNode::UnlinkFreePageLocked(vm_page* page) {
+    DEBUG_ASSERT(page->is_free());
+    DEBUG_ASSERT(list_in_list(&page->queue_node));
 
-    vm_page* page = list_remove_head_type(&free_list_, vm_page, queue_node);
-    if (!page) {
-        return ZX_ERR_NO_MEMORY;
+    list_delete(&page->queue_node);
+
+    if (page->flags & VM_PAGE_FLAG_ZEROED) {
+        page->flags &= ~VM_PAGE_FLAG_ZEROED;
+        DEBUG_ASSERT(zeroed_count_.load(fbl::memory_order_relaxed) > 0);
+        zeroed_count_.fetch_sub(1, fbl::memory_order_relaxed);
     }
 
     DEBUG_ASSERT(free_count_ > 0);
     free_count_--;
+}
 
-    DEBUG_ASSERT(page->is_free());
+vm_page* PmmNode::AllocPageLocked() {
+    // hand out dirty pages first, the zero pool is only dipped into once they run out
+    vm_page* page = list_peek_head_type(&free_list_, vm_page, queue_node);
+    if (page) {
+#if PMM_ENABLE_FREE_FILL
+        CheckFreeFill(page);
+#endif
+    } else {
+        page = list_peek_head_type(&zeroed_list_, vm_page, queue_node);
+        if (!page) {
+            return nullptr;
+        }
+    }
+
+    UnlinkFreePageLocked(page);
 
     set_state_alloc(page);
 
-#if PMM_ENABLE_FREE_FILL
-    CheckFreeFill(page);
-#endif
+    return page;
+}
+
+vm_page* PmmNode::AllocZeroedPage() {
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    if (TakeZeroedPagesFromCache(1, &pages)) {
+        return list_remove_head_type(&pages, vm_page, queue_node);
+    }
+
+    // racy peek, so that an empty pool does not cost a trip through lock_
+    if (zeroed_count_.load(fbl::memory_order_relaxed) == 0) {
+        return nullptr;
+    }
+
+    // take a batch for the local cpu's cache along with the page, so the next
+    // few zeroed allocations on this cpu do not need lock_
+    if (TakeZeroPoolPages(1 + cache_batch_.load(fbl::memory_order_relaxed), &pages) == 0) {
+        return nullptr;
+    }
+
+    vm_page* page = list_remove_head_type(&pages, vm_page, queue_node);
+    page->flags &= ~VM_PAGE_FLAG_ZEROED;
+
+    PutZeroedPagesInCache(&pages);
+
+    return page;
+}
+
+size_t PmmNode::AllocZeroedPages(size_t count, list_node* list) {
+    size_t allocated = TakeZeroedPagesFromCache(count, list);
+    if (allocated == count || zeroed_count_.load(fbl::memory_order_relaxed) == 0) {
+        return allocated;
+    }
+
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    allocated += TakeZeroPoolPages(count - allocated, &pages);
+
+    vm_page* page;
+    list_for_every_entry (&pages, page, vm_page, queue_node) {
+        page->flags &= ~VM_PAGE_FLAG_ZEROED;
+    }
+    list_append(list, &pages);
+
+    return allocated;
+}
+
+size_t PmmNode::TakeZeroPoolPages(size_t count, list_node* list) {
+    Guard<fbl::Mutex> guard{&lock_};
+
+    size_t allocated = 0;
+    while (allocated < count) {
+        vm_page* page = list_peek_head_type(&zeroed_list_, vm_page, queue_node);
+        if (!page) {
+            break;
+        }
+
+        UnlinkFreePageLocked(page);
+        set_state_alloc(page);
+
+        // still zeroed, the caller clears the flag as it hands the page out
+        page->flags |= VM_PAGE_FLAG_ZEROED;
+        list_add_tail(list, &page->queue_node);
+        allocated++;
+    }
+
+    if (zeroed_count_.load(fbl::memory_order_relaxed) < zero_pool_target_ / 2) {
+        event_signal(&zero_pool_event_, false);
+    }
+
+    return allocated;
+}
+
+void PmmNode::ZeroPoolMiss(size_t count) {
+    kcounter_add(pmm_zero_pool_miss, count);
+
+    // okay to read outside of the lock, the zero pool thread copes with spurious wakeups
+    [this]() TA_NO_THREAD_SAFETY_ANALYSIS {
+        if (zero_pool_target_ > 0) {
+            event_signal(&zero_pool_event_, false);
+        }
+    }();
+}
+
+// Pull a batch of pages off the free list to top up the local cpu's page cache once lock_
+// has been dropped. Called on the cache miss paths while lock_ is already held.
+void PmmNode::AllocRefillLocked(list_node* refill) {
+    const size_t batch = cache_batch_.load(fbl::memory_order_relaxed);
+    for (size_t i = 0; i < batch; i++) {
+        vm_page* page = AllocPageLocked();
+        if (!page) {
+            break;
+        }
+        list_add_tail(refill, &page->queue_node);
+    }
+}
+
+zx_status_t PmmNode::AllocPage(uint alloc_flags, vm_page_t** page_out, paddr_t* pa_out) {
+    vm_page* page = nullptr;
+
+    if (alloc_flags & PMM_ALLOC_FLAG_ZEROED) {
+        page = AllocZeroedPage();
+        if (page) {
+            kcounter_add(pmm_zero_pool_hit, 1);
+        }
+    }
+
+    if (!page) {
+        zx_status_t status = AllocDirtyPage(&page);
+        if (status != ZX_OK) {
+            return status;
+        }
+
+        if (alloc_flags & PMM_ALLOC_FLAG_ZEROED) {
+            ZeroPoolMiss(1);
+            zero_page(page);
+        }
+    }
 
     if (pa_out) {
         *pa_out = page->paddr();
@@ -123,6 +279,29 @@ zx_status_t PmmNode::AllocPage(uint alloc_flags, vm_page_t** page_out, paddr_t*
     return ZX_OK;
 }
 
+zx_status_t PmmNode::AllocDirtyPage(vm_page** page_out) {
+    list_node list = LIST_INITIAL_VALUE(list);
+    if (TakePagesFromCache(1, &list)) {
+        *page_out = list_remove_head_type(&list, vm_page, queue_node);
+        return ZX_OK;
+    }
+
+    list_node refill = LIST_INITIAL_VALUE(refill);
+    {
+        Guard<fbl::Mutex> guard{&lock_};
+
+        *page_out = AllocPageLocked();
+        if (!*page_out) {
+            return ZX_ERR_NO_MEMORY;
+        }
+
+        AllocRefillLocked(&refill);
+    }
+    RefillCache(&refill);
+
+    return ZX_OK;
+}
+
 zx_status_t PmmNode::AllocPages(size_t count, uint alloc_flags, list_node* list) {
     LTRACEF("count %zu\n", count);
 
@@ -133,32 +312,71 @@ zx_status_t PmmNode::AllocPages(size_t count, uint alloc_flags, list_node* list)
         return ZX_OK;
     }
 
-    Guard<fbl::Mutex> guard{&lock_};
+    if (!(alloc_flags & PMM_ALLOC_FLAG_ZEROED)) {
+        return AllocDirtyPages(count, list);
+    }
 
-    while (count > 0) {
-        vm_page* page = list_remove_head_type(&free_list_, vm_page, queue_node);
-        if (unlikely(!page)) {
-            // free pages that have already been allocated
-            FreeListLocked(list);
-            return ZX_ERR_NO_MEMORY;
+    // take what the zero pool has, and zero the rest by hand
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    size_t zeroed = AllocZeroedPages(count, &pages);
+    kcounter_add(pmm_zero_pool_hit, zeroed);
+
+    if (zeroed < count) {
+        list_node dirty = LIST_INITIAL_VALUE(dirty);
+        zx_status_t status = AllocDirtyPages(count - zeroed, &dirty);
+        if (status != ZX_OK) {
+            FreeList(&pages);
+            return status;
         }
 
-        LTRACEF("allocating page %p, pa %#" PRIxPTR "\n", page, page->paddr());
+        ZeroPoolMiss(count - zeroed);
 
-        DEBUG_ASSERT(free_count_ > 0);
+        vm_page* page;
+        list_for_every_entry (&dirty, page, vm_page, queue_node) {
+            zero_page(page);
+        }
+        list_append(&pages, &dirty);
+    }
 
-        free_count_--;
+    list_append(list, &pages);
 
-        DEBUG_ASSERT(page->is_free());
-#if PMM_ENABLE_FREE_FILL
-        CheckFreeFill(page);
-#endif
+    return ZX_OK;
+}
 
-        page->state = VM_PAGE_STATE_ALLOC;
-        list_add_tail(list, &page->queue_node);
+zx_status_t PmmNode::AllocDirtyPages(size_t count, list_node* list) {
+    // small requests may be satisfied entirely out of the local cpu's page cache
+    const bool cacheable = count <= cache_batch_.load(fbl::memory_order_relaxed);
+    if (cacheable && TakePagesFromCache(count, list)) {
+        return ZX_OK;
+    }
 
-        count--;
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    list_node refill = LIST_INITIAL_VALUE(refill);
+    {
+        Guard<fbl::Mutex> guard{&lock_};
+
+        while (count > 0) {
+            vm_page* page = AllocPageLocked();
+            if (unlikely(!page)) {
+                // free pages that have already been allocated
+                FreeListLocked(&pages);
+                return ZX_ERR_NO_MEMORY;
+            }
+
+            LTRACEF("allocating page %p, pa %#" PRIxPTR "\n", page, page->paddr());
+
+            list_add_tail(&pages, &page->queue_node);
+
+            count--;
+        }
+
+        if (cacheable) {
+            AllocRefillLocked(&refill);
+        }
     }
+    RefillCache(&refill);
+
+    list_append(list, &pages);
 
     return ZX_OK;
 }
@@ -175,9 +393,12 @@ zx_status_t PmmNode::AllocRange(paddr_t address, size_t count, list_node* list)
     }
 
     address = ROUNDDOWN(address, PAGE_SIZE);
+    const paddr_t start_address = address;
+    bool drained_caches = false;
 
     Guard<fbl::Mutex> guard{&lock_};
 
+retry:
     // walk through the arenas, looking to see if the physical page belongs to it
     for (auto& a : arena_list_) {
         while (allocated < count && a.address_in_arena(address)) {
@@ -190,7 +411,7 @@ zx_status_t PmmNode::AllocRange(paddr_t address, size_t count, list_node* list)
                 break;
             }
 
-            list_delete(&page->queue_node);
+            UnlinkFreePageLocked(page);
 
             page->state = VM_PAGE_STATE_ALLOC;
 
@@ -198,7 +419,6 @@ zx_status_t PmmNode::AllocRange(paddr_t address, size_t count, list_node* list)
 
             allocated++;
             address += PAGE_SIZE;
-            free_count_--;
         }
 
         if (allocated == count) {
@@ -209,6 +429,15 @@ zx_status_t PmmNode::AllocRange(paddr_t address, size_t count, list_node* list)
     if (allocated != count) {
         // we were not able to allocate the entire run, free these pages
         FreeListLocked(list);
+
+        // some of the range may be held by the per cpu page caches, give
+        // those back to the node and try once more
+        if (!drained_caches && DrainPageCachesLocked()) {
+            drained_caches = true;
+            address = start_address;
+            allocated = 0;
+            goto retry;
+        }
         return ZX_ERR_NOT_FOUND;
     }
 
@@ -230,8 +459,37 @@ zx_status_t PmmNode::AllocContiguous(const size_t count, uint alloc_flags, uint8
     DEBUG_ASSERT(pa);
     DEBUG_ASSERT(list);
 
-    Guard<fbl::Mutex> guard{&lock_};
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    zx_status_t status;
+    {
+        Guard<fbl::Mutex> guard{&lock_};
+
+        status = AllocContiguousLocked(count, alignment_log2, pa, &pages);
+    }
+    if (status != ZX_OK) {
+        return status;
+    }
 
+    // zero the run with the lock dropped, skipping what the zero pool already did for us
+    const bool zero = alloc_flags & PMM_ALLOC_FLAG_ZEROED;
+    vm_page* page;
+    list_for_every_entry (&pages, page, vm_page, queue_node) {
+        if (zero && !(page->flags & VM_PAGE_FLAG_ZEROED)) {
+            zero_page(page);
+        }
+        page->flags &= ~VM_PAGE_FLAG_ZEROED;
+    }
+
+    list_append(list, &pages);
+
+    return ZX_OK;
+}
+
+zx_status_t PmmNode::AllocContiguousLocked(size_t count, uint8_t alignment_log2, paddr_t* pa,
+                                           list_node* list) {
+    bool drained_caches = false;
+
+retry:
     for (auto& a : arena_list_) {
         vm_page_t* p = a.FindFreeContiguous(count, alignment_log2);
         if (!p) {
@@ -243,18 +501,19 @@ zx_status_t PmmNode::AllocContiguous(const size_t count, uint alloc_flags, uint8
         // remove the pages from the run out of the free list
         for (size_t i = 0; i < count; i++, p++) {
             DEBUG_ASSERT_MSG(p->is_free(), "p %p state %u\n", p, p->state);
-            DEBUG_ASSERT(list_in_list(&p->queue_node));
 
-            list_delete(&p->queue_node);
+            // remember which pages were already zeroed, the caller clears the flag
+            const bool zeroed = p->flags & VM_PAGE_FLAG_ZEROED;
+            UnlinkFreePageLocked(p);
             p->state = VM_PAGE_STATE_ALLOC;
 
-            DEBUG_ASSERT(free_count_ > 0);
-
-            free_count_--;
-
+            if (zeroed) {
+                p->flags |= VM_PAGE_FLAG_ZEROED;
+            } else {
 #if PMM_ENABLE_FREE_FILL
-            CheckFreeFill(p);
+                CheckFreeFill(p);
 #endif
+            }
 
             list_add_tail(list, &p->queue_node);
         }
@@ -262,6 +521,13 @@ zx_status_t PmmNode::AllocContiguous(const size_t count, uint alloc_flags, uint8
         return ZX_OK;
     }
 
+    // free runs may be fragmented by pages held in the per cpu page caches,
+    // give those back to the node and try once more
+    if (!drained_caches && DrainPageCachesLocked()) {
+        drained_caches = true;
+        goto retry;
+    }
+
     LTRACEF("couldn't find run\n");
     return ZX_ERR_NOT_FOUND;
 }
@@ -291,9 +557,15 @@ void PmmNode::FreePageLocked(vm_page* page) {
 }
 
 void PmmNode::FreePage(vm_page* page) {
-    Guard<fbl::Mutex> guard{&lock_};
+    // remove it from its old queue so it can be handed over as a list
+    if (list_in_list(&page->queue_node)) {
+        list_delete(&page->queue_node);
+    }
 
-    FreePageLocked(page);
+    list_node list = LIST_INITIAL_VALUE(list);
+    list_add_tail(&list, &page->queue_node);
+
+    FreeList(&list);
 }
 
 void PmmNode::FreeListLocked(list_node* list) {
@@ -307,14 +579,347 @@ void PmmNode::FreeListLocked(list_node* list) {
 }
 
 void PmmNode::FreeList(list_node* list) {
+    DEBUG_ASSERT(list);
+
+    PutPagesInCache(list);
+    if (list_is_empty(list)) {
+        return;
+    }
+
     Guard<fbl::Mutex> guard{&lock_};
 
     FreeListLocked(list);
 }
 
+bool PmmNode::TakePagesFromCache(size_t count, list_node* list) {
+    if (cache_high_.load(fbl::memory_order_relaxed) == 0) {
+        return false;
+    }
+
+    // We may migrate between picking the cache and locking it, which only
+    // costs locality; the cache lock is what protects its contents.
+    PageCache* cache = &page_cache_[arch_curr_cpu_num()];
+    Guard<SpinLock, IrqSave> guard{&cache->lock};
+
+    if (cache->count < count) {
+        kcounter_add(pmm_cache_miss, 1);
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        vm_page* page = list_remove_head_type(&cache->list, vm_page, queue_node);
+        DEBUG_ASSERT(page);
+        DEBUG_ASSERT(page->state == VM_PAGE_STATE_ALLOC);
+        DEBUG_ASSERT(page->flags & VM_PAGE_FLAG_PMM_CACHED);
+
+        page->flags &= ~VM_PAGE_FLAG_PMM_CACHED;
+        list_add_tail(list, &page->queue_node);
+    }
+    cache->count -= count;
+
+    kcounter_add(pmm_cache_hit, 1);
+    return true;
+}
+
+void PmmNode::PutPagesInCache(list_node* list) {
+    const size_t high = cache_high_.load(fbl::memory_order_relaxed);
+    if (high == 0) {
+        return;
+    }
+
+    PageCache* cache = &page_cache_[arch_curr_cpu_num()];
+    Guard<SpinLock, IrqSave> guard{&cache->lock};
+
+    while (cache->count < high) {
+        vm_page* page = list_remove_head_type(list, vm_page, queue_node);
+        if (!page) {
+            return;
+        }
+
+        LTRACEF("page %p state %u paddr %#" PRIxPTR "\n", page, page->state, page->paddr());
+
+        DEBUG_ASSERT(page->state != VM_PAGE_STATE_OBJECT || page->object.pin_count == 0);
+        DEBUG_ASSERT(!page->is_free());
+        DEBUG_ASSERT(!(page->flags & VM_PAGE_FLAG_PMM_CACHED));
+
+        // cached pages stay allocated as far as the node and its arenas are concerned
+        page->state = VM_PAGE_STATE_ALLOC;
+        page->flags |= VM_PAGE_FLAG_PMM_CACHED;
+
+        // most recently freed pages are handed out first, they are the most likely to be cache hot
+        list_add_head(&cache->list, &page->queue_node);
+        cache->count++;
+    }
+
+    if (list_is_empty(list)) {
+        return;
+    }
+
+    // The cache is full and the caller is about to take lock_ to free the
+    // overflow anyway. Drain a batch of the coldest pages along with it so the
+    // next few frees on this cpu do not have to.
+    size_t batch = fbl::min(cache_batch_.load(fbl::memory_order_relaxed), cache->count);
+    for (size_t i = 0; i < batch; i++) {
+        vm_page* page = list_remove_tail_type(&cache->list, vm_page, queue_node);
+        DEBUG_ASSERT(page);
+
+        page->flags &= ~VM_PAGE_FLAG_PMM_CACHED;
+        list_add_tail(list, &page->queue_node);
+    }
+    cache->count -= batch;
+
+    kcounter_add(pmm_cache_drain, 1);
+}
+
+void PmmNode::RefillCache(list_node* refill) {
+    if (list_is_empty(refill)) {
+        return;
+    }
+
+    kcounter_add(pmm_cache_refill, 1);
+
+    // pages that do not fit, if we moved to a cpu with a full cache, go back to the node
+    FreeList(refill);
+}
+
+size_t PmmNode::TakeZeroedPagesFromCache(size_t count, list_node* list) {
+    if (cache_high_.load(fbl::memory_order_relaxed) == 0) {
+        return 0;
+    }
+
+    PageCache* cache = &page_cache_[arch_curr_cpu_num()];
+    Guard<SpinLock, IrqSave> guard{&cache->lock};
+
+    size_t taken = 0;
+    while (taken < count) {
+        vm_page* page = list_remove_head_type(&cache->zeroed, vm_page, queue_node);
+        if (!page) {
+            break;
+        }
+        DEBUG_ASSERT(page->state == VM_PAGE_STATE_ALLOC);
+        DEBUG_ASSERT(page->flags & VM_PAGE_FLAG_PMM_CACHED);
+        DEBUG_ASSERT(page->flags & VM_PAGE_FLAG_ZEROED);
+
+        page->flags &= ~(VM_PAGE_FLAG_PMM_CACHED | VM_PAGE_FLAG_ZEROED);
+        list_add_tail(list, &page->queue_node);
+        taken++;
+    }
+    cache->zeroed_count -= taken;
+
+    return taken;
+}
+
+void PmmNode::PutZeroedPagesInCache(list_node* list) {
+    if (list_is_empty(list)) {
+        return;
+    }
+
+    if (cache_high_.load(fbl::memory_order_relaxed) != 0) {
+        const size_t batch = cache_batch_.load(fbl::memory_order_relaxed);
+
+        PageCache* cache = &page_cache_[arch_curr_cpu_num()];
+        Guard<SpinLock, IrqSave> guard{&cache->lock};
+
+        while (cache->zeroed_count < batch) {
+            vm_page* page = list_remove_head_type(list, vm_page, queue_node);
+            if (!page) {
+                return;
+            }
+            DEBUG_ASSERT(page->state == VM_PAGE_STATE_ALLOC);
+            DEBUG_ASSERT(page->flags & VM_PAGE_FLAG_ZEROED);
+
+            page->flags |= VM_PAGE_FLAG_PMM_CACHED;
+            list_add_tail(&cache->zeroed, &page->queue_node);
+            cache->zeroed_count++;
+        }
+    }
+
+    if (list_is_empty(list)) {
+        return;
+    }
+
+    // we moved to a cpu whose stash is already full, the rest go back to the pool
+    Guard<fbl::Mutex> guard{&lock_};
+
+    FreeZeroedListLocked(list);
+}
+
+void PmmNode::FreeZeroedListLocked(list_node* list) {
+    vm_page* page;
+    while ((page = list_remove_head_type(list, vm_page, queue_node)) != nullptr) {
+        DEBUG_ASSERT(page->state == VM_PAGE_STATE_ALLOC);
+        DEBUG_ASSERT(page->flags & VM_PAGE_FLAG_ZEROED);
+
+        page->state = VM_PAGE_STATE_FREE;
+        list_add_tail(&zeroed_list_, &page->queue_node);
+        zeroed_count_.fetch_add(1, fbl::memory_order_relaxed);
+        free_count_++;
+    }
+}
+
+bool PmmNode::DrainPageCachesLocked() {
+    list_node drained = LIST_INITIAL_VALUE(drained);
+    list_node zeroed = LIST_INITIAL_VALUE(zeroed);
+
+    for (auto& cache : page_cache_) {
+        Guard<SpinLock, IrqSave> guard{&cache.lock};
+
+        vm_page* page;
+        while ((page = list_remove_head_type(&cache.list, vm_page, queue_node)) != nullptr) {
+            page->flags &= ~VM_PAGE_FLAG_PMM_CACHED;
+            list_add_tail(&drained, &page->queue_node);
+        }
+        cache.count = 0;
+
+        while ((page = list_remove_head_type(&cache.zeroed, vm_page, queue_node)) != nullptr) {
+            page->flags &= ~VM_PAGE_FLAG_PMM_CACHED;
+            list_add_tail(&zeroed, &page->queue_node);
+        }
+        cache.zeroed_count = 0;
+    }
+
+    if (list_is_empty(&drained) && list_is_empty(&zeroed)) {
+        return false;
+    }
+
+    kcounter_add(pmm_cache_drain, 1);
+    FreeListLocked(&drained);
+    FreeZeroedListLocked(&zeroed);
+    return true;
+}
+
+void PmmNode::DrainPageCaches() {
+    Guard<fbl::Mutex> guard{&lock_};
+
+    DrainPageCachesLocked();
+}
+
+zx_status_t PmmNode::SetPageCacheLimits(size_t high, size_t batch) {
+    if (high != 0 && (batch == 0 || batch > high)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    Guard<fbl::Mutex> guard{&lock_};
+
+    // turn the caches off while the limits change so no cache grows past the new high
+    // watermark, then start over with empty caches
+    cache_high_.store(0, fbl::memory_order_relaxed);
+    DrainPageCachesLocked();
+
+    cache_batch_.store(high ? batch : 0, fbl::memory_order_relaxed);
+    cache_high_.store(high, fbl::memory_order_relaxed);
+
+    return ZX_OK;
+}
+
+void PmmNode::GetPageCacheLimits(size_t* high, size_t* batch) const {
+    *high = cache_high_.load(fbl::memory_order_relaxed);
+    *batch = cache_batch_.load(fbl::memory_order_relaxed);
+}
+
+uint64_t PmmNode::CountCachedPages() const {
+    uint64_t count = 0;
+    for (const auto& cache : page_cache_) {
+        count += cache.count + cache.zeroed_count;
+    }
+    return count;
+}
+
+void PmmNode::DumpPageCaches() const {
+    printf("pmm node %p: page cache high %zu batch %zu, %" PRIu64 " pages cached\n",
+           this, cache_high_.load(fbl::memory_order_relaxed),
+           cache_batch_.load(fbl::memory_order_relaxed), CountCachedPages());
+    for (uint i = 0; i < arch_max_num_cpus(); i++) {
+        printf("\tcpu %u: %zu pages, %zu zeroed\n", i, page_cache_[i].count,
+               page_cache_[i].zeroed_count);
+    }
+}
+
+void PmmNode::StartZeroPool(size_t target) {
+    {
+        Guard<fbl::Mutex> guard{&lock_};
+
+        DEBUG_ASSERT(zero_pool_thread_ == nullptr);
+        zero_pool_target_ = target;
+    }
+
+    if (target == 0) {
+        return;
+    }
+
+    // runs just above the idle threads, so pages only get zeroed on otherwise idle cpus
+    zero_pool_thread_ = thread_create("pmm zero pool", &PmmNode::ZeroPoolThread, this,
+                                      IDLE_PRIORITY + 1);
+    if (!zero_pool_thread_) {
+        printf("PMM: failed to create zero pool thread\n");
+        return;
+    }
+    thread_detach_and_resume(zero_pool_thread_);
+
+    event_signal(&zero_pool_event_, false);
+}
+
+int PmmNode::ZeroPoolThread(void* arg) {
+    static_cast<PmmNode*>(arg)->ZeroPoolLoop();
+    return 0;
+}
+
+void PmmNode::ZeroPoolLoop() {
+    // number of pages pulled off the free list per trip through lock_
+    static const size_t kBatch = 16;
+
+    for (;;) {
+        event_wait(&zero_pool_event_);
+
+        for (;;) {
+            list_node batch = LIST_INITIAL_VALUE(batch);
+            size_t count = 0;
+            {
+                Guard<fbl::Mutex> guard{&lock_};
+
+                const uint64_t zeroed = zeroed_count_.load(fbl::memory_order_relaxed);
+                const uint64_t want = zeroed < zero_pool_target_ ? zero_pool_target_ - zeroed : 0;
+
+                // take the coldest pages, the head of the free list is the most likely to be
+                // reallocated while still in cache
+                while (count < fbl::min<uint64_t>(want, kBatch)) {
+                    vm_page* page = list_peek_tail_type(&free_list_, vm_page, queue_node);
+                    if (!page) {
+                        break;
+                    }
+
+                    // the page is ours while it is being zeroed, keep arena scans away from it
+                    UnlinkFreePageLocked(page);
+                    page->state = VM_PAGE_STATE_ALLOC;
+                    list_add_tail(&batch, &page->queue_node);
+                    count++;
+                }
+            }
+
+            if (count == 0) {
+                break;
+            }
+
+            vm_page* page;
+            list_for_every_entry (&batch, page, vm_page, queue_node) {
+                zero_page(page);
+                page->flags |= VM_PAGE_FLAG_ZEROED;
+            }
+
+            {
+                Guard<fbl::Mutex> guard{&lock_};
+
+                FreeZeroedListLocked(&batch);
+            }
+
+            kcounter_add(pmm_zero_pool_zeroed, count);
+        }
+    }
+}
+
 // okay if accessed outside of a lock
 uint64_t PmmNode::CountFreePages() const TA_NO_THREAD_SAFETY_ANALYSIS {
-    return free_count_;
+    return free_count_ + CountCachedPages();
 }
 
 uint64_t PmmNode::CountTotalBytes() const TA_NO_THREAD_SAFETY_ANALYSIS {
@@ -340,6 +945,8 @@ void PmmNode::Dump(bool is_panic) const {
     auto dump = [this]() TA_NO_THREAD_SAFETY_ANALYSIS {
         printf("pmm node %p: free_count %zu (%zu bytes), total size %zu\n",
                this, free_count_, free_count_ * PAGE_SIZE, arena_cumulative_size_);
+        printf("\tzero pool %" PRIu64 " of %" PRIu64 " pages\n",
+               zeroed_count_.load(fbl::memory_order_relaxed), zero_pool_target_);
         for (auto& a : arena_list_) {
             a.Dump(false, false);
         }
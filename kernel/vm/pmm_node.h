@@ -5,11 +5,16 @@
 // https://opensource.org/licenses/MIT
 #pragma once
 
+#include <fbl/atomic.h>
 #include <fbl/canary.h>
 #include <fbl/intrusive_double_list.h>
 #include <fbl/mutex.h>
 
+#include <kernel/align.h>
+#include <kernel/event.h>
 #include <kernel/lockdep.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
 #include <vm/pmm.h>
 
 #include "pmm_arena.h"
@@ -17,6 +22,13 @@
 #define PMM_ENABLE_FREE_FILL 0
 #define PMM_FREE_FILL_BYTE 0x42
 
+// default watermarks for the per cpu page caches, in pages
+#define PMM_PAGE_CACHE_DEFAULT_HIGH 64
+#define PMM_PAGE_CACHE_DEFAULT_BATCH 16
+
+// default size of the pool of pre-zeroed free pages, in pages
+#define PMM_ZERO_POOL_DEFAULT_PAGES 1024
+
 // per numa node collection of pmm arenas and worker threads
 class PmmNode {
 public:
@@ -55,10 +67,84 @@ public:
     // add new pages to the free queue. used when boostrapping a PmmArena
     void AddFreePages(list_node* list);
 
+    // Set the watermarks of the per cpu page caches. Each cpu caches at most |high| pages
+    // and refills from or drains to the node free list |batch| pages at a time.
+    // A |high| of 0 disables the caches and returns every cached page to the node.
+    zx_status_t SetPageCacheLimits(size_t high, size_t batch);
+    void GetPageCacheLimits(size_t* high, size_t* batch) const;
+
+    // return every page held in a per cpu cache to the node free list
+    void DrainPageCaches();
+
+    // printf the state of the per cpu page caches
+    void DumpPageCaches() const TA_NO_THREAD_SAFETY_ANALYSIS;
+
+    // Start a low priority thread that zeroes free pages in the background until
+    // |target| of them are available to PMM_ALLOC_FLAG_ZEROED allocations.
+    void StartZeroPool(size_t target);
+
 private:
+    // A small per cpu stash of pages sitting in front of free_list_ so that
+    // the common single page alloc/free paths do not need to take lock_.
+    // Pages in a cache are owned by the cache rather than the node: they
+    // are in the ALLOC state, tagged with VM_PAGE_FLAG_PMM_CACHED, and are
+    // invisible to arena scans such as AllocContiguous and AllocRange.
+    // Pre-zeroed pages taken from the zero pool in a batch are stashed apart
+    // on |zeroed| and keep VM_PAGE_FLAG_ZEROED until they are handed out.
+    struct PageCache {
+        DECLARE_SPINLOCK(PmmNode::PageCache) lock;
+        list_node list TA_GUARDED(lock) = LIST_INITIAL_VALUE(list);
+        size_t count TA_GUARDED(lock) = 0;
+        list_node zeroed TA_GUARDED(lock) = LIST_INITIAL_VALUE(zeroed);
+        size_t zeroed_count TA_GUARDED(lock) = 0;
+    } __CPU_ALIGN;
+
+    void UnlinkFreePageLocked(vm_page* page) TA_REQ(lock_);
+    vm_page* AllocPageLocked() TA_REQ(lock_);
+    zx_status_t AllocDirtyPage(vm_page** page);
+    zx_status_t AllocDirtyPages(size_t count, list_node* list);
+    zx_status_t AllocContiguousLocked(size_t count, uint8_t alignment_log2, paddr_t* pa,
+                                      list_node* list) TA_REQ(lock_);
+    void AllocRefillLocked(list_node* refill) TA_REQ(lock_);
     void FreePageLocked(vm_page* page) TA_REQ(lock_);
     void FreeListLocked(list_node* list) TA_REQ(lock_);
 
+    // Take |count| pages from the local cpu's cache, all or nothing.
+    bool TakePagesFromCache(size_t count, list_node* list);
+
+    // Move pages from |list| into the local cpu's cache up to the high watermark. Pages
+    // that do not fit, plus a batch drained from a full cache, are left in |list|.
+    void PutPagesInCache(list_node* list);
+
+    void RefillCache(list_node* refill);
+
+    // Take up to |count| pre-zeroed pages from the local cpu's cache, returning how many.
+    size_t TakeZeroedPagesFromCache(size_t count, list_node* list);
+
+    // Stash the pre-zeroed pages of |list| in the local cpu's cache, up to a batch.
+    // The ones that do not fit are handed back to the zero pool.
+    void PutZeroedPagesInCache(list_node* list);
+
+    // Return pre-zeroed pages taken out of the zero pool to it.
+    void FreeZeroedListLocked(list_node* list) TA_REQ(lock_);
+
+    // returns true if any pages were returned to the node
+    bool DrainPageCachesLocked() TA_REQ(lock_);
+
+    // Take pages out of the zero pool. Both return nothing rather than wait
+    // when the pool is empty.
+    vm_page* AllocZeroedPage();
+    size_t AllocZeroedPages(size_t count, list_node* list);
+    // Take up to |count| pages off zeroed_list_ under lock_, still tagged VM_PAGE_FLAG_ZEROED.
+    size_t TakeZeroPoolPages(size_t count, list_node* list);
+    void ZeroPoolMiss(size_t count);
+
+    static int ZeroPoolThread(void* arg);
+    void ZeroPoolLoop();
+
+    // number of pages currently held in all per cpu caches
+    uint64_t CountCachedPages() const TA_NO_THREAD_SAFETY_ANALYSIS;
+
     fbl::Canary<fbl::magic("PNOD")> canary_;
 
     mutable DECLARE_MUTEX(PmmNode) lock_;
@@ -75,6 +161,20 @@ private:
     list_node modified_list_ TA_GUARDED(lock_) = LIST_INITIAL_VALUE(modified_list_);
     list_node wired_list_ TA_GUARDED(lock_) = LIST_INITIAL_VALUE(wired_list_);
 
+    // Free pages known to be filled with zeroes, tagged with VM_PAGE_FLAG_ZEROED.
+    // They are counted in free_count_ as well. zeroed_count_ is only written
+    // with lock_ held, but may be peeked at without it.
+    list_node zeroed_list_ TA_GUARDED(lock_) = LIST_INITIAL_VALUE(zeroed_list_);
+    fbl::atomic<uint64_t> zeroed_count_{0};
+    uint64_t zero_pool_target_ TA_GUARDED(lock_) = 0;
+    event_t zero_pool_event_ = EVENT_INITIAL_VALUE(zero_pool_event_, false, EVENT_FLAG_AUTOUNSIGNAL);
+    thread_t* zero_pool_thread_ = nullptr;
+
+    // per cpu page caches and their watermarks, 0 until SetPageCacheLimits is called
+    PageCache page_cache_[SMP_MAX_CPUS];
+    fbl::atomic<size_t> cache_high_{0};
+    fbl::atomic<size_t> cache_batch_{0};
+
 #if PMM_ENABLE_FREE_FILL
     void FreeFill(vm_page_t* page);
     void CheckFreeFill(vm_page_t* page);
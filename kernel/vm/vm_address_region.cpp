@@ -143,7 +143,16 @@ zx_status_t VmAddressRegion::CreateSubVmarInternal(size_t offset, size_t size, u
         }
     } else {
         // If we're not mapping to a specific place, search for an opening.
-        zx_status_t status = AllocSpotLocked(size, align_pow2, arch_mmu_flags, &new_base);
+        // Prefer a large page aligned spot for objects that may be backed by
+        // large pages, so they can also be mapped with them.
+        zx_status_t status = ZX_ERR_NO_MEMORY;
+        if (vmo && align_pow2 < LARGE_PAGE_SIZE_SHIFT && size >= LARGE_PAGE_SIZE &&
+            IS_ALIGNED(vmo_offset, LARGE_PAGE_SIZE) && vmo->CanUseLargePages()) {
+            status = AllocSpotLocked(size, LARGE_PAGE_SIZE_SHIFT, arch_mmu_flags, &new_base);
+        }
+        if (status != ZX_OK) {
+            status = AllocSpotLocked(size, align_pow2, arch_mmu_flags, &new_base);
+        }
         if (status != ZX_OK) {
             return status;
         }
@@ -378,6 +387,19 @@ size_t VmAddressRegion::AllocatedPagesLocked() const {
     return sum;
 }
 
+void VmAddressRegion::GetFaultStatsLocked(FaultStats* stats) const {
+    canary_.Assert();
+    DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
+
+    if (state_ != LifeCycleState::ALIVE) {
+        return;
+    }
+
+    for (const auto& child : subregions_) {
+        child.GetFaultStatsLocked(stats);
+    }
+}
+
 zx_status_t VmAddressRegion::PageFault(vaddr_t va, uint pf_flags) {
     canary_.Assert();
     DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
@@ -90,3 +90,11 @@ size_t VmAddressRegionOrMapping::AllocatedPages() const {
     }
     return AllocatedPagesLocked();
 }
+
+void VmAddressRegionOrMapping::GetFaultStats(FaultStats* stats) const {
+    Guard<fbl::Mutex> guard{aspace_->lock()};
+    if (state_ != LifeCycleState::ALIVE) {
+        return;
+    }
+    GetFaultStatsLocked(stats);
+}
@@ -531,7 +531,7 @@ void VmAspace::AttachToThread(thread_t* t) {
     DEBUG_ASSERT(t);
 
     // point the lk thread at our object via the dummy C vmm_aspace_t struct
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
 
     // not prepared to handle setting a new address space or one on a running thread
     DEBUG_ASSERT(!t->aspace);
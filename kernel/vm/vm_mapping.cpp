@@ -10,9 +10,12 @@
 #include <assert.h>
 #include <err.h>
 #include <fbl/alloc_checker.h>
+#include <fbl/algorithm.h>
 #include <fbl/auto_call.h>
+#include <kernel/cmdline.h>
 #include <ktl/move.h>
 #include <inttypes.h>
+#include <lk/init.h>
 #include <trace.h>
 #include <vm/fault.h>
 #include <vm/vm.h>
@@ -22,6 +25,31 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+#define VM_FAULT_AROUND_DEFAULT_PAGES 16
+#define VM_FAULT_AROUND_MAX_PAGES 256
+
+namespace {
+
+// Size in pages of the naturally aligned window around a faulting address
+// that PageFault() will try to populate with already present pages.  Always a
+// power of two; 1 disables fault-around.
+size_t fault_around_pages = VM_FAULT_AROUND_DEFAULT_PAGES;
+
+void vm_fault_around_init(uint level) {
+    uint32_t pages = cmdline_get_uint32("kernel.vm.fault-around-pages",
+                                        VM_FAULT_AROUND_DEFAULT_PAGES);
+    pages = fbl::min<uint32_t>(pages, VM_FAULT_AROUND_MAX_PAGES);
+    // round down to a power of two so the window can be aligned
+    while (pages & (pages - 1)) {
+        pages &= pages - 1;
+    }
+    fault_around_pages = fbl::max<uint32_t>(pages, 1);
+}
+
+} // namespace
+
+LK_INIT_HOOK(vm_fault_around, vm_fault_around_init, LK_INIT_LEVEL_VM);
+
 VmMapping::VmMapping(VmAddressRegion& parent, vaddr_t base, size_t size, uint32_t vmar_flags,
                      fbl::RefPtr<VmObject> vmo, uint64_t vmo_offset, uint arch_mmu_flags)
     : VmAddressRegionOrMapping(base, size, vmar_flags,
@@ -48,6 +76,14 @@ size_t VmMapping::AllocatedPagesLocked() const {
     return object_->AllocatedPagesInRange(object_offset_, size_);
 }
 
+void VmMapping::GetFaultStatsLocked(FaultStats* stats) const {
+    canary_.Assert();
+    DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
+
+    stats->page_faults += page_faults_;
+    stats->fault_around_pages += fault_around_pages_;
+}
+
 void VmMapping::Dump(uint depth, bool verbose) const {
     canary_.Assert();
     for (uint i = 0; i < depth; ++i) {
@@ -343,8 +379,10 @@ zx_status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) const
     // back to us, detect the recursion and abort here.
     // The specific path we're avoiding is if the VMO calls back into us during vmo->GetPageLocked()
     // via UnmapVmoRangeLocked(). If we set this flag we're short circuiting the unmap operation
-    // so that we don't do extra work.
-    if (likely(currently_faulting_)) {
+    // so that we don't do extra work. This only holds for the single page being faulted in; when
+    // the VMO backs a whole large page at once, the rest of the range may still have the zero
+    // page mapped and has to be unmapped.
+    if (likely(currently_faulting_) && len == PAGE_SIZE) {
         LTRACEF("recursing to ourself, abort\n");
         return ZX_OK;
     }
@@ -392,7 +430,7 @@ namespace {
 
 class VmMappingCoalescer {
 public:
-    VmMappingCoalescer(VmMapping* mapping, vaddr_t base);
+    VmMappingCoalescer(VmMapping* mapping, vaddr_t base, uint mmu_flags);
     ~VmMappingCoalescer();
 
     // Add a page to the mapping run.  If this fails, the VmMappingCoalescer is
@@ -422,18 +460,28 @@ public:
         aborted_ = true;
     }
 
+    // Number of pages successfully submitted to the MMU so far.
+    size_t mapped_pages() const { return mapped_pages_; }
+
+    // Synchronize the instruction cache over each run after it is mapped.
+    void set_sync_cache(bool sync_cache) { sync_cache_ = sync_cache; }
+
 private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmMappingCoalescer);
 
     VmMapping* mapping_;
     vaddr_t base_;
+    uint mmu_flags_;
     paddr_t phys_[16];
     size_t count_;
+    size_t mapped_pages_;
     bool aborted_;
+    bool sync_cache_;
 };
 
-VmMappingCoalescer::VmMappingCoalescer(VmMapping* mapping, vaddr_t base)
-    : mapping_(mapping), base_(base), count_(0), aborted_(false) {}
+VmMappingCoalescer::VmMappingCoalescer(VmMapping* mapping, vaddr_t base, uint mmu_flags)
+    : mapping_(mapping), base_(base), mmu_flags_(mmu_flags), count_(0), mapped_pages_(0),
+      aborted_(false), sync_cache_(false) {}
 
 VmMappingCoalescer::~VmMappingCoalescer() {
     // Make sure we've flushed or aborted
@@ -445,10 +493,9 @@ zx_status_t VmMappingCoalescer::Flush() {
         return ZX_OK;
     }
 
-    uint flags = mapping_->arch_mmu_flags();
-    if (flags & ARCH_MMU_FLAG_PERM_RWX_MASK) {
+    if (mmu_flags_ & ARCH_MMU_FLAG_PERM_RWX_MASK) {
         size_t mapped;
-        zx_status_t ret = mapping_->aspace()->arch_aspace().Map(base_, phys_, count_, flags,
+        zx_status_t ret = mapping_->aspace()->arch_aspace().Map(base_, phys_, count_, mmu_flags_,
                                                                 &mapped);
         if (ret != ZX_OK) {
             TRACEF("error %d mapping %zu pages starting at va %#" PRIxPTR "\n", ret, count_, base_);
@@ -456,6 +503,12 @@ zx_status_t VmMappingCoalescer::Flush() {
             return ret;
         }
         DEBUG_ASSERT(mapped == count_);
+        mapped_pages_ += mapped;
+#if ARCH_ARM64
+        if (sync_cache_) {
+            arch_sync_cache_range(base_, count_ * PAGE_SIZE);
+        }
+#endif
     }
     base_ += count_ * PAGE_SIZE;
     count_ = 0;
@@ -502,7 +555,7 @@ zx_status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
     // iterate through the range, grabbing a page from the underlying object and
     // mapping it in
     size_t o;
-    VmMappingCoalescer coalescer(this, base_ + offset);
+    VmMappingCoalescer coalescer(this, base_ + offset, arch_mmu_flags_);
     for (o = offset; o < offset + len; o += PAGE_SIZE) {
         uint64_t vmo_offset = object_offset_ + o;
 
@@ -655,6 +708,7 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
         LTRACEF("%p vmo_offset %#" PRIx64 ", pf_flags %#x\n", this, vmo_offset, pf_flags);
         return status;
     }
+    page_faults_++;
 
     // if we read faulted, make sure we map or modify the page without any write permissions
     // this ensures we will fault again if a write is attempted so we can potentially
@@ -684,8 +738,15 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
             // assert that we're not accidentally marking the zero page writable
             DEBUG_ASSERT((pa != vm_get_zero_page_paddr()) || !(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE));
 
-            // same page, different permission
-            status = aspace_->arch_aspace().Protect(va, 1, mmu_flags);
+            // same page, different permission; if it is part of a large page
+            // change the whole of it, so a large mapping does not get split
+            vaddr_t large_va;
+            paddr_t large_pa;
+            if (GetLargePageRangeLocked(vmo_offset, &large_va, &large_pa) == ZX_OK) {
+                status = aspace_->arch_aspace().Protect(large_va, LARGE_PAGE_PAGE_COUNT, mmu_flags);
+            } else {
+                status = aspace_->arch_aspace().Protect(va, 1, mmu_flags);
+            }
             if (status != ZX_OK) {
                 TRACEF("failed to modify permissions on existing mapping\n");
                 return ZX_ERR_NO_MEMORY;
@@ -724,13 +785,47 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
         // assert that we're not accidentally mapping the zero page writable
         DEBUG_ASSERT((new_pa != vm_get_zero_page_paddr()) || !(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE));
 
-        size_t mapped;
-        status = aspace_->arch_aspace().MapContiguous(va, new_pa, 1, mmu_flags, &mapped);
-        if (status != ZX_OK) {
-            TRACEF("failed to map page\n");
-            return ZX_ERR_NO_MEMORY;
+        // If the page is part of a large page, map all of it at once.  Whatever
+        // is mapped in that range can only be small mappings of the same pages,
+        // so replace them.
+        vaddr_t large_va;
+        paddr_t large_pa;
+        bool mapped_large = false;
+        if (GetLargePageRangeLocked(vmo_offset, &large_va, &large_pa) == ZX_OK) {
+            size_t mapped;
+            status = aspace_->arch_aspace().Unmap(large_va, LARGE_PAGE_PAGE_COUNT, nullptr);
+            if (status == ZX_OK) {
+                status = aspace_->arch_aspace().MapContiguous(large_va, large_pa,
+                                                              LARGE_PAGE_PAGE_COUNT, mmu_flags,
+                                                              &mapped);
+            }
+            if (status == ZX_OK) {
+                DEBUG_ASSERT(mapped == LARGE_PAGE_PAGE_COUNT);
+                mapped_large = true;
+#if ARCH_ARM64
+                if (!(pf_flags & VMM_PF_FLAG_GUEST) && (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)) {
+                    arch_sync_cache_range(large_va, LARGE_PAGE_SIZE);
+                }
+#endif
+            } else {
+                LTRACEF("failed to map large page at va %#" PRIxPTR ", status %d\n",
+                        large_va, status);
+            }
+        }
+
+        if (!mapped_large) {
+            size_t mapped;
+            status = aspace_->arch_aspace().MapContiguous(va, new_pa, 1, mmu_flags, &mapped);
+            if (status != ZX_OK) {
+                TRACEF("failed to map page\n");
+                return ZX_ERR_NO_MEMORY;
+            }
+            DEBUG_ASSERT(mapped == 1);
+
+            // a fresh mapping is likely to be followed by accesses to its neighbours,
+            // so map whatever the object already has around it
+            fault_around_pages_ += FaultAroundLocked(va, pf_flags);
         }
-        DEBUG_ASSERT(mapped == 1);
     }
 
 // TODO: figure out what to do with this
@@ -744,6 +839,81 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
     return ZX_OK;
 }
 
+zx_status_t VmMapping::GetLargePageRangeLocked(uint64_t vmo_offset, vaddr_t* large_va,
+                                               paddr_t* large_pa) {
+    DEBUG_ASSERT(object_->lock()->lock().IsHeld());
+
+    uint64_t large_offset;
+    paddr_t pa;
+    zx_status_t status = object_->GetLargePageLocked(vmo_offset, &large_offset, &pa);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    // the large page has to lie entirely within the mapping, at an address
+    // aligned to its size
+    if (large_offset < object_offset_) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+    const uint64_t offset = large_offset - object_offset_;
+    if (offset >= size_ || size_ - offset < LARGE_PAGE_SIZE) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+    const vaddr_t va = base_ + offset;
+    if (!IS_ALIGNED(va, LARGE_PAGE_SIZE)) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    *large_va = va;
+    *large_pa = pa;
+    return ZX_OK;
+}
+
+size_t VmMapping::FaultAroundLocked(vaddr_t va, uint pf_flags) {
+    DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
+    DEBUG_ASSERT(object_->lock()->lock().IsHeld());
+    DEBUG_ASSERT(currently_faulting_);
+
+    // Write faults are left alone: neighbours would have to be mapped read-only
+    // and would fault again on the next write anyway.
+    if (fault_around_pages <= 1 || (pf_flags & (VMM_PF_FLAG_WRITE | VMM_PF_FLAG_GUEST))) {
+        return 0;
+    }
+
+    // clip the aligned window around the fault to the mapping
+    const size_t window = fault_around_pages * PAGE_SIZE;
+    const vaddr_t window_base = ROUNDDOWN(va, window);
+    const vaddr_t start = fbl::max(window_base, base_);
+    const vaddr_t last = fbl::min(window_base + (window - 1), base_ + (size_ - 1));
+
+    // Only map pages the object (or its parents) already has, without write
+    // permission, so copy-on-write and zero-fill still go through PageFault().
+    VmMappingCoalescer coalescer(this, start, arch_mmu_flags_ & ~ARCH_MMU_FLAG_PERM_WRITE);
+    coalescer.set_sync_cache(arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE);
+    for (vaddr_t addr = start; addr <= last && addr >= start; addr += PAGE_SIZE) {
+        if (addr == va) {
+            continue;
+        }
+        // leave existing mappings alone
+        if (aspace_->arch_aspace().Query(addr, nullptr, nullptr) == ZX_OK) {
+            continue;
+        }
+        paddr_t pa;
+        if (object_->GetPageLocked(addr - base_ + object_offset_, 0, nullptr, nullptr, &pa) != ZX_OK) {
+            continue;
+        }
+        if (coalescer.Append(addr, pa) != ZX_OK) {
+            // fault-around is best effort, the faulting page itself is already mapped
+            return coalescer.mapped_pages();
+        }
+    }
+    coalescer.Flush();
+
+    LTRACEF_LEVEL(2, "%p va %#" PRIxPTR " mapped %zu pages around fault\n",
+                  this, va, coalescer.mapped_pages());
+    return coalescer.mapped_pages();
+}
+
 // We disable thread safety analysis here because one of the common uses of this
 // function is for splitting one mapping object into several that will be backed
 // by the same VmObject.  In that case, object_->lock() gets aliased across all
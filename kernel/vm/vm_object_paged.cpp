@@ -12,10 +12,15 @@
 #include <assert.h>
 #include <err.h>
 #include <fbl/alloc_checker.h>
+#include <fbl/atomic.h>
 #include <fbl/auto_call.h>
 #include <inttypes.h>
+#include <kernel/cmdline.h>
 #include <ktl/move.h>
 #include <lib/console.h>
+#include <lib/counters.h>
+#include <lk/init.h>
+#include <platform.h>
 #include <stdlib.h>
 #include <string.h>
 #include <trace.h>
@@ -27,24 +32,29 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+// how long to stop looking for free large pages after failing to find one
+#define LARGE_PAGE_RETRY_DELAY ZX_SEC(1)
+
+KCOUNTER(vm_large_page_alloc, "kernel.vm.large_page.alloc");
+KCOUNTER(vm_large_page_alloc_fail, "kernel.vm.large_page.alloc_fail");
+
 namespace {
 
-void ZeroPage(paddr_t pa) {
-    void* ptr = paddr_to_physmap(pa);
-    DEBUG_ASSERT(ptr);
+// Whether anonymous VMOs may be backed by large pages, see kernel.vm.large-pages.
+bool large_pages_enabled = true;
 
-    arch_zero_page(ptr);
-}
+// Earliest time at which to look for a free large page again.
+fbl::atomic<zx_time_t> large_page_retry_time;
 
-void ZeroPage(vm_page_t* p) {
-    paddr_t pa = p->paddr();
-    ZeroPage(pa);
+void vm_large_pages_init(uint level) {
+    large_pages_enabled = cmdline_get_bool("kernel.vm.large-pages", true);
 }
 
 void InitializeVmPage(vm_page_t* p) {
     DEBUG_ASSERT(p->state == VM_PAGE_STATE_ALLOC);
     p->state = VM_PAGE_STATE_OBJECT;
     p->object.pin_count = 0;
+    p->object.large_page = 0;
 }
 
 // round up the size to the next page size boundary and make sure we dont wrap
@@ -64,6 +74,8 @@ zx_status_t RoundSize(uint64_t size, uint64_t* out_size) {
 
 } // namespace
 
+LK_INIT_HOOK(vm_large_pages, vm_large_pages_init, LK_INIT_LEVEL_VM);
+
 VmObjectPaged::VmObjectPaged(
     uint32_t options, uint32_t pmm_alloc_flags, uint64_t size,
     fbl::RefPtr<VmObject> parent, fbl::RefPtr<PageSource> page_source)
@@ -153,7 +165,8 @@ zx_status_t VmObjectPaged::CreateContiguous(uint32_t pmm_alloc_flags, uint64_t s
 
     size_t num_pages = size / PAGE_SIZE;
     paddr_t pa;
-    status = pmm_alloc_contiguous(num_pages, pmm_alloc_flags, alignment_log2, &pa, &page_list);
+    status = pmm_alloc_contiguous(num_pages, pmm_alloc_flags | PMM_ALLOC_FLAG_ZEROED,
+                                  alignment_log2, &pa, &page_list);
     if (status != ZX_OK) {
         LTRACEF("failed to allocate enough pages (asked for %zu)\n", num_pages);
         return ZX_ERR_NO_MEMORY;
@@ -170,9 +183,6 @@ zx_status_t VmObjectPaged::CreateContiguous(uint32_t pmm_alloc_flags, uint64_t s
 
         InitializeVmPage(p);
 
-        // TODO: remove once pmm returns zeroed pages
-        ZeroPage(p);
-
         // We don't need thread-safety analysis here, since this VMO has not
         // been shared anywhere yet.
         [&]() TA_NO_THREAD_SAFETY_ANALYSIS {
@@ -329,8 +339,9 @@ void VmObjectPaged::Dump(uint depth, bool verbose) {
         printf("  ");
     }
     printf("vmo %p/k%" PRIu64 " size %#" PRIx64
-           " pages %zu ref %d parent k%" PRIu64 "\n",
-           this, user_id_, size_, count, ref_count_debug(), parent_id);
+           " pages %zu large %zu ref %d parent k%" PRIu64 "\n",
+           this, user_id_, size_, count, page_list_.large_page_count(), ref_count_debug(),
+           parent_id);
 
     if (verbose) {
         auto f = [depth](const auto p, uint64_t offset) {
@@ -364,6 +375,94 @@ size_t VmObjectPaged::AllocatedPagesInRange(uint64_t offset, uint64_t len) const
     return count;
 }
 
+void VmObjectPaged::ResetLargePageBackoff() {
+    large_page_retry_time.store(0, fbl::memory_order_relaxed);
+}
+
+size_t VmObjectPaged::AllocatedLargePages() const {
+    canary_.Assert();
+    Guard<fbl::Mutex> guard{&lock_};
+    return page_list_.large_page_count();
+}
+
+bool VmObjectPaged::CanUseLargePages() const {
+    canary_.Assert();
+    Guard<fbl::Mutex> guard{&lock_};
+    return CanUseLargePagesLocked();
+}
+
+bool VmObjectPaged::CanUseLargePagesLocked() const {
+    // Only plain anonymous memory: clones need their parent's pages, external
+    // pages come from their source, and contiguous vmos are already allocated.
+    return large_pages_enabled && !parent_ && !page_source_ && !(options_ & kContiguous) &&
+           pmm_alloc_flags_ == PMM_ALLOC_FLAG_ANY && cache_policy_ == ARCH_MMU_FLAG_CACHED &&
+           size_ >= LARGE_PAGE_SIZE;
+}
+
+zx_status_t VmObjectPaged::AllocLargePageLocked(uint64_t offset) {
+    DEBUG_ASSERT(IS_ALIGNED(offset, LARGE_PAGE_SIZE));
+    DEBUG_ASSERT(CanUseLargePagesLocked());
+
+    if (offset + LARGE_PAGE_SIZE < offset || offset + LARGE_PAGE_SIZE > size_) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+    if (page_list_.AnyPagesInRange(offset, offset + LARGE_PAGE_SIZE)) {
+        return ZX_ERR_ALREADY_EXISTS;
+    }
+
+    // searching the arenas for a free aligned run is expensive, so back off
+    // for a while once one could not be found
+    if (current_time() < large_page_retry_time.load(fbl::memory_order_relaxed)) {
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    list_node pages;
+    list_initialize(&pages);
+    paddr_t pa;
+    zx_status_t status = pmm_alloc_contiguous(LARGE_PAGE_PAGE_COUNT,
+                                              pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED,
+                                              LARGE_PAGE_SIZE_SHIFT, &pa, &pages);
+    if (status != ZX_OK) {
+        LTRACEF("no free large page for offset %#" PRIx64 "\n", offset);
+        large_page_retry_time.store(current_time() + LARGE_PAGE_RETRY_DELAY,
+                                    fbl::memory_order_relaxed);
+        kcounter_add(vm_large_page_alloc_fail, 1);
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    vm_page* p;
+    list_for_every_entry (&pages, p, vm_page, queue_node) {
+        InitializeVmPage(p);
+    }
+
+    status = page_list_.AddLargePage(&pages, offset);
+    if (status != ZX_OK) {
+        pmm_free(&pages);
+        return status;
+    }
+
+    // other mappings may have covered this range of the vmo with the zero page
+    RangeChangeUpdateLocked(offset, LARGE_PAGE_SIZE);
+
+    LTRACEF("large page at offset %#" PRIx64 ", pa %#" PRIxPTR "\n", offset, pa);
+    kcounter_add(vm_large_page_alloc, 1);
+    return ZX_OK;
+}
+
+zx_status_t VmObjectPaged::GetLargePageLocked(uint64_t offset, uint64_t* large_offset,
+                                              paddr_t* pa) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.lock().IsHeld());
+
+    vm_page* p = page_list_.GetLargePage(offset);
+    if (!p) {
+        return ZX_ERR_NOT_FOUND;
+    }
+    *large_offset = ROUNDDOWN(offset, LARGE_PAGE_SIZE);
+    *pa = p->paddr();
+    return ZX_OK;
+}
+
 zx_status_t VmObjectPaged::AddPage(vm_page_t* p, uint64_t offset) {
     Guard<fbl::Mutex> guard{&lock_};
 
@@ -393,11 +492,26 @@ zx_status_t VmObjectPaged::AddPageLocked(vm_page_t* p, uint64_t offset) {
     return ZX_OK;
 }
 
+bool VmObjectPaged::ParentHasPageLocked(uint64_t offset) {
+    if (!parent_) {
+        return false;
+    }
+
+    uint64_t parent_offset;
+    bool overflowed = add_overflow(parent_offset_, offset, &parent_offset);
+    ASSERT(!overflowed);
+
+    // no fault flags, so the parent only reports pages it already has
+    return parent_->GetPageLocked(parent_offset, 0, nullptr, nullptr, nullptr) == ZX_OK;
+}
+
 // Looks up the page at the requested offset, faulting it in if requested and necessary.  If
 // this VMO has a parent and the requested page isn't found, the parent will be searched.
 //
 // |free_list|, if not NULL, is a list of allocated but unused vm_page_t that
-// this function may allocate from.  This function will need at most one entry,
+// this function may allocate from. Unless the page is to be copied from the
+// parent, the pages must already be zeroed, as if allocated with
+// PMM_ALLOC_FLAG_ZEROED.  This function will need at most one entry,
 // and will not fail if |free_list| is a non-empty list, faulting in was requested,
 // and offset is in range.
 zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_node* free_list,
@@ -517,6 +631,25 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
         return ZX_OK;
     }
 
+    // if a mapping is faulting and nothing around the faulting page has been
+    // committed yet, try to back the whole aligned range with a large page.
+    // software faults, such as a small zx_vmo_write, stick to single pages
+    if ((pf_flags & VMM_PF_FLAG_HW_FAULT) && !free_list && CanUseLargePagesLocked() &&
+        AllocLargePageLocked(ROUNDDOWN(offset, LARGE_PAGE_SIZE)) == ZX_OK) {
+        p = page_list_.GetPage(offset);
+        DEBUG_ASSERT(p);
+
+        LTRACEF("faulted in large page, page %p, pa %#" PRIxPTR "\n", p, p->paddr());
+
+        if (page_out) {
+            *page_out = p;
+        }
+        if (pa_out) {
+            *pa_out = p->paddr();
+        }
+        return ZX_OK;
+    }
+
     // allocate a page
     if (free_list) {
         p = list_remove_head_type(free_list, vm_page, queue_node);
@@ -525,7 +658,7 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
         }
     }
     if (!p) {
-        pmm_alloc_page(pmm_alloc_flags_, &p, &pa);
+        pmm_alloc_page(pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED, &p, &pa);
     }
     if (!p) {
         return ZX_ERR_NO_MEMORY;
@@ -533,9 +666,6 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
 
     InitializeVmPage(p);
 
-    // TODO: remove once pmm returns zeroed pages
-    ZeroPage(pa);
-
 // if ARM and not fully cached, clean/invalidate the page after zeroing it
 #if ARCH_ARM64
     if (cache_policy_ != ARCH_MMU_FLAG_CACHED) {
@@ -583,32 +713,51 @@ zx_status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len) {
     DEBUG_ASSERT(end > offset);
     offset = ROUNDDOWN(offset, PAGE_SIZE);
 
-    // make a pass through the list, counting the number of pages we need to allocate
-    size_t count = 0;
-    uint64_t expected_next_off = offset;
-    page_list_.ForEveryPageInRange(
-        [&count, &expected_next_off](const auto p, uint64_t off) {
-
-            count += (off - expected_next_off) / PAGE_SIZE;
-            expected_next_off = off + PAGE_SIZE;
-            return ZX_ERR_NEXT;
-        },
-        expected_next_off, end);
+    // back any empty aligned large page ranges fully covered by the commit
+    // first, stopping as soon as no more large pages can be found
+    if (CanUseLargePagesLocked()) {
+        for (uint64_t o = ROUNDUP(offset, LARGE_PAGE_SIZE);
+             o >= offset && o < end && end - o >= LARGE_PAGE_SIZE; o += LARGE_PAGE_SIZE) {
+            if (AllocLargePageLocked(o) == ZX_ERR_NO_MEMORY) {
+                break;
+            }
+        }
+    }
 
-    // If expected_next_off isn't at the end of the range, there was a gap at
-    // the end.  Add it back in
-    DEBUG_ASSERT(end >= expected_next_off);
-    count += (end - expected_next_off) / PAGE_SIZE;
-    if (count == 0) {
+    // make a pass through the range, counting the number of pages we need to allocate.
+    // pages that will be copied from the parent are going to be overwritten anyway, so
+    // only the rest need to come pre-zeroed
+    size_t zero_count = 0;
+    size_t copy_count = 0;
+    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
+        if (page_list_.GetPage(o)) {
+            continue;
+        }
+        if (ParentHasPageLocked(o)) {
+            copy_count++;
+        } else {
+            zero_count++;
+        }
+    }
+    if (zero_count + copy_count == 0) {
         return ZX_OK;
     }
 
-    // allocate count number of pages
-    list_node page_list;
-    list_initialize(&page_list);
-
-    zx_status_t status = pmm_alloc_pages(count, pmm_alloc_flags_, &page_list);
+    // allocate the pages
+    list_node zero_list;
+    list_initialize(&zero_list);
+    list_node copy_list;
+    list_initialize(&copy_list);
+
+    // the zero_list pages are handed to GetPageLocked below, which expects them to be zeroed
+    zx_status_t status = pmm_alloc_pages(zero_count, pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED,
+                                         &zero_list);
+    if (status != ZX_OK) {
+        return status;
+    }
+    status = pmm_alloc_pages(copy_count, pmm_alloc_flags_, &copy_list);
     if (status != ZX_OK) {
+        pmm_free(&zero_list);
         return status;
     }
 
@@ -626,13 +775,15 @@ zx_status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len) {
         // Check if our parent has the page
         paddr_t pa;
         const uint flags = VMM_PF_FLAG_SW_FAULT | VMM_PF_FLAG_WRITE;
+        list_node* free_list = ParentHasPageLocked(o) ? &copy_list : &zero_list;
         // Should not be able to fail, since we're providing it memory and the
         // range should be valid.
-        zx_status_t status = GetPageLocked(o, flags, &page_list, &p, &pa);
+        zx_status_t status = GetPageLocked(o, flags, free_list, &p, &pa);
         ASSERT(status == ZX_OK);
     }
 
-    DEBUG_ASSERT(list_is_empty(&page_list));
+    DEBUG_ASSERT(list_is_empty(&zero_list));
+    DEBUG_ASSERT(list_is_empty(&copy_list));
 
     return ZX_OK;
 }
@@ -10,6 +10,7 @@
 #include <fbl/alloc_checker.h>
 #include <inttypes.h>
 #include <ktl/move.h>
+#include <lib/counters.h>
 #include <trace.h>
 #include <vm/pmm.h>
 #include <vm/vm.h>
@@ -19,6 +20,8 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+KCOUNTER(vm_large_page_split, "kernel.vm.large_page.split");
+
 namespace {
 
 inline uint64_t offset_to_node_offset(uint64_t offset) {
@@ -94,6 +97,7 @@ VmPageList::VmPageList() {
 VmPageList::~VmPageList() {
     LTRACEF("%p\n", this);
     DEBUG_ASSERT(list_.is_empty());
+    DEBUG_ASSERT(large_page_count_ == 0);
 }
 
 zx_status_t VmPageList::AddPage(vm_page* p, uint64_t offset) {
@@ -155,8 +159,14 @@ bool VmPageList::RemovePage(uint64_t offset, vm_page_t** page_out) {
         return false;
     }
 
+    // the rest of a large page stays behind as individual pages
+    auto page = pln->GetPage(index);
+    if (page && page->object.large_page) {
+        SplitLargePage(offset);
+    }
+
     // free this page
-    auto page = pln->RemovePage(index);
+    page = pln->RemovePage(index);
     if (page) {
         // if it was the last page in the node, remove the node from the tree
         if (pln->IsEmpty()) {
@@ -172,6 +182,8 @@ bool VmPageList::RemovePage(uint64_t offset, vm_page_t** page_out) {
 }
 
 void VmPageList::FreePages(uint64_t start_offset, uint64_t end_offset) {
+    SplitLargePagesInRange(start_offset, end_offset);
+
     // Find the first node with a start after start_offset; if start_offset
     // is in a node, it'll be in the one before that one.
     auto start = --list_.upper_bound(start_offset);
@@ -218,6 +230,7 @@ size_t VmPageList::FreeAllPages() {
     auto per_page_func = [&](vm_page*& p, uint64_t offset) {
 
         // add the page to our list and null out the inner node
+        p->object.large_page = 0;
         list_add_tail(&list, &p->queue_node);
         p = nullptr;
         count++;
@@ -232,6 +245,7 @@ size_t VmPageList::FreeAllPages() {
 
     // empty the tree
     list_.clear();
+    large_page_count_ = 0;
 
     return count;
 }
@@ -240,10 +254,22 @@ bool VmPageList::IsEmpty() {
     return list_.is_empty();
 }
 
+bool VmPageList::AnyPagesInRange(uint64_t start_offset, uint64_t end_offset) const {
+    bool found = false;
+    ForEveryPageInRange([&found](const vm_page* p, uint64_t offset) {
+        found = true;
+        return ZX_ERR_STOP;
+    }, start_offset, end_offset);
+    return found;
+}
+
 VmPageSpliceList VmPageList::TakePages(uint64_t offset, uint64_t length) {
     VmPageSpliceList res(offset, length);
     const uint64_t end = offset + length;
 
+    // the splice list only tracks individual pages
+    SplitLargePagesInRange(offset, end);
+
     // If we can't take the whole node at the start of the range,
     // the shove the pages into the splice list head_ node.
     while (offset_to_node_index(offset) != 0 && offset < end) {
@@ -276,6 +302,90 @@ VmPageSpliceList VmPageList::TakePages(uint64_t offset, uint64_t length) {
     return res;
 }
 
+zx_status_t VmPageList::AddLargePage(list_node* pages, uint64_t offset) {
+    DEBUG_ASSERT(IS_ALIGNED(offset, LARGE_PAGE_SIZE));
+    DEBUG_ASSERT(list_length(pages) == LARGE_PAGE_PAGE_COUNT);
+
+    LTRACEF("%p offset %#" PRIx64 "\n", this, offset);
+
+    // the whole range has to be empty
+    const uint64_t end = offset + LARGE_PAGE_SIZE;
+    if (AnyPagesInRange(offset, end)) {
+        return ZX_ERR_ALREADY_EXISTS;
+    }
+
+    vm_page* page;
+    __UNUSED paddr_t expected_pa = list_peek_head_type(pages, vm_page, queue_node)->paddr();
+    for (uint64_t off = offset; off < end; off += PAGE_SIZE) {
+        page = list_peek_head_type(pages, vm_page, queue_node);
+        DEBUG_ASSERT(page->paddr() == expected_pa);
+        expected_pa += PAGE_SIZE;
+
+        zx_status_t status = AddPage(page, off);
+        if (status != ZX_OK) {
+            // put back what we added so the caller still owns every page
+            while (off > offset) {
+                off -= PAGE_SIZE;
+                __UNUSED bool removed = RemovePage(off, &page);
+                DEBUG_ASSERT(removed);
+                list_add_head(pages, &page->queue_node);
+            }
+            return status;
+        }
+        list_delete(&page->queue_node);
+    }
+
+    // only flag the pages once they are all in, so the unwinding above never
+    // sees a partial large page
+    ForEveryPageInRange([](vm_page* p, uint64_t off) {
+        p->object.large_page = 1;
+        return ZX_ERR_NEXT;
+    }, offset, end);
+    large_page_count_++;
+    return ZX_OK;
+}
+
+vm_page* VmPageList::GetLargePage(uint64_t offset) {
+    vm_page* page = GetPage(offset);
+    if (!page || !page->object.large_page) {
+        return nullptr;
+    }
+    page = GetPage(ROUNDDOWN(offset, LARGE_PAGE_SIZE));
+    DEBUG_ASSERT(page && page->object.large_page);
+    return page;
+}
+
+void VmPageList::SplitLargePage(uint64_t offset) {
+    const uint64_t start = ROUNDDOWN(offset, LARGE_PAGE_SIZE);
+
+    LTRACEF("%p offset %#" PRIx64 "\n", this, start);
+
+    DEBUG_ASSERT(large_page_count_ > 0);
+    ForEveryPageInRange([](vm_page* p, uint64_t off) {
+        DEBUG_ASSERT(p->object.large_page);
+        p->object.large_page = 0;
+        return ZX_ERR_NEXT;
+    }, start, start + LARGE_PAGE_SIZE);
+    large_page_count_--;
+    kcounter_add(vm_large_page_split, 1);
+}
+
+void VmPageList::SplitLargePagesInRange(uint64_t start_offset, uint64_t end_offset) {
+    if (large_page_count_ == 0 || end_offset <= start_offset) {
+        return;
+    }
+    // Only large pages straddling either end of the range can survive the
+    // operation, but those fully inside are split too since their pages are
+    // about to leave the list. Only the pages actually present are visited,
+    // so a sparse range costs no more than the pages it holds.
+    ForEveryPageInRange([this](vm_page* p, uint64_t off) {
+        if (p->object.large_page) {
+            SplitLargePage(off);
+        }
+        return large_page_count_ > 0 ? ZX_ERR_NEXT : ZX_ERR_STOP;
+    }, ROUNDDOWN(start_offset, LARGE_PAGE_SIZE), end_offset);
+}
+
 VmPageSpliceList::VmPageSpliceList() : VmPageSpliceList(0, 0) {}
 
 VmPageSpliceList::VmPageSpliceList(uint64_t offset, uint64_t length)
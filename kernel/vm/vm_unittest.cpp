@@ -8,6 +8,8 @@
 #include <err.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/array.h>
+#include <kernel/cpu.h>
+#include <kernel/thread.h>
 #include <ktl/move.h>
 #include <lib/unittest/unittest.h>
 #include <vm/physmap.h>
@@ -85,6 +87,118 @@ static bool pmm_alloc_contiguous_one_test() {
     END_TEST;
 }
 
+// Frees and reallocates pages through the per cpu page caches.
+static bool pmm_page_cache_test() {
+    BEGIN_TEST;
+
+    size_t old_high, old_batch;
+    pmm_get_page_cache_limits(&old_high, &old_batch);
+
+    EXPECT_EQ(ZX_ERR_INVALID_ARGS, pmm_set_page_cache_limits(8, 0), "batch of 0");
+    EXPECT_EQ(ZX_ERR_INVALID_ARGS, pmm_set_page_cache_limits(8, 16), "batch above high");
+    ASSERT_EQ(ZX_OK, pmm_set_page_cache_limits(8, 4), "set page cache limits");
+
+    // stay on one cpu so every operation below goes through the same cache
+    thread_t* t = get_current_thread();
+    cpu_mask_t old_affinity = t->cpu_affinity;
+    thread_set_cpu_affinity(t, cpu_num_to_mask(arch_curr_cpu_num()));
+
+    // a freed page is parked in the cache and handed straight back out
+    vm_page_t* page;
+    zx_status_t status = pmm_alloc_page(0, &page);
+    ASSERT_EQ(ZX_OK, status, "pmm_alloc single page");
+    pmm_free_page(page);
+    EXPECT_EQ(VM_PAGE_STATE_ALLOC, page->state, "cached page state");
+    EXPECT_TRUE(page->flags & VM_PAGE_FLAG_PMM_CACHED, "cached page flag");
+
+    vm_page_t* page2;
+    status = pmm_alloc_page(0, &page2);
+    ASSERT_EQ(ZX_OK, status, "pmm_alloc single page");
+    EXPECT_EQ(page, page2, "page came back from the cache");
+    EXPECT_FALSE(page2->flags & VM_PAGE_FLAG_PMM_CACHED, "allocated page flag");
+    pmm_free_page(page2);
+
+    // freeing more pages than the cache holds spills the rest to the node
+    list_node list = LIST_INITIAL_VALUE(list);
+    static const size_t alloc_count = 32;
+    status = pmm_alloc_pages(alloc_count, 0, &list);
+    ASSERT_EQ(ZX_OK, status, "pmm_alloc_pages");
+    EXPECT_EQ(alloc_count, list_length(&list), "pmm_alloc_pages list count");
+    pmm_free(&list);
+    EXPECT_TRUE(list_is_empty(&list), "pmm_free consumed the list");
+
+    // small multi page allocations are served from the cache as well
+    status = pmm_alloc_pages(4, 0, &list);
+    ASSERT_EQ(ZX_OK, status, "pmm_alloc_pages from cache");
+    EXPECT_EQ(4u, list_length(&list), "pmm_alloc_pages from cache list count");
+    vm_page_t* p;
+    list_for_every_entry (&list, p, vm_page_t, queue_node) {
+        EXPECT_EQ(VM_PAGE_STATE_ALLOC, p->state, "allocated page state");
+        EXPECT_FALSE(p->flags & VM_PAGE_FLAG_PMM_CACHED, "allocated page flag");
+    }
+    pmm_free(&list);
+
+    pmm_drain_page_caches();
+
+    thread_set_cpu_affinity(t, old_affinity);
+    EXPECT_EQ(ZX_OK, pmm_set_page_cache_limits(old_high, old_batch), "restore limits");
+
+    END_TEST;
+}
+
+static bool page_is_zero(const vm_page_t* page) {
+    const uint8_t* ptr = static_cast<const uint8_t*>(paddr_to_physmap(page->paddr()));
+    for (size_t i = 0; i < PAGE_SIZE; i++) {
+        if (ptr[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Makes sure PMM_ALLOC_FLAG_ZEROED hands out zeroed pages, whether or not
+// they come out of the zero pool.
+static bool pmm_alloc_zeroed_test() {
+    BEGIN_TEST;
+
+    // dirty a page and free it, it is likely to be the next one handed out
+    vm_page_t* page;
+    zx_status_t status = pmm_alloc_page(0, &page);
+    ASSERT_EQ(ZX_OK, status, "pmm_alloc single page");
+    memset(paddr_to_physmap(page->paddr()), 0xff, PAGE_SIZE);
+    pmm_free_page(page);
+
+    status = pmm_alloc_page(PMM_ALLOC_FLAG_ZEROED, &page);
+    ASSERT_EQ(ZX_OK, status, "pmm_alloc zeroed page");
+    EXPECT_TRUE(page_is_zero(page), "page is zeroed");
+    EXPECT_FALSE(page->flags & VM_PAGE_FLAG_ZEROED, "allocated page flag");
+    pmm_free_page(page);
+
+    // ask for more than the zero pool is likely to hold
+    list_node list = LIST_INITIAL_VALUE(list);
+    static const size_t alloc_count = 2048;
+    status = pmm_alloc_pages(alloc_count, PMM_ALLOC_FLAG_ZEROED, &list);
+    ASSERT_EQ(ZX_OK, status, "pmm_alloc_pages zeroed");
+    EXPECT_EQ(alloc_count, list_length(&list), "pmm_alloc_pages zeroed list count");
+    vm_page_t* p;
+    list_for_every_entry (&list, p, vm_page_t, queue_node) {
+        EXPECT_TRUE(page_is_zero(p), "page is zeroed");
+        EXPECT_FALSE(p->flags & VM_PAGE_FLAG_ZEROED, "allocated page flag");
+    }
+    pmm_free(&list);
+
+    paddr_t pa;
+    status = pmm_alloc_contiguous(16, PMM_ALLOC_FLAG_ZEROED, PAGE_SIZE_SHIFT, &pa, &list);
+    ASSERT_EQ(ZX_OK, status, "pmm_alloc_contiguous zeroed");
+    list_for_every_entry (&list, p, vm_page_t, queue_node) {
+        EXPECT_TRUE(page_is_zero(p), "page is zeroed");
+        EXPECT_FALSE(p->flags & VM_PAGE_FLAG_ZEROED, "allocated page flag");
+    }
+    pmm_free(&list);
+
+    END_TEST;
+}
+
 static uint32_t test_rand(uint32_t seed) {
     return (seed = seed * 1664525 + 1013904223);
 }
@@ -364,6 +478,168 @@ static bool vmo_commit_test() {
     END_TEST;
 }
 
+// Frees up a LARGE_PAGE_SIZE aligned run of |count| large pages, so that
+// VMOs created right after can be backed by them. Returns false if there is
+// no such run, in which case large pages can't be tested.
+static bool make_room_for_large_pages(size_t count) {
+    list_node list = LIST_INITIAL_VALUE(list);
+    paddr_t pa;
+    zx_status_t status = pmm_alloc_contiguous(count * LARGE_PAGE_PAGE_COUNT, 0,
+                                              LARGE_PAGE_SIZE_SHIFT, &pa, &list);
+    if (status != ZX_OK) {
+        return false;
+    }
+    // hand the run back to the arena it came from, rather than the page caches
+    pmm_free(&list);
+    pmm_drain_page_caches();
+    VmObjectPaged::ResetLargePageBackoff();
+    return true;
+}
+
+// Commits a VMO large enough for large pages and checks that decommitting a
+// single page splits the large page it belongs to.
+static bool vmo_large_page_test() {
+    BEGIN_TEST;
+    static const size_t alloc_size = LARGE_PAGE_SIZE * 2;
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, alloc_size, &vmo);
+    ASSERT_EQ(status, ZX_OK, "vmobject creation\n");
+    ASSERT_TRUE(vmo, "vmobject creation\n");
+
+    if (!vmo->CanUseLargePages()) {
+        unittest_printf("large pages disabled, skipping\n");
+        END_TEST;
+    }
+    if (!make_room_for_large_pages(2)) {
+        unittest_printf("no free contiguous memory for large pages, skipping\n");
+        END_TEST;
+    }
+
+    status = vmo->CommitRange(0, alloc_size);
+    ASSERT_EQ(ZX_OK, status, "committing vm object\n");
+    EXPECT_EQ(alloc_size, PAGE_SIZE * vmo->AllocatedPages(), "committing vm object\n");
+    EXPECT_EQ(2u, vmo->AllocatedLargePages(), "committing vm object\n");
+
+    // Decommitting a page from the middle of each 2MB chunk must split the
+    // large page there.
+    for (uint64_t offset = 0; offset < alloc_size; offset += LARGE_PAGE_SIZE) {
+        status = vmo->DecommitRange(offset + 16 * PAGE_SIZE, PAGE_SIZE);
+        ASSERT_EQ(ZX_OK, status, "decommit\n");
+    }
+    EXPECT_EQ(alloc_size - 2 * PAGE_SIZE, PAGE_SIZE * vmo->AllocatedPages(), "decommit\n");
+    EXPECT_EQ(0u, vmo->AllocatedLargePages(), "large page not split\n");
+    END_TEST;
+}
+
+// Writes a single byte into a VMO large enough for large pages and checks
+// that only a single page gets committed for it.
+static bool vmo_large_page_write_test() {
+    BEGIN_TEST;
+    static const size_t alloc_size = LARGE_PAGE_SIZE;
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, alloc_size, &vmo);
+    ASSERT_EQ(status, ZX_OK, "vmobject creation\n");
+    ASSERT_TRUE(vmo, "vmobject creation\n");
+
+    if (!vmo->CanUseLargePages()) {
+        unittest_printf("large pages disabled, skipping\n");
+        END_TEST;
+    }
+    if (!make_room_for_large_pages(1)) {
+        unittest_printf("no free contiguous memory for large pages, skipping\n");
+        END_TEST;
+    }
+
+    const uint8_t byte = 0x5a;
+    status = vmo->Write(&byte, 0, sizeof(byte));
+    ASSERT_EQ(ZX_OK, status, "write\n");
+    EXPECT_EQ(1u, vmo->AllocatedPages(), "write\n");
+    EXPECT_EQ(0u, vmo->AllocatedLargePages(), "write\n");
+    END_TEST;
+}
+
+// Checks that the page at |va| is mapped to |pa|, writable if |writable|.
+static bool check_mapped_page(ArchVmAspace& aspace, vaddr_t va, paddr_t pa, bool writable) {
+    BEGIN_TEST;
+    paddr_t mapped_pa;
+    uint mmu_flags;
+    ASSERT_EQ(ZX_OK, aspace.Query(va, &mapped_pa, &mmu_flags), "query\n");
+    EXPECT_EQ(pa, mapped_pa, "physical address\n");
+    EXPECT_EQ(writable, !!(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE), "write permission\n");
+    END_TEST;
+}
+
+// Faults in a large page mapping, then protects and unmaps single pages in
+// the middle of it. The hardware mapping must be split around them while the
+// rest of the large page stays mapped, with its contents intact.
+static bool vmo_large_page_map_split_test() {
+    BEGIN_TEST;
+    static const size_t alloc_size = LARGE_PAGE_SIZE;
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, alloc_size, &vmo);
+    ASSERT_EQ(status, ZX_OK, "vmobject creation\n");
+
+    if (!vmo->CanUseLargePages()) {
+        unittest_printf("large pages disabled, skipping\n");
+        END_TEST;
+    }
+    if (!make_room_for_large_pages(1)) {
+        unittest_printf("no free contiguous memory for large pages, skipping\n");
+        END_TEST;
+    }
+
+    auto ka = VmAspace::kernel_aspace();
+    void* ptr;
+    status = ka->MapObjectInternal(vmo, "test", 0, alloc_size, &ptr, 0, 0, kArchRwFlags);
+    ASSERT_EQ(ZX_OK, status, "mapping object\n");
+    const vaddr_t base = reinterpret_cast<vaddr_t>(ptr);
+    EXPECT_TRUE(IS_ALIGNED(base, LARGE_PAGE_SIZE), "mapping alignment\n");
+
+    // A single fault maps the whole large page, including its last page.
+    *static_cast<volatile uint8_t*>(ptr) = 1;
+    EXPECT_EQ(1u, vmo->AllocatedLargePages(), "fault\n");
+    ArchVmAspace& aspace = ka->arch_aspace();
+    paddr_t pa;
+    uint mmu_flags;
+    ASSERT_EQ(ZX_OK, aspace.Query(base, &pa, &mmu_flags), "query\n");
+    const vaddr_t last = base + alloc_size - PAGE_SIZE;
+    EXPECT_TRUE(check_mapped_page(aspace, last, pa + alloc_size - PAGE_SIZE, true), "");
+
+    // fill what will be either side of the hole separately, so each can be
+    // checked on its own
+    const vaddr_t unmap_va = base + 32 * PAGE_SIZE;
+    const vaddr_t tail_va = unmap_va + PAGE_SIZE;
+    const size_t head = unmap_va - base;
+    const size_t tail = base + alloc_size - tail_va;
+    fill_region(base, ptr, head);
+    fill_region(tail_va, reinterpret_cast<void*>(tail_va), tail);
+
+    const vaddr_t protect_va = base + 16 * PAGE_SIZE;
+    status = ka->RootVmar()->Protect(protect_va, PAGE_SIZE, ARCH_MMU_FLAG_PERM_READ);
+    ASSERT_EQ(ZX_OK, status, "protect\n");
+    EXPECT_TRUE(check_mapped_page(aspace, protect_va, pa + 16 * PAGE_SIZE, false), "");
+    EXPECT_TRUE(check_mapped_page(aspace, protect_va - PAGE_SIZE, pa + 15 * PAGE_SIZE, true), "");
+    EXPECT_TRUE(check_mapped_page(aspace, protect_va + PAGE_SIZE, pa + 17 * PAGE_SIZE, true), "");
+
+    status = ka->RootVmar()->Unmap(unmap_va, PAGE_SIZE);
+    ASSERT_EQ(ZX_OK, status, "unmap\n");
+    paddr_t unused_pa;
+    EXPECT_EQ(ZX_ERR_NOT_FOUND, aspace.Query(unmap_va, &unused_pa, &mmu_flags), "unmapped\n");
+    EXPECT_TRUE(check_mapped_page(aspace, unmap_va - PAGE_SIZE, pa + 31 * PAGE_SIZE, true), "");
+    EXPECT_TRUE(check_mapped_page(aspace, tail_va, pa + 33 * PAGE_SIZE, true), "");
+    EXPECT_TRUE(check_mapped_page(aspace, last, pa + alloc_size - PAGE_SIZE, true), "");
+
+    // Only the mappings were split; the object still holds the large page.
+    EXPECT_EQ(1u, vmo->AllocatedLargePages(), "large page split\n");
+    EXPECT_TRUE(test_region(base, ptr, head), "contents before the hole\n");
+    EXPECT_TRUE(test_region(tail_va, reinterpret_cast<void*>(tail_va), tail),
+                "contents after the hole\n");
+
+    status = ka->RootVmar()->Unmap(base, alloc_size);
+    EXPECT_EQ(ZX_OK, status, "unmapping object\n");
+    END_TEST;
+}
+
 // Creates a paged VMO, pins it, and tries operations that should unpin it.
 static bool vmo_pin_test() {
     BEGIN_TEST;
@@ -1271,6 +1547,7 @@ static bool vmpl_take_cleanup_test() {
 
     page->state = VM_PAGE_STATE_OBJECT;
     page->object.pin_count = 0;
+    page->object.large_page = 0;
 
     VmPageList pl;
     pl.AddPage(page, 0);
@@ -1298,6 +1575,9 @@ VM_UNITTEST(vmo_create_test)
 VM_UNITTEST(vmo_pin_test)
 VM_UNITTEST(vmo_multiple_pin_test)
 VM_UNITTEST(vmo_commit_test)
+VM_UNITTEST(vmo_large_page_test)
+VM_UNITTEST(vmo_large_page_write_test)
+VM_UNITTEST(vmo_large_page_map_split_test)
 VM_UNITTEST(vmo_odd_size_commit_test)
 VM_UNITTEST(vmo_create_physical_test)
 VM_UNITTEST(vmo_create_contiguous_test)
@@ -1319,6 +1599,8 @@ UNITTEST_START_TESTCASE(pmm_tests)
 VM_UNITTEST(pmm_smoke_test)
 VM_UNITTEST(pmm_alloc_contiguous_one_test)
 VM_UNITTEST(pmm_multi_alloc_test)
+VM_UNITTEST(pmm_page_cache_test)
+VM_UNITTEST(pmm_alloc_zeroed_test)
 // runs the system out of memory, uncomment for debugging
 //VM_UNITTEST(pmm_oversized_alloc_test)
 UNITTEST_END_TESTCASE(pmm_tests, "pmm", "Physical memory manager tests");
@@ -86,7 +86,7 @@ void vmm_set_active_aspace(vmm_aspace_t* aspace) {
     }
 
     // grab the thread lock and switch to the new address space
-    Guard<spin_lock_t, IrqSave> thread_lock_guard{ThreadLock::Get()};
+    Guard<spin_lock_t, ThreadLockIrqSave> thread_lock_guard{ThreadLock::Get()};
     vmm_aspace_t* old = t->aspace;
     t->aspace = aspace;
     vmm_context_switch(old, t->aspace);
@@ -139,6 +139,21 @@ static_assert(sizeof(nvme_cmd_t) == (1 << NVME_CMD_SHIFT), "");
 
 #define NVME_FEATURE_NUMBER_OF_QUEUES 0x07
 
+// Number of Queues feature: counts are zero-based, in both the command
+// (dword 11) and the completion (dword 0).
+#define NVME_FEATURE_NSQR(n)       (((n) & 0xFFFF) << 0)  // Submission Queues Requested
+#define NVME_FEATURE_NCQR(n)       (((n) & 0xFFFF) << 16) // Completion Queues Requested
+#define NVME_FEATURE_NSQA(n)       (((n) >> 0) & 0xFFFF)  // Submission Queues Allocated
+#define NVME_FEATURE_NCQA(n)       (((n) >> 16) & 0xFFFF) // Completion Queues Allocated
+
+// Create I/O Completion/Submission Queue
+#define NVME_QUEUE_QSIZE(n)        (((n) & 0xFFFF) << 16) // Queue Size (minus 1)
+#define NVME_QUEUE_QID(n)          (((n) & 0xFFFF) << 0)  // Queue Identifier
+#define NVME_QUEUE_PC              (1 << 0)               // Physically Contiguous
+#define NVME_IOCQ_IEN              (1 << 1)               // Interrupts Enabled
+#define NVME_IOCQ_IV(n)            (((n) & 0xFFFF) << 16) // Interrupt Vector
+#define NVME_IOSQ_CQID(n)          (((n) & 0xFFFF) << 16) // Completion Queue Identifier
+
 
 #define NVME_LBAFMT_RP(n)      (((n) >> 24) & 3)
 #define NVME_LBAFMT_LBADS(n)   (((n) >> 16) & 0xFF)  // 2^n bytes
@@ -0,0 +1,960 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Tests of the nvme driver against a software model of an NVMe controller.
+//
+// The model sits behind a fake PCI protocol: its registers are a VMO handed
+// out as BAR 0, its interrupts are virtual interrupts, and it runs on its
+// own thread, polling the doorbells the way a controller would fetch
+// commands.  To let it follow the driver's DMA pointers, this file also
+// replaces the BTI syscalls: pinned memory is mapped into the process and
+// its "physical" addresses are the addresses of those mappings.
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include <initializer_list>
+
+#include <ddk/binding.h>
+#include <ddk/device.h>
+#include <ddk/driver.h>
+#include <ddk/protocol/block.h>
+#include <ddk/protocol/pci.h>
+#include <fbl/algorithm.h>
+#include <fbl/atomic.h>
+#include <fbl/auto_lock.h>
+#include <fbl/mutex.h>
+#include <fbl/unique_ptr.h>
+#include <fbl/vector.h>
+#include <lib/sync/completion.h>
+#include <lib/zx/event.h>
+#include <lib/zx/interrupt.h>
+#include <lib/zx/resource.h>
+#include <lib/zx/vmo.h>
+#include <unittest/unittest.h>
+#include <zircon/device/block.h>
+#include <zircon/process.h>
+#include <zircon/syscalls.h>
+#include <zircon/syscalls/pci.h>
+#include <zircon/thread_annotations.h>
+
+#include "nvme-hw.h"
+
+namespace {
+
+constexpr size_t kRegisterSize = 2 * PAGE_SIZE;
+constexpr uint32_t kBlockSize = 512;
+constexpr uint64_t kBlockCount = 1024;
+
+// Queue ids 1..kMaxQueues, plus the admin queue pair at 0.
+constexpr uint32_t kMaxQueues = 8;
+constexpr uint32_t kNumCpus = 4;
+
+// NVMe status codes, as NVME_CPL_STATUS_CODE() extracts them: the status
+// code type above the status code.
+constexpr uint16_t kInvalidOpcode = 0x001;
+constexpr uint16_t kInvalidField = 0x002;
+constexpr uint16_t kLbaOutOfRange = 0x080;
+constexpr uint16_t kInvalidQueueId = 0x101;
+constexpr uint16_t kInvalidQueueSize = 0x102;
+constexpr uint16_t kInvalidVector = 0x108;
+constexpr uint16_t kInvalidQueueDeletion = 0x10C;
+
+struct Config {
+    // Vectors offered in each irq mode; zero if the mode is unsupported.
+    uint32_t msix_vectors = 8;
+    uint32_t msi_vectors = 1;
+    uint32_t legacy_vectors = 1;
+    // Zero-based, as in CAP.MQES.
+    uint16_t mqes = 1023;
+    uint32_t max_queues = kMaxQueues;
+    bool volatile_write_cache = false;
+    // A submission queue whose creation fails, or zero.
+    uint32_t failed_sq = 0;
+};
+
+struct QueueInfo {
+    bool created = false;
+    bool cq_created = false;
+    uint16_t entries = 0;
+    uint32_t vector = 0;
+    uint32_t commands = 0;
+};
+
+// The controller model and the PCI device it sits on.
+class FakeNvme {
+public:
+    explicit FakeNvme(const Config& config) : config_(config) {
+        ops_.get_bar = GetBar;
+        ops_.enable_bus_master = EnableBusMaster;
+        ops_.map_interrupt = MapInterrupt;
+        ops_.query_irq_mode = QueryIrqMode;
+        ops_.set_irq_mode = SetIrqMode;
+        ops_.get_bti = GetBti;
+        disk_.reset(new uint8_t[kBlockCount * kBlockSize]());
+    }
+
+    ~FakeNvme() {
+        Stop();
+        if (regs_ != 0) {
+            zx_vmar_unmap(zx_vmar_root_self(), regs_, kRegisterSize);
+        }
+    }
+
+    pci_protocol_t protocol() { return pci_protocol_t{&ops_, this}; }
+
+    zx_pci_irq_mode_t irq_mode() const { return irq_mode_; }
+    uint32_t irq_count() const { return irq_count_; }
+    uint32_t queues_requested() {
+        fbl::AutoLock lock(&lock_);
+        return queues_requested_;
+    }
+
+    QueueInfo queue(uint32_t qid) {
+        fbl::AutoLock lock(&lock_);
+        QueueInfo info;
+        info.created = sq_[qid].base != nullptr;
+        info.cq_created = cq_[qid].base != nullptr;
+        info.entries = sq_[qid].entries;
+        info.vector = cq_[qid].vector;
+        info.commands = sq_[qid].commands;
+        return info;
+    }
+
+    uint32_t queue_count() {
+        uint32_t count = 0;
+        for (uint32_t qid = 1; qid <= kMaxQueues; qid++) {
+            count += queue(qid).created;
+        }
+        return count;
+    }
+
+    uint32_t flushes() {
+        fbl::AutoLock lock(&lock_);
+        return flushes_;
+    }
+
+    // While paused, the model leaves IO commands in the submission queues.
+    void Pause(bool paused) { paused_.store(paused); }
+
+    // The most commands waiting in any IO submission queue right now.
+    uint32_t MaxOutstanding() {
+        fbl::AutoLock lock(&lock_);
+        uint32_t max = 0;
+        for (uint32_t qid = 1; qid <= kMaxQueues; qid++) {
+            const SubmissionQueue& sq = sq_[qid];
+            if (sq.base != nullptr) {
+                uint32_t tail = Read32(NVME_REG_SQnTDBL(qid, Cap()));
+                max = fbl::max<uint32_t>(max, (tail + sq.entries - sq.head) % sq.entries);
+            }
+        }
+        return max;
+    }
+
+private:
+    struct SubmissionQueue {
+        nvme_cmd_t* base = nullptr;
+        uint16_t entries = 0;
+        uint16_t head = 0;
+        uint16_t cqid = 0;
+        uint32_t commands = 0;
+    };
+
+    struct CompletionQueue {
+        nvme_cpl_t* base = nullptr;
+        uint16_t entries = 0;
+        uint16_t tail = 0;
+        uint16_t phase = 1;
+        uint32_t vector = 0;
+        bool interrupts = false;
+    };
+
+    static FakeNvme* Self(void* ctx) { return static_cast<FakeNvme*>(ctx); }
+
+    static zx_status_t GetBar(void* ctx, uint32_t bar_id, zx_pci_bar_t* out_bar) {
+        FakeNvme* nvme = Self(ctx);
+        if (bar_id != 0 || nvme->regs_vmo_.is_valid()) {
+            return ZX_ERR_BAD_STATE;
+        }
+        // The driver sets the cache policy, which needs a VMO that is
+        // neither mapped nor committed yet, so the model only maps the
+        // registers once bus mastering is enabled.
+        zx::vmo vmo;
+        zx_status_t status = zx::vmo::create(kRegisterSize, 0, &nvme->regs_vmo_);
+        if (status == ZX_OK) {
+            status = nvme->regs_vmo_.duplicate(ZX_RIGHT_SAME_RIGHTS, &vmo);
+        }
+        if (status != ZX_OK) {
+            return status;
+        }
+        out_bar->id = 0;
+        out_bar->type = ZX_PCI_BAR_TYPE_MMIO;
+        out_bar->size = kRegisterSize;
+        out_bar->handle = vmo.release();
+        return ZX_OK;
+    }
+
+    static zx_status_t EnableBusMaster(void* ctx, bool enable) {
+        FakeNvme* nvme = Self(ctx);
+        if (!enable) {
+            nvme->Stop();
+            return ZX_OK;
+        }
+        return nvme->Start();
+    }
+
+    static zx_status_t QueryIrqMode(void* ctx, zx_pci_irq_mode_t mode, uint32_t* out_max_irqs) {
+        uint32_t vectors = Self(ctx)->Vectors(mode);
+        if (vectors == 0) {
+            return ZX_ERR_NOT_SUPPORTED;
+        }
+        *out_max_irqs = vectors;
+        return ZX_OK;
+    }
+
+    static zx_status_t SetIrqMode(void* ctx, zx_pci_irq_mode_t mode, uint32_t count) {
+        FakeNvme* nvme = Self(ctx);
+        if (count == 0 || count > nvme->Vectors(mode)) {
+            return ZX_ERR_NOT_SUPPORTED;
+        }
+        nvme->irq_mode_ = mode;
+        nvme->irq_count_ = count;
+        return ZX_OK;
+    }
+
+    static zx_status_t MapInterrupt(void* ctx, int32_t which_irq, zx_handle_t* out_handle) {
+        FakeNvme* nvme = Self(ctx);
+        if (which_irq < 0 || static_cast<uint32_t>(which_irq) >= nvme->irq_count_) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        zx::interrupt irq;
+        zx_status_t status = zx::interrupt::create(zx::resource(), 0, ZX_INTERRUPT_VIRTUAL, &irq);
+        if (status == ZX_OK) {
+            status = irq.duplicate(ZX_RIGHT_SAME_RIGHTS, &nvme->irqs_[which_irq]);
+        }
+        if (status != ZX_OK) {
+            return status;
+        }
+        *out_handle = irq.release();
+        return ZX_OK;
+    }
+
+    static zx_status_t GetBti(void* ctx, uint32_t index, zx_handle_t* out_handle) {
+        // Any handle will do: the BTI syscalls below do not look at it.
+        zx::event bti;
+        zx_status_t status = zx::event::create(0, &bti);
+        if (status != ZX_OK) {
+            return status;
+        }
+        *out_handle = bti.release();
+        return ZX_OK;
+    }
+
+    uint32_t Vectors(zx_pci_irq_mode_t mode) const {
+        switch (mode) {
+        case ZX_PCIE_IRQ_MODE_MSI_X:
+            return config_.msix_vectors;
+        case ZX_PCIE_IRQ_MODE_MSI:
+            return config_.msi_vectors;
+        case ZX_PCIE_IRQ_MODE_LEGACY:
+            return config_.legacy_vectors;
+        default:
+            return 0;
+        }
+    }
+
+    uint64_t Cap() const { return config_.mqes | (1ull << 37); }
+
+    uint32_t Read32(uint32_t offset) {
+        return __atomic_load_n(reinterpret_cast<uint32_t*>(regs_ + offset), __ATOMIC_ACQUIRE);
+    }
+    uint64_t Read64(uint32_t offset) {
+        return __atomic_load_n(reinterpret_cast<uint64_t*>(regs_ + offset), __ATOMIC_ACQUIRE);
+    }
+    void Write32(uint32_t value, uint32_t offset) {
+        __atomic_store_n(reinterpret_cast<uint32_t*>(regs_ + offset), value, __ATOMIC_RELEASE);
+    }
+    void Write64(uint64_t value, uint32_t offset) {
+        __atomic_store_n(reinterpret_cast<uint64_t*>(regs_ + offset), value, __ATOMIC_RELEASE);
+    }
+
+    zx_status_t Start() {
+        zx_status_t status = zx_vmar_map(zx_vmar_root_self(), ZX_VM_PERM_READ | ZX_VM_PERM_WRITE,
+                                         0, regs_vmo_.get(), 0, kRegisterSize, &regs_);
+        if (status != ZX_OK) {
+            return status;
+        }
+        Write64(Cap(), NVME_REG_CAP);
+        Write32(0x00010200, NVME_REG_VS);
+
+        running_.store(true);
+        if (thrd_create_with_name(&thread_, Thread, this, "fake-nvme") != thrd_success) {
+            running_.store(false);
+            return ZX_ERR_NO_RESOURCES;
+        }
+        thread_started_ = true;
+        return ZX_OK;
+    }
+
+    void Stop() {
+        running_.store(false);
+        if (thread_started_) {
+            thrd_join(thread_, nullptr);
+            thread_started_ = false;
+        }
+    }
+
+    static int Thread(void* arg) {
+        FakeNvme* nvme = Self(arg);
+        while (nvme->running_.load()) {
+            nvme->Poll();
+            zx_nanosleep(zx_deadline_after(ZX_USEC(100)));
+        }
+        return 0;
+    }
+
+    void Poll() {
+        fbl::AutoLock lock(&lock_);
+        uint32_t csts = Read32(NVME_REG_CSTS);
+        if (!(Read32(NVME_REG_CC) & NVME_CC_EN)) {
+            if (csts & NVME_CSTS_RDY) {
+                for (uint32_t qid = 0; qid <= kMaxQueues; qid++) {
+                    sq_[qid] = SubmissionQueue();
+                    cq_[qid] = CompletionQueue();
+                }
+                Write32(0, NVME_REG_CSTS);
+            }
+            return;
+        }
+        if (!(csts & NVME_CSTS_RDY)) {
+            uint32_t aqa = Read32(NVME_REG_AQA);
+            sq_[0].base = reinterpret_cast<nvme_cmd_t*>(Read64(NVME_REG_ASQ));
+            sq_[0].entries = static_cast<uint16_t>((aqa & 0xFFF) + 1);
+            cq_[0].base = reinterpret_cast<nvme_cpl_t*>(Read64(NVME_REG_ACQ));
+            cq_[0].entries = static_cast<uint16_t>(((aqa >> 16) & 0xFFF) + 1);
+            cq_[0].interrupts = true;
+            Write32(NVME_CSTS_RDY, NVME_REG_CSTS);
+            return;
+        }
+
+        Service(0);
+        if (!paused_.load()) {
+            for (uint32_t qid = 1; qid <= kMaxQueues; qid++) {
+                if (sq_[qid].base != nullptr) {
+                    Service(qid);
+                }
+            }
+        }
+    }
+
+    // Executes the commands in submission queue |sqid|, as long as its
+    // completion queue has room for their completions.
+    void Service(uint32_t sqid) TA_REQ(lock_) {
+        SubmissionQueue& sq = sq_[sqid];
+        CompletionQueue& cq = cq_[sq.cqid];
+        uint32_t tail = Read32(NVME_REG_SQnTDBL(sqid, Cap()));
+        if (tail >= sq.entries) {
+            return;
+        }
+
+        bool posted = false;
+        while (sq.head != tail) {
+            uint32_t cq_head = Read32(NVME_REG_CQnHDBL(sq.cqid, Cap()));
+            if ((cq.tail + 1u) % cq.entries == cq_head) {
+                break;
+            }
+            nvme_cmd_t cmd = sq.base[sq.head];
+            sq.head = static_cast<uint16_t>((sq.head + 1) % sq.entries);
+            sq.commands++;
+
+            uint32_t result = 0;
+            uint16_t code = sqid == 0 ? Admin(cmd, &result) : Io(cmd);
+
+            nvme_cpl_t* cpl = cq.base + cq.tail;
+            cpl->cmd = result;
+            cpl->reserved = 0;
+            cpl->sq_head = sq.head;
+            cpl->sq_id = static_cast<uint16_t>(sqid);
+            cpl->cmd_id = static_cast<uint16_t>(cmd.cmd >> 16);
+            __atomic_store_n(&cpl->status, static_cast<uint16_t>((code << 1) | cq.phase),
+                             __ATOMIC_RELEASE);
+            if (++cq.tail == cq.entries) {
+                cq.tail = 0;
+                cq.phase ^= 1;
+            }
+            posted = true;
+        }
+        if (posted && cq.interrupts) {
+            irqs_[cq.vector].trigger(0, zx::time(zx_clock_get_monotonic()));
+        }
+    }
+
+    uint16_t Admin(const nvme_cmd_t& cmd, uint32_t* result) TA_REQ(lock_) {
+        switch (NVME_CMD_OPC(cmd.cmd)) {
+        case NVME_ADMIN_OP_IDENTIFY:
+            if ((cmd.u.raw[0] & 0xFF) == 1) {
+                auto ci = reinterpret_cast<nvme_identify_t*>(cmd.dptr.prp[0]);
+                memset(ci, 0, sizeof(*ci));
+                memcpy(ci->MN, "fake nvme", 9);
+                ci->SQES = (NVME_CMD_SHIFT << 4) | NVME_CMD_SHIFT;
+                ci->CQES = (NVME_CPL_SHIFT << 4) | NVME_CPL_SHIFT;
+                ci->NN = 1;
+                ci->VWC = config_.volatile_write_cache ? 1 : 0;
+                return 0;
+            }
+            if ((cmd.u.raw[0] & 0xFF) == 0 && cmd.nsid == 1) {
+                auto ni = reinterpret_cast<nvme_identify_ns_t*>(cmd.dptr.prp[0]);
+                memset(ni, 0, sizeof(*ni));
+                ni->NSSZ = kBlockCount;
+                ni->NCAP = kBlockCount;
+                ni->LBAF[0] = 9 << 16;
+                return 0;
+            }
+            return kInvalidField;
+        case NVME_ADMIN_OP_SET_FEATURE: {
+            if ((cmd.u.raw[0] & 0xFF) != NVME_FEATURE_NUMBER_OF_QUEUES) {
+                return kInvalidField;
+            }
+            uint32_t nsq = NVME_FEATURE_NSQA(cmd.u.raw[1]) + 1;
+            uint32_t ncq = NVME_FEATURE_NCQA(cmd.u.raw[1]) + 1;
+            queues_requested_ = nsq;
+            nsq = fbl::min(nsq, config_.max_queues);
+            ncq = fbl::min(ncq, config_.max_queues);
+            *result = NVME_FEATURE_NSQR(nsq - 1) | NVME_FEATURE_NCQR(ncq - 1);
+            return 0;
+        }
+        case NVME_ADMIN_OP_CREATE_IOCQ: {
+            uint32_t qid = cmd.u.raw[0] & 0xFFFF;
+            uint32_t entries = (cmd.u.raw[0] >> 16) + 1;
+            uint32_t vector = cmd.u.raw[1] >> 16;
+            if (qid == 0 || qid > config_.max_queues || cq_[qid].base != nullptr) {
+                return kInvalidQueueId;
+            }
+            if (entries < 2 || entries > config_.mqes + 1u) {
+                return kInvalidQueueSize;
+            }
+            if (vector >= irq_count_) {
+                return kInvalidVector;
+            }
+            cq_[qid].base = reinterpret_cast<nvme_cpl_t*>(cmd.dptr.prp[0]);
+            cq_[qid].entries = static_cast<uint16_t>(entries);
+            cq_[qid].vector = vector;
+            cq_[qid].interrupts = (cmd.u.raw[1] & NVME_IOCQ_IEN) != 0;
+            return 0;
+        }
+        case NVME_ADMIN_OP_CREATE_IOSQ: {
+            uint32_t qid = cmd.u.raw[0] & 0xFFFF;
+            uint32_t entries = (cmd.u.raw[0] >> 16) + 1;
+            uint32_t cqid = cmd.u.raw[1] >> 16;
+            if (qid == 0 || qid > config_.max_queues || sq_[qid].base != nullptr ||
+                qid == config_.failed_sq) {
+                return kInvalidQueueId;
+            }
+            if (entries < 2 || entries > config_.mqes + 1u) {
+                return kInvalidQueueSize;
+            }
+            if (cqid == 0 || cqid > kMaxQueues || cq_[cqid].base == nullptr) {
+                return kInvalidQueueId;
+            }
+            sq_[qid].base = reinterpret_cast<nvme_cmd_t*>(cmd.dptr.prp[0]);
+            sq_[qid].entries = static_cast<uint16_t>(entries);
+            sq_[qid].cqid = static_cast<uint16_t>(cqid);
+            return 0;
+        }
+        case NVME_ADMIN_OP_DELETE_IOCQ: {
+            uint32_t qid = cmd.u.raw[0] & 0xFFFF;
+            if (qid == 0 || qid > kMaxQueues || cq_[qid].base == nullptr) {
+                return kInvalidQueueId;
+            }
+            for (uint32_t sqid = 1; sqid <= kMaxQueues; sqid++) {
+                if (sq_[sqid].base != nullptr && sq_[sqid].cqid == qid) {
+                    return kInvalidQueueDeletion;
+                }
+            }
+            cq_[qid] = CompletionQueue();
+            return 0;
+        }
+        default:
+            return kInvalidOpcode;
+        }
+    }
+
+    uint16_t Io(const nvme_cmd_t& cmd) TA_REQ(lock_) {
+        if (cmd.nsid != 1) {
+            return kInvalidField;
+        }
+        switch (NVME_CMD_OPC(cmd.cmd)) {
+        case NVME_OP_FLUSH:
+            flushes_++;
+            return 0;
+        case NVME_OP_WRITE:
+        case NVME_OP_READ:
+            break;
+        default:
+            return kInvalidOpcode;
+        }
+
+        uint64_t blocks = cmd.u.rw.block_count + 1u;
+        if (cmd.u.rw.start_lba >= kBlockCount || kBlockCount - cmd.u.rw.start_lba < blocks) {
+            return kLbaOutOfRange;
+        }
+        bool write = NVME_CMD_OPC(cmd.cmd) == NVME_OP_WRITE;
+        uint8_t* disk = disk_.get() + cmd.u.rw.start_lba * kBlockSize;
+        size_t remaining = blocks * kBlockSize;
+
+        // Walk the PRPs: the first may start inside a page, the second is
+        // either the next page or, for longer transfers, a list of pages.
+        uint64_t prp = cmd.dptr.prp[0];
+        const uint64_t* list = nullptr;
+        if (remaining + (prp & (PAGE_SIZE - 1)) > 2 * PAGE_SIZE) {
+            list = reinterpret_cast<const uint64_t*>(cmd.dptr.prp[1]);
+        }
+        for (unsigned n = 0; remaining > 0; n++) {
+            if (n == 1) {
+                prp = list ? *list++ : cmd.dptr.prp[1];
+            } else if (n > 1) {
+                prp = *list++;
+            }
+            size_t chunk = fbl::min<size_t>(remaining, PAGE_SIZE - (prp & (PAGE_SIZE - 1)));
+            void* mem = reinterpret_cast<void*>(prp);
+            if (write) {
+                memcpy(disk, mem, chunk);
+            } else {
+                memcpy(mem, disk, chunk);
+            }
+            disk += chunk;
+            remaining -= chunk;
+        }
+        return 0;
+    }
+
+    const Config config_;
+    pci_protocol_ops_t ops_ = {};
+
+    zx::vmo regs_vmo_;
+    zx_vaddr_t regs_ = 0;
+    zx_pci_irq_mode_t irq_mode_ = ZX_PCIE_IRQ_MODE_DISABLED;
+    uint32_t irq_count_ = 0;
+    zx::interrupt irqs_[kMaxQueues];
+
+    fbl::atomic<bool> running_{false};
+    fbl::atomic<bool> paused_{false};
+    bool thread_started_ = false;
+    thrd_t thread_;
+
+    fbl::Mutex lock_;
+    SubmissionQueue sq_[kMaxQueues + 1] TA_GUARDED(lock_);
+    CompletionQueue cq_[kMaxQueues + 1] TA_GUARDED(lock_);
+    uint32_t queues_requested_ TA_GUARDED(lock_) = 0;
+    uint32_t flushes_ TA_GUARDED(lock_) = 0;
+    fbl::unique_ptr<uint8_t[]> disk_;
+};
+
+// What the driver handed to device_add(), and the parent's protocol.
+struct Device {
+    void* ctx = nullptr;
+    zx_protocol_device_t* ops = nullptr;
+    block_impl_protocol_ops_t* block_ops = nullptr;
+    bool added = false;
+    bool visible = false;
+    bool removed = false;
+};
+
+zx_device_t* const kFakeParent = reinterpret_cast<zx_device_t*>(0xaa);
+zx_device_t* const kFakeDevice = reinterpret_cast<zx_device_t*>(0x55);
+
+Device gDevice;
+pci_protocol_t gPci;
+
+// A batch of block ops, queued together and waited for together.
+class IoBatch {
+public:
+    explicit IoBatch(const Device& device) : device_(device) {
+        block_info_t info;
+        device_.block_ops->query(device_.ctx, &info, &op_size_);
+    }
+
+    ~IoBatch() {
+        for (uint8_t* op : ops_) {
+            delete[] op;
+        }
+    }
+
+    void Queue(uint32_t command, zx_handle_t vmo, uint32_t length, uint64_t offset_dev,
+               uint64_t offset_vmo) {
+        uint8_t* buffer = new uint8_t[op_size_]();
+        ops_.push_back(buffer);
+        block_op_t* op = reinterpret_cast<block_op_t*>(buffer);
+        op->rw.command = command;
+        op->rw.vmo = vmo;
+        op->rw.length = length;
+        op->rw.offset_dev = offset_dev;
+        op->rw.offset_vmo = offset_vmo;
+        pending_.fetch_add(1);
+        device_.block_ops->queue(device_.ctx, op, Complete, this);
+    }
+
+    // Waits for all the ops queued so far, and returns the first error
+    // any of them completed with.  Call at most once.
+    zx_status_t Wait() {
+        if (!ops_.is_empty() && sync_completion_wait(&done_, ZX_SEC(5)) != ZX_OK) {
+            return ZX_ERR_TIMED_OUT;
+        }
+        return status_.load();
+    }
+
+private:
+    static void Complete(void* cookie, zx_status_t status, block_op_t* op) {
+        IoBatch* batch = static_cast<IoBatch*>(cookie);
+        zx_status_t ok = ZX_OK;
+        batch->status_.compare_exchange_strong(&ok, status, fbl::memory_order_seq_cst,
+                                               fbl::memory_order_seq_cst);
+        if (batch->pending_.fetch_sub(1) == 1) {
+            sync_completion_signal(&batch->done_);
+        }
+    }
+
+    const Device& device_;
+    size_t op_size_ = 0;
+    fbl::Vector<uint8_t*> ops_;
+    fbl::atomic<uint32_t> pending_{0};
+    fbl::atomic<zx_status_t> status_{ZX_OK};
+    sync_completion_t done_ = {};
+};
+
+bool BindDriver(FakeNvme* nvme) {
+    BEGIN_HELPER;
+    gDevice = Device();
+    gPci = nvme->protocol();
+    ASSERT_EQ(__zircon_driver_rec__.ops->bind(nullptr, kFakeParent), ZX_OK);
+    ASSERT_TRUE(gDevice.added);
+    ASSERT_TRUE(gDevice.visible);
+    ASSERT_NONNULL(gDevice.block_ops);
+    END_HELPER;
+}
+
+void ReleaseDriver() {
+    if (gDevice.added) {
+        gDevice.ops->release(gDevice.ctx);
+        gDevice.added = false;
+    }
+}
+
+void Fill(uint8_t* buffer, size_t size, uint32_t seed) {
+    for (size_t i = 0; i < size; i++) {
+        buffer[i] = static_cast<uint8_t>(seed * 31 + i * 7);
+    }
+}
+
+// Writes |blocks| blocks of a pattern at |offset_dev| as |ops| separate ops,
+// then reads them back the same way and compares.
+zx_status_t RoundTrip(uint64_t offset_dev, uint32_t blocks, uint32_t ops, uint32_t seed) {
+    const size_t size = blocks * kBlockSize;
+    zx::vmo vmo;
+    zx_status_t status = zx::vmo::create(2 * size, 0, &vmo);
+    if (status != ZX_OK) {
+        return status;
+    }
+    fbl::unique_ptr<uint8_t[]> expected(new uint8_t[size]);
+    fbl::unique_ptr<uint8_t[]> actual(new uint8_t[size]);
+    Fill(expected.get(), size, seed);
+    if ((status = vmo.write(expected.get(), 0, size)) != ZX_OK) {
+        return status;
+    }
+
+    const uint32_t per_op = blocks / ops;
+    for (uint32_t command : {BLOCK_OP_WRITE, BLOCK_OP_READ}) {
+        // Reads land in the second half of the vmo.
+        const uint64_t vmo_base = command == BLOCK_OP_READ ? blocks : 0;
+        IoBatch batch(gDevice);
+        for (uint32_t n = 0; n < ops; n++) {
+            batch.Queue(command, vmo.get(), per_op, offset_dev + n * per_op,
+                        vmo_base + n * per_op);
+        }
+        if ((status = batch.Wait()) != ZX_OK) {
+            return status;
+        }
+    }
+
+    if ((status = vmo.read(actual.get(), size, size)) != ZX_OK) {
+        return status;
+    }
+    return memcmp(expected.get(), actual.get(), size) == 0 ? ZX_OK : ZX_ERR_IO_DATA_INTEGRITY;
+}
+
+// Each thread is handed its own IO queue by the driver, so IO from several
+// threads at once reaches every queue.
+constexpr uint32_t kIoThreads = 2 * kMaxQueues;
+
+int RoundTripThread(void* arg) {
+    uint32_t index = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(arg));
+    return RoundTrip(index * 16, 16, 2, index);
+}
+
+bool RoundTripFromThreads() {
+    BEGIN_HELPER;
+    thrd_t threads[kIoThreads];
+    for (uint32_t n = 0; n < kIoThreads; n++) {
+        ASSERT_EQ(thrd_create(&threads[n], RoundTripThread, reinterpret_cast<void*>(n)),
+                  thrd_success);
+    }
+    for (uint32_t n = 0; n < kIoThreads; n++) {
+        int status;
+        ASSERT_EQ(thrd_join(threads[n], &status), thrd_success);
+        EXPECT_EQ(status, ZX_OK);
+    }
+    END_HELPER;
+}
+
+bool MultiQueueTest() {
+    BEGIN_TEST;
+    // Fewer vectors than cpus, and fewer queues than asked for.
+    Config config;
+    config.msix_vectors = 2;
+    config.max_queues = 3;
+    FakeNvme nvme(config);
+    ASSERT_TRUE(BindDriver(&nvme));
+
+    EXPECT_EQ(nvme.irq_mode(), ZX_PCIE_IRQ_MODE_MSI_X);
+    EXPECT_EQ(nvme.irq_count(), 2u);
+    EXPECT_EQ(nvme.queues_requested(), kNumCpus);
+    EXPECT_EQ(nvme.queue_count(), 3u);
+    for (uint32_t qid = 1; qid <= 3; qid++) {
+        QueueInfo info = nvme.queue(qid);
+        EXPECT_TRUE(info.created);
+        EXPECT_EQ(info.entries, 128u);
+        EXPECT_EQ(info.vector, (qid - 1) % 2);
+    }
+
+    EXPECT_TRUE(RoundTripFromThreads());
+    for (uint32_t qid = 1; qid <= 3; qid++) {
+        EXPECT_GT(nvme.queue(qid).commands, 0u, "every queue should have carried IO");
+    }
+
+    ReleaseDriver();
+    END_TEST;
+}
+
+bool MsixFallbackTest() {
+    BEGIN_TEST;
+    // Without MSI-X, all queues share the single MSI or legacy vector.
+    for (zx_pci_irq_mode_t mode : {ZX_PCIE_IRQ_MODE_MSI, ZX_PCIE_IRQ_MODE_LEGACY}) {
+        Config config;
+        config.msix_vectors = 0;
+        config.msi_vectors = mode == ZX_PCIE_IRQ_MODE_MSI ? 4 : 0;
+        FakeNvme nvme(config);
+        ASSERT_TRUE(BindDriver(&nvme));
+
+        EXPECT_EQ(nvme.irq_mode(), mode);
+        EXPECT_EQ(nvme.irq_count(), 1u);
+        EXPECT_EQ(nvme.queue_count(), kNumCpus);
+        for (uint32_t qid = 1; qid <= kNumCpus; qid++) {
+            EXPECT_EQ(nvme.queue(qid).vector, 0u);
+        }
+
+        EXPECT_TRUE(RoundTripFromThreads());
+        for (uint32_t qid = 1; qid <= kNumCpus; qid++) {
+            EXPECT_GT(nvme.queue(qid).commands, 0u, "every queue should have carried IO");
+        }
+
+        ReleaseDriver();
+    }
+    END_TEST;
+}
+
+bool SmallQueueTest() {
+    BEGIN_TEST;
+    // Four entries, of which the driver may fill three.
+    Config config;
+    config.mqes = 3;
+    FakeNvme nvme(config);
+    ASSERT_TRUE(BindDriver(&nvme));
+
+    for (uint32_t qid = 1; qid <= kNumCpus; qid++) {
+        EXPECT_EQ(nvme.queue(qid).entries, 4u);
+    }
+
+    // With the controller stalled, the driver fills the queue and holds
+    // the rest of the ops back until completions make room.
+    constexpr uint32_t kOps = 16;
+    zx::vmo vmo;
+    ASSERT_EQ(zx::vmo::create(kOps * 2 * kBlockSize, 0, &vmo), ZX_OK);
+    fbl::unique_ptr<uint8_t[]> expected(new uint8_t[kOps * 2 * kBlockSize]);
+    Fill(expected.get(), kOps * 2 * kBlockSize, 5);
+    ASSERT_EQ(vmo.write(expected.get(), 0, kOps * 2 * kBlockSize), ZX_OK);
+
+    nvme.Pause(true);
+    IoBatch batch(gDevice);
+    for (uint32_t n = 0; n < kOps; n++) {
+        batch.Queue(BLOCK_OP_WRITE, vmo.get(), 2, n * 2, n * 2);
+    }
+    EXPECT_EQ(nvme.MaxOutstanding(), 3u);
+    nvme.Pause(false);
+    EXPECT_EQ(batch.Wait(), ZX_OK);
+
+    // Transfers of more than two pages also go through the PRP list.
+    EXPECT_EQ(RoundTrip(0, kOps * 2, 1, 5), ZX_OK);
+    EXPECT_EQ(RoundTrip(64, 8, 8, 6), ZX_OK);
+
+    ReleaseDriver();
+    END_TEST;
+}
+
+bool QueueFailureTest() {
+    BEGIN_TEST;
+    // The driver carries on with the queues made before the failed one, and
+    // hands back the completion queue it paired with it.
+    Config config;
+    config.failed_sq = 3;
+    FakeNvme nvme(config);
+    ASSERT_TRUE(BindDriver(&nvme));
+
+    EXPECT_EQ(nvme.queue_count(), 2u);
+    EXPECT_FALSE(nvme.queue(3).cq_created);
+    EXPECT_TRUE(RoundTripFromThreads());
+
+    ReleaseDriver();
+    END_TEST;
+}
+
+bool FlushTest() {
+    BEGIN_TEST;
+    for (bool vwc : {false, true}) {
+        Config config;
+        config.volatile_write_cache = vwc;
+        FakeNvme nvme(config);
+        ASSERT_TRUE(BindDriver(&nvme));
+
+        EXPECT_EQ(RoundTrip(0, 4, 1, 7), ZX_OK);
+        IoBatch batch(gDevice);
+        batch.Queue(BLOCK_OP_FLUSH, ZX_HANDLE_INVALID, 0, 0, 0);
+        EXPECT_EQ(batch.Wait(), ZX_OK);
+
+        // Only a volatile write cache needs flushing.
+        EXPECT_EQ(nvme.flushes(), vwc ? 1u : 0u);
+
+        ReleaseDriver();
+    }
+    END_TEST;
+}
+
+}  // namespace
+
+// The driver's view of the DDK.
+
+zx_status_t device_add_from_driver(zx_driver_t* drv, zx_device_t* parent,
+                                   device_add_args_t* args, zx_device_t** out) {
+    if (parent != kFakeParent) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    gDevice.ctx = args->ctx;
+    gDevice.ops = args->ops;
+    gDevice.block_ops = static_cast<block_impl_protocol_ops_t*>(args->proto_ops);
+    gDevice.added = true;
+    *out = kFakeDevice;
+    return ZX_OK;
+}
+
+zx_status_t device_remove(zx_device_t* device) {
+    gDevice.removed = true;
+    ReleaseDriver();
+    return ZX_OK;
+}
+
+void device_make_visible(zx_device_t* device) {
+    gDevice.visible = true;
+}
+
+zx_status_t device_get_protocol(const zx_device_t* device, uint32_t proto_id, void* protocol) {
+    if (device != kFakeParent || proto_id != ZX_PROTOCOL_PCI) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+    memcpy(protocol, &gPci, sizeof(gPci));
+    return ZX_OK;
+}
+
+extern "C" void driver_printf(uint32_t flags, const char* fmt, ...) {}
+
+// The driver's view of the kernel.  Pinned memory is mapped, and its
+// addresses stand in for physical ones.
+
+namespace {
+
+struct Pin {
+    zx_handle_t pmt;
+    zx_vaddr_t addr;
+    size_t size;
+};
+
+fbl::Mutex gPinLock;
+fbl::Vector<Pin> gPins TA_GUARDED(gPinLock);
+
+}  // namespace
+
+uint32_t zx_system_get_num_cpus() {
+    return kNumCpus;
+}
+
+zx_status_t zx_vmo_create_contiguous(zx_handle_t bti, size_t size, uint32_t alignment_log2,
+                                     zx_handle_t* out) {
+    return zx_vmo_create(size, 0, out);
+}
+
+zx_status_t zx_bti_pin(zx_handle_t bti, uint32_t options, zx_handle_t vmo, uint64_t offset,
+                       uint64_t size, zx_paddr_t* addrs, size_t addrs_count, zx_handle_t* out) {
+    if (offset % PAGE_SIZE || size % PAGE_SIZE || size == 0) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    if (addrs_count != 1 && addrs_count != size / PAGE_SIZE) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    zx_vm_option_t perms = ZX_VM_PERM_READ;
+    if (options & ZX_BTI_PERM_WRITE) {
+        perms |= ZX_VM_PERM_WRITE;
+    }
+    zx_vaddr_t addr;
+    zx_status_t status = zx_vmar_map(zx_vmar_root_self(), perms, 0, vmo, offset, size, &addr);
+    if (status != ZX_OK) {
+        return status;
+    }
+    zx::event pmt;
+    if ((status = zx::event::create(0, &pmt)) != ZX_OK) {
+        zx_vmar_unmap(zx_vmar_root_self(), addr, size);
+        return status;
+    }
+    for (size_t n = 0; n < addrs_count; n++) {
+        addrs[n] = addr + n * PAGE_SIZE;
+    }
+
+    fbl::AutoLock lock(&gPinLock);
+    gPins.push_back(Pin{pmt.get(), addr, size});
+    *out = pmt.release();
+    return ZX_OK;
+}
+
+zx_status_t zx_pmt_unpin(zx_handle_t pmt) {
+    fbl::AutoLock lock(&gPinLock);
+    for (size_t n = 0; n < gPins.size(); n++) {
+        if (gPins[n].pmt == pmt) {
+            zx_vmar_unmap(zx_vmar_root_self(), gPins[n].addr, gPins[n].size);
+            gPins.erase(n);
+            return zx_handle_close(pmt);
+        }
+    }
+    return ZX_ERR_BAD_HANDLE;
+}
+
+BEGIN_TEST_CASE(nvme_tests)
+RUN_TEST(MultiQueueTest)
+RUN_TEST(MsixFallbackTest)
+RUN_TEST(SmallQueueTest)
+RUN_TEST(QueueFailureTest)
+RUN_TEST(FlushTest)
+END_TEST_CASE(nvme_tests)
+
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : 1;
+}
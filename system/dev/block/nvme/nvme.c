@@ -4,9 +4,11 @@
 
 #include <assert.h>
 #include <limits.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
 #include <threads.h>
 
 #include <ddk/binding.h>
@@ -41,20 +43,19 @@ typedef struct {
     uint16_t pending_utxns;
     uint8_t opcode;
     uint8_t flags;
+    zx_status_t status;    // set once the txn is ready to complete
 } nvme_txn_t;
 
 typedef struct {
     zx_paddr_t phys;    // io buffer phys base (1 page)
     void* virt;         // io buffer virt base
-    zx_handle_t pmt;    // pinned memory
+    zx_handle_t pmt;    // pinned memory, or ZX_HANDLE_INVALID if no data
     nvme_txn_t* txn;    // related txn
     uint16_t id;
     uint16_t reserved0;
     uint32_t reserved1;
 } nvme_utxn_t;
 
-#define UTXN_COUNT 63
-
 // There's no system constant for this.  Ensure it matches reality.
 #define PAGE_SHIFT (12ULL)
 static_assert(PAGE_SIZE == (1ULL << PAGE_SHIFT), "");
@@ -66,37 +67,55 @@ static_assert(PAGE_SIZE == (1ULL << PAGE_SHIFT), "");
 #define MAX_XFER (1024*1024)
 
 // Maximum submission and completion queue item counts, for
-// queues that are a single page in size.
+// the admin queues which are a single page in size.
 #define SQMAX (PAGE_SIZE / sizeof(nvme_cmd_t))
 #define CQMAX (PAGE_SIZE / sizeof(nvme_cpl_t))
 
+// Maximum item count of each IO submission and completion queue.  The
+// submission queue spans two pages at this depth.  The controller may
+// limit it further (CAP.MQES).
+#define IO_QUEUE_ENTRIES 128
+
+// One utxn per IO submission queue entry, less the one which must stay
+// free to tell a full queue from an empty one.
+#define UTXN_COUNT (IO_QUEUE_ENTRIES - 1)
+#define UTXN_WORDS ((UTXN_COUNT + 63) / 64)
+
+// Upper bounds on IO queue pairs and interrupt vectors.  We ask for one
+// queue pair per cpu, up to MAX_IO_QUEUES, and spread them over as many
+// vectors as we are given.
+#define MAX_IO_QUEUES 8
+#define MAX_IRQS MAX_IO_QUEUES
+
 // global driver state bits
-#define FLAG_IRQ_THREAD_STARTED  0x0001
-#define FLAG_IO_THREAD_STARTED   0x0002
 #define FLAG_SHUTDOWN            0x0004
 
 #define FLAG_HAS_VWC             0x0100
 
+typedef struct nvme_device nvme_device_t;
+
 typedef struct {
-    mmio_buffer_t mmio;
-    zx_handle_t irqh;
-    zx_handle_t bti;
-    uint32_t flags;
+    nvme_device_t* nvme;
+    uint16_t id;           // queue id, shared by the sq and its cq
+    uint16_t entries;      // item count of the sq and the cq
+    uint32_t vector;       // interrupt vector of the cq
+
+    // Protects everything below, and is held while submitting
+    // commands and while reaping completions.
     mtx_t lock;
 
-    // io queue doorbell registers
-    void* io_sq_tail_db;
-    void* io_cq_head_db;
+    // doorbell registers
+    void* sq_tail_db;
+    void* cq_head_db;
 
-    nvme_cpl_t* io_cq;
-    nvme_cmd_t* io_sq;
-    uint32_t io_nsid;
-    uint16_t io_cq_head;
-    uint16_t io_cq_toggle;
-    uint16_t io_sq_tail;
-    uint16_t io_sq_head;
+    nvme_cmd_t* sq;
+    nvme_cpl_t* cq;
+    uint16_t cq_head;
+    uint16_t cq_toggle;
+    uint16_t sq_tail;
+    uint16_t sq_head;
 
-    uint64_t utxn_avail;   // bitmask of available utxns
+    uint64_t utxn_avail[UTXN_WORDS];   // bitmask of available utxns
 
     // The pending list is txns that have been received
     // via nvme_queue() and are waiting for io to start.
@@ -109,10 +128,28 @@ typedef struct {
     list_node_t pending_txns;      // inbound txns to process
     list_node_t active_txns;       // txns in flight
 
-    // The io signal completion is signaled from nvme_queue()
-    // or from the irq thread, notifying the io thread that
-    // it has work to do.
-    sync_completion_t io_signal;
+    // submission queue followed by completion queue, physically contiguous
+    io_buffer_t ring_iob;
+    // one scatter gather page per utxn
+    io_buffer_t utxn_iob;
+
+    // pool of utxns
+    nvme_utxn_t utxn[UTXN_COUNT];
+} nvme_queue_t;
+
+typedef struct {
+    nvme_device_t* nvme;
+    zx_handle_t irqh;
+    uint32_t vector;
+    bool thread_started;
+    thrd_t thread;
+} nvme_irq_t;
+
+struct nvme_device {
+    mmio_buffer_t mmio;
+    zx_handle_t bti;
+    uint32_t flags;
+    uint64_t cap;
 
     uint32_t max_xfer;
     block_info_t info;
@@ -138,17 +175,19 @@ typedef struct {
     pci_protocol_t pci;
     zx_device_t* zxdev;
 
-    size_t iosz;
-
-    // source of physical pages for queues and admin commands
+    // source of physical pages for admin queues and admin commands
     io_buffer_t iob;
 
-    thrd_t irqthread;
-    thrd_t iothread;
+    // One thread per interrupt vector.  Vector 0 also serves the
+    // admin completion queue.
+    uint32_t irq_count;
+    nvme_irq_t irq[MAX_IRQS];
 
-    // pool of utxns
-    nvme_utxn_t utxn[UTXN_COUNT];
-} nvme_device_t;
+    // IO queue pairs.  queue_count only grows, and only once the
+    // queue it covers is ready to be serviced by the irq threads.
+    atomic_uint queue_count;
+    nvme_queue_t queue[MAX_IO_QUEUES];
+};
 
 
 // We break IO transactions down into one or more "micro transactions" (utxn)
@@ -157,26 +196,26 @@ typedef struct {
 // queued to the NVME device.  This id is the same as its index into the
 // pool of utxns and the bitmask of free txns, to simplify management.
 //
-// We maintain a pool of 63 of these, which is the number of commands
-// that can be submitted to NVME via a single page submit queue.
+// Each IO queue has its own pool, with one utxn per submission queue
+// entry, so a utxn in hand always has room in the submission queue.
 //
-// The utxns are not protected by locks.  Instead, after initialization,
-// they may only be touched by the io thread, which is responsible for
-// queueing commands and dequeuing completion messages.
-
-static nvme_utxn_t* utxn_get(nvme_device_t* nvme) {
-    uint64_t n = __builtin_ffsll(nvme->utxn_avail);
-    if (n == 0) {
-        return NULL;
-    }
-    n--;
-    nvme->utxn_avail &= ~(1ULL << n);
-    return nvme->utxn + n;
+// The utxns, like the rest of the queue, are protected by the queue lock.
+
+static nvme_utxn_t* utxn_get(nvme_queue_t* q) {
+    for (unsigned w = 0; w < UTXN_WORDS; w++) {
+        uint64_t n = __builtin_ffsll(q->utxn_avail[w]);
+        if (n != 0) {
+            n--;
+            q->utxn_avail[w] &= ~(1ULL << n);
+            return q->utxn + w * 64 + n;
+        }
+    }
+    return NULL;
 }
 
-static void utxn_put(nvme_device_t* nvme, nvme_utxn_t* utxn) {
+static void utxn_put(nvme_queue_t* q, nvme_utxn_t* utxn) {
     uint64_t n = utxn->id;
-    nvme->utxn_avail |= (1ULL << n);
+    q->utxn_avail[n / 64] |= (1ULL << (n % 64));
 }
 
 static zx_status_t nvme_admin_cq_get(nvme_device_t* nvme, nvme_cpl_t* cpl) {
@@ -215,62 +254,52 @@ static zx_status_t nvme_admin_sq_put(nvme_device_t* nvme, nvme_cmd_t* cmd) {
     return ZX_OK;
 }
 
-static zx_status_t nvme_io_cq_get(nvme_device_t* nvme, nvme_cpl_t* cpl) {
-    if ((readw(&nvme->io_cq[nvme->io_cq_head].status) & 1) != nvme->io_cq_toggle) {
+// IO queues need not be a power of two in size, since the controller
+// may limit them to any size.
+static inline uint16_t queue_next(nvme_queue_t* q, uint16_t n) {
+    return (n + 1 == q->entries) ? 0 : n + 1;
+}
+
+static zx_status_t nvme_io_cq_get(nvme_queue_t* q, nvme_cpl_t* cpl) {
+    if ((readw(&q->cq[q->cq_head].status) & 1) != q->cq_toggle) {
         return ZX_ERR_SHOULD_WAIT;
     }
-    *cpl = nvme->io_cq[nvme->io_cq_head];
+    *cpl = q->cq[q->cq_head];
 
     // advance the head pointer, wrapping and inverting toggle at max
-    uint16_t next = (nvme->io_cq_head + 1) & (CQMAX - 1);
-    if ((nvme->io_cq_head = next) == 0) {
-        nvme->io_cq_toggle ^= 1;
+    uint16_t next = queue_next(q, q->cq_head);
+    if ((q->cq_head = next) == 0) {
+        q->cq_toggle ^= 1;
     }
 
     // note the new sq head reported by hw
-    nvme->io_sq_head = cpl->sq_head;
+    q->sq_head = cpl->sq_head;
     return ZX_OK;
 }
 
-static void nvme_io_cq_ack(nvme_device_t* nvme) {
+static void nvme_io_cq_ack(nvme_queue_t* q) {
     // ring the doorbell
-    writel(nvme->io_cq_head, nvme->io_cq_head_db);
+    writel(q->cq_head, q->cq_head_db);
 }
 
-static zx_status_t nvme_io_sq_put(nvme_device_t* nvme, nvme_cmd_t* cmd) {
-    uint16_t next = (nvme->io_sq_tail + 1) & (SQMAX - 1);
+// Adds a command to the submission queue.  The doorbell is rung
+// separately, by nvme_io_sq_ring(), once per batch of commands.
+static zx_status_t nvme_io_sq_put(nvme_queue_t* q, nvme_cmd_t* cmd) {
+    uint16_t next = queue_next(q, q->sq_tail);
 
     // if head+1 == tail: queue is full
-    if (next == nvme->io_sq_head) {
+    if (next == q->sq_head) {
         return ZX_ERR_SHOULD_WAIT;
     }
 
-    nvme->io_sq[nvme->io_sq_tail] = *cmd;
-    nvme->io_sq_tail = next;
-
-    // ring the doorbell
-    writel(next, nvme->io_sq_tail_db);
+    q->sq[q->sq_tail] = *cmd;
+    q->sq_tail = next;
     return ZX_OK;
 }
 
-static int irq_thread(void* arg) {
-    nvme_device_t* nvme = arg;
-    for (;;) {
-        zx_status_t r;
-        if ((r = zx_interrupt_wait(nvme->irqh, NULL)) != ZX_OK) {
-            zxlogf(ERROR, "nvme: irq wait failed: %d\n", r);
-            break;
-        }
-
-        nvme_cpl_t cpl;
-        if (nvme_admin_cq_get(nvme, &cpl) == ZX_OK) {
-            nvme->admin_result = cpl;
-            sync_completion_signal(&nvme->admin_signal);
-        }
-
-        sync_completion_signal(&nvme->io_signal);
-    }
-    return 0;
+static void nvme_io_sq_ring(nvme_queue_t* q) {
+    // ring the doorbell
+    writel(q->sq_tail, q->sq_tail_db);
 }
 
 static zx_status_t nvme_admin_txn(nvme_device_t* nvme, nvme_cmd_t* cmd, nvme_cpl_t* cpl) {
@@ -302,10 +331,26 @@ static inline void txn_complete(nvme_txn_t* txn, zx_status_t status) {
     txn->completion_cb(txn->cookie, status, &txn->op);
 }
 
+// Moves a txn to the list of txns to complete once the queue lock
+// is dropped, since completion callbacks may queue further txns.
+static inline void txn_done(nvme_txn_t* txn, zx_status_t status, list_node_t* done) {
+    txn->status = status;
+    list_add_tail(done, &txn->node);
+}
+
+static void txns_complete(list_node_t* done) {
+    nvme_txn_t* txn;
+    while ((txn = list_remove_head_type(done, nvme_txn_t, node)) != NULL) {
+        txn_complete(txn, txn->status);
+    }
+}
+
 // Attempt to generate utxns and queue nvme commands for a txn
 // Returns true if this could not be completed due to temporary
 // lack of resources or false if either it succeeded or errored out.
-static bool io_process_txn(nvme_device_t* nvme, nvme_txn_t* txn) {
+// Called with the queue lock held.
+static bool io_process_txn(nvme_queue_t* q, nvme_txn_t* txn, list_node_t* done) {
+    nvme_device_t* nvme = q->nvme;
     zx_handle_t vmo = txn->op.rw.vmo;
     nvme_utxn_t* utxn;
     zx_paddr_t* pages;
@@ -314,63 +359,72 @@ static bool io_process_txn(nvme_device_t* nvme, nvme_txn_t* txn) {
     for (;;) {
         // If there are no available utxns, we can't proceed
         // and we tell the caller to retain the txn (true)
-        if ((utxn = utxn_get(nvme)) == NULL) {
+        if ((utxn = utxn_get(q)) == NULL) {
             return true;
         }
-
-        uint32_t blocks = txn->op.rw.length;
-        if (blocks > nvme->max_xfer) {
-            blocks = nvme->max_xfer;
-        }
-
-        // Total transfer size in bytes
-        size_t bytes = ((size_t) blocks) * ((size_t) nvme->info.block_size);
-
-        // Page offset of first page of transfer
-        size_t pageoffset = txn->op.rw.offset_vmo & (~PAGE_MASK);
-
-        // Byte offset into first page of transfer
-        size_t byteoffset = txn->op.rw.offset_vmo & PAGE_MASK;
-
-        // Total pages mapped / touched
-        size_t pagecount = (byteoffset + bytes + PAGE_MASK) >> PAGE_SHIFT;
-
-        // read disk (OP_READ) -> memory (PERM_WRITE) or
-        // write memory (PERM_READ) -> disk (OP_WRITE)
-        uint32_t opt = (txn->opcode == NVME_OP_READ) ? ZX_BTI_PERM_WRITE : ZX_BTI_PERM_READ;
-
-        pages = utxn->virt;
-
-        if ((r = zx_bti_pin(nvme->bti, opt, vmo, pageoffset, pagecount << PAGE_SHIFT,
-                            pages, pagecount, &utxn->pmt)) != ZX_OK) {
-            zxlogf(ERROR, "nvme: could not pin pages: %d\n", r);
-            break;
-        }
+        utxn->pmt = ZX_HANDLE_INVALID;
 
         nvme_cmd_t cmd;
         memset(&cmd, 0, sizeof(cmd));
         cmd.cmd = NVME_CMD_CID(utxn->id) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(txn->opcode);
         cmd.nsid = 1;
-        cmd.u.rw.start_lba = txn->op.rw.offset_dev;
-        cmd.u.rw.block_count = blocks - 1;
-        // The NVME command has room for two data pointers inline.
-        // The first is always the pointer to the first page where data is.
-        // The second is the second page if pagecount is 2.
-        // The second is the address of an array of page 2..n if pagecount > 2
-        cmd.dptr.prp[0] = pages[0] | byteoffset;
-        if (pagecount == 2) {
-            cmd.dptr.prp[1] = pages[1];
-        } else if (pagecount > 2) {
-            cmd.dptr.prp[1] = utxn->phys + sizeof(uint64_t);
-        }
 
-        zxlogf(TRACE, "nvme: txn=%p utxn id=%u pages=%zu op=%s\n", txn, utxn->id, pagecount,
-               txn->opcode == NVME_OP_WRITE ? "WR" : "RD");
-        zxlogf(SPEW, "nvme: prp[0]=%016zx prp[1]=%016zx\n", cmd.dptr.prp[0], cmd.dptr.prp[1]);
-        zxlogf(SPEW, "nvme: pages[] = { %016zx, %016zx, %016zx, %016zx, ... }\n",
-               pages[0], pages[1], pages[2], pages[3]);
+        uint32_t blocks = 0;
+        size_t bytes = 0;
+        if (txn->opcode != NVME_OP_FLUSH) {
+            blocks = txn->op.rw.length;
+            if (blocks > nvme->max_xfer) {
+                blocks = nvme->max_xfer;
+            }
+
+            // Total transfer size in bytes
+            bytes = ((size_t) blocks) * ((size_t) nvme->info.block_size);
+
+            // Page offset of first page of transfer
+            size_t pageoffset = txn->op.rw.offset_vmo & (~PAGE_MASK);
+
+            // Byte offset into first page of transfer
+            size_t byteoffset = txn->op.rw.offset_vmo & PAGE_MASK;
+
+            // Total pages mapped / touched
+            size_t pagecount = (byteoffset + bytes + PAGE_MASK) >> PAGE_SHIFT;
+
+            // read disk (OP_READ) -> memory (PERM_WRITE) or
+            // write memory (PERM_READ) -> disk (OP_WRITE)
+            uint32_t opt = (txn->opcode == NVME_OP_READ) ? ZX_BTI_PERM_WRITE : ZX_BTI_PERM_READ;
+
+            pages = utxn->virt;
+
+            if ((r = zx_bti_pin(nvme->bti, opt, vmo, pageoffset, pagecount << PAGE_SHIFT,
+                                pages, pagecount, &utxn->pmt)) != ZX_OK) {
+                zxlogf(ERROR, "nvme: could not pin pages: %d\n", r);
+                utxn->pmt = ZX_HANDLE_INVALID;
+                break;
+            }
+
+            cmd.u.rw.start_lba = txn->op.rw.offset_dev;
+            cmd.u.rw.block_count = blocks - 1;
+            // The NVME command has room for two data pointers inline.
+            // The first is always the pointer to the first page where data is.
+            // The second is the second page if pagecount is 2.
+            // The second is the address of an array of page 2..n if pagecount > 2
+            cmd.dptr.prp[0] = pages[0] | byteoffset;
+            if (pagecount == 2) {
+                cmd.dptr.prp[1] = pages[1];
+            } else if (pagecount > 2) {
+                cmd.dptr.prp[1] = utxn->phys + sizeof(uint64_t);
+            }
+
+            zxlogf(TRACE, "nvme: q%u txn=%p utxn id=%u pages=%zu op=%s\n", q->id, txn, utxn->id,
+                   pagecount, txn->opcode == NVME_OP_WRITE ? "WR" : "RD");
+            zxlogf(SPEW, "nvme: prp[0]=%016zx prp[1]=%016zx\n", cmd.dptr.prp[0], cmd.dptr.prp[1]);
+            zxlogf(SPEW, "nvme: pages[] = { %016zx, %016zx, %016zx, %016zx, ... }\n",
+                   pages[0], pages[1], pages[2], pages[3]);
+        } else {
+            zxlogf(TRACE, "nvme: q%u txn=%p utxn id=%u op=FLUSH\n", q->id, txn, utxn->id);
+        }
 
-        if ((r = nvme_io_sq_put(nvme, &cmd)) != ZX_OK) {
+        if ((r = nvme_io_sq_put(q, &cmd)) != ZX_OK) {
             zxlogf(ERROR, "nvme: could not submit cmd (txn=%p id=%u)\n", txn, utxn->id);
             break;
         }
@@ -387,139 +441,164 @@ static bool io_process_txn(nvme_device_t* nvme, nvme_txn_t* txn) {
         // move this txn to the active list and tell the
         // caller not to retain the txn (false)
         if (txn->op.rw.length == 0) {
-            mtx_lock(&nvme->lock);
-            list_add_tail(&nvme->active_txns, &txn->node);
-            mtx_unlock(&nvme->lock);
+            list_add_tail(&q->active_txns, &txn->node);
             return false;
         }
     }
 
     // failure
-    if ((r = zx_pmt_unpin(utxn->pmt)) != ZX_OK) {
-        zxlogf(ERROR, "nvme: cannot unpin io buffer: %d\n", r);
+    if (utxn->pmt != ZX_HANDLE_INVALID) {
+        if ((r = zx_pmt_unpin(utxn->pmt)) != ZX_OK) {
+            zxlogf(ERROR, "nvme: cannot unpin io buffer: %d\n", r);
+        }
     }
-    utxn_put(nvme, utxn);
+    utxn_put(q, utxn);
 
-    mtx_lock(&nvme->lock);
     txn->flags |= TXN_FLAG_FAILED;
     if (txn->pending_utxns) {
         // if there are earlier uncompleted IOs we become active now
         // and will finish erroring out when they complete
-        list_add_tail(&nvme->active_txns, &txn->node);
-        txn = NULL;
-    }
-    mtx_unlock(&nvme->lock);
-
-    if (txn != NULL) {
-        txn_complete(txn, ZX_ERR_INTERNAL);
+        txn->op.rw.length = 0;
+        list_add_tail(&q->active_txns, &txn->node);
+    } else {
+        txn_done(txn, ZX_ERR_INTERNAL, done);
     }
 
     // Either way we tell the caller not to retain the txn (false)
     return false;
 }
 
-static void io_process_txns(nvme_device_t* nvme) {
+// Called with the queue lock held.
+static void io_process_txns(nvme_queue_t* q, list_node_t* done) {
+    uint16_t tail = q->sq_tail;
     nvme_txn_t* txn;
 
-    for (;;) {
-        mtx_lock(&nvme->lock);
-        txn = list_remove_head_type(&nvme->pending_txns, nvme_txn_t, node);
-        mtx_unlock(&nvme->lock);
-
-        if (txn == NULL) {
-            return;
-        }
-
-        if (io_process_txn(nvme, txn)) {
+    while ((txn = list_remove_head_type(&q->pending_txns, nvme_txn_t, node)) != NULL) {
+        if (io_process_txn(q, txn, done)) {
             // put txn back at front of queue for further processing later
-            mtx_lock(&nvme->lock);
-            list_add_head(&nvme->pending_txns, &txn->node);
-            mtx_unlock(&nvme->lock);
-            return;
+            list_add_head(&q->pending_txns, &txn->node);
+            break;
         }
     }
+
+    if (q->sq_tail != tail) {
+        nvme_io_sq_ring(q);
+    }
 }
 
-static void io_process_cpls(nvme_device_t* nvme) {
+// Called with the queue lock held.
+static void io_process_cpls(nvme_queue_t* q, list_node_t* done) {
     bool ring_doorbell = false;
     nvme_cpl_t cpl;
 
-    while (nvme_io_cq_get(nvme, &cpl) == ZX_OK) {
+    while (nvme_io_cq_get(q, &cpl) == ZX_OK) {
         ring_doorbell = true;
 
         if (cpl.cmd_id >= UTXN_COUNT) {
-            zxlogf(ERROR, "nvme: unexpected cmd id %u\n", cpl.cmd_id);
+            zxlogf(ERROR, "nvme: q%u: unexpected cmd id %u\n", q->id, cpl.cmd_id);
             continue;
         }
-        nvme_utxn_t* utxn = nvme->utxn + cpl.cmd_id;
+        nvme_utxn_t* utxn = q->utxn + cpl.cmd_id;
         nvme_txn_t* txn = utxn->txn;
 
         if (txn == NULL) {
-            zxlogf(ERROR, "nvme: inactive utxn #%u completed?!\n", cpl.cmd_id);
+            zxlogf(ERROR, "nvme: q%u: inactive utxn #%u completed?!\n", q->id, cpl.cmd_id);
             continue;
         }
 
         uint32_t code = NVME_CPL_STATUS_CODE(cpl.status);
         if (code != 0) {
-            zxlogf(ERROR, "nvme: utxn #%u txn %p failed: status=%03x\n",
-                   cpl.cmd_id, txn, code);
+            zxlogf(ERROR, "nvme: q%u: utxn #%u txn %p failed: status=%03x\n",
+                   q->id, cpl.cmd_id, txn, code);
             txn->flags |= TXN_FLAG_FAILED;
             // discard any remaining bytes -- no reason to keep creating
             // further utxns once one has failed
             txn->op.rw.length = 0;
         } else {
-            zxlogf(SPEW, "nvme: utxn #%u txn %p OKAY\n", cpl.cmd_id, txn);
+            zxlogf(SPEW, "nvme: q%u: utxn #%u txn %p OKAY\n", q->id, cpl.cmd_id, txn);
         }
 
-        zx_status_t r;
-        if ((r = zx_pmt_unpin(utxn->pmt)) != ZX_OK) {
-            zxlogf(ERROR, "nvme: cannot unpin io buffer: %d\n", r);
+        if (utxn->pmt != ZX_HANDLE_INVALID) {
+            zx_status_t r;
+            if ((r = zx_pmt_unpin(utxn->pmt)) != ZX_OK) {
+                zxlogf(ERROR, "nvme: cannot unpin io buffer: %d\n", r);
+            }
         }
 
         // release the microtransaction
         utxn->txn = NULL;
-        utxn_put(nvme, utxn);
+        utxn_put(q, utxn);
 
         txn->pending_utxns--;
         if ((txn->pending_utxns == 0) && (txn->op.rw.length == 0)) {
             // remove from either pending or active list
-            mtx_lock(&nvme->lock);
             list_delete(&txn->node);
-            mtx_unlock(&nvme->lock);
             zxlogf(TRACE, "nvme: txn %p %s\n", txn, txn->flags & TXN_FLAG_FAILED ? "error" : "okay");
-            txn_complete(txn, txn->flags & TXN_FLAG_FAILED ? ZX_ERR_IO : ZX_OK);
+            txn_done(txn, txn->flags & TXN_FLAG_FAILED ? ZX_ERR_IO : ZX_OK, done);
         }
     }
 
     if (ring_doorbell) {
-        nvme_io_cq_ack(nvme);
+        nvme_io_cq_ack(q);
     }
 }
 
-static int io_thread(void* arg) {
-    nvme_device_t* nvme = arg;
+// Reaps completions from |q|, then starts whatever pending txns the
+// freed utxns make room for.
+static void io_service_queue(nvme_queue_t* q) {
+    list_node_t done = LIST_INITIAL_VALUE(done);
+
+    mtx_lock(&q->lock);
+    io_process_cpls(q, &done);
+    io_process_txns(q, &done);
+    mtx_unlock(&q->lock);
+
+    txns_complete(&done);
+}
+
+static int irq_thread(void* arg) {
+    nvme_irq_t* irq = arg;
+    nvme_device_t* nvme = irq->nvme;
     for (;;) {
-        if (sync_completion_wait(&nvme->io_signal, ZX_TIME_INFINITE)) {
-            break;
-        }
-        if (nvme->flags & FLAG_SHUTDOWN) {
-            //TODO: cancel out pending IO
-            zxlogf(INFO, "nvme: io thread exiting\n");
+        zx_status_t r;
+        if ((r = zx_interrupt_wait(irq->irqh, NULL)) != ZX_OK) {
+            if (!(nvme->flags & FLAG_SHUTDOWN)) {
+                zxlogf(ERROR, "nvme: irq %u wait failed: %d\n", irq->vector, r);
+            }
             break;
         }
 
-        sync_completion_reset(&nvme->io_signal);
-
-        // process completion messages
-        io_process_cpls(nvme);
-
-        // process work queue
-        io_process_txns(nvme);
+        if (irq->vector == 0) {
+            nvme_cpl_t cpl;
+            if (nvme_admin_cq_get(nvme, &cpl) == ZX_OK) {
+                nvme->admin_result = cpl;
+                sync_completion_signal(&nvme->admin_signal);
+            }
+        }
 
+        unsigned count = atomic_load(&nvme->queue_count);
+        for (unsigned n = 0; n < count; n++) {
+            if (nvme->queue[n].vector == irq->vector) {
+                io_service_queue(nvme->queue + n);
+            }
+        }
     }
     return 0;
 }
 
+// Picks the IO queue for txns submitted from the calling thread.  There
+// is no way to ask which cpu we are running on, so instead each thread
+// is given a queue in turn and keeps it, which spreads concurrent
+// clients over the queues without them contending for one lock.
+static nvme_queue_t* nvme_pick_queue(nvme_device_t* nvme) {
+    static atomic_uint next_index;
+    static thread_local unsigned index = UINT_MAX;
+    if (index == UINT_MAX) {
+        index = atomic_fetch_add(&next_index, 1);
+    }
+    return nvme->queue + (index % atomic_load(&nvme->queue_count));
+}
+
 static void nvme_queue(void* ctx, block_op_t* op, block_impl_queue_callback completion_cb,
                        void* cookie) {
     nvme_device_t* nvme = ctx;
@@ -535,27 +614,41 @@ static void nvme_queue(void* ctx, block_op_t* op, block_impl_queue_callback comp
         txn->opcode = NVME_OP_WRITE;
         break;
     case BLOCK_OP_FLUSH:
-        // TODO
-        txn_complete(txn, ZX_OK);
-        return;
+        // Without a volatile write cache, completed writes are
+        // already durable and there is nothing to flush.
+        if (!(nvme->flags & FLAG_HAS_VWC)) {
+            txn_complete(txn, ZX_OK);
+            return;
+        }
+        txn->opcode = NVME_OP_FLUSH;
+        break;
     default:
         txn_complete(txn, ZX_ERR_NOT_SUPPORTED);
         return;
     }
 
-    if (txn->op.rw.length == 0) {
-        txn_complete(txn, ZX_ERR_INVALID_ARGS);
-        return;
-    }
-    // Transaction must fit within device
-    if ((txn->op.rw.offset_dev >= nvme->info.block_count) ||
-        (nvme->info.block_count - txn->op.rw.offset_dev < txn->op.rw.length)) {
-        txn_complete(txn, ZX_ERR_OUT_OF_RANGE);
-        return;
-    }
+    if (txn->opcode == NVME_OP_FLUSH) {
+        // A flush is a single command without data.  Its rw fields
+        // are only used to track progress: with no blocks left to
+        // transfer, it is active as soon as its command is queued.
+        txn->op.rw.length = 0;
+        txn->op.rw.offset_dev = 0;
+        txn->op.rw.offset_vmo = 0;
+    } else {
+        if (txn->op.rw.length == 0) {
+            txn_complete(txn, ZX_ERR_INVALID_ARGS);
+            return;
+        }
+        // Transaction must fit within device
+        if ((txn->op.rw.offset_dev >= nvme->info.block_count) ||
+            (nvme->info.block_count - txn->op.rw.offset_dev < txn->op.rw.length)) {
+            txn_complete(txn, ZX_ERR_OUT_OF_RANGE);
+            return;
+        }
 
-    // convert vmo offset to a byte offset
-    txn->op.rw.offset_vmo *= nvme->info.block_size;
+        // convert vmo offset to a byte offset
+        txn->op.rw.offset_vmo *= nvme->info.block_size;
+    }
 
     txn->pending_utxns = 0;
     txn->flags = 0;
@@ -564,11 +657,17 @@ static void nvme_queue(void* ctx, block_op_t* op, block_impl_queue_callback comp
            txn->opcode == NVME_OP_WRITE ? "wr" : "rd",
            txn->op.rw.length + 1U, txn->op.rw.offset_dev);
 
-    mtx_lock(&nvme->lock);
-    list_add_tail(&nvme->pending_txns, &txn->node);
-    mtx_unlock(&nvme->lock);
+    // Submit directly from the caller's thread; the irq threads pick up
+    // whatever does not fit in the queue as completions free up room.
+    nvme_queue_t* q = nvme_pick_queue(nvme);
+    list_node_t done = LIST_INITIAL_VALUE(done);
 
-    sync_completion_signal(&nvme->io_signal);
+    mtx_lock(&q->lock);
+    list_add_tail(&q->pending_txns, &txn->node);
+    io_process_txns(q, &done);
+    mtx_unlock(&q->lock);
+
+    txns_complete(&done);
 }
 
 static void nvme_query(void* ctx, block_info_t* info_out, size_t* block_op_size_out) {
@@ -614,34 +713,50 @@ static void nvme_release(void* ctx) {
 
     zxlogf(INFO, "nvme: release\n");
     nvme->flags |= FLAG_SHUTDOWN;
+
+    // destroying the interrupts wakes their threads with an error; they ring
+    // doorbells through the mmio mapping, so join them before it goes away
+    for (unsigned n = 0; n < nvme->irq_count; n++) {
+        nvme_irq_t* irq = nvme->irq + n;
+        zx_interrupt_destroy(irq->irqh);
+        if (irq->thread_started) {
+            thrd_join(irq->thread, &r);
+        }
+        zx_handle_close(irq->irqh);
+    }
+
     if (nvme->mmio.vmo != ZX_HANDLE_INVALID) {
         pci_enable_bus_master(&nvme->pci, false);
-        zx_handle_close(nvme->bti);
-        mmio_buffer_release(&nvme->mmio);
-        // TODO: risks a handle use-after-close, will be resolved by IRQ api
-        // changes coming soon
-        zx_handle_close(nvme->irqh);
-    }
-    if (nvme->flags & FLAG_IRQ_THREAD_STARTED) {
-        thrd_join(nvme->irqthread, &r);
-    }
-    if (nvme->flags & FLAG_IO_THREAD_STARTED) {
-        sync_completion_signal(&nvme->io_signal);
-        thrd_join(nvme->iothread, &r);
     }
 
     // error out any pending txns
-    mtx_lock(&nvme->lock);
-    nvme_txn_t* txn;
-    while ((txn = list_remove_head_type(&nvme->active_txns, nvme_txn_t, node)) != NULL) {
-        txn_complete(txn, ZX_ERR_PEER_CLOSED);
+    unsigned count = atomic_load(&nvme->queue_count);
+    for (unsigned n = 0; n < count; n++) {
+        nvme_queue_t* q = nvme->queue + n;
+        list_node_t done = LIST_INITIAL_VALUE(done);
+        nvme_txn_t* txn;
+
+        mtx_lock(&q->lock);
+        while ((txn = list_remove_head_type(&q->active_txns, nvme_txn_t, node)) != NULL) {
+            txn_done(txn, ZX_ERR_PEER_CLOSED, &done);
+        }
+        while ((txn = list_remove_head_type(&q->pending_txns, nvme_txn_t, node)) != NULL) {
+            txn_done(txn, ZX_ERR_PEER_CLOSED, &done);
+        }
+        mtx_unlock(&q->lock);
+
+        txns_complete(&done);
     }
-    while ((txn = list_remove_head_type(&nvme->pending_txns, nvme_txn_t, node)) != NULL) {
-        txn_complete(txn, ZX_ERR_PEER_CLOSED);
+    for (unsigned n = 0; n < MAX_IO_QUEUES; n++) {
+        io_buffer_release(&nvme->queue[n].ring_iob);
+        io_buffer_release(&nvme->queue[n].utxn_iob);
     }
-    mtx_unlock(&nvme->lock);
-
     io_buffer_release(&nvme->iob);
+
+    if (nvme->mmio.vmo != ZX_HANDLE_INVALID) {
+        mmio_buffer_release(&nvme->mmio);
+        zx_handle_close(nvme->bti);
+    }
     free(nvme);
 }
 
@@ -690,12 +805,9 @@ static void infostring(const char* prefix, uint8_t* str, size_t len) {
 // dedicated pages from the page pool
 #define IDX_ADMIN_SQ   0
 #define IDX_ADMIN_CQ   1
-#define IDX_IO_SQ      2
-#define IDX_IO_CQ      3
-#define IDX_SCRATCH    4
-#define IDX_UTXN_POOL  5 // this must always be last
+#define IDX_SCRATCH    2
 
-#define IO_PAGE_COUNT  (IDX_UTXN_POOL + UTXN_COUNT)
+#define IO_PAGE_COUNT  3
 
 static inline uint64_t U64(uint8_t* x) {
     return *((uint64_t*) (void*) x);
@@ -709,9 +821,141 @@ static inline uint32_t U16(uint8_t* x) {
 
 #define WAIT_MS 5000
 
+// Allocates the rings and utxn pool of IO queue pair |n| and creates its
+// completion and submission queues on the controller.
+static zx_status_t nvme_create_io_queue(nvme_device_t* nvme, unsigned n) {
+    nvme_queue_t* q = nvme->queue + n;
+    q->nvme = nvme;
+    q->id = n + 1;
+    q->vector = n % nvme->irq_count;
+    q->entries = MIN(IO_QUEUE_ENTRIES, NVME_CAP_MQES(nvme->cap) + 1);
+
+    // The rings are allocated physically contiguous, so we need not
+    // care whether the controller requires it (CAP.CQR).
+    size_t sq_bytes = ROUNDUP(q->entries * sizeof(nvme_cmd_t), PAGE_SIZE);
+    size_t cq_bytes = ROUNDUP(q->entries * sizeof(nvme_cpl_t), PAGE_SIZE);
+    unsigned utxn_count = q->entries - 1;
+    zx_status_t r;
+    if (io_buffer_init(&q->ring_iob, nvme->bti, sq_bytes + cq_bytes,
+                       IO_BUFFER_RW | IO_BUFFER_CONTIG) ||
+        io_buffer_init(&q->utxn_iob, nvme->bti, PAGE_SIZE * utxn_count, IO_BUFFER_RW) ||
+        io_buffer_physmap(&q->utxn_iob)) {
+        zxlogf(ERROR, "nvme: could not allocate io buffers for queue %u\n", q->id);
+        r = ZX_ERR_NO_MEMORY;
+        goto fail;
+    }
+
+    // initialize the microtransaction pool
+    for (unsigned i = 0; i < utxn_count; i++) {
+        q->utxn[i].id = i;
+        q->utxn[i].phys = q->utxn_iob.phys_list[i];
+        q->utxn[i].virt = q->utxn_iob.virt + i * PAGE_SIZE;
+        q->utxn_avail[i / 64] |= 1ULL << (i % 64);
+    }
+
+    // registers and buffers for the queue pair
+    q->sq_tail_db = nvme->mmio.vaddr + NVME_REG_SQnTDBL(q->id, nvme->cap);
+    q->cq_head_db = nvme->mmio.vaddr + NVME_REG_CQnHDBL(q->id, nvme->cap);
+
+    q->sq = io_buffer_virt(&q->ring_iob);
+    q->sq_head = 0;
+    q->sq_tail = 0;
+
+    q->cq = io_buffer_virt(&q->ring_iob) + sq_bytes;
+    q->cq_head = 0;
+    q->cq_toggle = 1;
+
+    nvme_cmd_t cmd;
+
+    // create the IO completion queue
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cmd = NVME_CMD_CID(0) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_ADMIN_OP_CREATE_IOCQ);
+    cmd.dptr.prp[0] = io_buffer_phys(&q->ring_iob) + sq_bytes;
+    cmd.u.raw[0] = NVME_QUEUE_QSIZE(q->entries - 1) | NVME_QUEUE_QID(q->id);
+    cmd.u.raw[1] = NVME_IOCQ_IV(q->vector) | NVME_IOCQ_IEN | NVME_QUEUE_PC;
+
+    if (nvme_admin_txn(nvme, &cmd, NULL) != ZX_OK) {
+        zxlogf(ERROR, "nvme: completion queue %u creation op failed\n", q->id);
+        r = ZX_ERR_INTERNAL;
+        goto fail;
+    }
+
+    // create the IO submit queue
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cmd = NVME_CMD_CID(0) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_ADMIN_OP_CREATE_IOSQ);
+    cmd.dptr.prp[0] = io_buffer_phys(&q->ring_iob);
+    cmd.u.raw[0] = NVME_QUEUE_QSIZE(q->entries - 1) | NVME_QUEUE_QID(q->id);
+    cmd.u.raw[1] = NVME_IOSQ_CQID(q->id) | NVME_QUEUE_PC; // qprio 0 (urgent, unused by RR)
+
+    if (nvme_admin_txn(nvme, &cmd, NULL) != ZX_OK) {
+        zxlogf(ERROR, "nvme: submit queue %u creation op failed\n", q->id);
+
+        // the controller owns the completion ring until it is deleted
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.cmd = NVME_CMD_CID(0) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_ADMIN_OP_DELETE_IOCQ);
+        cmd.u.raw[0] = NVME_QUEUE_QID(q->id);
+        if (nvme_admin_txn(nvme, &cmd, NULL) != ZX_OK) {
+            zxlogf(ERROR, "nvme: completion queue %u deletion op failed\n", q->id);
+            return ZX_ERR_INTERNAL;
+        }
+        r = ZX_ERR_INTERNAL;
+        goto fail;
+    }
+    return ZX_OK;
+
+fail:
+    // a queue other than the first is simply left out, so give its buffers
+    // back now rather than at release
+    io_buffer_release(&q->ring_iob);
+    io_buffer_release(&q->utxn_iob);
+    memset(q->utxn_avail, 0, sizeof(q->utxn_avail));
+    return r;
+}
+
+// Negotiates the number of IO queue pairs with the controller, aiming for
+// one per cpu, and creates them.  Only failing to create the first one is
+// fatal; otherwise we carry on with the queues we have.
+static zx_status_t nvme_create_io_queues(nvme_device_t* nvme) {
+    unsigned want = MIN(zx_system_get_num_cpus(), MAX_IO_QUEUES);
+
+    // set feature (number of queues), which counts from zero
+    nvme_cmd_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cmd = NVME_CMD_CID(0) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_ADMIN_OP_SET_FEATURE);
+    cmd.u.raw[0] = NVME_FEATURE_NUMBER_OF_QUEUES;
+    cmd.u.raw[1] = NVME_FEATURE_NSQR(want - 1) | NVME_FEATURE_NCQR(want - 1);
+
+    nvme_cpl_t cpl;
+    if (nvme_admin_txn(nvme, &cmd, &cpl) != ZX_OK) {
+        zxlogf(ERROR, "nvme: set feature (number queues) op failed\n");
+        return ZX_ERR_INTERNAL;
+    }
+    unsigned nsqa = NVME_FEATURE_NSQA(cpl.cmd) + 1;
+    unsigned ncqa = NVME_FEATURE_NCQA(cpl.cmd) + 1;
+    zxlogf(INFO, "nvme: io queues: requested %u, allocated %u sq / %u cq\n", want, nsqa, ncqa);
+    want = MIN(want, MIN(nsqa, ncqa));
+
+    for (unsigned n = 0; n < want; n++) {
+        zx_status_t r;
+        if ((r = nvme_create_io_queue(nvme, n)) != ZX_OK) {
+            if (n == 0) {
+                return r;
+            }
+            zxlogf(ERROR, "nvme: continuing with %u io queues\n", n);
+            break;
+        }
+        // the irq threads may service the queue from here on
+        atomic_store(&nvme->queue_count, n + 1);
+    }
+    zxlogf(INFO, "nvme: %u io queues, %u entries each, on %u irqs\n",
+           atomic_load(&nvme->queue_count), nvme->queue[0].entries, nvme->irq_count);
+    return ZX_OK;
+}
+
 static zx_status_t nvme_init(nvme_device_t* nvme) {
     uint32_t n = rd32(VS);
     uint64_t cap = rd64(CAP);
+    nvme->cap = cap;
 
     zxlogf(INFO, "nvme: version %d.%d.%d\n", n >> 16, (n >> 8) & 0xFF, n & 0xFF);
     zxlogf(INFO, "nvme: page size: (MPSMIN): %u (MPSMAX): %u\n",
@@ -731,7 +975,7 @@ static zx_status_t nvme_init(nvme_device_t* nvme) {
         zxlogf(ERROR, "nvme: minimum page size larger than platform page size\n");
         return ZX_ERR_NOT_SUPPORTED;
     }
-    // allocate pages for various queues and the utxn scatter lists
+    // allocate pages for the admin queues and commands
     // TODO: these should all be RO to hardware apart from the scratch io page(s)
     if (io_buffer_init(&nvme->iob, nvme->bti, PAGE_SIZE * IO_PAGE_COUNT, IO_BUFFER_RW) ||
         io_buffer_physmap(&nvme->iob)) {
@@ -739,14 +983,6 @@ static zx_status_t nvme_init(nvme_device_t* nvme) {
         return ZX_ERR_NO_MEMORY;
     }
 
-    // initialize the microtransaction pool
-    nvme->utxn_avail = 0x7FFFFFFFFFFFFFFFULL;
-    for (unsigned n = 0; n < UTXN_COUNT; n++) {
-        nvme->utxn[n].id = n;
-        nvme->utxn[n].phys = nvme->iob.phys_list[IDX_UTXN_POOL + n];
-        nvme->utxn[n].virt = nvme->iob.virt + (IDX_UTXN_POOL + n) * PAGE_SIZE;
-    }
-
     if (rd32(CSTS) & NVME_CSTS_RDY) {
         zxlogf(INFO, "nvme: controller is active. resetting...\n");
         wr32(rd32(CC) & ~NVME_CC_EN, CC); // disable
@@ -796,32 +1032,19 @@ static zx_status_t nvme_init(nvme_device_t* nvme) {
     nvme->admin_cq_head = 0;
     nvme->admin_cq_toggle = 1;
 
-    // registers and buffers for IO queues
-    nvme->io_sq_tail_db = nvme->mmio.vaddr + NVME_REG_SQnTDBL(1, cap);
-    nvme->io_cq_head_db = nvme->mmio.vaddr + NVME_REG_CQnHDBL(1, cap);
-
-    nvme->io_sq = nvme->iob.virt + PAGE_SIZE * IDX_IO_SQ;
-    nvme->io_sq_head = 0;
-    nvme->io_sq_tail = 0;
-
-    nvme->io_cq = nvme->iob.virt + PAGE_SIZE * IDX_IO_CQ;
-    nvme->io_cq_head = 0;
-    nvme->io_cq_toggle = 1;
-
     // scratch page for admin ops
     void* scratch = nvme->iob.virt + PAGE_SIZE * IDX_SCRATCH;
 
-    if (thrd_create_with_name(&nvme->irqthread, irq_thread, nvme, "nvme-irq-thread")) {
-        zxlogf(ERROR, "nvme; cannot create irq thread\n");
-        return ZX_ERR_INTERNAL;
-    }
-    nvme->flags |= FLAG_IRQ_THREAD_STARTED;
-
-    if (thrd_create_with_name(&nvme->iothread, io_thread, nvme, "nvme-io-thread")) {
-        zxlogf(ERROR, "nvme; cannot create io thread\n");
-        return ZX_ERR_INTERNAL;
+    for (unsigned i = 0; i < nvme->irq_count; i++) {
+        nvme_irq_t* irq = nvme->irq + i;
+        char name[ZX_MAX_NAME_LEN];
+        snprintf(name, sizeof(name), "nvme-irq-thread-%u", i);
+        if (thrd_create_with_name(&irq->thread, irq_thread, irq, name)) {
+            zxlogf(ERROR, "nvme; cannot create irq thread\n");
+            return ZX_ERR_INTERNAL;
+        }
+        irq->thread_started = true;
     }
-    nvme->flags |= FLAG_IO_THREAD_STARTED;
 
     nvme_cmd_t cmd;
 
@@ -899,41 +1122,9 @@ static zx_status_t nvme_init(nvme_device_t* nvme) {
     FEATURE(ONCS, WRITE_UNCORRECTABLE);
     FEATURE(ONCS, COMPARE);
 
-    // set feature (number of queues) to 1 iosq and 1 iocq
-    memset(&cmd, 0, sizeof(cmd));
-    cmd.cmd = NVME_CMD_CID(0) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_ADMIN_OP_SET_FEATURE);
-    cmd.u.raw[0] = NVME_FEATURE_NUMBER_OF_QUEUES;
-    cmd.u.raw[1] = 0;
-
-    nvme_cpl_t cpl;
-    if (nvme_admin_txn(nvme, &cmd, &cpl) != ZX_OK) {
-        zxlogf(ERROR, "nvme: set feature (number queues) op failed\n");
-        return ZX_ERR_INTERNAL;
-    }
-    zxlogf(INFO,"cpl.cmd %08x\n", cpl.cmd);
-
-    // create the IO completion queue
-    memset(&cmd, 0, sizeof(cmd));
-    cmd.cmd = NVME_CMD_CID(0) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_ADMIN_OP_CREATE_IOCQ);
-    cmd.dptr.prp[0] = nvme->iob.phys_list[IDX_IO_CQ];
-    cmd.u.raw[0] = ((CQMAX - 1) << 16) | 1; // queue size, queue id
-    cmd.u.raw[1] = (0 << 16) | 2 | 1; // irq vector, irq enable, phys contig
-
-    if (nvme_admin_txn(nvme, &cmd, NULL) != ZX_OK) {
-        zxlogf(ERROR, "nvme: completion queue creation op failed\n");
-        return ZX_ERR_INTERNAL;
-    }
-
-    // create the IO submit queue
-    memset(&cmd, 0, sizeof(cmd));
-    cmd.cmd = NVME_CMD_CID(0) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_ADMIN_OP_CREATE_IOSQ);
-    cmd.dptr.prp[0] = nvme->iob.phys_list[IDX_IO_SQ];
-    cmd.u.raw[0] = ((SQMAX - 1) << 16) | 1; // queue size, queue id
-    cmd.u.raw[1] = (1 << 16) | 0 | 1; // cqid, qprio, phys contig
-
-    if (nvme_admin_txn(nvme, &cmd, NULL) != ZX_OK) {
-        zxlogf(ERROR, "nvme: submit queue creation op failed\n");
-        return ZX_ERR_INTERNAL;
+    zx_status_t r;
+    if ((r = nvme_create_io_queues(nvme)) != ZX_OK) {
+        return r;
     }
 
     // identify namespace 1
@@ -1017,9 +1208,11 @@ static zx_status_t nvme_bind(void* ctx, zx_device_t* dev) {
     if ((nvme = calloc(1, sizeof(nvme_device_t))) == NULL) {
         return ZX_ERR_NO_MEMORY;
     }
-    list_initialize(&nvme->pending_txns);
-    list_initialize(&nvme->active_txns);
-    mtx_init(&nvme->lock, mtx_plain);
+    for (unsigned n = 0; n < MAX_IO_QUEUES; n++) {
+        list_initialize(&nvme->queue[n].pending_txns);
+        list_initialize(&nvme->queue[n].active_txns);
+        mtx_init(&nvme->queue[n].lock, mtx_plain);
+    }
     mtx_init(&nvme->admin_lock, mtx_plain);
 
     if (device_get_protocol(dev, ZX_PROTOCOL_PCI, &nvme->pci)) {
@@ -1035,10 +1228,20 @@ static zx_status_t nvme_bind(void* ctx, zx_device_t* dev) {
         ZX_PCIE_IRQ_MODE_MSI_X, ZX_PCIE_IRQ_MODE_MSI, ZX_PCIE_IRQ_MODE_LEGACY,
     };
     uint32_t nirq = 0;
+    uint32_t count = 0;
     for (unsigned n = 0; n < countof(modes); n++) {
-        if ((pci_query_irq_mode(&nvme->pci, modes[n], &nirq) == ZX_OK) &&
-            (pci_set_irq_mode(&nvme->pci, modes[n], 1) == ZX_OK)) {
-            zxlogf(INFO, "nvme: irq mode %u, irq count %u (#%u)\n", modes[n], nirq, n);
+        if (pci_query_irq_mode(&nvme->pci, modes[n], &nirq) != ZX_OK) {
+            continue;
+        }
+        // With MSI-X, ask for a vector per IO queue so that completions
+        // are spread over several threads.  Otherwise all queues share one.
+        count = 1;
+        if (modes[n] == ZX_PCIE_IRQ_MODE_MSI_X) {
+            count = MIN(nirq, MIN(zx_system_get_num_cpus(), MAX_IRQS));
+        }
+        if (pci_set_irq_mode(&nvme->pci, modes[n], count) == ZX_OK) {
+            zxlogf(INFO, "nvme: irq mode %u, irq count %u, using %u (#%u)\n",
+                   modes[n], nirq, count, n);
             goto irq_configured;
         }
     }
@@ -1046,9 +1249,18 @@ static zx_status_t nvme_bind(void* ctx, zx_device_t* dev) {
     goto fail;
 
 irq_configured:
-    if (pci_map_interrupt(&nvme->pci, 0, &nvme->irqh) != ZX_OK) {
-        zxlogf(ERROR, "nvme: could not map irq\n");
-        goto fail;
+    for (unsigned n = 0; n < count; n++) {
+        nvme_irq_t* irq = nvme->irq + n;
+        if (pci_map_interrupt(&nvme->pci, n, &irq->irqh) != ZX_OK) {
+            zxlogf(ERROR, "nvme: could not map irq %u\n", n);
+            if (n == 0) {
+                goto fail;
+            }
+            break;
+        }
+        irq->nvme = nvme;
+        irq->vector = n;
+        nvme->irq_count++;
     }
     if (pci_enable_bus_master(&nvme->pci, true)) {
         zxlogf(ERROR, "nvme: cannot enable bus mastering\n");
@@ -19,3 +19,31 @@ MODULE_BANJO_LIBS := \
     system/banjo/ddk-protocol-pci \
 
 include make/module.mk
+
+MODULE := $(LOCAL_DIR).test
+
+MODULE_NAME := nvme-test
+
+MODULE_TYPE := usertest
+
+MODULE_SRCS := \
+    $(LOCAL_DIR)/nvme.c \
+    $(LOCAL_DIR)/nvme-test.cpp \
+
+MODULE_STATIC_LIBS := \
+    system/ulib/ddk \
+    system/ulib/fbl \
+    system/ulib/sync \
+    system/ulib/zx \
+    system/ulib/zxcpp \
+
+MODULE_LIBS := \
+    system/ulib/c \
+    system/ulib/unittest \
+    system/ulib/zircon \
+
+MODULE_BANJO_LIBS := \
+    system/banjo/ddk-protocol-block \
+    system/banjo/ddk-protocol-pci \
+
+include make/module.mk
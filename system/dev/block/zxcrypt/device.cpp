@@ -22,6 +22,7 @@
 #include <zircon/device/block.h>
 #include <zircon/errors.h>
 #include <zircon/status.h>
+#include <zircon/syscalls.h>
 #include <zircon/thread_annotations.h>
 #include <zircon/types.h>
 #include <zxcrypt/volume.h>
@@ -160,13 +161,17 @@ zx_status_t Device::Init() {
         return rc;
     }
 
-    // Start workers
-    // TODO(aarongreen): Investigate performance implications of adding more workers.
+    // Start workers.  Cryptographic transformations are CPU bound, so run one worker per CPU; each
+    // takes requests off the shared port in batches.
     if ((rc = zx::port::create(0, &port_)) != ZX_OK) {
         zxlogf(ERROR, "zx::port::create failed: %s\n", zx_status_get_string(rc));
         return rc;
     }
-    for (size_t i = 0; i < kNumWorkers; ++i) {
+    size_t num_workers = zx_system_get_num_cpus();
+    if (num_workers > kMaxWorkers) {
+        num_workers = kMaxWorkers;
+    }
+    for (size_t i = 0; i < num_workers; ++i) {
         zx::port port;
         port_.duplicate(ZX_RIGHT_SAME_RIGHTS, &port);
         if ((rc = workers_[i].Start(this, *volume, std::move(port))) != ZX_OK) {
@@ -175,6 +180,7 @@ zx_status_t Device::Init() {
         }
         ++info->num_workers;
     }
+    zxlogf(TRACE, "zxcrypt device %p started %u workers\n", this, info->num_workers);
 
     // |info_| now holds the pointer; it is reclaimed in |DdkRelease|.
     DeviceInfo* released __attribute__((unused)) = info.release();
@@ -81,9 +81,8 @@ public:
 private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Device);
 
-    // TODO(aarongreen): Investigate performance impact of changing this.
-    // Number of encrypting/decrypting workers
-    static const size_t kNumWorkers = 2;
+    // Maximum number of encrypting/decrypting workers.  |Init| starts one per CPU, up to this many.
+    static const size_t kMaxWorkers = 16;
 
     // Adds |block| to the write queue if not null, and sends to the workers as many write requests
     // as fit in the space available in the write buffer.
@@ -139,7 +138,7 @@ private:
     thrd_t init_;
 
     // Threads that performs encryption/decryption.
-    Worker workers_[kNumWorkers];
+    Worker workers_[kMaxWorkers];
 
     // Port used to send write/read operations to be encrypted/decrypted.
     zx::port port_;
@@ -75,69 +75,144 @@ zx_status_t Worker::Run() {
     ZX_DEBUG_ASSERT(device_);
     zx_status_t rc;
 
-    zx_port_packet_t packet;
+    zx_port_packet_t packets[kMaxBatch];
+    block_op_t* blocks[kMaxBatch];
     while (true) {
-        // Read request
-        if ((rc = port_.wait(zx::time::infinite(), &packet)) != ZX_OK) {
+        // Read a request, then any others already queued.
+        if ((rc = port_.wait(zx::time::infinite(), &packets[0])) != ZX_OK) {
             zxlogf(ERROR, "failed to read request: %s\n", zx_status_get_string(rc));
             return rc;
         }
-        ZX_DEBUG_ASSERT(packet.key == 0);
-        ZX_DEBUG_ASSERT(packet.type == ZX_PKT_TYPE_USER);
-        ZX_DEBUG_ASSERT(packet.status == ZX_OK);
+        size_t num_packets = 1;
+        while (num_packets < kMaxBatch && port_.wait(zx::time(), &packets[num_packets]) == ZX_OK) {
+            ++num_packets;
+        }
 
         // Handle control messages
-        switch (packet.user.u64[0]) {
-        case kBlockRequest:
-            break;
-        case kStopRequest:
-            zxlogf(TRACE, "worker %p stopping.\n", this);
-            return ZX_OK;
-        default:
-            zxlogf(ERROR, "unknown request: 0x%016" PRIx64 "\n", packet.user.u64[0]);
-            return ZX_ERR_NOT_SUPPORTED;
+        bool stop = false;
+        size_t num_blocks = 0;
+        for (size_t i = 0; i < num_packets; ++i) {
+            zx_port_packet_t* packet = &packets[i];
+            ZX_DEBUG_ASSERT(packet->key == 0);
+            ZX_DEBUG_ASSERT(packet->type == ZX_PKT_TYPE_USER);
+            ZX_DEBUG_ASSERT(packet->status == ZX_OK);
+
+            if (stop) {
+                // Each worker must consume exactly one stop request, so give back anything taken
+                // after ours.
+                port_.queue(packet);
+                continue;
+            }
+            switch (packet->user.u64[0]) {
+            case kBlockRequest:
+                blocks[num_blocks++] = reinterpret_cast<block_op_t*>(packet->user.u64[1]);
+                break;
+            case kStopRequest:
+                zxlogf(TRACE, "worker %p stopping.\n", this);
+                stop = true;
+                break;
+            default:
+                zxlogf(ERROR, "unknown request: 0x%016" PRIx64 "\n", packet->user.u64[0]);
+                return ZX_ERR_NOT_SUPPORTED;
+            }
         }
 
-        // Dispatch block request
-        block_op_t* block = reinterpret_cast<block_op_t*>(packet.user.u64[1]);
-        switch (block->command & BLOCK_OP_MASK) {
-        case BLOCK_OP_WRITE:
-            device_->BlockForward(block, EncryptWrite(block));
-            break;
+        // Dispatch block requests, transforming adjacent ones together
+        for (size_t i = 0; i < num_blocks;) {
+            size_t num = CountAdjacent(&blocks[i], num_blocks - i);
+            switch (blocks[i]->command & BLOCK_OP_MASK) {
+            case BLOCK_OP_WRITE:
+                rc = EncryptWrite(&blocks[i], num);
+                for (size_t j = 0; j < num; ++j) {
+                    device_->BlockForward(blocks[i + j], rc);
+                }
+                break;
+
+            case BLOCK_OP_READ:
+                rc = DecryptRead(&blocks[i], num);
+                for (size_t j = 0; j < num; ++j) {
+                    device_->BlockComplete(blocks[i + j], rc);
+                }
+                break;
+
+            default:
+                device_->BlockComplete(blocks[i], ZX_ERR_NOT_SUPPORTED);
+            }
+            i += num;
+        }
 
-        case BLOCK_OP_READ:
-            device_->BlockComplete(block, DecryptRead(block));
-            break;
+        if (stop) {
+            return ZX_OK;
+        }
+    }
+}
 
-        default:
-            device_->BlockComplete(block, ZX_ERR_NOT_SUPPORTED);
+size_t Worker::CountAdjacent(block_op_t** blocks, size_t num) const {
+    uint32_t op = blocks[0]->command & BLOCK_OP_MASK;
+    if (op != BLOCK_OP_WRITE && op != BLOCK_OP_READ) {
+        return 1;
+    }
+    size_t i = 1;
+    for (; i < num; ++i) {
+        block_op_t* prev = blocks[i - 1];
+        block_op_t* next = blocks[i];
+        if ((next->command & BLOCK_OP_MASK) != op ||
+            next->rw.offset_dev != prev->rw.offset_dev + prev->rw.length) {
+            break;
+        }
+        if (op == BLOCK_OP_WRITE) {
+            // Writes are copied to the write buffer, so must be adjacent there.
+            uint8_t* prev_data = BlockToExtra(prev, device_->op_size())->data;
+            uint8_t* next_data = BlockToExtra(next, device_->op_size())->data;
+            if (next_data != prev_data + prev->rw.length * device_->block_size()) {
+                break;
+            }
+        } else {
+            // Reads are decrypted in place, so must be adjacent in the same VMO.
+            if (next->rw.vmo != prev->rw.vmo ||
+                next->rw.offset_vmo != prev->rw.offset_vmo + prev->rw.length) {
+                break;
+            }
         }
     }
+    return i;
 }
 
-zx_status_t Worker::EncryptWrite(block_op_t* block) {
-    LOG_ENTRY_ARGS("block=%p", block);
+zx_status_t Worker::EncryptWrite(block_op_t** blocks, size_t num) {
+    LOG_ENTRY_ARGS("blocks=%p, num=%zu", blocks, num);
     zx_status_t rc;
 
-    // Convert blocks to bytes
-    extra_op_t* extra = BlockToExtra(block, device_->op_size());
-    uint32_t length;
-    uint64_t offset_dev, offset_vmo;
-    if (mul_overflow(block->rw.length, device_->block_size(), &length) ||
-        mul_overflow(block->rw.offset_dev, device_->block_size(), &offset_dev) ||
-        mul_overflow(extra->offset_vmo, device_->block_size(), &offset_vmo)) {
-        zxlogf(ERROR,
-               "overflow; length=%" PRIu32 "; offset_dev=%" PRIu64 "; offset_vmo=%" PRIu64 "\n",
-               block->rw.length, block->rw.offset_dev, extra->offset_vmo);
-        return ZX_ERR_OUT_OF_RANGE;
+    // Copy the plaintext of each request
+    size_t total = 0;
+    for (size_t i = 0; i < num; ++i) {
+        block_op_t* block = blocks[i];
+
+        // Convert blocks to bytes
+        extra_op_t* extra = BlockToExtra(block, device_->op_size());
+        uint32_t length;
+        uint64_t offset_vmo;
+        if (mul_overflow(block->rw.length, device_->block_size(), &length) ||
+            mul_overflow(extra->offset_vmo, device_->block_size(), &offset_vmo)) {
+            zxlogf(ERROR, "overflow; length=%" PRIu32 "; offset_vmo=%" PRIu64 "\n",
+                   block->rw.length, extra->offset_vmo);
+            return ZX_ERR_OUT_OF_RANGE;
+        }
+
+        if ((rc = zx_vmo_read(extra->vmo, extra->data, offset_vmo, length)) != ZX_OK) {
+            zxlogf(ERROR, "zx_vmo_read() failed: %s\n", zx_status_get_string(rc));
+            return rc;
+        }
+        total += length;
     }
 
-    // Copy and encrypt the plaintext
-    if ((rc = zx_vmo_read(extra->vmo, extra->data, offset_vmo, length)) != ZX_OK) {
-        zxlogf(ERROR, "zx_vmo_read() failed: %s\n", zx_status_get_string(rc));
-        return rc;
+    // Encrypt them all at once
+    uint64_t offset_dev;
+    if (mul_overflow(blocks[0]->rw.offset_dev, device_->block_size(), &offset_dev)) {
+        zxlogf(ERROR, "overflow; offset_dev=%" PRIu64 "\n", blocks[0]->rw.offset_dev);
+        return ZX_ERR_OUT_OF_RANGE;
     }
-    if ((rc = encrypt_.Encrypt(extra->data, offset_dev, length, extra->data) != ZX_OK)) {
+    uint8_t* data = BlockToExtra(blocks[0], device_->op_size())->data;
+    if ((rc = encrypt_.Encrypt(data, offset_dev, total, data)) != ZX_OK) {
         zxlogf(ERROR, "failed to encrypt: %s\n", zx_status_get_string(rc));
         return rc;
     }
@@ -145,19 +220,24 @@ zx_status_t Worker::EncryptWrite(block_op_t* block) {
     return ZX_OK;
 }
 
-zx_status_t Worker::DecryptRead(block_op_t* block) {
-    LOG_ENTRY_ARGS("block=%p", block);
+zx_status_t Worker::DecryptRead(block_op_t** blocks, size_t num) {
+    LOG_ENTRY_ARGS("blocks=%p, num=%zu", blocks, num);
     zx_status_t rc;
 
     // Convert blocks to bytes
-    uint32_t length;
+    block_op_t* block = blocks[0];
+    uint64_t num_blocks = 0;
+    for (size_t i = 0; i < num; ++i) {
+        num_blocks += blocks[i]->rw.length;
+    }
+    size_t length;
     uint64_t offset_dev, offset_vmo;
-    if (mul_overflow(block->rw.length, device_->block_size(), &length) ||
+    if (mul_overflow(num_blocks, device_->block_size(), &length) ||
         mul_overflow(block->rw.offset_dev, device_->block_size(), &offset_dev) ||
         mul_overflow(block->rw.offset_vmo, device_->block_size(), &offset_vmo)) {
         zxlogf(ERROR,
-               "overflow; length=%" PRIu32 "; offset_dev=%" PRIu64 "; offset_vmo=%" PRIu64 "\n",
-               block->rw.length, block->rw.offset_dev, block->rw.offset_vmo);
+               "overflow; length=%" PRIu64 "; offset_dev=%" PRIu64 "; offset_vmo=%" PRIu64 "\n",
+               num_blocks, block->rw.offset_dev, block->rw.offset_vmo);
         return ZX_ERR_OUT_OF_RANGE;
     }
 
@@ -32,6 +32,9 @@ public:
     static constexpr uint64_t kBlockRequest = 0x1;
     static constexpr uint64_t kStopRequest = 0x2;
 
+    // Maximum number of requests a worker takes from the port at once.
+    static constexpr size_t kMaxBatch = 16;
+
     // Configure the given |packet| to be an |op| request, with an optional |arg|.
     static void MakeRequest(zx_port_packet_t* packet, uint64_t op, void* arg = nullptr);
 
@@ -46,17 +49,23 @@ public:
 private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Worker);
 
-    // Loop thread.  Reads an I/O request from the |port_| and dispatches it between |EncryptWrite|
-    // and |DecryptRead|.
+    // Loop thread.  Waits for an I/O request on the |port_|, takes any others already queued up to
+    // |kMaxBatch|, and dispatches them between |EncryptWrite| and |DecryptRead|.
     static int WorkerRun(void* arg) { return static_cast<Worker*>(arg)->Run(); }
     zx_status_t Run();
 
-    // Copies the plaintext data to be written to the write buffer location given in |block|'s extra
-    // information, and encrypts it before sending it to the parent device.
-    zx_status_t EncryptWrite(block_op_t* block);
+    // Returns the number of requests at the start of |blocks|, out of |num|, which can be
+    // transformed together: reads or writes that are contiguous both on the device and in memory.
+    size_t CountAdjacent(block_op_t** blocks, size_t num) const;
+
+    // Copies the plaintext data of the |num| adjacent write requests in |blocks| to the write buffer
+    // locations given in their extra information, and encrypts it before they are sent to the
+    // parent device.
+    zx_status_t EncryptWrite(block_op_t** blocks, size_t num);
 
-    // Maps the ciphertext data in |block|, and decrypts it in place before completing the block op.
-    zx_status_t DecryptRead(block_op_t* block);
+    // Maps the ciphertext data of the |num| adjacent read requests in |blocks|, and decrypts it in
+    // place before the block ops are completed.
+    zx_status_t DecryptRead(block_op_t** blocks, size_t num);
 
     // The cipher objects used to perform cryptographic.  See notes on "random access" in
     // crypto/cipher.h.
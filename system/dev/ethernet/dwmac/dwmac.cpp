@@ -307,6 +307,11 @@ void DWMacDevice::EthmacGetBti(zx::bti* bti) {
     bti_.duplicate(ZX_RIGHT_SAME_RIGHTS, bti);
 }
 
+zx_status_t DWMacDevice::EthmacQueueRx(ethmac_netbuf_t* netbuf) {
+    // Received frames are copied out of the descriptor ring; see ETHMAC_FEATURE_RX_NETBUF.
+    return ZX_ERR_NOT_SUPPORTED;
+}
+
 zx_status_t DWMacDevice::EthMacMdioWrite(uint32_t reg, uint32_t val) {
     dwmac_regs_->miidata = val;
 
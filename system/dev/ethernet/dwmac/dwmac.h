@@ -100,6 +100,7 @@ public:
     zx_status_t EthmacQueueTx(uint32_t options, ethmac_netbuf_t* netbuf) __TA_EXCLUDES(lock_);
     zx_status_t EthmacSetParam(uint32_t param, int32_t value, const void* data, size_t data_size);
     void EthmacGetBti(zx::bti* bti);
+    zx_status_t EthmacQueueRx(ethmac_netbuf_t* netbuf);
 
     // ZX_PROTOCOL_ETH_MAC ops.
     zx_status_t EthMacMdioWrite(uint32_t reg, uint32_t val);
@@ -14,6 +14,7 @@
 #include <zircon/listnode.h>
 #include <zircon/process.h>
 #include <zircon/syscalls.h>
+#include <zircon/syscalls/port.h>
 #include <zircon/thread_annotations.h>
 #include <zircon/types.h>
 
@@ -34,6 +35,15 @@ static const zx_signals_t kSignalFifoTerminate = ZX_USER_SIGNAL_0;
 // ensure that we will not exceed fifo capacity
 static_assert((FIFO_DEPTH * FIFO_ESIZE) <= 4096, "");
 
+// Longest time that a received packet is held back so that it can be written to the
+// client's rx fifo together with the packets following it.
+#define RX_FLUSH_DELAY ZX_USEC(50)
+
+// Keys of the packets handled by eth_rx_thread().
+#define RX_KEY_FLUSH (1u)    // rx_flush_deadline has been set
+#define RX_KEY_QUEUE (2u)    // rx_owner may have buffers to hand to the ethmac
+#define RX_KEY_EXIT (3u)     // the device is being released
+
 // ethernet device
 typedef struct ethdev0 {
     // shared state
@@ -53,6 +63,16 @@ typedef struct ethdev0 {
     ethmac_info_t info;
     uint32_t status;
     zx_device_t* zxdev;
+
+    // rx thread, which writes out batches of received packets and, with
+    // ETHMAC_FEATURE_RX_NETBUF, hands the rx buffers of |rx_owner| to the ethmac
+    thrd_t rx_thr;
+    zx_handle_t rx_port;
+    // when to write out the received packets held back, or ZX_TIME_INFINITE if none are
+    zx_time_t rx_flush_deadline;
+    struct ethdev* rx_owner;
+    // set while an RX_KEY_QUEUE packet is pending for |rx_owner|
+    bool rx_owner_waiting;
 } ethdev0_t;
 
 // transmit thread has been created
@@ -106,6 +126,9 @@ typedef struct ethdev {
     uint32_t rx_depth;
     fuchsia_hardware_ethernet_FifoEntry rx_entries[FIFO_BATCH_SZ];
     size_t rx_entry_count;
+    // received packets not yet written to rx_fifo
+    fuchsia_hardware_ethernet_FifoEntry rx_done[FIFO_BATCH_SZ];
+    size_t rx_done_count;
 
     // io buffer
     zx_handle_t io_vmo;
@@ -121,6 +144,14 @@ typedef struct ethdev {
     mtx_t lock;               // Protects free_tx_bufs
     list_node_t free_tx_bufs; // tx_info_t elements
 
+    // With ETHMAC_FEATURE_RX_NETBUF, FIFO_DEPTH entries, each |rx_size| large.
+    void* all_rx_bufs;
+    size_t rx_size;
+
+    // Protected by edev0->lock
+    list_node_t free_rx_bufs; // rx_info_t elements
+    size_t rx_queued;         // rx_info_t elements held by the ethmac
+
     // fifo thread
     thrd_t tx_thr;
 
@@ -150,6 +181,20 @@ static ethmac_netbuf_t* tx_info_to_netbuf(ethdev0_t* edev0, tx_info_t* tx_info)
     return (ethmac_netbuf_t*)((uintptr_t)tx_info - edev0->info.netbuf_size);
 }
 
+typedef struct rx_info {
+    struct ethdev* edev;
+    fuchsia_hardware_ethernet_FifoEntry entry;
+    list_node_t node;
+} rx_info_t;
+
+static rx_info_t* netbuf_to_rx_info(ethdev0_t* edev0, ethmac_netbuf_t* netbuf) {
+    return (rx_info_t*)((uintptr_t)netbuf + edev0->info.netbuf_size);
+}
+
+static ethmac_netbuf_t* rx_info_to_netbuf(ethdev0_t* edev0, rx_info_t* rx_info) {
+    return (ethmac_netbuf_t*)((uintptr_t)rx_info - edev0->info.netbuf_size);
+}
+
 static ssize_t eth_promisc_helper_logic_locked(ethdev_t* edev, bool req_on, uint32_t state_bit,
                                                uint32_t param_id, int32_t* requesters_count) {
     if (state_bit == 0 || state_bit & (state_bit - 1)) {
@@ -266,6 +311,75 @@ static ssize_t eth_test_clear_multicast_promisc_locked(ethdev_t* edev) {
     return status;
 }
 
+// Writes the received packets held back for |edev| to its rx fifo.
+static void eth_rx_flush_locked(ethdev_t* edev) {
+    size_t count = edev->rx_done_count;
+    if (count == 0) {
+        return;
+    }
+    edev->rx_done_count = 0;
+    if (edev->rx_fifo == ZX_HANDLE_INVALID) {
+        return;
+    }
+
+    zx_status_t status;
+    size_t actual;
+    if ((status = zx_fifo_write(edev->rx_fifo, sizeof(edev->rx_done[0]), edev->rx_done, count,
+                                &actual)) < 0) {
+        if (status == ZX_ERR_SHOULD_WAIT) {
+            if ((edev->fail_rx_write++ % FAIL_REPORT_RATE) == 0) {
+                zxlogf(ERROR, "eth [%s]: no rx_fifo space available (%u times)\n",
+                       edev->name, edev->fail_rx_write);
+            }
+        } else {
+            // Fatal, should force teardown
+            zxlogf(ERROR, "eth [%s]: rx_fifo write failed %d\n", edev->name, status);
+        }
+        return;
+    }
+    if (actual != count) {
+        zxlogf(ERROR, "eth [%s]: rx_fifo: only wrote %zu of %zu!\n", edev->name, actual, count);
+    }
+}
+
+// Writes the received packets held back for every client to their rx fifos.
+static void eth_rx_flush_all_locked(ethdev0_t* edev0) {
+    ethdev_t* edev;
+    list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
+        eth_rx_flush_locked(edev);
+    }
+    list_for_every_entry(&edev0->list_idle, edev, ethdev_t, node) {
+        eth_rx_flush_locked(edev);
+    }
+    edev0->rx_flush_deadline = ZX_TIME_INFINITE;
+}
+
+// Holds back the rx fifo entry |e| of |edev| until a batch of them can be written to the
+// rx fifo, or until RX_FLUSH_DELAY has passed.
+static void eth_rx_complete_locked(ethdev_t* edev, const fuchsia_hardware_ethernet_FifoEntry* e) {
+    ethdev0_t* edev0 = edev->edev0;
+
+    edev->rx_done[edev->rx_done_count++] = *e;
+    if (edev->rx_done_count == countof(edev->rx_done)) {
+        eth_rx_flush_locked(edev);
+    } else if (edev0->rx_flush_deadline == ZX_TIME_INFINITE) {
+        edev0->rx_flush_deadline = zx_deadline_after(RX_FLUSH_DELAY);
+        zx_port_packet_t packet = {.key = RX_KEY_FLUSH, .type = ZX_PKT_TYPE_USER};
+        zx_port_queue(edev0->rx_port, &packet);
+    }
+}
+
+// Has eth_rx_thread() call eth_rx_queue_locked() for the rx owner, unless it is already due to.
+static void eth_rx_queue_later_locked(ethdev0_t* edev0) {
+    if (edev0->rx_owner_waiting) {
+        return;
+    }
+    zx_port_packet_t packet = {.key = RX_KEY_QUEUE, .type = ZX_PKT_TYPE_USER};
+    if (zx_port_queue(edev0->rx_port, &packet) == ZX_OK) {
+        edev0->rx_owner_waiting = true;
+    }
+}
+
 static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t extra) {
     zx_status_t status;
     size_t count;
@@ -289,6 +403,11 @@ static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t
     }
 
     fuchsia_hardware_ethernet_FifoEntry* e = &edev->rx_entries[--edev->rx_entry_count];
+    if (edev == edev->edev0->rx_owner && edev->rx_queued == 0) {
+        // With no buffers held by the ethmac, no completion will have eth_rx_queue_locked()
+        // try again, so do it now that an entry it kept back has been used up.
+        eth_rx_queue_later_locked(edev->edev0);
+    }
     if ((e->offset >= edev->io_size) || ((e->length > (edev->io_size - e->offset)))) {
         // invalid offset/length. report error. drop packet
         e->length = 0;
@@ -303,18 +422,141 @@ static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t
         e->flags = fuchsia_hardware_ethernet_FIFO_RX_OK | extra;
     }
 
-    if ((status = zx_fifo_write(edev->rx_fifo, sizeof(*e), e, 1, NULL)) < 0) {
-        if (status == ZX_ERR_SHOULD_WAIT) {
-            if ((edev->fail_rx_write++ % FAIL_REPORT_RATE) == 0) {
-                zxlogf(ERROR, "eth [%s]: no rx_fifo space available (%u times)\n",
-                       edev->name, edev->fail_rx_write);
+    eth_rx_complete_locked(edev, e);
+}
+
+// Sets |*out| to the physical address of |length| bytes at |offset| in the io buffer of
+// |edev|. Returns false if they are not physically contiguous.
+static bool eth_iobuf_phys(ethdev_t* edev, size_t offset, size_t length, zx_paddr_t* out) {
+    if (length == 0) {
+        return false;
+    }
+    size_t first = offset / PAGE_SIZE;
+    size_t last = (offset + length - 1) / PAGE_SIZE;
+    for (size_t i = first; i < last; i++) {
+        if (edev->paddr_map[i + 1] != edev->paddr_map[i] + PAGE_SIZE) {
+            return false;
+        }
+    }
+    *out = edev->paddr_map[first] + (offset & PAGE_MASK);
+    return true;
+}
+
+// Hands rx buffers from the rx fifo of |edev| to the ethmac, so that it can receive packets
+// into them directly. Entries it cannot use are kept for eth_handle_rx().
+static void eth_rx_queue_locked(ethdev_t* edev) {
+    ethdev0_t* edev0 = edev->edev0;
+    fuchsia_hardware_ethernet_FifoEntry entries[FIFO_BATCH_SZ];
+    zx_status_t status;
+    size_t count;
+
+    for (;;) {
+        count = countof(entries) - edev->rx_entry_count;
+        if (count > FIFO_DEPTH - edev->rx_queued) {
+            count = FIFO_DEPTH - edev->rx_queued;
+        }
+        if (count == 0) {
+            // eth0_complete_rx() picks up again once the ethmac returns a buffer, or
+            // eth_handle_rx() once it uses up an entry kept back.
+            return;
+        }
+        if ((status = zx_fifo_read(edev->rx_fifo, sizeof(entries[0]), entries, count,
+                                   &count)) != ZX_OK) {
+            if (status == ZX_ERR_SHOULD_WAIT) {
+                zx_object_wait_async(edev->rx_fifo, edev0->rx_port, RX_KEY_QUEUE,
+                                     ZX_FIFO_READABLE, ZX_WAIT_ASYNC_ONCE);
+                edev0->rx_owner_waiting = true;
+            } else {
+                zxlogf(ERROR, "eth [%s]: rx fifo read failed %d\n", edev->name, status);
             }
-        } else {
-            // Fatal, should force teardown
-            zxlogf(ERROR, "eth [%s]: rx_fifo write failed %d\n", edev->name, status);
+            return;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            fuchsia_hardware_ethernet_FifoEntry* e = &entries[i];
+            if ((e->offset >= edev->io_size) || ((e->length > (edev->io_size - e->offset)))) {
+                e->length = 0;
+                e->flags = fuchsia_hardware_ethernet_FIFO_INVALID;
+                eth_rx_complete_locked(edev, e);
+                continue;
+            }
+            rx_info_t* rx_info = list_remove_head_type(&edev->free_rx_bufs, rx_info_t, node);
+            ZX_DEBUG_ASSERT(rx_info != NULL);
+            rx_info->entry = *e;
+            ethmac_netbuf_t* netbuf = rx_info_to_netbuf(edev0, rx_info);
+            netbuf->data_buffer = edev->io_buf + e->offset;
+            netbuf->data_size = e->length;
+            if (edev0->info.features & ETHMAC_FEATURE_DMA) {
+                status = eth_iobuf_phys(edev, e->offset, e->length, &netbuf->phys)
+                             ? ZX_OK : ZX_ERR_NOT_SUPPORTED;
+            } else {
+                status = ZX_OK;
+            }
+            if (status == ZX_OK) {
+                status = ethmac_queue_rx(&edev0->mac, netbuf);
+            }
+            if (status == ZX_OK) {
+                edev->rx_queued++;
+            } else {
+                list_add_head(&edev->free_rx_bufs, &rx_info->node);
+                edev->rx_entries[edev->rx_entry_count++] = *e;
+            }
+        }
+    }
+}
+
+// Makes |edev|, if not NULL, the client whose rx buffers are handed to the ethmac.
+static void eth_rx_set_owner_locked(ethdev0_t* edev0, ethdev_t* edev) {
+    if (edev0->rx_owner != NULL && edev0->rx_owner_waiting) {
+        zx_port_cancel(edev0->rx_port, edev0->rx_owner->rx_fifo, RX_KEY_QUEUE);
+    }
+    edev0->rx_owner = edev;
+    edev0->rx_owner_waiting = false;
+    if (edev != NULL) {
+        eth_rx_queue_later_locked(edev0);
+    }
+}
+
+static int eth_rx_thread(void* arg) {
+    ethdev0_t* edev0 = arg;
+    zx_status_t status;
+
+    for (;;) {
+        mtx_lock(&edev0->lock);
+        zx_time_t deadline = edev0->rx_flush_deadline;
+        mtx_unlock(&edev0->lock);
+
+        zx_port_packet_t packet;
+        status = zx_port_wait(edev0->rx_port, deadline, &packet);
+        if (status == ZX_ERR_TIMED_OUT) {
+            mtx_lock(&edev0->lock);
+            eth_rx_flush_all_locked(edev0);
+            mtx_unlock(&edev0->lock);
+            continue;
+        }
+        if (status != ZX_OK) {
+            zxlogf(ERROR, "eth: rx_thread: cannot wait: %d\n", status);
+            break;
+        }
+
+        switch (packet.key) {
+        case RX_KEY_FLUSH:
+            // Wait again with the new deadline.
+            break;
+        case RX_KEY_QUEUE:
+            mtx_lock(&edev0->lock);
+            edev0->rx_owner_waiting = false;
+            if (edev0->rx_owner != NULL) {
+                eth_rx_queue_locked(edev0->rx_owner);
+            }
+            mtx_unlock(&edev0->lock);
+            break;
+        case RX_KEY_EXIT:
+            return 0;
         }
-        return;
     }
+
+    return 0;
 }
 
 static void eth0_status(void* cookie, uint32_t status) {
@@ -401,10 +643,44 @@ static void eth0_complete_tx(void* cookie, ethmac_netbuf_t* netbuf, zx_status_t
     tx_fifo_write(edev, &entry, 1);
 }
 
+static void eth0_complete_rx(void* cookie, ethmac_netbuf_t* netbuf, zx_status_t status) {
+    ethdev0_t* edev0 = cookie;
+    rx_info_t* rx_info = netbuf_to_rx_info(edev0, netbuf);
+    ethdev_t* edev = rx_info->edev;
+    fuchsia_hardware_ethernet_FifoEntry entry = rx_info->entry;
+
+    mtx_lock(&edev0->lock);
+    list_add_head(&edev->free_rx_bufs, &rx_info->node);
+    edev->rx_queued--;
+
+    if (status == ZX_OK && netbuf->data_size <= entry.length) {
+        entry.length = netbuf->data_size;
+        entry.flags = fuchsia_hardware_ethernet_FIFO_RX_OK;
+
+        // The packet is already in the buffer of |edev|; every other client gets a copy.
+        ethdev_t* edev_i;
+        list_for_every_entry(&edev0->list_active, edev_i, ethdev_t, node) {
+            if (edev_i != edev) {
+                eth_handle_rx(edev_i, netbuf->data_buffer, netbuf->data_size, 0);
+            }
+        }
+    } else {
+        entry.length = 0;
+        entry.flags = 0;
+    }
+    eth_rx_complete_locked(edev, &entry);
+
+    if (edev == edev0->rx_owner) {
+        eth_rx_queue_later_locked(edev0);
+    }
+    mtx_unlock(&edev0->lock);
+}
+
 static ethmac_ifc_ops_t ethmac_ifc = {
     .status = eth0_status,
     .recv = eth0_recv,
     .complete_tx = eth0_complete_tx,
+    .complete_rx = eth0_complete_rx,
 };
 
 static void eth_tx_echo(ethdev0_t* edev0, const void* data, size_t len) {
@@ -681,6 +957,9 @@ static zx_status_t eth_start_locked(ethdev_t* edev) TA_NO_THREAD_SAFETY_ANALYSIS
         edev->state |= ETHDEV_RUNNING;
         list_delete(&edev->node);
         list_add_tail(&edev0->list_active, &edev->node);
+        if ((edev0->info.features & ETHMAC_FEATURE_RX_NETBUF) && edev0->rx_owner == NULL) {
+            eth_rx_set_owner_locked(edev0, edev);
+        }
         // TODO - After we get IGMP, don't automatically set multicast promisc true
         eth_set_multicast_promisc_locked(edev, true);
         // Trigger the status signal so the client will query the status at the start.
@@ -707,6 +986,27 @@ static zx_status_t eth_stop_locked(ethdev_t* edev) TA_NO_THREAD_SAFETY_ANALYSIS
         eth_set_promisc_locked(edev, false);
         eth_set_multicast_promisc_locked(edev, false);
         eth_rebuild_multicast_filter_locked(edev);
+        if (edev0->rx_owner == edev) {
+            eth_rx_set_owner_locked(edev0, NULL);
+            if (!list_is_empty(&edev0->list_active) && !(edev->state & ETHDEV_DEAD)) {
+                // The ethmac only gives back the rx buffers of this client when stopped, so
+                // restart it and hand it the buffers of another client instead.
+                edev0->state |= ETHDEV0_BUSY;
+                mtx_unlock(&edev0->lock);
+                ethmac_stop(&edev0->mac);
+                const ethmac_ifc_t ifc = {&ethmac_ifc, edev0};
+                zx_status_t status = ethmac_start(&edev0->mac, &ifc);
+                mtx_lock(&edev0->lock);
+                edev0->state &= ~ETHDEV0_BUSY;
+                if (status != ZX_OK) {
+                    zxlogf(ERROR, "eth [%s]: failed to restart mac: %d\n", edev->name, status);
+                } else if (!list_is_empty(&edev0->list_active)) {
+                    eth_rx_set_owner_locked(edev0,
+                                            list_peek_head_type(&edev0->list_active, ethdev_t,
+                                                                node));
+                }
+            }
+        }
         if (list_is_empty(&edev0->list_active)) {
             if (!(edev->state & ETHDEV_DEAD)) {
                 // Release the lock to allow other device operations in callback routine.
@@ -718,6 +1018,7 @@ static zx_status_t eth_stop_locked(ethdev_t* edev) TA_NO_THREAD_SAFETY_ANALYSIS
                 edev0->state &= ~ETHDEV0_BUSY;
             }
         }
+        eth_rx_flush_locked(edev);
     }
 
     return ZX_OK;
@@ -946,6 +1247,7 @@ static void eth_release(void* ctx) {
     ethdev_t* edev = ctx;
     if (edev) {
         free(edev->all_tx_bufs);
+        free(edev->all_rx_bufs);
         free(edev->paddr_map);
     }
     free(edev);
@@ -995,6 +1297,23 @@ static zx_status_t eth0_open(void* ctx, zx_device_t** out, uint32_t flags) {
     }
     mtx_init(&edev->lock, mtx_plain);
 
+    list_initialize(&edev->free_rx_bufs);
+    if (edev0->info.features & ETHMAC_FEATURE_RX_NETBUF) {
+        edev->rx_size = ROUNDUP(sizeof(rx_info_t) + edev0->info.netbuf_size, 8);
+        if ((edev->all_rx_bufs = calloc(FIFO_DEPTH, edev->rx_size)) == NULL) {
+            free(edev->all_tx_bufs);
+            free(edev);
+            return ZX_ERR_NO_MEMORY;
+        }
+        for (size_t ndx = 0; ndx < FIFO_DEPTH; ndx++) {
+            ethmac_netbuf_t* netbuf =
+                    (ethmac_netbuf_t*)((uintptr_t)edev->all_rx_bufs + (edev->rx_size * ndx));
+            rx_info_t* rx_info = netbuf_to_rx_info(edev0, netbuf);
+            rx_info->edev = edev;
+            list_add_tail(&edev->free_rx_bufs, &rx_info->node);
+        }
+    }
+
     device_add_args_t args = {
         .version = DEVICE_ADD_ARGS_VERSION,
         .name = "ethernet",
@@ -1007,6 +1326,7 @@ static zx_status_t eth0_open(void* ctx, zx_device_t** out, uint32_t flags) {
     zx_status_t status;
     if ((status = device_add(edev0->zxdev, &args, &edev->zxdev)) < 0) {
         free(edev->all_tx_bufs);
+        free(edev->all_rx_bufs);
         free(edev);
         return status;
     }
@@ -1024,6 +1344,16 @@ static void eth0_unbind(void* ctx) {
 
     mtx_lock(&edev0->lock);
 
+    // get back any rx buffers held by the ethmac before their client goes away
+    if (edev0->rx_owner != NULL) {
+        eth_rx_set_owner_locked(edev0, NULL);
+        edev0->state |= ETHDEV0_BUSY;
+        mtx_unlock(&edev0->lock);
+        ethmac_stop(&edev0->mac);
+        mtx_lock(&edev0->lock);
+        edev0->state &= ~ETHDEV0_BUSY;
+    }
+
     // tear down shared memory, fifos, and threads
     // to encourage any open instances to close
     ethdev_t* edev;
@@ -1041,6 +1371,11 @@ static void eth0_unbind(void* ctx) {
 
 static void eth0_release(void* ctx) {
     ethdev0_t* edev0 = ctx;
+    zx_port_packet_t packet = {.key = RX_KEY_EXIT, .type = ZX_PKT_TYPE_USER};
+    if (zx_port_queue(edev0->rx_port, &packet) == ZX_OK) {
+        thrd_join(edev0->rx_thr, NULL);
+    }
+    zx_handle_close(edev0->rx_port);
     free(edev0);
 }
 
@@ -1086,6 +1421,14 @@ static zx_status_t eth_bind(void* ctx, zx_device_t* dev) {
         goto fail;
     }
 
+    if ((edev0->info.features & ETHMAC_FEATURE_RX_NETBUF) &&
+        (ops->queue_rx == NULL)) {
+        zxlogf(ERROR, "eth: bind: device '%s': does not implement ops->queue_rx()\n",
+               device_get_name(dev));
+        status = ZX_ERR_NOT_SUPPORTED;
+        goto fail;
+    }
+
     if (edev0->info.netbuf_size < sizeof(ethmac_netbuf_t)) {
         zxlogf(ERROR, "eth: bind: device '%s': invalid buffer size %ld\n",
                device_get_name(dev), edev0->info.netbuf_size);
@@ -1100,6 +1443,18 @@ static zx_status_t eth_bind(void* ctx, zx_device_t* dev) {
 
     edev0->macdev = dev;
 
+    edev0->rx_flush_deadline = ZX_TIME_INFINITE;
+    if ((status = zx_port_create(0, &edev0->rx_port)) < 0) {
+        zxlogf(ERROR, "eth: bind: failed to create rx port: %d\n", status);
+        goto fail;
+    }
+    int r = thrd_create_with_name(&edev0->rx_thr, eth_rx_thread, edev0, "eth-rx-thread");
+    if (r != thrd_success) {
+        zxlogf(ERROR, "eth: bind: failed to start rx thread: %d\n", r);
+        status = ZX_ERR_INTERNAL;
+        goto fail;
+    }
+
     device_add_args_t args = {
         .version = DEVICE_ADD_ARGS_VERSION,
         .name = "ethernet",
@@ -1109,12 +1464,14 @@ static zx_status_t eth_bind(void* ctx, zx_device_t* dev) {
     };
 
     if ((status = device_add(dev, &args, &edev0->zxdev)) < 0) {
-        goto fail;
+        eth0_release(edev0);
+        return status;
     }
 
     return ZX_OK;
 
 fail:
+    zx_handle_close(edev0->rx_port);
     free(edev0);
     return status;
 }
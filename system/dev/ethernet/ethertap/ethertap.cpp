@@ -94,6 +94,7 @@ TapDevice::TapDevice(zx_device_t* device, const ethertap_ioctl_config* config, z
       data_(std::move(data)) {
     ZX_DEBUG_ASSERT(data_.is_valid());
     memcpy(mac_, config->mac, 6);
+    list_initialize(&rx_netbufs_);
 
     int ret = thrd_create_with_name(&thread_, tap_device_thread, reinterpret_cast<void*>(this),
                                     "ethertap-thread");
@@ -120,13 +121,22 @@ zx_status_t TapDevice::EthmacQuery(uint32_t options, ethmac_info_t* info) {
     info->features = features_;
     info->mtu = mtu_;
     memcpy(info->mac, mac_, 6);
-    info->netbuf_size = sizeof(ethmac_netbuf_t);
+    info->netbuf_size = sizeof(RxNetbuf);
     return ZX_OK;
 }
 
 void TapDevice::EthmacStop() {
     ethertap_trace("EthmacStop\n");
     fbl::AutoLock lock(&lock_);
+    list_node_t netbufs;
+    {
+        fbl::AutoLock rx_lock(&rx_lock_);
+        list_move(&rx_netbufs_, &netbufs);
+    }
+    RxNetbuf* rx_netbuf;
+    while ((rx_netbuf = list_remove_head_type(&netbufs, RxNetbuf, node)) != nullptr) {
+        ethmac_client_.CompleteRx(&rx_netbuf->netbuf, ZX_ERR_CANCELED);
+    }
     ethmac_client_.clear();
 }
 
@@ -218,6 +228,18 @@ void TapDevice::EthmacGetBti(zx::bti* bti) {
     bti->reset();
 }
 
+zx_status_t TapDevice::EthmacQueueRx(ethmac_netbuf_t* netbuf) {
+    // A datagram is truncated if it is read into a smaller buffer, so only take buffers which
+    // can hold any packet.
+    if (netbuf->data_size < mtu_) {
+        return ZX_ERR_BUFFER_TOO_SMALL;
+    }
+    auto rx_netbuf = reinterpret_cast<RxNetbuf*>(netbuf);
+    fbl::AutoLock rx_lock(&rx_lock_);
+    list_add_tail(&rx_netbufs_, &rx_netbuf->node);
+    return ZX_OK;
+}
+
 int TapDevice::Thread() {
     ethertap_trace("starting main thread\n");
     zx_signals_t pending;
@@ -311,19 +333,39 @@ zx_status_t TapDevice::UpdateLinkStatus(zx_signals_t observed) {
 }
 
 zx_status_t TapDevice::Recv(uint8_t* buffer, uint32_t capacity) {
+    fbl::AutoLock lock(&lock_);
+
+    // Read straight into a receive buffer if the client has queued one.
+    RxNetbuf* rx_netbuf = nullptr;
+    if (ethmac_client_.is_valid()) {
+        fbl::AutoLock rx_lock(&rx_lock_);
+        rx_netbuf = list_remove_head_type(&rx_netbufs_, RxNetbuf, node);
+    }
+    if (rx_netbuf != nullptr) {
+        buffer = static_cast<uint8_t*>(const_cast<void*>(rx_netbuf->netbuf.data_buffer));
+        capacity = static_cast<uint32_t>(rx_netbuf->netbuf.data_size);
+    }
+
     size_t actual = 0;
     zx_status_t status = data_.read(0u, buffer, capacity, &actual);
     if (status != ZX_OK) {
         zxlogf(ERROR, "ethertap: error reading data: %d\n", status);
+        if (rx_netbuf != nullptr) {
+            ethmac_client_.CompleteRx(&rx_netbuf->netbuf, status);
+        }
         return status;
     }
 
-    fbl::AutoLock lock(&lock_);
     if (unlikely(options_ & ETHERTAP_OPT_TRACE_PACKETS)) {
         ethertap_trace("received %zu bytes\n", actual);
         hexdump8_ex(buffer, actual, 0);
     }
-    if (ethmac_client_.is_valid()) {
+    if (rx_netbuf != nullptr) {
+        rx_netbuf->netbuf.data_size = actual;
+        // Signal before the frame can reach the client, so that it sees both together.
+        data_.signal_peer(0, ETHERTAP_SIGNAL_RX_NETBUF);
+        ethmac_client_.CompleteRx(&rx_netbuf->netbuf, ZX_OK);
+    } else if (ethmac_client_.is_valid()) {
         ethmac_client_.Recv(buffer, actual, 0u);
     }
     return ZX_OK;
@@ -12,6 +12,7 @@
 #include <zircon/compiler.h>
 #include <zircon/types.h>
 #include <zircon/device/ethertap.h>
+#include <zircon/listnode.h>
 #include <lib/zx/socket.h>
 #include <fbl/mutex.h>
 #include <fbl/unique_ptr.h>
@@ -44,6 +45,7 @@ class TapDevice : public ddk::Device<TapDevice, ddk::Unbindable>,
                                   size_t data_size);
     // No DMA capability, so return invalid handle for get_bti
     void EthmacGetBti(zx::bti* bti);
+    zx_status_t EthmacQueueRx(ethmac_netbuf_t* netbuf);
     int Thread();
 
   private:
@@ -62,6 +64,16 @@ class TapDevice : public ddk::Device<TapDevice, ddk::Unbindable>,
     bool dead_ = false;
     ddk::EthmacIfcClient ethmac_client_ __TA_GUARDED(lock_);
 
+    // Receive buffers passed to EthmacQueueRx, which packets are read into directly. This has
+    // its own lock because the ethernet driver queues buffers while holding its own lock, which
+    // it also takes in callbacks made under |lock_|.
+    struct RxNetbuf {
+        ethmac_netbuf_t netbuf;
+        list_node_t node;
+    };
+    fbl::Mutex rx_lock_;
+    list_node_t rx_netbufs_ __TA_GUARDED(rx_lock_);
+
     // Only accessed from Thread, so not locked.
     bool online_ = false;
     zx::socket data_;
@@ -77,6 +77,13 @@ static zx_status_t ktrace_ioctl(void* ctx, uint32_t op,
         zx_ktrace_control(get_root_resource(), KTRACE_ACTION_REWIND, 0, NULL);
         return ZX_OK;
     }
+    case IOCTL_KTRACE_SET_MODE: {
+        if (cmdlen != sizeof(uint32_t)) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        uint32_t mode = *(uint32_t *)cmd;
+        return zx_ktrace_control(get_root_resource(), KTRACE_ACTION_SET_MODE, mode, NULL);
+    }
     default:
         return ZX_ERR_INVALID_ARGS;
     }
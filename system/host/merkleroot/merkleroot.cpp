@@ -68,7 +68,8 @@ int handle_argument(char** argv, const char* arg,
     }
 }
 
-void handle_entry(FileEntry* entry) {
+// Hashes one file on up to |num_threads| threads.
+void handle_entry(FileEntry* entry, size_t num_threads) {
     fbl::unique_fd fd{open(entry->filename.c_str(), O_RDONLY)};
     if (!fd) {
         perror(entry->filename.c_str());
@@ -102,8 +103,8 @@ void handle_entry(FileEntry* entry) {
         perror("mmap");
         exit(1);
     }
-    zx_status_t rc =
-        MerkleTree::Create(data, info.st_size, tree.get(), len, &digest);
+    zx_status_t rc = MerkleTree::CreateParallel(data, info.st_size, tree.get(),
+                                                len, &digest, num_threads);
     if (info.st_size != 0 && munmap(data, info.st_size) != 0) {
         perror("munmap");
         exit(1);
@@ -152,13 +153,16 @@ int main(int argc, char** argv) {
     std::vector<std::thread> threads;
     std::mutex mtx;
     size_t next_entry = 0;
-    size_t n_threads = std::thread::hardware_concurrency();
-    if (!n_threads) {
-        n_threads = 4;
+    size_t n_cpus = std::thread::hardware_concurrency();
+    if (!n_cpus) {
+        n_cpus = 4;
     }
+    size_t n_threads = n_cpus;
     if (n_threads > entries.size()) {
         n_threads = entries.size();
     }
+    // With fewer files than CPUs, let each file's tree use the spare ones.
+    size_t n_file_threads = n_threads ? n_cpus / n_threads : 1;
     for (size_t i = n_threads; i > 0; --i) {
         threads.push_back(std::thread([&] {
             while (true) {
@@ -168,7 +172,7 @@ int main(int argc, char** argv) {
                 if (j >= entries.size()) {
                     return;
                 }
-                handle_entry(&entries[j]);
+                handle_entry(&entries[j], n_file_threads);
             }
         }));
     }
@@ -4,6 +4,7 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cerrno>
 #include <climits>
@@ -26,14 +27,18 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/uio.h>
+#include <thread>
 #include <unistd.h>
 #include <utility>
 #include <vector>
 
+#include <fbl/algorithm.h>
 #include <fbl/macros.h>
 #include <fbl/unique_fd.h>
 #include <lib/cksum.h>
+#include <lz4/lz4.h>
 #include <lz4/lz4frame.h>
+#include <lz4/lz4hc.h>
 #include <zircon/boot/image.h>
 
 namespace {
@@ -409,8 +414,63 @@ private:
     uint32_t crc_ = 0;
 };
 
-// This tells LZ4f_compressUpdate it can keep a pointer to data.
-constexpr const LZ4F_compressOptions_t kCompressOpt = {1, {}};
+// Set by --threads.  Zero means one thread per CPU.
+size_t gThreads = 0;
+
+// Calls worker(i) for each i < count, using up to gThreads threads.  Each
+// thread gets its own worker from make_worker(), so it can carry state that
+// is reused from one call to the next.
+template <typename MakeWorker>
+void ParallelFor(size_t count, MakeWorker make_worker) {
+    size_t n_threads = gThreads;
+    if (n_threads == 0) {
+        n_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    n_threads = std::min(n_threads, count);
+    std::atomic<size_t> next{0};
+    auto run = [&]() {
+        auto worker = make_worker();
+        for (size_t i = next++; i < count; i = next++) {
+            worker(i);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < n_threads; ++i) {
+        threads.emplace_back(run);
+    }
+    run();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// LZ4 frames are a sequence of blocks, each one a 32-bit little-endian size
+// followed by that many bytes, ending with a zero size.
+constexpr uint32_t kLZ4FBlockUncompressed = 0x80000000;
+constexpr size_t kLZ4FBlockHeaderSize = sizeof(uint32_t);
+constexpr size_t kLZ4FEndMarkSize = sizeof(uint32_t);
+
+// With LZ4F_blockIndependent, each block is compressed on its own.  This is
+// what lets the blocks be handled on several threads at once.
+constexpr LZ4F_blockSizeID_t kLZ4FBlockSizeID = LZ4F_max64KB;
+constexpr size_t kLZ4FBlockSize = 64 << 10;
+
+// LZ4 compression levels 1-3 are for "fast" compression, and 4-16
+// are for higher compression. The additional compression going from
+// 4 to 16 is not worth the extra time needed during compression.
+constexpr int kLZ4CompressionLevel = 4;
+
+uint32_t ReadLE32(const std::byte* p) {
+    return (static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+            (static_cast<uint32_t>(p[2]) << 16) |
+            (static_cast<uint32_t>(p[3]) << 24));
+}
+
+void WriteLE32(std::byte* p, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        p[i] = static_cast<std::byte>(value >> (i * 8));
+    }
+}
 
 class Compressor {
 public:
@@ -436,54 +496,75 @@ public:
         // and fill in once we know the payload length and CRC.
         header_pos_ = out->PlaceHeader();
 
-        prefs_.frameInfo.contentSize = header_.length;
-
-        prefs_.frameInfo.blockSizeID = LZ4F_max64KB;
-        prefs_.frameInfo.blockMode = LZ4F_blockIndependent;
-
-        // LZ4 compression levels 1-3 are for "fast" compression, and 4-16
-        // are for higher compression. The additional compression going from
-        // 4 to 16 is not worth the extra time needed during compression.
-        prefs_.compressionLevel = 4;
-
-        LZ4F_CALL(LZ4F_createCompressionContext, &ctx_, LZ4F_VERSION);
+        LZ4F_preferences_t prefs{};
+        prefs.frameInfo.contentSize = header_.length;
+        prefs.frameInfo.blockSizeID = kLZ4FBlockSizeID;
+        prefs.frameInfo.blockMode = LZ4F_blockIndependent;
+        prefs.compressionLevel = kLZ4CompressionLevel;
 
         // Record the original uncompressed size in header_.extra.
         // WriteBuffer will accumulate the compressed size in header_.length.
         header_.extra = header_.length;
         header_.length = 0;
 
-        // This might start writing compression format headers before it
-        // receives any data.
+        // The library writes the frame header.  The blocks are compressed
+        // here, the same way LZ4F_compressUpdate would, so that batches of
+        // them can be done on several threads.
+        LZ4F_compressionContext_t ctx;
+        LZ4F_CALL(LZ4F_createCompressionContext, &ctx, LZ4F_VERSION);
         auto buffer = GetBuffer(kLZ4FMaxHeaderFrameSize);
-        size_t size = LZ4F_CALL(LZ4F_compressBegin, ctx_,
-                                buffer.data.get(), buffer.size, &prefs_);
+        size_t size = LZ4F_CALL(LZ4F_compressBegin, ctx,
+                                buffer.data.get(), buffer.size, &prefs);
         assert(size <= buffer.size);
+        LZ4F_CALL(LZ4F_freeCompressionContext, ctx);
         WriteBuffer(out, std::move(buffer), size);
     }
 
-    ~Compressor() {
-        LZ4F_CALL(LZ4F_freeCompressionContext, ctx_);
-    }
-
     // NOTE: Input buffer may be referenced for the life of the Compressor!
     void Write(OutputStream* out, const iovec& input) {
-        auto buffer = GetBuffer(LZ4F_compressBound(input.iov_len, &prefs_));
-        size_t actual_size = LZ4F_CALL(LZ4F_compressUpdate,
-                                       ctx_, buffer.data.get(), buffer.size,
-                                       input.iov_base, input.iov_len,
-                                       &kCompressOpt);
-        WriteBuffer(out, std::move(buffer), actual_size);
+        auto src = static_cast<const std::byte*>(input.iov_base);
+        size_t size = input.iov_len;
+        in_size_ += size;
+        // A block that straddles input buffers is gathered into a copy.
+        if (partial_size_ > 0) {
+            size_t chunk = std::min(size, kLZ4FBlockSize - partial_size_);
+            memcpy(partial_.get() + partial_size_, src, chunk);
+            partial_size_ += chunk;
+            src += chunk;
+            size -= chunk;
+            if (partial_size_ < kLZ4FBlockSize) {
+                return;
+            }
+            AddPartialBlock(out);
+        }
+        // Whole blocks are compressed straight from the input.
+        while (size >= kLZ4FBlockSize) {
+            AddBlock(out, Iovec(src, kLZ4FBlockSize));
+            src += kLZ4FBlockSize;
+            size -= kLZ4FBlockSize;
+        }
+        if (size > 0) {
+            partial_ = std::make_unique<std::byte[]>(kLZ4FBlockSize);
+            memcpy(partial_.get(), src, size);
+            partial_size_ = size;
+        }
     }
 
     uint32_t Finish(OutputStream* out) {
-        // Write the closing chunk from the compressor.
-        auto buffer = GetBuffer(LZ4F_compressBound(0, &prefs_));
-        size_t actual_size = LZ4F_CALL(LZ4F_compressEnd,
-                                       ctx_, buffer.data.get(), buffer.size,
-                                       &kCompressOpt);
+        if (in_size_ != header_.extra) {
+            fprintf(stderr, "compressor got %zu bytes, expected %u\n",
+                    in_size_, header_.extra);
+            exit(1);
+        }
 
-        WriteBuffer(out, std::move(buffer), actual_size);
+        // Compress what's left and write the end mark.
+        if (partial_size_ > 0) {
+            AddPartialBlock(out);
+        }
+        CompressBlocks(out);
+        auto buffer = GetBuffer(kLZ4FEndMarkSize);
+        WriteLE32(buffer.data.get(), 0);
+        WriteBuffer(out, std::move(buffer), kLZ4FEndMarkSize);
 
         // Complete the checksum.
         crc_.FinalizeHeader(&header_);
@@ -514,11 +595,22 @@ private:
     } unused_buffer_;
     zbi_header_t header_;
     Checksummer crc_;
-    LZ4F_compressionContext_t ctx_;
-    LZ4F_preferences_t prefs_{};
     uint32_t header_pos_ = 0;
+    size_t in_size_ = 0;
+    // Blocks waiting to be compressed, and the gathered copies among them.
+    std::vector<iovec> blocks_;
+    std::vector<std::unique_ptr<std::byte[]>> partials_;
+    std::unique_ptr<std::byte[]> partial_;
+    size_t partial_size_ = 0;
+    std::unique_ptr<std::byte[]> scratch_;
     // IOV_MAX buffers might be live at once.
     static constexpr const size_t kMinBufferSize = (128 << 20) / IOV_MAX;
+    // Blocks are compressed this many at a time.
+    static constexpr const size_t kBatchBlocks = 256;
+    // The most a block can take up in the frame: it is stored uncompressed
+    // if compression doesn't make it smaller.
+    static constexpr const size_t kMaxBlockSize =
+        kLZ4FBlockHeaderSize + kLZ4FBlockSize;
 
     Buffer GetBuffer(size_t max_size) {
         if (unused_buffer_.size >= max_size) {
@@ -539,26 +631,90 @@ private:
             out->Write(iov, std::move(buffer.data));
             buffer.size = 0;
         } else {
-            // The compressor often delivers zero bytes for an input chunk.
             // Stash the unused buffer for next time to cut down on new/delete.
             unused_buffer_ = std::move(buffer);
         }
     }
+
+    void AddBlock(OutputStream* out, const iovec& block) {
+        blocks_.push_back(block);
+        if (blocks_.size() == kBatchBlocks) {
+            CompressBlocks(out);
+        }
+    }
+
+    void AddPartialBlock(OutputStream* out) {
+        partials_.push_back(std::move(partial_));
+        auto block = Iovec(partials_.back().get(), partial_size_);
+        partial_size_ = 0;
+        AddBlock(out, block);
+    }
+
+    // Compresses the pending blocks in parallel and writes them out in order.
+    void CompressBlocks(OutputStream* out) {
+        if (blocks_.empty()) {
+            return;
+        }
+        // Each block is compressed into its own slot of the scratch buffer,
+        // and then the slots are packed together into the output buffer.
+        if (!scratch_) {
+            scratch_ = std::make_unique<std::byte[]>(kBatchBlocks *
+                                                     kMaxBlockSize);
+        }
+        std::vector<size_t> sizes(blocks_.size());
+        ParallelFor(blocks_.size(), [&]() {
+            auto state = std::make_unique<std::byte[]>(LZ4_sizeofStateHC());
+            return [&, state = std::move(state)](size_t i) {
+                sizes[i] = CompressBlock(state.get(), blocks_[i],
+                                         scratch_.get() + i * kMaxBlockSize);
+            };
+        });
+        auto buffer = GetBuffer(
+            std::accumulate(sizes.begin(), sizes.end(), size_t{0}));
+        size_t size = 0;
+        for (size_t i = 0; i < blocks_.size(); ++i) {
+            memcpy(buffer.data.get() + size,
+                   scratch_.get() + i * kMaxBlockSize, sizes[i]);
+            size += sizes[i];
+        }
+        WriteBuffer(out, std::move(buffer), size);
+        blocks_.clear();
+        partials_.clear();
+    }
+
+    // This matches what LZ4F_compressUpdate does with each block.
+    static size_t CompressBlock(void* state, const iovec& block,
+                                std::byte* dst) {
+        auto src = static_cast<const char*>(block.iov_base);
+        int src_size = static_cast<int>(block.iov_len);
+        int size = LZ4_compress_HC_extStateHC(
+            state, src, reinterpret_cast<char*>(dst + kLZ4FBlockHeaderSize),
+            src_size, src_size - 1, kLZ4CompressionLevel);
+        if (size == 0) {
+            // It didn't fit in fewer bytes than the input, so store it as is.
+            WriteLE32(dst, static_cast<uint32_t>(src_size) |
+                               kLZ4FBlockUncompressed);
+            memcpy(dst + kLZ4FBlockHeaderSize, src, src_size);
+            size = src_size;
+        } else {
+            WriteLE32(dst, static_cast<uint32_t>(size));
+        }
+        return kLZ4FBlockHeaderSize + size;
+    }
 };
 
 const size_t Compressor::kMinBufferSize;
+const size_t Compressor::kBatchBlocks;
+const size_t Compressor::kMaxBlockSize;
 
 constexpr const LZ4F_decompressOptions_t kDecompressOpt{};
 
-std::unique_ptr<std::byte[]> Decompress(const std::list<const iovec>& payload,
-                                        uint32_t decompressed_length) {
-    auto buffer = std::make_unique<std::byte[]>(decompressed_length);
-
+// Decompresses one LZ4 frame using the library's streaming decoder.
+void DecompressSerial(const std::list<const iovec>& payload, std::byte* dst,
+                      size_t dst_size) {
     LZ4F_decompressionContext_t ctx;
     LZ4F_CALL(LZ4F_createDecompressionContext, &ctx, LZ4F_VERSION);
 
-    std::byte* dst = buffer.get();
-    size_t dst_size = decompressed_length;
     for (const auto& iov : payload) {
         auto src = static_cast<const std::byte*>(iov.iov_base);
         size_t src_size = iov.iov_len;
@@ -589,7 +745,113 @@ std::unique_ptr<std::byte[]> Decompress(const std::list<const iovec>& payload,
     }
 
     LZ4F_CALL(LZ4F_freeDecompressionContext, ctx);
+}
+
+// Decompresses the blocks of one LZ4 frame in parallel.  This handles the
+// frames Compressor writes: independent blocks, every one but the last
+// full-sized, and no content checksum.  It returns false, having possibly
+// written some of dst, for any frame it can't handle; DecompressSerial
+// is the authority on those.
+bool DecompressParallel(const std::byte* src, size_t src_size,
+                        std::byte* dst, size_t dst_size) {
+    LZ4F_decompressionContext_t ctx;
+    LZ4F_CALL(LZ4F_createDecompressionContext, &ctx, LZ4F_VERSION);
+    LZ4F_frameInfo_t info;
+    size_t header_size = src_size;
+    size_t result = LZ4F_getFrameInfo(ctx, &info, src, &header_size);
+    LZ4F_CALL(LZ4F_freeDecompressionContext, ctx);
+    if (LZ4F_isError(result) ||
+        (info.contentSize != 0 && info.contentSize != dst_size) ||
+        info.blockMode != LZ4F_blockIndependent ||
+        info.contentChecksumFlag != LZ4F_noContentChecksum ||
+        info.blockSizeID != kLZ4FBlockSizeID) {
+        return false;
+    }
+
+    // Find all the blocks.
+    struct Block {
+        const std::byte* src;
+        uint32_t src_size;
+        bool compressed;
+    };
+    std::vector<Block> blocks;
+    size_t pos = header_size;
+    while (true) {
+        if (src_size - pos < kLZ4FBlockHeaderSize) {
+            return false;
+        }
+        uint32_t size = ReadLE32(src + pos);
+        pos += kLZ4FBlockHeaderSize;
+        if (size == 0) {
+            break;
+        }
+        bool compressed = !(size & kLZ4FBlockUncompressed);
+        size &= ~kLZ4FBlockUncompressed;
+        if (size > kLZ4FBlockSize || src_size - pos < size) {
+            return false;
+        }
+        blocks.push_back({src + pos, size, compressed});
+        pos += size;
+    }
+    if (pos != src_size ||
+        fbl::round_up(dst_size, kLZ4FBlockSize) / kLZ4FBlockSize !=
+            blocks.size()) {
+        return false;
+    }
 
+    std::atomic<bool> ok{true};
+    ParallelFor(blocks.size(), [&]() {
+        return [&](size_t i) {
+            const Block& block = blocks[i];
+            size_t offset = i * kLZ4FBlockSize;
+            size_t size = std::min(kLZ4FBlockSize, dst_size - offset);
+            std::byte* block_dst = dst + offset;
+            if (!block.compressed) {
+                if (block.src_size != size) {
+                    ok = false;
+                    return;
+                }
+                memcpy(block_dst, block.src, size);
+            } else if (LZ4_decompress_safe(
+                           reinterpret_cast<const char*>(block.src),
+                           reinterpret_cast<char*>(block_dst),
+                           static_cast<int>(block.src_size),
+                           static_cast<int>(size)) != static_cast<int>(size)) {
+                ok = false;
+            }
+        };
+    });
+    return ok;
+}
+
+std::unique_ptr<std::byte[]> Decompress(const std::list<const iovec>& payload,
+                                        uint32_t decompressed_length) {
+    auto buffer = std::make_unique<std::byte[]>(decompressed_length);
+
+    // The blocks can only be found in one contiguous buffer.
+    const std::byte* src = nullptr;
+    size_t src_size = 0;
+    std::unique_ptr<std::byte[]> gathered;
+    if (payload.size() == 1) {
+        src = static_cast<const std::byte*>(payload.front().iov_base);
+        src_size = payload.front().iov_len;
+    } else {
+        for (const auto& iov : payload) {
+            src_size += iov.iov_len;
+        }
+        AppendBuffer gather(src_size);
+        for (const auto& iov : payload) {
+            gather.Append(static_cast<const std::byte*>(iov.iov_base),
+                          iov.iov_len);
+        }
+        gathered = gather.release();
+        src = gathered.get();
+    }
+
+    if (!DecompressParallel(src, src_size, buffer.get(),
+                            decompressed_length)) {
+        DecompressSerial(payload, buffer.get(), decompressed_length);
+    }
     return buffer;
 }
 
@@ -1719,7 +1981,7 @@ const char* IncompleteImage(const ItemList& items, const uint32_t image_arch) {
     return nullptr;
 }
 
-constexpr const char kOptString[] = "-B:cd:e:FxXRg:hto:p:sT:uv";
+constexpr const char kOptString[] = "-B:cd:e:FxXRg:hj:to:p:sT:uv";
 constexpr const option kLongOpts[] = {
     {"complete", required_argument, nullptr, 'B'},
     {"compressed", no_argument, nullptr, 'c'},
@@ -1731,6 +1993,7 @@ constexpr const option kLongOpts[] = {
     {"extract-raw", no_argument, nullptr, 'R'},
     {"groups", required_argument, nullptr, 'g'},
     {"help", no_argument, nullptr, 'h'},
+    {"threads", required_argument, nullptr, 'j'},
     {"list", no_argument, nullptr, 't'},
     {"output", required_argument, nullptr, 'o'},
     {"prefix", required_argument, nullptr, 'p'},
@@ -1790,6 +2053,8 @@ Format control switches (last switch affects all output):\n\
     --compressed, -c               compress BOOTFS images (default)\n\
     --uncompressed, -u             do not compress BOOTFS images\n\
     --sort, -s                     sort BOOTFS entries by name\n\
+    --threads=N, -j N              use N threads to compress and decompress\n\
+                                   items (default: one per CPU)\n\
 \n\
 In all cases there is only a single BOOTFS item (if any) written out.\n\
 The BOOTFS image contains all files from BOOTFS items in ZBI input files,\n\
@@ -1946,6 +2211,17 @@ int main(int argc, char** argv) {
             sort = true;
             continue;
 
+        case 'j': {
+            char* end;
+            unsigned long threads = strtoul(optarg, &end, 0);
+            if (*end != '\0' || optarg[0] == '\0' || threads == 0) {
+                fprintf(stderr, "--threads must be a positive number\n");
+                exit(1);
+            }
+            gThreads = threads;
+            continue;
+        }
+
         case 'x':
             extract = true;
             continue;
@@ -21,6 +21,10 @@
 // ZX_USER_SIGNAL_7 is reserved for internal ethertap use.
 #define ETHERTAP_SIGNAL_ONLINE  ZX_USER_SIGNAL_0
 #define ETHERTAP_SIGNAL_OFFLINE ZX_USER_SIGNAL_1
+// Asserted by the device on the client's end of the socket each time it reads a frame straight
+// into a receive buffer queued by the ethernet driver (ETHMAC_FEATURE_RX_NETBUF). The client
+// clears it.
+#define ETHERTAP_SIGNAL_RX_NETBUF ZX_USER_SIGNAL_2
 
 // Enables tracing of the ethertap device itself
 #define ETHERTAP_OPT_TRACE         (1u << 0)
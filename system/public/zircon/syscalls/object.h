@@ -36,6 +36,8 @@ typedef uint32_t zx_object_info_topic_t;
 #define ZX_INFO_PROCESS_HANDLE_STATS    ((zx_object_info_topic_t) 21u) // zx_info_process_handle_stats_t[1]
 #define ZX_INFO_SOCKET                  ((zx_object_info_topic_t) 22u) // zx_info_socket_t[1]
 #define ZX_INFO_VMO                     ((zx_object_info_topic_t) 23u) // zx_info_vmo_t[1]
+#define ZX_INFO_VMAR_FAULT_STATS        ((zx_object_info_topic_t) 24u) // zx_info_vmar_fault_stats_t[1]
+#define ZX_INFO_VMO_LARGE_PAGES         ((zx_object_info_topic_t) 25u) // zx_info_vmo_large_pages_t[1]
 
 typedef uint32_t zx_obj_props_t;
 #define ZX_OBJ_PROP_NONE                ((zx_obj_props_t)0u)
@@ -146,6 +148,15 @@ typedef struct zx_info_vmar {
     size_t len;
 } zx_info_vmar_t;
 
+typedef struct zx_info_vmar_fault_stats {
+    // Number of page faults resolved by mappings within the region.
+    uint64_t page_faults;
+
+    // Number of pages mapped around faulting addresses without taking a
+    // fault of their own.
+    uint64_t fault_around_pages;
+} zx_info_vmar_fault_stats_t;
+
 typedef struct zx_info_bti {
     // zx_bti_pin will always be able to return addresses that are contiguous for at
     // least this many bytes.  E.g. if this returns 1MB, then a call to
@@ -319,6 +330,15 @@ typedef struct zx_info_vmo {
     uint32_t cache_policy;
 } zx_info_vmo_t;
 
+typedef struct zx_info_vmo_large_pages {
+    // The size in bytes of a large page.
+    uint64_t large_page_size;
+
+    // The number of large pages currently backing the VMO. Their memory is
+    // included in the VMO's |committed_bytes|.
+    uint64_t committed_large_pages;
+} zx_info_vmo_large_pages_t;
+
 // kernel statistics per cpu
 // TODO(cpu), expose the deprecated stats via a new syscall.
 typedef struct zx_info_cpu_stats {
@@ -9,6 +9,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <threads.h>
 
 #include <fbl/algorithm.h>
 #include <fbl/unique_ptr.h>
@@ -115,6 +116,165 @@ void do_test(uint32_t duration_sec, const TestArgs& test_args) {
            test_args.size, test_args.handles, test_args.queue, its_per_second);
 }
 
+int compare_durations(const void* a, const void* b) {
+    zx_duration_t x = *static_cast<const zx_duration_t*>(a);
+    zx_duration_t y = *static_cast<const zx_duration_t*>(b);
+    return (x > y) - (x < y);
+}
+
+// Times every write/read pair of |size| byte messages for |duration_sec| and reports the message
+// rate along with the median and tail latency of a single pair.
+void do_latency_test(uint32_t duration_sec, uint32_t size) {
+    __UNUSED zx_status_t status;
+
+    zx_duration_t duration_ns = ZX_SEC(duration_sec);
+
+    zx_handle_t mp[2] = {ZX_HANDLE_INVALID, ZX_HANDLE_INVALID};
+    status = zx_channel_create(0u, &mp[0], &mp[1]);
+    assert(status == ZX_OK);
+
+    fbl::unique_ptr<uint8_t[]> data(new uint8_t[size]);
+    for (uint32_t i = 0; i < size; i++)
+        data[i] = static_cast<uint8_t>(i);
+
+    // Latencies past this many messages are not recorded, though they still count towards the
+    // message rate.
+    static constexpr size_t max_samples = 1u << 20;
+    fbl::unique_ptr<zx_duration_t[]> samples(new zx_duration_t[max_samples]);
+    size_t num_samples = 0;
+
+    uint64_t messages = 0;
+    zx_time_t start_ns = zx_clock_get_monotonic();
+    zx_time_t end_ns = start_ns;
+    while (zx_time_sub_time(end_ns, start_ns) < duration_ns) {
+        status = zx_channel_write(mp[0], 0u, data.get(), size, nullptr, 0u);
+        assert(status == ZX_OK);
+
+        uint32_t r_size = size;
+        uint32_t r_handles = 0;
+        status = zx_channel_read(mp[1], 0u, data.get(), nullptr, r_size, 0u, &r_size, &r_handles);
+        assert(status == ZX_OK);
+        assert(r_size == size);
+
+        zx_time_t now_ns = zx_clock_get_monotonic();
+        if (num_samples < max_samples)
+            samples[num_samples++] = zx_time_sub_time(now_ns, end_ns);
+        end_ns = now_ns;
+        messages++;
+    }
+
+    status = zx_handle_close(mp[0]);
+    assert(status == ZX_OK);
+    status = zx_handle_close(mp[1]);
+    assert(status == ZX_OK);
+
+    qsort(samples.get(), num_samples, sizeof(samples[0]), compare_durations);
+
+    double real_duration = static_cast<double>(zx_time_sub_time(end_ns, start_ns)) / 1000000000.0;
+    printf("write/read %6" PRIu32 " bytes: %9.0f messages/second, "
+               "p50 %7.2fus, p99 %7.2fus\n",
+           size, static_cast<double>(messages) / real_duration,
+           static_cast<double>(samples[num_samples / 2]) / 1000.0,
+           static_cast<double>(samples[num_samples * 99 / 100]) / 1000.0);
+}
+
+struct ServerArgs {
+    zx_handle_t channel;
+    uint32_t size;
+};
+
+// Echoes every message on |channel| back until the client end is closed.
+int call_server(void* arg) {
+    const ServerArgs* args = static_cast<const ServerArgs*>(arg);
+    fbl::unique_ptr<uint8_t[]> data(new uint8_t[args->size]);
+    for (;;) {
+        zx_signals_t pending;
+        zx_status_t status = zx_object_wait_one(args->channel,
+                                                ZX_CHANNEL_READABLE | ZX_CHANNEL_PEER_CLOSED,
+                                                ZX_TIME_INFINITE, &pending);
+        if (status != ZX_OK)
+            return 1;
+
+        uint32_t r_size;
+        uint32_t r_handles;
+        status = zx_channel_read(args->channel, 0u, data.get(), nullptr, args->size, 0u,
+                                 &r_size, &r_handles);
+        if (status == ZX_ERR_SHOULD_WAIT)
+            continue;
+        if (status != ZX_OK)
+            return 0;  // Peer closed.
+
+        status = zx_channel_write(args->channel, 0u, data.get(), r_size, nullptr, 0u);
+        if (status != ZX_OK)
+            return 0;
+    }
+}
+
+// Times zx_channel_call round trips of |size| byte messages to an echo server thread for
+// |duration_sec| and reports the call rate along with the median and tail latency of a call.
+void do_call_test(uint32_t duration_sec, uint32_t size) {
+    __UNUSED zx_status_t status;
+
+    zx_duration_t duration_ns = ZX_SEC(duration_sec);
+
+    zx_handle_t mp[2] = {ZX_HANDLE_INVALID, ZX_HANDLE_INVALID};
+    status = zx_channel_create(0u, &mp[0], &mp[1]);
+    assert(status == ZX_OK);
+
+    ServerArgs server_args = {mp[1], size};
+    thrd_t server;
+    __UNUSED int ret = thrd_create_with_name(&server, call_server, &server_args, "call-server");
+    assert(ret == thrd_success);
+
+    // zx_channel_call needs room for a txid at the start of the message.
+    fbl::unique_ptr<uint8_t[]> wr_data(new uint8_t[size]);
+    fbl::unique_ptr<uint8_t[]> rd_data(new uint8_t[size]);
+    for (uint32_t i = 0; i < size; i++)
+        wr_data[i] = static_cast<uint8_t>(i);
+    zx_channel_call_args_t args = {};
+    args.wr_bytes = wr_data.get();
+    args.wr_num_bytes = size;
+    args.rd_bytes = rd_data.get();
+    args.rd_num_bytes = size;
+
+    static constexpr size_t max_samples = 1u << 20;
+    fbl::unique_ptr<zx_duration_t[]> samples(new zx_duration_t[max_samples]);
+    size_t num_samples = 0;
+
+    uint64_t calls = 0;
+    zx_time_t start_ns = zx_clock_get_monotonic();
+    zx_time_t end_ns = start_ns;
+    while (zx_time_sub_time(end_ns, start_ns) < duration_ns) {
+        uint32_t r_size;
+        uint32_t r_handles;
+        status = zx_channel_call(mp[0], 0u, ZX_TIME_INFINITE, &args, &r_size, &r_handles);
+        assert(status == ZX_OK);
+        assert(r_size == size);
+
+        zx_time_t now_ns = zx_clock_get_monotonic();
+        if (num_samples < max_samples)
+            samples[num_samples++] = zx_time_sub_time(now_ns, end_ns);
+        end_ns = now_ns;
+        calls++;
+    }
+
+    status = zx_handle_close(mp[0]);
+    assert(status == ZX_OK);
+    ret = thrd_join(server, nullptr);
+    assert(ret == thrd_success);
+    status = zx_handle_close(mp[1]);
+    assert(status == ZX_OK);
+
+    qsort(samples.get(), num_samples, sizeof(samples[0]), compare_durations);
+
+    double real_duration = static_cast<double>(zx_time_sub_time(end_ns, start_ns)) / 1000000000.0;
+    printf("call %6" PRIu32 " bytes: %9.0f calls/second, "
+               "p50 %7.2fus, p99 %7.2fus\n",
+           size, static_cast<double>(calls) / real_duration,
+           static_cast<double>(samples[num_samples / 2]) / 1000.0,
+           static_cast<double>(samples[num_samples * 99 / 100]) / 1000.0);
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -125,6 +285,11 @@ int main(int argc, char** argv) {
         "  -h    show help (this)\n"
         "  -o    run single test (default)\n"
         "  -s    run suite (ignores -S/-H/-Q)\n"
+        "  -l    run payload size sweep from 64 bytes to 64KiB, reporting\n"
+        "        messages/second and p99 latency (ignores -S/-H/-Q)\n"
+        "  -c    run zx_channel_call round trips to a server thread over the\n"
+        "        same payload sizes, reporting calls/second and p99 latency\n"
+        "        (ignores -S/-H/-Q)\n"
         "  -n N  set test repetition count to N (default: 1)\n"
         "  -d N  set test duration to N seconds (default: 5)\n"
         "  -S N  set message size to N bytes (default: 10)\n"
@@ -132,6 +297,8 @@ int main(int argc, char** argv) {
         "  -Q N  set message pre-queue count to N messages (default: 0)\n";
 
     bool run_suite = false;  // -o/-s
+    bool run_sweep = false;  // -l
+    bool run_calls = false;  // -c
     uint32_t duration = 5;   // -d
     uint32_t repeats = 1;    // -n
     // Ignored when running a suite:
@@ -142,7 +309,7 @@ int main(int argc, char** argv) {
     };
 
     int opt;
-    while ((opt = getopt(argc, argv, "+hosn:d:S:H:Q:")) != -1) {
+    while ((opt = getopt(argc, argv, "+hoslcn:d:S:H:Q:")) != -1) {
         // Our option values are always unsigned numbers.
         uint32_t value = 0;
         if (optarg) {
@@ -160,9 +327,23 @@ int main(int argc, char** argv) {
                 return EXIT_SUCCESS;
             case 'o':
                 run_suite = false;
+                run_sweep = false;
+                run_calls = false;
                 break;
             case 's':
                 run_suite = true;
+                run_sweep = false;
+                run_calls = false;
+                break;
+            case 'l':
+                run_suite = false;
+                run_sweep = true;
+                run_calls = false;
+                break;
+            case 'c':
+                run_suite = false;
+                run_sweep = false;
+                run_calls = true;
                 break;
             case 'n':
                 assert(optarg);
@@ -200,7 +381,16 @@ int main(int argc, char** argv) {
                    repeats);
         }
 
-        if (run_suite) {
+        static constexpr uint32_t sweep_sizes[] = {
+            64, 256, 1024, 4096, 16384, 65536,
+        };
+        if (run_sweep) {
+            for (size_t i = 0; i < fbl::count_of(sweep_sizes); i++)
+                do_latency_test(duration, sweep_sizes[i]);
+        } else if (run_calls) {
+            for (size_t i = 0; i < fbl::count_of(sweep_sizes); i++)
+                do_call_test(duration, sweep_sizes[i]);
+        } else if (run_suite) {
             static constexpr TestArgs suite[] = {
                 {10, 0, 0},
                 {100, 0, 0},
@@ -0,0 +1,150 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lib/kcounter/reader.h>
+#include <zircon/status.h>
+#include <zircon/syscalls.h>
+
+namespace {
+
+int Usage() {
+    fprintf(stderr, "usage: kcounter [ <option>* ] [prefix]*\n");
+    fprintf(stderr, " kcounter prints the kernel counters whose names start with one of the\n"
+                    " given prefixes, or all counters if there are none.\n");
+    fprintf(stderr, " --verbose (-v) : also print the sum, min and max across cpus\n");
+    fprintf(stderr, " --histograms (-H) : print the kernel's latency histograms instead:\n"
+                    "   how many values each recorded, and upper bounds in nanoseconds on\n"
+                    "   their 50th, 99th and 99.9th percentiles and their maximum\n");
+    fprintf(stderr, " --watch (-w) <seconds> : print the counters again every <seconds>\n");
+    fprintf(stderr, " --help (-h) : show this help message\n");
+    return -1;
+}
+
+void PrintCounter(const kcounter::Reader& reader, size_t index, bool verbose) {
+    printf("%s = %ld", reader.name(index), reader.Value(index));
+    if (verbose) {
+        kcounter::Stats stats = reader.Read(index);
+        printf(" (sum %ld, min %ld, max %ld)", stats.sum, stats.min, stats.max);
+    }
+    printf("\n");
+}
+
+void PrintCounters(const kcounter::Reader& reader, int num_prefixes, char* const* prefixes,
+                   bool verbose) {
+    if (num_prefixes == 0) {
+        for (size_t i = 0; i < reader.count(); ++i) {
+            PrintCounter(reader, i, verbose);
+        }
+        return;
+    }
+    for (int p = 0; p < num_prefixes; ++p) {
+        const char* prefix = prefixes[p];
+        const size_t len = strlen(prefix);
+        for (size_t i = reader.LowerBound(prefix);
+             i < reader.count() && strncmp(reader.name(i), prefix, len) == 0; ++i) {
+            PrintCounter(reader, i, verbose);
+        }
+    }
+}
+
+bool MatchesPrefix(const char* name, int num_prefixes, char* const* prefixes) {
+    if (num_prefixes == 0) {
+        return true;
+    }
+    for (int p = 0; p < num_prefixes; ++p) {
+        if (strncmp(name, prefixes[p], strlen(prefixes[p])) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Prints the histograms that recorded anything.  A family of more than one
+// histogram, such as the per-syscall one, prints each with its index.
+void PrintHistograms(const kcounter::HistogramReader& reader, int num_prefixes,
+                     char* const* prefixes) {
+    for (size_t family = 0; family < reader.count(); ++family) {
+        if (!MatchesPrefix(reader.name(family), num_prefixes, prefixes)) {
+            continue;
+        }
+        for (uint32_t i = 0; i < reader.size(family); ++i) {
+            kcounter::Histogram histogram;
+            reader.Read(family, i, &histogram);
+            const int64_t total = histogram.total();
+            if (total == 0) {
+                continue;
+            }
+            if (reader.size(family) > 1) {
+                printf("%s[%u]", reader.name(family), i);
+            } else {
+                printf("%s", reader.name(family));
+            }
+            printf(": count %ld p50 %lu p99 %lu p99.9 %lu max %lu\n", total,
+                   histogram.Percentile(0.5), histogram.Percentile(0.99),
+                   histogram.Percentile(0.999), histogram.Percentile(1.0));
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool verbose = false;
+    bool histograms = false;
+    long watch_seconds = 0;
+
+    static const struct option opts[] = {
+        {"verbose", no_argument, nullptr, 'v'},
+        {"histograms", no_argument, nullptr, 'H'},
+        {"watch", required_argument, nullptr, 'w'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "vHw:h", opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'v':
+            verbose = true;
+            break;
+        case 'H':
+            histograms = true;
+            break;
+        case 'w':
+            watch_seconds = strtol(optarg, nullptr, 0);
+            if (watch_seconds <= 0) {
+                return Usage();
+            }
+            break;
+        default:
+            return Usage();
+        }
+    }
+
+    kcounter::Reader reader;
+    kcounter::HistogramReader histogram_reader;
+    zx_status_t status = histograms ? histogram_reader.Init() : reader.Init();
+    if (status != ZX_OK) {
+        fprintf(stderr, "kcounter: cannot read kernel %s: %s\n",
+                histograms ? "histograms" : "counters", zx_status_get_string(status));
+        return 1;
+    }
+
+    for (;;) {
+        if (histograms) {
+            PrintHistograms(histogram_reader, argc - optind, argv + optind);
+        } else {
+            PrintCounters(reader, argc - optind, argv + optind, verbose);
+        }
+        if (watch_seconds == 0) {
+            return 0;
+        }
+        zx_nanosleep(zx_deadline_after(ZX_SEC(watch_seconds)));
+        printf("\n");
+    }
+}
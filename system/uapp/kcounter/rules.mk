@@ -0,0 +1,26 @@
+# Copyright 2018 The Fuchsia Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+MODULE := $(LOCAL_DIR)
+
+MODULE_TYPE := userapp
+MODULE_GROUP := core
+
+MODULE_NAME := kcounter
+
+MODULE_SRCS += \
+    $(LOCAL_DIR)/main.cpp
+
+MODULE_STATIC_LIBS := \
+    system/ulib/kcounter \
+    system/ulib/fbl \
+    system/ulib/fzl \
+    system/ulib/zircon-internal \
+    system/ulib/zx \
+
+MODULE_LIBS := system/ulib/fdio system/ulib/c system/ulib/zircon
+
+include make/module.mk
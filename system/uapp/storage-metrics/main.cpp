@@ -99,6 +99,13 @@ void PrintFsMetrics(const MinfsMetrics& metrics, const char* path) {
     printf("lookup calls:                       %lu\n", metrics.lookup_calls);
     printf("successful lookup calls:            %lu\n", metrics.lookup_calls_success);
     printf("lookup nanoseconds:                 %lu\n", metrics.lookup_ticks);
+    printf("\n");
+
+    printf("Block cache metrics\n");
+    printf("block cache hits:                   %lu\n", metrics.block_cache_hits);
+    printf("block cache misses:                 %lu\n", metrics.block_cache_misses);
+    printf("blocks read ahead:                  %lu\n", metrics.block_cache_readahead_blocks);
+    printf("block cache evictions:              %lu\n", metrics.block_cache_evictions);
 }
 
 // Sends a FIDL call to enable or disable filesystem metrics for path
@@ -0,0 +1,90 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "lock-stats.h"
+
+#include <stdio.h>
+
+#include <fbl/alloc_checker.h>
+#include <fbl/unique_ptr.h>
+#include <lib/kcounter/reader.h>
+
+struct lock_stats {
+    kcounter::Reader counters;
+    kcounter::HistogramReader histograms;
+
+    // The values at lock_stats_start().
+    int64_t contended = 0;
+    kcounter::Histogram wait = {};
+    kcounter::Histogram hold = {};
+};
+
+namespace {
+
+constexpr char kContended[] = "kernel.thread_lock.contended";
+constexpr char kWait[] = "kernel.latency.thread_lock.wait";
+constexpr char kHold[] = "kernel.latency.thread_lock.hold";
+
+int64_t ReadCounter(const kcounter::Reader& reader, const char* name) {
+    size_t index;
+    return reader.Find(name, &index) ? reader.Value(index) : 0;
+}
+
+void ReadHistogram(const kcounter::HistogramReader& reader, const char* name,
+                   kcounter::Histogram* histogram) {
+    size_t family;
+    if (reader.Find(name, &family)) {
+        reader.Read(family, 0, histogram);
+    } else {
+        *histogram = {};
+    }
+}
+
+// Returns the number of values recorded since |start|.
+int64_t PrintHistogram(const char* what, const kcounter::Histogram& start,
+                    const kcounter::HistogramReader& reader, const char* name) {
+    kcounter::Histogram histogram;
+    ReadHistogram(reader, name, &histogram);
+    for (uint32_t bucket = 0; bucket < KHISTOGRAM_BUCKETS; ++bucket) {
+        histogram.buckets[bucket] -= start.buckets[bucket];
+    }
+    if (histogram.total() == 0) {
+        printf("  %s: none recorded\n", what);
+        return 0;
+    }
+    printf("  %s: %ld, p50 <%.1fus p99 <%.1fus p99.9 <%.1fus\n", what, histogram.total(),
+           histogram.Percentile(0.5) / 1e3, histogram.Percentile(0.99) / 1e3,
+           histogram.Percentile(0.999) / 1e3);
+    return histogram.total();
+}
+
+} // namespace
+
+lock_stats_t* lock_stats_create(void) {
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<lock_stats_t> stats(new (&ac) lock_stats_t);
+    if (!ac.check() || stats->counters.Init() != ZX_OK || stats->histograms.Init() != ZX_OK) {
+        return nullptr;
+    }
+    return stats.release();
+}
+
+void lock_stats_destroy(lock_stats_t* stats) {
+    delete stats;
+}
+
+void lock_stats_start(lock_stats_t* stats) {
+    stats->contended = ReadCounter(stats->counters, kContended);
+    ReadHistogram(stats->histograms, kWait, &stats->wait);
+    ReadHistogram(stats->histograms, kHold, &stats->hold);
+}
+
+void lock_stats_print(const lock_stats_t* stats) {
+    printf("thread lock: contended %ld times\n",
+           ReadCounter(stats->counters, kContended) - stats->contended);
+    PrintHistogram("spins", stats->wait, stats->histograms, kWait);
+    if (PrintHistogram("holds", stats->hold, stats->histograms, kHold) == 0) {
+        printf("  (hold times need kernel.thread-lock-hold-stats=true)\n");
+    }
+}
@@ -0,0 +1,27 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <zircon/compiler.h>
+
+__BEGIN_CDECLS
+
+// The kernel's thread lock statistics, read through the kernel counter and
+// histogram VMOs, so that the scheduler lock contention of a test run can be
+// reported next to its own measurements.
+typedef struct lock_stats lock_stats_t;
+
+// Returns NULL if the kernel's counters cannot be read.
+lock_stats_t* lock_stats_create(void);
+void lock_stats_destroy(lock_stats_t* stats);
+
+// Notes the current values, which lock_stats_print() reports the changes from.
+void lock_stats_start(lock_stats_t* stats);
+
+// Prints how often the thread lock was contended since lock_stats_start(),
+// how long cpus spun on it and how long they held it.
+void lock_stats_print(const lock_stats_t* stats);
+
+__END_CDECLS
@@ -9,10 +9,19 @@ MODULE := $(LOCAL_DIR)
 MODULE_TYPE := userapp
 MODULE_GROUP := misc
 
-MODULE_SRCS += $(LOCAL_DIR)/thread-stress.c
+MODULE_SRCS += \
+    $(LOCAL_DIR)/lock-stats.cpp \
+    $(LOCAL_DIR)/thread-stress.c \
 
 MODULE_NAME := thread-stress-test
 
+MODULE_STATIC_LIBS := \
+    system/ulib/kcounter \
+    system/ulib/fbl \
+    system/ulib/fzl \
+    system/ulib/zircon-internal \
+    system/ulib/zx \
+
 MODULE_LIBS := system/ulib/fdio system/ulib/zircon system/ulib/c
 
 include make/module.mk
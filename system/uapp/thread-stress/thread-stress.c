@@ -2,15 +2,24 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <threads.h>
 
 #include <zircon/syscalls.h>
 #include <zircon/time.h>
 #include <zircon/types.h>
 
+#include "lock-stats.h"
+
 #define NUM_THREADS 1000
 
+// wakeup storm defaults
+#define WAKEUP_THREADS 64
+#define WAKEUP_ROUNDS 100
+
 static int thread_func(void* arg) {
   return 0;
 }
@@ -29,7 +38,7 @@ static void thread_join(thrd_t thread) {
   }
 }
 
-int main(int argc, char** argv) {
+static void create_join_stress(void) {
     printf("Running thread stress test...\n");
     thrd_t thread[NUM_THREADS];
     while (true) {
@@ -49,5 +58,150 @@ int main(int argc, char** argv) {
             zx_time_sub_time(create, start) / 1e9,
             zx_time_sub_time(join, create) / 1e9);
     }
+}
+
+// State shared by the waker and the threads of a wakeup storm. Every round the
+// waker bumps |generation| and wakes all of the waiters blocked on it at once,
+// each of which then records how long it took to get back on a cpu.
+static zx_futex_t generation;
+static atomic_int waiting;
+static atomic_int woken;
+static atomic_bool stop_waiters;
+static _Atomic zx_time_t wake_time;
+static zx_duration_t* latencies;
+
+static int waiter_func(void* arg) {
+    size_t index = (size_t)(uintptr_t)arg;
+    int gen = atomic_load(&generation);
+    for (;;) {
+        atomic_fetch_add(&waiting, 1);
+        while (atomic_load(&generation) == gen) {
+            zx_futex_wait(&generation, gen, ZX_HANDLE_INVALID, ZX_TIME_INFINITE);
+        }
+        zx_time_t now = zx_clock_get_monotonic();
+        gen = atomic_load(&generation);
+        if (atomic_load(&stop_waiters)) {
+            return 0;
+        }
+        latencies[index] = zx_time_sub_time(now, atomic_load(&wake_time));
+        atomic_fetch_add(&woken, 1);
+    }
+}
+
+static int compare_durations(const void* a, const void* b) {
+    zx_duration_t x = *(const zx_duration_t*)a;
+    zx_duration_t y = *(const zx_duration_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int wakeup_stress(int num_threads, int rounds) {
+    printf("Running wakeup storm: %d threads, %d rounds, %u cpus\n",
+           num_threads, rounds, zx_system_get_num_cpus());
+
+    thrd_t* threads = calloc(num_threads, sizeof(*threads));
+    latencies = calloc(num_threads, sizeof(*latencies));
+    zx_duration_t* all = calloc((size_t)num_threads * rounds, sizeof(*all));
+    if (!threads || !latencies || !all) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    for (int i = 0; i < num_threads; ++i) {
+        int ret = thrd_create_with_name(&threads[i], waiter_func, (void*)(uintptr_t)i, "waiter");
+        if (ret != thrd_success) {
+            printf("Failed to create thread: %d\n", ret);
+            return 1;
+        }
+    }
+
+    // the waiters' own startup is not part of the storm
+    lock_stats_t* lock_stats = lock_stats_create();
+    if (lock_stats) {
+        lock_stats_start(lock_stats);
+    }
+
+    zx_duration_t storm_total = 0;
+    for (int round = 0; round < rounds; ++round) {
+        // wait until every waiter is about to block, then give them time to
+        // actually get into the kernel so the wakeups are real ones
+        while (atomic_load(&waiting) != num_threads) {
+            thrd_yield();
+        }
+        zx_nanosleep(zx_deadline_after(ZX_MSEC(1)));
+        atomic_store(&waiting, 0);
+        atomic_store(&woken, 0);
+
+        zx_time_t start = zx_clock_get_monotonic();
+        atomic_store(&wake_time, start);
+        atomic_fetch_add(&generation, 1);
+        zx_futex_wake(&generation, UINT32_MAX);
+
+        while (atomic_load(&woken) != num_threads) {
+            thrd_yield();
+        }
+        storm_total += zx_time_sub_time(zx_clock_get_monotonic(), start);
+
+        memcpy(&all[(size_t)round * num_threads], latencies, num_threads * sizeof(*latencies));
+    }
+
+    if (lock_stats) {
+        lock_stats_print(lock_stats);
+        lock_stats_destroy(lock_stats);
+    } else {
+        printf("thread lock statistics unavailable\n");
+    }
+
+    atomic_store(&stop_waiters, true);
+    while (atomic_load(&waiting) != num_threads) {
+        thrd_yield();
+    }
+    atomic_fetch_add(&generation, 1);
+    zx_futex_wake(&generation, UINT32_MAX);
+    for (int i = 0; i < num_threads; ++i) {
+        thread_join(threads[i]);
+    }
+
+    size_t count = (size_t)num_threads * rounds;
+    qsort(all, count, sizeof(*all), compare_durations);
+    zx_duration_t sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+        sum += all[i];
+    }
+    printf("wakeup latency: min %.1fus avg %.1fus p50 %.1fus p99 %.1fus max %.1fus\n",
+           all[0] / 1e3, sum / (double)count / 1e3, all[count / 2] / 1e3,
+           all[count * 99 / 100] / 1e3, all[count - 1] / 1e3);
+    printf("storm completion: avg %.1fus per round\n", storm_total / (double)rounds / 1e3);
+    printf("compare runs with kernel.sched.wakeup-queue=true/false\n");
+
+    free(all);
+    free(latencies);
+    free(threads);
     return 0;
 }
+
+static void usage(const char* argv0) {
+    printf("Usage: %s [wakeup [threads] [rounds]]\n", argv0);
+    printf("  with no arguments, creates and joins %d threads in a loop\n", NUM_THREADS);
+    printf("  wakeup: wakes a group of blocked threads at once and reports the\n"
+           "          wakeup latency and the thread lock's contention, spin and\n"
+           "          hold times (default %d threads, %d rounds)\n",
+           WAKEUP_THREADS, WAKEUP_ROUNDS);
+}
+
+int main(int argc, char** argv) {
+    if (argc == 1) {
+        create_join_stress();
+        return 0;
+    }
+    if (strcmp(argv[1], "wakeup") == 0) {
+        int num_threads = (argc > 2) ? atoi(argv[2]) : WAKEUP_THREADS;
+        int rounds = (argc > 3) ? atoi(argv[3]) : WAKEUP_ROUNDS;
+        if (num_threads <= 0 || rounds <= 0) {
+            usage(argv[0]);
+            return 1;
+        }
+        return wakeup_stress(num_threads, rounds);
+    }
+    usage(argv[0]);
+    return 1;
+}
@@ -26,6 +26,9 @@
 // The port wait key associated with the dispatcher's control messages.
 #define KEY_CONTROL (0u)
 
+// The maximum number of packets read from the port per wakeup.
+#define MAX_BATCH_PACKETS (16u)
+
 static zx_time_t async_loop_now(async_dispatcher_t* dispatcher);
 static zx_status_t async_loop_begin_wait(async_dispatcher_t* dispatcher, async_wait_t* wait);
 static zx_status_t async_loop_cancel_wait(async_dispatcher_t* dispatcher, async_wait_t* wait);
@@ -90,9 +93,20 @@ typedef struct async_loop {
     list_node_t due_list; // due tasks, earliest deadline first
     list_node_t thread_list; // earliest created thread first
     list_node_t exception_list; // most recently added first
+
+    // Packets read from the port but not dispatched yet, guarded by |lock|.
+    // Only one thread at a time reads batches, and only while it is the sole
+    // dispatch thread; see |async_loop_next_packet|.
+    bool batch_reading;
+    uint32_t batch_next; // index of the next packet to dispatch
+    uint32_t batch_count;
+    zx_port_packet_t batch[MAX_BATCH_PACKETS];
 } async_loop_t;
 
 static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline);
+static zx_status_t async_loop_next_packet(async_loop_t* loop, zx_time_t deadline,
+                                          zx_port_packet_t* out_packet);
+static bool async_loop_remove_batched_packet_locked(async_loop_t* loop, uint64_t key);
 static zx_status_t async_loop_dispatch_wait(async_loop_t* loop, async_wait_t* wait,
                                             zx_status_t status, const zx_packet_signal_t* signal);
 static zx_status_t async_loop_dispatch_tasks(async_loop_t* loop);
@@ -207,6 +221,11 @@ void async_loop_shutdown(async_loop_t* loop) {
     async_loop_wake_threads(loop);
     async_loop_join_threads(loop);
 
+    // Waits whose packets were read but not dispatched are still on the wait
+    // list and get canceled below along with the rest.
+    loop->batch_next = 0u;
+    loop->batch_count = 0u;
+
     list_node_t* node;
     while ((node = list_remove_head(&loop->wait_list))) {
         async_wait_t* wait = node_to_wait(node);
@@ -259,7 +278,7 @@ static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline) {
         return ZX_ERR_CANCELED;
 
     zx_port_packet_t packet;
-    zx_status_t status = zx_port_wait(loop->port, deadline, &packet);
+    zx_status_t status = async_loop_next_packet(loop, deadline, &packet);
     if (status != ZX_OK)
         return status;
 
@@ -308,6 +327,64 @@ static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline) {
     return ZX_ERR_INTERNAL;
 }
 
+// Returns the next packet to dispatch, reading more from the port when none
+// are left over from the last read.
+//
+// A loop with a single dispatch thread reads up to |MAX_BATCH_PACKETS| at a
+// time and hands them out over the following calls, which saves a syscall per
+// packet under load.  Loops with several threads read one packet at a time
+// so that every ready packet is available to an idle thread.
+static zx_status_t async_loop_next_packet(async_loop_t* loop, zx_time_t deadline,
+                                          zx_port_packet_t* out_packet) {
+    mtx_lock(&loop->lock);
+    if (loop->batch_next < loop->batch_count) {
+        *out_packet = loop->batch[loop->batch_next++];
+        mtx_unlock(&loop->lock);
+        return ZX_OK;
+    }
+    bool batch = !loop->batch_reading &&
+        atomic_load_explicit(&loop->active_threads, memory_order_acquire) == 1u;
+    if (batch)
+        loop->batch_reading = true;
+    mtx_unlock(&loop->lock);
+
+    if (!batch)
+        return zx_port_wait(loop->port, deadline, out_packet);
+
+    zx_port_packet_t packets[MAX_BATCH_PACKETS];
+    size_t count = 0u;
+    zx_status_t status = zx_port_wait_many(loop->port, deadline, packets,
+                                           MAX_BATCH_PACKETS, &count);
+
+    mtx_lock(&loop->lock);
+    loop->batch_reading = false;
+    if (status == ZX_OK) {
+        // Nobody else adds to the batch while we are reading, and it was
+        // empty when we started, so it can only have been drained since.
+        ZX_DEBUG_ASSERT(loop->batch_next == loop->batch_count);
+        *out_packet = packets[0];
+        for (size_t i = 1u; i < count; i++)
+            loop->batch[i - 1u] = packets[i];
+        loop->batch_next = 0u;
+        loop->batch_count = (uint32_t)(count - 1u);
+    }
+    mtx_unlock(&loop->lock);
+    return status;
+}
+
+// Drops the undispatched packet with |key| from the batch, if there is one.
+static bool async_loop_remove_batched_packet_locked(async_loop_t* loop, uint64_t key) {
+    for (uint32_t i = loop->batch_next; i < loop->batch_count; i++) {
+        if (loop->batch[i].key == key) {
+            for (uint32_t j = i + 1u; j < loop->batch_count; j++)
+                loop->batch[j - 1u] = loop->batch[j];
+            loop->batch_count--;
+            return true;
+        }
+    }
+    return false;
+}
+
 async_dispatcher_t* async_loop_get_dispatcher(async_loop_t* loop) {
     // Note: The loop's implementation inherits from async_t so we can upcast to it.
     return (async_dispatcher_t*)loop;
@@ -525,9 +602,14 @@ static zx_status_t async_loop_cancel_wait(async_dispatcher_t* async, async_wait_
 
     // Next, cancel the wait.  This may be racing with another thread that
     // has read the wait's packet but not yet dispatched it.  So if we fail
-    // to cancel then we assume we lost the race.
+    // to cancel then we assume we lost the race, unless the packet is still
+    // sitting in our batch where we can take it back.
     zx_status_t status = zx_port_cancel(loop->port, wait->object,
                                         (uintptr_t)wait);
+    if (status == ZX_ERR_NOT_FOUND &&
+        async_loop_remove_batched_packet_locked(loop, (uintptr_t)wait)) {
+        status = ZX_OK;
+    }
     if (status == ZX_OK) {
         list_delete(node);
     } else {
@@ -681,6 +763,11 @@ static zx_status_t async_loop_unbind_exception_port(async_dispatcher_t* async,
 
     if (status == ZX_OK) {
         list_delete(node);
+
+        // Exception reports already read from the port must not reach the
+        // handler either.
+        while (async_loop_remove_batched_packet_locked(loop, key))
+            ;
     }
 
     mtx_unlock(&loop->lock);
@@ -81,7 +81,7 @@ zx_status_t buffer_create_merkle(const FileMapping& mapping, MerkleInfo* out_inf
 }
 
 zx_status_t buffer_compress(const FileMapping& mapping, MerkleInfo* out_info) {
-    size_t max = Compressor::BufferMax(mapping.length());
+    size_t max = ChunkedCompressor::BufferMax(mapping.length());
     out_info->compressed_data.reset(new uint8_t[max]);
     out_info->compressed = false;
 
@@ -90,8 +90,9 @@ zx_status_t buffer_compress(const FileMapping& mapping, MerkleInfo* out_info) {
     }
 
     zx_status_t status;
-    Compressor compressor;
-    if ((status = compressor.Initialize(out_info->compressed_data.get(), max)) != ZX_OK) {
+    ChunkedCompressor compressor;
+    if ((status = compressor.Initialize(out_info->compressed_data.get(), max,
+                                        mapping.length())) != ZX_OK) {
         FS_TRACE_ERROR("Failed to initialize blobfs compressor: %d\n", status);
         return status;
     }
@@ -145,7 +146,7 @@ zx_status_t blobfs_add_mapped_blob_with_merkle(Blobfs* bs, const FileMapping& ma
     Inode* inode = inode_block->GetInode();
     inode->blob_size = mapping.length();
     inode->block_count = MerkleTreeBlocks(*inode) + info.GetDataBlocks();
-    inode->header.flags |= kBlobFlagAllocated | (info.compressed ? kBlobFlagLZ4Compressed : 0);
+    inode->header.flags |= kBlobFlagAllocated | (info.compressed ? kBlobFlagChunkCompressed : 0);
 
     // TODO(smklein): Currently, host-side tools can only generate single-extent
     // blobs. This should be fixed.
@@ -586,7 +587,7 @@ zx_status_t Blobfs::VerifyBlob(uint32_t node_index) {
 
     // Create data buffer.
     fbl::unique_ptr<uint8_t[]> data(new uint8_t[target_size]);
-    if (inode.header.flags & kBlobFlagLZ4Compressed) {
+    if (inode.header.flags & (kBlobFlagLZ4Compressed | kBlobFlagChunkCompressed)) {
         // Read in uncompressed merkle blocks.
         for (unsigned i = 0; i < merkle_blocks; i++) {
             ReadBlock(data_start_block_ + inode.extents[0].Start() + i);
@@ -614,8 +615,20 @@ zx_status_t Blobfs::VerifyBlob(uint32_t node_index) {
         zx_status_t status;
         target_size = inode.blob_size;
         uint8_t* data_ptr = data.get() + (merkle_blocks * kBlobfsBlockSize);
-        if ((status = Decompressor::Decompress(data_ptr, &target_size, compressed_data.get(),
-                                               &compressed_size)) != ZX_OK) {
+        if (inode.header.flags & kBlobFlagChunkCompressed) {
+            if ((status = Decompressor::CheckChunked(compressed_data.get(), compressed_size,
+                                                     inode.blob_size)) != ZX_OK) {
+                return status;
+            }
+            const uint64_t chunks = CompressionChunks(inode.blob_size);
+            if ((status = Decompressor::DecompressChunks(data_ptr, inode.blob_size,
+                                                         compressed_data.get(), 0,
+                                                         chunks)) != ZX_OK) {
+                return status;
+            }
+        } else if ((status = Decompressor::Decompress(data_ptr, &target_size,
+                                                      compressed_data.get(),
+                                                      &compressed_size)) != ZX_OK) {
             return status;
         }
         if (target_size != inode.blob_size) {
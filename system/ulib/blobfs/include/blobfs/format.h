@@ -28,7 +28,7 @@
 namespace blobfs {
 constexpr uint64_t kBlobfsMagic0  = (0xac2153479e694d21ULL);
 constexpr uint64_t kBlobfsMagic1  = (0x985000d4d4d3d314ULL);
-constexpr uint32_t kBlobfsVersion = 0x00000007;
+constexpr uint32_t kBlobfsVersion = 0x00000008;
 
 constexpr uint32_t kBlobFlagClean        = 1;
 constexpr uint32_t kBlobFlagDirty        = 2;
@@ -263,6 +263,10 @@ constexpr uint16_t kBlobFlagLZ4Compressed = 1 << 1;
 // Identifies that this node is a container for extents.
 constexpr uint16_t kBlobFlagExtentContainer = 1 << 2;
 
+// Identifies that the on-disk storage of the blob is LZ4 compressed in independently
+// decompressible chunks, described by a ChunkedHeader and seek table.
+constexpr uint16_t kBlobFlagChunkCompressed = 1 << 3;
+
 // The number of extents within a normal inode.
 constexpr uint32_t kInlineMaxExtents = 1;
 // The number of extents within an extent container node.
@@ -325,4 +329,41 @@ constexpr uint64_t BlobDataBlocks(const Inode& blobNode) {
     return fbl::round_up(blobNode.blob_size, kBlobfsBlockSize) / kBlobfsBlockSize;
 }
 
+constexpr uint64_t kChunkedCompressionMagic = (0x6b6e756863347a6cULL);
+
+// The number of decompressed bytes in each chunk of a chunk-compressed blob; only the
+// last chunk may be shorter. Chunks are whole blocks, and so whole Merkle tree nodes,
+// so each one can be verified without the rest of the blob.
+constexpr uint32_t kCompressionChunkSize = 8 * kBlobfsBlockSize;
+constexpr uint32_t kCompressionChunkBlocks = kCompressionChunkSize / kBlobfsBlockSize;
+
+// The compressed data of a chunk-compressed blob starts with a ChunkedHeader, followed by
+// |chunk_count| SeekTableEntry structures, followed by the chunks themselves in order.
+// Each chunk is a complete LZ4 frame.
+struct ChunkedHeader {
+    uint64_t magic;
+    uint32_t chunk_size;
+    uint32_t chunk_count;
+};
+
+struct SeekTableEntry {
+    // Offset of the chunk's frame from the start of the ChunkedHeader.
+    uint64_t offset;
+    // Length of the chunk's frame.
+    uint64_t length;
+};
+
+static_assert(kCompressionChunkSize % kBlobfsBlockSize == 0,
+              "Compression chunks must be made of whole blocks");
+
+// Number of chunks in a chunk-compressed blob of |blob_size| decompressed bytes.
+constexpr uint64_t CompressionChunks(uint64_t blob_size) {
+    return fbl::round_up(blob_size, kCompressionChunkSize) / kCompressionChunkSize;
+}
+
+// Size of the ChunkedHeader and seek table of a chunk-compressed blob with |chunk_count| chunks.
+constexpr uint64_t ChunkedHeaderSize(uint64_t chunk_count) {
+    return sizeof(ChunkedHeader) + chunk_count * sizeof(SeekTableEntry);
+}
+
 } // namespace blobfs
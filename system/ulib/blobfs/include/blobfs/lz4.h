@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <blobfs/format.h>
 #include <fbl/macros.h>
 #include <lz4/lz4frame.h>
 #include <zircon/types.h>
@@ -66,6 +67,74 @@ private:
     size_t buf_used_ = 0;
 };
 
+// A ChunkedCompressor compresses a blob into the chunked format described by
+// ChunkedHeader, so that pieces of the blob can be decompressed on their own.
+//
+// Its interface matches Compressor, except that the final size of the blob
+// must be known up front.
+class ChunkedCompressor {
+public:
+    ChunkedCompressor();
+
+    ~ChunkedCompressor();
+
+    // Returns the maximum possible size a buffer would need to be
+    // in order to compress a blob of size |blob_size|.
+    static size_t BufferMax(size_t blob_size);
+
+    // Identifies if compression is underway.
+    bool Compressing() const {
+        return buf_ != nullptr;
+    }
+
+    // Resets the compression process.
+    void Reset();
+
+    // Initializes the compression object with a provided buffer of a specified size,
+    // for a blob of |blob_size| bytes.
+    //
+    // Although ChunkedCompressor uses this buffer, it does not own the buffer,
+    // assuming that a parent object is responsible for the lifetime.
+    zx_status_t Initialize(void* buf, size_t buf_max, size_t blob_size);
+
+    // The following functions are only safe to call after |Initialize()|.
+
+    // Returns the compressed size of the blob so far, including the header and
+    // seek table.
+    size_t Size() const;
+
+    // Continues the compression after initialization.
+    zx_status_t Update(const void* data, size_t length);
+
+    // Finishes the compression process, once all |blob_size| bytes have been
+    // passed to |Update()|.
+    zx_status_t End();
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(ChunkedCompressor);
+
+    void* Buffer() const {
+        return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(buf_) + buf_used_);
+    }
+
+    size_t buf_remaining() const { return buf_max_ - buf_used_; }
+
+    SeekTableEntry* SeekTable() const {
+        return reinterpret_cast<SeekTableEntry*>(reinterpret_cast<uintptr_t>(buf_) +
+                                                 sizeof(ChunkedHeader));
+    }
+
+    LZ4F_compressionContext_t ctx_ = {};
+    void* buf_ = nullptr;
+    size_t buf_max_ = 0;
+    size_t buf_used_ = 0;
+    size_t blob_size_ = 0;
+    // The chunk being compressed, and the bytes still to come before it is finished.
+    uint64_t chunk_ = 0;
+    uint64_t chunk_count_ = 0;
+    size_t chunk_remaining_ = 0;
+};
+
 // A Decompressor is used to decompress a blob transparently before it is
 // read back from disk.
 class Decompressor {
@@ -75,6 +144,19 @@ public:
     // filled (or both).
     static zx_status_t Decompress(void* target_buf, size_t* target_size,
                                   const void* src_buf, size_t* src_size);
+
+    // Checks the ChunkedHeader and seek table at the start of |src_buf|, which holds
+    // the |src_size| bytes of compressed data of a chunk-compressed blob of |blob_size|
+    // bytes. Only the header and seek table need to have been read into |src_buf|.
+    static zx_status_t CheckChunked(const void* src_buf, size_t src_size, uint64_t blob_size);
+
+    // Decompresses chunks [|first|, |last|) of a chunk-compressed blob into |target_buf|,
+    // which holds the whole |blob_size| bytes of the decompressed blob. Only the header,
+    // seek table and those chunks need to have been read into |src_buf|.
+    //
+    // CheckChunked() must have already succeeded for |src_buf|.
+    static zx_status_t DecompressChunks(void* target_buf, uint64_t blob_size,
+                                        const void* src_buf, uint64_t first, uint64_t last);
 };
 
 } // namespace blobfs
@@ -12,6 +12,8 @@
 
 #include <string.h>
 
+#include <bitmap/raw-bitmap.h>
+#include <bitmap/storage.h>
 #include <digest/digest.h>
 #include <fbl/algorithm.h>
 #include <fbl/intrusive_wavl_tree.h>
@@ -222,12 +224,14 @@ private:
     // Requires: kBlobStateReadable
     zx_status_t ReadInternal(void* data, size_t len, size_t off, size_t* actual);
 
-    // Reads both VMOs into memory, if we haven't already.
+    // Creates the blob's VMO and reads its Merkle tree into memory, if we haven't already.
     //
-    // TODO(ZX-1481): When we have can register the Blob Store as a pager
-    // service, and it can properly handle pages faults on a vnode's contents,
-    // then we can avoid reading the entire blob up-front. Until then, read
-    // the contents of a VMO into memory when it is opened.
+    // Blobs in the older, single-frame compressed format are also read, decompressed and
+    // verified in full. The data of other blobs is left on disk until LoadData() asks for it.
+    //
+    // TODO(ZX-1481): When we can register the Blob Store as a pager service, page faults
+    // on cloned VMOs could be served by LoadData() too. Until then, clones force the
+    // whole blob into memory.
     zx_status_t InitVmos();
 
     // Initializes a compressed blob by reading it from disk and decompressing
@@ -235,13 +239,37 @@ private:
     // Does not verify the blob.
     zx_status_t InitCompressed();
 
-    // Initializes a decompressed blob by reading it from disk.
-    // Does not verify the blob.
+    // Initializes an uncompressed blob by reading its Merkle tree from disk.
     zx_status_t InitUncompressed();
 
+    // Initializes a chunk-compressed blob by reading its Merkle tree and seek table
+    // from disk, and checking the seek table.
+    zx_status_t InitChunkCompressed();
+
+    // Ensures the data of the blob between |off| and |off| + |len| is in memory and
+    // verified, reading and verifying any blocks in that range which haven't been yet.
+    // InitVmos() must have already been called for this blob.
+    zx_status_t LoadData(uint64_t off, uint64_t len);
+
+    // Reads data blocks [|start|, |end|) of the blob from disk, decompressing them if the
+    // blob is chunk-compressed, in which case the blocks must make up whole chunks.
+    // Does not verify the blocks.
+    zx_status_t ReadDataBlocks(uint64_t start, uint64_t end);
+
+    // Reads chunks [|first|, |last|) of a chunk-compressed blob from disk and
+    // decompresses them.
+    // Does not verify the chunks.
+    zx_status_t ReadChunks(uint64_t first, uint64_t last);
+
+    // Releases the compressed copy of a chunk-compressed blob, if we have one.
+    void ReleaseCompressedMapping();
+
     // Verifies the integrity of the in-memory Blob.
     // InitVmos() must have already been called for this blob.
-    zx_status_t Verify() const;
+    zx_status_t Verify() const { return Verify(0, inode_.blob_size); }
+
+    // Verifies the integrity of the in-memory Blob between |off| and |off| + |len|.
+    zx_status_t Verify(uint64_t off, uint64_t len) const;
 
     // Called by the Vnode once the last write has completed, updating the
     // on-disk metadata.
@@ -261,6 +289,15 @@ private:
     fzl::OwnedVmoMapper mapping_;
     vmoid_t vmoid_ = {};
 
+    // One bit per data block of a blob being read on demand, set once the block has been
+    // read and verified. Empty when the whole blob is in |mapping_|.
+    bitmap::RawBitmapGeneric<bitmap::DefaultStorage> loaded_blocks_;
+
+    // For a chunk-compressed blob being read on demand: the compressed blob, of which the
+    // seek table and any chunks which have been needed so far have been read from disk.
+    fzl::OwnedVmoMapper compressed_mapping_;
+    vmoid_t compressed_vmoid_ = {};
+
     // Watches any clones of "vmo_" provided to clients.
     // Observes the ZX_VMO_ZERO_CHILDREN signal.
     async::WaitMethod<VnodeBlob, &VnodeBlob::HandleNoClones> clone_watcher_;
@@ -289,7 +326,7 @@ private:
         fbl::Vector<ReservedExtent> extents;
         fbl::Vector<ReservedNode> node_indices;
 
-        Compressor compressor;
+        ChunkedCompressor compressor;
         fzl::OwnedVmoMapper compressed_blob;
     };
 
@@ -2,8 +2,10 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <inttypes.h>
 #include <lz4/lz4frame.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <fbl/algorithm.h>
@@ -15,6 +17,8 @@
 
 #include <blobfs/lz4.h>
 
+#include <limits>
+
 namespace blobfs {
 
 constexpr size_t kLz4HeaderSize = 15;
@@ -82,6 +86,121 @@ size_t Compressor::Size() const {
     return buf_used_;
 }
 
+ChunkedCompressor::ChunkedCompressor() {}
+
+ChunkedCompressor::~ChunkedCompressor() {
+    Reset();
+}
+
+void ChunkedCompressor::Reset() {
+    if (Compressing()) {
+        LZ4F_freeCompressionContext(ctx_);
+    }
+    buf_ = nullptr;
+    buf_max_ = 0;
+    buf_used_ = 0;
+    blob_size_ = 0;
+    chunk_ = 0;
+    chunk_count_ = 0;
+    chunk_remaining_ = 0;
+}
+
+size_t ChunkedCompressor::BufferMax(size_t blob_size) {
+    const uint64_t chunks = CompressionChunks(blob_size);
+    return ChunkedHeaderSize(chunks) +
+           chunks * (kLz4HeaderSize + LZ4F_compressBound(kCompressionChunkSize, nullptr));
+}
+
+zx_status_t ChunkedCompressor::Initialize(void* buf, size_t buf_max, size_t blob_size) {
+    ZX_DEBUG_ASSERT(!Compressing());
+    const uint64_t chunk_count = CompressionChunks(blob_size);
+    const uint64_t header_size = ChunkedHeaderSize(chunk_count);
+    if (chunk_count > std::numeric_limits<uint32_t>::max()) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+    if (buf_max < header_size) {
+        return ZX_ERR_BUFFER_TOO_SMALL;
+    }
+    LZ4F_errorCode_t errc = LZ4F_createCompressionContext(&ctx_, LZ4F_VERSION);
+    if (LZ4F_isError(errc)) {
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    buf_ = buf;
+    buf_max_ = buf_max;
+    buf_used_ = header_size;
+    blob_size_ = blob_size;
+    chunk_ = 0;
+    chunk_count_ = chunk_count;
+    chunk_remaining_ = 0;
+
+    // The seek table is filled in as each chunk is finished.
+    memset(buf_, 0, header_size);
+    ChunkedHeader* header = reinterpret_cast<ChunkedHeader*>(buf_);
+    header->magic = kChunkedCompressionMagic;
+    header->chunk_size = kCompressionChunkSize;
+    header->chunk_count = static_cast<uint32_t>(chunk_count);
+    return ZX_OK;
+}
+
+zx_status_t ChunkedCompressor::Update(const void* data, size_t length) {
+    ZX_DEBUG_ASSERT(Compressing());
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(data);
+    while (length > 0) {
+        if (chunk_remaining_ == 0) {
+            // Start the frame of the next chunk.
+            if (chunk_ == chunk_count_) {
+                return ZX_ERR_OUT_OF_RANGE;
+            }
+            size_t r = LZ4F_compressBegin(ctx_, Buffer(), buf_remaining(), nullptr);
+            if (LZ4F_isError(r)) {
+                return ZX_ERR_BUFFER_TOO_SMALL;
+            }
+            SeekTable()[chunk_].offset = buf_used_;
+            buf_used_ += r;
+            chunk_remaining_ = fbl::min<size_t>(kCompressionChunkSize,
+                                                blob_size_ - chunk_ * kCompressionChunkSize);
+        }
+
+        const size_t chunk_length = fbl::min(length, chunk_remaining_);
+        size_t r = LZ4F_compressUpdate(ctx_, Buffer(), buf_remaining(), src, chunk_length,
+                                       nullptr);
+        if (LZ4F_isError(r)) {
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+        buf_used_ += r;
+        src += chunk_length;
+        length -= chunk_length;
+        chunk_remaining_ -= chunk_length;
+
+        if (chunk_remaining_ == 0) {
+            // Finish the chunk's frame, so it can be decompressed on its own.
+            r = LZ4F_compressEnd(ctx_, Buffer(), buf_remaining(), nullptr);
+            if (LZ4F_isError(r)) {
+                return ZX_ERR_IO_DATA_INTEGRITY;
+            }
+            buf_used_ += r;
+            SeekTableEntry* entry = &SeekTable()[chunk_];
+            entry->length = buf_used_ - entry->offset;
+            chunk_++;
+        }
+    }
+    return ZX_OK;
+}
+
+zx_status_t ChunkedCompressor::End() {
+    ZX_DEBUG_ASSERT(Compressing());
+    if (chunk_ != chunk_count_) {
+        return ZX_ERR_BAD_STATE;
+    }
+    return ZX_OK;
+}
+
+size_t ChunkedCompressor::Size() const {
+    ZX_DEBUG_ASSERT(Compressing());
+    return buf_used_;
+}
+
 zx_status_t Decompressor::Decompress(void* target_buf_, size_t* target_size,
                                      const void* src_buf_, size_t* src_size) {
     TRACE_DURATION("blobfs", "Decompressor::Decompress", "target_size", *target_size,
@@ -133,4 +252,64 @@ zx_status_t Decompressor::Decompress(void* target_buf_, size_t* target_size,
     return ZX_OK;
 }
 
+zx_status_t Decompressor::CheckChunked(const void* src_buf, size_t src_size,
+                                       uint64_t blob_size) {
+    if (src_size < sizeof(ChunkedHeader)) {
+        FS_TRACE_ERROR("blobfs: Compressed blob too small for header\n");
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    const ChunkedHeader* header = reinterpret_cast<const ChunkedHeader*>(src_buf);
+    if (header->magic != kChunkedCompressionMagic ||
+        header->chunk_size != kCompressionChunkSize ||
+        header->chunk_count != CompressionChunks(blob_size)) {
+        FS_TRACE_ERROR("blobfs: Bad compressed blob header\n");
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    const uint64_t header_size = ChunkedHeaderSize(header->chunk_count);
+    if (src_size < header_size) {
+        FS_TRACE_ERROR("blobfs: Compressed blob too small for seek table\n");
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    // The chunks must follow the seek table, back to back and in order.
+    const SeekTableEntry* table = reinterpret_cast<const SeekTableEntry*>(header + 1);
+    uint64_t next_offset = header_size;
+    for (uint64_t i = 0; i < header->chunk_count; i++) {
+        if (table[i].offset != next_offset || table[i].length == 0 ||
+            table[i].length > src_size - next_offset) {
+            FS_TRACE_ERROR("blobfs: Bad seek table entry %" PRIu64 "\n", i);
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+        next_offset += table[i].length;
+    }
+    return ZX_OK;
+}
+
+zx_status_t Decompressor::DecompressChunks(void* target_buf, uint64_t blob_size,
+                                           const void* src_buf, uint64_t first, uint64_t last) {
+    TRACE_DURATION("blobfs", "Decompressor::DecompressChunks", "first", first, "last", last);
+    const ChunkedHeader* header = reinterpret_cast<const ChunkedHeader*>(src_buf);
+    const SeekTableEntry* table = reinterpret_cast<const SeekTableEntry*>(header + 1);
+    ZX_DEBUG_ASSERT(first <= last && last <= header->chunk_count);
+
+    for (uint64_t i = first; i < last; i++) {
+        const uint64_t offset = i * kCompressionChunkSize;
+        const size_t expected_size = fbl::min<uint64_t>(kCompressionChunkSize,
+                                                        blob_size - offset);
+        size_t target_size = expected_size;
+        size_t src_size = table[i].length;
+        zx_status_t status = Decompress(
+            reinterpret_cast<uint8_t*>(target_buf) + offset, &target_size,
+            reinterpret_cast<const uint8_t*>(src_buf) + table[i].offset, &src_size);
+        if (status != ZX_OK) {
+            return status;
+        }
+        if (target_size != expected_size || src_size != table[i].length) {
+            FS_TRACE_ERROR("blobfs: Failed to fully decompress chunk %" PRIu64 "\n", i);
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+    }
+    return ZX_OK;
+}
+
 } // namespace blobfs
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <algorithm>
 #include <memory>
@@ -176,6 +177,135 @@ bool BufferTooSmall() {
     END_TEST;
 }
 
+bool ChunkedCompressionHelper(ChunkedCompressor* compressor, const char* input, size_t size,
+                              size_t step, std::unique_ptr<char[]>* out_compressed) {
+    BEGIN_HELPER;
+
+    size_t max_output = ChunkedCompressor::BufferMax(size);
+    std::unique_ptr<char[]> compressed(new char[max_output]);
+    ASSERT_EQ(ZX_OK, compressor->Initialize(compressed.get(), max_output, size));
+    EXPECT_TRUE(compressor->Compressing());
+
+    size_t offset = 0;
+    while (offset != size) {
+        const size_t incremental_size = std::min(step, size - offset);
+        ASSERT_EQ(ZX_OK, compressor->Update(input + offset, incremental_size));
+        offset += incremental_size;
+    }
+    ASSERT_EQ(ZX_OK, compressor->End());
+    EXPECT_GT(compressor->Size(), ChunkedHeaderSize(CompressionChunks(size)));
+
+    *out_compressed = std::move(compressed);
+
+    END_HELPER;
+}
+
+// Tests compressing a blob into chunks, and decompressing them all.
+//
+// kSize: The Size of the input buffer.
+// kStep: The step size of updating the compression buffer.
+template <size_t kSize, size_t kStep>
+bool ChunkedCompressDecompressRandom() {
+    BEGIN_TEST;
+
+    std::unique_ptr<char[]> input(GenerateInput(0, kSize));
+    ChunkedCompressor compressor;
+    std::unique_ptr<char[]> compressed;
+    ASSERT_TRUE(ChunkedCompressionHelper(&compressor, input.get(), kSize, kStep, &compressed));
+
+    ASSERT_EQ(ZX_OK, Decompressor::CheckChunked(compressed.get(), compressor.Size(), kSize));
+    std::unique_ptr<char[]> output(new char[kSize]);
+    ASSERT_EQ(ZX_OK, Decompressor::DecompressChunks(output.get(), kSize, compressed.get(), 0,
+                                                    CompressionChunks(kSize)));
+    EXPECT_EQ(0, memcmp(input.get(), output.get(), kSize));
+
+    END_TEST;
+}
+
+// Tests that each chunk can be decompressed without any of the others.
+bool ChunkedDecompressSingleChunks() {
+    BEGIN_TEST;
+
+    const size_t size = 5 * kCompressionChunkSize + 1234;
+    std::unique_ptr<char[]> input(GenerateInput(0, size));
+    ChunkedCompressor compressor;
+    std::unique_ptr<char[]> compressed;
+    ASSERT_TRUE(ChunkedCompressionHelper(&compressor, input.get(), size, 4096, &compressed));
+
+    const uint64_t chunks = CompressionChunks(size);
+    ASSERT_EQ(6, chunks);
+    for (uint64_t i = chunks; i-- > 0;) {
+        // Only hand over the header, seek table and the chunk being decompressed.
+        const auto table = reinterpret_cast<const SeekTableEntry*>(compressed.get() +
+                                                                   sizeof(ChunkedHeader));
+        std::unique_ptr<char[]> partial(new char[compressor.Size()]);
+        memset(partial.get(), 0, compressor.Size());
+        memcpy(partial.get(), compressed.get(), ChunkedHeaderSize(chunks));
+        memcpy(partial.get() + table[i].offset, compressed.get() + table[i].offset,
+               table[i].length);
+
+        std::unique_ptr<char[]> output(new char[size]);
+        ASSERT_EQ(ZX_OK, Decompressor::DecompressChunks(output.get(), size, partial.get(), i,
+                                                        i + 1));
+        const size_t offset = i * kCompressionChunkSize;
+        const size_t length = std::min<size_t>(kCompressionChunkSize, size - offset);
+        EXPECT_EQ(0, memcmp(input.get() + offset, output.get() + offset, length));
+    }
+
+    END_TEST;
+}
+
+// Tests that damaged headers and seek tables are caught before decompressing.
+bool ChunkedCheckCorruption() {
+    BEGIN_TEST;
+
+    const size_t size = 3 * kCompressionChunkSize;
+    std::unique_ptr<char[]> input(GenerateInput(0, size));
+    ChunkedCompressor compressor;
+    std::unique_ptr<char[]> compressed;
+    ASSERT_TRUE(ChunkedCompressionHelper(&compressor, input.get(), size, size, &compressed));
+    ASSERT_EQ(ZX_OK, Decompressor::CheckChunked(compressed.get(), compressor.Size(), size));
+
+    // The wrong blob size, or a truncated blob.
+    EXPECT_EQ(ZX_ERR_IO_DATA_INTEGRITY,
+              Decompressor::CheckChunked(compressed.get(), compressor.Size(), size + 1));
+    EXPECT_EQ(ZX_ERR_IO_DATA_INTEGRITY,
+              Decompressor::CheckChunked(compressed.get(), compressor.Size() - 1, size));
+
+    // A bad magic number.
+    auto header = reinterpret_cast<ChunkedHeader*>(compressed.get());
+    header->magic++;
+    EXPECT_EQ(ZX_ERR_IO_DATA_INTEGRITY,
+              Decompressor::CheckChunked(compressed.get(), compressor.Size(), size));
+    header->magic--;
+
+    // Overlapping chunks.
+    auto table = reinterpret_cast<SeekTableEntry*>(header + 1);
+    table[1].offset--;
+    EXPECT_EQ(ZX_ERR_IO_DATA_INTEGRITY,
+              Decompressor::CheckChunked(compressed.get(), compressor.Size(), size));
+    table[1].offset++;
+    ASSERT_EQ(ZX_OK, Decompressor::CheckChunked(compressed.get(), compressor.Size(), size));
+
+    END_TEST;
+}
+
+// Tests ChunkedCompressor refuses more data than the blob size it was given.
+bool ChunkedTooMuchData() {
+    BEGIN_TEST;
+
+    const size_t size = kCompressionChunkSize + 1;
+    std::unique_ptr<char[]> input(GenerateInput(0, size + 1));
+    const size_t max_output = ChunkedCompressor::BufferMax(size);
+    std::unique_ptr<char[]> compressed(new char[max_output]);
+    ChunkedCompressor compressor;
+    ASSERT_EQ(ZX_OK, compressor.Initialize(compressed.get(), max_output, size));
+    EXPECT_EQ(ZX_ERR_BAD_STATE, compressor.End());
+    ASSERT_EQ(ZX_ERR_OUT_OF_RANGE, compressor.Update(input.get(), size + 1));
+
+    END_TEST;
+}
+
 } // namespace
 } // namespace blobfs
 
@@ -188,4 +318,10 @@ RUN_TEST((blobfs::CompressDecompressRandom<1 << 15, 1 << 10>))
 RUN_TEST(blobfs::CompressDecompressReset)
 RUN_TEST(blobfs::UpdateNoData)
 RUN_TEST(blobfs::BufferTooSmall)
+RUN_TEST((blobfs::ChunkedCompressDecompressRandom<1 << 10, 1 << 5>))
+RUN_TEST((blobfs::ChunkedCompressDecompressRandom<1 << 16, 1 << 10>))
+RUN_TEST((blobfs::ChunkedCompressDecompressRandom<(1 << 20) + 7, 1 << 15>))
+RUN_TEST(blobfs::ChunkedDecompressSingleChunks)
+RUN_TEST(blobfs::ChunkedCheckCorruption)
+RUN_TEST(blobfs::ChunkedTooMuchData)
 END_TEST_CASE(blobfsCompressorTests);
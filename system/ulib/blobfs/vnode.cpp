@@ -99,24 +99,43 @@ zx_status_t EnqueuePaginated(fbl::unique_ptr<WritebackWork>* work, Blobfs* blobf
     return ZX_OK;
 }
 
+// Enqueues reads of blocks [|start|, |end|) of the blob at |map_index|, counted from
+// the start of its Merkle tree, into |vmoid|, with block |start| landing at block
+// |vmo_offset| of the VMO.
+zx_status_t EnqueueBlobRead(Blobfs* blobfs, uint32_t map_index, fs::ReadTxn* txn, vmoid_t vmoid,
+                            uint64_t start, uint64_t end, uint64_t vmo_offset) {
+    AllocatedExtentIterator extent_iter(blobfs->GetAllocator(), map_index);
+    BlockIterator block_iter(&extent_iter);
+    const uint64_t data_start = DataStartBlock(blobfs->Info());
+
+    // Skip past the blocks preceding |start|.
+    zx_status_t status = StreamBlocks(&block_iter, static_cast<uint32_t>(start),
+                                      [](uint64_t, uint64_t, uint32_t) { return ZX_OK; });
+    if (status != ZX_OK) {
+        return status;
+    }
+    return StreamBlocks(&block_iter, static_cast<uint32_t>(end - start),
+                        [&](uint64_t local_offset, uint64_t dev_offset, uint32_t length) {
+                            txn->Enqueue(vmoid, vmo_offset + (local_offset - start),
+                                         dev_offset + data_start, length);
+                            return ZX_OK;
+                        });
+}
+
 } // namespace
 
-zx_status_t VnodeBlob::Verify() const {
-    TRACE_DURATION("blobfs", "Blobfs::Verify");
+zx_status_t VnodeBlob::Verify(uint64_t off, uint64_t len) const {
+    TRACE_DURATION("blobfs", "Blobfs::Verify", "off", off, "len", len);
     fs::Ticker ticker(blobfs_->LocalMetrics().Collecting());
 
     const void* data = inode_.blob_size ? GetData() : nullptr;
     const void* tree = inode_.blob_size ? GetMerkle() : nullptr;
     const uint64_t data_size = inode_.blob_size;
     const uint64_t merkle_size = MerkleTree::GetTreeLength(data_size);
-    // TODO(smklein): We could lazily verify more of the VMO if
-    // we could fault in pages on-demand.
-    //
-    // For now, we aggressively verify the entire VMO up front.
     Digest digest(GetKey());
     zx_status_t status =
-        MerkleTree::Verify(data, data_size, tree, merkle_size, 0, data_size, digest);
-    blobfs_->LocalMetrics().UpdateMerkleVerify(data_size, merkle_size, ticker.End());
+        MerkleTree::Verify(data, data_size, tree, merkle_size, off, len, digest);
+    blobfs_->LocalMetrics().UpdateMerkleVerify(len, merkle_size, ticker.End());
 
     if (status != ZX_OK) {
         char name[Digest::kLength * 2 + 1];
@@ -166,14 +185,18 @@ zx_status_t VnodeBlob::InitVmos() {
         if ((status = InitCompressed()) != ZX_OK) {
             return status;
         }
+        if ((status = Verify()) != ZX_OK) {
+            return status;
+        }
+    } else if ((inode_.header.flags & kBlobFlagChunkCompressed) != 0) {
+        if ((status = InitChunkCompressed()) != ZX_OK) {
+            return status;
+        }
     } else {
         if ((status = InitUncompressed()) != ZX_OK) {
             return status;
         }
     }
-    if ((status = Verify()) != ZX_OK) {
-        return status;
-    }
 
     cleanup.cancel();
     return ZX_OK;
@@ -268,22 +291,147 @@ zx_status_t VnodeBlob::InitUncompressed() {
                    inode_.block_count);
     fs::Ticker ticker(blobfs_->LocalMetrics().Collecting());
     fs::ReadTxn txn(blobfs_);
-    AllocatedExtentIterator extent_iter(blobfs_->GetAllocator(), GetMapIndex());
-    BlockIterator block_iter(&extent_iter);
-    // Read both the uncompressed merkle tree and data.
+    // Read only the merkle tree; the data is read on demand by LoadData.
     const uint64_t blob_data_blocks = BlobDataBlocks(inode_);
     const uint64_t merkle_blocks = MerkleTreeBlocks(inode_);
     if (blob_data_blocks + merkle_blocks > std::numeric_limits<uint32_t>::max()) {
         return ZX_ERR_IO_DATA_INTEGRITY;
     }
-    const uint32_t length = static_cast<uint32_t>(blob_data_blocks + merkle_blocks);
-    const uint64_t data_start = DataStartBlock(blobfs_->Info());
-    zx_status_t status = StreamBlocks(
-        &block_iter, length, [&](uint64_t vmo_offset, uint64_t dev_offset, uint32_t length) {
-            txn.Enqueue(vmoid_, vmo_offset, dev_offset + data_start, length);
-            return ZX_OK;
-        });
+    zx_status_t status = EnqueueBlobRead(blobfs_, GetMapIndex(), &txn, vmoid_, 0, merkle_blocks, 0);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    status = txn.Transact();
+    if (status != ZX_OK) {
+        return status;
+    }
+    blobfs_->LocalMetrics().UpdateMerkleDiskRead(merkle_blocks * kBlobfsBlockSize, ticker.End());
+    return loaded_blocks_.Reset(blob_data_blocks);
+}
+
+zx_status_t VnodeBlob::InitChunkCompressed() {
+    TRACE_DURATION("blobfs", "Blobfs::InitChunkCompressed", "size", inode_.blob_size, "blocks",
+                   inode_.block_count);
+    fs::Ticker ticker(blobfs_->LocalMetrics().Collecting());
+    const uint64_t merkle_blocks = MerkleTreeBlocks(inode_);
+    const uint64_t header_blocks =
+        fbl::round_up(ChunkedHeaderSize(CompressionChunks(inode_.blob_size)), kBlobfsBlockSize) /
+        kBlobfsBlockSize;
+    if (inode_.block_count < merkle_blocks + header_blocks) {
+        FS_TRACE_ERROR("blobfs: Compressed blob too small for its seek table\n");
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    const uint64_t compressed_blocks = inode_.block_count - merkle_blocks;
+    size_t compressed_size;
+    if (mul_overflow(compressed_blocks, kBlobfsBlockSize, &compressed_size)) {
+        FS_TRACE_ERROR("Multiplication overflow\n");
+        return ZX_ERR_OUT_OF_RANGE;
+    }
 
+    // Only the chunks which are needed get read into the compressed VMO, so most of it
+    // never needs to be committed.
+    fzl::OwnedVmoMapper compressed_mapping;
+    zx_status_t status = compressed_mapping.CreateAndMap(compressed_size, "compressed-blob");
+    if (status != ZX_OK) {
+        FS_TRACE_ERROR("Failed to initialized compressed vmo; error: %d\n", status);
+        return status;
+    }
+    vmoid_t compressed_vmoid;
+    if ((status = blobfs_->AttachVmo(compressed_mapping.vmo(), &compressed_vmoid)) != ZX_OK) {
+        FS_TRACE_ERROR("Failed to attach commpressed VMO to blkdev: %d\n", status);
+        return status;
+    }
+    compressed_mapping_ = std::move(compressed_mapping);
+    compressed_vmoid_ = compressed_vmoid;
+
+    // Read the merkle tree into the start of the blob's VMO, and the header and seek
+    // table into the start of the compressed VMO.
+    fs::ReadTxn txn(blobfs_);
+    status = EnqueueBlobRead(blobfs_, GetMapIndex(), &txn, vmoid_, 0, merkle_blocks, 0);
+    if (status != ZX_OK) {
+        return status;
+    }
+    status = EnqueueBlobRead(blobfs_, GetMapIndex(), &txn, compressed_vmoid_, merkle_blocks,
+                             merkle_blocks + header_blocks, 0);
+    if (status != ZX_OK) {
+        return status;
+    }
+    if ((status = txn.Transact()) != ZX_OK) {
+        FS_TRACE_ERROR("Failed to flush read transaction: %d\n", status);
+        return status;
+    }
+    blobfs_->LocalMetrics().UpdateMerkleDiskRead((merkle_blocks + header_blocks) *
+                                                 kBlobfsBlockSize, ticker.End());
+
+    status = Decompressor::CheckChunked(compressed_mapping_.start(), compressed_size,
+                                        inode_.blob_size);
+    if (status != ZX_OK) {
+        return status;
+    }
+    return loaded_blocks_.Reset(BlobDataBlocks(inode_));
+}
+
+zx_status_t VnodeBlob::LoadData(uint64_t off, uint64_t len) {
+    if (loaded_blocks_.size() == 0) {
+        // The whole blob is already in memory.
+        return ZX_OK;
+    }
+    TRACE_DURATION("blobfs", "Blobfs::LoadData", "off", off, "len", len);
+
+    // Chunk-compressed blobs are loaded a chunk at a time.
+    const uint64_t unit =
+        (inode_.header.flags & kBlobFlagChunkCompressed) ? kCompressionChunkBlocks : 1;
+    const uint64_t end = fbl::round_up(off + len, kBlobfsBlockSize) / kBlobfsBlockSize;
+    size_t start = off / kBlobfsBlockSize;
+    while (!loaded_blocks_.Get(start, end, &start)) {
+        // Read the whole run of missing blocks at once, ending either at the end of the
+        // requested range or at the next block which has already been loaded.
+        size_t run_end;
+        if (loaded_blocks_.Scan(start, end, false, &run_end)) {
+            run_end = end;
+        }
+        start = fbl::round_down(start, unit);
+        run_end = fbl::min(fbl::round_up(run_end, unit), loaded_blocks_.size());
+
+        zx_status_t status = ReadDataBlocks(start, run_end);
+        if (status != ZX_OK) {
+            return status;
+        }
+        // The blocks are the same size as the Merkle tree's nodes, so they can be
+        // verified independently of the rest of the blob.
+        static_assert(kBlobfsBlockSize == MerkleTree::kNodeSize, "Mismatched block size");
+        const uint64_t verify_off = start * kBlobfsBlockSize;
+        const uint64_t verify_end = fbl::min(run_end * kBlobfsBlockSize, inode_.blob_size);
+        if ((status = Verify(verify_off, verify_end - verify_off)) != ZX_OK) {
+            return status;
+        }
+        loaded_blocks_.Set(start, run_end);
+        start = run_end;
+    }
+
+    if (loaded_blocks_.Get(0, loaded_blocks_.size())) {
+        // The whole blob is in memory now, so there is nothing left to read.
+        ReleaseCompressedMapping();
+        loaded_blocks_.Reset(0);
+    }
+    return ZX_OK;
+}
+
+zx_status_t VnodeBlob::ReadDataBlocks(uint64_t start, uint64_t end) {
+    if ((inode_.header.flags & kBlobFlagChunkCompressed) != 0) {
+        ZX_DEBUG_ASSERT(start % kCompressionChunkBlocks == 0);
+        return ReadChunks(start / kCompressionChunkBlocks,
+                          fbl::round_up(end, kCompressionChunkBlocks) / kCompressionChunkBlocks);
+    }
+
+    TRACE_DURATION("blobfs", "Blobfs::ReadDataBlocks", "start", start, "end", end);
+    fs::Ticker ticker(blobfs_->LocalMetrics().Collecting());
+    fs::ReadTxn txn(blobfs_);
+    const uint64_t merkle_blocks = MerkleTreeBlocks(inode_);
+    zx_status_t status = EnqueueBlobRead(blobfs_, GetMapIndex(), &txn, vmoid_,
+                                         merkle_blocks + start, merkle_blocks + end,
+                                         merkle_blocks + start);
     if (status != ZX_OK) {
         return status;
     }
@@ -292,8 +440,59 @@ zx_status_t VnodeBlob::InitUncompressed() {
     if (status != ZX_OK) {
         return status;
     }
-    blobfs_->LocalMetrics().UpdateMerkleDiskRead(length * kBlobfsBlockSize, ticker.End());
-    return status;
+    blobfs_->LocalMetrics().UpdateMerkleDiskRead((end - start) * kBlobfsBlockSize, ticker.End());
+    return ZX_OK;
+}
+
+zx_status_t VnodeBlob::ReadChunks(uint64_t first, uint64_t last) {
+    TRACE_DURATION("blobfs", "Blobfs::ReadChunks", "first", first, "last", last);
+    ZX_DEBUG_ASSERT(compressed_mapping_.vmo());
+    fs::Ticker ticker(blobfs_->LocalMetrics().Collecting());
+
+    // The seek table was checked by InitChunkCompressed, so the chunks lie within the
+    // compressed VMO.
+    const auto header = reinterpret_cast<const ChunkedHeader*>(compressed_mapping_.start());
+    const auto table = reinterpret_cast<const SeekTableEntry*>(header + 1);
+    const uint64_t block_start = table[first].offset / kBlobfsBlockSize;
+    const uint64_t block_end =
+        fbl::round_up(table[last - 1].offset + table[last - 1].length, kBlobfsBlockSize) /
+        kBlobfsBlockSize;
+
+    fs::ReadTxn txn(blobfs_);
+    const uint64_t merkle_blocks = MerkleTreeBlocks(inode_);
+    zx_status_t status = EnqueueBlobRead(blobfs_, GetMapIndex(), &txn, compressed_vmoid_,
+                                         merkle_blocks + block_start, merkle_blocks + block_end,
+                                         block_start);
+    if (status != ZX_OK) {
+        return status;
+    }
+    if ((status = txn.Transact()) != ZX_OK) {
+        FS_TRACE_ERROR("Failed to flush read transaction: %d\n", status);
+        return status;
+    }
+
+    fs::Duration read_time = ticker.End();
+    ticker.Reset();
+
+    status = Decompressor::DecompressChunks(GetData(), inode_.blob_size,
+                                            compressed_mapping_.start(), first, last);
+    if (status != ZX_OK) {
+        FS_TRACE_ERROR("Failed to decompress data: %d\n", status);
+        return status;
+    }
+
+    const uint64_t decompressed_end = fbl::min(last * kCompressionChunkSize, inode_.blob_size);
+    blobfs_->LocalMetrics().UdpateMerkleDecompress((block_end - block_start) * kBlobfsBlockSize,
+                                                   decompressed_end - first * kCompressionChunkSize,
+                                                   read_time, ticker.End());
+    return ZX_OK;
+}
+
+void VnodeBlob::ReleaseCompressedMapping() {
+    if (compressed_mapping_.vmo()) {
+        blobfs_->DetachVmo(compressed_vmoid_);
+    }
+    compressed_mapping_.Reset();
 }
 
 void VnodeBlob::PopulateInode(uint32_t node_index) {
@@ -321,6 +520,8 @@ VnodeBlob::VnodeBlob(Blobfs* bs)
 
 void VnodeBlob::BlobCloseHandles() {
     mapping_.Reset();
+    loaded_blocks_.Reset(0);
+    ReleaseCompressedMapping();
     readable_event_.reset();
 }
 
@@ -382,13 +583,14 @@ zx_status_t VnodeBlob::SpaceAllocate(uint64_t size_data) {
     }
 
     if (inode_.blob_size >= kCompressionMinBytesSaved) {
-        size_t max = Compressor::BufferMax(inode_.blob_size);
+        size_t max = ChunkedCompressor::BufferMax(inode_.blob_size);
         status = write_info->compressed_blob.CreateAndMap(max, "compressed-blob");
         if (status != ZX_OK) {
             return status;
         }
         status = write_info->compressor.Initialize(write_info->compressed_blob.start(),
-                                                   write_info->compressed_blob.size());
+                                                   write_info->compressed_blob.size(),
+                                                   inode_.blob_size);
         if (status != ZX_OK) {
             FS_TRACE_ERROR("blobfs: Failed to initialize compressor: %d\n", status);
             return status;
@@ -489,7 +691,7 @@ zx_status_t VnodeBlob::WriteMetadata() {
         ZX_ASSERT(populator.Walk(on_node, on_extent) == ZX_OK);
 
         // Ensure all non-allocation flags are propagated to the inode.
-        mapped_inode->header.flags |= (inode_.header.flags & kBlobFlagLZ4Compressed);
+        mapped_inode->header.flags |= (inode_.header.flags & kBlobFlagChunkCompressed);
     } else {
         // Special case: Empty node.
         ZX_DEBUG_ASSERT(write_info_->node_indices.size() == 1);
@@ -631,7 +833,7 @@ zx_status_t VnodeBlob::WriteInternal(const void* data, size_t len, size_t* actua
             ZX_DEBUG_ASSERT(inode_.block_count > blocks);
 
             inode_.block_count = blocks;
-            inode_.header.flags |= kBlobFlagLZ4Compressed;
+            inode_.header.flags |= kBlobFlagChunkCompressed;
         } else {
             uint64_t blocks64 =
                 fbl::round_up(inode_.blob_size, kBlobfsBlockSize) / kBlobfsBlockSize;
@@ -707,9 +909,12 @@ zx_status_t VnodeBlob::CloneVmo(zx_rights_t rights, zx_handle_t* out) {
     if (status != ZX_OK) {
         return status;
     }
-
     // TODO(smklein): Only clone / verify the part of the vmo that
     // was requested.
+    if ((status = LoadData(0, inode_.blob_size)) != ZX_OK) {
+        return status;
+    }
+
     const size_t merkle_bytes = MerkleTreeBlocks(inode_) * kBlobfsBlockSize;
     zx::vmo clone;
     if ((status = mapping_.vmo().clone(ZX_VMO_CLONE_COPY_ON_WRITE, merkle_bytes, inode_.blob_size,
@@ -769,8 +974,6 @@ zx_status_t VnodeBlob::ReadInternal(void* data, size_t len, size_t off, size_t*
         return status;
     }
 
-    Digest d(GetKey());
-
     if (off >= inode_.blob_size) {
         *actual = 0;
         return ZX_OK;
@@ -778,6 +981,9 @@ zx_status_t VnodeBlob::ReadInternal(void* data, size_t len, size_t off, size_t*
     if (len > (inode_.blob_size - off)) {
         len = inode_.blob_size - off;
     }
+    if ((status = LoadData(off, len)) != ZX_OK) {
+        return status;
+    }
 
     const size_t merkle_bytes = MerkleTreeBlocks(inode_) * kBlobfsBlockSize;
     status = mapping_.vmo().read(data, merkle_bytes + off, len);
@@ -806,8 +1012,12 @@ zx_status_t VnodeBlob::VerifyBlob(Blobfs* bs, uint32_t node_index) {
     vn->PopulateInode(node_index);
 
     // If we are unable to read in the blob from disk, this should also be a VerifyBlob error.
-    // Since InitVmos calls Verify as its final step, we can just return its result here.
-    return vn->InitVmos();
+    // Loading the whole blob verifies all of it.
+    zx_status_t status = vn->InitVmos();
+    if (status != ZX_OK) {
+        return status;
+    }
+    return vn->LoadData(0, inode->blob_size);
 }
 
 BlobCache& VnodeBlob::Cache() {
@@ -831,6 +1041,8 @@ void VnodeBlob::ActivateLowMemory() {
         blobfs_->DetachVmo(vmoid_);
     }
     mapping_.Reset();
+    loaded_blocks_.Reset(0);
+    ReleaseCompressedMapping();
 }
 
 VnodeBlob::~VnodeBlob() {
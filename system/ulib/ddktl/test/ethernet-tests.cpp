@@ -41,14 +41,21 @@ class TestEthmacIfc : public ddk::Device<TestEthmacIfc>,
         complete_tx_called_ = true;
     }
 
+    void EthmacIfcCompleteRx(ethmac_netbuf_t* netbuf, zx_status_t status) {
+        complete_rx_this_ = get_this();
+        complete_rx_called_ = true;
+    }
+
     bool VerifyCalls() const {
         BEGIN_HELPER;
         EXPECT_EQ(this_, status_this_, "");
         EXPECT_EQ(this_, recv_this_, "");
         EXPECT_EQ(this_, complete_tx_this_, "");
+        EXPECT_EQ(this_, complete_rx_this_, "");
         EXPECT_TRUE(status_called_, "");
         EXPECT_TRUE(recv_called_, "");
         EXPECT_TRUE(complete_tx_called_, "");
+        EXPECT_TRUE(complete_rx_called_, "");
         END_HELPER;
     }
 
@@ -64,9 +71,11 @@ class TestEthmacIfc : public ddk::Device<TestEthmacIfc>,
     uintptr_t status_this_ = 0u;
     uintptr_t recv_this_ = 0u;
     uintptr_t complete_tx_this_ = 0u;
+    uintptr_t complete_rx_this_ = 0u;
     bool status_called_ = false;
     bool recv_called_ = false;
     bool complete_tx_called_ = false;
+    bool complete_rx_called_ = false;
 };
 
 class TestEthmacProtocol : public ddk::Device<TestEthmacProtocol, ddk::GetProtocolable>,
@@ -118,6 +127,12 @@ class TestEthmacProtocol : public ddk::Device<TestEthmacProtocol, ddk::GetProtoc
     }
     void EthmacGetBti(zx::bti* bti) { bti->reset();}
 
+    zx_status_t EthmacQueueRx(ethmac_netbuf_t* netbuf) {
+        queue_rx_this_ = get_this();
+        queue_rx_called_ = true;
+        return ZX_OK;
+    }
+
 
     bool VerifyCalls() const {
         BEGIN_HELPER;
@@ -126,11 +141,13 @@ class TestEthmacProtocol : public ddk::Device<TestEthmacProtocol, ddk::GetProtoc
         EXPECT_EQ(this_, stop_this_, "");
         EXPECT_EQ(this_, queue_tx_this_, "");
         EXPECT_EQ(this_, set_param_this_, "");
+        EXPECT_EQ(this_, queue_rx_this_, "");
         EXPECT_TRUE(query_called_, "");
         EXPECT_TRUE(start_called_, "");
         EXPECT_TRUE(stop_called_, "");
         EXPECT_TRUE(queue_tx_called_, "");
         EXPECT_TRUE(set_param_called_, "");
+        EXPECT_TRUE(queue_rx_called_, "");
         END_HELPER;
     }
 
@@ -140,6 +157,7 @@ class TestEthmacProtocol : public ddk::Device<TestEthmacProtocol, ddk::GetProtoc
         client_->Status(0);
         client_->Recv(nullptr, 0, 0);
         client_->CompleteTx(nullptr, ZX_OK);
+        client_->CompleteRx(nullptr, ZX_OK);
         return true;
     }
 
@@ -150,11 +168,13 @@ class TestEthmacProtocol : public ddk::Device<TestEthmacProtocol, ddk::GetProtoc
     uintptr_t start_this_ = 0u;
     uintptr_t queue_tx_this_ = 0u;
     uintptr_t set_param_this_ = 0u;
+    uintptr_t queue_rx_this_ = 0u;
     bool query_called_ = false;
     bool stop_called_ = false;
     bool start_called_ = false;
     bool queue_tx_called_ = false;
     bool set_param_called_ = false;
+    bool queue_rx_called_ = false;
 
     fbl::unique_ptr<ddk::EthmacIfcClient> client_;
 };
@@ -168,6 +188,7 @@ static bool test_ethmac_ifc() {
     ethmac_ifc_status(&ifc, 0);
     ethmac_ifc_recv(&ifc, nullptr, 0, 0);
     ethmac_ifc_complete_tx(&ifc, nullptr, ZX_OK);
+    ethmac_ifc_complete_rx(&ifc, nullptr, ZX_OK);
 
     EXPECT_TRUE(dev.VerifyCalls(), "");
 
@@ -184,6 +205,7 @@ static bool test_ethmac_ifc_client() {
     client.Status(0);
     client.Recv(nullptr, 0, 0);
     client.CompleteTx(nullptr, ZX_OK);
+    client.CompleteRx(nullptr, ZX_OK);
 
     EXPECT_TRUE(dev.VerifyCalls(), "");
 
@@ -211,6 +233,7 @@ static bool test_ethmac_protocol() {
     ethmac_netbuf_t netbuf = {};
     EXPECT_EQ(ZX_OK, ethmac_queue_tx(&proto, 0, &netbuf), "");
     EXPECT_EQ(ZX_OK, ethmac_set_param(&proto, 0, 0, nullptr, 0), "");
+    EXPECT_EQ(ZX_OK, ethmac_queue_rx(&proto, &netbuf), "");
 
     EXPECT_TRUE(dev.VerifyCalls(), "");
 
@@ -240,6 +263,7 @@ static bool test_ethmac_protocol_client() {
     ethmac_netbuf_t netbuf = {};
     EXPECT_EQ(ZX_OK, client.QueueTx(0, &netbuf), "");
     EXPECT_EQ(ZX_OK, client.SetParam(0, 0, nullptr, 0));
+    EXPECT_EQ(ZX_OK, client.QueueRx(&netbuf), "");
 
     EXPECT_TRUE(protocol_dev.VerifyCalls(), "");
 
@@ -55,9 +55,23 @@ public:
 
     // Writes a Merkle tree for the given data and saves its root digest.
     // |tree_len| must be at least as much as returned by GetTreeLength().
+    // Large inputs are hashed on several threads; see |CreateParallel|.
     static zx_status_t Create(const void* data, size_t data_len, void* tree,
                               size_t tree_len, Digest* digest);
 
+    // Like |Create|, but hashes the nodes of each level of the tree on up to
+    // |num_threads| threads, including the calling one.  Each thread is given
+    // at least |kMinBytesPerThread| of the level.  If |num_threads| is 0, it
+    // uses one thread per CPU.  The tree and root are the same regardless of
+    // the number of threads.
+    static zx_status_t CreateParallel(const void* data, size_t data_len,
+                                      void* tree, size_t tree_len,
+                                      Digest* digest, size_t num_threads);
+
+    // The smallest share of a level that |CreateParallel| hands to a thread.
+    // Below this, starting the thread costs more than it saves.
+    static constexpr size_t kMinBytesPerThread = 128 * kNodeSize;
+
     // Checks the integrity of a the region of data given by the offset and
     // length.  It checks integrity using the given Merkle tree and trusted root
     // digest. |tree_len| must be at least as much as returned by
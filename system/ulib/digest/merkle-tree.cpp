@@ -4,8 +4,10 @@
 
 #include <digest/merkle-tree.h>
 
+#include <pthread.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <digest/digest.h>
 #include <fbl/algorithm.h>
@@ -14,10 +16,13 @@
 #include <zircon/assert.h>
 #include <zircon/errors.h>
 
+#include "sha256-ni.h"
+
 namespace digest {
 
 // Size of a node in bytes.  Defined in tree.h.
 constexpr size_t MerkleTree::kNodeSize;
+constexpr size_t MerkleTree::kMinBytesPerThread;
 
 // The number of digests that fit in a node.  Importantly, if L is a
 // node-aligned length in one level of the Merkle tree, |L / kDigestsPerNode| is
@@ -94,6 +99,111 @@ size_t NextAligned(size_t length) {
     return fbl::round_up(NextLength(length), MerkleTree::kNodeSize);
 }
 
+////////
+// Helper functions for hashing whole nodes.
+
+// The most threads |CreateParallel| will use for one level of the tree.
+const size_t kMaxThreads = 32;
+
+// Writes the digest of the node of |length| bytes at |in| to |out|, as
+// DigestInit, DigestUpdate and DigestFinal would.  Uses the SHA extensions if
+// the CPU has them, and |digest| otherwise.
+zx_status_t HashNode(Digest* digest, uint64_t locality, const uint8_t* in, size_t length,
+                     uint8_t* out) {
+    ZX_DEBUG_ASSERT(length <= MerkleTree::kNodeSize);
+    if (!internal::Sha256Ni::IsSupported()) {
+        zx_status_t rc;
+        if ((rc = DigestInit(digest, locality, length)) != ZX_OK) {
+            return rc;
+        }
+        DigestUpdate(digest, in, 0, length);
+        DigestFinal(digest, length);
+        return digest->CopyTo(out, Digest::kLength);
+    }
+    internal::Sha256Ni sha;
+    uint32_t len32 = static_cast<uint32_t>(length);
+    sha.Update(&locality, sizeof(locality));
+    sha.Update(&len32, sizeof(len32));
+    sha.Update(in, length);
+    if (length != 0) {
+        sha.Pad(MerkleTree::kNodeSize - length);
+    }
+    sha.Final(out);
+    return ZX_OK;
+}
+
+// A run of whole nodes from one level of the tree, hashed by one thread.
+struct HashTask {
+    // The level, its height in the tree, and its length.
+    const uint8_t* in;
+    uint64_t level;
+    size_t in_len;
+    // The node-aligned range of the level to hash.
+    size_t start;
+    size_t end;
+    // Where the level's digests go, i.e. the next level up.
+    uint8_t* out;
+    zx_status_t rc;
+};
+
+void HashNodes(HashTask* task) {
+    Digest digest;
+    uint8_t* out = task->out + (task->start / kDigestsPerNode);
+    task->rc = ZX_OK;
+    for (size_t offset = task->start; offset < task->end; offset += MerkleTree::kNodeSize) {
+        size_t length = fbl::min(task->in_len - offset, MerkleTree::kNodeSize);
+        task->rc = HashNode(&digest, offset | task->level, task->in + offset, length, out);
+        if (task->rc != ZX_OK) {
+            return;
+        }
+        out += Digest::kLength;
+    }
+}
+
+void* HashNodesThread(void* arg) {
+    HashNodes(static_cast<HashTask*>(arg));
+    return nullptr;
+}
+
+// Hashes every node of the |level| that is |len| bytes long at |in|, and writes
+// their digests to |out|.  The nodes are split evenly between up to
+// |num_threads| threads, each hashing a contiguous run of them.
+zx_status_t HashLevel(const uint8_t* in, size_t len, uint64_t level, uint8_t* out,
+                      size_t num_threads) {
+    size_t nodes = fbl::round_up(len, MerkleTree::kNodeSize) / MerkleTree::kNodeSize;
+    num_threads = fbl::min(num_threads, len / MerkleTree::kMinBytesPerThread);
+    num_threads = fbl::clamp<size_t>(num_threads, 1, kMaxThreads);
+    HashTask tasks[kMaxThreads];
+    pthread_t threads[kMaxThreads];
+    bool started[kMaxThreads];
+    for (size_t i = 0; i < num_threads; ++i) {
+        HashTask* task = &tasks[i];
+        task->in = in;
+        task->level = level;
+        task->in_len = len;
+        task->start = (nodes * i / num_threads) * MerkleTree::kNodeSize;
+        task->end = (nodes * (i + 1) / num_threads) * MerkleTree::kNodeSize;
+        task->out = out;
+        // The calling thread takes the first run once the others are going.
+        // If a thread can't be started, its run is done here instead.
+        started[i] = i != 0 && pthread_create(&threads[i], nullptr, HashNodesThread, task) == 0;
+        if (i != 0 && !started[i]) {
+            HashNodes(task);
+        }
+    }
+    HashNodes(&tasks[0]);
+    zx_status_t rc = tasks[0].rc;
+    for (size_t i = 1; i < num_threads; ++i) {
+        if (started[i]) {
+            pthread_join(threads[i], nullptr);
+        }
+        if (rc == ZX_OK) {
+            rc = tasks[i].rc;
+        }
+    }
+    return rc;
+}
+
 } // namespace
 
 ////////
@@ -106,13 +216,47 @@ size_t MerkleTree::GetTreeLength(size_t data_len) {
 
 zx_status_t MerkleTree::Create(const void* data, size_t data_len, void* tree, size_t tree_len,
                                Digest* digest) {
+    return CreateParallel(data, data_len, tree, tree_len, digest, 0);
+}
+
+zx_status_t MerkleTree::CreateParallel(const void* data, size_t data_len, void* tree,
+                                       size_t tree_len, Digest* root, size_t num_threads) {
     zx_status_t rc;
-    MerkleTree mt;
-    if ((rc = mt.CreateInit(data_len, tree_len)) != ZX_OK ||
-        (rc = mt.CreateUpdate(data, data_len, tree)) != ZX_OK ||
-        (rc = mt.CreateFinal(tree, digest)) != ZX_OK) {
+    // Fail the same way as CreateInit, CreateUpdate, and CreateFinal would.
+    if (tree_len < GetTreeLength(data_len)) {
+        return ZX_ERR_BUFFER_TOO_SMALL;
+    }
+    if ((!data && data_len != 0) || (!tree && data_len > kNodeSize) || !root) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    if (num_threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = (cpus > 0 ? cpus : 1);
+    }
+    // Unlike CreateUpdate, which climbs the tree a digest at a time, this
+    // finishes each level before starting the next so that all of a level's
+    // nodes can be hashed at once.
+    const uint8_t* in = static_cast<const uint8_t*>(data);
+    uint8_t* out = static_cast<uint8_t*>(tree);
+    uint64_t level = 0;
+    while (data_len > kNodeSize) {
+        if ((rc = HashLevel(in, data_len, level, out, num_threads)) != ZX_OK) {
+            return rc;
+        }
+        // Zero the rest of the last node of digests.
+        size_t next_len = NextLength(data_len);
+        data_len = NextAligned(data_len);
+        memset(out + next_len, 0, data_len - next_len);
+        in = out;
+        out += data_len;
+        ++level;
+    }
+    Digest digest;
+    uint8_t bytes[Digest::kLength];
+    if ((rc = HashNode(&digest, level, in, data_len, bytes)) != ZX_OK) {
         return rc;
     }
+    *root = bytes;
     return ZX_OK;
 }
 
@@ -306,21 +450,21 @@ zx_status_t MerkleTree::VerifyLevel(const void* data, size_t data_len, const voi
     length = fbl::min(finish, data_len) - offset;
     const uint8_t* in = static_cast<const uint8_t*>(data) + offset;
     // The digests are in the next level up.
-    Digest actual;
+    Digest digest;
+    uint8_t actual[Digest::kLength];
     const uint8_t* expected = static_cast<const uint8_t*>(tree) + (offset / kDigestsPerNode);
     // Check the data of this level against the digests.
     while (length > 0) {
-        if ((rc = DigestInit(&actual, offset | level, data_len - offset)) != ZX_OK) {
+        size_t chunk = fbl::min(length, kNodeSize);
+        if ((rc = HashNode(&digest, offset | level, in, chunk, actual)) != ZX_OK) {
             return rc;
         }
-        size_t chunk = DigestUpdate(&actual, in, offset, length);
+        if (memcmp(actual, expected, Digest::kLength) != 0) {
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
         in += chunk;
         offset += chunk;
         length -= chunk;
-        DigestFinal(&actual, offset);
-        if (actual != expected) {
-            return ZX_ERR_IO_DATA_INTEGRITY;
-        }
         expected += Digest::kLength;
     }
     return ZX_OK;
@@ -0,0 +1,203 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sha256-ni.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <fbl/algorithm.h>
+#include <fbl/atomic.h>
+#include <zircon/assert.h>
+#include <zircon/compiler.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace digest {
+namespace internal {
+namespace {
+
+const uint32_t kInitialState[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+#if defined(__x86_64__)
+
+const uint32_t kRoundConstants[64] __ALIGNED(16) = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define SHA_TARGET __attribute__((target("sha,sse4.1")))
+
+// Does four rounds with the message schedule words |w|, starting at round
+// |4 * i|.
+SHA_TARGET inline __ALWAYS_INLINE void Rounds(__m128i* abef, __m128i* cdgh, __m128i w, size_t i) {
+    __m128i k = _mm_load_si128(reinterpret_cast<const __m128i*>(kRoundConstants) + i);
+    __m128i wk = _mm_add_epi32(w, k);
+    *cdgh = _mm_sha256rnds2_epu32(*cdgh, *abef, wk);
+    *abef = _mm_sha256rnds2_epu32(*abef, *cdgh, _mm_shuffle_epi32(wk, 0x0e));
+}
+
+// Returns the next four message schedule words, given the previous sixteen.
+SHA_TARGET inline __ALWAYS_INLINE __m128i Schedule(__m128i w16, __m128i w12, __m128i w8,
+                                                   __m128i w4) {
+    __m128i w = _mm_sha256msg1_epu32(w16, w12);
+    w = _mm_add_epi32(w, _mm_alignr_epi8(w4, w8, 4));
+    return _mm_sha256msg2_epu32(w, w4);
+}
+
+// Runs the SHA-256 compression function over |blocks| 64-byte blocks of |in|.
+SHA_TARGET void Compress(uint32_t state[8], const uint8_t* in, size_t blocks) {
+    const __m128i kByteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // The SHA instructions want the state as the vectors ABEF and CDGH.
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<__m128i*>(&state[0])), 0xb1);
+    __m128i cdgh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<__m128i*>(&state[4])), 0x1b);
+    __m128i abef = _mm_alignr_epi8(tmp, cdgh, 8);
+    cdgh = _mm_blend_epi16(cdgh, tmp, 0xf0);
+
+    for (; blocks > 0; --blocks, in += Sha256Ni::kBlockSize) {
+        __m128i abef_save = abef;
+        __m128i cdgh_save = cdgh;
+        const __m128i* msg = reinterpret_cast<const __m128i*>(in);
+        __m128i w0 = _mm_shuffle_epi8(_mm_loadu_si128(msg + 0), kByteSwap);
+        Rounds(&abef, &cdgh, w0, 0);
+        __m128i w1 = _mm_shuffle_epi8(_mm_loadu_si128(msg + 1), kByteSwap);
+        Rounds(&abef, &cdgh, w1, 1);
+        __m128i w2 = _mm_shuffle_epi8(_mm_loadu_si128(msg + 2), kByteSwap);
+        Rounds(&abef, &cdgh, w2, 2);
+        __m128i w3 = _mm_shuffle_epi8(_mm_loadu_si128(msg + 3), kByteSwap);
+        Rounds(&abef, &cdgh, w3, 3);
+        for (size_t i = 4; i < 16; i += 4) {
+            w0 = Schedule(w0, w1, w2, w3);
+            Rounds(&abef, &cdgh, w0, i);
+            w1 = Schedule(w1, w2, w3, w0);
+            Rounds(&abef, &cdgh, w1, i + 1);
+            w2 = Schedule(w2, w3, w0, w1);
+            Rounds(&abef, &cdgh, w2, i + 2);
+            w3 = Schedule(w3, w0, w1, w2);
+            Rounds(&abef, &cdgh, w3, i + 3);
+        }
+        abef = _mm_add_epi32(abef, abef_save);
+        cdgh = _mm_add_epi32(cdgh, cdgh_save);
+    }
+
+    // Back to ABCD and EFGH.
+    tmp = _mm_shuffle_epi32(abef, 0x1b);
+    cdgh = _mm_shuffle_epi32(cdgh, 0xb1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), _mm_blend_epi16(tmp, cdgh, 0xf0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), _mm_alignr_epi8(cdgh, tmp, 8));
+}
+
+#else
+
+void Compress(uint32_t state[8], const uint8_t* in, size_t blocks) {
+    ZX_PANIC("SHA extensions are only available on x86-64\n");
+}
+
+#endif // __x86_64__
+
+} // namespace
+
+constexpr size_t Sha256Ni::kBlockSize;
+constexpr size_t Sha256Ni::kLength;
+
+bool Sha256Ni::IsSupported() {
+#if defined(__x86_64__)
+    // -1 until the first call looks it up.  Racing callers all find the same
+    // answer, so there is no need to serialize them.
+    static fbl::atomic<int> supported(-1);
+    int cached = supported.load(fbl::memory_order_relaxed);
+    if (cached >= 0) {
+        return cached != 0;
+    }
+    bool found = false;
+    uint32_t eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_1) &&
+        __get_cpuid_max(0, nullptr) >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        found = (ebx & (1u << 29)) != 0;
+    }
+    supported.store(found ? 1 : 0, fbl::memory_order_relaxed);
+    return found;
+#else
+    return false;
+#endif
+}
+
+Sha256Ni::Sha256Ni() : total_(0), block_len_(0) {
+    memcpy(state_, kInitialState, sizeof(state_));
+}
+
+void Sha256Ni::Update(const void* buf, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    const uint8_t* in = static_cast<const uint8_t*>(buf);
+    total_ += len;
+    if (block_len_ != 0) {
+        size_t n = fbl::min(len, kBlockSize - block_len_);
+        memcpy(block_ + block_len_, in, n);
+        block_len_ += n;
+        in += n;
+        len -= n;
+        if (block_len_ < kBlockSize) {
+            return;
+        }
+        Compress(state_, block_, 1);
+        block_len_ = 0;
+    }
+    if (len >= kBlockSize) {
+        size_t blocks = len / kBlockSize;
+        Compress(state_, in, blocks);
+        in += blocks * kBlockSize;
+        len -= blocks * kBlockSize;
+    }
+    memcpy(block_, in, len);
+    block_len_ = len;
+}
+
+void Sha256Ni::Pad(size_t len) {
+    static const uint8_t kZeros[kBlockSize] = {};
+    while (len > 0) {
+        size_t n = fbl::min(len, kBlockSize);
+        Update(kZeros, n);
+        len -= n;
+    }
+}
+
+void Sha256Ni::Final(uint8_t out[kLength]) {
+    uint64_t bits = total_ * 8;
+    block_[block_len_++] = 0x80;
+    if (block_len_ > kBlockSize - sizeof(bits)) {
+        memset(block_ + block_len_, 0, kBlockSize - block_len_);
+        Compress(state_, block_, 1);
+        block_len_ = 0;
+    }
+    memset(block_ + block_len_, 0, kBlockSize - sizeof(bits) - block_len_);
+    for (size_t i = 0; i < sizeof(bits); ++i) {
+        block_[kBlockSize - 1 - i] = static_cast<uint8_t>(bits >> (i * 8));
+    }
+    Compress(state_, block_, 1);
+    for (size_t i = 0; i < 8; ++i) {
+        out[i * 4 + 0] = static_cast<uint8_t>(state_[i] >> 24);
+        out[i * 4 + 1] = static_cast<uint8_t>(state_[i] >> 16);
+        out[i * 4 + 2] = static_cast<uint8_t>(state_[i] >> 8);
+        out[i * 4 + 3] = static_cast<uint8_t>(state_[i]);
+    }
+}
+
+} // namespace internal
+} // namespace digest
@@ -0,0 +1,47 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace digest {
+namespace internal {
+
+// SHA-256 using the x86 SHA extensions.  BoringSSL's x86-64 SHA-256 only has
+// SSSE3 and AVX code paths, so the Merkle tree uses this instead to hash nodes
+// whenever the CPU has the SHA instructions.  On other architectures, and on
+// x86 CPUs without them, |Sha256Ni::IsSupported| returns false and nothing
+// else in this class may be used.
+class Sha256Ni final {
+public:
+    static constexpr size_t kBlockSize = 64;
+    static constexpr size_t kLength = 32;
+
+    // Returns whether the CPU implements the SHA extensions.  Only the first
+    // call executes CPUID; later ones return the saved answer.
+    static bool IsSupported();
+
+    Sha256Ni();
+
+    // Adds |len| bytes of |buf| to the data being hashed.
+    void Update(const void* buf, size_t len);
+
+    // Adds |len| zero bytes to the data being hashed.
+    void Pad(size_t len);
+
+    // Finishes the hash and writes the digest to |out|.  The object must not be
+    // used again after this.
+    void Final(uint8_t out[kLength]);
+
+private:
+    uint32_t state_[8];
+    uint64_t total_;
+    uint8_t block_[kBlockSize];
+    size_t block_len_;
+};
+
+} // namespace internal
+} // namespace digest
@@ -0,0 +1,120 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <fbl/macros.h>
+#include <lib/fzl/vmo-mapper.h>
+#include <lib/zircon-internal/kcounter.h>
+#include <lib/zircon-internal/khistogram.h>
+#include <lib/zx/vmo.h>
+#include <zircon/types.h>
+
+namespace kcounter {
+
+// The values of one counter, combined across the cpus in the system.
+struct Stats {
+    int64_t sum;
+    int64_t min;
+    int64_t max;
+};
+
+// Reads the kernel counters from the read-only VMOs that the kernel publishes
+// in /boot/kernel (see <lib/zircon-internal/kcounter.h>).  Once the VMOs are
+// mapped, reading a counter is a handful of loads; no syscalls are made.
+//
+// The kernel does not update the counters atomically, so a value read while
+// it changes is only approximate, just as in the kernel's own `k counters`.
+class Reader {
+public:
+    Reader() = default;
+    DISALLOW_COPY_ASSIGN_AND_MOVE(Reader);
+
+    // Maps the VMOs published in /boot/kernel.
+    zx_status_t Init();
+
+    // Maps the given descriptor and arena VMOs.
+    zx_status_t Init(const zx::vmo& desc, const zx::vmo& arena);
+
+    // Counters are numbered from 0 to count() - 1, in order of their names.
+    size_t count() const { return desc_ ? desc_->num_counters : 0; }
+    const char* name(size_t index) const { return desc_->descriptors[index].name; }
+    // One of KCOUNTER_TYPE_*.
+    uint64_t type(size_t index) const { return desc_->descriptors[index].type; }
+
+    // Finds the first counter whose name is not less than |name|; returns
+    // count() if there is none.  Counters sharing a prefix follow it.
+    size_t LowerBound(const char* name) const;
+
+    // Finds the counter named |name|.
+    bool Find(const char* name, size_t* index) const;
+
+    // Combines the counter's values on each cpu.
+    Stats Read(size_t index) const;
+
+    // The counter's value as the kernel presents it: the sum, min or max of
+    // its per-cpu values, according to its type.
+    int64_t Value(size_t index) const;
+
+private:
+    fzl::VmoMapper desc_mapping_;
+    fzl::VmoMapper arena_mapping_;
+    const kcounter_desc_header_t* desc_ = nullptr;
+    const int64_t* arena_ = nullptr;
+    uint32_t num_cpus_ = 0;
+};
+
+// One kernel histogram, combined across the cpus in the system.
+struct Histogram {
+    int64_t buckets[KHISTOGRAM_BUCKETS];
+
+    // The number of values recorded.
+    int64_t total() const;
+
+    // An upper bound, in nanoseconds, on the smallest value that at least
+    // |fraction| of the recorded values do not exceed: the end of the bucket
+    // that holds it.  Values in the last bucket have no upper bound, so for
+    // those this is the start of that bucket.  Returns 0 if nothing was
+    // recorded.
+    uint64_t Percentile(double fraction) const;
+};
+
+// Reads the kernel's latency histograms from the read-only VMOs that the
+// kernel publishes in /boot/kernel (see <lib/zircon-internal/khistogram.h>),
+// in the same way as Reader reads the counters.
+class HistogramReader {
+public:
+    HistogramReader() = default;
+    DISALLOW_COPY_ASSIGN_AND_MOVE(HistogramReader);
+
+    // Maps the VMOs published in /boot/kernel.
+    zx_status_t Init();
+
+    // Maps the given descriptor and arena VMOs.
+    zx_status_t Init(const zx::vmo& desc, const zx::vmo& arena);
+
+    // Families are numbered from 0 to count() - 1, in order of their names.
+    // There are none if the kernel was booted with kernel.histograms=false.
+    size_t count() const { return desc_ ? desc_->num_families : 0; }
+    const char* name(size_t family) const { return desc_->descriptors[family].name; }
+    // The number of histograms in the family.
+    uint32_t size(size_t family) const { return desc_->descriptors[family].count; }
+
+    // Finds the family named |name|.
+    bool Find(const char* name, size_t* family) const;
+
+    // Sums histogram |index| of |family| across the cpus.
+    void Read(size_t family, uint32_t index, Histogram* histogram) const;
+
+private:
+    fzl::VmoMapper desc_mapping_;
+    fzl::VmoMapper arena_mapping_;
+    const khistogram_desc_header_t* desc_ = nullptr;
+    const int64_t* arena_ = nullptr;
+};
+
+} // namespace kcounter
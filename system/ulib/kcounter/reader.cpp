@@ -0,0 +1,253 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <lib/kcounter/reader.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+
+#include <fbl/unique_fd.h>
+#include <lib/fdio/io.h>
+#include <zircon/syscalls.h>
+
+namespace kcounter {
+
+namespace {
+
+constexpr char kDescPath[] = "/boot/kernel/" KCOUNTER_DESC_VMO_NAME;
+constexpr char kArenaPath[] = "/boot/kernel/" KCOUNTER_ARENA_VMO_NAME;
+constexpr char kHistogramDescPath[] = "/boot/kernel/" KHISTOGRAM_DESC_VMO_NAME;
+constexpr char kHistogramArenaPath[] = "/boot/kernel/" KHISTOGRAM_ARENA_VMO_NAME;
+
+zx_status_t OpenVmo(const char* path, zx::vmo* vmo) {
+    fbl::unique_fd fd(open(path, O_RDONLY));
+    if (!fd) {
+        return ZX_ERR_NOT_FOUND;
+    }
+    return fdio_get_vmo_clone(fd.get(), vmo->reset_and_get_address());
+}
+
+template <typename T>
+zx_status_t OpenVmos(T* reader, const char* desc_path, const char* arena_path) {
+    zx::vmo desc, arena;
+    zx_status_t status = OpenVmo(desc_path, &desc);
+    if (status != ZX_OK) {
+        return status;
+    }
+    status = OpenVmo(arena_path, &arena);
+    if (status != ZX_OK) {
+        return status;
+    }
+    return reader->Init(desc, arena);
+}
+
+} // namespace
+
+zx_status_t Reader::Init() {
+    return OpenVmos(this, kDescPath, kArenaPath);
+}
+
+zx_status_t Reader::Init(const zx::vmo& desc, const zx::vmo& arena) {
+    uint64_t desc_size, arena_size;
+    zx_status_t status = desc.get_size(&desc_size);
+    if (status != ZX_OK) {
+        return status;
+    }
+    status = arena.get_size(&arena_size);
+    if (status != ZX_OK) {
+        return status;
+    }
+    if (desc_size < sizeof(kcounter_desc_header_t)) {
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    status = desc_mapping_.Map(desc, 0, desc_size, ZX_VM_PERM_READ);
+    if (status != ZX_OK) {
+        return status;
+    }
+    auto header = static_cast<const kcounter_desc_header_t*>(desc_mapping_.start());
+    const uint64_t num_counters = header->num_counters;
+    if (header->magic != KCOUNTER_DESC_MAGIC || header->max_cpus == 0 ||
+        (desc_size - sizeof(*header)) / sizeof(kcounter_desc_entry_t) < num_counters ||
+        arena_size / sizeof(int64_t) / header->max_cpus < num_counters) {
+        desc_mapping_.Unmap();
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    status = arena_mapping_.Map(arena, 0, arena_size, ZX_VM_PERM_READ);
+    if (status != ZX_OK) {
+        desc_mapping_.Unmap();
+        return status;
+    }
+
+    desc_ = header;
+    arena_ = static_cast<const int64_t*>(arena_mapping_.start());
+    num_cpus_ = zx_system_get_num_cpus();
+    if (num_cpus_ > header->max_cpus) {
+        num_cpus_ = header->max_cpus;
+    }
+    return ZX_OK;
+}
+
+size_t Reader::LowerBound(const char* name) const {
+    // The kernel sorts the descriptors by name.
+    size_t first = 0;
+    size_t count = this->count();
+    while (count > 0) {
+        size_t step = count / 2;
+        if (strcmp(this->name(first + step), name) < 0) {
+            first += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    return first;
+}
+
+bool Reader::Find(const char* name, size_t* index) const {
+    size_t i = LowerBound(name);
+    if (i == count() || strcmp(this->name(i), name) != 0) {
+        return false;
+    }
+    *index = i;
+    return true;
+}
+
+Stats Reader::Read(size_t index) const {
+    Stats stats = {0, INT64_MAX, INT64_MIN};
+    for (uint32_t cpu = 0; cpu < num_cpus_; ++cpu) {
+        int64_t value = __atomic_load_n(&arena_[cpu * desc_->num_counters + index],
+                                        __ATOMIC_RELAXED);
+        stats.sum += value;
+        if (value < stats.min) {
+            stats.min = value;
+        }
+        if (value > stats.max) {
+            stats.max = value;
+        }
+    }
+    return stats;
+}
+
+int64_t Reader::Value(size_t index) const {
+    Stats stats = Read(index);
+    switch (type(index)) {
+    case KCOUNTER_TYPE_MIN:
+        return stats.min;
+    case KCOUNTER_TYPE_MAX:
+        return stats.max;
+    default:
+        return stats.sum;
+    }
+}
+
+int64_t Histogram::total() const {
+    int64_t total = 0;
+    for (int64_t count : buckets) {
+        total += count;
+    }
+    return total;
+}
+
+uint64_t Histogram::Percentile(double fraction) const {
+    const int64_t total = this->total();
+    if (total <= 0) {
+        return 0;
+    }
+    // The rank of the value sought, counting from 1.
+    int64_t rank = static_cast<int64_t>(fraction * static_cast<double>(total));
+    if (rank < 1) {
+        rank = 1;
+    }
+    int64_t seen = 0;
+    for (uint32_t bucket = 0; bucket < KHISTOGRAM_BUCKETS - 1; ++bucket) {
+        seen += buckets[bucket];
+        if (seen >= rank) {
+            return khistogram_bucket_min(bucket + 1);
+        }
+    }
+    return khistogram_bucket_min(KHISTOGRAM_BUCKETS - 1);
+}
+
+zx_status_t HistogramReader::Init() {
+    return OpenVmos(this, kHistogramDescPath, kHistogramArenaPath);
+}
+
+zx_status_t HistogramReader::Init(const zx::vmo& desc, const zx::vmo& arena) {
+    uint64_t desc_size, arena_size;
+    zx_status_t status = desc.get_size(&desc_size);
+    if (status != ZX_OK) {
+        return status;
+    }
+    status = arena.get_size(&arena_size);
+    if (status != ZX_OK) {
+        return status;
+    }
+    if (desc_size < sizeof(khistogram_desc_header_t)) {
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    status = desc_mapping_.Map(desc, 0, desc_size, ZX_VM_PERM_READ);
+    if (status != ZX_OK) {
+        return status;
+    }
+    auto header = static_cast<const khistogram_desc_header_t*>(desc_mapping_.start());
+    const uint64_t num_families = header->num_families;
+    const uint64_t block = static_cast<uint64_t>(header->num_histograms) * KHISTOGRAM_BUCKETS;
+    bool valid = header->magic == KHISTOGRAM_DESC_MAGIC &&
+                 header->num_buckets == KHISTOGRAM_BUCKETS &&
+                 (desc_size - sizeof(*header)) / sizeof(khistogram_desc_entry_t) >= num_families &&
+                 arena_size / sizeof(int64_t) / (block ? block : 1) >= header->num_cpus;
+    for (uint64_t i = 0; valid && i < num_families; ++i) {
+        const khistogram_desc_entry_t& entry = header->descriptors[i];
+        valid = static_cast<uint64_t>(entry.first) + entry.count <= header->num_histograms;
+    }
+    if (!valid) {
+        desc_mapping_.Unmap();
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    // With the histograms disabled there is nothing to map.
+    if (num_families > 0) {
+        status = arena_mapping_.Map(arena, 0, arena_size, ZX_VM_PERM_READ);
+        if (status != ZX_OK) {
+            desc_mapping_.Unmap();
+            return status;
+        }
+        arena_ = static_cast<const int64_t*>(arena_mapping_.start());
+    }
+
+    desc_ = header;
+    return ZX_OK;
+}
+
+bool HistogramReader::Find(const char* name, size_t* family) const {
+    // There are only a handful of families.
+    for (size_t i = 0; i < count(); ++i) {
+        if (strcmp(this->name(i), name) == 0) {
+            *family = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void HistogramReader::Read(size_t family, uint32_t index, Histogram* histogram) const {
+    memset(histogram, 0, sizeof(*histogram));
+    if (family >= count() || index >= size(family)) {
+        return;
+    }
+    const size_t block = static_cast<size_t>(desc_->num_histograms) * KHISTOGRAM_BUCKETS;
+    const size_t offset = (desc_->descriptors[family].first + index) * KHISTOGRAM_BUCKETS;
+    for (uint32_t cpu = 0; cpu < desc_->num_cpus; ++cpu) {
+        const int64_t* buckets = &arena_[cpu * block + offset];
+        for (uint32_t bucket = 0; bucket < KHISTOGRAM_BUCKETS; ++bucket) {
+            histogram->buckets[bucket] += __atomic_load_n(&buckets[bucket], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+} // namespace kcounter
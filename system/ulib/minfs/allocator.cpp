@@ -8,6 +8,10 @@
 
 #include <bitmap/raw-bitmap.h>
 
+#ifdef __Fuchsia__
+#include <fbl/auto_lock.h>
+#endif
+
 #include <minfs/allocator.h>
 #include <minfs/block-txn.h>
 
@@ -113,7 +117,14 @@ zx_status_t Allocator::Create(Bcache* bc, SuperblockManager* sb, fs::ReadTxn* tx
 
 zx_status_t Allocator::Reserve(WriteTxn* txn, size_t count,
                                fbl::unique_ptr<AllocatorPromise>* out_promise) {
+#ifdef __Fuchsia__
+    ReclaimCommittedFrees();
+#endif
     if (GetAvailable() < count) {
+        if (GetAvailable() + GetPendingFrees() >= count) {
+            return ZX_ERR_SHOULD_WAIT;
+        }
+
         // If we do not have enough free elements, attempt to extend the partition.
         zx_status_t status;
         //TODO(planders): Allow Extend to take in count.
@@ -136,9 +147,12 @@ void Allocator::Unreserve(size_t count) {
 
 size_t Allocator::Allocate(WriteTxn* txn) {
     ZX_DEBUG_ASSERT(reserved_ > 0);
+#ifdef __Fuchsia__
+    ReclaimCommittedFrees();
+#endif
     size_t bitoff_start;
-    if (map_.Find(false, hint_, map_.size(), 1, &bitoff_start) != ZX_OK) {
-        ZX_ASSERT(map_.Find(false, 0, hint_, 1, &bitoff_start) == ZX_OK);
+    if (FindAvailable(hint_, map_.size(), &bitoff_start) != ZX_OK) {
+        ZX_ASSERT(FindAvailable(0, hint_, &bitoff_start) == ZX_OK);
     }
 
     ZX_ASSERT(map_.Set(bitoff_start, bitoff_start + 1) == ZX_OK);
@@ -158,9 +172,54 @@ void Allocator::Free(WriteTxn* txn, size_t index) {
     metadata_.PoolRelease(1);
     sb_->Write(txn);
 
+#ifdef __Fuchsia__
+    ZX_ASSERT(pending_.Set(index, index + 1) == ZX_OK);
+    txn->DeferFree(this, index);
+#else
     if (index < hint_) {
         hint_ = index;
     }
+#endif
+}
+
+#ifdef __Fuchsia__
+void Allocator::FreeCommitted(size_t index) {
+    fbl::AutoLock lock(&committed_lock_);
+    committed_.push_back(index);
+}
+
+void Allocator::ReclaimCommittedFrees() {
+    fbl::Vector<size_t> committed;
+    {
+        fbl::AutoLock lock(&committed_lock_);
+        committed.swap(committed_);
+    }
+    for (size_t i = 0; i < committed.size(); i++) {
+        size_t index = committed[i];
+        ZX_DEBUG_ASSERT(pending_.Get(index, index + 1));
+        ZX_ASSERT(pending_.Clear(index, index + 1) == ZX_OK);
+        if (index < hint_) {
+            hint_ = index;
+        }
+    }
+}
+#endif
+
+zx_status_t Allocator::FindAvailable(size_t start, size_t end, size_t* out) const {
+    size_t bitoff;
+    while (map_.Find(false, start, end, 1, &bitoff) == ZX_OK) {
+#ifdef __Fuchsia__
+        // Skip the run of pending frees starting at |bitoff|, if any.
+        if (pending_.Get(bitoff, end, &start)) {
+            break;
+        } else if (start != bitoff) {
+            continue;
+        }
+#endif
+        *out = bitoff;
+        return ZX_OK;
+    }
+    return ZX_ERR_NO_RESOURCES;
 }
 
 zx_status_t Allocator::Extend(WriteTxn* txn) {
@@ -9,6 +9,7 @@
 #include <unistd.h>
 
 #include <fbl/alloc_checker.h>
+#include <fbl/auto_lock.h>
 #include <fbl/ref_ptr.h>
 #include <fbl/unique_ptr.h>
 #include <fs/trace.h>
@@ -21,24 +22,84 @@
 
 namespace minfs {
 
-zx_status_t Bcache::Readblk(blk_t bno, void* data) {
+zx_status_t Bcache::ReadDevice(blk_t bno, blk_t count, void* data) {
     off_t off = static_cast<off_t>(bno) * kMinfsBlockSize;
     assert(off / kMinfsBlockSize == bno); // Overflow
 #ifndef __Fuchsia__
     off += offset_;
 #endif
-    if (lseek(fd_.get(), off, SEEK_SET) < 0) {
-        FS_TRACE_ERROR("minfs: cannot seek to block %u\n", bno);
+    const ssize_t length = static_cast<ssize_t>(count) * kMinfsBlockSize;
+    if (lseek(fd_.get(), off, SEEK_SET) < 0 || read(fd_.get(), data, length) != length) {
         return ZX_ERR_IO;
     }
-    if (read(fd_.get(), data, kMinfsBlockSize) != kMinfsBlockSize) {
+    return ZX_OK;
+}
+
+zx_status_t Bcache::Readblk(blk_t bno, void* data) {
+#ifdef __Fuchsia__
+    fbl::AutoLock lock(&cache_lock_);
+#endif
+    auto overlay = overlay_.find(bno);
+    if (overlay.IsValid()) {
+        memcpy(data, overlay->data, kMinfsBlockSize);
+        return ZX_OK;
+    }
+
+    auto iter = cache_.find(bno);
+    if (iter.IsValid()) {
+        stats_.hits++;
+        lru_.erase(*iter);
+        lru_.push_back(&*iter);
+        memcpy(data, iter->data, kMinfsBlockSize);
+        next_sequential_ = bno + 1;
+        return ZX_OK;
+    }
+    stats_.misses++;
+
+    blk_t readahead = ReadaheadLength(bno);
+    if (readahead > 0) {
+        if (readahead_buffer_ == nullptr) {
+            fbl::AllocChecker ac;
+            readahead_buffer_.reset(new (&ac) uint8_t[(1 + kBcacheMaxReadahead) *
+                                                      kMinfsBlockSize]);
+            if (!ac.check()) {
+                CacheEvict(cache_size_ / 2);
+                readahead = 0;
+            }
+        }
+        // Blocks near the end of the device may not be readable (for
+        // instance, when they lie in an unallocated FVM slice), so fall back
+        // to reading just the requested block.
+        if (readahead > 0 && ReadDevice(bno, 1 + readahead, readahead_buffer_.get()) == ZX_OK) {
+            stats_.readahead_blocks += readahead;
+            memcpy(data, readahead_buffer_.get(), kMinfsBlockSize);
+            for (blk_t i = 0; i <= readahead; i++) {
+                // Leave blocks which were already cached where they are in
+                // the LRU order.
+                if (!cache_.find(bno + i).IsValid()) {
+                    CacheStore(bno + i, &readahead_buffer_[i * kMinfsBlockSize], true);
+                }
+            }
+            return ZX_OK;
+        }
+        readahead_ = 0;
+        next_sequential_ = bno + 1;
+    }
+
+    zx_status_t status = ReadDevice(bno, 1, data);
+    if (status != ZX_OK) {
         FS_TRACE_ERROR("minfs: cannot read block %u\n", bno);
-        return ZX_ERR_IO;
+        return status;
     }
+    CacheStore(bno, data, true);
     return ZX_OK;
 }
 
 zx_status_t Bcache::Writeblk(blk_t bno, const void* data) {
+#ifdef __Fuchsia__
+    fbl::AutoLock lock(&cache_lock_);
+#endif
+    OverlayInvalidate(bno, 1);
     off_t off = static_cast<off_t>(bno) * kMinfsBlockSize;
     assert(off / kMinfsBlockSize == bno); // Overflow
 #ifndef __Fuchsia__
@@ -46,15 +107,152 @@ zx_status_t Bcache::Writeblk(blk_t bno, const void* data) {
 #endif
     if (lseek(fd_.get(), off, SEEK_SET) < 0) {
         FS_TRACE_ERROR("minfs: cannot seek to block %u\n", bno);
+        CacheInvalidate(bno, 1);
         return ZX_ERR_IO;
     }
     if (write(fd_.get(), data, kMinfsBlockSize) != kMinfsBlockSize) {
         FS_TRACE_ERROR("minfs: cannot write block %u\n", bno);
+        CacheInvalidate(bno, 1);
         return ZX_ERR_IO;
     }
+    CacheStore(bno, data, false);
     return ZX_OK;
 }
 
+blk_t Bcache::ReadaheadLength(blk_t bno) {
+    if (bno != next_sequential_) {
+        readahead_ = 0;
+    } else if (readahead_ == 0) {
+        readahead_ = 4;
+    } else {
+        readahead_ = fbl::min(readahead_ * 2, static_cast<blk_t>(kBcacheMaxReadahead));
+    }
+    // Stop at the end of the device, and never read ahead so far that the
+    // blocks evict each other.
+    blk_t length = readahead_;
+    length = fbl::min(length, static_cast<blk_t>(cache_limit_ / 2));
+    length = (bno < blockmax_) ? fbl::min(length, blockmax_ - bno - 1) : 0;
+    next_sequential_ = bno + 1 + length;
+    return length;
+}
+
+void Bcache::CacheStore(blk_t bno, const void* data, bool insert) {
+    auto iter = cache_.find(bno);
+    if (iter.IsValid()) {
+        memcpy(iter->data, data, kMinfsBlockSize);
+        lru_.erase(*iter);
+        lru_.push_back(&*iter);
+        return;
+    }
+    if (!insert) {
+        return;
+    }
+
+    if (cache_limit_ == 0) {
+        return;
+    }
+
+    fbl::unique_ptr<CacheBlock> block;
+    if (cache_size_ >= cache_limit_) {
+        // Recycle the least recently used block.
+        CacheBlock* victim = lru_.pop_front();
+        block = cache_.erase(*victim);
+        cache_size_--;
+        stats_.evictions++;
+    } else {
+        fbl::AllocChecker ac;
+        block.reset(new (&ac) CacheBlock());
+        if (!ac.check()) {
+            // Give back memory rather than caching more.
+            CacheEvict(cache_size_ / 2);
+            return;
+        }
+    }
+    block->bno = bno;
+    memcpy(block->data, data, kMinfsBlockSize);
+    lru_.push_back(block.get());
+    cache_.insert(std::move(block));
+    cache_size_++;
+}
+
+void Bcache::CacheInvalidate(blk_t start, blk_t count) {
+    auto iter = cache_.lower_bound(start);
+    while (iter.IsValid() && iter->bno - start < count) {
+        CacheBlock* block = &*iter;
+        ++iter;
+        lru_.erase(*block);
+        cache_.erase(*block);
+        cache_size_--;
+    }
+}
+
+void Bcache::CacheEvict(size_t max_blocks) {
+    while (cache_size_ > max_blocks) {
+        CacheBlock* block = lru_.pop_front();
+        cache_.erase(*block);
+        cache_size_--;
+        stats_.evictions++;
+    }
+}
+
+void Bcache::OverlayInvalidate(blk_t start, blk_t count) {
+    auto iter = overlay_.lower_bound(start);
+    while (iter.IsValid() && iter->bno - start < count) {
+        CacheBlock* block = &*iter;
+        ++iter;
+        overlay_.erase(*block);
+    }
+}
+
+zx_status_t Bcache::OverlayBlock(blk_t bno, const void* data) {
+#ifdef __Fuchsia__
+    fbl::AutoLock lock(&cache_lock_);
+#endif
+    auto iter = overlay_.find(bno);
+    if (iter.IsValid()) {
+        memcpy(iter->data, data, kMinfsBlockSize);
+        return ZX_OK;
+    }
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<CacheBlock> block(new (&ac) CacheBlock());
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    block->bno = bno;
+    memcpy(block->data, data, kMinfsBlockSize);
+    overlay_.insert(std::move(block));
+    return ZX_OK;
+}
+
+void Bcache::GetCacheStats(CacheStats* out) {
+#ifdef __Fuchsia__
+    fbl::AutoLock lock(&cache_lock_);
+#endif
+    *out = stats_;
+    out->blocks = cache_size_;
+}
+
+void Bcache::ShrinkCache(size_t max_blocks) {
+#ifdef __Fuchsia__
+    fbl::AutoLock lock(&cache_lock_);
+#endif
+    CacheEvict(max_blocks);
+    if (max_blocks == 0) {
+        readahead_buffer_.reset();
+    }
+}
+
+void Bcache::SetCacheLimit(size_t max_blocks) {
+    max_blocks = fbl::min(max_blocks, kBcacheBlocks);
+    {
+#ifdef __Fuchsia__
+        fbl::AutoLock lock(&cache_lock_);
+#endif
+        cache_limit_ = max_blocks;
+    }
+    ShrinkCache(max_blocks);
+}
+
 int Bcache::Sync() {
     fs::WriteTxn sync_txn(this);
     sync_txn.EnqueueFlush();
@@ -92,6 +290,74 @@ zx_status_t Bcache::Create(fbl::unique_ptr<Bcache>* out, fbl::unique_fd fd, uint
 }
 
 #ifdef __Fuchsia__
+zx_status_t Bcache::Transaction(block_fifo_request_t* requests, size_t count) {
+    zx_status_t status = fifo_client_.Transaction(requests, count);
+
+    const uint32_t kDiskBlocksPerMinfsBlock = kMinfsBlockSize / info_.block_size;
+    fbl::AutoLock lock(&cache_lock_);
+    for (size_t i = 0; i < count; i++) {
+        switch (requests[i].opcode & BLOCKIO_OP_MASK) {
+        case BLOCKIO_WRITE: {
+            // Whether or not the writes succeeded, the device may now hold
+            // either version of the blocks.
+            uint64_t start = requests[i].dev_offset / kDiskBlocksPerMinfsBlock;
+            uint64_t end = (requests[i].dev_offset + requests[i].length +
+                            kDiskBlocksPerMinfsBlock - 1) / kDiskBlocksPerMinfsBlock;
+            CacheInvalidate(static_cast<blk_t>(start), static_cast<blk_t>(end - start));
+            OverlayInvalidate(static_cast<blk_t>(start), static_cast<blk_t>(end - start));
+            break;
+        }
+        case BLOCKIO_READ:
+            if (status == ZX_OK && !overlay_.is_empty()) {
+                status = OverlayRead(requests[i]);
+            }
+            break;
+        case BLOCKIO_CLOSE_VMO:
+            for (size_t j = 0; j < attached_vmos_.size(); j++) {
+                if (attached_vmos_[j].vmoid == requests[i].vmoid) {
+                    attached_vmos_.erase(j);
+                    break;
+                }
+            }
+            break;
+        }
+    }
+    return status;
+}
+
+zx_status_t Bcache::OverlayRead(const block_fifo_request_t& request) {
+    const zx::vmo* vmo = nullptr;
+    for (const AttachedVmo& attached : attached_vmos_) {
+        if (attached.vmoid == request.vmoid) {
+            vmo = &attached.vmo;
+        }
+    }
+    if (vmo == nullptr) {
+        return ZX_OK;
+    }
+
+    // Offsets in bytes.
+    const uint64_t dev_start = request.dev_offset * info_.block_size;
+    const uint64_t dev_end = dev_start + request.length * info_.block_size;
+    const uint64_t vmo_start = request.vmo_offset * info_.block_size;
+    for (auto iter = overlay_.lower_bound(static_cast<blk_t>(dev_start / kMinfsBlockSize));
+         iter.IsValid(); ++iter) {
+        const uint64_t offset = static_cast<uint64_t>(iter->bno) * kMinfsBlockSize;
+        if (offset + kMinfsBlockSize > dev_end) {
+            break;
+        }
+        if (offset < dev_start) {
+            continue;
+        }
+        zx_status_t status = vmo->write(iter->data, vmo_start + offset - dev_start,
+                                        kMinfsBlockSize);
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+    return ZX_OK;
+}
+
 zx_status_t Bcache::GetDevicePath(size_t buffer_len, char* out_name, size_t* out_len) {
     ssize_t r = ioctl_device_get_topo_path(fd_.get(), out_name, buffer_len);
     if (r < 0) {
@@ -102,7 +368,7 @@ zx_status_t Bcache::GetDevicePath(size_t buffer_len, char* out_name, size_t* out
 
 }
 
-zx_status_t Bcache::AttachVmo(const zx::vmo& vmo, vmoid_t* out) const {
+zx_status_t Bcache::AttachVmo(const zx::vmo& vmo, vmoid_t* out) {
     zx::vmo xfer_vmo;
     zx_status_t status = vmo.duplicate(ZX_RIGHT_SAME_RIGHTS, &xfer_vmo);
     if (status != ZX_OK) {
@@ -113,6 +379,20 @@ zx_status_t Bcache::AttachVmo(const zx::vmo& vmo, vmoid_t* out) const {
     if (r < 0) {
         return static_cast<zx_status_t>(r);
     }
+
+    fbl::AutoLock lock(&cache_lock_);
+    if (!overlay_.is_empty()) {
+        AttachedVmo attached;
+        attached.vmoid = *out;
+        if ((status = vmo.duplicate(ZX_RIGHT_SAME_RIGHTS, &attached.vmo)) != ZX_OK) {
+            return status;
+        }
+        fbl::AllocChecker ac;
+        attached_vmos_.push_back(std::move(attached), &ac);
+        if (!ac.check()) {
+            return ZX_ERR_NO_MEMORY;
+        }
+    }
     return ZX_OK;
 }
 #endif
@@ -121,6 +401,9 @@ Bcache::Bcache(fbl::unique_fd fd, uint32_t blockmax) :
     fd_(std::move(fd)), blockmax_(blockmax) {}
 
 Bcache::~Bcache() {
+    lru_.clear();
+    cache_.clear();
+    overlay_.clear();
 #ifdef __Fuchsia__
     if (fd_) {
         ioctl_block_fifo_close(fd_.get());
@@ -2,11 +2,14 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <fbl/alloc_checker.h>
+#include <fbl/array.h>
 #include <minfs/format.h>
 #include <minfs/fsck.h>
 
@@ -46,6 +49,7 @@ private:
                                blk_t* bno_out);
     zx_status_t CheckDirectory(Inode* inode, ino_t ino,
                                ino_t parent, uint32_t flags);
+    zx_status_t CheckDirectoryIndex(Inode* inode, ino_t ino);
     const char* CheckDataBlock(blk_t bno);
     zx_status_t CheckFile(Inode* inode, ino_t ino);
 
@@ -177,6 +181,7 @@ zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino,
         return status;
     }
 
+    const bool indexed = (inode->flags & kMinfsInodeFlagDirIndex) != 0;
     size_t off = 0;
     while (true) {
         uint32_t data[MINFS_DIRENT_SIZE];
@@ -201,6 +206,11 @@ zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino,
             FS_TRACE_ERROR("check: ino#%u: de[%u]: bad dirent reclen (%u)\n", ino, eno, rlen);
             return ZX_ERR_IO_DATA_INTEGRITY;
         }
+        if (indexed && (is_last || ((off % kMinfsBlockSize) + rlen > kMinfsBlockSize))) {
+            FS_TRACE_ERROR("check: ino#%u: de[%u]: dirent crosses a block of an indexed directory\n",
+                           ino, eno);
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
         if (de->ino == 0) {
             if (flags & CD_DUMP) {
                 FS_TRACE_DEBUG("ino#%u: de[%u]: <empty> reclen=%u\n", ino, eno, rlen);
@@ -253,7 +263,7 @@ zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino,
             }
             dirent_count++;
         }
-        if (is_last) {
+        if (is_last || (indexed && (off + rlen == inode->size))) {
             break;
         } else {
             off += rlen;
@@ -273,6 +283,114 @@ zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino,
     return ZX_OK;
 }
 
+// Checks the index of a hashed directory: the layout of block 0, that the root
+// refers to every leaf exactly once, and that every name is in the leaf for its
+// hash. CheckDirectory checks the dirents themselves.
+zx_status_t MinfsChecker::CheckDirectoryIndex(Inode* inode, ino_t ino) {
+    if (fs_->Info().version != kMinfsVersion) {
+        FS_TRACE_ERROR("check: ino#%u: directory index in a version %u filesystem\n", ino,
+                       fs_->Info().version);
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    if ((inode->size % kMinfsBlockSize != 0) || (inode->size < 2 * kMinfsBlockSize) ||
+        (inode->size > kMinfsMaxIndexedDirectorySize)) {
+        FS_TRACE_ERROR("check: ino#%u: bad indexed directory size %u\n", ino, inode->size);
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    blk_t block_count = inode->size / kMinfsBlockSize;
+
+    zx_status_t status;
+    fbl::RefPtr<VnodeMinfs> vn;
+    if ((status = VnodeMinfs::Recreate(fs_.get(), ino, &vn)) != ZX_OK) {
+        return status;
+    }
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint32_t[]> root_block(new (&ac) uint32_t[kMinfsBlockSize / sizeof(uint32_t)]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    fbl::unique_ptr<uint32_t[]> leaf(new (&ac) uint32_t[kMinfsBlockSize / sizeof(uint32_t)]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    fbl::Array<bool> referenced(new (&ac) bool[block_count](), block_count);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    size_t actual;
+    status = vn->ReadInternal(root_block.get(), kMinfsBlockSize, 0, &actual);
+    if (status != ZX_OK || actual != kMinfsBlockSize) {
+        FS_TRACE_ERROR("check: ino#%u: Could not read index root\n", ino);
+        return status != ZX_OK ? status : ZX_ERR_IO;
+    }
+
+    char* block = reinterpret_cast<char*>(root_block.get());
+    const Dirent* dot = reinterpret_cast<const Dirent*>(block);
+    const Dirent* dotdot = reinterpret_cast<const Dirent*>(block + DirentSize(1));
+    const Dirent* de = reinterpret_cast<const Dirent*>(block + kMinfsDirIndexDirentOffset);
+    if ((dot->reclen != DirentSize(1)) || (dotdot->reclen != DirentSize(2)) || (de->ino != 0) ||
+        (de->reclen != kMinfsBlockSize - kMinfsDirIndexDirentOffset)) {
+        FS_TRACE_ERROR("check: ino#%u: bad layout of index root block\n", ino);
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    const DirIndexRoot* root = reinterpret_cast<const DirIndexRoot*>(
+        block + kMinfsDirIndexRootOffset);
+    if ((root->magic != kMinfsDirIndexMagic) || (root->hash_version != kMinfsDirHashFnv1a)) {
+        FS_TRACE_ERROR("check: ino#%u: bad index root magic %08x / hash %u\n", ino,
+                       root->magic, root->hash_version);
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    if (root->count != block_count - 1) {
+        FS_TRACE_ERROR("check: ino#%u: index has %u leaves in %u blocks\n", ino, root->count,
+                       block_count);
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    for (uint32_t i = 0; i < root->count; i++) {
+        const DirIndexEntry& entry = root->entries[i];
+        if ((i == 0) ? (entry.hash != 0) : (entry.hash <= root->entries[i - 1].hash)) {
+            FS_TRACE_ERROR("check: ino#%u: index entry %u: hash %08x out of order\n", ino, i,
+                           entry.hash);
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+        if ((entry.block == 0) || (entry.block >= block_count) || referenced[entry.block]) {
+            FS_TRACE_ERROR("check: ino#%u: index entry %u: bad block %u\n", ino, i, entry.block);
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+        referenced[entry.block] = true;
+
+        status = vn->ReadInternal(leaf.get(), kMinfsBlockSize, entry.block * kMinfsBlockSize,
+                                  &actual);
+        if (status != ZX_OK || actual != kMinfsBlockSize) {
+            FS_TRACE_ERROR("check: ino#%u: Could not read leaf %u\n", ino, entry.block);
+            return status != ZX_OK ? status : ZX_ERR_IO;
+        }
+        uint64_t hash_end = (i + 1 < root->count) ? root->entries[i + 1].hash : (1ull << 32);
+        const char* data = reinterpret_cast<const char*>(leaf.get());
+        uint32_t rlen;
+        for (size_t off = 0; off < kMinfsBlockSize; off += rlen) {
+            de = reinterpret_cast<const Dirent*>(data + off);
+            rlen = de->reclen & kMinfsReclenMask;
+            if ((off + MINFS_DIRENT_SIZE > kMinfsBlockSize) || (rlen < MINFS_DIRENT_SIZE) ||
+                (off + rlen > kMinfsBlockSize)) {
+                // Reported by CheckDirectory.
+                break;
+            }
+            if (de->ino == 0) {
+                continue;
+            }
+            uint32_t hash = DirentHash(de->name, de->namelen);
+            if ((hash < entry.hash) || (hash >= hash_end)) {
+                FS_TRACE_ERROR("check: ino#%u: '%.*s' (hash %08x) in leaf for [%08x, %08llx)\n",
+                               ino, de->namelen, de->name, hash, entry.hash,
+                               static_cast<unsigned long long>(hash_end));
+                return ZX_ERR_IO_DATA_INTEGRITY;
+            }
+        }
+    }
+    return ZX_OK;
+}
+
 const char* MinfsChecker::CheckDataBlock(blk_t bno) {
     if (bno == 0) {
         return "reserved bno";
@@ -443,11 +561,20 @@ zx_status_t MinfsChecker::CheckInode(ino_t ino, ino_t parent, bool dot_or_dotdot
         conforming_ = false;
     }
 
+    if ((inode.flags & kMinfsInodeFlagDirIndex) && (inode.magic != kMinfsMagicDir)) {
+        FS_TRACE_ERROR("check: ino#%u: directory index flag on a file\n", ino);
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
     if (inode.magic == kMinfsMagicDir) {
         FS_TRACE_DEBUG("ino#%u: DIR blks=%u links=%u\n", ino, inode.block_count, inode.link_count);
         if ((status = CheckFile(&inode, ino)) < 0) {
             return status;
         }
+        if ((inode.flags & kMinfsInodeFlagDirIndex) &&
+            (status = CheckDirectoryIndex(&inode, ino)) < 0) {
+            return status;
+        }
         if ((status = CheckDirectory(&inode, ino, parent, CD_DUMP)) < 0) {
             return status;
         }
@@ -582,22 +709,17 @@ zx_status_t MinfsChecker::CheckAllocatedCounts() const {
 }
 
 zx_status_t MinfsChecker::CheckJournal() const {
-    char data[kMinfsBlockSize];
-    blk_t journal_block;
-#ifdef __Fuchsia__
-    journal_block = fs_->Info().journal_start_block;
-#else
-    journal_block = fs_->offsets_.JournalStartBlock();
-#endif
-
-    if (fs_->bc_->Readblk(journal_block, data) < 0) {
-        FS_TRACE_ERROR("minfs: could not read journal block\n");
-        return ZX_ERR_IO;
-    }
+    blk_t journal_block, journal_blocks;
+    GetJournalRegion(*fs_->bc_, fs_->Info(), &journal_block, &journal_blocks);
 
-    const JournalInfo* journal_info = reinterpret_cast<const JournalInfo*>(data);
-    if (journal_info->magic != kJournalMagic) {
-        FS_TRACE_ERROR("minfs: invalid journal magic\n");
+    JournalInfo journal_info;
+    zx_status_t status;
+    if ((status = LoadJournalInfo(fs_->bc_.get(), journal_block, &journal_info)) != ZX_OK) {
+        return status;
+    }
+    if (journal_info.start_block >= journal_blocks - 1) {
+        FS_TRACE_ERROR("minfs: journal start %" PRIu64 " out of range\n",
+                       journal_info.start_block);
         return ZX_ERR_BAD_STATE;
     }
 
@@ -648,6 +770,18 @@ zx_status_t Fsck(fbl::unique_ptr<Bcache> bc) {
         return status;
     }
 
+    // Check the filesystem as it will be mounted, with the journal replayed,
+    // but leave the replay itself to the mount: the check writes nothing.
+    size_t pending;
+    if ((status = OverlayJournal(bc.get(), *info, &pending)) != ZX_OK) {
+        FS_TRACE_ERROR("Fsck: could not read journal: %d\n", status);
+        return status;
+    }
+    if (pending > 0 && bc->Readblk(0, data) < 0) {
+        FS_TRACE_ERROR("minfs: could not read info block\n");
+        return ZX_ERR_IO;
+    }
+
     MinfsChecker chk;
     if ((status = chk.Init(std::move(bc), info)) != ZX_OK) {
         FS_TRACE_ERROR("Fsck: Init failure: %d\n", status);
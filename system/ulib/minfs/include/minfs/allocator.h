@@ -7,6 +7,12 @@
 
 #pragma once
 
+#ifdef __Fuchsia__
+#include <bitmap/rle-bitmap.h>
+#include <fbl/mutex.h>
+#include <fbl/vector.h>
+#endif
+
 #include <fbl/function.h>
 #include <fbl/macros.h>
 #include <fbl/unique_ptr.h>
@@ -197,11 +203,26 @@ public:
 
     // Reserve |count| elements. This is required in order to later allocate them.
     // Outputs a |promise| which contains reservation details.
+    //
+    // Returns ZX_ERR_SHOULD_WAIT if there would be enough elements once the
+    // frees of pending transactions commit; the caller should wait for
+    // writeback and try again, rather than grow the pool.
     zx_status_t Reserve(WriteTxn* txn, size_t count, fbl::unique_ptr<AllocatorPromise>* promise);
 
     // Free an item from the allocator.
+    //
+    // On Fuchsia, the item may not be allocated again until |txn| has been
+    // committed, which is when the journal calls FreeCommitted. Until then a
+    // replay would leave it in use, so it must not be handed out to, say, a
+    // file whose data is written in place before the journal entry freeing it.
     void Free(WriteTxn* txn, size_t index);
 
+#ifdef __Fuchsia__
+    // Makes |index|, which was freed by a transaction that has since been
+    // committed, available for allocation again. May be called from any thread.
+    void FreeCommitted(size_t index) __TA_EXCLUDES(committed_lock_);
+#endif
+
 private:
     friend class MinfsChecker;
     friend class AllocatorPromise;
@@ -222,12 +243,31 @@ private:
     // over-reserved initially.
     void Unreserve(size_t count);
 
-    // Return the number of total available elements, after taking reservations into account.
+    // Return the number of elements freed by transactions which have not been committed yet.
+    size_t GetPendingFrees() const {
+#ifdef __Fuchsia__
+        return pending_.num_bits();
+#else
+        return 0;
+#endif
+    }
+
+    // Return the number of total available elements, after taking reservations and pending
+    // frees into account.
     size_t GetAvailable() {
-        ZX_DEBUG_ASSERT(metadata_.PoolAvailable() >= reserved_);
-        return metadata_.PoolAvailable() - reserved_;
+        ZX_DEBUG_ASSERT(metadata_.PoolAvailable() >= reserved_ + GetPendingFrees());
+        return metadata_.PoolAvailable() - reserved_ - GetPendingFrees();
     }
 
+#ifdef __Fuchsia__
+    // Makes the elements passed to FreeCommitted available for allocation.
+    void ReclaimCommittedFrees() __TA_EXCLUDES(committed_lock_);
+#endif
+
+    // Finds a free element in [start, end) which may be allocated, returning
+    // ZX_ERR_NO_RESOURCES if there is none.
+    zx_status_t FindAvailable(size_t start, size_t end, size_t* out) const;
+
     Bcache* bc_;
     SuperblockManager* sb_;
     size_t unit_size_;
@@ -237,6 +277,18 @@ private:
 
     size_t reserved_;
     size_t hint_;
+
+#ifdef __Fuchsia__
+    // Elements freed by transactions which have not been committed. They are
+    // clear in |map_|, so that the freeing transaction persists them as free,
+    // but may not be allocated yet.
+    bitmap::RleBitmap pending_;
+
+    // Elements passed to FreeCommitted by the writeback thread, which are
+    // removed from |pending_| on the next Reserve or Allocate.
+    fbl::Mutex committed_lock_;
+    fbl::Vector<size_t> committed_ __TA_GUARDED(committed_lock_);
+#endif
 };
 
 } // namespace minfs
@@ -13,15 +13,18 @@
 #include <block-client/cpp/client.h>
 #include <fs/fvm.h>
 #include <lib/zx/vmo.h>
-#else
-#include <fbl/vector.h>
 #endif
 
 #include <fbl/algorithm.h>
+#include <fbl/intrusive_double_list.h>
+#include <fbl/intrusive_wavl_tree.h>
 #include <fbl/macros.h>
+#include <fbl/mutex.h>
 #include <fbl/unique_ptr.h>
 #include <fbl/unique_fd.h>
+#include <fbl/vector.h>
 #include <fs/block-txn.h>
+#include <fs/locking.h>
 #include <fs/trace.h>
 #include <fs/vfs.h>
 #include <fs/vnode.h>
@@ -31,6 +34,17 @@
 
 namespace minfs {
 
+// The largest number of blocks held by the block cache.
+constexpr size_t kBcacheBlocks = 256;
+
+// The number of blocks held by the block cache of a mounted filesystem. It
+// reads its metadata into VMOs when it is mounted, so after that only the few
+// reads which bypass them go through the cache.
+constexpr size_t kBcacheMountedBlocks = 32;
+
+// The largest number of blocks read ahead of a sequential read.
+constexpr size_t kBcacheMaxReadahead = 32;
+
 class Bcache : public fs::TransactionHandler {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Bcache);
@@ -57,17 +71,50 @@ public:
         return info_.block_size;
     }
 
-    zx_status_t Transaction(block_fifo_request_t* requests, size_t count) final {
-        return fifo_client_.Transaction(requests, count);
-    }
+    // Cached copies of any blocks written by |requests| are dropped.
+    zx_status_t Transaction(block_fifo_request_t* requests, size_t count) final;
 #endif // __Fuchsia__
-    // Raw block read functions.
-    // These do not track blocks (or attempt to access the block cache)
+    // Block read and write functions.
+    //
+    // These go through a small write-through cache of recently read blocks.
+    // A miss which continues a run of sequential reads also reads ahead, so
+    // scans of the inode table, bitmaps and indirect blocks take one device
+    // read per run rather than one per block.
     // NOTE: Not marked as final, since these are overridden methods on host,
     // but not on __Fuchsia__.
     zx_status_t Readblk(blk_t bno, void* data);
     zx_status_t Writeblk(blk_t bno, const void* data);
 
+    // Counters describing the block cache.
+    struct CacheStats {
+        uint64_t hits;
+        uint64_t misses;
+        // Blocks read ahead of a miss, whether or not they were used.
+        uint64_t readahead_blocks;
+        uint64_t evictions;
+        // Blocks currently cached.
+        uint64_t blocks;
+    };
+    void GetCacheStats(CacheStats* out);
+
+    // Drops the least recently used blocks from the cache until at most
+    // |max_blocks| remain. The cache refills as blocks are read again, so this
+    // may be called whenever memory is needed elsewhere.
+    void ShrinkCache(size_t max_blocks);
+
+    // Keeps the cache at or below |max_blocks| from now on, shrinking it
+    // first if it holds more. The limit never exceeds kBcacheBlocks.
+    void SetCacheLimit(size_t max_blocks);
+
+    // Makes reads of block |bno| return a copy of |data| rather than what the
+    // device holds, without writing anything to the device. A later write to
+    // |bno| replaces the overlaid copy. Fsck uses this to check a filesystem
+    // as it will be once its journal is replayed.
+    //
+    // On Fuchsia this also applies to read transactions, but only into VMOs
+    // attached after the first block was overlaid.
+    zx_status_t OverlayBlock(blk_t bno, const void* data);
+
     ////////////////
     // Other methods.
 
@@ -80,7 +127,7 @@ public:
 
 #ifdef __Fuchsia__
     zx_status_t GetDevicePath(size_t buffer_len, char* out_name, size_t* out_len);
-    zx_status_t AttachVmo(const zx::vmo& vmo, vmoid_t* out) const;
+    zx_status_t AttachVmo(const zx::vmo& vmo, vmoid_t* out);
 
     zx_status_t FVMQuery(fvm_info_t* info) const {
         ssize_t r = ioctl_block_fvm_query(fd_.get(), info);
@@ -134,8 +181,47 @@ public:
     ~Bcache();
 
 private:
+    // A cached copy of block |bno|. Blocks are indexed by number and kept on
+    // a list from least to most recently used.
+    struct CacheBlock : public fbl::WAVLTreeContainable<fbl::unique_ptr<CacheBlock>>,
+                        public fbl::DoublyLinkedListable<CacheBlock*> {
+        blk_t GetKey() const { return bno; }
+
+        blk_t bno;
+        uint8_t data[kMinfsBlockSize];
+    };
+
     Bcache(fbl::unique_fd fd, uint32_t blockmax);
 
+    // Reads |count| consecutive blocks starting at |bno| from the device.
+    zx_status_t ReadDevice(blk_t bno, blk_t count, void* data);
+
+    // Returns the number of blocks to read ahead of a miss on |bno|, and
+    // updates the sequential read detection.
+    blk_t ReadaheadLength(blk_t bno) FS_TA_REQUIRES(cache_lock_);
+
+    // Copies |data| into the cached copy of |bno|, adding one if |insert|.
+    void CacheStore(blk_t bno, const void* data, bool insert) FS_TA_REQUIRES(cache_lock_);
+
+    // Drops the cached copies of blocks [start, start + count).
+    void CacheInvalidate(blk_t start, blk_t count) FS_TA_REQUIRES(cache_lock_);
+
+    void CacheEvict(size_t max_blocks) FS_TA_REQUIRES(cache_lock_);
+
+    // Drops the overlaid copies of blocks [start, start + count).
+    void OverlayInvalidate(blk_t start, blk_t count) FS_TA_REQUIRES(cache_lock_);
+
+#ifdef __Fuchsia__
+    // Copies the overlaid blocks within |request|, a completed read, into the
+    // VMO it read into.
+    zx_status_t OverlayRead(const block_fifo_request_t& request) FS_TA_REQUIRES(cache_lock_);
+
+    struct AttachedVmo {
+        vmoid_t vmoid;
+        zx::vmo vmo;
+    };
+#endif
+
 #ifdef __Fuchsia__
     block_client::Client fifo_client_{}; // Fast path to interact with block device
     block_info_t info_{};
@@ -145,6 +231,29 @@ private:
 #endif
     fbl::unique_fd fd_{};
     uint32_t blockmax_{};
+
+#ifdef __Fuchsia__
+    // Serializes device reads with cache updates, so that a block written
+    // through |Transaction| while it is being read is never left cached.
+    fbl::Mutex cache_lock_;
+#endif
+    fbl::WAVLTree<blk_t, fbl::unique_ptr<CacheBlock>> cache_ FS_TA_GUARDED(cache_lock_);
+    fbl::DoublyLinkedList<CacheBlock*> lru_ FS_TA_GUARDED(cache_lock_);
+    size_t cache_size_ FS_TA_GUARDED(cache_lock_) = 0;
+    size_t cache_limit_ FS_TA_GUARDED(cache_lock_) = kBcacheBlocks;
+    // The block which would continue the current run of sequential reads,
+    // and how far ahead of it to read on the next miss.
+    blk_t next_sequential_ FS_TA_GUARDED(cache_lock_) = 0;
+    blk_t readahead_ FS_TA_GUARDED(cache_lock_) = 0;
+    fbl::unique_ptr<uint8_t[]> readahead_buffer_ FS_TA_GUARDED(cache_lock_);
+    CacheStats stats_ FS_TA_GUARDED(cache_lock_) = {};
+
+    // Blocks set by |OverlayBlock|, which reads return instead of the device's.
+    fbl::WAVLTree<blk_t, fbl::unique_ptr<CacheBlock>> overlay_ FS_TA_GUARDED(cache_lock_);
+#ifdef __Fuchsia__
+    // The VMOs attached while there are overlaid blocks, for |OverlayRead|.
+    fbl::Vector<AttachedVmo> attached_vmos_ FS_TA_GUARDED(cache_lock_);
+#endif
 };
 
 } // namespace minfs
@@ -16,11 +16,14 @@ namespace minfs {
 
 #ifdef __Fuchsia__
 
+class Allocator;
+
 struct WriteRequest {
     zx_handle_t vmo;
     size_t vmo_offset;
     size_t dev_offset;
     size_t length;
+    bool data;          // File data, which is written in place rather than journaled.
 };
 
 // A transaction consisting of enqueued VMOs to be written
@@ -32,7 +35,9 @@ struct WriteRequest {
 class WriteTxn {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(WriteTxn);
-    explicit WriteTxn(Bcache* bc) : bc_(bc) {}
+    // Takes a Bcache to match fs::WriteTxn, which is used on the host. Here
+    // the requests are written out by the Journal instead.
+    explicit WriteTxn(Bcache*) {}
     ~WriteTxn() {
         ZX_DEBUG_ASSERT_MSG(requests_.size() == 0, "WriteTxn still has pending requests");
     }
@@ -40,20 +45,34 @@ public:
     // Identify that a block should be written to disk at a later point in time.
     void Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset, uint64_t nblocks);
 
+    // Like |Enqueue|, but for blocks of file data. Those skip the metadata
+    // journal and are written straight to their final location.
+    void EnqueueData(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset, uint64_t nblocks);
+
     fbl::Vector<WriteRequest>& Requests() { return requests_; }
 
     size_t BlkCount() const;
 
-protected:
-    // Activate the transaction, writing it out to disk.
-    //
-    // Each transaction uses the |vmo| / |vmoid| pair supplied, since the
-    // transactions should be all reading from a single in-memory buffer.
-    zx_status_t Flush(zx_handle_t vmo, vmoid_t vmoid);
+    // Records that this transaction freed element |index| of |allocator|,
+    // which keeps it from being allocated again until the transaction has
+    // been committed (see Allocator::Free).
+    void DeferFree(Allocator* allocator, size_t index);
+
+    // Hands the elements recorded by DeferFree back to their allocators. Called
+    // once the transaction has been committed.
+    void CommitFrees();
 
 private:
-    Bcache* bc_;
+    struct DeferredFree {
+        Allocator* allocator;
+        size_t index;
+    };
+
+    void EnqueueRequest(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
+                        uint64_t nblocks, bool data);
+
     fbl::Vector<WriteRequest> requests_;
+    fbl::Vector<DeferredFree> frees_;
 };
 
 #else
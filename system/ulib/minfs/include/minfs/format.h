@@ -32,7 +32,11 @@ typedef uint32_t ino_t;
 
 constexpr uint64_t kMinfsMagic0         = (0x002153466e694d21ULL);
 constexpr uint64_t kMinfsMagic1         = (0x385000d3d3d3d304ULL);
-constexpr uint32_t kMinfsVersion        = 0x00000007;
+constexpr uint32_t kMinfsVersion        = 0x00000008;
+// The last version without hashed directory indexes. Such filesystems are
+// still mounted, and are upgraded to kMinfsVersion when their first
+// directory index is created.
+constexpr uint32_t kMinfsVersionNoDirIndex = 0x00000007;
 
 constexpr ino_t    kMinfsRootIno        = 1;
 constexpr uint32_t kMinfsFlagClean      = 0x00000001; // Currently unused
@@ -129,16 +133,63 @@ constexpr size_t kMinfsMinimumSlices = 7;
 
 constexpr uint64_t kMinfsDefaultInodeCount = 32768;
 
+// Metadata journal
+//
+// The journal region starts with a JournalInfo block. The remaining blocks of
+// the region hold a circular log of entries, each of which is a HeaderBlock,
+// a copy of every metadata block updated by the entry, and a CommitBlock.
+// Metadata updates are written to the log before they are written in place;
+// file data is always written in place.
+//
+// Entries carry consecutive sequence numbers. Replay starts with the entry at
+// JournalInfo.start_block, which must carry JournalInfo.sequence, and stops
+// at the first block which is not the header of the next entry, or whose
+// entry fails its checksum. JournalInfo is rewritten (a "checkpoint") only
+// once all the entries before the new start have been written in place.
+//
+// An update too large for one entry is split into a chain of entries, all
+// but the last of which carry kJournalEntryFlagContinued. Replay applies a
+// chain only once it has read the last entry, so an update is replayed
+// either whole or not at all.
+//
+// A JournalInfo whose fields other than the magic are all zero describes an
+// empty journal.
+
+constexpr uint64_t kJournalEntryHeaderMagic = (0x6d696e6a68656164ULL);
+constexpr uint64_t kJournalEntryCommitMagic = (0x6d696e6a636d6974ULL);
+
+// HeaderBlock.flags
+constexpr uint64_t kJournalEntryFlagContinued = 1; // The next entry belongs to the same update.
+
 struct JournalInfo {
     uint64_t magic;
-    uint64_t reserved0;
-    uint64_t reserved1;
-    uint64_t reserved2;
-    uint64_t reserved3;
+    uint64_t start_block;   // First entry to replay, relative to the first entry block.
+    uint64_t sequence;      // Sequence number of the entry at start_block.
+    uint32_t checksum;      // crc32 of the info block, computed with this field zero.
+    uint32_t reserved;
 };
 
 static_assert(sizeof(JournalInfo) <= kMinfsBlockSize, "Journal info size is too large");
 
+struct HeaderBlock {
+    uint64_t magic;         // kJournalEntryHeaderMagic
+    uint64_t sequence;
+    uint64_t num_blocks;    // Number of metadata blocks following the header.
+    uint64_t flags;         // kJournalEntryFlag*
+    blk_t target_blocks[kJournalEntryHeaderMaxBlocks];
+};
+
+static_assert(sizeof(HeaderBlock) == kMinfsBlockSize, "HeaderBlock size is wrong");
+
+struct CommitBlock {
+    uint64_t magic;         // kJournalEntryCommitMagic
+    uint64_t sequence;      // Matches the header.
+    uint32_t checksum;      // crc32 of the header and metadata blocks of the entry.
+    uint32_t reserved;
+};
+
+static_assert(sizeof(CommitBlock) <= kMinfsBlockSize, "CommitBlock size is too large");
+
 struct Inode {
     uint32_t magic;
     uint32_t size;
@@ -151,7 +202,8 @@ struct Inode {
     uint32_t dirent_count;          // for directories
     ino_t last_inode;               // index to the previous unlinked inode
     ino_t next_inode;               // index to the next unlinked inode
-    uint32_t rsvd[3];
+    uint32_t flags;                 // kMinfsInodeFlag*
+    uint32_t rsvd[2];
     blk_t dnum[kMinfsDirect];    // direct blocks
     blk_t inum[kMinfsIndirect];  // indirect blocks
     blk_t dinum[kMinfsDoublyIndirect]; // doubly indirect blocks
@@ -160,6 +212,9 @@ struct Inode {
 static_assert(sizeof(Inode) == kMinfsInodeSize,
               "minfs inode size is wrong");
 
+// The directory is laid out as a hashed index (see DirIndexRoot).
+constexpr uint32_t kMinfsInodeFlagDirIndex = 0x00000001;
+
 struct Dirent {
     ino_t ino;                      // inode number
     uint32_t reclen;                // Low 28 bits: Length of record
@@ -205,6 +260,67 @@ static_assert(kMinfsMaxDirectorySize <= kMinfsReclenMask,
 //   record starts. If the MAX_DIR_SIZE is increased, this 'last' record will
 //   also increase in size.
 
+// Hashed directory indexes
+//
+// Directories start out as a linear list of dirents. Once a directory outgrows
+// its first block, it is converted into a hashed index in the style of ext4's
+// htree, and the inode gains kMinfsInodeFlagDirIndex:
+//
+// - Block 0 holds '.' and '..', followed by a free dirent (ino 0) whose record
+//   covers the rest of the block. The body of that free dirent holds a
+//   DirIndexRoot.
+// - Every other block is a leaf: a run of ordinary dirents whose last record
+//   ends exactly at the end of the block. Records never cross blocks and do
+//   not use kMinfsReclenLast, and the directory size is a multiple of the
+//   block size.
+// - The root maps ranges of DirentHash values onto leaves. A name whose hash
+//   is |h| lives in the leaf of the last root entry with a hash <= |h|, so a
+//   lookup reads block 0 and one leaf. When a leaf fills up, the entries
+//   with the upper half of its hashes move to a new leaf at the end of the
+//   directory.
+//
+// Since the root hides inside a free dirent and the leaves are plain dirents,
+// a linear walk of an indexed directory (fsck) sees a valid directory.
+// Readdir instead walks the leaves in hash order, so that its position
+// survives leaf splits.
+
+constexpr uint32_t kMinfsDirIndexMagic   = 0x78646e49; // 'Indx'
+constexpr uint32_t kMinfsDirHashFnv1a    = 1;
+
+struct DirIndexEntry {
+    uint32_t hash;                  // smallest hash which may be stored in 'block'
+    uint32_t block;                 // leaf block, relative to the directory
+};
+
+struct DirIndexRoot {
+    uint32_t magic;                 // kMinfsDirIndexMagic
+    uint32_t hash_version;          // kMinfsDirHash*
+    uint32_t count;                 // entries in use, sorted by hash
+    uint32_t reserved;
+    DirIndexEntry entries[];        // entries[0].hash is always 0
+};
+
+// Offset of the free dirent holding the root, within block 0.
+constexpr uint32_t kMinfsDirIndexDirentOffset = DirentSize(1) + DirentSize(2);
+// Offset of the DirIndexRoot, within block 0.
+constexpr uint32_t kMinfsDirIndexRootOffset = kMinfsDirIndexDirentOffset + MINFS_DIRENT_SIZE;
+constexpr uint32_t kMinfsDirIndexMaxLeaves =
+    (kMinfsBlockSize - kMinfsDirIndexRootOffset - sizeof(DirIndexRoot)) / sizeof(DirIndexEntry);
+constexpr uint32_t kMinfsMaxIndexedDirectorySize = (1 + kMinfsDirIndexMaxLeaves) * kMinfsBlockSize;
+
+static_assert(kMinfsMaxIndexedDirectorySize <= kMinfsReclenMask,
+              "MinFS indexed directory size must be smaller than reclen mask");
+
+// Hashes a name for the directory index (32-bit FNV-1a).
+inline uint32_t DirentHash(const char* name, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= static_cast<uint8_t>(name[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
 // blocksize   8K    16K    32K
 // 16 dir =  128K   256K   512K
 // 32 ind =  512M  1024M  2048M
@@ -23,7 +23,9 @@ zx_status_t CheckSuperblock(const Superblock* info, Bcache* bc);
 
 // Run fsck on an unmounted filesystem backed by |bc|.
 //
-// Invokes CheckSuperblock, but also verifies inode and block usage.
+// Invokes CheckSuperblock, but also verifies inode and block usage. The
+// filesystem is checked as it will be once its journal is replayed, but
+// nothing is written to it.
 zx_status_t Fsck(fbl::unique_ptr<Bcache> bc);
 
 #ifndef __Fuchsia__
@@ -0,0 +1,164 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#ifdef __Fuchsia__
+#include <block-client/cpp/client.h>
+#include <fbl/vector.h>
+#include <lib/fzl/owned-vmo-mapper.h>
+#endif
+
+#include <fbl/macros.h>
+#include <fbl/unique_ptr.h>
+#include <zircon/types.h>
+
+#include <minfs/bcache.h>
+#include <minfs/format.h>
+
+namespace minfs {
+
+// Sets |*out_start| to the JournalInfo block of the filesystem described by
+// |info|, and |*out_count| to the size of the journal including that block.
+void GetJournalRegion(const Bcache& bc, const Superblock& info, blk_t* out_start,
+                      blk_t* out_count);
+
+// Reads the JournalInfo block at |block| into |out|, and checks its magic and
+// checksum.
+zx_status_t LoadJournalInfo(Bcache* bc, blk_t block, JournalInfo* out);
+
+// Writes every entry still in the journal of the filesystem described by
+// |info| to its final location, then checkpoints the journal so that they are
+// not replayed again. Sets |*out_entries| to the number of entries replayed.
+//
+// Since the superblock may be among the replayed blocks, this must run before
+// any metadata is read except for the location of the journal.
+zx_status_t ReplayJournal(Bcache* bc, const Superblock& info, size_t* out_entries);
+
+// Like ReplayJournal, but leaves the device untouched: the blocks of the
+// entries are overlaid on |bc| instead (see Bcache::OverlayBlock), so that
+// reads see the filesystem as it will be once the journal is replayed.
+zx_status_t OverlayJournal(Bcache* bc, const Superblock& info, size_t* out_entries);
+
+#ifdef __Fuchsia__
+
+class WritebackWork;
+
+// Writes out batches of WritebackWork through the metadata journal.
+//
+// The writeback thread adds consecutive works to an entry with |Append| and
+// then writes them out with |Commit|. Their file data and the entry, which
+// holds a copy of all their metadata blocks, are written and flushed first;
+// then the metadata is written in place. Entries are only checkpointed when
+// the journal runs out of space, or when file data is about to overwrite a
+// block held by an entry, so most batches cost two device transactions and a
+// flush no matter how many works they hold. A single work with more metadata
+// than fits in one entry is written as a chain of entries.
+class Journal {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(Journal);
+
+    // Loads the journal of the filesystem described by |info|. The journal
+    // must already have been replayed.
+    static zx_status_t Create(Bcache* bc, const Superblock& info, fbl::unique_ptr<Journal>* out);
+    ~Journal();
+
+    // Adds |work| to the entry being built. Returns false, without adding it,
+    // if |work| must wait for the next entry instead: when the entry is full,
+    // or when |work| writes file data over a block which an earlier work of
+    // the entry writes as metadata. The first work of an entry is always
+    // accepted, however large. Data never overlaps a block freed by an earlier
+    // work of the entry, since freed blocks are not allocated again until
+    // their entry has been committed (see Allocator::Free).
+    //
+    // |work| must stay alive until the next |Commit|.
+    bool Append(WritebackWork* work);
+
+    // Writes out the works passed to |Append| since the last commit. Their
+    // requests must refer to the writeback buffer, which is mapped at
+    // |buffer| and attached to the block device as |buffer_vmoid|.
+    //
+    // The requests of the works are consumed, but their closures are left for
+    // the caller to signal with the returned status.
+    zx_status_t Commit(const void* buffer, vmoid_t buffer_vmoid);
+
+    // Marks every entry written so far as no longer needed for replay.
+    zx_status_t Checkpoint();
+
+private:
+    Journal(Bcache* bc, blk_t start_block, blk_t block_count, fzl::OwnedVmoMapper mapper);
+
+    // Returns the device block holding entry block |index|, which wraps
+    // around the end of the journal.
+    blk_t EntryBlock(size_t index) const {
+        return static_cast<blk_t>(start_block_ + 1 + index % capacity_);
+    }
+
+    // Returns true if file data in the pending works overlaps a block held by
+    // an entry written since the last checkpoint.
+    bool DataOverlapsLive() const;
+
+    // Appends a request to |reqs| writing |length| blocks from |vmo_offset| of
+    // |vmoid| to |dev_offset|. All three are in units of minfs blocks.
+    void AddRequest(vmoid_t vmoid, uint64_t vmo_offset, uint64_t dev_offset, uint64_t length,
+                    fbl::Vector<block_fifo_request_t>* reqs) const;
+
+    // Appends requests to |reqs| writing the pending file data (if |data|) or
+    // metadata (otherwise) to its final location. Only the last write of each
+    // block is kept, since the device may reorder the requests of a single
+    // transaction.
+    void AddInPlaceRequests(bool data, vmoid_t buffer_vmoid,
+                            fbl::Vector<block_fifo_request_t>* reqs) const;
+
+    // Calls |fn(dev_offset, vmo_offset, length)| for each run of the pending
+    // metadata blocks [first, first + count), counted in the order in which
+    // the works enqueued them.
+    template <typename RunFn>
+    void ForEachMetadataRun(size_t first, size_t count, RunFn fn) const;
+
+    // Fills in the header and commit blocks of an entry holding the pending
+    // metadata blocks [first, first + count), and appends requests to |reqs|
+    // writing the whole entry at entry block |index| with |sequence|.
+    // |continued| marks every entry of a chain but the last.
+    void AddEntryRequests(const void* buffer, vmoid_t buffer_vmoid, size_t index,
+                          uint64_t sequence, size_t first, size_t count, bool continued,
+                          fbl::Vector<block_fifo_request_t>* reqs);
+
+    // Writes a JournalInfo naming |start| and |sequence| as the first entry
+    // to replay.
+    zx_status_t WriteInfo(uint64_t start, uint64_t sequence);
+
+    Bcache* bc_;
+    // The JournalInfo block; entries use the |capacity_| blocks after it.
+    const blk_t start_block_;
+    const size_t capacity_;
+    // Upper bound on the metadata of one entry, and on the metadata (and
+    // separately, the file data) that further works may add to a batch.
+    const size_t max_entry_blocks_;
+    // Staging for the header, commit and info blocks.
+    fzl::OwnedVmoMapper mapper_;
+    vmoid_t vmoid_ = VMOID_INVALID;
+
+    // Position and sequence number of the next entry.
+    size_t head_ = 0;
+    uint64_t sequence_ = 0;
+    // Entry blocks written since the last checkpoint.
+    size_t used_ = 0;
+    // Metadata blocks written by entries since the last checkpoint. File data
+    // must not land on these until the next checkpoint, or a replay would
+    // overwrite it with stale metadata.
+    fbl::Vector<blk_t> live_;
+    // Set when the metadata of an entry could not be written in place. That
+    // entry must then stay in the journal, so no further checkpoint is taken.
+    bool failed_ = false;
+
+    // The entry being built.
+    fbl::Vector<WritebackWork*> works_;
+    size_t entry_blocks_ = 0;
+    size_t data_blocks_ = 0;
+};
+
+#endif
+
+} // namespace minfs
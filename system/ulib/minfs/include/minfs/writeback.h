@@ -25,6 +25,7 @@
 #include <minfs/bcache.h>
 #include <minfs/block-txn.h>
 #include <minfs/format.h>
+#include <minfs/journal.h>
 
 #include <utility>
 
@@ -48,12 +49,10 @@ public:
     void Reset();
 
 #ifdef __Fuchsia__
-    // Actually transacts the enqueued work, and resets the WritebackWork to
+    // Signals the closure (if any) with the |status| of writing out the work,
+    // which the journal has already consumed, and resets the WritebackWork to
     // its initial state.
-    //
-    // Returns the number of blocks of the writeback buffer that have been
-    // consumed.
-    size_t Complete(zx_handle_t vmo, vmoid_t vmoid);
+    void Complete(zx_status_t status);
 
     // Adds a closure to the WritebackWork, such that it will be signalled
     // when the WritebackWork is flushed to disk.
@@ -131,6 +130,7 @@ class WritebackBuffer {
 public:
     // Calls constructor, return an error if anything goes wrong.
     static zx_status_t Create(Bcache* bc, fzl::OwnedVmoMapper mapper,
+                              fbl::unique_ptr<Journal> journal,
                               fbl::unique_ptr<WritebackBuffer>* out);
     ~WritebackBuffer();
 
@@ -145,7 +145,7 @@ public:
     void Enqueue(fbl::unique_ptr<WritebackWork> work) __TA_EXCLUDES(writeback_lock_);
 
 private:
-    WritebackBuffer(Bcache* bc, fzl::OwnedVmoMapper mapper);
+    WritebackBuffer(Bcache* bc, fzl::OwnedVmoMapper mapper, fbl::unique_ptr<Journal> journal);
 
     // Blocks until |blocks| blocks of data are free for the caller.
     // Returns |ZX_OK| with the lock still held in this case.
@@ -195,6 +195,8 @@ private:
     bool unmounting_ __TA_GUARDED(writeback_lock_){false};
     fzl::OwnedVmoMapper mapper_;
     vmoid_t buffer_vmoid_ = VMOID_INVALID;
+    // Only used by the writeback thread, and after it exits.
+    fbl::unique_ptr<Journal> journal_;
     // The units of all the following are "MinFS blocks".
     size_t start_ __TA_GUARDED(writeback_lock_){};
     size_t len_ __TA_GUARDED(writeback_lock_){};
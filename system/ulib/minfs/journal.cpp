@@ -0,0 +1,696 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/unique_ptr.h>
+#include <fs/trace.h>
+#include <lib/cksum.h>
+
+#include "minfs-private.h"
+#include <minfs/journal.h>
+
+#include <utility>
+
+namespace minfs {
+
+namespace {
+
+uint32_t JournalInfoChecksum(const JournalInfo& info) {
+    JournalInfo copy = info;
+    copy.checksum = 0;
+    return crc32(0, reinterpret_cast<const uint8_t*>(&copy), sizeof(copy));
+}
+
+// The largest number of metadata blocks in one entry of a journal with
+// |capacity| entry blocks.
+size_t MaxEntryBlocks(size_t capacity) {
+    return (capacity < 2) ? 0 : fbl::min(static_cast<size_t>(kJournalEntryHeaderMaxBlocks),
+                                         capacity - 2);
+}
+
+} // namespace
+
+void GetJournalRegion(const Bcache& bc, const Superblock& info, blk_t* out_start,
+                      blk_t* out_count) {
+#ifndef __Fuchsia__
+    if (bc.extent_lengths_.size() > 0) {
+        BlockOffsets offsets(bc, info);
+        *out_start = offsets.JournalStartBlock();
+        *out_count = offsets.JournalBlockCount();
+        return;
+    }
+#endif
+    *out_start = info.journal_start_block;
+    if (info.flags & kMinfsFlagFVM) {
+        *out_count = static_cast<blk_t>(info.journal_slices * (info.slice_size / kMinfsBlockSize));
+    } else {
+        *out_count = info.dat_block - info.journal_start_block;
+    }
+}
+
+zx_status_t LoadJournalInfo(Bcache* bc, blk_t block, JournalInfo* out) {
+    char data[kMinfsBlockSize];
+    zx_status_t status;
+    if ((status = bc->Readblk(block, data)) != ZX_OK) {
+        FS_TRACE_ERROR("minfs: could not read journal info\n");
+        return status;
+    }
+    memcpy(out, data, sizeof(*out));
+    if (out->magic != kJournalMagic) {
+        FS_TRACE_ERROR("minfs: invalid journal magic\n");
+        return ZX_ERR_BAD_STATE;
+    }
+    // An all-zero info block describes an empty journal.
+    if ((out->start_block != 0 || out->sequence != 0 || out->checksum != 0) &&
+        out->checksum != JournalInfoChecksum(*out)) {
+        FS_TRACE_ERROR("minfs: journal info checksum corrupt\n");
+        return ZX_ERR_BAD_STATE;
+    }
+    return ZX_OK;
+}
+
+namespace {
+
+// Reads the entries of a journal whose JournalInfo block is |journal_start|
+// and which has |capacity| entry blocks.
+class EntryReader {
+public:
+    EntryReader(Bcache* bc, blk_t journal_start, size_t capacity)
+        : bc_(bc), journal_start_(journal_start), capacity_(capacity) {}
+
+    // Reads the entry with |sequence| at entry block |index|. Sets |*valid| to
+    // false if there is no complete entry there.
+    zx_status_t Read(size_t index, uint64_t sequence, bool* valid);
+
+    const HeaderBlock& header() const { return header_; }
+    const uint8_t* block(size_t i) const { return &blocks_[i * kMinfsBlockSize]; }
+
+private:
+    blk_t EntryBlock(size_t index) const {
+        return static_cast<blk_t>(journal_start_ + 1 + index % capacity_);
+    }
+
+    Bcache* bc_;
+    const blk_t journal_start_;
+    const size_t capacity_;
+    HeaderBlock header_;
+    fbl::unique_ptr<uint8_t[]> blocks_;
+    size_t blocks_size_ = 0;
+};
+
+zx_status_t EntryReader::Read(size_t index, uint64_t sequence, bool* valid) {
+    *valid = false;
+    zx_status_t status;
+    if ((status = bc_->Readblk(EntryBlock(index), &header_)) != ZX_OK) {
+        return status;
+    }
+    if (header_.magic != kJournalEntryHeaderMagic || header_.sequence != sequence ||
+        header_.num_blocks == 0 || header_.num_blocks > MaxEntryBlocks(capacity_)) {
+        return ZX_OK;
+    }
+
+    const size_t count = header_.num_blocks;
+    if (blocks_size_ < count) {
+        fbl::AllocChecker ac;
+        blocks_.reset(new (&ac) uint8_t[count * kMinfsBlockSize]);
+        if (!ac.check()) {
+            blocks_size_ = 0;
+            return ZX_ERR_NO_MEMORY;
+        }
+        blocks_size_ = count;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if ((status = bc_->Readblk(EntryBlock(index + 1 + i),
+                                   &blocks_[i * kMinfsBlockSize])) != ZX_OK) {
+            return status;
+        }
+    }
+    char commit_data[kMinfsBlockSize];
+    if ((status = bc_->Readblk(EntryBlock(index + 1 + count), commit_data)) != ZX_OK) {
+        return status;
+    }
+    CommitBlock commit;
+    memcpy(&commit, commit_data, sizeof(commit));
+    uint32_t checksum = crc32(0, reinterpret_cast<const uint8_t*>(&header_), sizeof(header_));
+    checksum = crc32(checksum, blocks_.get(), count * kMinfsBlockSize);
+    *valid = commit.magic == kJournalEntryCommitMagic && commit.sequence == sequence &&
+             commit.checksum == checksum;
+    return ZX_OK;
+}
+
+// Reads the complete entries still in the journal of the filesystem described
+// by |info|, and passes every block they hold to |apply(target, data)|, oldest
+// first. The entries of a chain are only applied once its last entry has been
+// read. Sets |*out_info| to the JournalInfo which drops the applied entries,
+// and |*out_entries| and |*out_blocks| to how many there were.
+template <typename ApplyFn>
+zx_status_t WalkJournal(Bcache* bc, const Superblock& info, ApplyFn apply,
+                        JournalInfo* out_info, size_t* out_entries, size_t* out_blocks) {
+    *out_entries = 0;
+    *out_blocks = 0;
+
+    blk_t journal_start, journal_blocks;
+    GetJournalRegion(*bc, info, &journal_start, &journal_blocks);
+    if (journal_blocks < 1) {
+        FS_TRACE_ERROR("minfs: journal too small\n");
+        return ZX_ERR_BAD_STATE;
+    }
+    const size_t capacity = journal_blocks - 1;
+
+    zx_status_t status;
+    if ((status = LoadJournalInfo(bc, journal_start, out_info)) != ZX_OK) {
+        return status;
+    }
+    if (capacity == 0) {
+        return ZX_OK;
+    }
+    if (out_info->start_block >= capacity) {
+        FS_TRACE_ERROR("minfs: journal start %" PRIu64 " out of range\n",
+                       out_info->start_block);
+        return ZX_ERR_BAD_STATE;
+    }
+
+    // Writes the blocks of the entry last read by |reader| in place.
+    auto apply_entry = [&](const EntryReader& reader) -> zx_status_t {
+        const HeaderBlock& header = reader.header();
+        for (size_t i = 0; i < header.num_blocks; i++) {
+            blk_t target = header.target_blocks[i];
+            if (target >= journal_start && target < journal_start + journal_blocks) {
+                FS_TRACE_ERROR("minfs: journal entry targets the journal (block %u)\n", target);
+                return ZX_ERR_BAD_STATE;
+            }
+            zx_status_t status = apply(target, reader.block(i));
+            if (status != ZX_OK) {
+                return status;
+            }
+        }
+        return ZX_OK;
+    };
+
+    // Read entries until one is missing or incomplete. Since an entry is
+    // written in full before any of its blocks are written in place, an
+    // incomplete entry has not changed anything yet; neither has any entry of
+    // a chain whose last entry is missing.
+    EntryReader reader(bc, journal_start, capacity);
+    size_t chain_index = out_info->start_block;
+    uint64_t chain_sequence = out_info->sequence;
+    size_t chain_entries = 0;
+    size_t chain_length = 0;
+    size_t index = chain_index;
+    uint64_t sequence = chain_sequence;
+    while (true) {
+        bool valid;
+        if ((status = reader.Read(index, sequence, &valid)) != ZX_OK) {
+            return status;
+        }
+        if (!valid) {
+            break;
+        }
+        // A chain longer than the journal would have overwritten its own start.
+        chain_length += reader.header().num_blocks + 2;
+        if (chain_length > capacity) {
+            break;
+        }
+        chain_entries++;
+        index = (index + reader.header().num_blocks + 2) % capacity;
+        sequence++;
+        if (reader.header().flags & kJournalEntryFlagContinued) {
+            continue;
+        }
+
+        // The chain is complete. An entry on its own is still at hand; a
+        // longer chain is read again from its start.
+        if (chain_entries == 1) {
+            if ((status = apply_entry(reader)) != ZX_OK) {
+                return status;
+            }
+            *out_blocks += reader.header().num_blocks;
+        } else {
+            size_t i = chain_index;
+            for (uint64_t s = chain_sequence; s < sequence; s++) {
+                if ((status = reader.Read(i, s, &valid)) != ZX_OK) {
+                    return status;
+                }
+                if (!valid) {
+                    return ZX_ERR_IO;
+                }
+                if ((status = apply_entry(reader)) != ZX_OK) {
+                    return status;
+                }
+                *out_blocks += reader.header().num_blocks;
+                i = (i + reader.header().num_blocks + 2) % capacity;
+            }
+        }
+        *out_entries += chain_entries;
+        chain_index = index;
+        chain_sequence = sequence;
+        chain_entries = 0;
+        chain_length = 0;
+    }
+
+    out_info->start_block = chain_index;
+    out_info->sequence = chain_sequence;
+    return ZX_OK;
+}
+
+} // namespace
+
+zx_status_t ReplayJournal(Bcache* bc, const Superblock& info, size_t* out_entries) {
+    TRACE_DURATION("minfs", "ReplayJournal");
+    *out_entries = 0;
+
+    JournalInfo journal_info;
+    size_t entries, blocks;
+    zx_status_t status = WalkJournal(bc, info, [bc](blk_t target, const void* data) {
+        return bc->Writeblk(target, data);
+    }, &journal_info, &entries, &blocks);
+    if (status != ZX_OK || entries == 0) {
+        return status;
+    }
+
+    // Make sure the replayed blocks are on disk before the entries holding
+    // them are dropped from the journal.
+    bc->Sync();
+    blk_t journal_start, journal_blocks;
+    GetJournalRegion(*bc, info, &journal_start, &journal_blocks);
+    char data[kMinfsBlockSize];
+    memset(data, 0, sizeof(data));
+    journal_info.checksum = JournalInfoChecksum(journal_info);
+    memcpy(data, &journal_info, sizeof(journal_info));
+    if ((status = bc->Writeblk(journal_start, data)) != ZX_OK) {
+        return status;
+    }
+    bc->Sync();
+
+    FS_TRACE_INFO("minfs: replayed %zu journal entries (%zu blocks)\n", entries, blocks);
+    *out_entries = entries;
+    return ZX_OK;
+}
+
+zx_status_t OverlayJournal(Bcache* bc, const Superblock& info, size_t* out_entries) {
+    TRACE_DURATION("minfs", "OverlayJournal");
+    JournalInfo journal_info;
+    size_t blocks;
+    zx_status_t status = WalkJournal(bc, info, [bc](blk_t target, const void* data) {
+        return bc->OverlayBlock(target, data);
+    }, &journal_info, out_entries, &blocks);
+    if (status == ZX_OK && *out_entries > 0) {
+        FS_TRACE_INFO("minfs: %zu journal entries (%zu blocks) not yet replayed\n",
+                      *out_entries, blocks);
+    }
+    return status;
+}
+
+#ifdef __Fuchsia__
+
+namespace {
+
+// Staging blocks within Journal::mapper_.
+constexpr size_t kHeaderIndex = 0;
+constexpr size_t kCommitIndex = 1;
+constexpr size_t kInfoIndex = 2;
+constexpr size_t kStagingBlocks = 3;
+
+// One block of a pending write in place, ordered by target and then by age.
+struct BlockWrite {
+    uint64_t dev_block;
+    uint64_t buffer_block;
+    size_t order;
+};
+
+int CompareBlockWrites(const void* a, const void* b) {
+    const BlockWrite* lhs = static_cast<const BlockWrite*>(a);
+    const BlockWrite* rhs = static_cast<const BlockWrite*>(b);
+    if (lhs->dev_block != rhs->dev_block) {
+        return lhs->dev_block < rhs->dev_block ? -1 : 1;
+    }
+    return lhs->order < rhs->order ? -1 : (lhs->order > rhs->order ? 1 : 0);
+}
+
+bool Overlaps(const WriteRequest& request, blk_t block) {
+    return request.dev_offset <= block && block < request.dev_offset + request.length;
+}
+
+} // namespace
+
+zx_status_t Journal::Create(Bcache* bc, const Superblock& info, fbl::unique_ptr<Journal>* out) {
+    blk_t start_block, block_count;
+    GetJournalRegion(*bc, info, &start_block, &block_count);
+    if (MaxEntryBlocks(block_count - 1) == 0) {
+        FS_TRACE_ERROR("minfs: journal too small\n");
+        return ZX_ERR_BAD_STATE;
+    }
+
+    JournalInfo journal_info;
+    zx_status_t status;
+    if ((status = LoadJournalInfo(bc, start_block, &journal_info)) != ZX_OK) {
+        return status;
+    }
+    if (journal_info.start_block >= block_count - 1) {
+        return ZX_ERR_BAD_STATE;
+    }
+
+    fzl::OwnedVmoMapper mapper;
+    if ((status = mapper.CreateAndMap(kStagingBlocks * kMinfsBlockSize,
+                                      "minfs-journal")) != ZX_OK) {
+        return status;
+    }
+
+    fbl::unique_ptr<Journal> journal(new Journal(bc, start_block, block_count, std::move(mapper)));
+    if ((status = bc->AttachVmo(journal->mapper_.vmo(), &journal->vmoid_)) != ZX_OK) {
+        return status;
+    }
+    journal->head_ = journal_info.start_block;
+    journal->sequence_ = journal_info.sequence;
+    *out = std::move(journal);
+    return ZX_OK;
+}
+
+Journal::Journal(Bcache* bc, blk_t start_block, blk_t block_count, fzl::OwnedVmoMapper mapper)
+    : bc_(bc), start_block_(start_block), capacity_(block_count - 1),
+      max_entry_blocks_(MaxEntryBlocks(block_count - 1)), mapper_(std::move(mapper)) {}
+
+Journal::~Journal() {
+    ZX_DEBUG_ASSERT(works_.is_empty());
+    if (vmoid_ != VMOID_INVALID) {
+        block_fifo_request_t request;
+        request.group = bc_->BlockGroupID();
+        request.vmoid = vmoid_;
+        request.opcode = BLOCKIO_CLOSE_VMO;
+        bc_->Transaction(&request, 1);
+    }
+}
+
+bool Journal::Append(WritebackWork* work) {
+    size_t metadata = 0;
+    size_t data = 0;
+    auto& reqs = work->Requests();
+    for (size_t i = 0; i < reqs.size(); i++) {
+        if (reqs[i].data) {
+            data += reqs[i].length;
+        } else {
+            metadata += reqs[i].length;
+        }
+    }
+
+    if (!works_.is_empty()) {
+        if (entry_blocks_ + metadata > max_entry_blocks_ ||
+            data_blocks_ + data > max_entry_blocks_) {
+            return false;
+        }
+        // Replaying the entry would revert file data written over a block
+        // which the entry holds as metadata.
+        for (size_t i = 0; i < reqs.size(); i++) {
+            if (!reqs[i].data) {
+                continue;
+            }
+            for (WritebackWork* other : works_) {
+                auto& other_reqs = other->Requests();
+                for (size_t j = 0; j < other_reqs.size(); j++) {
+                    if (!other_reqs[j].data &&
+                        other_reqs[j].dev_offset < reqs[i].dev_offset + reqs[i].length &&
+                        reqs[i].dev_offset < other_reqs[j].dev_offset + other_reqs[j].length) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+
+    works_.push_back(work);
+    entry_blocks_ += metadata;
+    data_blocks_ += data;
+    return true;
+}
+
+bool Journal::DataOverlapsLive() const {
+    for (WritebackWork* work : works_) {
+        auto& reqs = work->Requests();
+        for (size_t i = 0; i < reqs.size(); i++) {
+            if (!reqs[i].data) {
+                continue;
+            }
+            for (blk_t block : live_) {
+                if (Overlaps(reqs[i], block)) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+void Journal::AddRequest(vmoid_t vmoid, uint64_t vmo_offset, uint64_t dev_offset, uint64_t length,
+                         fbl::Vector<block_fifo_request_t>* reqs) const {
+    const uint32_t kDiskBlocksPerMinfsBlock = kMinfsBlockSize / bc_->DeviceBlockSize();
+    block_fifo_request_t request;
+    request.group = bc_->BlockGroupID();
+    request.vmoid = vmoid;
+    request.opcode = BLOCKIO_WRITE;
+    request.vmo_offset = vmo_offset * kDiskBlocksPerMinfsBlock;
+    request.dev_offset = dev_offset * kDiskBlocksPerMinfsBlock;
+    uint64_t disk_length = length * kDiskBlocksPerMinfsBlock;
+    ZX_ASSERT_MSG(disk_length < UINT32_MAX, "Too many blocks");
+    request.length = static_cast<uint32_t>(disk_length);
+    reqs->push_back(request);
+}
+
+void Journal::AddInPlaceRequests(bool data, vmoid_t buffer_vmoid,
+                                 fbl::Vector<block_fifo_request_t>* reqs) const {
+    fbl::Vector<BlockWrite> writes;
+    for (WritebackWork* work : works_) {
+        auto& work_reqs = work->Requests();
+        for (size_t i = 0; i < work_reqs.size(); i++) {
+            if (work_reqs[i].data != data) {
+                continue;
+            }
+            for (size_t j = 0; j < work_reqs[i].length; j++) {
+                BlockWrite write;
+                write.dev_block = work_reqs[i].dev_offset + j;
+                write.buffer_block = work_reqs[i].vmo_offset + j;
+                write.order = writes.size();
+                writes.push_back(write);
+            }
+        }
+    }
+    if (writes.is_empty()) {
+        return;
+    }
+    qsort(writes.get(), writes.size(), sizeof(BlockWrite), CompareBlockWrites);
+
+    // Keep the newest write of each block, merging runs which are contiguous
+    // both on disk and in the buffer.
+    uint64_t run_dev = 0;
+    uint64_t run_buffer = 0;
+    uint64_t run_length = 0;
+    for (size_t i = 0; i < writes.size(); i++) {
+        if (i + 1 < writes.size() && writes[i + 1].dev_block == writes[i].dev_block) {
+            continue;
+        }
+        if (run_length > 0 && run_dev + run_length == writes[i].dev_block &&
+            run_buffer + run_length == writes[i].buffer_block) {
+            run_length++;
+            continue;
+        }
+        if (run_length > 0) {
+            AddRequest(buffer_vmoid, run_buffer, run_dev, run_length, reqs);
+        }
+        run_dev = writes[i].dev_block;
+        run_buffer = writes[i].buffer_block;
+        run_length = 1;
+    }
+    AddRequest(buffer_vmoid, run_buffer, run_dev, run_length, reqs);
+}
+
+template <typename RunFn>
+void Journal::ForEachMetadataRun(size_t first, size_t count, RunFn fn) const {
+    size_t pos = 0;
+    for (WritebackWork* work : works_) {
+        auto& work_reqs = work->Requests();
+        for (size_t i = 0; i < work_reqs.size() && pos < first + count; i++) {
+            if (work_reqs[i].data) {
+                continue;
+            }
+            const uint64_t length = work_reqs[i].length;
+            if (pos + length > first) {
+                const uint64_t skip = first > pos ? first - pos : 0;
+                const uint64_t run = fbl::min<uint64_t>(length - skip, first + count - pos - skip);
+                fn(work_reqs[i].dev_offset + skip, work_reqs[i].vmo_offset + skip, run);
+            }
+            pos += length;
+        }
+    }
+}
+
+void Journal::AddEntryRequests(const void* buffer, vmoid_t buffer_vmoid, size_t index,
+                               uint64_t sequence, size_t first, size_t count, bool continued,
+                               fbl::Vector<block_fifo_request_t>* reqs) {
+    auto header = reinterpret_cast<HeaderBlock*>(
+        static_cast<uint8_t*>(mapper_.start()) + kHeaderIndex * kMinfsBlockSize);
+    auto commit = reinterpret_cast<CommitBlock*>(
+        static_cast<uint8_t*>(mapper_.start()) + kCommitIndex * kMinfsBlockSize);
+    memset(header, 0, kMinfsBlockSize);
+    memset(commit, 0, kMinfsBlockSize);
+
+    header->magic = kJournalEntryHeaderMagic;
+    header->sequence = sequence;
+    header->num_blocks = count;
+    header->flags = continued ? kJournalEntryFlagContinued : 0;
+    size_t targets = 0;
+    ForEachMetadataRun(first, count, [&](uint64_t dev_offset, uint64_t, uint64_t length) {
+        for (uint64_t j = 0; j < length; j++) {
+            header->target_blocks[targets++] = static_cast<blk_t>(dev_offset + j);
+        }
+    });
+    ZX_DEBUG_ASSERT(targets == count);
+
+    uint32_t checksum = crc32(0, reinterpret_cast<const uint8_t*>(header), kMinfsBlockSize);
+    AddRequest(vmoid_, kHeaderIndex, EntryBlock(index), 1, reqs);
+    index++;
+    ForEachMetadataRun(first, count, [&](uint64_t, uint64_t vmo_offset, uint64_t length) {
+        const uint8_t* data = static_cast<const uint8_t*>(buffer) + vmo_offset * kMinfsBlockSize;
+        checksum = crc32(checksum, data, length * kMinfsBlockSize);
+
+        // Split the copy where the journal wraps around.
+        uint64_t done = 0;
+        while (done < length) {
+            uint64_t run = fbl::min(length - done, capacity_ - (index + done) % capacity_);
+            AddRequest(buffer_vmoid, vmo_offset + done, EntryBlock(index + done), run, reqs);
+            done += run;
+        }
+        index += length;
+    });
+
+    commit->magic = kJournalEntryCommitMagic;
+    commit->sequence = sequence;
+    commit->checksum = checksum;
+    AddRequest(vmoid_, kCommitIndex, EntryBlock(index), 1, reqs);
+}
+
+zx_status_t Journal::Commit(const void* buffer, vmoid_t buffer_vmoid) {
+    TRACE_DURATION("minfs", "Journal::Commit", "metadata", entry_blocks_, "data", data_blocks_);
+    // Metadata which does not fit in one entry is split into a chain of them.
+    const size_t entries = (entry_blocks_ + max_entry_blocks_ - 1) / max_entry_blocks_;
+    const size_t chain_length = entry_blocks_ + 2 * entries;
+    const bool journaled = entry_blocks_ > 0 && chain_length <= capacity_;
+
+    zx_status_t status = ZX_OK;
+    if (DataOverlapsLive()) {
+        status = Checkpoint();
+    } else if (journaled && used_ + chain_length > capacity_) {
+        // The entries would overwrite entries which are still needed.
+        status = Checkpoint();
+    } else if (entry_blocks_ > 0 && !journaled) {
+        // A work too large for the whole journal is written in place, so no
+        // older entry may be replayed over it.
+        FS_TRACE_WARN("minfs: %zu metadata blocks do not fit in the journal\n", entry_blocks_);
+        status = Checkpoint();
+    }
+
+    // File data goes out along with the first entry, and the metadata only
+    // once every entry is on disk. The entries of a chain share the staging
+    // blocks for their header and commit, so each is a transaction of its own.
+    size_t index = head_;
+    fbl::Vector<block_fifo_request_t> reqs;
+    if (status == ZX_OK) {
+        AddInPlaceRequests(true, buffer_vmoid, &reqs);
+        size_t done = 0;
+        for (size_t i = 0; journaled && i < entries && status == ZX_OK; i++) {
+            const size_t count = fbl::min(max_entry_blocks_, entry_blocks_ - done);
+            AddEntryRequests(buffer, buffer_vmoid, index, sequence_ + i, done, count,
+                             i + 1 < entries, &reqs);
+            status = bc_->Transaction(reqs.get(), reqs.size());
+            reqs.reset();
+            index = (index + count + 2) % capacity_;
+            done += count;
+        }
+        if (status == ZX_OK && !reqs.is_empty()) {
+            status = bc_->Transaction(reqs.get(), reqs.size());
+        }
+        if (status == ZX_OK && journaled) {
+            status = bc_->Sync();
+        }
+    }
+
+    if (status == ZX_OK && entry_blocks_ > 0) {
+        if (journaled) {
+            for (WritebackWork* work : works_) {
+                auto& work_reqs = work->Requests();
+                for (size_t i = 0; i < work_reqs.size(); i++) {
+                    for (size_t j = 0; !work_reqs[i].data && j < work_reqs[i].length; j++) {
+                        live_.push_back(static_cast<blk_t>(work_reqs[i].dev_offset + j));
+                    }
+                }
+            }
+            head_ = index;
+            used_ += chain_length;
+            sequence_ += entries;
+        }
+
+        reqs.reset();
+        AddInPlaceRequests(false, buffer_vmoid, &reqs);
+        status = bc_->Transaction(reqs.get(), reqs.size());
+        if (status != ZX_OK && journaled) {
+            failed_ = true;
+        }
+    }
+
+    for (WritebackWork* work : works_) {
+        work->Requests().reset();
+    }
+    works_.reset();
+    entry_blocks_ = 0;
+    data_blocks_ = 0;
+    return status;
+}
+
+zx_status_t Journal::Checkpoint() {
+    if (failed_) {
+        return ZX_ERR_IO;
+    }
+    if (used_ == 0) {
+        return ZX_OK;
+    }
+    // The metadata of every entry must be on disk before the entries are
+    // dropped.
+    zx_status_t status = bc_->Sync();
+    if (status != ZX_OK) {
+        return status;
+    }
+    // Nothing may overwrite the old entries until the new info block is on
+    // disk, either.
+    if ((status = WriteInfo(head_, sequence_)) != ZX_OK ||
+        (status = bc_->Sync()) != ZX_OK) {
+        return status;
+    }
+    used_ = 0;
+    live_.reset();
+    return ZX_OK;
+}
+
+zx_status_t Journal::WriteInfo(uint64_t start, uint64_t sequence) {
+    TRACE_DURATION("minfs", "Journal::WriteInfo");
+    uint8_t* data = static_cast<uint8_t*>(mapper_.start()) + kInfoIndex * kMinfsBlockSize;
+    memset(data, 0, kMinfsBlockSize);
+    JournalInfo info;
+    memset(&info, 0, sizeof(info));
+    info.magic = kJournalMagic;
+    info.start_block = start;
+    info.sequence = sequence;
+    info.checksum = JournalInfoChecksum(info);
+    memcpy(data, &info, sizeof(info));
+
+    fbl::Vector<block_fifo_request_t> reqs;
+    AddRequest(vmoid_, kInfoIndex, start_block_, 1, &reqs);
+    return bc_->Transaction(reqs.get(), reqs.size());
+}
+
+#endif // __Fuchsia__
+
+} // namespace minfs
@@ -85,6 +85,9 @@ constexpr uint32_t kMinfsBlockCacheSize = 64;
 class MinfsChecker;
 class VnodeMinfs;
 
+// Readdir position, stored in an fs::vdircookie_t.
+struct DirCookie;
+
 using SyncCallback = fs::Vnode::SyncCallback;
 
 #ifndef __Fuchsia__
@@ -92,7 +95,7 @@ using SyncCallback = fs::Vnode::SyncCallback;
 // sparse files.
 class BlockOffsets {
 public:
-    BlockOffsets(const Bcache& bc, const SuperblockManager& sb);
+    BlockOffsets(const Bcache& bc, const Superblock& info);
 
     blk_t IbmStartBlock() const { return ibm_start_block_; }
     blk_t IbmBlockCount() const { return ibm_block_count_; }
@@ -175,6 +178,10 @@ public:
     // Free resources of all vnodes marked unlinked.
     zx_status_t PurgeUnlinked();
 
+    // Raises the on-disk format version to |kMinfsVersion|, before the first
+    // directory index is written to a filesystem formatted without them.
+    void UpgradeVersion(WriteTxn* txn);
+
     // Writes back an inode into the inode table on persistent storage.
     // Does not modify inode bitmap.
     void InodeUpdate(WriteTxn* txn, ino_t ino, const Inode* inode) {
@@ -207,6 +214,10 @@ public:
     // (1) A sync probe has entered and exited the writeback queue, and
     // (2) The block cache has sync'd with the underlying block device.
     void Sync(SyncCallback closure);
+
+    // Blocks until every transaction committed so far has been written out,
+    // which makes the elements they freed available for allocation.
+    void WaitForWriteback();
 #endif
 
     // The following methods are used to read one block from the specified extent,
@@ -245,6 +256,12 @@ public:
     zx_status_t GetMetrics(fuchsia_minfs_Metrics* out) const {
         if (collecting_metrics_) {
             memcpy(out, &metrics_, sizeof(metrics_));
+            Bcache::CacheStats stats;
+            bc_->GetCacheStats(&stats);
+            out->block_cache_hits = stats.hits;
+            out->block_cache_misses = stats.misses;
+            out->block_cache_readahead_blocks = stats.readahead_blocks;
+            out->block_cache_evictions = stats.evictions;
             return ZX_OK;
         }
         return ZX_ERR_UNAVAILABLE;
@@ -359,6 +376,7 @@ public:
     static zx_status_t Recreate(Minfs* fs, ino_t ino, fbl::RefPtr<VnodeMinfs>* out);
 
     bool IsDirectory() const { return inode_.magic == kMinfsMagicDir; }
+    bool IsIndexed() const { return (inode_.flags & kMinfsInodeFlagDirIndex) != 0; }
     bool IsUnlinked() const { return inode_.link_count == 0; }
     zx_status_t CanUnlink() const;
 
@@ -439,8 +457,15 @@ private:
 
     using DirentCallback = zx_status_t (*)(fbl::RefPtr<VnodeMinfs>, Dirent*, DirArgs*);
 
-    // Enumerates directories.
+    // Enumerates directories. In an indexed directory, only the block which may
+    // hold |args->name| is enumerated.
     zx_status_t ForEachDirent(DirArgs* args, const DirentCallback func);
+    zx_status_t ForEachIndexedDirent(DirArgs* args, const DirentCallback func);
+
+    // The end of the region of the directory a dirent may occupy.
+    size_t DirentLimit() const {
+        return IsIndexed() ? inode_.size : kMinfsMaxDirectorySize;
+    }
 
     // Directory callback functions.
     //
@@ -457,10 +482,41 @@ private:
                                                  DirArgs*);
     static zx_status_t DirentCallbackFindSpace(fbl::RefPtr<VnodeMinfs>, Dirent*, DirArgs*);
 
+    // Finds space for a new direntry of |args->reclen| bytes named |args->name|, setting
+    // |args->offs|, and returns the number of blocks AppendDirent may need to allocate.
+    zx_status_t FindDirentSpace(DirArgs* args, blk_t* out_reserve_blocks);
+    zx_status_t FindIndexedDirentSpace(DirArgs* args, blk_t* out_reserve_blocks);
+
     // Appends a new directory at the specified offset within |args|. This requires a prior call to
-    // DirentCallbackFindSpace to find an offset where there is space for the direntry. It takes
-    // the same |args| that were passed into DirentCallbackFindSpace.
+    // FindDirentSpace to find an offset where there is space for the direntry. It takes
+    // the same |args| that were passed into FindDirentSpace.
+    //
+    // A linear directory which would grow past its first block is converted to an index first,
+    // and a full leaf of an indexed directory is split.
     zx_status_t AppendDirent(DirArgs* args);
+    zx_status_t AppendIndexedDirent(DirArgs* args);
+    // Writes the new direntry into the record at |args->offs|.
+    zx_status_t InsertDirent(DirArgs* args);
+
+    // Returns the end of the new direntry AppendDirent would write into a linear directory.
+    zx_status_t LinearDirentEnd(const DirArgs& args, size_t* out_end);
+    // Whether a linear directory must become indexed to hold a direntry ending at |dirent_end|.
+    bool NeedsIndex(size_t dirent_end) const;
+
+    // Continues Readdir of an indexed directory from |dc|, in hash order.
+    zx_status_t ReaddirIndexed(DirCookie* dc, fs::DirentFiller* df);
+    // Reads block 0 of an indexed directory into |block|, returning the index root within it.
+    zx_status_t ReadIndexRoot(char* block, DirIndexRoot** out_root);
+    // Lays out the dirents of a linear directory which fits in one block in |leaf|, as the
+    // first leaf of a new index, and returns the inode of '..'. |block| is scratch space.
+    zx_status_t BuildFirstLeaf(char* block, char* leaf, ino_t* out_parent);
+    // Converts a linear directory which fits in one block to an index with one leaf.
+    zx_status_t CreateIndex(Transaction* state);
+    // Splits |leaf|, the leaf of root entry |index| in the index root block |block|, to make
+    // room for a dirent of |reclen| bytes hashing to |hash|. On return |leaf| holds the half
+    // that dirent belongs in, which is block |*out_blk| of the directory.
+    zx_status_t SplitLeaf(Transaction* state, char* block, uint32_t index, char* leaf,
+                          uint32_t hash, uint32_t reclen, blk_t* out_blk);
 
     zx_status_t UnlinkChild(Transaction* state, fbl::RefPtr<VnodeMinfs> child,
                             Dirent* de, DirectoryOffset* offs);
@@ -96,7 +96,7 @@ zx_status_t CheckSuperblock(const Superblock* info, Bcache* bc) {
         FS_TRACE_ERROR("minfs: bad magic\n");
         return ZX_ERR_INVALID_ARGS;
     }
-    if (info->version != kMinfsVersion) {
+    if ((info->version != kMinfsVersion) && (info->version != kMinfsVersionNoDirIndex)) {
         FS_TRACE_ERROR("minfs: FS Version: %08x. Driver version: %08x\n", info->version,
                        kMinfsVersion);
         return ZX_ERR_INVALID_ARGS;
@@ -245,7 +245,7 @@ zx_status_t CheckSuperblock(const Superblock* info, Bcache* bc) {
 }
 
 #ifndef __Fuchsia__
-BlockOffsets::BlockOffsets(const Bcache& bc, const SuperblockManager& sb) {
+BlockOffsets::BlockOffsets(const Bcache& bc, const Superblock& info) {
     if (bc.extent_lengths_.size() > 0) {
         ZX_ASSERT(bc.extent_lengths_.size() == kExtentCount);
         ibm_block_count_ = bc.extent_lengths_[1] / kMinfsBlockSize;
@@ -260,17 +260,17 @@ BlockOffsets::BlockOffsets(const Bcache& bc, const SuperblockManager& sb) {
         journal_start_block_ = ino_start_block_ + ino_block_count_;
         dat_start_block_ = journal_start_block_ + journal_block_count_;
     } else {
-        ibm_start_block_ = sb.Info().ibm_block;
-        abm_start_block_ = sb.Info().abm_block;
-        ino_start_block_ = sb.Info().ino_block;
-        journal_start_block_ = sb.Info().journal_start_block;
-        dat_start_block_ = sb.Info().dat_block;
+        ibm_start_block_ = info.ibm_block;
+        abm_start_block_ = info.abm_block;
+        ino_start_block_ = info.ino_block;
+        journal_start_block_ = info.journal_start_block;
+        dat_start_block_ = info.dat_block;
 
         ibm_block_count_ = abm_start_block_ - ibm_start_block_;
         abm_block_count_ = ino_start_block_ - abm_start_block_;
         ino_block_count_ = dat_start_block_ - ino_start_block_;
         journal_block_count_ = dat_start_block_ - journal_start_block_;
-        dat_block_count_ = sb.Info().block_count;
+        dat_block_count_ = info.block_count;
     }
 }
 #endif
@@ -290,12 +290,28 @@ zx_status_t Minfs::BeginTransaction(size_t reserve_inodes, size_t reserve_blocks
     zx_status_t status;
     if (reserve_inodes &&
         (status = inodes_->Reserve(work.get(), reserve_inodes, &inode_promise)) != ZX_OK) {
-        return status;
+#ifdef __Fuchsia__
+        if (status == ZX_ERR_SHOULD_WAIT) {
+            WaitForWriteback();
+            status = inodes_->Reserve(work.get(), reserve_inodes, &inode_promise);
+        }
+#endif
+        if (status != ZX_OK) {
+            return (status == ZX_ERR_SHOULD_WAIT) ? ZX_ERR_NO_SPACE : status;
+        }
     }
 
     if (reserve_blocks &&
         (status = block_allocator_->Reserve(work.get(), reserve_blocks, &block_promise)) != ZX_OK) {
-        return status;
+#ifdef __Fuchsia__
+        if (status == ZX_ERR_SHOULD_WAIT) {
+            WaitForWriteback();
+            status = block_allocator_->Reserve(work.get(), reserve_blocks, &block_promise);
+        }
+#endif
+        if (status != ZX_OK) {
+            return (status == ZX_ERR_SHOULD_WAIT) ? ZX_ERR_NO_SPACE : status;
+        }
     }
 
     (*out).reset(
@@ -320,6 +336,16 @@ void Minfs::Sync(SyncCallback closure) {
     state->GetWork()->SetClosure(std::move(closure));
     CommitTransaction(std::move(state));
 }
+
+void Minfs::WaitForWriteback() {
+    TRACE_DURATION("minfs", "Minfs::WaitForWriteback");
+    sync_completion_t completion;
+    sync_completion_reset(&completion);
+    Sync([&completion](zx_status_t status) {
+        sync_completion_signal(&completion);
+    });
+    sync_completion_wait(&completion, ZX_TIME_INFINITE);
+}
 #endif
 
 #ifdef __Fuchsia__
@@ -567,6 +593,13 @@ zx_status_t Minfs::PurgeUnlinked() {
     return ZX_OK;
 }
 
+void Minfs::UpgradeVersion(WriteTxn* txn) {
+    if (Info().version != kMinfsVersion) {
+        sb_->MutableInfo()->version = kMinfsVersion;
+        sb_->Write(txn);
+    }
+}
+
 #ifdef __Fuchsia__
 zx_status_t Minfs::CreateFsId(uint64_t* out) {
     zx::event event;
@@ -747,7 +780,7 @@ zx_status_t Minfs::Create(fbl::unique_ptr<Bcache> bc, const Superblock* info,
     const blk_t ibm_start_block = sb->Info().ibm_block;
     const blk_t ino_start_block = sb->Info().ino_block;
 #else
-    BlockOffsets offsets(*bc, *sb);
+    BlockOffsets offsets(*bc, sb->Info());
     const blk_t abm_start_block = offsets.AbmStartBlock();
     const blk_t ibm_start_block = offsets.IbmStartBlock();
     const blk_t ino_start_block = offsets.InoStartBlock();
@@ -805,8 +838,15 @@ zx_status_t Minfs::Create(fbl::unique_ptr<Bcache> bc, const Superblock* info,
         return status;
     }
 
+    fbl::unique_ptr<Journal> journal;
+    if ((status = Journal::Create(bc.get(), sb->Info(), &journal)) != ZX_OK) {
+        FS_TRACE_ERROR("Minfs::Create failed to load journal: %d\n", status);
+        return status;
+    }
+
     fbl::unique_ptr<WritebackBuffer> writeback;
-    status = WritebackBuffer::Create(bc.get(), std::move(mapper), &writeback);
+    status = WritebackBuffer::Create(bc.get(), std::move(mapper), std::move(journal),
+                                     &writeback);
     if (status != ZX_OK) {
         return status;
     }
@@ -845,6 +885,23 @@ zx_status_t Mount(fbl::unique_ptr<minfs::Bcache> bc, fbl::RefPtr<VnodeMinfs>* ro
     }
     const Superblock* info = reinterpret_cast<Superblock*>(blk);
 
+    // Finish any metadata updates left in the journal, then reread the
+    // superblock in case it was one of them.
+    size_t replayed;
+    if ((status = ReplayJournal(bc.get(), *info, &replayed)) != ZX_OK) {
+        FS_TRACE_ERROR("minfs: could not replay journal\n");
+        return status;
+    }
+    if (replayed > 0 && (status = bc->Readblk(0, &blk)) != ZX_OK) {
+        FS_TRACE_ERROR("minfs: could not read info block\n");
+        return status;
+    }
+
+#ifdef __Fuchsia__
+    // Most of the block cache only helped the replay, so give it back.
+    bc->SetCacheLimit(kBcacheMountedBlocks);
+#endif
+
     fbl::unique_ptr<Minfs> fs;
     if ((status = Minfs::Create(std::move(bc), info, &fs)) != ZX_OK) {
         FS_TRACE_ERROR("minfs: mount failed\n");
@@ -1145,6 +1202,10 @@ zx_status_t Mkfs(const MountOptions& options, fbl::unique_ptr<Bcache> bc) {
     journal_info->magic = kJournalMagic;
     bc->Writeblk(info.journal_start_block, blk);
 
+    // Make sure no stale entry from an earlier filesystem is replayed.
+    memset(blk, 0, sizeof(blk));
+    bc->Writeblk(info.journal_start_block + 1, blk);
+
     fvm_cleanup.cancel();
     return ZX_OK;
 }
@@ -74,10 +74,11 @@ void TransactionLimits::CalculateDataBlocks() {
     constexpr blk_t kOffset =
         (kMinfsDirect + (kMinfsIndirect * kMinfsDirectPerIndirect)) * kMinfsBlockSize - 1;
 
-    // This calculation ignores the fact that directory size is capped at |kMinfsMaxDirectorySize|,
-    // because following that constraint makes it a little harder to predict where the most
-    // significant cross-block write would be. This means we may overestimate the maximum number of
-    // directory blocks by some amount, but this is better than an understimate.
+    // This calculation ignores the fact that directory size is capped at
+    // |kMinfsMaxIndexedDirectorySize|, because following that constraint makes it a little harder
+    // to predict where the most significant cross-block write would be. This means we may
+    // overestimate the maximum number of directory blocks by some amount, but this is better than
+    // an understimate.
     blk_t max_directory_blocks;
     ZX_ASSERT(GetRequiredBlockCount(kOffset, kMinfsMaxDirentSize, &max_directory_blocks) == ZX_OK);
     ZX_ASSERT(GetRequiredBlockCount(kOffset, kMaxWriteBytes, &max_data_blocks_) == ZX_OK);
@@ -105,7 +106,8 @@ void TransactionLimits::CalculateJournalBlocks(blk_t block_bitmap_blocks) {
     // vnode's maximum possible number of data blocks + indirect blocks, or a data vnode's maximum
     // possible number of indirect blocks.
     blk_t maximum_directory_blocks;
-    ZX_ASSERT(GetRequiredBlockCount(0, kMinfsMaxDirectorySize, &maximum_directory_blocks) == ZX_OK);
+    ZX_ASSERT(GetRequiredBlockCount(0, kMinfsMaxIndexedDirectorySize,
+                                    &maximum_directory_blocks) == ZX_OK);
     blk_t maximum_indirect_blocks = kMinfsIndirect + kMinfsDoublyIndirect * kMinfsDirectPerIndirect;
     blk_t revocation_blocks = fbl::round_up(fbl::max(maximum_directory_blocks,
                                                      maximum_indirect_blocks),
@@ -45,13 +45,15 @@ zx_time_t GetTimeUTC() {
     return time;
 }
 
-zx_status_t ValidateDirent(Dirent* de, size_t bytes_read, size_t off) {
+// Validates the dirent at |off|, of which |bytes_read| bytes were read, in a directory whose
+// records end by |limit|.
+zx_status_t ValidateDirent(Dirent* de, size_t bytes_read, size_t off, size_t limit) {
     uint32_t reclen = static_cast<uint32_t>(MinfsReclen(de, off));
     if ((bytes_read < MINFS_DIRENT_SIZE) || (reclen < MINFS_DIRENT_SIZE)) {
         FS_TRACE_ERROR("vn_dir: Could not read dirent at offset: %zd\n", off);
         return ZX_ERR_IO;
-    } else if ((off + reclen > kMinfsMaxDirectorySize) || (reclen & 3)) {
-        FS_TRACE_ERROR("vn_dir: bad reclen %u > %u\n", reclen, kMinfsMaxDirectorySize);
+    } else if ((off + reclen > limit) || (reclen & 3)) {
+        FS_TRACE_ERROR("vn_dir: bad reclen %u > %zu\n", reclen, limit);
         return ZX_ERR_IO;
     } else if (de->ino != 0) {
         if ((de->namelen == 0) ||
@@ -70,6 +72,183 @@ zx_status_t NextDirent(Dirent* de, DirectoryOffset* offs) {
     return kDirIteratorNext;
 }
 
+// Validates the dirent at |off| within |leaf|, one block of an indexed directory, and returns
+// its record length. Unlike the records of linear directories, these never cross a block.
+zx_status_t ValidateLeafDirent(const char* leaf, size_t off, uint32_t* out_reclen) {
+    const Dirent* de = reinterpret_cast<const Dirent*>(leaf + off);
+    uint32_t reclen = de->reclen & kMinfsReclenMask;
+    if ((off + MINFS_DIRENT_SIZE > kMinfsBlockSize) || (de->reclen & kMinfsReclenLast) ||
+        (reclen < MINFS_DIRENT_SIZE) || (reclen & 3) || (off + reclen > kMinfsBlockSize)) {
+        FS_TRACE_ERROR("vn_dir: bad indexed dirent reclen %#x at offset %zu\n", de->reclen, off);
+        return ZX_ERR_IO;
+    } else if ((de->ino != 0) && ((de->namelen == 0) || (DirentSize(de->namelen) > reclen))) {
+        FS_TRACE_ERROR("vn_dir: bad namelen %u / %u\n", de->namelen, reclen);
+        return ZX_ERR_IO;
+    }
+    *out_reclen = reclen;
+    return ZX_OK;
+}
+
+DirIndexRoot* GetIndexRoot(char* block) {
+    return reinterpret_cast<DirIndexRoot*>(block + kMinfsDirIndexRootOffset);
+}
+
+// Finds the entry of |root| for the leaf which holds the names hashing to |hash|: the last one
+// whose hash is no larger.
+zx_status_t FindIndexEntry(const DirIndexRoot* root, uint32_t hash, size_t dir_size,
+                           uint32_t* out_index) {
+    uint32_t lo = 0;
+    uint32_t hi = root->count;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (root->entries[mid].hash <= hash) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    blk_t block = root->entries[lo].block;
+    if ((block == 0) || (block >= dir_size / kMinfsBlockSize)) {
+        FS_TRACE_ERROR("vn_dir: index entry %u has bad block %u\n", lo, block);
+        return ZX_ERR_IO;
+    }
+    *out_index = lo;
+    return ZX_OK;
+}
+
+// Finds a record of |leaf| with room for a dirent of |reclen| bytes, the way AppendDirent
+// would use it, and returns its offset within the leaf.
+zx_status_t FindLeafSpace(const char* leaf, uint32_t reclen, size_t* out_off) {
+    uint32_t rlen;
+    for (size_t off = 0; off < kMinfsBlockSize; off += rlen) {
+        zx_status_t status = ValidateLeafDirent(leaf, off, &rlen);
+        if (status != ZX_OK) {
+            return status;
+        }
+        const Dirent* de = reinterpret_cast<const Dirent*>(leaf + off);
+        uint32_t used = (de->ino == 0) ? 0 : DirentSize(de->namelen);
+        if (rlen - used >= reclen) {
+            *out_off = off;
+            return ZX_OK;
+        }
+    }
+    return ZX_ERR_NO_SPACE;
+}
+
+struct HashedDirent {
+    uint32_t hash;
+    uint32_t size;
+};
+
+int CompareHashedDirents(const void* a, const void* b) {
+    uint32_t hash_a = static_cast<const HashedDirent*>(a)->hash;
+    uint32_t hash_b = static_cast<const HashedDirent*>(b)->hash;
+    return (hash_a > hash_b) - (hash_a < hash_b);
+}
+
+// A dirent of a leaf, in the order Readdir returns them: by hash, then by name.
+struct OrderedDirent {
+    uint32_t hash;
+    const Dirent* de;
+};
+
+int CompareOrderedDirents(const void* a, const void* b) {
+    const OrderedDirent* da = static_cast<const OrderedDirent*>(a);
+    const OrderedDirent* db = static_cast<const OrderedDirent*>(b);
+    if (da->hash != db->hash) {
+        return (da->hash > db->hash) ? 1 : -1;
+    }
+    int r = memcmp(da->de->name, db->de->name, fbl::min(da->de->namelen, db->de->namelen));
+    return (r != 0) ? r : (da->de->namelen - db->de->namelen);
+}
+
+// Chooses how to split |leaf|, which has no room for a dirent of |reclen| bytes hashing to
+// |hash|: the dirents hashing to |*out_split_hash| or more move to a new leaf. Names with the
+// same hash must share a leaf, so the split falls on the boundary between two hashes which is
+// closest to the middle of the leaf by bytes.
+zx_status_t PlanLeafSplit(const char* leaf, uint32_t hash, uint32_t reclen,
+                          uint32_t* out_split_hash) {
+    HashedDirent dirents[kMinfsBlockSize / DirentSize(1)];
+    size_t count = 0;
+    size_t total = 0;
+    uint32_t rlen;
+    for (size_t off = 0; off < kMinfsBlockSize; off += rlen) {
+        zx_status_t status = ValidateLeafDirent(leaf, off, &rlen);
+        if (status != ZX_OK) {
+            return status;
+        }
+        const Dirent* de = reinterpret_cast<const Dirent*>(leaf + off);
+        if (de->ino != 0) {
+            dirents[count].hash = DirentHash(de->name, de->namelen);
+            dirents[count].size = DirentSize(de->namelen);
+            total += dirents[count].size;
+            count++;
+        }
+    }
+    qsort(dirents, count, sizeof(dirents[0]), CompareHashedDirents);
+
+    size_t best = count;
+    size_t best_below = 0;
+    size_t best_delta = 0;
+    size_t below = 0;
+    for (size_t i = 0; i < count; i++) {
+        if ((i > 0) && (dirents[i].hash != dirents[i - 1].hash)) {
+            size_t delta = (2 * below > total) ? 2 * below - total : total - 2 * below;
+            if ((best == count) || (delta < best_delta)) {
+                best = i;
+                best_below = below;
+                best_delta = delta;
+            }
+        }
+        below += dirents[i].size;
+    }
+    if (best == count) {
+        return ZX_ERR_NO_SPACE;
+    }
+    size_t target = (hash >= dirents[best].hash) ? total - best_below : best_below;
+    if (target + reclen > kMinfsBlockSize) {
+        return ZX_ERR_NO_SPACE;
+    }
+    *out_split_hash = dirents[best].hash;
+    return ZX_OK;
+}
+
+// Lays out dirents back to back in one block of an indexed directory.
+class LeafBuilder {
+public:
+    explicit LeafBuilder(char* leaf) : leaf_(leaf) {
+        memset(leaf_, 0, kMinfsBlockSize);
+    }
+
+    // Appends a copy of |de|, if there is room for it.
+    bool Add(const Dirent* de) {
+        uint32_t size = DirentSize(de->namelen);
+        if (off_ + size > kMinfsBlockSize) {
+            return false;
+        }
+        memcpy(leaf_ + off_, de, size);
+        last_ = reinterpret_cast<Dirent*>(leaf_ + off_);
+        last_->reclen = size;
+        off_ += size;
+        return true;
+    }
+
+    // Stretches the last record to the end of the block. A leaf without dirents holds a single
+    // free record.
+    void Finish() {
+        if (last_ == nullptr) {
+            last_ = reinterpret_cast<Dirent*>(leaf_);
+            off_ = 0;
+        }
+        last_->reclen += kMinfsBlockSize - off_;
+    }
+
+private:
+    char* leaf_;
+    uint32_t off_ = 0;
+    Dirent* last_ = nullptr;
+};
+
 #ifdef __Fuchsia__
 
 // MinfsConnection overrides the base Connection class to allow Minfs to
@@ -776,13 +955,15 @@ zx_status_t VnodeMinfs::UnlinkChild(Transaction* state,
     // Verify they are free and small enough to merge.
     size_t coalesced_size = MinfsReclen(de, off);
     // Coalesce with "next" first, so the kMinfsReclenLast bit can easily flow
-    // back to "de" and "de_prev".
-    if (!(de->reclen & kMinfsReclenLast)) {
+    // back to "de" and "de_prev". The records of an indexed directory never
+    // cross a block, so neither may the coalesced one.
+    if (!(de->reclen & kMinfsReclenLast) &&
+        !(IsIndexed() && (off_next % kMinfsBlockSize == 0))) {
         size_t len = MINFS_DIRENT_SIZE;
         if ((status = ReadExactInternal(&de_next, len, off_next)) != ZX_OK) {
             FS_TRACE_ERROR("unlink: Failed to read next dirent\n");
             return status;
-        } else if ((status = ValidateDirent(&de_next, len, off_next)) != ZX_OK) {
+        } else if ((status = ValidateDirent(&de_next, len, off_next, DirentLimit())) != ZX_OK) {
             FS_TRACE_ERROR("unlink: Read invalid dirent\n");
             return status;
         }
@@ -797,7 +978,7 @@ zx_status_t VnodeMinfs::UnlinkChild(Transaction* state,
         if ((status = ReadExactInternal(&de_prev, len, off_prev)) != ZX_OK) {
             FS_TRACE_ERROR("unlink: Failed to read previous dirent\n");
             return status;
-        } else if ((status = ValidateDirent(&de_prev, len, off_prev)) != ZX_OK) {
+        } else if ((status = ValidateDirent(&de_prev, len, off_prev, DirentLimit())) != ZX_OK) {
             FS_TRACE_ERROR("unlink: Read invalid dirent\n");
             return status;
         }
@@ -988,14 +1169,333 @@ zx_status_t VnodeMinfs::DirentCallbackFindSpace(fbl::RefPtr<VnodeMinfs> vndir, D
     }
 }
 
+zx_status_t VnodeMinfs::FindDirentSpace(DirArgs* args, blk_t* out_reserve_blocks) {
+    if (IsIndexed()) {
+        return FindIndexedDirentSpace(args, out_reserve_blocks);
+    }
+
+    zx_status_t status = ForEachDirent(args, DirentCallbackFindSpace);
+    if (status == ZX_ERR_NOT_FOUND) {
+        return ZX_ERR_NO_SPACE;
+    } else if (status != ZX_OK) {
+        return status;
+    }
+    size_t end;
+    if ((status = LinearDirentEnd(*args, &end)) != ZX_OK) {
+        return status;
+    }
+    if (!NeedsIndex(end)) {
+        return GetRequiredBlockCount(inode_.size, args->reclen, out_reserve_blocks);
+    }
+
+    // AppendDirent will convert the directory to an index. Check that the new
+    // dirent will fit in its first leaf, or in one more after a split.
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<char[]> buffer(new (&ac) char[2 * kMinfsBlockSize]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    char* leaf = buffer.get() + kMinfsBlockSize;
+    ino_t parent;
+    if ((status = BuildFirstLeaf(buffer.get(), leaf, &parent)) != ZX_OK) {
+        return status;
+    }
+    size_t off;
+    blk_t blocks = 1;
+    if ((status = FindLeafSpace(leaf, args->reclen, &off)) == ZX_ERR_NO_SPACE) {
+        uint32_t split_hash;
+        uint32_t hash = DirentHash(args->name.data(), args->name.length());
+        status = PlanLeafSplit(leaf, hash, args->reclen, &split_hash);
+        blocks++;
+    }
+    if (status != ZX_OK) {
+        return status;
+    }
+    return GetRequiredBlockCount(kMinfsBlockSize, blocks * kMinfsBlockSize, out_reserve_blocks);
+}
+
+zx_status_t VnodeMinfs::FindIndexedDirentSpace(DirArgs* args, blk_t* out_reserve_blocks) {
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<char[]> buffer(new (&ac) char[2 * kMinfsBlockSize]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    char* leaf = buffer.get() + kMinfsBlockSize;
+    DirIndexRoot* root;
+    uint32_t index;
+    uint32_t hash = DirentHash(args->name.data(), args->name.length());
+    zx_status_t status;
+    if ((status = ReadIndexRoot(buffer.get(), &root)) != ZX_OK) {
+        return status;
+    } else if ((status = FindIndexEntry(root, hash, inode_.size, &index)) != ZX_OK) {
+        return status;
+    }
+    size_t leaf_start = root->entries[index].block * kMinfsBlockSize;
+    if ((status = ReadExactInternal(leaf, kMinfsBlockSize, leaf_start)) != ZX_OK) {
+        return status;
+    }
+
+    size_t off;
+    if ((status = FindLeafSpace(leaf, args->reclen, &off)) == ZX_OK) {
+        args->offs.off = leaf_start + off;
+        *out_reserve_blocks = 0;
+        return ZX_OK;
+    } else if (status != ZX_ERR_NO_SPACE) {
+        return status;
+    } else if (root->count >= kMinfsDirIndexMaxLeaves) {
+        return ZX_ERR_NO_SPACE;
+    }
+    uint32_t split_hash;
+    if ((status = PlanLeafSplit(leaf, hash, args->reclen, &split_hash)) != ZX_OK) {
+        return status;
+    }
+    // AppendDirent chooses the record once the leaf has been split.
+    args->offs.off = leaf_start;
+    return GetRequiredBlockCount(inode_.size, kMinfsBlockSize, out_reserve_blocks);
+}
+
+zx_status_t VnodeMinfs::LinearDirentEnd(const DirArgs& args, size_t* out_end) {
+    char data[kMinfsMaxDirentSize];
+    Dirent* de = reinterpret_cast<Dirent*>(data);
+    size_t r;
+    zx_status_t status = ReadInternal(data, kMinfsMaxDirentSize, args.offs.off, &r);
+    if (status != ZX_OK) {
+        return status;
+    } else if ((status = ValidateDirent(de, r, args.offs.off, DirentLimit())) != ZX_OK) {
+        return status;
+    }
+    *out_end = args.offs.off + ((de->ino == 0) ? 0 : DirentSize(de->namelen)) + args.reclen;
+    return ZX_OK;
+}
+
+bool VnodeMinfs::NeedsIndex(size_t dirent_end) const {
+    // Directories which grew past their first block before indexes existed
+    // stay linear.
+    return (dirent_end > kMinfsBlockSize) && (inode_.size <= kMinfsBlockSize);
+}
+
+zx_status_t VnodeMinfs::ReadIndexRoot(char* block, DirIndexRoot** out_root) {
+    zx_status_t status = ReadExactInternal(block, kMinfsBlockSize, 0);
+    if (status != ZX_OK) {
+        return status;
+    }
+    DirIndexRoot* root = GetIndexRoot(block);
+    if ((root->magic != kMinfsDirIndexMagic) || (root->hash_version != kMinfsDirHashFnv1a) ||
+        (root->count == 0) || (root->count > kMinfsDirIndexMaxLeaves)) {
+        FS_TRACE_ERROR("minfs: ino#%u: bad directory index root\n", ino_);
+        return ZX_ERR_IO;
+    }
+    *out_root = root;
+    return ZX_OK;
+}
+
+zx_status_t VnodeMinfs::BuildFirstLeaf(char* block, char* leaf, ino_t* out_parent) {
+    ZX_DEBUG_ASSERT(inode_.size <= kMinfsBlockSize);
+    memset(block, 0, kMinfsBlockSize);
+    zx_status_t status = ReadExactInternal(block, inode_.size, 0);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    LeafBuilder builder(leaf);
+    *out_parent = 0;
+    for (size_t off = 0; off + MINFS_DIRENT_SIZE <= inode_.size;) {
+        Dirent* de = reinterpret_cast<Dirent*>(block + off);
+        if ((status = ValidateDirent(de, inode_.size - off, off, DirentLimit())) != ZX_OK) {
+            return status;
+        }
+        fbl::StringPiece name(de->name, de->namelen);
+        if (de->ino == 0 || name == ".") {
+            // Not moved to the leaf.
+        } else if (name == "..") {
+            *out_parent = de->ino;
+        } else if (!builder.Add(de)) {
+            FS_TRACE_ERROR("minfs: ino#%u: dirents do not fit in one block\n", ino_);
+            return ZX_ERR_IO;
+        }
+        if (de->reclen & kMinfsReclenLast) {
+            break;
+        }
+        off += MinfsReclen(de, off);
+    }
+    if (*out_parent == 0) {
+        FS_TRACE_ERROR("minfs: ino#%u: directory without '..'\n", ino_);
+        return ZX_ERR_IO;
+    }
+    builder.Finish();
+    return ZX_OK;
+}
+
+zx_status_t VnodeMinfs::CreateIndex(Transaction* state) {
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<char[]> buffer(new (&ac) char[2 * kMinfsBlockSize]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    char* block = buffer.get();
+    char* leaf = block + kMinfsBlockSize;
+    ino_t parent;
+    zx_status_t status = BuildFirstLeaf(block, leaf, &parent);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    // Block 0 keeps '.' and '..'; the rest of it is a free dirent holding the
+    // root, so that a linear walk still finds a well-formed block.
+    memset(block, 0, kMinfsBlockSize);
+    InitializeDirectory(block, ino_, parent);
+    Dirent* de = reinterpret_cast<Dirent*>(block + DirentSize(1));
+    de->reclen = DirentSize(2);
+    de = reinterpret_cast<Dirent*>(block + kMinfsDirIndexDirentOffset);
+    de->reclen = kMinfsBlockSize - kMinfsDirIndexDirentOffset;
+    DirIndexRoot* root = GetIndexRoot(block);
+    root->magic = kMinfsDirIndexMagic;
+    root->hash_version = kMinfsDirHashFnv1a;
+    root->count = 1;
+    root->entries[0].hash = 0;
+    root->entries[0].block = 1;
+
+    if ((status = WriteExactInternal(state, leaf, kMinfsBlockSize, kMinfsBlockSize)) != ZX_OK) {
+        return status;
+    } else if ((status = WriteExactInternal(state, block, kMinfsBlockSize, 0)) != ZX_OK) {
+        return status;
+    }
+    inode_.flags |= kMinfsInodeFlagDirIndex;
+    InodeSync(state->GetWork(), kMxFsSyncMtime);
+    fs_->UpgradeVersion(state->GetWork());
+    return ZX_OK;
+}
+
+zx_status_t VnodeMinfs::SplitLeaf(Transaction* state, char* block, uint32_t index, char* leaf,
+                                  uint32_t hash, uint32_t reclen, blk_t* out_blk) {
+    DirIndexRoot* root = GetIndexRoot(block);
+    if (root->count >= kMinfsDirIndexMaxLeaves) {
+        return ZX_ERR_NO_SPACE;
+    }
+    uint32_t split_hash;
+    zx_status_t status = PlanLeafSplit(leaf, hash, reclen, &split_hash);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<char[]> buffer(new (&ac) char[2 * kMinfsBlockSize]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    char* lower = buffer.get();
+    char* upper = lower + kMinfsBlockSize;
+    LeafBuilder lower_builder(lower);
+    LeafBuilder upper_builder(upper);
+    uint32_t rlen;
+    for (size_t off = 0; off < kMinfsBlockSize; off += rlen) {
+        if ((status = ValidateLeafDirent(leaf, off, &rlen)) != ZX_OK) {
+            return status;
+        }
+        const Dirent* de = reinterpret_cast<const Dirent*>(leaf + off);
+        if (de->ino == 0) {
+            continue;
+        }
+        LeafBuilder* builder = (DirentHash(de->name, de->namelen) < split_hash) ?
+            &lower_builder : &upper_builder;
+        if (!builder->Add(de)) {
+            return ZX_ERR_IO;
+        }
+    }
+    lower_builder.Finish();
+    upper_builder.Finish();
+
+    // The upper half moves to a new leaf at the end of the directory.
+    blk_t lower_blk = root->entries[index].block;
+    blk_t upper_blk = static_cast<blk_t>(inode_.size / kMinfsBlockSize);
+    if ((status = WriteExactInternal(state, upper, kMinfsBlockSize,
+                                     upper_blk * kMinfsBlockSize)) != ZX_OK) {
+        return status;
+    } else if ((status = WriteExactInternal(state, lower, kMinfsBlockSize,
+                                            lower_blk * kMinfsBlockSize)) != ZX_OK) {
+        return status;
+    }
+    memmove(&root->entries[index + 2], &root->entries[index + 1],
+            (root->count - index - 1) * sizeof(DirIndexEntry));
+    root->entries[index + 1].hash = split_hash;
+    root->entries[index + 1].block = upper_blk;
+    root->count++;
+    if ((status = WriteExactInternal(state, root,
+                                     sizeof(DirIndexRoot) + root->count * sizeof(DirIndexEntry),
+                                     kMinfsDirIndexRootOffset)) != ZX_OK) {
+        return status;
+    }
+
+    bool in_upper = hash >= split_hash;
+    memcpy(leaf, in_upper ? upper : lower, kMinfsBlockSize);
+    *out_blk = in_upper ? upper_blk : lower_blk;
+    return ZX_OK;
+}
+
+zx_status_t VnodeMinfs::AppendIndexedDirent(DirArgs* args) {
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<char[]> buffer(new (&ac) char[2 * kMinfsBlockSize]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    char* block = buffer.get();
+    char* leaf = block + kMinfsBlockSize;
+    DirIndexRoot* root;
+    uint32_t index;
+    uint32_t hash = DirentHash(args->name.data(), args->name.length());
+    zx_status_t status;
+    if ((status = ReadIndexRoot(block, &root)) != ZX_OK) {
+        return status;
+    } else if ((status = FindIndexEntry(root, hash, inode_.size, &index)) != ZX_OK) {
+        return status;
+    }
+    blk_t blk = root->entries[index].block;
+    if ((status = ReadExactInternal(leaf, kMinfsBlockSize, blk * kMinfsBlockSize)) != ZX_OK) {
+        return status;
+    }
+
+    size_t off;
+    status = FindLeafSpace(leaf, args->reclen, &off);
+    if (status == ZX_ERR_NO_SPACE) {
+        // On success, |leaf| holds the half of the split leaf |hash| belongs to.
+        if ((status = SplitLeaf(args->state, block, index, leaf, hash, args->reclen,
+                                &blk)) != ZX_OK) {
+            return status;
+        }
+        status = FindLeafSpace(leaf, args->reclen, &off);
+    }
+    if (status != ZX_OK) {
+        return status;
+    }
+    args->offs.off = blk * kMinfsBlockSize + off;
+    return InsertDirent(args);
+}
+
 zx_status_t VnodeMinfs::AppendDirent(DirArgs* args) {
+    if (IsIndexed()) {
+        return AppendIndexedDirent(args);
+    }
+    size_t end;
+    zx_status_t status = LinearDirentEnd(*args, &end);
+    if (status != ZX_OK) {
+        return status;
+    } else if (NeedsIndex(end)) {
+        if ((status = CreateIndex(args->state)) != ZX_OK) {
+            return status;
+        }
+        return AppendIndexedDirent(args);
+    }
+    return InsertDirent(args);
+}
+
+zx_status_t VnodeMinfs::InsertDirent(DirArgs* args) {
     char data[kMinfsMaxDirentSize];
     Dirent* de = reinterpret_cast<Dirent*>(data);
     size_t r;
     zx_status_t status = ReadInternal(data, kMinfsMaxDirentSize, args->offs.off, &r);
     if (status != ZX_OK) {
         return status;
-    } else if ((status = ValidateDirent(de, r, args->offs.off)) != ZX_OK) {
+    } else if ((status = ValidateDirent(de, r, args->offs.off, DirentLimit())) != ZX_OK) {
         return status;
     }
 
@@ -1064,6 +1564,9 @@ zx_status_t VnodeMinfs::AppendDirent(DirArgs* args) {
 //          Since 'func' may create / remove surrounding dirents, it is responsible for
 //          updating the offset information to access the next dirent.
 zx_status_t VnodeMinfs::ForEachDirent(DirArgs* args, const DirentCallback func) {
+    if (IsIndexed()) {
+        return ForEachIndexedDirent(args, func);
+    }
     char data[kMinfsMaxDirentSize];
     Dirent* de = (Dirent*) data;
     args->offs.off = 0;
@@ -1074,7 +1577,8 @@ zx_status_t VnodeMinfs::ForEachDirent(DirArgs* args, const DirentCallback func)
         zx_status_t status = ReadInternal(data, kMinfsMaxDirentSize, args->offs.off, &r);
         if (status != ZX_OK) {
             return status;
-        } else if ((status = ValidateDirent(de, r, args->offs.off)) != ZX_OK) {
+        } else if ((status = ValidateDirent(de, r, args->offs.off,
+                                            kMinfsMaxDirectorySize)) != ZX_OK) {
             return status;
         }
 
@@ -1095,6 +1599,58 @@ zx_status_t VnodeMinfs::ForEachDirent(DirArgs* args, const DirentCallback func)
     return ZX_ERR_NOT_FOUND;
 }
 
+// In an indexed directory, only the one block which may hold |args->name| is
+// walked: block 0 for '.' and '..', and otherwise the leaf for its hash.
+zx_status_t VnodeMinfs::ForEachIndexedDirent(DirArgs* args, const DirentCallback func) {
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<char[]> buffer(new (&ac) char[kMinfsBlockSize]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    char* block = buffer.get();
+    zx_status_t status;
+    blk_t blk = 0;
+    if ((args->name != ".") && (args->name != "..")) {
+        DirIndexRoot* root;
+        uint32_t index;
+        uint32_t hash = DirentHash(args->name.data(), args->name.length());
+        if ((status = ReadIndexRoot(block, &root)) != ZX_OK) {
+            return status;
+        } else if ((status = FindIndexEntry(root, hash, inode_.size, &index)) != ZX_OK) {
+            return status;
+        }
+        blk = root->entries[index].block;
+    }
+    size_t start = blk * kMinfsBlockSize;
+    if ((status = ReadExactInternal(block, kMinfsBlockSize, start)) != ZX_OK) {
+        return status;
+    }
+
+    args->offs.off = start;
+    args->offs.off_prev = start;
+    while (args->offs.off < start + kMinfsBlockSize) {
+        uint32_t reclen;
+        if ((status = ValidateLeafDirent(block, args->offs.off - start, &reclen)) != ZX_OK) {
+            return status;
+        }
+        Dirent* de = reinterpret_cast<Dirent*>(block + (args->offs.off - start));
+        switch ((status = func(fbl::RefPtr<VnodeMinfs>(this), de, args))) {
+        case kDirIteratorNext:
+            break;
+        case kDirIteratorSaveSync:
+            inode_.seq_num++;
+            InodeSync(args->state->GetWork(), kMxFsSyncMtime);
+            args->state->GetWork()->PinVnode(fbl::WrapRefPtr(this));
+            return ZX_OK;
+        case kDirIteratorDone:
+        default:
+            return status;
+        }
+    }
+
+    return ZX_ERR_NOT_FOUND;
+}
+
 void VnodeMinfs::fbl_recycle() {
     ZX_DEBUG_ASSERT(fd_count_ == 0);
     if (!IsUnlinked()) {
@@ -1361,7 +1917,12 @@ zx_status_t VnodeMinfs::WriteInternal(Transaction* state, const void* data,
             break;
         }
         ZX_DEBUG_ASSERT(bno != 0);
-        state->GetWork()->Enqueue(vmo_.get(), n, bno + fs_->Info().dat_block, 1);
+        // Directory contents are metadata, and go through the journal.
+        if (IsDirectory()) {
+            state->GetWork()->Enqueue(vmo_.get(), n, bno + fs_->Info().dat_block, 1);
+        } else {
+            state->GetWork()->EnqueueData(vmo_.get(), n, bno + fs_->Info().dat_block, 1);
+        }
 #else
         blk_t bno;
         if ((status = BlockGet(state, n, &bno))) {
@@ -1479,12 +2040,29 @@ zx_status_t VnodeMinfs::Setattr(const vnattr_t* a) {
     return ZX_OK;
 }
 
+// Linear directories are read in offset order. Indexed directories are read in hash order,
+// as ext4 htree does, since a leaf split moves dirents to a later block: |pos.hash| is the
+// smallest hash not yet returned in full, and |pos.seen| the number of dirents with that hash
+// (taken in name order) which were.
 struct DirCookie {
-    size_t off;        // Offset into directory
-    uint32_t reserved; // Unused
-    uint32_t seqno;    // inode seq no
+    union {
+        size_t off;        // Offset into a linear directory
+        struct {
+            uint32_t hash;
+            uint32_t seen;
+        } pos;             // Position in an indexed directory
+    };
+    uint32_t state;        // kDirCookie*
+    uint32_t seqno;        // inode seq no
 };
 
+// Nothing returned yet, or a linear directory.
+constexpr uint32_t kDirCookieStart = 0;
+// '.' returned; |pos| holds the position in an indexed directory.
+constexpr uint32_t kDirCookieIndexed = 1;
+// Every dirent of an indexed directory returned.
+constexpr uint32_t kDirCookieDone = 2;
+
 static_assert(sizeof(DirCookie) <= sizeof(fs::vdircookie_t),
               "MinFS DirCookie too large to fit in IO state");
 
@@ -1498,6 +2076,15 @@ zx_status_t VnodeMinfs::Readdir(fs::vdircookie_t* cookie, void* dirents, size_t
     if (!IsDirectory()) {
         return ZX_ERR_NOT_SUPPORTED;
     }
+    if (IsIndexed()) {
+        zx_status_t status = ReaddirIndexed(dc, &df);
+        if (status != ZX_OK) {
+            return status;
+        }
+        *out_actual = df.BytesFilled();
+        ZX_DEBUG_ASSERT(*out_actual <= len); // Otherwise, we're overflowing the input buffer.
+        return ZX_OK;
+    }
 
     size_t off = dc->off;
     size_t r;
@@ -1511,12 +2098,12 @@ zx_status_t VnodeMinfs::Readdir(fs::vdircookie_t* cookie, void* dirents, size_t
 
         size_t off_recovered = 0;
         while (off_recovered < off) {
-            if (off_recovered + MINFS_DIRENT_SIZE >= kMinfsMaxDirectorySize) {
+            if (off_recovered + MINFS_DIRENT_SIZE >= DirentLimit()) {
                 FS_TRACE_ERROR("minfs: Readdir: Corrupt dirent; dirent reclen too large\n");
                 goto fail;
             }
             zx_status_t status = ReadInternal(de, kMinfsMaxDirentSize, off_recovered, &r);
-            if ((status != ZX_OK) || (ValidateDirent(de, r, off_recovered) != ZX_OK)) {
+            if ((status != ZX_OK) || (ValidateDirent(de, r, off_recovered, DirentLimit()) != ZX_OK)) {
                 FS_TRACE_ERROR("minfs: Readdir: Corrupt dirent unreadable/failed validation\n");
                 goto fail;
             }
@@ -1525,12 +2112,12 @@ zx_status_t VnodeMinfs::Readdir(fs::vdircookie_t* cookie, void* dirents, size_t
         off = off_recovered;
     }
 
-    while (off + MINFS_DIRENT_SIZE < kMinfsMaxDirectorySize) {
+    while (off + MINFS_DIRENT_SIZE < DirentLimit()) {
         zx_status_t status = ReadInternal(de, kMinfsMaxDirentSize, off, &r);
         if (status != ZX_OK) {
             FS_TRACE_ERROR("minfs: Readdir: Unreadable dirent\n");
             goto fail;
-        } else if (ValidateDirent(de, r, off) != ZX_OK) {
+        } else if (ValidateDirent(de, r, off, DirentLimit()) != ZX_OK) {
             FS_TRACE_ERROR("minfs: Readdir: Corrupt dirent failed validation\n");
             goto fail;
         }
@@ -1561,6 +2148,85 @@ fail:
     return ZX_ERR_IO;
 }
 
+zx_status_t VnodeMinfs::ReaddirIndexed(DirCookie* dc, fs::DirentFiller* df) {
+    if (dc->state == kDirCookieDone) {
+        return ZX_OK;
+    } else if (dc->state != kDirCookieIndexed) {
+        // A cookie from before the directory became indexed starts over, which may repeat
+        // dirents but does not skip any.
+        if (df->Next(".", kMinfsTypeDir, ino_) != ZX_OK) {
+            return ZX_OK;
+        }
+        dc->pos.hash = 0;
+        dc->pos.seen = 0;
+        dc->state = kDirCookieIndexed;
+    }
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<char[]> buffer(new (&ac) char[2 * kMinfsBlockSize]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    char* block = buffer.get();
+    char* leaf = block + kMinfsBlockSize;
+    DirIndexRoot* root;
+    uint32_t index;
+    zx_status_t status;
+    if ((status = ReadIndexRoot(block, &root)) != ZX_OK) {
+        return status;
+    } else if ((status = FindIndexEntry(root, dc->pos.hash, inode_.size, &index)) != ZX_OK) {
+        return status;
+    }
+
+    OrderedDirent dirents[kMinfsBlockSize / DirentSize(1)];
+    for (; index < root->count; index++) {
+        blk_t blk = root->entries[index].block;
+        if ((blk == 0) || (blk >= inode_.size / kMinfsBlockSize)) {
+            FS_TRACE_ERROR("minfs: Readdir: index entry %u has bad block %u\n", index, blk);
+            return ZX_ERR_IO;
+        } else if ((status = ReadExactInternal(leaf, kMinfsBlockSize,
+                                               blk * kMinfsBlockSize)) != ZX_OK) {
+            return status;
+        }
+        size_t count = 0;
+        uint32_t rlen;
+        for (size_t off = 0; off < kMinfsBlockSize; off += rlen) {
+            if ((status = ValidateLeafDirent(leaf, off, &rlen)) != ZX_OK) {
+                return status;
+            }
+            const Dirent* de = reinterpret_cast<const Dirent*>(leaf + off);
+            uint32_t hash = DirentHash(de->name, de->namelen);
+            if ((de->ino != 0) && (hash >= dc->pos.hash)) {
+                dirents[count].hash = hash;
+                dirents[count].de = de;
+                count++;
+            }
+        }
+        qsort(dirents, count, sizeof(dirents[0]), CompareOrderedDirents);
+
+        uint32_t skip = dc->pos.seen;
+        for (size_t i = 0; i < count; i++) {
+            const Dirent* de = dirents[i].de;
+            if ((dirents[i].hash == dc->pos.hash) && (skip > 0)) {
+                skip--;
+                continue;
+            }
+            if (df->Next(fbl::StringPiece(de->name, de->namelen), de->type, de->ino) != ZX_OK) {
+                // no more space
+                return ZX_OK;
+            }
+            if (dirents[i].hash == dc->pos.hash) {
+                dc->pos.seen++;
+            } else {
+                dc->pos.hash = dirents[i].hash;
+                dc->pos.seen = 1;
+            }
+        }
+    }
+    dc->state = kDirCookieDone;
+    return ZX_OK;
+}
+
 VnodeMinfs::VnodeMinfs(Minfs* fs) : fs_(fs) {}
 
 #ifdef __Fuchsia__
@@ -1628,17 +2294,11 @@ zx_status_t VnodeMinfs::Create(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece nam
     // before updating any other metadata.
     args.type = type;
     args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(name.length())));
-    status = ForEachDirent(&args, DirentCallbackFindSpace);
-    if (status == ZX_ERR_NOT_FOUND) {
-        return ZX_ERR_NO_SPACE;
-    } else if (status != ZX_OK) {
-        return status;
-    }
 
-    // Calculate maximum blocks to reserve for the current directory, based on the size and offset
-    // of the new direntry (Assuming that the offset is the current size of the directory).
+    // Calculate maximum blocks to reserve for the current directory, based on where the new
+    // direntry will go.
     blk_t reserve_blocks = 0;
-    if ((status = GetRequiredBlockCount(inode_.size, args.reclen, &reserve_blocks)) != ZX_OK) {
+    if ((status = FindDirentSpace(&args, &reserve_blocks)) != ZX_OK) {
         return status;
     }
 
@@ -1843,7 +2503,13 @@ zx_status_t VnodeMinfs::TruncateInternal(Transaction* state, size_t len) {
                     FS_TRACE_ERROR("minfs: Truncate failed to write last block: %d\n", r);
                     return ZX_ERR_IO;
                 }
-                state->GetWork()->Enqueue(vmo_.get(), rel_bno, bno + fs_->Info().dat_block, 1);
+                if (IsDirectory()) {
+                    state->GetWork()->Enqueue(vmo_.get(), rel_bno,
+                                              bno + fs_->Info().dat_block, 1);
+                } else {
+                    state->GetWork()->EnqueueData(vmo_.get(), rel_bno,
+                                                  bno + fs_->Info().dat_block, 1);
+                }
 #else
                 if (fs_->bc_->Readblk(bno + fs_->Info().dat_block, bdata)) {
                     return ZX_ERR_IO;
@@ -1937,27 +2603,32 @@ zx_status_t VnodeMinfs::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece
         return ZX_OK;
     }
 
+    // An existing 'newname' is replaced in place, so space for a new direntry
+    // is only needed (and only looked for) if there is none.
+    args.name = newname;
+    bool target_exists;
+    if ((status = newdir->ForEachDirent(&args, DirentCallbackFind)) == ZX_OK) {
+        target_exists = true;
+    } else if (status == ZX_ERR_NOT_FOUND) {
+        target_exists = false;
+    } else {
+        return status;
+    }
+
     // Ensure that we have enough space to write the vnode's new direntry
     // before updating any other metadata.
     args.type = oldvn->IsDirectory() ? kMinfsTypeDir : kMinfsTypeFile;
     args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(newname.length())));
 
-    status = newdir->ForEachDirent(&args, DirentCallbackFindSpace);
-    if (status == ZX_ERR_NOT_FOUND) {
-        return ZX_ERR_NO_SPACE;
-    } else if (status != ZX_OK) {
+    // Reserve potential blocks to add a new direntry to newdir.
+    blk_t reserved_blocks = 0;
+    if (!target_exists &&
+        (status = newdir->FindDirentSpace(&args, &reserved_blocks)) != ZX_OK) {
         return status;
     }
 
     DirectoryOffset append_offs = args.offs;
 
-    // Reserve potential blocks to add a new direntry to newdir.
-    blk_t reserved_blocks;
-    if ((status = GetRequiredBlockCount(newdir->GetInode()->size, args.reclen, &reserved_blocks))
-        != ZX_OK) {
-        return status;
-    }
-
     fbl::unique_ptr<Transaction> state;
     if ((status = fs_->BeginTransaction(0, reserved_blocks, &state)) != ZX_OK) {
         return status;
@@ -1968,15 +2639,16 @@ zx_status_t VnodeMinfs::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece
     args.state = state.get();
     args.name = newname;
     args.ino = oldvn->ino_;
-    status = newdir->ForEachDirent(&args, DirentCallbackAttemptRename);
-    if (status == ZX_ERR_NOT_FOUND) {
+    if (target_exists) {
+        if ((status = newdir->ForEachDirent(&args, DirentCallbackAttemptRename)) != ZX_OK) {
+            return status;
+        }
+    } else {
         // if 'newname' does not exist, create it
         args.offs = append_offs;
         if ((status = newdir->AppendDirent(&args)) != ZX_OK) {
             return status;
         }
-    } else if (status != ZX_OK) {
-        return status;
     }
 
     // update the oldvn's entry for '..' if (1) it was a directory, and (2) it
@@ -2038,17 +2710,10 @@ zx_status_t VnodeMinfs::Link(fbl::StringPiece name, fbl::RefPtr<fs::Vnode> _targ
     // before updating any other metadata.
     args.type = kMinfsTypeFile; // We can't hard link directories
     args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(name.length())));
-    status = ForEachDirent(&args, DirentCallbackFindSpace);
-    if (status == ZX_ERR_NOT_FOUND) {
-        return ZX_ERR_NO_SPACE;
-    } else if (status != ZX_OK) {
-        return status;
-    }
 
     // Reserve potential blocks to write a new direntry.
     blk_t reserved_blocks;
-    if ((status = GetRequiredBlockCount(GetInode()->size, args.reclen, &reserved_blocks))
-        != ZX_OK) {
+    if ((status = FindDirentSpace(&args, &reserved_blocks)) != ZX_OK) {
         return status;
     }
 
@@ -32,9 +32,19 @@ namespace minfs {
 
 void WriteTxn::Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
                        uint64_t nblocks) {
+    EnqueueRequest(vmo, vmo_offset, dev_offset, nblocks, false);
+}
+
+void WriteTxn::EnqueueData(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
+                           uint64_t nblocks) {
+    EnqueueRequest(vmo, vmo_offset, dev_offset, nblocks, true);
+}
+
+void WriteTxn::EnqueueRequest(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
+                              uint64_t nblocks, bool data) {
     ValidateVmoSize(vmo, static_cast<blk_t>(vmo_offset));
     for (size_t i = 0; i < requests_.size(); i++) {
-        if (requests_[i].vmo != vmo) {
+        if (requests_[i].vmo != vmo || requests_[i].data != data) {
             continue;
         }
 
@@ -55,40 +65,14 @@ void WriteTxn::Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset
     request.vmo = vmo;
     // NOTE: It's easier to compare everything when dealing
     // with blocks (not offsets!) so the following are described in
-    // terms of blocks until we Flush().
+    // terms of blocks until the journal writes them out.
     request.vmo_offset = vmo_offset;
     request.dev_offset = dev_offset;
     request.length = nblocks;
+    request.data = data;
     requests_.push_back(std::move(request));
 }
 
-zx_status_t WriteTxn::Flush(zx_handle_t vmo, vmoid_t vmoid) {
-    ZX_DEBUG_ASSERT(vmo != ZX_HANDLE_INVALID);
-    ZX_DEBUG_ASSERT(vmoid != VMOID_INVALID);
-
-    // Update all the outgoing transactions to be in "disk blocks",
-    // not "Minfs blocks".
-    block_fifo_request_t blk_reqs[requests_.size()];
-    const uint32_t kDiskBlocksPerMinfsBlock = kMinfsBlockSize / bc_->DeviceBlockSize();
-    for (size_t i = 0; i < requests_.size(); i++) {
-        blk_reqs[i].group = bc_->BlockGroupID();
-        blk_reqs[i].vmoid = vmoid;
-        blk_reqs[i].opcode = BLOCKIO_WRITE;
-        blk_reqs[i].vmo_offset = requests_[i].vmo_offset * kDiskBlocksPerMinfsBlock;
-        blk_reqs[i].dev_offset = requests_[i].dev_offset * kDiskBlocksPerMinfsBlock;
-        // TODO(ZX-2253): Remove this assertion.
-        uint64_t length = requests_[i].length * kDiskBlocksPerMinfsBlock;
-        ZX_ASSERT_MSG(length < UINT32_MAX, "Too many blocks");
-        blk_reqs[i].length = static_cast<uint32_t>(length);
-    }
-
-    // Actually send the operations to the underlying block device.
-    zx_status_t status = bc_->Transaction(blk_reqs, requests_.size());
-
-    requests_.reset();
-    return status;
-}
-
 size_t WriteTxn::BlkCount() const {
     size_t blocks_needed = 0;
     for (size_t i = 0; i < requests_.size(); i++) {
@@ -97,6 +81,20 @@ size_t WriteTxn::BlkCount() const {
     return blocks_needed;
 }
 
+void WriteTxn::DeferFree(Allocator* allocator, size_t index) {
+    DeferredFree free;
+    free.allocator = allocator;
+    free.index = index;
+    frees_.push_back(free);
+}
+
+void WriteTxn::CommitFrees() {
+    for (size_t i = 0; i < frees_.size(); i++) {
+        frees_[i].allocator->FreeCommitted(frees_[i].index);
+    }
+    frees_.reset();
+}
+
 #endif  // __Fuchsia__
 
 WritebackWork::WritebackWork(Bcache* bc) : WriteTxn(bc),
@@ -116,16 +114,16 @@ void WritebackWork::Reset() {
 }
 
 #ifdef __Fuchsia__
-// Returns the number of blocks of the writeback buffer that have been
-// consumed
-size_t WritebackWork::Complete(zx_handle_t vmo, vmoid_t vmoid) {
-    size_t blk_count = BlkCount();
-    zx_status_t status = Flush(vmo, vmoid);
+void WritebackWork::Complete(zx_status_t status) {
+    if (status == ZX_OK) {
+        CommitFrees();
+    }
+    // Otherwise, the elements freed by this work stay unavailable until the
+    // next mount: a replay may still find them in use.
     if (closure_) {
         closure_(status);
     }
     Reset();
-    return blk_count;
 }
 
 void WritebackWork::SetClosure(SyncCallback closure) {
@@ -155,8 +153,10 @@ void WritebackWork::PinVnode(fbl::RefPtr<VnodeMinfs> vn) {
 #ifdef __Fuchsia__
 
 zx_status_t WritebackBuffer::Create(Bcache* bc, fzl::OwnedVmoMapper mapper,
+                                    fbl::unique_ptr<Journal> journal,
                                     fbl::unique_ptr<WritebackBuffer>* out) {
-    fbl::unique_ptr<WritebackBuffer> wb(new WritebackBuffer(bc, std::move(mapper)));
+    fbl::unique_ptr<WritebackBuffer> wb(new WritebackBuffer(bc, std::move(mapper),
+                                                            std::move(journal)));
     if (wb->mapper_.size() % kMinfsBlockSize != 0) {
         return ZX_ERR_INVALID_ARGS;
     } else if (cnd_init(&wb->consumer_cvar_) != thrd_success) {
@@ -177,8 +177,9 @@ zx_status_t WritebackBuffer::Create(Bcache* bc, fzl::OwnedVmoMapper mapper,
     return ZX_OK;
 }
 
-WritebackBuffer::WritebackBuffer(Bcache* bc, fzl::OwnedVmoMapper mapper) :
-    bc_(bc), unmounting_(false), mapper_(std::move(mapper)),
+WritebackBuffer::WritebackBuffer(Bcache* bc, fzl::OwnedVmoMapper mapper,
+                                 fbl::unique_ptr<Journal> journal) :
+    bc_(bc), unmounting_(false), mapper_(std::move(mapper)), journal_(std::move(journal)),
     cap_(mapper_.size() / kMinfsBlockSize) {}
 
 WritebackBuffer::~WritebackBuffer() {
@@ -191,6 +192,13 @@ WritebackBuffer::~WritebackBuffer() {
     int r;
     thrd_join(writeback_thrd_, &r);
 
+    // Everything has been written in place, so a clean unmount leaves
+    // nothing to replay.
+    if (journal_->Checkpoint() != ZX_OK) {
+        FS_TRACE_ERROR("minfs: failed to checkpoint journal\n");
+    }
+    journal_ = nullptr;
+
     if (buffer_vmoid_ != VMOID_INVALID) {
         block_fifo_request_t request;
         request.group = bc_->BlockGroupID();
@@ -272,6 +280,7 @@ void WritebackBuffer::CopyToBufferLocked(WriteTxn* txn) {
             request.vmo_offset = 0;
             request.dev_offset = dev_offset;
             request.length = wb_len;
+            request.data = reqs[i].data;
             i++;
             reqs.insert(i, request);
         }
@@ -318,18 +327,29 @@ int WritebackBuffer::WritebackThread(void* arg) {
     b->writeback_lock_.Acquire();
     while (true) {
         while (!b->work_queue_.is_empty()) {
-            auto work = b->work_queue_.pop();
             TRACE_DURATION("minfs", "WritebackBuffer::WritebackThread");
 
+            // Take as many queued works as fit in one journal entry, so they
+            // are written out together.
+            WorkQueue batch;
+            size_t blks_consumed = 0;
+            while (!b->work_queue_.is_empty() && b->journal_->Append(&b->work_queue_.front())) {
+                blks_consumed += b->work_queue_.front().BlkCount();
+                batch.push(b->work_queue_.pop());
+            }
+
             // Stay unlocked while processing a unit of work
             b->writeback_lock_.Release();
 
             // TODO(smklein): We could add additional validation that the blocks
             // in "work" are contiguous and in the range of [start_, len_) (including
             // wraparound).
-            size_t blks_consumed = work->Complete(b->mapper_.vmo().get(), b->buffer_vmoid_);
-            TRACE_FLOW_END("minfs", "writeback", reinterpret_cast<trace_flow_id_t>(work.get()));
-            work = nullptr;
+            zx_status_t status = b->journal_->Commit(b->mapper_.start(), b->buffer_vmoid_);
+            while (!batch.is_empty()) {
+                auto work = batch.pop();
+                work->Complete(status);
+                TRACE_FLOW_END("minfs", "writeback", reinterpret_cast<trace_flow_id_t>(work.get()));
+            }
 
             // Relock before checking the state of the queue
             b->writeback_lock_.Acquire();
@@ -0,0 +1,46 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+#include <zircon/compiler.h>
+
+__BEGIN_CDECLS
+
+// The kernel publishes its counters (see kernel/lib/counters) as two
+// read-only VMOs, which appear as files under /boot/kernel.
+//
+// The descriptor VMO holds a kcounter_desc_header_t followed by one
+// kcounter_desc_entry_t per counter, sorted by name.
+//
+// The arena VMO holds |max_cpus| blocks of |num_counters| int64_t values,
+// one block per cpu.  Within a block, a counter's slot is the index of its
+// descriptor.  The kernel updates the arena in place, so a mapping of it
+// always shows the current values.
+#define KCOUNTER_DESC_VMO_NAME  "counters/desc"
+#define KCOUNTER_ARENA_VMO_NAME "counters/arena"
+
+#define KCOUNTER_DESC_MAGIC     0x636e746b63736564ULL // "desckcnt"
+
+#define KCOUNTER_MAX_NAME       56
+
+// How the per-cpu values of a counter combine into its value.
+#define KCOUNTER_TYPE_SUM       1
+#define KCOUNTER_TYPE_MIN       2
+#define KCOUNTER_TYPE_MAX       3
+
+typedef struct kcounter_desc_entry {
+    char name[KCOUNTER_MAX_NAME];   // NUL-terminated
+    uint64_t type;                  // KCOUNTER_TYPE_*
+} kcounter_desc_entry_t;
+
+typedef struct kcounter_desc_header {
+    uint64_t magic;                 // KCOUNTER_DESC_MAGIC
+    uint32_t max_cpus;
+    uint32_t num_counters;
+    kcounter_desc_entry_t descriptors[];
+} kcounter_desc_header_t;
+
+__END_CDECLS
@@ -0,0 +1,78 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+#include <zircon/compiler.h>
+
+__BEGIN_CDECLS
+
+// The kernel's latency histograms (see kernel/lib/counters) are published
+// like its counters (see <lib/zircon-internal/kcounter.h>), as two read-only
+// VMOs that appear as files under /boot/kernel.
+//
+// The descriptor VMO holds a khistogram_desc_header_t followed by one
+// khistogram_desc_entry_t per family of histograms, sorted by name.  A family
+// holds |count| histograms, such as one per syscall number, numbered from
+// |first| among all of the histograms.
+//
+// The arena VMO holds |num_cpus| blocks of |num_histograms| histograms, one
+// block per cpu.  Each histogram is KHISTOGRAM_BUCKETS int64_t counts.  The
+// kernel updates the arena in place.
+#define KHISTOGRAM_DESC_VMO_NAME    "histograms/desc"
+#define KHISTOGRAM_ARENA_VMO_NAME   "histograms/arena"
+
+#define KHISTOGRAM_DESC_MAGIC       0x74736968636b6564ULL // "dekchist"
+
+#define KHISTOGRAM_MAX_NAME         56
+
+// Values are durations in nanoseconds.  Bucket 0 counts values below
+// 2^KHISTOGRAM_MIN_SHIFT, and the last bucket values of 2^KHISTOGRAM_MAX_SHIFT
+// and above.  In between, each power of two is split into two buckets, so a
+// bucket's bounds are within a factor of 1.5 of each other.
+#define KHISTOGRAM_MIN_SHIFT        7   // 128ns
+#define KHISTOGRAM_MAX_SHIFT        30  // ~1.07s
+#define KHISTOGRAM_BUCKETS          (2 + 2 * (KHISTOGRAM_MAX_SHIFT - KHISTOGRAM_MIN_SHIFT))
+
+typedef struct khistogram_desc_entry {
+    char name[KHISTOGRAM_MAX_NAME]; // NUL-terminated
+    uint32_t count;
+    uint32_t first;
+} khistogram_desc_entry_t;
+
+typedef struct khistogram_desc_header {
+    uint64_t magic;                 // KHISTOGRAM_DESC_MAGIC
+    uint32_t num_cpus;
+    uint32_t num_buckets;           // KHISTOGRAM_BUCKETS
+    uint32_t num_families;
+    uint32_t num_histograms;
+    khistogram_desc_entry_t descriptors[];
+} khistogram_desc_header_t;
+
+// Returns the bucket that counts |ns|.
+static inline uint32_t khistogram_bucket(uint64_t ns) {
+    if (ns < (1ull << KHISTOGRAM_MIN_SHIFT)) {
+        return 0;
+    }
+    uint32_t shift = 63 - __builtin_clzll(ns);
+    if (shift >= KHISTOGRAM_MAX_SHIFT) {
+        return KHISTOGRAM_BUCKETS - 1;
+    }
+    return 1 + 2 * (shift - KHISTOGRAM_MIN_SHIFT) + ((ns >> (shift - 1)) & 1);
+}
+
+// Returns the smallest value counted by |bucket|.
+static inline uint64_t khistogram_bucket_min(uint32_t bucket) {
+    if (bucket == 0) {
+        return 0;
+    }
+    if (bucket >= KHISTOGRAM_BUCKETS - 1) {
+        return 1ull << KHISTOGRAM_MAX_SHIFT;
+    }
+    uint32_t shift = KHISTOGRAM_MIN_SHIFT + (bucket - 1) / 2;
+    return (1ull << shift) + ((bucket - 1) % 2) * (1ull << (shift - 1));
+}
+
+__END_CDECLS
@@ -88,5 +88,11 @@ enum {
 #define KTRACE_ACTION_STOP      2 // options ignored
 #define KTRACE_ACTION_REWIND    3 // options ignored
 #define KTRACE_ACTION_NEW_PROBE 4 // options ignored, ptr = name
+#define KTRACE_ACTION_SET_MODE  5 // options = KTRACE_MODE_*, only while stopped
+
+// Modes for KTRACE_ACTION_SET_MODE
+#define KTRACE_MODE_ONESHOT     0 // drop a cpu's records once its buffer is full
+#define KTRACE_MODE_CIRCULAR    1 // overwrite a cpu's oldest records
+#define KTRACE_MODE_STREAMING   2 // reads drain the buffer while tracing runs
 
 __END_CDECLS
@@ -1352,6 +1352,40 @@ static bool CreateUmountRemountSmall(BlobfsTest* blobfsTest) {
     END_HELPER;
 }
 
+// Reads a blob back in scattered pieces after a remount, so that its blocks are
+// loaded from disk (and verified) out of order rather than all at once.
+static bool ReadOutOfOrder(BlobfsTest* blobfsTest) {
+    BEGIN_HELPER;
+    fbl::unique_ptr<blob_info_t> info;
+    ASSERT_TRUE(GenerateRandomBlob(1 << 20, &info));
+
+    fbl::unique_fd fd;
+    ASSERT_TRUE(MakeBlob(info.get(), &fd));
+    ASSERT_EQ(close(fd.release()), 0);
+    ASSERT_TRUE(blobfsTest->Remount(), "Could not re-mount blobfs");
+
+    fd.reset(open(info->path, O_RDONLY));
+    ASSERT_TRUE(fd, "Failed to open blob");
+
+    // Unaligned reads which straddle block boundaries, walking backwards from the end
+    // of the blob, and then every other block again from the start.
+    constexpr size_t kReadSize = 3000;
+    char buffer[kReadSize];
+    for (size_t off = info->size_data - kReadSize; off >= 5 * kReadSize; off -= 5 * kReadSize) {
+        ASSERT_EQ(pread(fd.get(), buffer, kReadSize, off), static_cast<ssize_t>(kReadSize));
+        ASSERT_EQ(memcmp(buffer, &info->data[off], kReadSize), 0);
+    }
+    for (size_t off = 0; off + kReadSize <= info->size_data; off += 2 * 8192) {
+        ASSERT_EQ(pread(fd.get(), buffer, kReadSize, off), static_cast<ssize_t>(kReadSize));
+        ASSERT_EQ(memcmp(buffer, &info->data[off], kReadSize), 0);
+    }
+    ASSERT_TRUE(VerifyContents(fd.get(), info->data.get(), info->size_data));
+
+    ASSERT_EQ(close(fd.release()), 0, "Could not close blob");
+    ASSERT_EQ(unlink(info->path), 0);
+    END_HELPER;
+}
+
 static bool check_not_readable(int fd) {
     BEGIN_HELPER;
     struct pollfd fds;
@@ -2739,6 +2773,7 @@ RUN_TESTS(MEDIUM, UmountWithOpenFile)
 RUN_TESTS(MEDIUM, UmountWithMappedFile)
 RUN_TESTS(MEDIUM, UmountWithOpenMappedFile)
 RUN_TESTS(MEDIUM, CreateUmountRemountSmall)
+RUN_TESTS(MEDIUM, ReadOutOfOrder)
 RUN_TESTS(MEDIUM, EarlyRead)
 RUN_TESTS(MEDIUM, WaitForRead)
 RUN_TESTS(MEDIUM, WriteSeekIgnored)
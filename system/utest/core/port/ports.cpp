@@ -2,9 +2,11 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <limits.h>
 #include <stdio.h>
 #include <threads.h>
 
+#include <zircon/process.h>
 #include <zircon/syscalls.h>
 #include <zircon/syscalls/port.h>
 #include <fbl/algorithm.h>
@@ -49,6 +51,115 @@ static bool basic_test(void) {
     END_TEST;
 }
 
+static bool wait_many_test(void) {
+    BEGIN_TEST;
+    zx_status_t status;
+
+    zx_handle_t port;
+    status = zx_port_create(0, &port);
+    EXPECT_EQ(status, 0, "could not create port");
+
+    zx_port_packet_t out[40] = {};
+    size_t actual = 0u;
+
+    status = zx_port_wait_many(port, 0u, out, 0u, &actual);
+    EXPECT_EQ(status, ZX_ERR_INVALID_ARGS);
+
+    status = zx_port_wait_many(port, 0u, out, fbl::count_of(out), &actual);
+    EXPECT_EQ(status, ZX_ERR_TIMED_OUT);
+
+    // More packets than the kernel copies out at a time, but fewer than asked for.
+    for (uint64_t i = 0u; i < 37u; ++i) {
+        zx_port_packet_t in = {i, ZX_PKT_TYPE_USER, ZX_OK, { {} }};
+        status = zx_port_queue(port, &in);
+        EXPECT_EQ(status, ZX_OK);
+    }
+
+    // Only the first few are read if that is all there is room for.
+    status = zx_port_wait_many(port, ZX_TIME_INFINITE, out, 3u, &actual);
+    EXPECT_EQ(status, ZX_OK);
+    EXPECT_EQ(actual, 3u);
+    for (uint64_t i = 0u; i < 3u; ++i) {
+        EXPECT_EQ(out[i].key, i);
+        EXPECT_EQ(out[i].type, ZX_PKT_TYPE_USER);
+    }
+
+    // The rest come back in order in one call.
+    status = zx_port_wait_many(port, ZX_TIME_INFINITE, out, fbl::count_of(out), &actual);
+    EXPECT_EQ(status, ZX_OK);
+    EXPECT_EQ(actual, 34u);
+    for (uint64_t i = 0u; i < 34u; ++i) {
+        EXPECT_EQ(out[i].key, i + 3u);
+    }
+
+    status = zx_port_wait_many(port, 0u, out, fbl::count_of(out), &actual);
+    EXPECT_EQ(status, ZX_ERR_TIMED_OUT);
+
+    status = zx_handle_close(port);
+    EXPECT_EQ(status, ZX_OK);
+
+    END_TEST;
+}
+
+// Packets that can't be copied out to the caller stay queued on the port.
+static bool wait_many_fault_test(void) {
+    BEGIN_TEST;
+    zx_status_t status;
+
+    zx_handle_t port;
+    status = zx_port_create(0, &port);
+    ASSERT_EQ(status, ZX_OK, "could not create port");
+
+    for (uint64_t i = 0u; i < 20u; ++i) {
+        zx_port_packet_t in = {i, ZX_PKT_TYPE_USER, ZX_OK, { {} }};
+        status = zx_port_queue(port, &in);
+        EXPECT_EQ(status, ZX_OK);
+    }
+
+    // Make a buffer with room for only the first 16 packets before an unmapped page.
+    zx_handle_t vmo;
+    ASSERT_EQ(zx_vmo_create(2 * PAGE_SIZE, 0, &vmo), ZX_OK);
+    uintptr_t addr;
+    ASSERT_EQ(zx_vmar_map(zx_vmar_root_self(), ZX_VM_PERM_READ | ZX_VM_PERM_WRITE, 0, vmo, 0,
+                          2 * PAGE_SIZE, &addr),
+              ZX_OK);
+    ASSERT_EQ(zx_vmar_unmap(zx_vmar_root_self(), addr + PAGE_SIZE, PAGE_SIZE), ZX_OK);
+    zx_port_packet_t* short_out =
+        reinterpret_cast<zx_port_packet_t*>(addr + PAGE_SIZE) - 16;
+    void* unmapped = reinterpret_cast<void*>(addr + PAGE_SIZE);
+
+    // Nothing is taken if there is nowhere to put the packets or their count.
+    zx_port_packet_t out[20] = {};
+    size_t actual = 0u;
+    status = zx_port_wait_many(port, 0u, static_cast<zx_port_packet_t*>(unmapped),
+                               fbl::count_of(out), &actual);
+    EXPECT_NE(status, ZX_OK);
+    status = zx_port_wait_many(port, 0u, out, fbl::count_of(out),
+                               static_cast<size_t*>(unmapped));
+    EXPECT_NE(status, ZX_OK);
+
+    // The packets that fit are delivered, the rest stay queued.
+    status = zx_port_wait_many(port, 0u, short_out, fbl::count_of(out), &actual);
+    EXPECT_EQ(status, ZX_OK);
+    EXPECT_EQ(actual, 16u);
+    for (uint64_t i = 0u; i < 16u; ++i) {
+        EXPECT_EQ(short_out[i].key, i);
+    }
+
+    status = zx_port_wait_many(port, 0u, out, fbl::count_of(out), &actual);
+    EXPECT_EQ(status, ZX_OK);
+    EXPECT_EQ(actual, 4u);
+    for (uint64_t i = 0u; i < 4u; ++i) {
+        EXPECT_EQ(out[i].key, i + 16u);
+    }
+
+    EXPECT_EQ(zx_vmar_unmap(zx_vmar_root_self(), addr, PAGE_SIZE), ZX_OK);
+    EXPECT_EQ(zx_handle_close(vmo), ZX_OK);
+    EXPECT_EQ(zx_handle_close(port), ZX_OK);
+
+    END_TEST;
+}
+
 static bool queue_and_close_test(void) {
     BEGIN_TEST;
     zx_status_t status;
@@ -679,6 +790,8 @@ static bool cancel_stress() {
 
 BEGIN_TEST_CASE(port_tests)
 RUN_TEST(basic_test)
+RUN_TEST(wait_many_test)
+RUN_TEST(wait_many_fault_test)
 RUN_TEST(queue_and_close_test)
 RUN_TEST(queue_too_many)
 RUN_TEST(async_wait_channel_test)
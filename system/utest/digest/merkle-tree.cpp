@@ -7,6 +7,8 @@
 #include <stdlib.h>
 
 #include <digest/digest.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/unique_ptr.h>
 #include <zircon/assert.h>
 #include <zircon/status.h>
 #include <unittest/unittest.h>
@@ -406,6 +408,57 @@ bool CreateTreeTooSmall(void) {
     END_TEST;
 }
 
+// Used by CreateParallelAll below.  Checks that CreateParallel builds the
+// same tree and root as CreateInit, CreateUpdate and CreateFinal do for
+// |data_len| bytes of |data|, using each of several thread counts.
+bool CreateParallel(const uint8_t* data, size_t data_len) {
+    zx_status_t rc;
+    size_t tree_len = MerkleTree::GetTreeLength(data_len);
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> expected_tree(new (&ac) uint8_t[tree_len]);
+    ASSERT_TRUE(ac.check());
+    fbl::unique_ptr<uint8_t[]> actual_tree(new (&ac) uint8_t[tree_len]);
+    ASSERT_TRUE(ac.check());
+    MerkleTree merkleTree;
+    Digest expected;
+    ASSERT_OK(merkleTree.CreateInit(data_len, tree_len));
+    ASSERT_OK(merkleTree.CreateUpdate(data, data_len, expected_tree.get()));
+    ASSERT_OK(merkleTree.CreateFinal(expected_tree.get(), &expected));
+    const size_t kThreads[] = {1, 2, 5, 32, 0};
+    for (size_t num_threads : kThreads) {
+        memset(actual_tree.get(), 0xff, tree_len);
+        Digest actual;
+        ASSERT_OK(MerkleTree::CreateParallel(data, data_len, actual_tree.get(), tree_len,
+                                             &actual, num_threads));
+        ASSERT_TRUE(actual == expected, "Incorrect root digest");
+        ASSERT_BYTES_EQ(expected_tree.get(), actual_tree.get(), tree_len, "Incorrect tree");
+    }
+    return true;
+}
+
+bool CreateParallelAll(void) {
+    BEGIN_TEST;
+    // Three levels, with enough leaves for every thread to get a share.
+    const size_t kHuge = (kNodeSize * 256 * 9) + 17;
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[kHuge]);
+    ASSERT_TRUE(ac.check());
+    for (size_t i = 0; i < kHuge; ++i) {
+        data[i] = static_cast<uint8_t>(rand());
+    }
+    const size_t kLengths[] = {
+        0, 1, kNodeSize, kNodeSize + 1, kSmall, kLarge, kUnalignedLarge,
+        MerkleTree::kMinBytesPerThread * 3, kHuge,
+    };
+    for (size_t data_len : kLengths) {
+        if (!CreateParallel(data.get(), data_len)) {
+            unittest_printf_critical("CreateParallelAll failed with data length of %zu\n",
+                                     data_len);
+        }
+    }
+    END_TEST;
+}
+
 // Used by VerifyAll below.
 bool Verify(size_t data_len) {
     zx_status_t rc;
@@ -722,6 +775,7 @@ RUN_TEST(CreateByteByByte)
 RUN_TEST(CreateMissingData)
 RUN_TEST(CreateMissingTree)
 RUN_TEST(CreateTreeTooSmall)
+RUN_TEST(CreateParallelAll)
 RUN_TEST(VerifyAll)
 RUN_TEST(VerifyCAll)
 RUN_TEST(VerifyNodeByNode)
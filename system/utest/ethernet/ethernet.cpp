@@ -61,7 +61,7 @@ const char* mxstrerror(zx_status_t status) {
 }
 
 zx_status_t CreateEthertapWithOption(uint32_t mtu, const char* name, zx::socket* sock,
-                                     uint32_t options) {
+                                     uint32_t options, uint32_t features = 0) {
     if (sock == nullptr) {
         return ZX_ERR_INVALID_ARGS;
     }
@@ -75,6 +75,7 @@ zx_status_t CreateEthertapWithOption(uint32_t mtu, const char* name, zx::socket*
     ethertap_ioctl_config_t config = {};
     strlcpy(config.name, name, ETHERTAP_MAX_NAME_LEN);
     config.options = options;
+    config.features = features;
     // Uncomment this to trace ETHERTAP events
     //config.options |= ETHERTAP_OPT_TRACE;
     config.mtu = mtu;
@@ -164,6 +165,8 @@ struct EthernetOpenInfo {
     const char* name;
     bool online = true;
     uint32_t options = 0;
+    // ETHMAC_FEATURE_* flags for the ethertap device to advertise.
+    uint32_t features = 0;
 };
 
 class EthernetClient {
@@ -479,7 +482,8 @@ static bool OpenFirstClientHelper(zx::socket* sock,
                                EthernetClient* client,
                                const EthernetOpenInfo& openInfo) {
     // Create the ethertap device
-    ASSERT_EQ(ZX_OK, CreateEthertapWithOption(1500, openInfo.name, sock, openInfo.options));
+    ASSERT_EQ(ZX_OK, CreateEthertapWithOption(1500, openInfo.name, sock, openInfo.options,
+                                              openInfo.features));
 
     if (openInfo.online) {
         // Set the link status to online
@@ -909,6 +913,155 @@ static bool EthernetDataTest_Recv() {
     END_TEST;
 }
 
+// Writes |count| frames of |len| bytes through the ethertap socket. Frame |n| holds bytes counting
+// up from |n|, so that ExpectFramesHelper can tell them apart.
+static bool SendFramesHelper(zx::socket* sock, size_t count, size_t len) {
+    uint8_t buf[256];
+    ASSERT_LE(len, sizeof(buf));
+    for (size_t n = 0; n < count; n++) {
+        for (size_t i = 0; i < len; i++) {
+            buf[i] = static_cast<uint8_t>((n + i) & 0xff);
+        }
+        size_t actual = 0;
+        ASSERT_EQ(ZX_OK, sock->write(0, static_cast<void*>(buf), len, &actual));
+        ASSERT_EQ(len, actual);
+    }
+    return true;
+}
+
+// Reads the |count| frames written by SendFramesHelper from the RX fifo of |client|, checks that
+// they arrived in order and intact, and returns their buffers to the driver as |buf_len| bytes
+// long.
+static bool ExpectFramesHelper(EthernetClient* client, size_t count, size_t len,
+                               uint32_t buf_len = 2048) {
+    BEGIN_HELPER;
+    fbl::unique_ptr<fuchsia_hardware_ethernet_FifoEntry[]> entries(
+        new fuchsia_hardware_ethernet_FifoEntry[count]);
+    size_t received = 0;
+    while (received < count) {
+        zx_signals_t obs;
+        ASSERT_EQ(ZX_OK, client->rx_fifo()->wait_one(ZX_FIFO_READABLE, FAIL_TIMEOUT, &obs));
+        size_t actual = 0;
+        ASSERT_EQ(ZX_OK, client->rx_fifo()->read(&entries[received], count - received, &actual));
+        received += actual;
+    }
+
+    uint8_t expected[256];
+    ASSERT_LE(len, sizeof(expected));
+    for (size_t n = 0; n < count; n++) {
+        for (size_t i = 0; i < len; i++) {
+            expected[i] = static_cast<uint8_t>((n + i) & 0xff);
+        }
+        ASSERT_EQ(len, entries[n].length);
+        EXPECT_TRUE(entries[n].flags & fuchsia_hardware_ethernet_FIFO_RX_OK);
+        EXPECT_BYTES_EQ(expected, client->GetRxBuffer(entries[n].offset), len, "");
+        entries[n].length = buf_len;
+    }
+
+    size_t actual = 0;
+    ASSERT_EQ(ZX_OK, client->rx_fifo()->write(entries.get(), count, &actual));
+    ASSERT_EQ(count, actual);
+    END_HELPER;
+}
+
+// Returns whether ethertap has received any frame into a client buffer since the last call.
+static bool TookZeroCopy(zx::socket* sock) {
+    zx_signals_t obs = 0;
+    sock->wait_one(ETHERTAP_SIGNAL_RX_NETBUF, zx::time(), &obs);
+    sock->signal(ETHERTAP_SIGNAL_RX_NETBUF, 0);
+    return (obs & ETHERTAP_SIGNAL_RX_NETBUF) != 0;
+}
+
+// Sends a full batch of frames and then a partial one, which the driver holds back until its
+// flush delay expires.
+static bool RecvBatchHelper(uint32_t features) {
+    BEGIN_HELPER;
+    zx::socket sock;
+    EthernetClient client;
+    EthernetOpenInfo info("RecvBatch");
+    info.features = features;
+    ASSERT_TRUE(OpenFirstClientHelper(&sock, &client, info));
+
+    ASSERT_TRUE(SendFramesHelper(&sock, 32, 64));
+    ASSERT_TRUE(ExpectFramesHelper(&client, 32, 64));
+    ASSERT_TRUE(SendFramesHelper(&sock, 5, 128));
+    ASSERT_TRUE(ExpectFramesHelper(&client, 5, 128));
+    EXPECT_EQ((features & ETHMAC_FEATURE_RX_NETBUF) != 0, TookZeroCopy(&sock));
+
+    ASSERT_TRUE(EthernetCleanupHelper(&sock, &client));
+    END_HELPER;
+}
+
+static bool EthernetDataTest_RecvBatch() {
+    BEGIN_TEST;
+    ASSERT_TRUE(RecvBatchHelper(0));
+    END_TEST;
+}
+
+static bool EthernetDataTest_RecvBatchZeroCopy() {
+    BEGIN_TEST;
+    ASSERT_TRUE(RecvBatchHelper(ETHMAC_FEATURE_RX_NETBUF));
+    END_TEST;
+}
+
+static bool EthernetDataTest_RecvZeroCopyMultiClient() {
+    BEGIN_TEST;
+    zx::socket sock;
+    EthernetClient clientA;
+    EthernetOpenInfo info("MultiClientA");
+    info.features = ETHMAC_FEATURE_RX_NETBUF;
+    ASSERT_TRUE(OpenFirstClientHelper(&sock, &clientA, info));
+
+    EthernetClient clientB;
+    info.name = "MultiClientB";
+    ASSERT_TRUE(AddClientHelper(&sock, &clientB, info));
+
+    // The first client receives into its own buffers; the second gets a copy of every frame.
+    ASSERT_TRUE(SendFramesHelper(&sock, 16, 64));
+    ASSERT_TRUE(ExpectFramesHelper(&clientA, 16, 64));
+    ASSERT_TRUE(ExpectFramesHelper(&clientB, 16, 64));
+    EXPECT_TRUE(TookZeroCopy(&sock));
+
+    // Once the first client stops, the second still receives every frame.
+    ASSERT_EQ(ZX_OK, clientA.Stop());
+    ASSERT_TRUE(SendFramesHelper(&sock, 16, 64));
+    ASSERT_TRUE(ExpectFramesHelper(&clientB, 16, 64));
+
+    ASSERT_TRUE(EthernetCleanupHelper(&sock, &clientB));
+    END_TEST;
+}
+
+static bool EthernetDataTest_RecvZeroCopyResume() {
+    BEGIN_TEST;
+    zx::socket sock;
+    EthernetClient client;
+    EthernetOpenInfo info("ZeroCopyResume");
+    info.features = ETHMAC_FEATURE_RX_NETBUF;
+    ASSERT_TRUE(OpenFirstClientHelper(&sock, &client, info));
+
+    // Ethertap turns down buffers shorter than its mtu, so the driver keeps all of these back for
+    // copies and is left with no buffer queued.
+    ASSERT_TRUE(SendFramesHelper(&sock, 32, 64));
+    ASSERT_TRUE(ExpectFramesHelper(&client, 32, 64, 1000));
+    EXPECT_TRUE(TookZeroCopy(&sock));
+    ASSERT_TRUE(SendFramesHelper(&sock, 32, 64));
+    ASSERT_TRUE(ExpectFramesHelper(&client, 32, 64));
+    EXPECT_FALSE(TookZeroCopy(&sock));
+
+    // Once full-sized buffers come back, frames go straight into them again. The first frames
+    // after a batch is returned may still be copied if they beat the driver to the buffers.
+    bool resumed = false;
+    for (int round = 0; round < 10 && !resumed; round++) {
+        ASSERT_TRUE(SendFramesHelper(&sock, 32, 64));
+        ASSERT_TRUE(ExpectFramesHelper(&client, 32, 64));
+        resumed = TookZeroCopy(&sock);
+    }
+    EXPECT_TRUE(resumed, "zero-copy receive did not resume");
+
+    ASSERT_TRUE(EthernetCleanupHelper(&sock, &client));
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(EthernetSetupTests)
 RUN_TEST_MEDIUM(EthernetStartTest)
 RUN_TEST_MEDIUM(EthernetLinkStatusTest)
@@ -928,6 +1081,10 @@ END_TEST_CASE(EthernetConfigTests)
 BEGIN_TEST_CASE(EthernetDataTests)
 RUN_TEST_MEDIUM(EthernetDataTest_Send)
 RUN_TEST_MEDIUM(EthernetDataTest_Recv)
+RUN_TEST_MEDIUM(EthernetDataTest_RecvBatch)
+RUN_TEST_MEDIUM(EthernetDataTest_RecvBatchZeroCopy)
+RUN_TEST_MEDIUM(EthernetDataTest_RecvZeroCopyMultiClient)
+RUN_TEST_MEDIUM(EthernetDataTest_RecvZeroCopyResume)
 END_TEST_CASE(EthernetDataTests)
 
 int main(int argc, char* argv[]) {
@@ -6,12 +6,14 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include <fbl/function.h>
 #include <fbl/string.h>
 #include <fbl/string_buffer.h>
 #include <fbl/string_printf.h>
 #include <fbl/unique_fd.h>
+#include <fbl/unique_ptr.h>
 #include <fs-management/mount.h>
 #include <fs-test-utils/fixture.h>
 #include <fs-test-utils/perftest.h>
@@ -158,6 +160,142 @@ private:
     fbl::StringBuffer<fs_test_utils::kPathSize> path_;
 };
 
+// Wrapper so state can be shared across calls. Populates a single directory with one entry per
+// sample. The entries are hard links to a single file, so that the directory is measured rather
+// than inode allocation, and so that the largest directories fit in the inode table of a plain
+// ramdisk.
+class LargeDirOp {
+public:
+    LargeDirOp() = default;
+    LargeDirOp(const LargeDirOp&) = delete;
+    LargeDirOp(LargeDirOp&&) = delete;
+    LargeDirOp& operator=(const LargeDirOp&) = delete;
+    LargeDirOp& operator=(LargeDirOp&&) = delete;
+    ~LargeDirOp() = default;
+
+    // Will add entries until |state::KeepGoing| returns false.
+    bool Link(perftest::RepeatState* state, Fixture* fixture) {
+        BEGIN_HELPER;
+        ASSERT_EQ(mkdir(GetDirPath(*fixture).c_str(), 0666), 0);
+        fbl::unique_fd fd(open(GetTargetPath(*fixture).c_str(), O_CREAT | O_RDWR, 0644));
+        ASSERT_TRUE(fd);
+        count_ = 0;
+        while (state->KeepRunning()) {
+            ASSERT_EQ(link(GetTargetPath(*fixture).c_str(), GetEntryPath(*fixture, count_).c_str()),
+                      0);
+            count_++;
+        }
+        END_HELPER;
+    }
+
+    // Will stat entries until |state::KeepGoing| returns false. Expects as many samples as Link.
+    bool Stat(perftest::RepeatState* state, Fixture* fixture) {
+        BEGIN_HELPER;
+        uint32_t i = 0;
+        while (state->KeepRunning()) {
+            struct stat buff;
+            ASSERT_EQ(stat(GetEntryPath(*fixture, i++).c_str(), &buff), 0);
+        }
+        END_HELPER;
+    }
+
+    // Will unlink entries until |state::KeepGoing| returns false, and then remove the directory.
+    bool Unlink(perftest::RepeatState* state, Fixture* fixture) {
+        BEGIN_HELPER;
+        uint32_t i = 0;
+        while (state->KeepRunning()) {
+            ASSERT_EQ(unlink(GetEntryPath(*fixture, i++).c_str()), 0);
+        }
+        ASSERT_EQ(i, count_);
+        ASSERT_EQ(rmdir(GetDirPath(*fixture).c_str()), 0);
+        ASSERT_EQ(unlink(GetTargetPath(*fixture).c_str()), 0);
+        END_HELPER;
+    }
+
+private:
+    static fbl::String GetDirPath(const Fixture& fixture) {
+        return fbl::StringPrintf("%s/largedir", fixture.fs_path().c_str());
+    }
+
+    static fbl::String GetTargetPath(const Fixture& fixture) {
+        return fbl::StringPrintf("%s/target", fixture.fs_path().c_str());
+    }
+
+    static fbl::String GetEntryPath(const Fixture& fixture, uint32_t i) {
+        return fbl::StringPrintf("%s/largedir/entry-%u", fixture.fs_path().c_str(), i);
+    }
+
+    uint32_t count_ = 0;
+};
+
+// Populates the filesystem with many small files, and some large enough to need indirect blocks,
+// and then measures checking it. The checker reads metadata straight from the device, one block
+// at a time, so this exercises the minfs block cache and its readahead.
+class FsckOp {
+public:
+    explicit FsckOp(uint32_t file_count) : file_count_(file_count) {}
+    FsckOp(const FsckOp&) = delete;
+    FsckOp(FsckOp&&) = delete;
+    FsckOp& operator=(const FsckOp&) = delete;
+    FsckOp& operator=(FsckOp&&) = delete;
+    ~FsckOp() = default;
+
+    // Will unmount, check and remount the filesystem until |state::KeepGoing| returns false.
+    bool Fsck(perftest::RepeatState* state, Fixture* fixture) {
+        BEGIN_HELPER;
+        ASSERT_TRUE(Populate(fixture));
+        state->DeclareStep("unmount");
+        state->DeclareStep("fsck");
+        state->DeclareStep("mount");
+        while (state->KeepRunning()) {
+            ASSERT_EQ(fixture->Umount(), ZX_OK);
+            state->NextStep();
+            fsck_options_t options = default_fsck_options;
+            ASSERT_EQ(fsck(fixture->GetFsBlockDevice().c_str(), fixture->options().fs_type,
+                           &options, launch_stdio_sync),
+                      ZX_OK);
+            state->NextStep();
+            ASSERT_EQ(fixture->Mount(), ZX_OK);
+        }
+        END_HELPER;
+    }
+
+    // Estimation of the disk space used by |Populate|.
+    size_t RequiredDiskSpace() const {
+        return (file_count_ / kLargeFileInterval) * kLargeFileSize + file_count_ * kSmallFileSize;
+    }
+
+private:
+    static constexpr uint32_t kDirCount = 16;
+    static constexpr uint32_t kLargeFileInterval = 8;
+    static constexpr size_t kSmallFileSize = 8 * (1 << 10);
+    static constexpr size_t kLargeFileSize = 512 * (1 << 10);
+
+    bool Populate(Fixture* fixture) {
+        BEGIN_HELPER;
+        fbl::unique_ptr<uint8_t[]> data(new uint8_t[kLargeFileSize]);
+        memset(data.get(), 0xab, kLargeFileSize);
+        for (uint32_t i = 0; i < kDirCount; i++) {
+            ASSERT_EQ(mkdir(GetDirPath(*fixture, i).c_str(), 0666), 0);
+        }
+        for (uint32_t i = 0; i < file_count_; i++) {
+            fbl::String path = fbl::StringPrintf(
+                "%s/file-%u", GetDirPath(*fixture, i % kDirCount).c_str(), i);
+            fbl::unique_fd fd(open(path.c_str(), O_CREAT | O_WRONLY, 0644));
+            ASSERT_TRUE(fd);
+            ssize_t size = (i % kLargeFileInterval == 0) ? kLargeFileSize : kSmallFileSize;
+            ASSERT_EQ(write(fd.get(), data.get(), size), size);
+        }
+        END_HELPER;
+    }
+
+    static fbl::String GetDirPath(const Fixture& fixture, uint32_t i) {
+        return fbl::StringPrintf("%s/fsck-%u", fixture.fs_path().c_str(), i);
+    }
+
+    const uint32_t file_count_;
+};
+
 } // namespace
 
 bool RunBenchmark(int argc, char** argv) {
@@ -240,6 +378,63 @@ bool RunBenchmark(int argc, char** argv) {
         testcases.push_back(std::move(testcase));
     }
 
+    // Large directory tests.
+    const int large_dir_sample_counts[] = {
+        1000,
+        10000,
+        100000,
+    };
+
+    LargeDirOp ld_op;
+    for (int test_sample_count : large_dir_sample_counts) {
+        TestCaseInfo testcase;
+        testcase.name = fbl::StringPrintf("%s/LargeDirectory/%d-Entries",
+                                          disk_format_string_[f_opts.fs_type], test_sample_count);
+        testcase.sample_count = test_sample_count;
+        testcase.teardown = false;
+
+        TestInfo link_test;
+        link_test.name = fbl::StringPrintf("%s/Link", testcase.name.c_str());
+        link_test.test_fn = fbl::BindMember(&ld_op, &LargeDirOp::Link);
+        testcase.tests.push_back(std::move(link_test));
+
+        TestInfo stat_test;
+        stat_test.name = fbl::StringPrintf("%s/Stat", testcase.name.c_str());
+        stat_test.test_fn = fbl::BindMember(&ld_op, &LargeDirOp::Stat);
+        testcase.tests.push_back(std::move(stat_test));
+
+        TestInfo unlink_test;
+        unlink_test.name = fbl::StringPrintf("%s/Unlink", testcase.name.c_str());
+        unlink_test.test_fn = fbl::BindMember(&ld_op, &LargeDirOp::Unlink);
+        testcase.tests.push_back(std::move(unlink_test));
+        testcases.push_back(std::move(testcase));
+    }
+
+    // Fsck tests.
+    const uint32_t fsck_file_counts[] = {
+        1000,
+        4000,
+    };
+
+    fbl::Vector<fbl::unique_ptr<FsckOp>> fsck_ops;
+    for (uint32_t file_count : fsck_file_counts) {
+        fsck_ops.push_back(fbl::make_unique<FsckOp>(file_count));
+        FsckOp* op = fsck_ops[fsck_ops.size() - 1].get();
+
+        TestCaseInfo testcase;
+        testcase.name = fbl::StringPrintf("%s/Fsck/%u-Files",
+                                          disk_format_string_[f_opts.fs_type], file_count);
+        testcase.sample_count = 10;
+        testcase.teardown = false;
+
+        TestInfo fsck_test;
+        fsck_test.name = fbl::StringPrintf("%s/Fsck", testcase.name.c_str());
+        fsck_test.test_fn = fbl::BindMember(op, &FsckOp::Fsck);
+        fsck_test.required_disk_space = op->RequiredDiskSpace();
+        testcase.tests.push_back(std::move(fsck_test));
+        testcases.push_back(std::move(testcase));
+    }
+
     return fs_test_utils::RunTestCases(f_opts, p_opts, testcases);
 }
 } // namespace fs_bench
@@ -14,7 +14,9 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/main.cpp \
     $(LOCAL_DIR)/util.cpp \
     $(LOCAL_DIR)/test-basic.cpp \
+    $(LOCAL_DIR)/test-bcache.cpp \
     $(LOCAL_DIR)/test-directory.cpp \
+    $(LOCAL_DIR)/test-journal.cpp \
     $(LOCAL_DIR)/test-maxfile.cpp \
     $(LOCAL_DIR)/test-rw-workers.cpp \
     $(LOCAL_DIR)/test-sparse.cpp \
@@ -37,6 +39,7 @@ MODULE_COMPILEFLAGS := \
     -Isystem/ulib/fdio/include \
     -Isystem/ulib/zircon-internal/include \
     -Isystem/ulib/zircon/include \
+    -Ithird_party/ulib/cksum/include \
 
 MODULE_HOST_LIBS := \
     system/ulib/unittest.hostlib \
@@ -44,5 +47,6 @@ MODULE_HOST_LIBS := \
     system/ulib/minfs.hostlib \
     system/ulib/fbl.hostlib \
     system/ulib/fs.hostlib \
+    third_party/ulib/cksum.hostlib \
 
 include make/module.mk
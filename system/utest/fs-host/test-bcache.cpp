@@ -0,0 +1,122 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fbl/unique_fd.h>
+#include <fbl/unique_ptr.h>
+#include <minfs/bcache.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+constexpr uint32_t kBlockCount = 512;
+
+// Creates an unlinked image of |kBlockCount| blocks, each filled with the low
+// byte of its block number, and a Bcache on top of it.
+bool CreateBcache(fbl::unique_ptr<minfs::Bcache>* out) {
+    BEGIN_HELPER;
+    char path[] = "/tmp/bcache-test.XXXXXX";
+    fbl::unique_fd fd(mkstemp(path));
+    ASSERT_TRUE(fd);
+    ASSERT_EQ(unlink(path), 0);
+
+    uint8_t block[minfs::kMinfsBlockSize];
+    for (uint32_t bno = 0; bno < kBlockCount; bno++) {
+        memset(block, bno & 0xff, sizeof(block));
+        ASSERT_EQ(write(fd.get(), block, sizeof(block)), static_cast<ssize_t>(sizeof(block)));
+    }
+
+    ASSERT_EQ(minfs::Bcache::Create(out, std::move(fd), kBlockCount), ZX_OK);
+    END_HELPER;
+}
+
+bool ReadBlocks(minfs::Bcache* bc, uint32_t start, uint32_t count) {
+    BEGIN_HELPER;
+    uint8_t block[minfs::kMinfsBlockSize];
+    for (uint32_t bno = start; bno < start + count; bno++) {
+        ASSERT_EQ(bc->Readblk(bno, block), ZX_OK);
+        ASSERT_EQ(block[0], bno & 0xff);
+        ASSERT_EQ(block[minfs::kMinfsBlockSize - 1], bno & 0xff);
+    }
+    END_HELPER;
+}
+
+// A sequential scan fills the cache up to its limit, and a second pass over
+// the cached part of it hits.
+bool TestBcacheFill(void) {
+    BEGIN_TEST;
+    fbl::unique_ptr<minfs::Bcache> bc;
+    ASSERT_TRUE(CreateBcache(&bc));
+
+    ASSERT_TRUE(ReadBlocks(bc.get(), 0, kBlockCount));
+    minfs::Bcache::CacheStats stats;
+    bc->GetCacheStats(&stats);
+    EXPECT_EQ(stats.blocks, minfs::kBcacheBlocks);
+    EXPECT_GT(stats.readahead_blocks, 0);
+    EXPECT_LT(stats.misses, kBlockCount);
+
+    const uint64_t misses = stats.misses;
+    ASSERT_TRUE(ReadBlocks(bc.get(), kBlockCount - 16, 16));
+    bc->GetCacheStats(&stats);
+    EXPECT_EQ(stats.misses, misses);
+    END_TEST;
+}
+
+// ShrinkCache and SetCacheLimit give back cached blocks, the limit holds as
+// the cache refills, and reads keep returning the right data throughout.
+bool TestBcacheShrink(void) {
+    BEGIN_TEST;
+    fbl::unique_ptr<minfs::Bcache> bc;
+    ASSERT_TRUE(CreateBcache(&bc));
+    ASSERT_TRUE(ReadBlocks(bc.get(), 0, kBlockCount));
+
+    minfs::Bcache::CacheStats stats;
+    bc->ShrinkCache(16);
+    bc->GetCacheStats(&stats);
+    EXPECT_EQ(stats.blocks, 16);
+    const uint64_t evictions = stats.evictions;
+
+    // The most recently read blocks are the ones kept.
+    ASSERT_TRUE(ReadBlocks(bc.get(), kBlockCount - 16, 16));
+    bc->GetCacheStats(&stats);
+    EXPECT_EQ(stats.evictions, evictions);
+
+    bc->ShrinkCache(0);
+    bc->GetCacheStats(&stats);
+    EXPECT_EQ(stats.blocks, 0);
+
+    bc->SetCacheLimit(minfs::kBcacheMountedBlocks);
+    ASSERT_TRUE(ReadBlocks(bc.get(), 0, kBlockCount));
+    bc->GetCacheStats(&stats);
+    EXPECT_EQ(stats.blocks, minfs::kBcacheMountedBlocks);
+
+    // A limit of zero disables the cache.
+    bc->SetCacheLimit(0);
+    bc->GetCacheStats(&stats);
+    EXPECT_EQ(stats.blocks, 0);
+    const uint64_t misses = stats.misses;
+    ASSERT_TRUE(ReadBlocks(bc.get(), 0, 8));
+    ASSERT_TRUE(ReadBlocks(bc.get(), 0, 8));
+    bc->GetCacheStats(&stats);
+    EXPECT_EQ(stats.blocks, 0);
+    EXPECT_EQ(stats.misses, misses + 16);
+
+    // Limits above the default are capped.
+    bc->SetCacheLimit(minfs::kBcacheBlocks * 2);
+    ASSERT_TRUE(ReadBlocks(bc.get(), 0, kBlockCount));
+    bc->GetCacheStats(&stats);
+    EXPECT_EQ(stats.blocks, minfs::kBcacheBlocks);
+    END_TEST;
+}
+
+} // namespace
+
+BEGIN_TEST_CASE(bcache_tests)
+RUN_TEST(TestBcacheFill)
+RUN_TEST(TestBcacheShrink)
+END_TEST_CASE(bcache_tests)
@@ -0,0 +1,193 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fbl/unique_fd.h>
+#include <fbl/unique_ptr.h>
+#include <lib/cksum.h>
+#include <minfs/bcache.h>
+#include <minfs/journal.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+constexpr uint32_t kBlockCount = 128;
+constexpr uint32_t kJournalStart = 64;
+constexpr uint32_t kJournalEnd = 96;
+
+// Blocks targeted by the entries written by CreateImage.
+constexpr uint32_t kSingleTarget = 10;
+constexpr uint32_t kChainTargets[] = {11, 12};
+constexpr uint32_t kIncompleteTarget = 13;
+
+bool WriteBlock(int fd, uint32_t bno, const void* data) {
+    BEGIN_HELPER;
+    ASSERT_EQ(pwrite(fd, data, minfs::kMinfsBlockSize,
+                     static_cast<off_t>(bno) * minfs::kMinfsBlockSize),
+              static_cast<ssize_t>(minfs::kMinfsBlockSize));
+    END_HELPER;
+}
+
+// Returns the first byte of block |bno| as the device holds it.
+uint8_t DeviceByte(int fd, uint32_t bno) {
+    uint8_t block[minfs::kMinfsBlockSize];
+    if (pread(fd, block, sizeof(block), static_cast<off_t>(bno) * minfs::kMinfsBlockSize) !=
+        static_cast<ssize_t>(sizeof(block))) {
+        return 0xff;
+    }
+    return block[0];
+}
+
+uint8_t CacheByte(minfs::Bcache* bc, uint32_t bno) {
+    uint8_t block[minfs::kMinfsBlockSize];
+    if (bc->Readblk(bno, block) != ZX_OK) {
+        return 0xff;
+    }
+    return block[0];
+}
+
+// Writes an entry of one block, filled with |fill| and targeting |target|, at
+// entry block |index|.
+bool WriteEntry(int fd, uint32_t index, uint64_t sequence, uint32_t target, uint8_t fill,
+                bool continued) {
+    BEGIN_HELPER;
+    minfs::HeaderBlock header;
+    memset(&header, 0, sizeof(header));
+    header.magic = minfs::kJournalEntryHeaderMagic;
+    header.sequence = sequence;
+    header.num_blocks = 1;
+    header.flags = continued ? minfs::kJournalEntryFlagContinued : 0;
+    header.target_blocks[0] = target;
+
+    uint8_t data[minfs::kMinfsBlockSize];
+    memset(data, fill, sizeof(data));
+
+    uint8_t commit_data[minfs::kMinfsBlockSize];
+    memset(commit_data, 0, sizeof(commit_data));
+    minfs::CommitBlock commit;
+    memset(&commit, 0, sizeof(commit));
+    commit.magic = minfs::kJournalEntryCommitMagic;
+    commit.sequence = sequence;
+    commit.checksum = crc32(0, reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+    commit.checksum = crc32(commit.checksum, data, sizeof(data));
+    memcpy(commit_data, &commit, sizeof(commit));
+
+    const uint32_t bno = kJournalStart + 1 + index;
+    ASSERT_TRUE(WriteBlock(fd, bno, &header));
+    ASSERT_TRUE(WriteBlock(fd, bno + 1, data));
+    ASSERT_TRUE(WriteBlock(fd, bno + 2, commit_data));
+    END_HELPER;
+}
+
+// Creates an unlinked, zeroed image whose journal holds an entry of its own,
+// then a complete chain of two entries, then the first entry of a chain whose
+// end is missing. Sets |*out_fd| to a second descriptor for the image, for
+// looking at the device behind the Bcache.
+bool CreateImage(fbl::unique_ptr<minfs::Bcache>* out, fbl::unique_fd* out_fd,
+                 minfs::Superblock* out_info) {
+    BEGIN_HELPER;
+    char path[] = "/tmp/journal-test.XXXXXX";
+    fbl::unique_fd fd(mkstemp(path));
+    ASSERT_TRUE(fd);
+    ASSERT_EQ(unlink(path), 0);
+    ASSERT_EQ(ftruncate(fd.get(), kBlockCount * minfs::kMinfsBlockSize), 0);
+
+    uint8_t info_data[minfs::kMinfsBlockSize];
+    memset(info_data, 0, sizeof(info_data));
+    minfs::JournalInfo journal_info;
+    memset(&journal_info, 0, sizeof(journal_info));
+    journal_info.magic = minfs::kJournalMagic;
+    memcpy(info_data, &journal_info, sizeof(journal_info));
+    ASSERT_TRUE(WriteBlock(fd.get(), kJournalStart, info_data));
+
+    ASSERT_TRUE(WriteEntry(fd.get(), 0, 0, kSingleTarget, 0xa1, false));
+    ASSERT_TRUE(WriteEntry(fd.get(), 3, 1, kChainTargets[0], 0xb1, true));
+    ASSERT_TRUE(WriteEntry(fd.get(), 6, 2, kChainTargets[1], 0xb2, false));
+    ASSERT_TRUE(WriteEntry(fd.get(), 9, 3, kIncompleteTarget, 0xc1, true));
+
+    memset(out_info, 0, sizeof(*out_info));
+    out_info->journal_start_block = kJournalStart;
+    out_info->dat_block = kJournalEnd;
+
+    out_fd->reset(dup(fd.get()));
+    ASSERT_TRUE(*out_fd);
+    ASSERT_EQ(minfs::Bcache::Create(out, std::move(fd), kBlockCount), ZX_OK);
+    END_HELPER;
+}
+
+// Overlaying the journal shows the blocks of complete entries and chains to
+// reads, but writes nothing to the device.
+bool TestJournalOverlay(void) {
+    BEGIN_TEST;
+    fbl::unique_ptr<minfs::Bcache> bc;
+    fbl::unique_fd fd;
+    minfs::Superblock info;
+    ASSERT_TRUE(CreateImage(&bc, &fd, &info));
+
+    uint8_t before[minfs::kMinfsBlockSize];
+    ASSERT_EQ(pread(fd.get(), before, sizeof(before), kJournalStart * minfs::kMinfsBlockSize),
+              static_cast<ssize_t>(sizeof(before)));
+
+    size_t entries;
+    ASSERT_EQ(minfs::OverlayJournal(bc.get(), info, &entries), ZX_OK);
+    EXPECT_EQ(entries, 3);
+    EXPECT_EQ(CacheByte(bc.get(), kSingleTarget), 0xa1);
+    EXPECT_EQ(CacheByte(bc.get(), kChainTargets[0]), 0xb1);
+    EXPECT_EQ(CacheByte(bc.get(), kChainTargets[1]), 0xb2);
+    EXPECT_EQ(CacheByte(bc.get(), kIncompleteTarget), 0);
+
+    EXPECT_EQ(DeviceByte(fd.get(), kSingleTarget), 0);
+    EXPECT_EQ(DeviceByte(fd.get(), kChainTargets[0]), 0);
+    EXPECT_EQ(DeviceByte(fd.get(), kChainTargets[1]), 0);
+    uint8_t after[minfs::kMinfsBlockSize];
+    ASSERT_EQ(pread(fd.get(), after, sizeof(after), kJournalStart * minfs::kMinfsBlockSize),
+              static_cast<ssize_t>(sizeof(after)));
+    EXPECT_EQ(memcmp(before, after, sizeof(before)), 0);
+
+    // A write replaces the overlaid block.
+    uint8_t block[minfs::kMinfsBlockSize];
+    memset(block, 0xd1, sizeof(block));
+    ASSERT_EQ(bc->Writeblk(kSingleTarget, block), ZX_OK);
+    EXPECT_EQ(CacheByte(bc.get(), kSingleTarget), 0xd1);
+    EXPECT_EQ(DeviceByte(fd.get(), kSingleTarget), 0xd1);
+    END_TEST;
+}
+
+// Replaying the journal writes out complete entries and chains only, and
+// drops them from the journal.
+bool TestJournalReplay(void) {
+    BEGIN_TEST;
+    fbl::unique_ptr<minfs::Bcache> bc;
+    fbl::unique_fd fd;
+    minfs::Superblock info;
+    ASSERT_TRUE(CreateImage(&bc, &fd, &info));
+
+    size_t entries;
+    ASSERT_EQ(minfs::ReplayJournal(bc.get(), info, &entries), ZX_OK);
+    EXPECT_EQ(entries, 3);
+    EXPECT_EQ(DeviceByte(fd.get(), kSingleTarget), 0xa1);
+    EXPECT_EQ(DeviceByte(fd.get(), kChainTargets[0]), 0xb1);
+    EXPECT_EQ(DeviceByte(fd.get(), kChainTargets[1]), 0xb2);
+    EXPECT_EQ(DeviceByte(fd.get(), kIncompleteTarget), 0);
+
+    minfs::JournalInfo journal_info;
+    ASSERT_EQ(minfs::LoadJournalInfo(bc.get(), kJournalStart, &journal_info), ZX_OK);
+    EXPECT_EQ(journal_info.start_block, 9);
+    EXPECT_EQ(journal_info.sequence, 3);
+
+    ASSERT_EQ(minfs::ReplayJournal(bc.get(), info, &entries), ZX_OK);
+    EXPECT_EQ(entries, 0);
+    END_TEST;
+}
+
+} // namespace
+
+BEGIN_TEST_CASE(journal_tests)
+RUN_TEST(TestJournalOverlay)
+RUN_TEST(TestJournalReplay)
+END_TEST_CASE(journal_tests)
@@ -17,6 +17,7 @@
 #include <zircon/compiler.h>
 
 #include <fbl/algorithm.h>
+#include <fbl/unique_ptr.h>
 
 #include "filesystems.h"
 #include "misc.h"
@@ -310,6 +311,18 @@ bool TestDirectoryReaddir(void) {
 
 // Create a directory named "::dir" with entries "00000", "00001" ... up to
 // num_entries.
+// Checks that |name| is one of the |num_entries| names made by large_dir_setup,
+// and that it has not been seen before.
+bool large_dir_check_entry(const char* name, size_t num_entries, bool* seen) {
+    char* end;
+    size_t i = strtoul(name, &end, 10);
+    ASSERT_EQ(*end, '\0', "Unexpected dirent");
+    ASSERT_LT(i, num_entries, "Unexpected dirent");
+    ASSERT_FALSE(seen[i], "Duplicate dirent");
+    seen[i] = true;
+    return true;
+}
+
 bool large_dir_setup(size_t num_entries) {
     ASSERT_EQ(mkdir("::dir", 0755), 0);
 
@@ -325,20 +338,21 @@ bool large_dir_setup(size_t num_entries) {
     DIR* dir = opendir("::dir");
     ASSERT_NONNULL(dir);
 
-    // As a sanity check, it should contain all then entries we made
+    // As a sanity check, it should contain all then entries we made. Some
+    // filesystems (such as minfs, once a directory is indexed) do not return
+    // entries in the order they were created.
+    fbl::unique_ptr<bool[]> seen(new bool[num_entries]());
     struct dirent* de;
     size_t num_seen = 0;
-    size_t i = 0;
     while ((de = readdir(dir)) != NULL) {
         if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
             // Ignore these entries
             continue;
         }
-        char dirname[100];
-        snprintf(dirname, 100, "%05lu", i++);
-        ASSERT_EQ(strcmp(de->d_name, dirname), 0, "Unexpected dirent");
+        ASSERT_TRUE(large_dir_check_entry(de->d_name, num_entries, seen.get()));
         num_seen++;
     }
+    ASSERT_EQ(num_seen, num_entries, "Did not see all expected entries");
     ASSERT_EQ(closedir(dir), 0);
 
     return true;
@@ -354,18 +368,16 @@ bool TestDirectoryReaddirRmAll(void) {
     ASSERT_NONNULL(dir);
 
     // Unlink all the entries as we read them.
+    fbl::unique_ptr<bool[]> seen(new bool[num_entries]());
     struct dirent* de;
     size_t num_seen = 0;
-    size_t i = 0;
     while ((de = readdir(dir)) != NULL) {
         if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
             // Ignore these entries
             continue;
         }
-        char dirname[100];
-        snprintf(dirname, 100, "%05lu", i++);
-        ASSERT_EQ(strcmp(de->d_name, dirname), 0, "Unexpected dirent");
-        ASSERT_EQ(unlinkat(dirfd(dir), dirname, AT_REMOVEDIR), 0);
+        ASSERT_TRUE(large_dir_check_entry(de->d_name, num_entries, seen.get()));
+        ASSERT_EQ(unlinkat(dirfd(dir), de->d_name, AT_REMOVEDIR), 0);
         num_seen++;
     }
 
@@ -4,10 +4,12 @@
 
 // Tests for MinFS-specific behavior.
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -229,26 +231,56 @@ bool GetFileBlocks(int fd, uint64_t* blocks) {
     END_HELPER;
 }
 
-// Fill a directory to at most |max_blocks| full of direntries.
+// Fill the directory |dir_path| within |parent_fd| to at most |max_blocks| full of direntries,
+// and return in |overflow_path| the name of a file which would grow it past |max_blocks|.
 // We assume the directory is empty to begin with, and any files we are adding do not already exist.
-bool FillDirectory(int dir_fd, uint32_t max_blocks) {
+//
+// Large directories are indexed by name hash, and do not shrink when a file which caused a leaf to
+// split is removed again. So first find how many files it takes to grow a scratch directory past
+// |max_blocks|, and then create one fewer in the real one.
+bool FillDirectory(int parent_fd, const char* dir_path, uint32_t max_blocks,
+                   char* overflow_path, size_t overflow_len) {
     BEGIN_HELPER;
 
+    const char* probe_path = "probe";
+    ASSERT_EQ(mkdirat(parent_fd, probe_path, 0666), 0);
+    fbl::unique_fd probe_fd(openat(parent_fd, probe_path, O_RDONLY));
+    ASSERT_TRUE(probe_fd);
+
     uint32_t file_count = 0;
     while (true) {
         char path[128];
         snprintf(path, sizeof(path) - 1, "file_%u", file_count++);
-        fbl::unique_fd fd(openat(dir_fd, path, O_CREAT | O_RDWR));
+        fbl::unique_fd fd(openat(probe_fd.get(), path, O_CREAT | O_RDWR));
         ASSERT_TRUE(fd);
 
         uint64_t current_blocks;
-        ASSERT_TRUE(GetFileBlocks(dir_fd, &current_blocks));
+        ASSERT_TRUE(GetFileBlocks(probe_fd.get(), &current_blocks));
 
         if (current_blocks > max_blocks) {
-            ASSERT_EQ(unlinkat(dir_fd, path, 0), 0);
             break;
         }
     }
+    for (uint32_t i = 0; i < file_count; i++) {
+        char path[128];
+        snprintf(path, sizeof(path) - 1, "file_%u", i);
+        ASSERT_EQ(unlinkat(probe_fd.get(), path, 0), 0);
+    }
+    probe_fd.reset();
+    ASSERT_EQ(unlinkat(parent_fd, probe_path, AT_REMOVEDIR), 0);
+
+    fbl::unique_fd dir_fd(openat(parent_fd, dir_path, O_RDONLY));
+    ASSERT_TRUE(dir_fd);
+    for (uint32_t i = 0; i < file_count - 1; i++) {
+        char path[128];
+        snprintf(path, sizeof(path) - 1, "file_%u", i);
+        fbl::unique_fd fd(openat(dir_fd.get(), path, O_CREAT | O_RDWR));
+        ASSERT_TRUE(fd);
+    }
+    uint64_t current_blocks;
+    ASSERT_TRUE(GetFileBlocks(dir_fd.get(), &current_blocks));
+    ASSERT_LE(current_blocks, max_blocks);
+    snprintf(overflow_path, overflow_len, "file_%u", file_count - 1);
 
     END_HELPER;
 }
@@ -334,7 +366,9 @@ bool TestFullOperations() {
     ASSERT_TRUE(dir_fd);
 
     // Fill the directory up to kMinfsDirect blocks full of direntries.
-    ASSERT_TRUE(FillDirectory(dir_fd.get(), minfs::kMinfsDirect));
+    char overflow_path[128];
+    ASSERT_TRUE(FillDirectory(mnt_fd.get(), dir_path, minfs::kMinfsDirect, overflow_path,
+                              sizeof(overflow_path)));
 
     // Now re-fill the partition by writing as much as possible back to the original file.
     // Attempt to leave 1 block free.
@@ -369,7 +403,7 @@ bool TestFullOperations() {
     uint64_t block_count;
     ASSERT_TRUE(GetFileBlocks(dir_fd.get(), &block_count));
     ASSERT_EQ(block_count, minfs::kMinfsDirect);
-    fbl::unique_fd tmp_fd(openat(dir_fd.get(), "new_file", O_CREAT | O_RDWR));
+    fbl::unique_fd tmp_fd(openat(dir_fd.get(), overflow_path, O_CREAT | O_RDWR));
     ASSERT_FALSE(tmp_fd);
 
     // Again, try editing nearby blocks to force bad allocation leftovers to be persisted, and
@@ -414,7 +448,7 @@ bool TestFullOperations() {
 
     // Now, attempt to rename one of our original files under the new directory.
     // This should also fail.
-    ASSERT_NE(renameat(mnt_fd.get(), med_path, dir_fd.get(), med_path), 0);
+    ASSERT_NE(renameat(mnt_fd.get(), med_path, dir_fd.get(), overflow_path), 0);
 
     // Again, truncate the original file and attempt to remount.
     // Again, this should fail without block reservation.
@@ -431,6 +465,63 @@ bool TestFullOperations() {
     END_TEST;
 }
 
+// Test a directory large enough to be indexed: lookups, unlinks and renames within it must find
+// the right entries, and fsck must accept the index after a remount.
+bool TestLargeDirectory() {
+    BEGIN_TEST;
+
+    const uint32_t kEntries = 4000;
+    ASSERT_EQ(mkdir("::dir", 0755), 0);
+    fbl::unique_fd dir_fd(open("::dir", O_RDONLY | O_DIRECTORY));
+    ASSERT_TRUE(dir_fd);
+    for (uint32_t i = 0; i < kEntries; i++) {
+        char path[128];
+        snprintf(path, sizeof(path), "entry-%u", i);
+        fbl::unique_fd fd(openat(dir_fd.get(), path, O_CREAT | O_EXCL | O_RDWR));
+        ASSERT_TRUE(fd);
+    }
+
+    // Remove every other entry, and rename every fourth to a new name.
+    for (uint32_t i = 0; i < kEntries; i++) {
+        char path[128];
+        snprintf(path, sizeof(path), "entry-%u", i);
+        struct stat s;
+        ASSERT_EQ(fstatat(dir_fd.get(), path, &s, 0), 0);
+        if (i % 2) {
+            ASSERT_EQ(unlinkat(dir_fd.get(), path, 0), 0);
+        } else if (i % 4 == 0) {
+            char new_path[128];
+            snprintf(new_path, sizeof(new_path), "renamed-%u", i);
+            ASSERT_EQ(renameat(dir_fd.get(), path, dir_fd.get(), new_path), 0);
+        }
+    }
+    dir_fd.reset();
+    ASSERT_TRUE(check_remount());
+
+    DIR* dir = opendir("::dir");
+    ASSERT_NONNULL(dir);
+    struct dirent* de;
+    uint32_t num_seen = 0;
+    while ((de = readdir(dir)) != NULL) {
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+            continue;
+        }
+        uint32_t i;
+        char prefix[16];
+        ASSERT_EQ(sscanf(de->d_name, "%15[a-z]-%u", prefix, &i), 2, "Unexpected dirent");
+        ASSERT_EQ(i % 2, 0, "Unlinked dirent");
+        ASSERT_EQ(strcmp(prefix, (i % 4 == 0) ? "renamed" : "entry"), 0, "Unexpected dirent");
+        ASSERT_EQ(unlinkat(dirfd(dir), de->d_name, 0), 0);
+        num_seen++;
+    }
+    ASSERT_EQ(num_seen, kEntries / 2, "Did not see all expected entries");
+    ASSERT_EQ(closedir(dir), 0);
+    ASSERT_EQ(rmdir("::dir"), 0);
+    ASSERT_TRUE(check_remount());
+
+    END_TEST;
+}
+
 bool TestUnlinkFail(void) {
     BEGIN_TEST;
 
@@ -504,6 +595,78 @@ bool TestUnlinkFail(void) {
 
     END_TEST;
 }
+
+// Cut power to the ramdisk at various points while metadata is being written, and check that
+// the filesystem is consistent once the journal has been replayed.
+bool TestJournalReplay() {
+    BEGIN_TEST;
+
+    if (use_real_disk) {
+        fprintf(stderr, "Ramdisk required; skipping test\n");
+        return true;
+    }
+
+    char data[minfs::kMinfsBlockSize];
+    memset(data, 0xaa, sizeof(data));
+    const uint64_t kCutAfterBlocks[] = {1, 16, 17, 40, 100, 400};
+    for (uint64_t blocks : kCutAfterBlocks) {
+        ASSERT_EQ(mkdir("::dir", 0755), 0);
+        fbl::unique_fd fd(open("::dir/before", O_CREAT | O_RDWR | O_EXCL));
+        ASSERT_TRUE(fd);
+        ASSERT_EQ(write(fd.get(), data, sizeof(data)), sizeof(data));
+        ASSERT_EQ(syncfs(fd.get()), 0);
+
+        // Every write after the first |blocks| fails, as if the device had lost power.
+        ASSERT_EQ(sleep_ramdisk(ramdisk_path, blocks), 0);
+        for (unsigned i = 0; i < 20; i++) {
+            char path[128];
+            snprintf(path, sizeof(path), "::dir/file-%u", i);
+            fbl::unique_fd file_fd(open(path, O_CREAT | O_RDWR | O_EXCL));
+            ASSERT_TRUE(file_fd);
+            ASSERT_EQ(write(file_fd.get(), data, sizeof(data)), sizeof(data));
+        }
+        ASSERT_EQ(rename("::dir/before", "::dir/after"), 0);
+        int sync_result = syncfs(fd.get());
+        fd.reset();
+
+        // If the device took every write, nothing may have been lost.
+        ramdisk_blk_counts_t counts;
+        ASSERT_EQ(get_ramdisk_blocks(ramdisk_path, &counts), ZX_OK);
+        if (counts.failed == 0) {
+            ASSERT_EQ(sync_result, 0);
+        }
+
+        ASSERT_EQ(test_info->unmount(kMountPath), 0);
+        ASSERT_EQ(wake_ramdisk(ramdisk_path), 0);
+        ASSERT_EQ(test_info->fsck(test_disk_path), 0);
+        ASSERT_EQ(test_info->mount(test_disk_path, kMountPath), 0);
+
+        // The rename happened entirely or not at all.
+        struct stat st;
+        bool before_exists = stat("::dir/before", &st) == 0;
+        bool after_exists = stat("::dir/after", &st) == 0;
+        ASSERT_NE(before_exists, after_exists, "Rename was not atomic");
+        if (counts.failed == 0) {
+            ASSERT_TRUE(after_exists, "Synced rename was lost");
+        }
+
+        // Whatever survived must be removable.
+        DIR* dir = opendir("::dir");
+        ASSERT_NONNULL(dir);
+        struct dirent* de;
+        while ((de = readdir(dir)) != NULL) {
+            if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+                continue;
+            }
+            ASSERT_EQ(unlinkat(dirfd(dir), de->d_name, 0), 0);
+        }
+        ASSERT_EQ(closedir(dir), 0);
+        ASSERT_EQ(rmdir("::dir"), 0);
+        ASSERT_TRUE(check_remount());
+    }
+
+    END_TEST;
+}
 }  // namespace
 
 #define RUN_MINFS_TESTS_NORMAL(name, CASE_TESTS) \
@@ -514,11 +677,14 @@ bool TestUnlinkFail(void) {
 
 RUN_MINFS_TESTS_NORMAL(FsMinfsTests,
     RUN_TEST_LARGE(TestFullOperations)
+    RUN_TEST_LARGE(TestLargeDirectory)
     RUN_TEST_MEDIUM(TestUnlinkFail)
+    RUN_TEST_MEDIUM(TestJournalReplay)
 )
 
 RUN_MINFS_TESTS_FVM(FsMinfsFvmTests,
     RUN_TEST_MEDIUM(TestQueryInfo)
     RUN_TEST_MEDIUM(TestMetrics)
     RUN_TEST_MEDIUM(TestUnlinkFail)
+    RUN_TEST_MEDIUM(TestJournalReplay)
 )
@@ -0,0 +1,177 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include <lib/kcounter/reader.h>
+#include <lib/zx/event.h>
+#include <lib/zx/vmo.h>
+#include <unittest/unittest.h>
+#include <zircon/limits.h>
+
+namespace {
+
+// A counter that every kernel has, and that creating handles bumps.
+constexpr char kHandlesMade[] = "kernel.handles.made";
+
+// The histogram family with one histogram per syscall number.
+constexpr char kSyscallLatency[] = "kernel.latency.syscall";
+
+bool counters_published() {
+    BEGIN_TEST;
+
+    kcounter::Reader reader;
+    ASSERT_EQ(reader.Init(), ZX_OK);
+    ASSERT_GT(reader.count(), 0u);
+
+    for (size_t i = 0; i < reader.count(); ++i) {
+        if (i > 0) {
+            EXPECT_LT(strcmp(reader.name(i - 1), reader.name(i)), 0, "names are not sorted");
+        }
+        EXPECT_GE(reader.type(i), KCOUNTER_TYPE_SUM);
+        EXPECT_LE(reader.type(i), KCOUNTER_TYPE_MAX);
+    }
+
+    size_t index;
+    EXPECT_TRUE(reader.Find(kHandlesMade, &index));
+    EXPECT_STR_EQ(reader.name(index), kHandlesMade);
+    EXPECT_FALSE(reader.Find("kernel.no.such.counter", &index));
+
+    END_TEST;
+}
+
+bool counters_are_live() {
+    BEGIN_TEST;
+
+    kcounter::Reader reader;
+    ASSERT_EQ(reader.Init(), ZX_OK);
+    size_t index;
+    ASSERT_TRUE(reader.Find(kHandlesMade, &index));
+
+    // The mapping follows the kernel's updates without any further calls.
+    const int64_t before = reader.Value(index);
+    for (int i = 0; i < 100; ++i) {
+        zx::event event;
+        ASSERT_EQ(zx::event::create(0, &event), ZX_OK);
+    }
+    const int64_t after = reader.Value(index);
+    EXPECT_GT(after, before);
+
+    kcounter::Stats stats = reader.Read(index);
+    EXPECT_LE(stats.min, stats.max);
+    EXPECT_GE(stats.sum, stats.max);
+
+    END_TEST;
+}
+
+bool bad_descriptors_rejected() {
+    BEGIN_TEST;
+
+    zx::vmo desc, arena;
+    ASSERT_EQ(zx::vmo::create(ZX_PAGE_SIZE, 0, &desc), ZX_OK);
+    ASSERT_EQ(zx::vmo::create(ZX_PAGE_SIZE, 0, &arena), ZX_OK);
+
+    kcounter::Reader reader;
+    EXPECT_EQ(reader.Init(desc, arena), ZX_ERR_IO_DATA_INTEGRITY);
+    EXPECT_EQ(reader.count(), 0u);
+
+    END_TEST;
+}
+
+int64_t SyscallsRecorded(const kcounter::HistogramReader& reader, size_t family) {
+    int64_t total = 0;
+    for (uint32_t i = 0; i < reader.size(family); ++i) {
+        kcounter::Histogram histogram;
+        reader.Read(family, i, &histogram);
+        total += histogram.total();
+    }
+    return total;
+}
+
+bool histograms_published() {
+    BEGIN_TEST;
+
+    kcounter::HistogramReader reader;
+    ASSERT_EQ(reader.Init(), ZX_OK);
+    ASSERT_GT(reader.count(), 0u);
+
+    for (size_t i = 1; i < reader.count(); ++i) {
+        EXPECT_LT(strcmp(reader.name(i - 1), reader.name(i)), 0, "names are not sorted");
+    }
+
+    size_t family;
+    ASSERT_TRUE(reader.Find(kSyscallLatency, &family));
+    EXPECT_GT(reader.size(family), 1u);
+    EXPECT_FALSE(reader.Find("kernel.latency.no.such.histogram", &family));
+
+    END_TEST;
+}
+
+bool syscall_histograms_are_live() {
+    BEGIN_TEST;
+
+    kcounter::HistogramReader reader;
+    ASSERT_EQ(reader.Init(), ZX_OK);
+    size_t family;
+    ASSERT_TRUE(reader.Find(kSyscallLatency, &family));
+
+    const int64_t before = SyscallsRecorded(reader, family);
+    for (int i = 0; i < 100; ++i) {
+        zx::event event;
+        ASSERT_EQ(zx::event::create(0, &event), ZX_OK);
+    }
+    EXPECT_GE(SyscallsRecorded(reader, family), before + 200);
+
+    END_TEST;
+}
+
+bool histogram_percentiles() {
+    BEGIN_TEST;
+
+    kcounter::Histogram histogram = {};
+    EXPECT_EQ(histogram.Percentile(0.5), 0u);
+
+    // 90 values under 128ns, 9 in [1024, 1536) and one of a second or more.
+    histogram.buckets[0] = 90;
+    histogram.buckets[khistogram_bucket(1024)] = 9;
+    histogram.buckets[KHISTOGRAM_BUCKETS - 1] = 1;
+    EXPECT_EQ(histogram.total(), 100);
+    EXPECT_EQ(histogram.Percentile(0.5), 128u);
+    EXPECT_EQ(histogram.Percentile(0.9), 128u);
+    EXPECT_EQ(histogram.Percentile(0.99), 1536u);
+    EXPECT_EQ(histogram.Percentile(1.0), 1u << KHISTOGRAM_MAX_SHIFT);
+
+    END_TEST;
+}
+
+bool bad_histogram_descriptors_rejected() {
+    BEGIN_TEST;
+
+    zx::vmo desc, arena;
+    ASSERT_EQ(zx::vmo::create(ZX_PAGE_SIZE, 0, &desc), ZX_OK);
+    ASSERT_EQ(zx::vmo::create(ZX_PAGE_SIZE, 0, &arena), ZX_OK);
+
+    kcounter::HistogramReader reader;
+    EXPECT_EQ(reader.Init(desc, arena), ZX_ERR_IO_DATA_INTEGRITY);
+    EXPECT_EQ(reader.count(), 0u);
+
+    END_TEST;
+}
+
+} // namespace
+
+BEGIN_TEST_CASE(kcounter_tests)
+RUN_TEST(counters_published)
+RUN_TEST(counters_are_live)
+RUN_TEST(bad_descriptors_rejected)
+RUN_TEST(histograms_published)
+RUN_TEST(syscall_histograms_are_live)
+RUN_TEST(histogram_percentiles)
+RUN_TEST(bad_histogram_descriptors_rejected)
+END_TEST_CASE(kcounter_tests)
+
+int main(int argc, char** argv) {
+    bool success = unittest_run_all_tests(argc, argv);
+    return success ? 0 : -1;
+}
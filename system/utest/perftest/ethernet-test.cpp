@@ -0,0 +1,188 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <string.h>
+
+#include <utility>
+
+#include <ddk/protocol/ethernet.h>
+#include <fbl/string_printf.h>
+#include <fbl/unique_fd.h>
+#include <fuchsia/hardware/ethernet/c/fidl.h>
+#include <lib/fdio/util.h>
+#include <lib/fdio/watcher.h>
+#include <lib/fzl/fifo.h>
+#include <lib/zx/channel.h>
+#include <lib/zx/socket.h>
+#include <lib/zx/time.h>
+#include <lib/zx/vmar.h>
+#include <lib/zx/vmo.h>
+#include <perftest/perftest.h>
+#include <zircon/assert.h>
+#include <zircon/device/ethertap.h>
+
+namespace {
+
+using FifoEntry = fuchsia_hardware_ethernet_FifoEntry;
+
+constexpr uint32_t kMtu = 1500;
+constexpr uint16_t kBufSize = 2048;
+// Frames sent in each run. The client keeps twice as many receive buffers
+// posted, so that none are dropped while it returns the previous run's.
+constexpr uint32_t kFramesPerRun = 64;
+constexpr uint32_t kRxBufs = 2 * kFramesPerRun;
+constexpr zx::duration kTimeout = zx::sec(10);
+
+// Passed to the directory watcher to find the ethernet device with a given MAC.
+struct WatchCookie {
+    uint8_t mac[6];
+    zx::channel svc;
+};
+
+zx_status_t WatchCb(int dirfd, int event, const char* fn, void* cookie) {
+    if (event != WATCH_EVENT_ADD_FILE || !strcmp(fn, ".") || !strcmp(fn, "..")) {
+        return ZX_OK;
+    }
+    fbl::unique_fd fd(openat(dirfd, fn, O_RDONLY));
+    if (!fd) {
+        return ZX_OK;
+    }
+    zx::channel svc;
+    if (fdio_get_service_handle(fd.release(), svc.reset_and_get_address()) != ZX_OK) {
+        return ZX_OK;
+    }
+    fuchsia_hardware_ethernet_Info info;
+    auto watch = static_cast<WatchCookie*>(cookie);
+    if (fuchsia_hardware_ethernet_DeviceGetInfo(svc.get(), &info) != ZX_OK ||
+        memcmp(info.mac.octets, watch->mac, sizeof(watch->mac))) {
+        return ZX_OK;
+    }
+    watch->svc = std::move(svc);
+    return ZX_ERR_STOP;
+}
+
+// An ethertap device with a single client, which receives the frames written
+// to the tap's socket.
+class TestDevice {
+public:
+    explicit TestDevice(uint32_t features) {
+        // Each device gets its own MAC, so that a tap left over from the
+        // previous test is not mistaken for this one.
+        static uint8_t next_id = 0;
+        WatchCookie watch = {{0x12, 0x20, 0x30, 0x40, 0x50, ++next_id}, {}};
+
+        fbl::unique_fd ctl(open("/dev/misc/tapctl", O_RDONLY));
+        ZX_ASSERT(ctl);
+        ethertap_ioctl_config_t config = {};
+        strlcpy(config.name, "perftest", ETHERTAP_MAX_NAME_LEN);
+        config.features = features;
+        config.mtu = kMtu;
+        memcpy(config.mac, watch.mac, sizeof(config.mac));
+        ZX_ASSERT(ioctl_ethertap_config(ctl.get(), &config, sock_.reset_and_get_address()) >= 0);
+
+        fbl::unique_fd dir(open("/dev/class/ethernet", O_RDONLY));
+        ZX_ASSERT(dir);
+        ZX_ASSERT(fdio_watch_directory(dir.get(), WatchCb, zx::deadline_after(kTimeout).get(),
+                                       &watch) == ZX_ERR_STOP);
+        svc_ = std::move(watch.svc);
+
+        zx_status_t call_status;
+        fuchsia_hardware_ethernet_Fifos fifos;
+        ZX_ASSERT(fuchsia_hardware_ethernet_DeviceGetFifos(svc_.get(), &call_status, &fifos) ==
+                  ZX_OK);
+        ZX_ASSERT(call_status == ZX_OK);
+        zx_handle_close(fifos.tx);
+        rx_.reset(fifos.rx);
+
+        size_t size = kRxBufs * kBufSize;
+        zx::vmo vmo;
+        ZX_ASSERT(zx::vmo::create(size, ZX_VMO_NON_RESIZABLE, &vmo) == ZX_OK);
+        ZX_ASSERT(zx::vmar::root_self()->map(0, vmo, 0, size, ZX_VM_PERM_READ | ZX_VM_PERM_WRITE,
+                                             &mapped_) == ZX_OK);
+        ZX_ASSERT(fuchsia_hardware_ethernet_DeviceSetIOBuffer(svc_.get(), vmo.release(),
+                                                              &call_status) == ZX_OK);
+        ZX_ASSERT(call_status == ZX_OK);
+
+        for (uint32_t i = 0; i < kRxBufs; ++i) {
+            FifoEntry entry = {};
+            entry.offset = i * kBufSize;
+            entry.length = kBufSize;
+            ZX_ASSERT(rx_.write_one(entry) == ZX_OK);
+        }
+        ZX_ASSERT(fuchsia_hardware_ethernet_DeviceStart(svc_.get(), &call_status) == ZX_OK);
+        ZX_ASSERT(call_status == ZX_OK);
+    }
+
+    ~TestDevice() {
+        fuchsia_hardware_ethernet_DeviceStop(svc_.get());
+        zx::vmar::root_self()->unmap(mapped_, kRxBufs * kBufSize);
+    }
+
+    // Writes |kFramesPerRun| frames of |frame_size| bytes to the tap, waits
+    // for all of them to arrive on the RX fifo, and posts their buffers again.
+    void Transfer(size_t frame_size) {
+        uint8_t frame[kMtu] = {};
+        for (uint32_t i = 0; i < kFramesPerRun; ++i) {
+            size_t actual;
+            ZX_ASSERT(sock_.write(0, frame, frame_size, &actual) == ZX_OK);
+        }
+
+        FifoEntry entries[kFramesPerRun];
+        size_t received = 0;
+        while (received < kFramesPerRun) {
+            ZX_ASSERT(rx_.wait_one(ZX_FIFO_READABLE, zx::deadline_after(kTimeout), nullptr) ==
+                      ZX_OK);
+            size_t actual;
+            ZX_ASSERT(rx_.read(&entries[received], kFramesPerRun - received, &actual) == ZX_OK);
+            received += actual;
+        }
+        for (auto& entry : entries) {
+            ZX_ASSERT(entry.length == frame_size);
+            entry.length = kBufSize;
+        }
+        ZX_ASSERT(rx_.write(entries, kFramesPerRun, nullptr) == ZX_OK);
+    }
+
+private:
+    zx::socket sock_;
+    zx::channel svc_;
+    fzl::fifo<FifoEntry> rx_;
+    uintptr_t mapped_ = 0;
+};
+
+// Test the receive path of the ethernet driver, which either copies each
+// frame into the client's buffers or, with ETHMAC_FEATURE_RX_NETBUF, has the
+// MAC write it there directly. Each run delivers |kFramesPerRun| frames of
+// |frame_size| bytes.
+bool EthernetRecvTest(perftest::RepeatState* state, uint32_t features, size_t frame_size) {
+    state->SetBytesProcessedPerRun(kFramesPerRun * frame_size);
+
+    TestDevice device(features);
+    while (state->KeepRunning()) {
+        device.Transfer(frame_size);
+    }
+    return true;
+}
+
+void RegisterTests() {
+    static const size_t kFrameSizes[] = {
+        64,
+        kMtu,
+    };
+    static const uint32_t kFeatures[] = {
+        0,
+        ETHMAC_FEATURE_RX_NETBUF,
+    };
+    for (auto features : kFeatures) {
+        const char* mode = features ? "ZeroCopy" : "Copy";
+        for (auto frame_size : kFrameSizes) {
+            auto name = fbl::StringPrintf("Ethernet/Recv/%s/%zubytes", mode, frame_size);
+            perftest::RegisterTest(name.c_str(), EthernetRecvTest, features, frame_size);
+        }
+    }
+}
+PERFTEST_CTOR(RegisterTests);
+
+}  // namespace
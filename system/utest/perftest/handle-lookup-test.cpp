@@ -0,0 +1,143 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <threads.h>
+
+#include <fbl/atomic.h>
+#include <fbl/string_printf.h>
+#include <lib/zx/event.h>
+#include <perftest/perftest.h>
+#include <zircon/syscalls.h>
+
+namespace {
+
+// Measure the time taken for |thread_count| threads to each run a fixed
+// number of handle operations on handles that no other thread uses.  The
+// threads share nothing but the process's handle table and the kernel's
+// handle arena, so any slowdown as |thread_count| grows comes from the
+// kernel serializing handle lookups, creation or destruction.
+class IndependentHandles {
+public:
+    static constexpr uint32_t kMaxThreads = 16;
+    static constexpr uint32_t kIterations = 1000;
+
+    enum class Op {
+        // zx_object_signal() on the thread's own event: one handle lookup.
+        kSignal,
+        // Create an event and close it again: one handle allocation and free.
+        kCreateClose,
+    };
+
+    IndependentHandles(uint32_t thread_count, Op op) : thread_count_(thread_count), op_(op) {
+        ZX_ASSERT(thread_count <= kMaxThreads);
+        for (uint32_t i = 0; i < thread_count_; ++i) {
+            workers_[i].test = this;
+            ZX_ASSERT(zx::event::create(0, &workers_[i].event) == ZX_OK);
+            ZX_ASSERT(thrd_create(&threads_[i], ThreadFunc, &workers_[i]) == thrd_success);
+        }
+    }
+
+    ~IndependentHandles() {
+        stop_.store(true);
+        StartRound();
+        for (uint32_t i = 0; i < thread_count_; ++i) {
+            ZX_ASSERT(thrd_join(threads_[i], nullptr) == thrd_success);
+        }
+    }
+
+    // Runs one round of handle operations on all of the threads.
+    void Run() {
+        done_.store(0);
+        StartRound();
+        for (;;) {
+            int done = done_.load();
+            if (done == static_cast<int>(thread_count_)) {
+                break;
+            }
+            zx_futex_wait(Futex(&done_), done, ZX_HANDLE_INVALID, ZX_TIME_INFINITE);
+        }
+    }
+
+private:
+    // Keep each worker on its own cache line so the threads share no memory.
+    struct alignas(64) Worker {
+        IndependentHandles* test;
+        zx::event event;
+    };
+
+    static zx_futex_t* Futex(fbl::atomic<int>* value) {
+        return reinterpret_cast<zx_futex_t*>(value);
+    }
+
+    void StartRound() {
+        generation_.fetch_add(1);
+        zx_futex_wake(Futex(&generation_), UINT32_MAX);
+    }
+
+    static int ThreadFunc(void* arg) {
+        Worker* worker = static_cast<Worker*>(arg);
+        IndependentHandles* test = worker->test;
+        int generation = 0;
+        for (;;) {
+            int current;
+            while ((current = test->generation_.load()) == generation) {
+                zx_futex_wait(Futex(&test->generation_), current, ZX_HANDLE_INVALID,
+                              ZX_TIME_INFINITE);
+            }
+            generation = current;
+            if (test->stop_.load()) {
+                return 0;
+            }
+
+            switch (test->op_) {
+            case Op::kSignal:
+                for (uint32_t i = 0; i < kIterations; ++i) {
+                    ZX_ASSERT(worker->event.signal(0, ZX_USER_SIGNAL_0) == ZX_OK);
+                }
+                break;
+            case Op::kCreateClose:
+                for (uint32_t i = 0; i < kIterations; ++i) {
+                    zx::event event;
+                    ZX_ASSERT(zx::event::create(0, &event) == ZX_OK);
+                }
+                break;
+            }
+
+            test->done_.fetch_add(1);
+            zx_futex_wake(Futex(&test->done_), 1);
+        }
+    }
+
+    const uint32_t thread_count_;
+    const Op op_;
+    Worker workers_[kMaxThreads];
+    thrd_t threads_[kMaxThreads];
+    fbl::atomic<int> generation_{0};
+    fbl::atomic<int> done_{0};
+    fbl::atomic<bool> stop_{false};
+};
+
+bool IndependentHandlesTest(perftest::RepeatState* state, uint32_t thread_count,
+                            IndependentHandles::Op op) {
+    IndependentHandles test(thread_count, op);
+    while (state->KeepRunning()) {
+        test.Run();
+    }
+    return true;
+}
+
+void RegisterTests() {
+    static const uint32_t kThreadCounts[] = {1, 2, 4, 8, 16};
+    for (uint32_t thread_count : kThreadCounts) {
+        auto name = fbl::StringPrintf("HandleLookup/ObjectSignal/%uthreads", thread_count);
+        perftest::RegisterTest(name.c_str(), IndependentHandlesTest, thread_count,
+                               IndependentHandles::Op::kSignal);
+        name = fbl::StringPrintf("HandleArena/EventCreateClose/%uthreads", thread_count);
+        perftest::RegisterTest(name.c_str(), IndependentHandlesTest, thread_count,
+                               IndependentHandles::Op::kCreateClose);
+    }
+}
+PERFTEST_CTOR(RegisterTests);
+
+}  // namespace
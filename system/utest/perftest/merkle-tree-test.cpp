@@ -0,0 +1,49 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include <digest/digest.h>
+#include <digest/merkle-tree.h>
+#include <fbl/string_printf.h>
+#include <fbl/unique_ptr.h>
+#include <perftest/perftest.h>
+#include <zircon/assert.h>
+
+namespace {
+
+// Test performance of building the Merkle tree of |size| bytes of data on up
+// to |num_threads| threads, where 0 means one per CPU.
+bool MerkleTreeCreateTest(perftest::RepeatState* state, size_t size, size_t num_threads) {
+    state->SetBytesProcessedPerRun(size);
+
+    size_t tree_len = digest::MerkleTree::GetTreeLength(size);
+    fbl::unique_ptr<uint8_t[]> data(new uint8_t[size]);
+    fbl::unique_ptr<uint8_t[]> tree(new uint8_t[tree_len]);
+    // Initialize data so that we are not hashing uninitialized memory.
+    memset(data.get(), 0xff, size);
+
+    digest::Digest digest;
+    while (state->KeepRunning()) {
+        ZX_ASSERT(digest::MerkleTree::CreateParallel(data.get(), size, tree.get(), tree_len,
+                                                     &digest, num_threads) == ZX_OK);
+    }
+    return true;
+}
+
+void RegisterTests() {
+    static const size_t kSizesBytes[] = {
+        1 << 20,
+        16 << 20,
+    };
+    for (auto size : kSizesBytes) {
+        auto name = fbl::StringPrintf("MerkleTree/Create/%zubytes/1thread", size);
+        perftest::RegisterTest(name.c_str(), MerkleTreeCreateTest, size, size_t{1});
+        name = fbl::StringPrintf("MerkleTree/Create/%zubytes/allcpus", size);
+        perftest::RegisterTest(name.c_str(), MerkleTreeCreateTest, size, size_t{0});
+    }
+}
+PERFTEST_CTOR(RegisterTests);
+
+}  // namespace
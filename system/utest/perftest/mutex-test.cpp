@@ -4,7 +4,10 @@
 
 #include <threads.h>
 
+#include <fbl/atomic.h>
+#include <fbl/string_printf.h>
 #include <perftest/perftest.h>
+#include <zircon/syscalls.h>
 
 namespace {
 
@@ -24,8 +27,122 @@ bool MutexLockUnlockTest(perftest::RepeatState* state) {
     return true;
 }
 
+// Measure the time taken for |pair_count| pairs of threads to each lock
+// and unlock their pair's mutex a fixed number of times.  The threads of a
+// pair contend with each other, so they block in and wake each other up
+// through the kernel's futex calls, but the pairs share nothing.  Any
+// slowdown as |pair_count| grows comes from the kernel serializing futex
+// operations on unrelated addresses.
+class IndependentMutexes {
+public:
+    static constexpr uint32_t kMaxPairs = 16;
+    static constexpr uint32_t kIterations = 1000;
+
+    explicit IndependentMutexes(uint32_t pair_count) : thread_count_(pair_count * 2) {
+        ZX_ASSERT(pair_count <= kMaxPairs);
+        for (uint32_t i = 0; i < pair_count; ++i) {
+            ZX_ASSERT(mtx_init(&mutexes_[i].mutex, mtx_plain) == thrd_success);
+        }
+        for (uint32_t i = 0; i < thread_count_; ++i) {
+            workers_[i] = Worker{this, &mutexes_[i / 2].mutex};
+            ZX_ASSERT(thrd_create(&threads_[i], ThreadFunc, &workers_[i]) == thrd_success);
+        }
+    }
+
+    ~IndependentMutexes() {
+        stop_.store(true);
+        StartRound();
+        for (uint32_t i = 0; i < thread_count_; ++i) {
+            ZX_ASSERT(thrd_join(threads_[i], nullptr) == thrd_success);
+        }
+        for (uint32_t i = 0; i < thread_count_ / 2; ++i) {
+            mtx_destroy(&mutexes_[i].mutex);
+        }
+    }
+
+    // Runs one round of lock/unlock loops on all of the threads.
+    void Run() {
+        done_.store(0);
+        StartRound();
+        for (;;) {
+            int done = done_.load();
+            if (done == static_cast<int>(thread_count_)) {
+                break;
+            }
+            zx_futex_wait(Futex(&done_), done, ZX_HANDLE_INVALID, ZX_TIME_INFINITE);
+        }
+    }
+
+private:
+    // Keep each mutex on its own cache line so the pairs share no memory.
+    struct alignas(64) Mutex {
+        mtx_t mutex;
+    };
+
+    struct Worker {
+        IndependentMutexes* test;
+        mtx_t* mutex;
+    };
+
+    static zx_futex_t* Futex(fbl::atomic<int>* value) {
+        return reinterpret_cast<zx_futex_t*>(value);
+    }
+
+    void StartRound() {
+        generation_.fetch_add(1);
+        zx_futex_wake(Futex(&generation_), UINT32_MAX);
+    }
+
+    static int ThreadFunc(void* arg) {
+        Worker* worker = static_cast<Worker*>(arg);
+        IndependentMutexes* test = worker->test;
+        int generation = 0;
+        for (;;) {
+            int current;
+            while ((current = test->generation_.load()) == generation) {
+                zx_futex_wait(Futex(&test->generation_), current, ZX_HANDLE_INVALID,
+                              ZX_TIME_INFINITE);
+            }
+            generation = current;
+            if (test->stop_.load()) {
+                return 0;
+            }
+
+            for (uint32_t i = 0; i < kIterations; ++i) {
+                ZX_ASSERT(mtx_lock(worker->mutex) == thrd_success);
+                ZX_ASSERT(mtx_unlock(worker->mutex) == thrd_success);
+            }
+
+            test->done_.fetch_add(1);
+            zx_futex_wake(Futex(&test->done_), 1);
+        }
+    }
+
+    Mutex mutexes_[kMaxPairs];
+    const uint32_t thread_count_;
+    Worker workers_[kMaxPairs * 2];
+    thrd_t threads_[kMaxPairs * 2];
+    fbl::atomic<int> generation_{0};
+    fbl::atomic<int> done_{0};
+    fbl::atomic<bool> stop_{false};
+};
+
+bool MutexIndependentContendedTest(perftest::RepeatState* state, uint32_t pair_count) {
+    IndependentMutexes test(pair_count);
+    while (state->KeepRunning()) {
+        test.Run();
+    }
+    return true;
+}
+
 void RegisterTests() {
     perftest::RegisterTest("MutexLockUnlock", MutexLockUnlockTest);
+
+    static const uint32_t kPairCounts[] = {1, 2, 4, 8, 16};
+    for (uint32_t pair_count : kPairCounts) {
+        auto name = fbl::StringPrintf("MutexIndependentContended/%upairs", pair_count);
+        perftest::RegisterTest(name.c_str(), MutexIndependentContendedTest, pair_count);
+    }
 }
 PERFTEST_CTOR(RegisterTests);
 
@@ -0,0 +1,106 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fbl/string_printf.h>
+#include <fbl/unique_ptr.h>
+#include <lib/async-loop/cpp/loop.h>
+#include <lib/async/cpp/wait.h>
+#include <lib/zx/event.h>
+#include <lib/zx/port.h>
+#include <perftest/perftest.h>
+#include <zircon/assert.h>
+
+namespace {
+
+constexpr size_t kMaxPackets = 64;
+
+// Queues |sources| packets on a port, then reads them back one zx_port_wait()
+// at a time.  Each iteration delivers |sources| events.
+bool PortWaitTest(perftest::RepeatState* state, uint32_t sources) {
+    zx::port port;
+    ZX_ASSERT(zx::port::create(0, &port) == ZX_OK);
+
+    zx_port_packet_t packet = {};
+    packet.type = ZX_PKT_TYPE_USER;
+    while (state->KeepRunning()) {
+        for (uint32_t i = 0; i < sources; ++i) {
+            packet.key = i;
+            ZX_ASSERT(port.queue(&packet) == ZX_OK);
+        }
+        for (uint32_t i = 0; i < sources; ++i) {
+            ZX_ASSERT(port.wait(zx::time::infinite(), &packet) == ZX_OK);
+        }
+    }
+    return true;
+}
+
+// Same as PortWaitTest, but reads the packets back with zx_port_wait_many().
+bool PortWaitManyTest(perftest::RepeatState* state, uint32_t sources) {
+    zx::port port;
+    ZX_ASSERT(zx::port::create(0, &port) == ZX_OK);
+
+    zx_port_packet_t packets[kMaxPackets];
+    zx_port_packet_t packet = {};
+    packet.type = ZX_PKT_TYPE_USER;
+    while (state->KeepRunning()) {
+        for (uint32_t i = 0; i < sources; ++i) {
+            packet.key = i;
+            ZX_ASSERT(port.queue(&packet) == ZX_OK);
+        }
+        for (uint32_t received = 0; received < sources;) {
+            size_t actual;
+            ZX_ASSERT(port.wait_many(zx::time::infinite(), packets, kMaxPackets,
+                                     &actual) == ZX_OK);
+            received += static_cast<uint32_t>(actual);
+        }
+    }
+    return true;
+}
+
+// Dispatches waits on |sources| signaled events through an async::Loop.  Every
+// handler begins its wait again, and since the events stay signaled each one
+// is ready again straight away.  Each iteration dispatches |sources| events.
+bool AsyncLoopWaitTest(perftest::RepeatState* state, uint32_t sources) {
+    async::Loop loop(&kAsyncLoopConfigNoAttachToThread);
+    zx::event events[kMaxPackets];
+    async::Wait waits[kMaxPackets];
+
+    for (uint32_t i = 0; i < sources; ++i) {
+        ZX_ASSERT(zx::event::create(0, &events[i]) == ZX_OK);
+        ZX_ASSERT(events[i].signal(0, ZX_USER_SIGNAL_0) == ZX_OK);
+        waits[i].set_object(events[i].get());
+        waits[i].set_trigger(ZX_USER_SIGNAL_0);
+        waits[i].set_handler([](async_dispatcher_t* dispatcher, async::Wait* wait,
+                                zx_status_t status, const zx_packet_signal_t* signal) {
+            ZX_ASSERT(status == ZX_OK);
+            ZX_ASSERT(wait->Begin(dispatcher) == ZX_OK);
+        });
+        ZX_ASSERT(waits[i].Begin(loop.dispatcher()) == ZX_OK);
+    }
+
+    while (state->KeepRunning()) {
+        for (uint32_t i = 0; i < sources; ++i) {
+            ZX_ASSERT(loop.Run(zx::time::infinite(), true) == ZX_OK);
+        }
+    }
+
+    loop.Shutdown();
+    return true;
+}
+
+void RegisterTests() {
+    static const uint32_t kSources[] = {1, 16, 64};
+    for (uint32_t sources : kSources) {
+        static_assert(kMaxPackets >= 64, "");
+        auto name = fbl::StringPrintf("Port/Wait/%usources", sources);
+        perftest::RegisterTest(name.c_str(), PortWaitTest, sources);
+        name = fbl::StringPrintf("Port/WaitMany/%usources", sources);
+        perftest::RegisterTest(name.c_str(), PortWaitManyTest, sources);
+        name = fbl::StringPrintf("AsyncLoop/Wait/%usources", sources);
+        perftest::RegisterTest(name.c_str(), AsyncLoopWaitTest, sources);
+    }
+}
+PERFTEST_CTOR(RegisterTests);
+
+} // namespace
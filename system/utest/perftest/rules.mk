@@ -10,17 +10,22 @@ MODULE_TYPE := usertest
 
 MODULE_SRCS += \
     $(LOCAL_DIR)/clock-test.cpp \
+    $(LOCAL_DIR)/ethernet-test.cpp \
     $(LOCAL_DIR)/handle-creation-test.cpp \
+    $(LOCAL_DIR)/handle-lookup-test.cpp \
     $(LOCAL_DIR)/malloc-test.cpp \
     $(LOCAL_DIR)/memcpy-test.cpp \
+    $(LOCAL_DIR)/merkle-tree-test.cpp \
     $(LOCAL_DIR)/mutex-test.cpp \
     $(LOCAL_DIR)/null-test.cpp \
+    $(LOCAL_DIR)/port-test.cpp \
     $(LOCAL_DIR)/process-test.cpp \
     $(LOCAL_DIR)/results-test.cpp \
     $(LOCAL_DIR)/runner-test.cpp \
     $(LOCAL_DIR)/sleep-test.cpp \
     $(LOCAL_DIR)/syscalls-test.cpp \
     $(LOCAL_DIR)/timer-test.cpp \
+    $(LOCAL_DIR)/zxcrypt-test.cpp \
 
 MODULE_NAME := perf-test
 
@@ -29,20 +34,33 @@ MODULE_STATIC_LIBS := \
     system/ulib/async-loop \
     system/ulib/async-loop.cpp \
     system/ulib/async.cpp \
+    system/ulib/block-client \
+    system/ulib/digest \
     system/ulib/fbl \
+    system/ulib/fzl \
     system/ulib/perftest \
+    system/ulib/sync \
     system/ulib/trace \
     system/ulib/trace-provider \
     system/ulib/zx \
     system/ulib/zxcpp \
+    third_party/ulib/uboringssl \
 
 MODULE_LIBS := \
     system/ulib/async.default \
     system/ulib/c \
+    system/ulib/crypto \
     system/ulib/fdio \
+    system/ulib/fs-management \
     system/ulib/launchpad \
     system/ulib/trace-engine \
     system/ulib/unittest \
     system/ulib/zircon \
+    system/ulib/zxcrypt \
+
+MODULE_FIDL_LIBS := system/fidl/fuchsia-hardware-ethernet
+
+MODULE_BANJO_LIBS := \
+    system/banjo/ddk-protocol-ethernet \
 
 include make/module.mk
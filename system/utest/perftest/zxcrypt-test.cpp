@@ -0,0 +1,142 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <block-client/client.h>
+#include <crypto/secret.h>
+#include <fbl/string_printf.h>
+#include <fbl/unique_fd.h>
+#include <fbl/unique_ptr.h>
+#include <fs-management/ramdisk.h>
+#include <lib/zx/time.h>
+#include <lib/zx/vmo.h>
+#include <perftest/perftest.h>
+#include <zircon/assert.h>
+#include <zircon/device/block.h>
+#include <zxcrypt/volume.h>
+
+namespace {
+
+constexpr uint32_t kBlockSize = 4096;
+constexpr size_t kDeviceSize = 64 << 20;
+// Amount of data read or written in each run; this matches the zxcrypt write buffer.
+constexpr size_t kBytesPerRun = 16 << 20;
+constexpr zx::duration kTimeout = zx::sec(3);
+
+// A ramdisk, or a zxcrypt volume on a ramdisk, which is read and written through the block FIFO.
+class TestDevice {
+public:
+    explicit TestDevice(bool zxcrypt) {
+        ZX_ASSERT(create_ramdisk(kBlockSize, kDeviceSize / kBlockSize, ramdisk_path_) == ZX_OK);
+        fd_.reset(open(ramdisk_path_, O_RDWR));
+        ZX_ASSERT(fd_);
+
+        if (zxcrypt) {
+            // The zxcrypt driver currently only unlocks volumes with a null key; see ZX-1130.
+            crypto::Secret key;
+            uint8_t* buf;
+            ZX_ASSERT(key.Allocate(zxcrypt::kZx1130KeyLen, &buf) == ZX_OK);
+            memset(buf, 0, key.len());
+            ZX_ASSERT(zxcrypt::Volume::Create(fbl::unique_fd(dup(fd_.get())), key) == ZX_OK);
+            ZX_ASSERT(zxcrypt::Volume::Unlock(fbl::unique_fd(dup(fd_.get())), key, 0, &volume_) ==
+                      ZX_OK);
+            ZX_ASSERT(volume_->Open(kTimeout, &fd_) == ZX_OK);
+        }
+
+        zx_handle_t fifo;
+        ZX_ASSERT(ioctl_block_get_fifos(fd_.get(), &fifo) >= 0);
+        ZX_ASSERT(block_fifo_create_client(fifo, &client_) == ZX_OK);
+
+        // Fill the buffer so that data written is not trivially compressible.
+        ZX_ASSERT(zx::vmo::create(kBytesPerRun, 0, &vmo_) == ZX_OK);
+        fbl::unique_ptr<uint8_t[]> data(new uint8_t[kBytesPerRun]);
+        for (size_t i = 0; i < kBytesPerRun; ++i) {
+            data[i] = static_cast<uint8_t>(rand());
+        }
+        ZX_ASSERT(vmo_.write(data.get(), 0, kBytesPerRun) == ZX_OK);
+        zx::vmo dup;
+        ZX_ASSERT(vmo_.duplicate(ZX_RIGHT_SAME_RIGHTS, &dup) == ZX_OK);
+        zx_handle_t handle = dup.release();
+        ZX_ASSERT(ioctl_block_attach_vmo(fd_.get(), &handle, &vmoid_) >= 0);
+    }
+
+    ~TestDevice() {
+        block_fifo_release_client(client_);
+        fd_.reset();
+        volume_.reset();
+        destroy_ramdisk(ramdisk_path_);
+    }
+
+    // Reads or writes |kBytesPerRun| bytes in requests of |request_size| bytes, all sent in a
+    // single FIFO transaction so that the device may work on them concurrently.
+    void Transfer(uint32_t opcode, size_t request_size) {
+        size_t num_requests = kBytesPerRun / request_size;
+        uint32_t length = static_cast<uint32_t>(request_size / kBlockSize);
+        fbl::unique_ptr<block_fifo_request_t[]> requests(new block_fifo_request_t[num_requests]);
+        for (size_t i = 0; i < num_requests; ++i) {
+            requests[i].opcode = opcode;
+            requests[i].reqid = 0;
+            requests[i].group = 0;
+            requests[i].vmoid = vmoid_;
+            requests[i].length = length;
+            requests[i].vmo_offset = i * length;
+            requests[i].dev_offset = i * length;
+        }
+        ZX_ASSERT(block_fifo_txn(client_, requests.get(), num_requests) == ZX_OK);
+    }
+
+private:
+    char ramdisk_path_[PATH_MAX];
+    fbl::unique_fd fd_;
+    fbl::unique_ptr<zxcrypt::Volume> volume_;
+    fifo_client_t* client_ = nullptr;
+    zx::vmo vmo_;
+    vmoid_t vmoid_;
+};
+
+// Test throughput of reading or writing through a ramdisk, with or without a zxcrypt volume on
+// top, in requests of |request_size| bytes.
+bool BlockDeviceTest(perftest::RepeatState* state, bool zxcrypt, uint32_t opcode,
+                     size_t request_size) {
+    state->SetBytesProcessedPerRun(kBytesPerRun);
+
+    TestDevice device(zxcrypt);
+    if (opcode == BLOCKIO_READ) {
+        device.Transfer(BLOCKIO_WRITE, request_size);
+    }
+    while (state->KeepRunning()) {
+        device.Transfer(opcode, request_size);
+    }
+    return true;
+}
+
+void RegisterTests() {
+    static const size_t kRequestSizes[] = {
+        64 << 10,
+        1 << 20,
+    };
+    static const bool kZxcrypt[] = {
+        false,
+        true,
+    };
+    for (auto zxcrypt : kZxcrypt) {
+        const char* device = zxcrypt ? "zxcrypt" : "ramdisk";
+        for (auto request_size : kRequestSizes) {
+            auto name = fbl::StringPrintf("BlockDevice/%s/Write/%zubytes", device, request_size);
+            perftest::RegisterTest(name.c_str(), BlockDeviceTest, zxcrypt,
+                                   static_cast<uint32_t>(BLOCKIO_WRITE), request_size);
+            name = fbl::StringPrintf("BlockDevice/%s/Read/%zubytes", device, request_size);
+            perftest::RegisterTest(name.c_str(), BlockDeviceTest, zxcrypt,
+                                   static_cast<uint32_t>(BLOCKIO_READ), request_size);
+        }
+    }
+}
+PERFTEST_CTOR(RegisterTests);
+
+}  // namespace
@@ -1768,6 +1768,107 @@ bool vmo_unmap_coherency() {
     END_TEST;
 }
 
+bool vmo_fault_around_test() {
+    BEGIN_TEST;
+
+    const size_t kPages = 64;
+    const size_t len = kPages * PAGE_SIZE;
+
+    // allocate and commit a vmo, so every page is already present when faulted
+    zx_handle_t vmo;
+    ASSERT_EQ(ZX_OK, zx_vmo_create(len, 0, &vmo));
+    ASSERT_EQ(ZX_OK, zx_vmo_op_range(vmo, ZX_VMO_OP_COMMIT, 0, len, nullptr, 0));
+
+    // map it into its own vmar so its counters are not shared with anything else
+    zx_handle_t vmar;
+    uintptr_t vmar_addr;
+    ASSERT_EQ(ZX_OK, zx_vmar_allocate(zx_vmar_root_self(), ZX_VM_CAN_MAP_READ,
+                                      0, len, &vmar, &vmar_addr));
+    uintptr_t ptr;
+    ASSERT_EQ(ZX_OK, zx_vmar_map(vmar, ZX_VM_PERM_READ, 0, vmo, 0, len, &ptr));
+
+    zx_info_vmar_fault_stats_t stats;
+    ASSERT_EQ(ZX_OK, zx_object_get_info(vmar, ZX_INFO_VMAR_FAULT_STATS, &stats,
+                                        sizeof(stats), nullptr, nullptr));
+    EXPECT_EQ(0u, stats.page_faults);
+    EXPECT_EQ(0u, stats.fault_around_pages);
+
+    // read through the mapping sequentially
+    for (size_t off = 0; off < len; off += PAGE_SIZE) {
+        EXPECT_EQ(0u, *reinterpret_cast<volatile uint32_t*>(ptr + off));
+    }
+
+    ASSERT_EQ(ZX_OK, zx_object_get_info(vmar, ZX_INFO_VMAR_FAULT_STATS, &stats,
+                                        sizeof(stats), nullptr, nullptr));
+    unittest_printf("%zu pages read with %" PRIu64 " faults, %" PRIu64 " pages faulted around\n",
+                    kPages, stats.page_faults, stats.fault_around_pages);
+
+    // every page was either faulted in or mapped around a fault, and fault-around
+    // (unless disabled on the kernel command line) saved us some faults
+    EXPECT_EQ(kPages, stats.page_faults + stats.fault_around_pages);
+    if (stats.fault_around_pages > 0) {
+        EXPECT_LT(stats.page_faults, kPages);
+    }
+
+    // reading again must not fault
+    for (size_t off = 0; off < len; off += PAGE_SIZE) {
+        EXPECT_EQ(0u, *reinterpret_cast<volatile uint32_t*>(ptr + off));
+    }
+    zx_info_vmar_fault_stats_t stats2;
+    ASSERT_EQ(ZX_OK, zx_object_get_info(vmar, ZX_INFO_VMAR_FAULT_STATS, &stats2,
+                                        sizeof(stats2), nullptr, nullptr));
+    EXPECT_EQ(stats.page_faults, stats2.page_faults);
+    EXPECT_EQ(stats.fault_around_pages, stats2.fault_around_pages);
+
+    EXPECT_EQ(ZX_OK, zx_vmar_destroy(vmar));
+    EXPECT_EQ(ZX_OK, zx_handle_close(vmar));
+    EXPECT_EQ(ZX_OK, zx_handle_close(vmo));
+
+    END_TEST;
+}
+
+bool vmo_large_pages_info_test() {
+    BEGIN_TEST;
+
+    const size_t kLargePageSize = 2 * 1024 * 1024;
+
+    zx_handle_t vmo;
+    ASSERT_EQ(ZX_OK, zx_vmo_create(PAGE_SIZE, 0, &vmo));
+
+    // too small for a large page, whether or not any are free
+    zx_info_vmo_large_pages_t info;
+    ASSERT_EQ(ZX_OK, zx_object_get_info(vmo, ZX_INFO_VMO_LARGE_PAGES, &info,
+                                        sizeof(info), nullptr, nullptr));
+    EXPECT_EQ(kLargePageSize, info.large_page_size);
+    EXPECT_EQ(0u, info.committed_large_pages);
+
+    // a committed large page is counted once, and still counts as committed
+    // bytes of the vmo
+    zx_handle_t large_vmo;
+    ASSERT_EQ(ZX_OK, zx_vmo_create(kLargePageSize, 0, &large_vmo));
+    ASSERT_EQ(ZX_OK, zx_vmo_op_range(large_vmo, ZX_VMO_OP_COMMIT, 0, kLargePageSize,
+                                     nullptr, 0));
+    ASSERT_EQ(ZX_OK, zx_object_get_info(large_vmo, ZX_INFO_VMO_LARGE_PAGES, &info,
+                                        sizeof(info), nullptr, nullptr));
+    EXPECT_LE(info.committed_large_pages, 1u);
+    zx_info_vmo_t vmo_info;
+    ASSERT_EQ(ZX_OK, zx_object_get_info(large_vmo, ZX_INFO_VMO, &vmo_info,
+                                        sizeof(vmo_info), nullptr, nullptr));
+    EXPECT_EQ(kLargePageSize, vmo_info.committed_bytes);
+
+    // requires ZX_RIGHT_INSPECT
+    zx_handle_t no_inspect;
+    ASSERT_EQ(ZX_OK, zx_handle_duplicate(vmo, ZX_RIGHT_READ, &no_inspect));
+    EXPECT_EQ(ZX_ERR_ACCESS_DENIED, zx_object_get_info(no_inspect, ZX_INFO_VMO_LARGE_PAGES,
+                                                       &info, sizeof(info), nullptr, nullptr));
+
+    EXPECT_EQ(ZX_OK, zx_handle_close(no_inspect));
+    EXPECT_EQ(ZX_OK, zx_handle_close(large_vmo));
+    EXPECT_EQ(ZX_OK, zx_handle_close(vmo));
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(vmo_tests)
 RUN_TEST(vmo_create_test);
 RUN_TEST(vmo_read_write_test);
@@ -1801,6 +1902,8 @@ RUN_TEST(vmo_resize_hazard);
 RUN_TEST(vmo_clone_resize_clone_hazard);
 RUN_TEST(vmo_clone_resize_parent_ok);
 RUN_TEST(vmo_info_test);
+RUN_TEST(vmo_fault_around_test);
+RUN_TEST(vmo_large_pages_info_test);
 RUN_TEST_LARGE(vmo_unmap_coherency);
 END_TEST_CASE(vmo_tests)
 
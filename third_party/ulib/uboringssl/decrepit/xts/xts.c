@@ -54,11 +54,32 @@
 #include <openssl/cipher.h>
 
 #include "../crypto/fipsmodule/modes/internal.h"
+#include "../crypto/fipsmodule/aes/internal.h"
 
 
+// Fuchsia: aesni-x86_64.S also carries OpenSSL's XTS routines, which process
+// a whole data unit per call and keep six AES-NI blocks in flight at a time.
+// They are used whenever AES-NI is available.
+#if defined(HWAES_ECB)
+#define HWAES_XTS
+void aes_hw_xts_encrypt(const uint8_t *in, uint8_t *out, size_t length,
+                        const AES_KEY *key1, const AES_KEY *key2,
+                        const uint8_t iv[16]);
+void aes_hw_xts_decrypt(const uint8_t *in, uint8_t *out, size_t length,
+                        const AES_KEY *key1, const AES_KEY *key2,
+                        const uint8_t iv[16]);
+#endif
+
+typedef void (*xts128_f)(const uint8_t *in, uint8_t *out, size_t length,
+                         const AES_KEY *key1, const AES_KEY *key2,
+                         const uint8_t iv[16]);
+
 typedef struct xts128_context {
   AES_KEY *key1, *key2;
   block128_f block1, block2;
+  // If set, transforms a whole data unit in one call instead of one block at
+  // a time through |block1| and |block2|.
+  xts128_f stream;
 } XTS128_CONTEXT;
 
 static size_t CRYPTO_xts128_encrypt(const XTS128_CONTEXT *ctx,
@@ -196,6 +217,15 @@ static int aes_xts_init_key(EVP_CIPHER_CTX *ctx, const uint8_t *key,
                         ctx->key_len * 4, &xctx->ks2.ks);
     xctx->xts.block2 = AES_encrypt;
     xctx->xts.key1 = &xctx->ks1.ks;
+
+    // |AES_set_*_key| produce hardware key schedules when |hwaes_capable|,
+    // which the stream functions require.
+    xctx->xts.stream = NULL;
+#if defined(HWAES_XTS)
+    if (hwaes_capable()) {
+      xctx->xts.stream = enc ? aes_hw_xts_encrypt : aes_hw_xts_decrypt;
+    }
+#endif
   }
 
   if (iv) {
@@ -213,8 +243,14 @@ static int aes_xts_cipher(EVP_CIPHER_CTX *ctx, uint8_t *out,
       !xctx->xts.key2 ||
       !out ||
       !in ||
-      len < AES_BLOCK_SIZE ||
-      !CRYPTO_xts128_encrypt(&xctx->xts, ctx->iv, in, out, len, ctx->encrypt)) {
+      len < AES_BLOCK_SIZE) {
+    return 0;
+  }
+  if (xctx->xts.stream) {
+    (*xctx->xts.stream)(in, out, len, xctx->xts.key1, xctx->xts.key2, ctx->iv);
+    return 1;
+  }
+  if (!CRYPTO_xts128_encrypt(&xctx->xts, ctx->iv, in, out, len, ctx->encrypt)) {
     return 0;
   }
   return 1;